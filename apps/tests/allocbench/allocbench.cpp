@@ -0,0 +1,218 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* Times small object allocation from several threads with the thread
+ * caching fixed size allocator, the mutex protected one and cs_malloc. */
+
+#include "cssysdef.h"
+#include "csgeom/math.h"
+#include "csutil/fixedsizeallocator.h"
+#include "csutil/platform.h"
+#include "csutil/refarr.h"
+#include "csutil/sysfunc.h"
+#include "csutil/threadcachedallocator.h"
+#include "csutil/threading/thread.h"
+
+CS_IMPLEMENT_APPLICATION
+
+/// Size of the allocated objects
+static const size_t objectSize = 64;
+/// Number of objects each thread keeps alive
+static const size_t windowSize = 1024;
+
+struct MallocPolicy
+{
+  void* Alloc () { return cs_malloc (objectSize); }
+  void Free (void* p) { cs_free (p); }
+  void FlushThreadCache () {}
+};
+
+struct SafePolicy
+{
+  CS::Memory::FixedSizeAllocatorSafe<objectSize> alloc;
+
+  SafePolicy () : alloc (1024) {}
+  void* Alloc () { return alloc.Alloc (); }
+  void Free (void* p) { alloc.Free (p); }
+  void FlushThreadCache () {}
+};
+
+struct ThreadCachedPolicy
+{
+  CS::Memory::FixedSizeAllocatorThreadCached<objectSize> alloc;
+
+  ThreadCachedPolicy () : alloc (1024) {}
+  void* Alloc () { return alloc.Alloc (); }
+  void Free (void* p) { alloc.Free (p); }
+  void FlushThreadCache () { alloc.FlushThreadCache (); }
+};
+
+/**
+ * Keeps a window of live objects and replaces pseudo-randomly chosen ones.
+ * Every thread also frees objects allocated by its neighbour, as happens
+ * when one thread produces objects that another consumes.
+ */
+template<typename Policy>
+class Churn : public CS::Threading::Runnable
+{
+  Policy& policy;
+  size_t ops;
+  uint32 seed;
+public:
+  void** window;
+  void** handOver;
+
+  Churn (Policy& policy, size_t ops, uint32 seed) : policy (policy),
+    ops (ops), seed (seed)
+  {
+    window = new void*[windowSize];
+    handOver = new void*[windowSize];
+  }
+  ~Churn ()
+  {
+    delete[] window;
+    delete[] handOver;
+  }
+
+  void Run ()
+  {
+    for (size_t i = 0; i < windowSize; i++)
+      window[i] = policy.Alloc ();
+    for (size_t n = 0; n < ops; n++)
+    {
+      seed = seed * 1664525 + 1013904223;
+      size_t const i = (seed >> 8) % windowSize;
+      policy.Free (window[i]);
+      window[i] = policy.Alloc ();
+      // Touch the object, as a real user would
+      *(size_t*)window[i] = n;
+    }
+    // The window is freed by the next thread, a fresh one is handed over
+    for (size_t i = 0; i < windowSize; i++)
+      handOver[i] = policy.Alloc ();
+  }
+
+  void FreeForeign (Churn* other)
+  {
+    for (size_t i = 0; i < windowSize; i++)
+      policy.Free (other->window[i]);
+    for (size_t i = 0; i < windowSize; i++)
+      policy.Free (handOver[i]);
+    policy.FlushThreadCache ();
+  }
+};
+
+template<typename Policy>
+class FreeForeignRunnable : public CS::Threading::Runnable
+{
+  Churn<Policy>* self;
+  Churn<Policy>* other;
+public:
+  FreeForeignRunnable (Churn<Policy>* self, Churn<Policy>* other) :
+    self (self), other (other) {}
+  void Run () { self->FreeForeign (other); }
+};
+
+/// Returns the time taken in milliseconds
+template<typename Policy>
+static double RunBench (int numThreads, size_t ops)
+{
+  Policy policy;
+  csRefArray<Churn<Policy> > churns;
+  csRefArray<CS::Threading::Thread> threads;
+  for (int t = 0; t < numThreads; t++)
+  {
+    csRef<Churn<Policy> > churn;
+    churn.AttachNew (new Churn<Policy> (policy, ops, 12345 + t));
+    churns.Push (churn);
+  }
+
+  const int64 start = csGetMicroTicks ();
+  for (int t = 0; t < numThreads; t++)
+  {
+    csRef<CS::Threading::Thread> thread;
+    thread.AttachNew (new CS::Threading::Thread (churns[t], true));
+    threads.Push (thread);
+  }
+  for (int t = 0; t < numThreads; t++)
+    threads[t]->Wait ();
+  threads.Empty ();
+  for (int t = 0; t < numThreads; t++)
+  {
+    csRef<FreeForeignRunnable<Policy> > freeForeign;
+    freeForeign.AttachNew (new FreeForeignRunnable<Policy> (churns[t],
+      churns[(t + 1) % numThreads]));
+    csRef<CS::Threading::Thread> thread;
+    thread.AttachNew (new CS::Threading::Thread (freeForeign, true));
+    threads.Push (thread);
+  }
+  for (int t = 0; t < numThreads; t++)
+    threads[t]->Wait ();
+  return double (csGetMicroTicks () - start) / 1000.0;
+}
+
+static void PrintHelp ()
+{
+  csPrintf ("Usage: allocbench [-threads=<n>] [-ops=<n>] [-runs=<n>]\n");
+  csPrintf ("Times fixed size allocation from several threads.\n");
+  csPrintf ("  -threads=<n>  Number of threads (default: processor count)\n");
+  csPrintf ("  -ops=<n>      Free/allocate pairs per thread (default 1000000)\n");
+  csPrintf ("  -runs=<n>     Number of runs to average (default 3)\n");
+}
+
+int main (int argc, char* argv[])
+{
+  int numThreads = csMax ((int)CS::Platform::GetProcessorCount (), 1);
+  size_t ops = 1000000;
+  int runs = 3;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp (argv[i], "-threads=", 9) == 0)
+      numThreads = csMax (atoi (argv[i] + 9), 1);
+    else if (strncmp (argv[i], "-ops=", 5) == 0)
+      ops = csMax (atoi (argv[i] + 5), 1);
+    else if (strncmp (argv[i], "-runs=", 6) == 0)
+      runs = csMax (atoi (argv[i] + 6), 1);
+    else
+    {
+      PrintHelp ();
+      return (strcmp (argv[i], "-help") == 0) ? 0 : -1;
+    }
+  }
+
+  csPrintf ("Allocating %zu byte objects, %d threads, %zu ops per thread\n",
+    objectSize, numThreads, ops);
+  int threads = 1;
+  while (true)
+  {
+    double tMalloc = 0, tSafe = 0, tCached = 0;
+    for (int r = 0; r < runs; r++)
+    {
+      tMalloc += RunBench<MallocPolicy> (threads, ops);
+      tSafe += RunBench<SafePolicy> (threads, ops);
+      tCached += RunBench<ThreadCachedPolicy> (threads, ops);
+    }
+    csPrintf ("%2d thread(s), ms (average of %d runs)\n", threads, runs);
+    csPrintf ("  cs_malloc:                      %8.1f\n", tMalloc / runs);
+    csPrintf ("  FixedSizeAllocatorSafe:         %8.1f\n", tSafe / runs);
+    csPrintf ("  FixedSizeAllocatorThreadCached: %8.1f\n", tCached / runs);
+    if (threads == numThreads) break;
+    threads = csMin (threads * 2, numThreads);
+  }
+  return 0;
+}
@@ -0,0 +1,264 @@
+/*
+  Copyright (C) 2010 by the Crystal Space team
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* Times the csgfx image operations and the DDS decoder with each pixel
+ * kernel implementation (see CS::Graphics::PixelOps). */
+
+#include "cssysdef.h"
+#include "cstool/initapp.h"
+#include "csgfx/imagemanipulate.h"
+#include "csgfx/imagememory.h"
+#include "csgfx/pixelops.h"
+#include "csgeom/math.h"
+#include "csutil/cmdhelp.h"
+#include "csutil/csstring.h"
+#include "csutil/dirtyaccessarray.h"
+#include "igraphic/imageio.h"
+#include "iutil/cmdline.h"
+
+using CS::Graphics::PixelOps;
+
+CS_IMPLEMENT_APPLICATION
+
+enum
+{
+  NUM_IMPLEMENTATIONS = PixelOps::implSSE2 + 1,
+  // Minimum time spent on each operation, in microseconds
+  MIN_BENCH_TIME = 250000
+};
+
+static csRef<iImageIO> imageIO;
+static csRef<csImageMemory> image;
+static csDirtyAccessArray<uint8> alphaBuffer;
+static csRef<iDataBuffer> ddsData[3];
+
+static void BenchRescale ()
+{
+  csImageManipulate::Rescale (image, image->GetWidth () * 3 / 2,
+    image->GetHeight () * 3 / 2);
+}
+
+static void BenchMipmap ()
+{
+  csImageManipulate::Mipmap (image, 1);
+}
+
+static void BenchBlur ()
+{
+  csImageManipulate::Blur (image);
+}
+
+static void BenchTransformColor ()
+{
+  csImageManipulate::TransformColor (image,
+    csColor4 (0.5f, 0.75f, 1.25f, 1.0f), csColor4 (16, 0, -8, 0));
+}
+
+static void BenchGray ()
+{
+  csImageManipulate::Gray (image);
+}
+
+static void BenchSharpen ()
+{
+  csImageManipulate::Sharpen (image, 128);
+}
+
+static void BenchClear ()
+{
+  image->Clear (csRGBpixel (64, 128, 192, 255));
+}
+
+static void BenchIsOpaque ()
+{
+  PixelOps::IsOpaque ((csRGBpixel*)image->GetImagePtr (),
+    image->GetWidth () * image->GetHeight ());
+}
+
+static void BenchExtractAlpha ()
+{
+  PixelOps::ExtractAlpha ((csRGBpixel*)image->GetImagePtr (),
+    alphaBuffer.GetArray (), alphaBuffer.GetSize ());
+}
+
+static void DecodeDDS (iDataBuffer* data)
+{
+  csRef<iImage> decoded (imageIO->Load (data,
+    CS_IMGFMT_TRUECOLOR | CS_IMGFMT_ALPHA));
+  // DDS images are decoded on the first data access
+  if (decoded.IsValid ()) decoded->GetImageData ();
+}
+
+static void BenchDecodeDXT1 () { DecodeDDS (ddsData[0]); }
+static void BenchDecodeDXT3 () { DecodeDDS (ddsData[1]); }
+static void BenchDecodeDXT5 () { DecodeDDS (ddsData[2]); }
+
+typedef void (*BenchFunc) ();
+
+/// Returns processed megapixels per second
+static double RunBenchmark (BenchFunc func)
+{
+  const double megaPixels =
+    double (image->GetWidth ()) * image->GetHeight () / 1000000.0;
+  // Warm up caches and lazy initializations
+  func ();
+  int runs = 0;
+  const int64 start = csGetMicroTicks ();
+  int64 elapsed;
+  do
+  {
+    func ();
+    runs++;
+    elapsed = csGetMicroTicks () - start;
+  }
+  while (elapsed < MIN_BENCH_TIME);
+  return megaPixels * runs * 1000000.0 / double (elapsed);
+}
+
+static void CreateTestImage (int size)
+{
+  image.AttachNew (new csImageMemory (size, size,
+    CS_IMGFMT_TRUECOLOR | CS_IMGFMT_ALPHA));
+  csRGBpixel* pixels = (csRGBpixel*)image->GetImagePtr ();
+  // Gradients with some noise, fully opaque so IsOpaque() has to scan all
+  uint32 seed = 12341;
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      seed = seed * 1103515245 + 12345;
+      const int noise = (seed >> 16) & 0x1f;
+      pixels->Set ((x * 255 / size + noise) & 0xff,
+        (y * 255 / size + noise) & 0xff, ((x ^ y) + noise) & 0xff, 255);
+      pixels++;
+    }
+  }
+  alphaBuffer.SetSize (size * size);
+}
+
+static void PrintHelp ()
+{
+  csPrintf ("Usage: imgbench [-size=<n>]\n");
+  csPrintf ("Times image operations with each pixel kernel "
+    "implementation.\n");
+  csPrintf ("  -size=<n>  Width and height of the test image (default 1024)\n");
+}
+
+int main (int argc, char* argv[])
+{
+  iObjectRegistry* object_reg = csInitializer::CreateEnvironment (argc, argv);
+  if (!object_reg) return -1;
+
+  if (!csInitializer::SetupConfigManager (object_reg, 0)
+    || !csInitializer::RequestPlugins (object_reg,
+      CS_REQUEST_VFS,
+      CS_REQUEST_IMAGELOADER,
+      CS_REQUEST_END))
+  {
+    csPrintf ("Error initializing system\n");
+    csInitializer::DestroyApplication (object_reg);
+    return -1;
+  }
+
+  if (csCommandLineHelper::CheckHelp (object_reg))
+  {
+    PrintHelp ();
+    csInitializer::DestroyApplication (object_reg);
+    return 0;
+  }
+
+  int size = 1024;
+  csRef<iCommandLineParser> cmdline =
+    csQueryRegistry<iCommandLineParser> (object_reg);
+  const char* sizeStr = cmdline->GetOption ("size");
+  if (sizeStr) size = csMax (atoi (sizeStr), 4);
+  CreateTestImage (size);
+
+  // DDS test data; the decode benchmarks are skipped if it can't be saved
+  imageIO = csQueryRegistry<iImageIO> (object_reg);
+  static const char* const ddsFormats[3] = { "dxt1", "dxt3", "dxt5" };
+  for (int f = 0; f < 3; f++)
+  {
+    if (!imageIO) break;
+    csString options;
+    options.Format ("format=%s,quality=fast,nomipmaps", ddsFormats[f]);
+    ddsData[f] = imageIO->Save (image, "image/dds", options);
+  }
+
+  static const struct
+  {
+    const char* name;
+    BenchFunc func;
+    int ddsIndex;
+  } benchmarks[] =
+  {
+    { "Rescale", BenchRescale, -1 },
+    { "Mipmap", BenchMipmap, -1 },
+    { "Blur", BenchBlur, -1 },
+    { "TransformColor", BenchTransformColor, -1 },
+    { "Gray", BenchGray, -1 },
+    { "Sharpen", BenchSharpen, -1 },
+    { "Clear", BenchClear, -1 },
+    { "IsOpaque", BenchIsOpaque, -1 },
+    { "ExtractAlpha", BenchExtractAlpha, -1 },
+    { "DecodeDXT1", BenchDecodeDXT1, 0 },
+    { "DecodeDXT3", BenchDecodeDXT3, 1 },
+    { "DecodeDXT5", BenchDecodeDXT5, 2 }
+  };
+
+  const PixelOps::Implementation defaultImpl = PixelOps::GetImplementation ();
+  bool supported[NUM_IMPLEMENTATIONS];
+  csPrintf ("%dx%d pixels, MPixel/s\n%-16s", size, size, "operation");
+  for (int i = 0; i < NUM_IMPLEMENTATIONS; i++)
+  {
+    supported[i] = PixelOps::SetImplementation (PixelOps::Implementation (i));
+    csPrintf ("%10s", PixelOps::GetImplementationName (
+      PixelOps::Implementation (i)));
+  }
+  csPrintf ("%10s\n", "speedup");
+
+  for (size_t b = 0; b < sizeof (benchmarks) / sizeof (benchmarks[0]); b++)
+  {
+    const int ddsIndex = benchmarks[b].ddsIndex;
+    if ((ddsIndex >= 0) && !ddsData[ddsIndex].IsValid ()) continue;
+
+    csPrintf ("%-16s", benchmarks[b].name);
+    double first = 0, best = 0;
+    for (int i = 0; i < NUM_IMPLEMENTATIONS; i++)
+    {
+      if (!supported[i])
+      {
+        csPrintf ("%10s", "-");
+        continue;
+      }
+      PixelOps::SetImplementation (PixelOps::Implementation (i));
+      const double rate = RunBenchmark (benchmarks[b].func);
+      if (first == 0) first = rate;
+      best = csMax (best, rate);
+      csPrintf ("%10.1f", rate);
+    }
+    csPrintf ("%9.2fx\n", best / first);
+  }
+  PixelOps::SetImplementation (defaultImpl);
+
+  for (int f = 0; f < 3; f++) ddsData[f] = 0;
+  image = 0;
+  imageIO = 0;
+  csInitializer::DestroyApplication (object_reg);
+  return 0;
+}
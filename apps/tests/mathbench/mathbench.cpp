@@ -0,0 +1,253 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* Times the batched csgeom kernels (see CS::Geometry::BatchMath) with each
+ * implementation, compared to transforming and culling one object at a
+ * time. */
+
+#include "cssysdef.h"
+#include "csgeom/batchmath.h"
+#include "csgeom/math.h"
+#include "csgeom/math3d.h"
+#include "csgeom/transfrm.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/sysfunc.h"
+
+using namespace CS::Geometry;
+
+CS_IMPLEMENT_APPLICATION
+
+enum
+{
+  NUM_IMPLEMENTATIONS = BatchMath::implSSE + 1,
+  // Minimum time spent on each operation, in microseconds
+  MIN_BENCH_TIME = 250000
+};
+
+static csReversibleTransform transform;
+static BatchTransform batchTransform;
+static csPlane3 planes[6];
+static const uint32 planeMask = 0x3f;
+
+static csDirtyAccessArray<csVector3> points;
+static csDirtyAccessArray<csVector3> pointsOut;
+static csDirtyAccessArray<csBox3> boxes;
+static csDirtyAccessArray<csBox3> boxesOut;
+static csDirtyAccessArray<float> radii;
+static csDirtyAccessArray<bool> visible;
+static csDirtyAccessArray<uint32> clipMasks;
+
+static Vector3Stream pointStream;
+static Vector3Stream pointStreamOut;
+static Box3Stream boxStream;
+static Box3Stream boxStreamOut;
+
+static void SingleTransformPoints ()
+{
+  for (size_t i = 0; i < points.GetSize (); i++)
+    pointsOut[i] = transform.Other2This (points[i]);
+}
+
+static void SingleTransformBoxes ()
+{
+  for (size_t i = 0; i < boxes.GetSize (); i++)
+    boxesOut[i] = transform.Other2This (boxes[i]);
+}
+
+static void SingleClassifyBoxes ()
+{
+  for (size_t i = 0; i < boxes.GetSize (); i++)
+    visible[i] = csIntersect3::BoxFrustum (boxes[i], planes, planeMask,
+      clipMasks[i]);
+}
+
+static void SingleSpheresInFrustum ()
+{
+  for (size_t i = 0; i < points.GetSize (); i++)
+  {
+    uint32 outMask = 0;
+    bool vis = true;
+    for (int p = 0; p < 6; p++)
+    {
+      const float d = planes[p].Classify (points[i]);
+      if (d < -radii[i]) { vis = false; break; }
+      if (d < radii[i]) outMask |= 1 << p;
+    }
+    visible[i] = vis;
+    clipMasks[i] = vis ? outMask : 0;
+  }
+}
+
+static void BatchTransformPoints ()
+{
+  BatchMath::TransformPoints (batchTransform, pointStream, pointStreamOut);
+}
+
+static void BatchTransformBoxes ()
+{
+  BatchMath::TransformBoxes (batchTransform, boxStream, boxStreamOut);
+}
+
+static void BatchClassifyBoxes ()
+{
+  BatchMath::ClassifyBoxesAgainstPlanes (planes, planeMask, boxStream,
+    visible.GetArray (), clipMasks.GetArray ());
+}
+
+static void BatchSpheresInFrustum ()
+{
+  BatchMath::SpheresInFrustum (planes, planeMask, pointStream,
+    radii.GetArray (), visible.GetArray (), clipMasks.GetArray ());
+}
+
+typedef void (*BenchFunc) ();
+
+/// Returns processed million objects per second
+static double RunBenchmark (BenchFunc func)
+{
+  const double megaObjects = double (points.GetSize ()) / 1000000.0;
+  // Warm up caches and lazy initializations
+  func ();
+  int runs = 0;
+  const int64 start = csGetMicroTicks ();
+  int64 elapsed;
+  do
+  {
+    func ();
+    runs++;
+    elapsed = csGetMicroTicks () - start;
+  }
+  while (elapsed < MIN_BENCH_TIME);
+  return megaObjects * runs * 1000000.0 / double (elapsed);
+}
+
+static void CreateTestData (size_t count)
+{
+  uint32 seed = 12341;
+  float values[6];
+  points.SetSize (count);
+  pointsOut.SetSize (count);
+  boxes.SetSize (count);
+  boxesOut.SetSize (count);
+  radii.SetSize (count);
+  visible.SetSize (count);
+  clipMasks.SetSize (count);
+  for (size_t i = 0; i < count; i++)
+  {
+    for (int v = 0; v < 6; v++)
+    {
+      seed = seed * 1103515245 + 12345;
+      values[v] = float ((seed >> 8) & 0xffff) / 65535.0f;
+    }
+    // Objects scattered around the frustum, some inside, some outside
+    points[i].Set (values[0] * 200 - 100, values[1] * 200 - 100,
+      values[2] * 200 - 50);
+    const csVector3 extent (values[3] * 10, values[4] * 10, values[5] * 10);
+    boxes[i].Set (points[i] - extent, points[i] + extent);
+    radii[i] = values[3] * 10;
+  }
+  pointStream.Load (points.GetArray (), count);
+  boxStream.Load (boxes.GetArray (), count);
+
+  transform.SetO2T (csXRotMatrix3 (0.3f) * csYRotMatrix3 (0.7f));
+  transform.SetOrigin (csVector3 (3, -2, 5));
+  batchTransform = BatchTransform::Other2This (transform);
+
+  // A 90 degree view frustum looking down +z, with near and far planes
+  planes[0].Set (1, 0, 1, 0);
+  planes[1].Set (-1, 0, 1, 0);
+  planes[2].Set (0, 1, 1, 0);
+  planes[3].Set (0, -1, 1, 0);
+  planes[4].Set (0, 0, 1, -1);
+  planes[5].Set (0, 0, -1, 100);
+  for (int p = 0; p < 6; p++) planes[p].Normalize ();
+}
+
+static void PrintHelp ()
+{
+  csPrintf ("Usage: mathbench [-count=<n>]\n");
+  csPrintf ("Times batched transform and culling kernels with each "
+    "implementation.\n");
+  csPrintf ("  -count=<n>  Number of objects (default 4096)\n");
+}
+
+int main (int argc, char* argv[])
+{
+  size_t count = 4096;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp (argv[i], "-count=", 7) == 0)
+      count = csMax (atoi (argv[i] + 7), 1);
+    else
+    {
+      PrintHelp ();
+      return (strcmp (argv[i], "-help") == 0) ? 0 : -1;
+    }
+  }
+  CreateTestData (count);
+
+  static const struct
+  {
+    const char* name;
+    BenchFunc single;
+    BenchFunc batch;
+  } benchmarks[] =
+  {
+    { "TransformPoints", SingleTransformPoints, BatchTransformPoints },
+    { "TransformBoxes", SingleTransformBoxes, BatchTransformBoxes },
+    { "ClassifyBoxes", SingleClassifyBoxes, BatchClassifyBoxes },
+    { "SpheresInFrustum", SingleSpheresInFrustum, BatchSpheresInFrustum }
+  };
+
+  const BatchMath::Implementation defaultImpl =
+    BatchMath::GetImplementation ();
+  bool supported[NUM_IMPLEMENTATIONS];
+  csPrintf ("%zu objects, MObjects/s\n%-18s%10s", count, "operation",
+    "single");
+  for (int i = 0; i < NUM_IMPLEMENTATIONS; i++)
+  {
+    supported[i] = BatchMath::SetImplementation (
+      BatchMath::Implementation (i));
+    csPrintf ("%10s", BatchMath::GetImplementationName (
+      BatchMath::Implementation (i)));
+  }
+  csPrintf ("%10s\n", "speedup");
+
+  for (size_t b = 0; b < sizeof (benchmarks) / sizeof (benchmarks[0]); b++)
+  {
+    csPrintf ("%-18s", benchmarks[b].name);
+    const double single = RunBenchmark (benchmarks[b].single);
+    csPrintf ("%10.1f", single);
+    double best = 0;
+    for (int i = 0; i < NUM_IMPLEMENTATIONS; i++)
+    {
+      if (!supported[i])
+      {
+        csPrintf ("%10s", "-");
+        continue;
+      }
+      BatchMath::SetImplementation (BatchMath::Implementation (i));
+      const double rate = RunBenchmark (benchmarks[b].batch);
+      best = csMax (best, rate);
+      csPrintf ("%10.1f", rate);
+    }
+    csPrintf ("%9.2fx\n", best / single);
+  }
+  BatchMath::SetImplementation (defaultImpl);
+  return 0;
+}
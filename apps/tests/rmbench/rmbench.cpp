@@ -0,0 +1,215 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* Times the render manager on a scene with many small meshes, using the
+ * null renderer so that only the CPU side of rendering is measured. Also
+ * times pushing the shader variables of all meshes onto a stack. */
+
+#include "cssysdef.h"
+#include "csgeom/math.h"
+#include "csgfx/shadervar.h"
+#include "cstool/csview.h"
+#include "cstool/genmeshbuilder.h"
+#include "cstool/initapp.h"
+#include "csutil/cmdhelp.h"
+#include "csutil/refarr.h"
+#include "iengine/camera.h"
+#include "iengine/engine.h"
+#include "iengine/material.h"
+#include "iengine/mesh.h"
+#include "iengine/movable.h"
+#include "iengine/sector.h"
+#include "iutil/cmdline.h"
+#include "iutil/objreg.h"
+#include "ivaria/view.h"
+#include "ivideo/graph2d.h"
+#include "ivideo/graph3d.h"
+#include "ivideo/shader/shader.h"
+
+CS_IMPLEMENT_APPLICATION
+
+enum
+{
+  // Minimum time spent on each benchmark, in microseconds
+  MIN_BENCH_TIME = 2000000,
+  // Shader variables set on each mesh
+  MESH_SV_NUM = 4
+};
+
+static csRef<iEngine> engine;
+static csRef<iGraphics3D> g3d;
+static csRef<iView> view;
+static csRefArray<iMeshWrapper> meshes;
+static csShaderVariableStack svStack;
+
+static bool CreateScene (iObjectRegistry* object_reg, int numMeshes)
+{
+  csRef<iShaderVarStringSet> svStrings =
+    csQueryRegistryTagInterface<iShaderVarStringSet> (object_reg,
+      "crystalspace.shader.variablenameset");
+  if (!svStrings) return false;
+
+  iSector* sector = engine->CreateSector ("room");
+  iMaterialWrapper* material = engine->CreateMaterial ("white", 0);
+
+  using namespace CS::Geometry;
+  Box box (csVector3 (-0.05f), csVector3 (0.05f));
+  csRef<iMeshFactoryWrapper> fact = GeneralMeshBuilder::CreateFactory (
+    engine, "box", &box);
+  if (!fact) return false;
+
+  CS::ShaderVarStringID svNames[MESH_SV_NUM];
+  for (int s = 0; s < MESH_SV_NUM; s++)
+  {
+    csString name;
+    name.Format ("rmbench var %d", s);
+    svNames[s] = svStrings->Request (name);
+  }
+
+  // A square grid of meshes in front of the camera, all of them visible
+  const int side = int (ceilf (sqrtf (float (numMeshes))));
+  const float spacing = 0.25f;
+  const float dist = side * spacing;
+  for (int i = 0; i < numMeshes; i++)
+  {
+    const csVector3 pos ((i % side - side / 2) * spacing,
+      (i / side - side / 2) * spacing, dist);
+    csRef<iMeshWrapper> mesh = GeneralMeshBuilder::CreateMesh (engine,
+      sector, "box", fact);
+    mesh->GetMovable ()->SetPosition (pos);
+    mesh->GetMovable ()->UpdateMove ();
+    mesh->GetMeshObject ()->SetMaterialWrapper (material);
+
+    iShaderVariableContext* svc = mesh->GetSVContext ();
+    for (int s = 0; s < MESH_SV_NUM; s++)
+    {
+      svc->GetVariableAdd (svNames[s])->SetValue (
+        csVector4 (float (i), float (s), 0, 1));
+    }
+    meshes.Push (mesh);
+  }
+  engine->Prepare ();
+
+  iGraphics2D* g2d = g3d->GetDriver2D ();
+  view.AttachNew (new csView (engine, g3d));
+  view->GetCamera ()->SetSector (sector);
+  view->GetCamera ()->GetTransform ().SetOrigin (csVector3 (0));
+  view->SetRectangle (0, 0, g2d->GetWidth (), g2d->GetHeight ());
+
+  svStack.Setup (svStrings->GetSize ());
+  return true;
+}
+
+static void BenchFrame ()
+{
+  g3d->BeginDraw (engine->GetBeginDrawFlags () | CSDRAW_3DGRAPHICS);
+  view->Draw ();
+  g3d->FinishDraw ();
+}
+
+static void BenchPushVariables ()
+{
+  for (size_t m = 0; m < meshes.GetSize (); m++)
+    meshes[m]->GetSVContext ()->PushVariables (svStack);
+}
+
+typedef void (*BenchFunc) ();
+
+/// Returns milliseconds per run
+static double RunBenchmark (BenchFunc func)
+{
+  // Warm up caches and lazy initializations
+  func ();
+  int runs = 0;
+  const int64 start = csGetMicroTicks ();
+  int64 elapsed;
+  do
+  {
+    func ();
+    runs++;
+    elapsed = csGetMicroTicks () - start;
+  }
+  while (elapsed < MIN_BENCH_TIME);
+  return double (elapsed) / (1000.0 * runs);
+}
+
+static void PrintHelp ()
+{
+  csPrintf ("Usage: rmbench [-meshes=<n>]\n");
+  csPrintf ("Times the render manager with the null renderer.\n");
+  csPrintf ("  -meshes=<n>  Number of meshes in the scene (default 50000)\n");
+}
+
+int main (int argc, char* argv[])
+{
+  iObjectRegistry* object_reg = csInitializer::CreateEnvironment (argc, argv);
+  if (!object_reg) return -1;
+
+  if (!csInitializer::SetupConfigManager (object_reg, 0)
+    || !csInitializer::RequestPlugins (object_reg,
+      CS_REQUEST_VFS,
+      CS_REQUEST_PLUGIN ("crystalspace.graphics3d.null", iGraphics3D),
+      CS_REQUEST_ENGINE,
+      CS_REQUEST_END))
+  {
+    csPrintf ("Error initializing system\n");
+    csInitializer::DestroyApplication (object_reg);
+    return -1;
+  }
+
+  if (csCommandLineHelper::CheckHelp (object_reg))
+  {
+    PrintHelp ();
+    csInitializer::DestroyApplication (object_reg);
+    return 0;
+  }
+
+  int numMeshes = 50000;
+  csRef<iCommandLineParser> cmdline =
+    csQueryRegistry<iCommandLineParser> (object_reg);
+  const char* meshesStr = cmdline->GetOption ("meshes");
+  if (meshesStr) numMeshes = csMax (atoi (meshesStr), 1);
+
+  if (!csInitializer::OpenApplication (object_reg))
+  {
+    csPrintf ("Error opening system\n");
+    csInitializer::DestroyApplication (object_reg);
+    return -1;
+  }
+
+  engine = csQueryRegistry<iEngine> (object_reg);
+  g3d = csQueryRegistry<iGraphics3D> (object_reg);
+  if (!engine || !g3d || !CreateScene (object_reg, numMeshes))
+  {
+    csPrintf ("Error creating scene\n");
+    csInitializer::DestroyApplication (object_reg);
+    return -1;
+  }
+
+  csPrintf ("%d meshes, %d shader variables each\n", numMeshes, MESH_SV_NUM);
+  csPrintf ("%-16s%10.3f ms\n", "frame", RunBenchmark (BenchFrame));
+  csPrintf ("%-16s%10.3f ms\n", "PushVariables",
+    RunBenchmark (BenchPushVariables));
+
+  meshes.Empty ();
+  view = 0;
+  g3d = 0;
+  engine = 0;
+  csInitializer::DestroyApplication (object_reg);
+  return 0;
+}
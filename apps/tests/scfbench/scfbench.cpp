@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* Times scanning the plugin paths for SCF classes without the plugin
+ * metadata cache, with an empty cache and with an up to date cache. */
+
+#include "cssysdef.h"
+#include "csgeom/math.h"
+#include "csutil/csstring.h"
+#include "csutil/scf.h"
+#include "csutil/sysfunc.h"
+#include "csutil/syspath.h"
+
+CS_IMPLEMENT_APPLICATION
+
+static csPathsList* pluginPaths = 0;
+
+/// Returns the time taken in milliseconds
+static double ScanPlugins ()
+{
+  const int64 start = csGetMicroTicks ();
+  for (size_t i = 0; i < pluginPaths->Length (); i++)
+  {
+    const csPathsList::Entry& entry = (*pluginPaths)[i];
+    iSCF::SCF->ScanPluginsPath (entry.path, entry.scanRecursive, entry.type);
+  }
+  return double (csGetMicroTicks () - start) / 1000.0;
+}
+
+static void PrintHelp ()
+{
+  csPrintf ("Usage: scfbench [-runs=<n>]\n");
+  csPrintf ("Times scanning the plugin paths for SCF classes.\n");
+  csPrintf ("  -runs=<n>  Number of scans to average (default 5)\n");
+}
+
+int main (int argc, char* argv[])
+{
+  int runs = 5;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp (argv[i], "-runs=", 6) == 0)
+      runs = csMax (atoi (argv[i] + 6), 1);
+    else
+    {
+      PrintHelp ();
+      return (strcmp (argv[i], "-help") == 0) ? 0 : -1;
+    }
+  }
+
+  // Don't scan yet, that is what's timed
+  scfInitialize (argc, argv, false);
+  pluginPaths = csInstallationPathsHelper::GetPluginPaths (argv[0]);
+
+  csString defaultCache (scfGetPluginCache ());
+  csString benchCache (defaultCache);
+  if (benchCache.IsEmpty ())
+    benchCache = csGetPlatformConfigPath ("CrystalSpace.PluginCache", true);
+  benchCache << ".bench";
+
+  /* Register all classes first, so all timed scans do the same work:
+     examining modules or looking them up in the cache. */
+  scfSetPluginCache (0);
+  const double first = ScanPlugins ();
+
+  double uncached = 0, cold = 0, warm = 0;
+  for (int r = 0; r < runs; r++)
+  {
+    scfSetPluginCache (0);
+    uncached += ScanPlugins ();
+
+    scfSetPluginCache (benchCache);
+    remove (benchCache);
+    cold += ScanPlugins ();
+    warm += ScanPlugins ();
+  }
+  remove (benchCache);
+  scfSetPluginCache (defaultCache.IsEmpty () ? 0 : defaultCache.GetData ());
+
+  csPrintf ("Plugin scan times, ms (average of %d runs)\n", runs);
+  csPrintf ("  first scan, registering:  %8.1f\n", first);
+  csPrintf ("  no cache:                 %8.1f\n", uncached / runs);
+  csPrintf ("  cold cache:               %8.1f\n", cold / runs);
+  csPrintf ("  warm cache:               %8.1f\n", warm / runs);
+  if (warm > 0)
+    csPrintf ("  speedup warm/no cache:    %8.2fx\n", uncached / warm);
+
+  delete pluginPaths;
+  iSCF::SCF->Finish ();
+  return 0;
+}
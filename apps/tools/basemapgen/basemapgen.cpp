@@ -18,6 +18,7 @@
 
 #include "crystalspace.h"
 #include "basemapgen.h"
+#include "generator.h"
 
 CS_IMPLEMENT_APPLICATION
 
@@ -25,7 +26,7 @@ CS_IMPLEMENT_APPLICATION
 BaseMapGen *basemapgen;
 
 BaseMapGen::BaseMapGen (iObjectRegistry* object_reg)
- : terraformerRE (0), meshRE (0)
+ : terraformerRE (0), meshRE (0), generator (0)
 {
   BaseMapGen::object_reg = object_reg;
 }
@@ -34,6 +35,7 @@ BaseMapGen::~BaseMapGen ()
 {
   delete terraformerRE;
   delete meshRE;
+  delete generator;
 }
 
 bool BaseMapGen::Initialize ()
@@ -78,6 +80,12 @@ bool BaseMapGen::Initialize ()
   if (optTerraformer != 0)
     terraformerRE = new csRegExpMatcher (optTerraformer);
 
+  int numThreads = 0;
+  const char* optThreads = cmdline->GetOption ("threads", 0);
+  if (optThreads != 0)
+    numThreads = atoi (optThreads);
+  generator = new BasemapGenerator (numThreads);
+
   return true;
 }
 
@@ -100,6 +108,7 @@ void BaseMapGen::OnCommandLineHelp()
   csPrintf ("-terrainname=<regexp>     Regexp for the terrain mesh objects (default '.*')\n");
   csPrintf ("-terraformername=<regexp> Regexp for the terraformer          (default '.*')\n");
   csPrintf ("-resolution=<pixels>      The resolution for the basemap      (default basemap resolution)\n");
+  csPrintf ("-threads=<number>         Number of threads to generate with  (default number of CPUs)\n");
 }
 
 static csPtr<iImage> GenerateErrorTexture (int width, int height)
@@ -301,153 +310,6 @@ bool BaseMapGen::LoadMap ()
   return true;
 }
   
-/* Get mipmap for an image, using precomputed mipmaps as far as
-   possible. */
-static csRef<iImage> GetImageMip (iImage* img, uint mip)
-{
-  if (mip == 0) return img;
-  csRef<iImage> imgToMip (img);
-  uint hasMips = img->HasMipmaps();
-  if (mip <= hasMips) return img->GetMipmap (mip);
-  imgToMip = img->GetMipmap (hasMips);
-  mip -= hasMips;
-  if (mip == 0) return imgToMip;
-  return csImageManipulate::Mipmap (imgToMip, mip);
-}
-
-static csColor GetPixelWrap (iImage* img, int img_w, int img_h, 
-                             int x, int y)
-{
-  // Wrap around the texture coordinates.
-  x = x % img_w;
-  y = y % img_h;
-
-  // Get the pixel.
-  csRGBpixel* px = (csRGBpixel*)img->GetImageData() + x + (y * img_h);
-  return csColor (px->red, px->green, px->blue);
-}
-
-class LayerSampler
-{
-  int img_w, img_h;
-  csRef<iImage> img;
-  csVector2 textureScale;
-public:
-  LayerSampler (int basemap_w, int basemap_h, MaterialLayer* layer)
-   : textureScale (layer->texture_scale)
-  {
-    float layer_needed_x = float (basemap_w) / textureScale.x;
-    float layer_needed_y = float (basemap_h) / textureScale.y;
-    iImage* layerImage = layer->GetImage();
-    int mip_x = csFindNearestPowerOf2 (
-      int (ceil (layerImage->GetWidth() / layer_needed_x)));
-    int mip_y = csFindNearestPowerOf2 (
-      int (ceil (layerImage->GetHeight() / layer_needed_y)));
-    int mip = csMax (
-      csClamp (csLog2 (mip_x), csLog2 (layerImage->GetWidth()), 0),
-      csClamp (csLog2 (mip_y), csLog2 (layerImage->GetHeight()), 0));
-    img = GetImageMip (layerImage, mip);
-    img_w = img->GetWidth();
-    img_h = img->GetHeight();
-  }
-  
-  csColor GetPixel (float coord_x, float coord_y)
-  {
-    // Scale the texture coordinates.
-    coord_x *= textureScale.x;
-    coord_y *= textureScale.y;
-  
-    // Calculate the material coordinates.
-    float matcoord_x_f = (coord_x * img_w);
-    float matcoord_y_f = (coord_y * img_h);
-    int matcoord_x = int (matcoord_x_f);
-    int matcoord_y = int (matcoord_y_f);
-  
-    // Bilinearly filter from material.
-    csColor p00 (GetPixelWrap (img, img_w, img_h,
-      matcoord_x, matcoord_y));
-    csColor p01 (GetPixelWrap (img, img_w, img_h,
-      matcoord_x, matcoord_y+1));
-    csColor p11 (GetPixelWrap (img, img_w, img_h,
-      matcoord_x+1, matcoord_y+1));
-    csColor p10 (GetPixelWrap (img, img_w, img_h,
-      matcoord_x+1, matcoord_y));
-  
-    float f1 = matcoord_x_f - matcoord_x;
-    float f2 = matcoord_y_f - matcoord_y;
-  
-    return csLerp (csLerp (p00, p10, f1), 
-      csLerp (p01, p11, f1), f2);
-  }
-};
-
-csPtr<iImage> BaseMapGen::CreateBasemap (int basemap_w, int basemap_h, 
-                                         const AlphaLayers& alphaLayers,
-                                         MaterialLayers& txt_layers)
-{
-  csPrintf ("Creating base texturemap... \n\n"); fflush (stdout);
-  // Block: to measure time
-  {
-    CS::MeasureTime lTimeMeasurer ("Time taken");
-
-    csArray<LayerSampler> samplers;
-    /* Mipmap the materials to the highest mipmap needed below the required 
-     * resolution. This mipmap is then upsampled. */
-    for (unsigned int i = 0 ; i < txt_layers.GetSize() ; i++)
-    {
-      samplers.Push (LayerSampler (basemap_w, basemap_h, txt_layers[i]));
-    }
-
-    csRef<iImage> basemapImage;
-    basemapImage.AttachNew (new csImageMemory (basemap_w, basemap_h));
-    // Get image data.
-    csRGBpixel* bm_dst = (csRGBpixel*)(basemapImage->GetImageData());
-
-    float coord_x, coord_y;
-
-    float inv_basemap_w = 1.0f / basemap_w;
-    float inv_basemap_h = 1.0f / basemap_h;
-
-    for (int y = 0 ; y < basemap_h ; y++)
-    {
-      // Draw progress.
-      uint percent = uint ((y*100) * inv_basemap_h);
-      DrawProgress(percent);
-
-      for (int x = 0 ; x < basemap_w ; x++)
-      {
-        // Calculate the destination coordinates.
-        coord_x    = x * inv_basemap_w;
-        coord_y    = y * inv_basemap_h;
-
-        csColor col (0, 0, 0);
-        for (size_t l = 0; l < samplers.GetSize(); l++)
-        {
-          if (l >= alphaLayers.GetSize()) break;
-        
-          float a = alphaLayers.GetAlpha (l, coord_x, coord_y);
-          // Blend material colors.
-          col += samplers[l].GetPixel (coord_x, coord_y) * a;
-        }
-
-        csRGBpixel mat_dst (int (col.red), int (col.green), int (col.blue));
-
-        // Set the basemap pixel.
-        bm_dst->Set (mat_dst.red, mat_dst.green, mat_dst.blue);
-
-        // Increase the pointer.
-        bm_dst++;
-
-      } // for y
-    } // for x
-
-    csPrintf ("\n");
-  
-    return csPtr<iImage> (basemapImage);
-  } // Block to measure time
-
-}
-
 void BaseMapGen::SaveImage (iImage* image, const char* texname)
 {
   csPrintf ("Saving %zu KB of data.\n", 
@@ -507,6 +369,8 @@ void BaseMapGen::Start ()
   
   ScanTerrain2Factories();
   ScanTerrain2Meshes();
+
+  generator->Run();
 }
 
 /*---------------------------------------------------------------------*
@@ -21,6 +21,8 @@
 
 #include "layers.h"
 
+class BasemapGenerator;
+
 class BaseMapGen
 {
 private:
@@ -33,6 +35,7 @@ private:
   
   csRegExpMatcher* terraformerRE;
   csRegExpMatcher* meshRE;
+  BasemapGenerator* generator;
 
   // The worldfile
   csRef<iDocumentNode> rootnode;
@@ -80,15 +83,12 @@ public:
   csRef<iDocumentNode> GetMaterialNode (const char* materialname);
   csRefArray<iDocumentNode> GetMaterialNodes ();
   
-  csPtr<iImage> CreateBasemap (int basemap_w, int basemap_h, 
-                               const AlphaLayers& alphaLayers,
-                               MaterialLayers& txt_layers);
-  void SaveImage (iImage* image, const char* filename);
 public:
   BaseMapGen (iObjectRegistry* object_reg);
   ~BaseMapGen ();
 
   csRef<iImage> LoadImage (const csString& filename, int format);
+  void SaveImage (iImage* image, const char* filename);
   
   bool Initialize ();
   void Start ();
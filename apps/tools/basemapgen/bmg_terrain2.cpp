@@ -20,6 +20,7 @@
 #include "crystalspace.h"
 
 #include "basemapgen.h"
+#include "generator.h"
 
 // The global pointer to basemapgen
 extern BaseMapGen *basemapgen;
@@ -229,13 +230,11 @@ void BaseMapGen::ScanTerrain2Meshes ()
       
 	csPrintf ("Basemap resolution: %dx%d\n", basemap_w, basemap_h); fflush (stdout);
 	
-	csRef<iImage> basemap = CreateBasemap (basemap_w, basemap_h,
-	  *(cell.alphaLayers), cell.alphaMaterials);
-	if (!basemap) continue;
 	const char* texfile = textureFiles.Get (mat->texture_name, (const char*)0);
 	if (texfile == 0) continue;
 	
-	SaveImage (basemap, texfile);
+	generator->Add (basemap_w, basemap_h, cell.alphaLayers,
+	  cell.alphaMaterials, texfile);
 	
 	baseMapWriteCounts.GetOrCreate (texfile, 0)++;
       }
@@ -20,6 +20,7 @@
 #include "crystalspace.h"
 
 #include "basemapgen.h"
+#include "generator.h"
 
 void BaseMapGen::ScanOldMaterialMaps()
 {
@@ -205,13 +206,10 @@ void BaseMapGen::ScanTerrain1Meshes ()
     
       csPrintf ("Basemap resolution: %dx%d\n", basemap_w, basemap_h); fflush (stdout);
       
-      csRef<iImage> basemap = CreateBasemap (basemap_w, basemap_h,
-        *alphaLayers, mlayers);
-      if (!basemap) continue;
       const char* texfile = textureFiles.Get (texname, (const char*)0);
       if (texfile == 0) continue;
       
-      SaveImage (basemap, texfile);
+      generator->Add (basemap_w, basemap_h, alphaLayers, mlayers, texfile);
     } // while meshobj
   } // while sector
 }
@@ -0,0 +1,363 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "crystalspace.h"
+
+#include "basemapgen.h"
+#include "generator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BASEMAPGEN_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace CS::Threading;
+
+// The global pointer to basemapgen
+extern BaseMapGen *basemapgen;
+
+// Width and height of the tiles basemaps are split into
+static const int tileSize = 64;
+
+/* Pick the highest mipmap of a layer that's not below the resolution
+   needed for a basemap. This mipmap is then upsampled. */
+static uint ChooseLayerMip (int basemap_w, int basemap_h, MaterialLayer* layer)
+{
+  float layer_needed_x = float (basemap_w) / layer->texture_scale.x;
+  float layer_needed_y = float (basemap_h) / layer->texture_scale.y;
+  iImage* layerImage = layer->GetImage();
+  if (!layerImage) return 0;
+  int mip_x = csFindNearestPowerOf2 (
+    int (ceil (layerImage->GetWidth() / layer_needed_x)));
+  int mip_y = csFindNearestPowerOf2 (
+    int (ceil (layerImage->GetHeight() / layer_needed_y)));
+  return csMax (
+    csClamp (csLog2 (mip_x), csLog2 (layerImage->GetWidth()), 0),
+    csClamp (csLog2 (mip_y), csLog2 (layerImage->GetHeight()), 0));
+}
+
+class LayerSampler
+{
+  int img_w, img_h;
+  const csRGBpixel* pixels;
+  // Texture scale multiplied with the image size
+  float scale_x, scale_y;
+
+#ifdef BASEMAPGEN_SSE2
+  static inline __m128 TexelToFloat (const csRGBpixel& p)
+  {
+    int packed;
+    memcpy (&packed, &p, sizeof (packed));
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i v = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (packed), zero);
+    v = _mm_unpacklo_epi16 (v, zero);
+    return _mm_cvtepi32_ps (v);
+  }
+#endif
+public:
+  LayerSampler () : img_w (0), img_h (0), pixels (0) {}
+  LayerSampler (int basemap_w, int basemap_h, MaterialLayer* layer)
+   : img_w (0), img_h (0), pixels (0)
+  {
+    if (!layer) return;
+    iImage* img = layer->GetMip (
+      ChooseLayerMip (basemap_w, basemap_h, layer));
+    if (!img) return;
+    img_w = img->GetWidth();
+    img_h = img->GetHeight();
+    pixels = (const csRGBpixel*)img->GetImageData();
+    scale_x = layer->texture_scale.x * img_w;
+    scale_y = layer->texture_scale.y * img_h;
+  }
+
+  bool IsValid () const { return pixels != 0; }
+
+#ifdef BASEMAPGEN_SSE2
+  /// Bilinearly filtered color; red, green, blue, alpha in the components
+  __m128 GetPixel (float coord_x, float coord_y) const
+#else
+  csColor GetPixel (float coord_x, float coord_y) const
+#endif
+  {
+    // Calculate the material coordinates.
+    float matcoord_x_f = coord_x * scale_x;
+    float matcoord_y_f = coord_y * scale_y;
+    int matcoord_x = int (matcoord_x_f);
+    int matcoord_y = int (matcoord_y_f);
+    float f1 = matcoord_x_f - matcoord_x;
+    float f2 = matcoord_y_f - matcoord_y;
+
+    // Wrap around the texture coordinates.
+    int x0 = matcoord_x % img_w;
+    int x1 = (matcoord_x + 1) % img_w;
+    const csRGBpixel* row0 = pixels + (matcoord_y % img_h) * img_w;
+    const csRGBpixel* row1 = pixels + ((matcoord_y + 1) % img_h) * img_w;
+
+    // Bilinearly filter from material.
+#ifdef BASEMAPGEN_SSE2
+    const __m128 p00 = TexelToFloat (row0[x0]);
+    const __m128 p10 = TexelToFloat (row0[x1]);
+    const __m128 p01 = TexelToFloat (row1[x0]);
+    const __m128 p11 = TexelToFloat (row1[x1]);
+    const __m128 vf1 = _mm_set1_ps (f1);
+    const __m128 top = _mm_add_ps (p00,
+      _mm_mul_ps (_mm_sub_ps (p10, p00), vf1));
+    const __m128 bottom = _mm_add_ps (p01,
+      _mm_mul_ps (_mm_sub_ps (p11, p01), vf1));
+    return _mm_add_ps (top,
+      _mm_mul_ps (_mm_sub_ps (bottom, top), _mm_set1_ps (f2)));
+#else
+    csColor p00 (row0[x0].red, row0[x0].green, row0[x0].blue);
+    csColor p10 (row0[x1].red, row0[x1].green, row0[x1].blue);
+    csColor p01 (row1[x0].red, row1[x0].green, row1[x0].blue);
+    csColor p11 (row1[x1].red, row1[x1].green, row1[x1].blue);
+    return csLerp (csLerp (p00, p10, f1),
+      csLerp (p01, p11, f1), f2);
+#endif
+  }
+};
+
+//-----------------------------------------------------------------------------
+
+class BasemapGenerator::Basemap
+{
+public:
+  csString filename;
+  int w, h;
+  csRef<AlphaLayers> alphaLayers;
+  csArray<LayerSampler> samplers;
+  csRef<csImageMemory> image;
+  csRGBpixel* pixels;
+  /// Number of tiles not rendered yet
+  int32 tilesLeft;
+
+  void RenderTile (int x0, int y0, int x1, int y1) const;
+};
+
+void BasemapGenerator::Basemap::RenderTile (int x0, int y0,
+                                            int x1, int y1) const
+{
+  const float inv_basemap_w = 1.0f / w;
+  const float inv_basemap_h = 1.0f / h;
+  const size_t numLayers = csMin (samplers.GetSize(),
+    alphaLayers->GetSize());
+
+  for (int y = y0; y < y1; y++)
+  {
+    csRGBpixel* bm_dst = pixels + y * w + x0;
+    // Calculate the destination coordinates.
+    const float coord_y = y * inv_basemap_h;
+    for (int x = x0; x < x1; x++)
+    {
+      const float coord_x = x * inv_basemap_w;
+
+#ifdef BASEMAPGEN_SSE2
+      __m128 col = _mm_setzero_ps ();
+#else
+      csColor col (0, 0, 0);
+#endif
+      for (size_t l = 0; l < numLayers; l++)
+      {
+        if (!samplers[l].IsValid()) continue;
+        float a = alphaLayers->GetAlpha (l, coord_x, coord_y);
+        // Most layers are invisible on most pixels
+        if (a == 0) continue;
+        // Blend material colors.
+#ifdef BASEMAPGEN_SSE2
+        col = _mm_add_ps (col, _mm_mul_ps (
+          samplers[l].GetPixel (coord_x, coord_y), _mm_set1_ps (a)));
+#else
+        col += samplers[l].GetPixel (coord_x, coord_y) * a;
+#endif
+      }
+
+      // Set the basemap pixel.
+#ifdef BASEMAPGEN_SSE2
+      __m128i c = _mm_cvttps_epi32 (col);
+      c = _mm_packs_epi32 (c, c);
+      c = _mm_packus_epi16 (c, c);
+      const int packed = _mm_cvtsi128_si32 (c);
+      memcpy (bm_dst, &packed, sizeof (packed));
+      bm_dst->alpha = 255;
+#else
+      bm_dst->Set (csMin (int (col.red), 255), csMin (int (col.green), 255),
+        csMin (int (col.blue), 255));
+#endif
+      bm_dst++;
+    }
+  }
+}
+
+class TileJob : public scfImplementation1<TileJob, iJob>
+{
+  BasemapGenerator::Basemap* basemap;
+  int x0, y0, x1, y1;
+  int32* tilesDone;
+public:
+  TileJob (BasemapGenerator::Basemap* basemap, int x0, int y0, int x1, int y1,
+           int32* tilesDone)
+   : scfImplementationType (this), basemap (basemap), x0 (x0), y0 (y0),
+     x1 (x1), y1 (y1), tilesDone (tilesDone) {}
+
+  void Run ()
+  {
+    basemap->RenderTile (x0, y0, x1, y1);
+    AtomicOperations::Increment (tilesDone);
+    /* Must be the last access to the basemap: the main thread frees it once
+       all tiles are done. */
+    AtomicOperations::Decrement (&basemap->tilesLeft);
+  }
+};
+
+//-----------------------------------------------------------------------------
+
+static int NumTiles (int w, int h)
+{
+  return ((w + tileSize - 1) / tileSize) * ((h + tileSize - 1) / tileSize);
+}
+
+BasemapGenerator::BasemapGenerator (int numThreads)
+ : numThreads (numThreads), tilesDone (0)
+{
+  if (this->numThreads <= 0)
+    this->numThreads = CS::Platform::GetProcessorCount();
+  if (this->numThreads <= 0)
+    this->numThreads = 1;
+  jobQueue.AttachNew (new ThreadedJobQueue (this->numThreads,
+    THREAD_PRIO_NORMAL));
+}
+
+BasemapGenerator::~BasemapGenerator ()
+{
+}
+
+void BasemapGenerator::Add (int basemap_w, int basemap_h,
+                            AlphaLayers* alphaLayers,
+                            const MaterialLayers& txt_layers,
+                            const char* filename)
+{
+  Request request;
+  request.w = basemap_w;
+  request.h = basemap_h;
+  request.alphaLayers = alphaLayers;
+  request.layers = txt_layers;
+  request.filename = filename;
+  requests.Push (request);
+}
+
+BasemapGenerator::Basemap* BasemapGenerator::StartBasemap (
+  const Request& request)
+{
+  Basemap* basemap = new Basemap;
+  basemap->filename = request.filename;
+  basemap->w = request.w;
+  basemap->h = request.h;
+  basemap->alphaLayers = request.alphaLayers;
+  for (size_t i = 0 ; i < request.layers.GetSize() ; i++)
+  {
+    basemap->samplers.Push (LayerSampler (request.w, request.h,
+      request.layers[i]));
+  }
+  basemap->image.AttachNew (new csImageMemory (request.w, request.h));
+  basemap->pixels = (csRGBpixel*)basemap->image->GetImagePtr();
+  basemap->tilesLeft = NumTiles (request.w, request.h);
+
+  for (int y = 0; y < request.h; y += tileSize)
+  {
+    for (int x = 0; x < request.w; x += tileSize)
+    {
+      csRef<iJob> job;
+      job.AttachNew (new TileJob (basemap, x, y,
+        csMin (x + tileSize, request.w), csMin (y + tileSize, request.h),
+        &tilesDone));
+      jobQueue->Enqueue (job);
+    }
+  }
+  return basemap;
+}
+
+void BasemapGenerator::Run ()
+{
+  if (requests.GetSize() == 0) return;
+
+  csPrintf ("Creating %zu base texturemap(s) using %d threads... \n",
+    requests.GetSize(), numThreads);
+  fflush (stdout);
+  CS::MeasureTime lTimeMeasurer ("Time taken");
+
+  /* Load and mipmap all layer images before rendering starts, so the
+     workers only read prefetched pixel data. */
+  int totalTiles = 0;
+  for (size_t r = 0; r < requests.GetSize(); r++)
+  {
+    const Request& request = requests[r];
+    for (size_t i = 0 ; i < request.layers.GetSize() ; i++)
+    {
+      MaterialLayer* layer = request.layers[i];
+      if (!layer) continue;
+      layer->GetMip (ChooseLayerMip (request.w, request.h, layer));
+    }
+    totalTiles += NumTiles (request.w, request.h);
+  }
+  csPrintf ("\n");
+
+  /* Several basemaps are rendered at once so the queue doesn't run dry at
+     the end of one; finished ones are saved right away to bound memory. */
+  const size_t maxInFlight = csMax (numThreads, 2);
+  csArray<Basemap*> inFlight;
+  size_t next = 0;
+  int lastPercent = -1;
+  AtomicOperations::Set (&tilesDone, 0);
+  while ((next < requests.GetSize()) || (inFlight.GetSize() > 0))
+  {
+    while ((next < requests.GetSize()) && (inFlight.GetSize() < maxInFlight))
+      inFlight.Push (StartBasemap (requests[next++]));
+
+    bool saved = false;
+    size_t i = 0;
+    while (i < inFlight.GetSize())
+    {
+      Basemap* basemap = inFlight[i];
+      if (AtomicOperations::Read (&basemap->tilesLeft) != 0)
+      {
+        i++;
+        continue;
+      }
+      csPrintf ("\n");
+      basemapgen->SaveImage (basemap->image, basemap->filename);
+      delete basemap;
+      inFlight.DeleteIndex (i);
+      saved = true;
+      lastPercent = -1;
+    }
+
+    // Draw progress.
+    int percent = int ((int64 (AtomicOperations::Read (&tilesDone)) * 100)
+      / totalTiles);
+    if (percent != lastPercent)
+    {
+      basemapgen->DrawProgress (percent);
+      lastPercent = percent;
+    }
+    if (!saved) csSleep (10);
+  }
+  csPrintf ("\n");
+
+  requests.DeleteAll ();
+}
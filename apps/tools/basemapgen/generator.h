@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __GENERATOR_H__
+#define __GENERATOR_H__
+
+#include "layers.h"
+
+/**
+ * Generates basemaps on a job queue. Each basemap is split into tiles which
+ * are rendered in parallel; several basemaps are in flight at once.
+ */
+class BasemapGenerator
+{
+public:
+  class Basemap;
+private:
+  struct Request
+  {
+    int w, h;
+    csRef<AlphaLayers> alphaLayers;
+    MaterialLayers layers;
+    csString filename;
+  };
+  csArray<Request> requests;
+
+  int numThreads;
+  csRef<iJobQueue> jobQueue;
+  /// Number of tiles finished, over all basemaps
+  int32 tilesDone;
+
+  Basemap* StartBasemap (const Request& request);
+public:
+  BasemapGenerator (int numThreads);
+  ~BasemapGenerator ();
+
+  /// Queue a basemap to be generated and saved to \a filename
+  void Add (int basemap_w, int basemap_h, AlphaLayers* alphaLayers,
+            const MaterialLayers& txt_layers, const char* filename);
+  /// Generate and save all queued basemaps
+  void Run ();
+};
+
+#endif // __GENERATOR_H__
@@ -158,6 +158,20 @@ float AlphaLayers::GetAlpha (size_t layer, float coord_x, float coord_y) const
 }
 
 //-----------------------------------------------------------------------------
+
+/* Get mipmap for an image, using precomputed mipmaps as far as
+   possible. */
+static csRef<iImage> GetImageMip (iImage* img, uint mip)
+{
+  if (mip == 0) return img;
+  csRef<iImage> imgToMip (img);
+  uint hasMips = img->HasMipmaps();
+  if (mip <= hasMips) return img->GetMipmap (mip);
+  imgToMip = img->GetMipmap (hasMips);
+  mip -= hasMips;
+  if (mip == 0) return imgToMip;
+  return csImageManipulate::Mipmap (imgToMip, mip);
+}
   
 iImage* MaterialLayer::GetImage()
 {
@@ -168,3 +182,17 @@ iImage* MaterialLayer::GetImage()
   return image;
 }
   
+
+iImage* MaterialLayer::GetMip (uint mip)
+{
+  csRef<iImage>& mipImage = mips.GetExtend (mip);
+  if (!mipImage.IsValid())
+  {
+    iImage* layerImage = GetImage();
+    if (!layerImage) return 0;
+    mipImage = GetImageMip (layerImage, mip);
+    // Some image loaders decode on the first access
+    mipImage->GetImageData();
+  }
+  return mipImage;
+}
@@ -47,8 +47,14 @@ struct MaterialLayer : public csRefCount
   csString texture_file;
   
   iImage* GetImage();
+  /**
+   * Get a mipmap of the image. Mipmaps are computed once and their data is
+   * decoded, so they can be read from any thread afterwards.
+   */
+  iImage* GetMip (uint mip);
 protected:
   csRef<iImage> image;
+  csArray<csRef<iImage> > mips;
 };
 typedef csRefArray<MaterialLayer> MaterialLayers;
 
@@ -21,6 +21,7 @@
 
 #include "cssysdef.h"
 #include <errno.h>
+#include <math.h>
 #include <string.h>
 
 #include "csgfx/bakekeycolor.h"
@@ -34,6 +35,7 @@
 #include "csutil/databuf.h"
 #include "csutil/cmdhelp.h"
 #include "csutil/getopt.h"
+#include "csutil/sysfunc.h"
 #include "csutil/util.h"
 #include "igraphic/imageio.h"
 #include "iutil/comp.h"
@@ -77,6 +79,7 @@ static struct option long_options[] =
   {"suffix", required_argument, 0, 'U'},
   {"display", optional_argument, 0, 'D'},
   {"info", no_argument, 0, 'I'},
+  {"dds-benchmark", no_argument, 0, 'B'},
   {0, no_argument, 0, 0}
 };
 
@@ -161,6 +164,7 @@ static int display_help ()
   csPrintf ("  -D   --display=#,#   Display the image in ASCII format :-)\n");
   csPrintf ("                       An optional scale argument may be specified\n");
   csPrintf ("  -I   --info          Display image info (and don't do anything more)\n");
+  csPrintf ("  -B   --dds-benchmark Compare speed and quality of the DDS compressors\n");
   return 1;
 }
 
@@ -267,6 +271,88 @@ static bool display_picture (csRef<iImage> ifile)
   return true;
 }
 
+/// Peak signal to noise ratio over the first \a channels of RGBA
+static float compute_psnr (iImage* a, iImage* b, int channels)
+{
+  const csRGBpixel* pa = (const csRGBpixel*)a->GetImageData ();
+  const csRGBpixel* pb = (const csRGBpixel*)b->GetImageData ();
+  const size_t pixels = a->GetWidth () * a->GetHeight ();
+  double sum = 0;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    const int d[4] = { pa[i].red - pb[i].red, pa[i].green - pb[i].green,
+      pa[i].blue - pb[i].blue, pa[i].alpha - pb[i].alpha };
+    for (int c = 0; c < channels; c++)
+      sum += d[c] * d[c];
+  }
+  const double mse = sum / (pixels * channels);
+  if (mse <= 0) return 99.0f;
+  return float (10.0 * log10 (255.0 * 255.0 / mse));
+}
+
+static bool benchmark_dds (iImage* image)
+{
+  csRef<iImage> source;
+  source.AttachNew (new csImageMemory (image,
+    CS_IMGFMT_TRUECOLOR | CS_IMGFMT_ALPHA));
+  const int w = source->GetWidth ();
+  const int h = source->GetHeight ();
+  const double megaBytes = double (w) * h * 4 / (1024 * 1024);
+
+  static const struct
+  {
+    const char* format;
+    int channels;
+  } formats[] = { {"dxt1", 3}, {"dxt5", 4}, {"bc5", 2} };
+  static const char* const qualities[] = 
+    { "reference", "fast", "normal", "high" };
+
+  csPrintf ("%-6s %-10s %10s %10s\n", "format", "quality", "MB/s", "PSNR");
+  for (size_t f = 0; f < sizeof (formats) / sizeof (formats[0]); f++)
+  {
+    for (size_t q = 0; q < sizeof (qualities) / sizeof (qualities[0]); q++)
+    {
+      // There is no reference compressor for BC5
+      if ((q == 0) && (formats[f].channels == 2)) continue;
+
+      csString options;
+      options.Format ("format=%s,quality=%s,nomipmaps", formats[f].format,
+        qualities[q]);
+      // Repeat for at least half a second to get a stable time
+      csRef<iDataBuffer> db;
+      int runs = 0;
+      const int64 start = csGetMicroTicks ();
+      int64 elapsed;
+      do
+      {
+        db = ImageLoader->Save (source, "image/dds", options);
+        if (!db) break;
+        runs++;
+        elapsed = csGetMicroTicks () - start;
+      }
+      while (elapsed < 500000);
+      if (!db)
+      {
+        csPrintf ("%-6s %-10s failed\n", formats[f].format, qualities[q]);
+        continue;
+      }
+
+      csRef<iImage> decoded (ImageLoader->Load (db,
+        CS_IMGFMT_TRUECOLOR | CS_IMGFMT_ALPHA));
+      if (!decoded)
+      {
+        csPrintf ("%-6s %-10s failed to load\n", formats[f].format,
+          qualities[q]);
+        continue;
+      }
+      csPrintf ("%-6s %-10s %10.2f %10.2f\n", formats[f].format, qualities[q],
+        megaBytes * runs * 1000000.0 / elapsed,
+        compute_psnr (source, decoded, formats[f].channels));
+    }
+  }
+  return true;
+}
+
 static void process_image (csRef<iImage>& ifile, csString& suffix)
 {
   if (opt.verbose || opt.info)
@@ -433,7 +519,8 @@ static csRef<iImage> open_file (const char *fname)
   fclose (f);
 
   int fmt;
-  if (opt.outputmode > 0
+  // The DDS benchmark needs the original colors
+  if ((opt.outputmode > 0 && opt.outputmode != 3)
    || opt.paletted)
     fmt = CS_IMGFMT_PALETTED8;
   else if (opt.truecolor)
@@ -472,6 +559,9 @@ static bool process_file (const char *fname, csRef<iImage>* outImage = 0)
       case 2:
 	success = true;
 	break;
+      case 3:
+	success = benchmark_dds (ifile);
+	break;
     }
   }
   else
@@ -491,7 +581,7 @@ int gfxtest_main (iObjectRegistry* object_reg, int argc, char *argv[])
   /* getopt_long 101: one colon follows - required argument, 
                       two colons - optional arg. */
   while ((c = getopt_long (argc, argv, 
-      "8cdaAs:m:t:p:D::S::EM:O:P:U:IhvVFTNC", long_options, 0)) != EOF)
+      "8cdaAs:m:t:p:D::S::EM:O:P:U:IBhvVFTNC", long_options, 0)) != EOF)
     switch (c)
     {
       case '?':
@@ -609,6 +699,9 @@ int gfxtest_main (iObjectRegistry* object_reg, int argc, char *argv[])
         opt.outputmode = 2;
         opt.info = true;
         break;
+      case 'B':
+        opt.outputmode = 3;
+        break;
       case 'h':
 	return display_help ();
       case 'v':
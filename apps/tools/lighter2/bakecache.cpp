@@ -0,0 +1,324 @@
+/*
+  Copyright (C) 2010 by the Crystal Space team
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "common.h"
+
+#include "bakecache.h"
+
+namespace lighter
+{
+  // Bump when the file layout or the meaning of cached data changes
+  static const uint32 bakeCacheVersion = 1;
+  static const char bakeCacheMagic[4] = {'L', '2', 'B', 'C'};
+
+  static void WriteUInt32 (iFile* file, uint32 v)
+  {
+    v = csLittleEndian::UInt32 (v);
+    file->Write ((const char*)&v, sizeof (v));
+  }
+
+  static void WriteFloat (iFile* file, float f)
+  {
+    WriteUInt32 (file, csIEEEfloat::FromNative (f));
+  }
+
+  static void WriteString (iFile* file, const csString& str)
+  {
+    WriteUInt32 (file, uint32 (str.Length ()));
+    file->Write (str.GetDataSafe (), str.Length ());
+  }
+
+  static void WriteDigest (iFile* file, const csMD5::Digest& digest)
+  {
+    file->Write ((const char*)digest.data, csMD5::Digest::DigestLen);
+  }
+
+  static void WriteSphere (iFile* file, const csSphere& sphere)
+  {
+    const csVector3& c = sphere.GetCenter ();
+    WriteFloat (file, c.x);
+    WriteFloat (file, c.y);
+    WriteFloat (file, c.z);
+    WriteFloat (file, sphere.GetRadius ());
+  }
+
+  // Sequential reader for a cache file; stays in error once data runs out
+  class CacheReader
+  {
+    const uint8* data;
+    size_t size, pos;
+    bool ok;
+
+    const uint8* Take (size_t n)
+    {
+      if (!ok || (size - pos < n))
+      {
+        ok = false;
+        return 0;
+      }
+      const uint8* p = data + pos;
+      pos += n;
+      return p;
+    }
+  public:
+    CacheReader (iDataBuffer* buf) : data (buf->GetUint8 ()),
+      size (buf->GetSize ()), pos (0), ok (true) {}
+
+    bool IsOk () const { return ok; }
+
+    uint32 ReadUInt32 ()
+    {
+      const uint8* p = Take (sizeof (uint32));
+      return p ? csLittleEndian::UInt32 (csGetFromAddress::UInt32 (p)) : 0;
+    }
+
+    float ReadFloat ()
+    {
+      return csIEEEfloat::ToNative (ReadUInt32 ());
+    }
+
+    csString ReadString ()
+    {
+      const uint32 len = ReadUInt32 ();
+      const uint8* p = Take (len);
+      csString str;
+      if (p) str.Append ((const char*)p, len);
+      return str;
+    }
+
+    csMD5::Digest ReadDigest ()
+    {
+      csMD5::Digest digest;
+      const uint8* p = Take (csMD5::Digest::DigestLen);
+      if (p)
+        memcpy (digest.data, p, csMD5::Digest::DigestLen);
+      else
+        memset (digest.data, 0, csMD5::Digest::DigestLen);
+      return digest;
+    }
+
+    csSphere ReadSphere ()
+    {
+      csVector3 c;
+      c.x = ReadFloat ();
+      c.y = ReadFloat ();
+      c.z = ReadFloat ();
+      const float r = ReadFloat ();
+      return csSphere (c, r);
+    }
+  };
+
+  //-------------------------------------------------------------------------
+
+  BakeCache::BakeCache (const csMD5::Digest& configHash) :
+    configHash (configHash), reusedSamples (0), shadedSamples (0), changedObjects (0),
+    changedLights (0)
+  {
+  }
+
+  bool BakeCache::Load (iVFS* vfs, const char* filename)
+  {
+    csRef<iDataBuffer> buf = vfs->ReadFile (filename, false);
+    return Load (buf);
+  }
+
+  bool BakeCache::Load (iDataBuffer* buf)
+  {
+    cachedLights.DeleteAll ();
+    cachedObjects.DeleteAll ();
+
+    if (!buf || (buf->GetSize () < sizeof (bakeCacheMagic)))
+      return false;
+    if (memcmp (buf->GetData (), bakeCacheMagic, sizeof (bakeCacheMagic)) != 0)
+      return false;
+
+    CacheReader reader (buf);
+    reader.ReadUInt32 ();
+    if (reader.ReadUInt32 () != bakeCacheVersion) return false;
+    // Results computed with other settings are useless
+    if (reader.ReadDigest () != configHash) return false;
+
+    const uint32 numLights = reader.ReadUInt32 ();
+    for (uint32 l = 0; (l < numLights) && reader.IsOk (); l++)
+    {
+      csString key (reader.ReadString ());
+      LightEntry entry;
+      entry.hash = reader.ReadDigest ();
+      entry.bounds = reader.ReadSphere ();
+      cachedLights.Put (key, entry);
+    }
+
+    const uint32 numObjects = reader.ReadUInt32 ();
+    for (uint32 o = 0; (o < numObjects) && reader.IsOk (); o++)
+    {
+      csString key (reader.ReadString ());
+      ObjectEntry entry;
+      entry.hash = reader.ReadDigest ();
+      entry.bounds = reader.ReadSphere ();
+      const uint32 numResults = reader.ReadUInt32 ();
+      for (uint32 r = 0; (r < numResults) && reader.IsOk (); r++)
+      {
+        csRef<ResultEntry> result;
+        result.AttachNew (new ResultEntry);
+        result->subLightmap = reader.ReadUInt32 ();
+        result->lightKey = reader.ReadString ();
+        const uint32 numColors = reader.ReadUInt32 ();
+        if (!reader.IsOk ()) break;
+        result->colors.SetSize (numColors);
+        for (uint32 c = 0; c < numColors; c++)
+        {
+          csColor& color = result->colors[c];
+          color.red = reader.ReadFloat ();
+          color.green = reader.ReadFloat ();
+          color.blue = reader.ReadFloat ();
+        }
+        entry.results.Push (result);
+      }
+      cachedObjects.Put (key, entry);
+    }
+
+    if (!reader.IsOk ())
+    {
+      // Truncated file, don't trust any of it
+      cachedLights.DeleteAll ();
+      cachedObjects.DeleteAll ();
+      return false;
+    }
+    return true;
+  }
+
+  bool BakeCache::Save (iVFS* vfs, const char* filename)
+  {
+    csRef<iDataBuffer> buf = Save ();
+    return vfs->WriteFile (filename, buf->GetData (), buf->GetSize ());
+  }
+
+  csPtr<iDataBuffer> BakeCache::Save ()
+  {
+    csMemFile file;
+    file.Write (bakeCacheMagic, sizeof (bakeCacheMagic));
+    WriteUInt32 (&file, bakeCacheVersion);
+    WriteDigest (&file, configHash);
+
+    WriteUInt32 (&file, uint32 (currentLights.GetSize ()));
+    LightEntryHash::GlobalIterator lightIt = currentLights.GetIterator ();
+    while (lightIt.HasNext ())
+    {
+      csString key;
+      const LightEntry& entry = lightIt.Next (key);
+      WriteString (&file, key);
+      WriteDigest (&file, entry.hash);
+      WriteSphere (&file, entry.bounds);
+    }
+
+    WriteUInt32 (&file, uint32 (currentObjects.GetSize ()));
+    ObjectEntryHash::GlobalIterator objIt = currentObjects.GetIterator ();
+    while (objIt.HasNext ())
+    {
+      csString key;
+      const ObjectEntry& entry = objIt.Next (key);
+      WriteString (&file, key);
+      WriteDigest (&file, entry.hash);
+      WriteSphere (&file, entry.bounds);
+      WriteUInt32 (&file, uint32 (entry.results.GetSize ()));
+      for (size_t r = 0; r < entry.results.GetSize (); r++)
+      {
+        const ResultEntry* result = entry.results[r];
+        WriteUInt32 (&file, result->subLightmap);
+        WriteString (&file, result->lightKey);
+        WriteUInt32 (&file, uint32 (result->colors.GetSize ()));
+        for (size_t c = 0; c < result->colors.GetSize (); c++)
+        {
+          const csColor& color = result->colors[c];
+          WriteFloat (&file, color.red);
+          WriteFloat (&file, color.green);
+          WriteFloat (&file, color.blue);
+        }
+      }
+    }
+
+    return file.GetAllData ();
+  }
+
+  bool BakeCache::AddObject (const csString& key,
+    const csMD5::Digest& hash, const csSphere& bounds)
+  {
+    ObjectEntry entry;
+    entry.hash = hash;
+    entry.bounds = bounds;
+    currentObjects.Put (key, entry);
+
+    ObjectEntry* cached = cachedObjects.GetElementPointer (key);
+    if (cached && (cached->hash == hash))
+      return false;
+
+    changedObjects++;
+    changedBounds.Push (bounds);
+    if (cached)
+    {
+      changedBounds.Push (cached->bounds);
+      cached->valid = false;
+    }
+    return true;
+  }
+
+  const csColor* BakeCache::GetCachedColors (const csString& objKey,
+    size_t subLightmapNum, const csString& lightKey, size_t numSamples) const
+  {
+    const ObjectEntry* entry = cachedObjects.GetElementPointer (objKey);
+    if (!entry || !entry->valid) return 0;
+
+    for (size_t r = 0; r < entry->results.GetSize (); r++)
+    {
+      const ResultEntry* result = entry->results[r];
+      if ((result->subLightmap == subLightmapNum)
+        && (result->lightKey == lightKey))
+      {
+        if (result->colors.GetSize () != numSamples) return 0;
+        return result->colors.GetArray ();
+      }
+    }
+    return 0;
+  }
+
+  csColor* BakeCache::GetResultColors (const csString& objKey,
+    size_t subLightmapNum, const csString& lightKey, size_t numSamples)
+  {
+    ObjectEntry* entry = currentObjects.GetElementPointer (objKey);
+    if (!entry) return 0;
+
+    csRef<ResultEntry> result;
+    result.AttachNew (new ResultEntry);
+    result->subLightmap = uint32 (subLightmapNum);
+    result->lightKey = lightKey;
+    result->colors.SetSize (numSamples, csColor (0, 0, 0));
+    entry->results.Push (result);
+    return result->colors.GetArray ();
+  }
+
+  void BakeCache::GetDirtyRegions (const csSphere& sphere,
+    csArray<csSphere>& regions) const
+  {
+    regions.Empty ();
+    for (size_t r = 0; r < dirtyRegions.GetSize (); r++)
+    {
+      if (dirtyRegions[r].TestIntersect (sphere))
+        regions.Push (dirtyRegions[r]);
+    }
+  }
+}
@@ -0,0 +1,177 @@
+/*
+  Copyright (C) 2010 by the Crystal Space team
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __BAKECACHE_H__
+#define __BAKECACHE_H__
+
+#include "csutil/csmd5.h"
+#include "csgeom/sphere.h"
+
+namespace lighter
+{
+  class Light;
+  class Object;
+  class Scene;
+
+  // Feed a POD value into an MD5 computation
+  template<typename T>
+  inline void HashAppend (csMD5::md5_state_t* md5, const T& value)
+  {
+    csMD5::md5_append (md5, reinterpret_cast<const csMD5::md5_byte_t*> (&value),
+      sizeof (T));
+  }
+
+  /**
+   * Cache of direct lighting results of a previous run.
+   * Objects, lights and the lighting configuration are hashed; on the next
+   * run only objects that changed are relit completely, and of the other
+   * objects only the samples inside the influence spheres of changed lights
+   * (or of lights shining on changed objects) are relit. Everything else is
+   * copied from the cache.
+   */
+  class BakeCache
+  {
+  public:
+    // Results computed with another \a configHash are not used
+    BakeCache (const csMD5::Digest& configHash);
+
+    // Load results of the previous run. Returns false if there were none.
+    bool Load (iVFS* vfs, const char* filename);
+    bool Load (iDataBuffer* buf);
+
+    // Save results of this run.
+    bool Save (iVFS* vfs, const char* filename);
+    csPtr<iDataBuffer> Save ();
+
+    // Compare the scene to the cached data and collect what changed
+    void Prepare (Scene* scene);
+
+    /**
+     * Add an object of this run. Returns true if the object is new or its
+     * \a hash differs from the cached one; its cached results are not used
+     * then.
+     */
+    bool AddObject (const csString& key, const csMD5::Digest& hash,
+      const csSphere& bounds);
+
+    /**
+     * Get cached colors for a number of samples of an object. \a light is
+     * 0 for the sum of all static lights or a PD light. Returns 0 if the
+     * object changed or the sample count does not match.
+     */
+    const csColor* GetCachedColors (Object* obj, size_t subLightmapNum,
+      Light* light, size_t numSamples) const;
+    // Same, for the object and light keys; the light key is empty for 0
+    const csColor* GetCachedColors (const csString& objKey,
+      size_t subLightmapNum, const csString& lightKey,
+      size_t numSamples) const;
+
+    // Get storage for the colors of samples computed in this run
+    csColor* GetResultColors (Object* obj, size_t subLightmapNum,
+      Light* light, size_t numSamples);
+    csColor* GetResultColors (const csString& objKey, size_t subLightmapNum,
+      const csString& lightKey, size_t numSamples);
+
+    // Collect the dirty regions touching a sphere
+    void GetDirtyRegions (const csSphere& sphere,
+      csArray<csSphere>& regions) const;
+
+    // Check if a sample is inside any of the given regions
+    static bool IsDirty (const csArray<csSphere>& regions,
+      const csVector3& pos, float radius)
+    {
+      for (size_t r = 0; r < regions.GetSize (); r++)
+      {
+        const float maxDist = regions[r].GetRadius () + radius;
+        if ((regions[r].GetCenter () - pos).SquaredNorm ()
+          <= maxDist * maxDist)
+          return true;
+      }
+      return false;
+    }
+
+    // Count samples that were reused or computed
+    void CountSamples (size_t reused, size_t shaded)
+    {
+      reusedSamples += reused;
+      shadedSamples += shaded;
+    }
+
+    size_t GetReusedSamples () const { return reusedSamples; }
+    size_t GetShadedSamples () const { return shadedSamples; }
+    size_t GetChangedObjectCount () const { return changedObjects; }
+    size_t GetChangedLightCount () const { return changedLights; }
+
+    // Hash of the configuration the results depend on
+    static csMD5::Digest ComputeConfigHash ();
+
+  protected:
+    struct LightEntry
+    {
+      csMD5::Digest hash;
+      csSphere bounds;
+    };
+    typedef csHash<LightEntry, csString> LightEntryHash;
+
+    struct ResultEntry : public csRefCount
+    {
+      uint32 subLightmap;
+      // Key of the PD light; empty for static lights
+      csString lightKey;
+      csDirtyAccessArray<csColor> colors;
+    };
+
+    struct ObjectEntry
+    {
+      csMD5::Digest hash;
+      csSphere bounds;
+      // Whether the cached results can be used
+      bool valid;
+      csRefArray<ResultEntry> results;
+
+      ObjectEntry () : valid (true) {}
+    };
+    typedef csHash<ObjectEntry, csString> ObjectEntryHash;
+
+    // Data of the previous run
+    LightEntryHash cachedLights;
+    ObjectEntryHash cachedObjects;
+    // Data of this run
+    LightEntryHash currentLights;
+    ObjectEntryHash currentObjects;
+    csMD5::Digest configHash;
+    // Keys of the lights in this run
+    csHash<csString, csPtrKey<Light> > lightKeys;
+
+    // Regions in which cached lighting can not be used
+    csArray<csSphere> dirtyRegions;
+    // Bounds of changed objects, old and new
+    csArray<csSphere> changedBounds;
+
+    size_t reusedSamples, shadedSamples;
+    size_t changedObjects, changedLights;
+
+    static csString GetObjectKey (Object* obj);
+    csString GetLightKey (Light* light) const;
+
+    static csMD5::Digest ComputeObjectHash (Object* obj);
+    static csMD5::Digest ComputeLightHash (Light* light);
+  };
+}
+
+#endif // __BAKECACHE_H__
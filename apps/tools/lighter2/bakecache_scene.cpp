@@ -0,0 +1,241 @@
+/*
+  Copyright (C) 2010 by the Crystal Space team
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "common.h"
+
+#include "bakecache.h"
+#include "config.h"
+#include "lighter.h"
+#include "object.h"
+#include "scene.h"
+
+namespace lighter
+{
+  /* The parts of BakeCache that deal with the scene. Kept apart from the
+     cache itself so that one can be used without a scene. */
+
+  void BakeCache::Prepare (Scene* scene)
+  {
+    changedBounds.Empty ();
+    changedObjects = changedLights = 0;
+
+    SectorHash::GlobalIterator sectIt = scene->GetSectors ().GetIterator ();
+    while (sectIt.HasNext ())
+    {
+      csRef<Sector> sect = sectIt.Next ();
+
+      LightRefArray lights (sect->allNonPDLights);
+      for (size_t l = 0; l < sect->allPDLights.GetSize (); l++)
+        lights.Push (sect->allPDLights[l]);
+      for (size_t l = 0; l < lights.GetSize (); l++)
+      {
+        Light* light = lights[l];
+        // Several proxies of one light can end up in the same sector
+        csString key;
+        key.Format ("%s:%s", sect->sectorName.GetData (),
+          light->GetLightID ().HexString ().GetData ());
+        csString uniqueKey (key);
+        for (int n = 1; currentLights.Contains (uniqueKey); n++)
+          uniqueKey.Format ("%s#%d", key.GetData (), n);
+        lightKeys.Put (light, uniqueKey);
+
+        LightEntry entry;
+        entry.hash = ComputeLightHash (light);
+        entry.bounds = light->GetBoundingSphere ();
+        currentLights.Put (uniqueKey, entry);
+
+        const LightEntry* cached = cachedLights.GetElementPointer (uniqueKey);
+        if (!cached || (cached->hash != entry.hash))
+        {
+          changedLights++;
+          dirtyRegions.Push (entry.bounds);
+          if (cached) dirtyRegions.Push (cached->bounds);
+        }
+      }
+
+      ObjectHash::GlobalIterator objIt = sect->allObjects.GetIterator ();
+      while (objIt.HasNext ())
+      {
+        csRef<Object> obj = objIt.Next ();
+        AddObject (GetObjectKey (obj), ComputeObjectHash (obj),
+          obj->GetBoundingSphere ());
+      }
+    }
+
+    // Removed lights and objects
+    LightEntryHash::GlobalIterator cachedLightIt = cachedLights.GetIterator ();
+    while (cachedLightIt.HasNext ())
+    {
+      csString key;
+      const LightEntry& entry = cachedLightIt.Next (key);
+      if (!currentLights.Contains (key))
+      {
+        changedLights++;
+        dirtyRegions.Push (entry.bounds);
+      }
+    }
+    ObjectEntryHash::GlobalIterator cachedObjIt = cachedObjects.GetIterator ();
+    while (cachedObjIt.HasNext ())
+    {
+      csString key;
+      const ObjectEntry& entry = cachedObjIt.Next (key);
+      if (!currentObjects.Contains (key))
+      {
+        changedObjects++;
+        changedBounds.Push (entry.bounds);
+      }
+    }
+
+    /* Changed geometry changes the shadows of all lights reaching it, so
+       everything those lights reach needs to be relit. */
+    csSet<csString> lightsDirtied;
+    LightEntryHash::GlobalIterator lightIt = currentLights.GetIterator ();
+    while (lightIt.HasNext ())
+    {
+      csString key;
+      const LightEntry& entry = lightIt.Next (key);
+      for (size_t b = 0; b < changedBounds.GetSize (); b++)
+      {
+        if (entry.bounds.TestIntersect (changedBounds[b]))
+        {
+          if (!lightsDirtied.Contains (key))
+          {
+            dirtyRegions.Push (entry.bounds);
+            lightsDirtied.AddNoTest (key);
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  const csColor* BakeCache::GetCachedColors (Object* obj,
+    size_t subLightmapNum, Light* light, size_t numSamples) const
+  {
+    return GetCachedColors (GetObjectKey (obj), subLightmapNum,
+      light ? GetLightKey (light) : csString (), numSamples);
+  }
+
+  csColor* BakeCache::GetResultColors (Object* obj, size_t subLightmapNum,
+    Light* light, size_t numSamples)
+  {
+    return GetResultColors (GetObjectKey (obj), subLightmapNum,
+      light ? GetLightKey (light) : csString (), numSamples);
+  }
+
+  csString BakeCache::GetObjectKey (Object* obj)
+  {
+    csString key;
+    key.Format ("%s:%s", obj->GetSector ()->sectorName.GetData (),
+      obj->meshName.GetData ());
+    return key;
+  }
+
+  csString BakeCache::GetLightKey (Light* light) const
+  {
+    return lightKeys.Get (light, csString ());
+  }
+
+  csMD5::Digest BakeCache::ComputeConfigHash ()
+  {
+    csMD5::md5_state_t md5;
+    csMD5::md5_init (&md5);
+
+    const Configuration::LighterProperties& lighterProps =
+      globalConfig.GetLighterProperties ();
+    HashAppend (&md5, lighterProps.directionalLMs);
+    const Configuration::LightmapProperties& lmProps =
+      globalConfig.GetLMProperties ();
+    HashAppend (&md5, lmProps.lmDensity);
+    HashAppend (&md5, lmProps.maxLightmapU);
+    HashAppend (&md5, lmProps.maxLightmapV);
+    HashAppend (&md5, lmProps.normalsTolerance);
+    const Configuration::TerrainProperties& terrainProps =
+      globalConfig.GetTerrainProperties ();
+    HashAppend (&md5, terrainProps.maxLightmapU);
+    HashAppend (&md5, terrainProps.maxLightmapV);
+    const Configuration::DIProperties& diProps =
+      globalConfig.GetDIProperties ();
+    HashAppend (&md5, diProps.pointLightMultiplier);
+    HashAppend (&md5, diProps.areaLightMultiplier);
+    HashAppend (&md5, diProps.lmElementLighting);
+    HashAppend (&md5, diProps.pvlElementLighting);
+    const bool directLightRandom = globalLighter->configMgr->GetBool (
+      "lighter2.DirectLightRandom", false);
+    HashAppend (&md5, directLightRandom);
+
+    csMD5::Digest digest;
+    csMD5::md5_finish (&md5, digest.data);
+    return digest;
+  }
+
+  csMD5::Digest BakeCache::ComputeObjectHash (Object* obj)
+  {
+    csMD5::md5_state_t md5;
+    csMD5::md5_init (&md5);
+
+    csMD5::md5_append (&md5, (const csMD5::md5_byte_t*)obj->meshName.GetDataSafe (),
+      obj->meshName.Length ());
+    HashAppend (&md5, obj->lightPerVertex);
+    HashAppend (&md5, obj->GetFlags ().Get ());
+
+    const ObjectVertexData& vdata = obj->GetVertexData ();
+    csMD5::md5_append (&md5, (const csMD5::md5_byte_t*)vdata.positions.GetArray (),
+      vdata.positions.GetSize () * sizeof (csVector3));
+    csMD5::md5_append (&md5, (const csMD5::md5_byte_t*)vdata.normals.GetArray (),
+      vdata.normals.GetSize () * sizeof (csVector3));
+
+    // The lumel grid and transparency of each primitive
+    const csArray<PrimitiveArray>& submeshes = obj->GetPrimitives ();
+    for (size_t s = 0; s < submeshes.GetSize (); s++)
+    {
+      const PrimitiveArray& prims = submeshes[s];
+      HashAppend (&md5, prims.GetSize ());
+      for (size_t p = 0; p < prims.GetSize (); p++)
+      {
+        const Primitive& prim = prims[p];
+        const Primitive::TriangleType& tri = prim.GetTriangle ();
+        HashAppend (&md5, tri.a);
+        HashAppend (&md5, tri.b);
+        HashAppend (&md5, tri.c);
+        HashAppend (&md5, prim.GetElementCount ());
+        HashAppend (&md5, prim.GetuFormVector ());
+        HashAppend (&md5, prim.GetvFormVector ());
+        HashAppend (&md5, prim.GetMinCoord ());
+        const RadMaterial* mat = prim.GetMaterial ();
+        const uint32 filterChecksum = (mat && mat->IsTransparent ())
+          ? mat->filterChecksum : 0;
+        HashAppend (&md5, filterChecksum);
+      }
+    }
+
+    csMD5::Digest digest;
+    csMD5::md5_finish (&md5, digest.data);
+    return digest;
+  }
+
+  csMD5::Digest BakeCache::ComputeLightHash (Light* light)
+  {
+    csMD5::md5_state_t md5;
+    csMD5::md5_init (&md5);
+    light->UpdateHash (&md5);
+    csMD5::Digest digest;
+    csMD5::md5_finish (&md5, digest.data);
+    return digest;
+  }
+}
@@ -38,6 +38,10 @@ namespace lighter
     lighterProperties.numThreads = CS::Platform::GetProcessorCount();
     lighterProperties.saveBinaryBuffers = true;
     lighterProperties.checkDupes = true;
+    lighterProperties.packetTracing = true;
+    lighterProperties.rayBenchmark = false;
+    lighterProperties.incremental = false;
+    lighterProperties.bakeCacheFile = "/this/lighter2.bakecache";
 
     lmProperties.lmDensity = 4.0f;
     lmProperties.maxLightmapU = 1024;
@@ -69,6 +73,14 @@ namespace lighter
       lighterProperties.numThreads);
     lighterProperties.checkDupes = cfgFile->GetBool ("lighter2.CheckDupes",
       lighterProperties.checkDupes);
+    lighterProperties.packetTracing = cfgFile->GetBool (
+      "lighter2.PacketTracing", lighterProperties.packetTracing);
+    lighterProperties.rayBenchmark = cfgFile->GetBool (
+      "lighter2.RayBenchmark", lighterProperties.rayBenchmark);
+    lighterProperties.incremental = cfgFile->GetBool (
+      "lighter2.Incremental", lighterProperties.incremental);
+    lighterProperties.bakeCacheFile = cfgFile->GetStr (
+      "lighter2.BakeCache", lighterProperties.bakeCacheFile);
 
     lmProperties.lmDensity = cfgFile->GetFloat ("lighter2.lmDensity", 
       lmProperties.lmDensity);
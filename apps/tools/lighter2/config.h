@@ -48,6 +48,14 @@ namespace lighter
       bool saveBinaryBuffers;
       // Check for duplicate objects when loading map data.
       bool checkDupes;
+      // Trace shadow rays of neighbouring samples as packets
+      bool packetTracing;
+      // Benchmark the raytracer before lighting
+      bool rayBenchmark;
+      // Reuse unchanged direct lighting results of the last run
+      bool incremental;
+      // VFS path of the cache of lighting results
+      csString bakeCacheFile;
     };
 
     // Lightmap and lightmap layout properties
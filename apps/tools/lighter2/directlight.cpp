@@ -31,7 +31,9 @@ namespace lighter
   DirectLighting::DirectLighting (const csVector3& tangentSpaceNorm, 
     size_t subLightmapNum) : tangentSpaceNorm (tangentSpaceNorm),
     fancyTangentSpaceNorm (!(tangentSpaceNorm - csVector3 (0, 0, 1)).IsZero ()),
-    subLightmapNum (subLightmapNum)
+    subLightmapNum (subLightmapNum),
+    packetTracing (globalConfig.GetLighterProperties ().packetTracing),
+    bakeCache (0)
   {
     if (globalLighter->configMgr->GetBool ("lighter2.DirectLightRandom", false))
     {
@@ -132,6 +134,9 @@ namespace lighter
       v += size_t (floorf (minUV.y));
     }
 
+    // Shade the four quadrants together so shadow rays can be packet traced
+    csVector3 points[4], normals[4];
+    InfluenceRecorder inflRecs[4];
     for (size_t qi = 0; qi < 4; ++qi)
     {
       const csVector3 offsetVector = uVec * ElementQuadrantConstants[qi].x +
@@ -139,7 +144,7 @@ namespace lighter
 
       csVector3 pos = elementC + offsetVector;
       
-      const csVector3 normal = ComputeElementNormal (element, pos);
+      normals[qi] = ComputeElementNormal (element, pos);
       if (elemType == Primitive::ELEMENT_BORDER)
       {
         const float fudge = EPSILON;
@@ -147,28 +152,25 @@ namespace lighter
            occlusions by e.g. neighbouring prims */
         pos -= element.primitive.GetPlane().Normal() * fudge;
       }
+      points[qi] = pos;
 
       if (recordInfluence)
       {
         csMatrix3 ts (element.primitive.GetObject()->ComputeTangentSpace (
           &element.primitive, pos));
         
-        InfluenceRecorder inflRec (element.primitive.GetObject(),
+        inflRecs[qi] = InfluenceRecorder (element.primitive.GetObject(),
           u, v, ts, element.primitive.GetGroupID(), 0.25f);
-	res += shade.ShadeLight (element.primitive.GetObject(), 
-	  pos, normal, lightSampler,
-	  &element.primitive,
-	  elemType == Primitive::ELEMENT_BORDER,
-	  &inflRec);
-      }
-      else
-      {
-	res += shade.ShadeLight (element.primitive.GetObject(), 
-	  pos, normal, lightSampler,
-	  &element.primitive,
-	  elemType == Primitive::ELEMENT_BORDER);
       }
     }
+
+    csColor colors[4];
+    shade.ShadeLightPacket (element.primitive.GetObject(), 4, points, 
+      normals, lightSampler, &element.primitive,
+      elemType == Primitive::ELEMENT_BORDER, 
+      recordInfluence ? inflRecs : 0, colors);
+    for (size_t qi = 0; qi < 4; ++qi)
+      res += colors[qi];
     
     return 0.25f * res;
   }
@@ -212,6 +214,34 @@ namespace lighter
     return res;
   }
 
+  void DirectLighting::ShadeAllLightsNonPD::ShadeLightPacket (Object* obj,
+    size_t numPoints, const csVector3* points, const csVector3* normals,
+    SamplerSequence<2>& lightSampler,
+    const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+    InfluenceRecorder* influenceRecs, csColor* results)
+  {
+    CS_ALLOC_STACK_ARRAY(csColor, litColors, numPoints);
+    CS_ALLOC_STACK_ARRAY(csVector3, lightVecs, numPoints);
+    for (size_t p = 0; p < numPoints; ++p)
+      results[p].Set (0, 0, 0);
+    for (size_t i = 0; i < allLights.GetSize (); ++i)
+    {
+      if (!lighting.affectingLights.IsBitSet (i)) 
+        continue;
+
+      lighting.ShadeLightPacket (allLights[i], obj, numPoints, points, 
+        normals, lightSampler, shadowIgnorePrimitive, fullIgnore,
+        litColors, lightVecs);
+      for (size_t p = 0; p < numPoints; ++p)
+      {
+        if (influenceRecs)
+          influenceRecs[p].RecordInfluence (allLights[i], lightVecs[p],
+            litColors[p]);
+        results[p] += litColors[p];
+      }
+    }
+  }
+
   // Shade a primitive element with direct lighting
   csColor DirectLighting::UniformShadeAllLightsNonPD (Sector* sector, 
     ElementProxy element, SamplerSequence<2>& lightSampler,
@@ -245,6 +275,21 @@ namespace lighter
     return litColor;
   }
 
+  void DirectLighting::ShadeRndLightNonPD::ShadeLightPacket (Object* obj,
+    size_t numPoints, const csVector3* points, const csVector3* normals,
+    SamplerSequence<2>& sampler,
+    const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+    InfluenceRecorder* influenceRecs, csColor* results)
+  {
+    // Each point picks its own light, so there's nothing to trace together
+    for (size_t p = 0; p < numPoints; ++p)
+    {
+      results[p] = ShadeLight (obj, points[p], normals[p], sampler,
+        shadowIgnorePrimitive, fullIgnore, 
+        influenceRecs ? influenceRecs + p : 0);
+    }
+  }
+
   // Shade a primitive element with direct lighting using a single light
   csColor DirectLighting::UniformShadeRndLightNonPD (Sector* sector, 
     ElementProxy element, SamplerSequence<2>& sampler, bool recordInfluence)
@@ -279,6 +324,22 @@ namespace lighter
     return litColor;
   }
 
+  void DirectLighting::ShadeOneLight::ShadeLightPacket (Object* obj,
+    size_t numPoints, const csVector3* points, const csVector3* normals,
+    SamplerSequence<2>& sampler,
+    const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+    InfluenceRecorder* influenceRecs, csColor* results)
+  {
+    CS_ALLOC_STACK_ARRAY(csVector3, lightVecs, numPoints);
+    lighting.ShadeLightPacket (light, obj, numPoints, points, normals,
+      sampler, shadowIgnorePrimitive, fullIgnore, results, lightVecs);
+    if (influenceRecs)
+    {
+      for (size_t p = 0; p < numPoints; ++p)
+        influenceRecs[p].RecordInfluence (light, lightVecs[p], results[p]);
+    }
+  }
+
   csColor DirectLighting::UniformShadeOneLight (Sector* sector, ElementProxy element,
     Light* light, SamplerSequence<2>& sampler, bool recordInfluence)
   {
@@ -361,6 +422,69 @@ namespace lighter
     return csColor (0,0,0);
   }
 
+  void DirectLighting::ShadeLightPacket (Light* light, Object* obj, 
+    size_t numPoints, const csVector3* points, const csVector3* normals,
+    SamplerSequence<2>& lightSampler, 
+    const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+    csColor* results, csVector3* incomingLightVecs)
+  {
+    // Border elements need an ignore callback which packets don't support
+    if (!packetTracing || fullIgnore || (numPoints > RayPacket::PACKET_SIZE))
+    {
+      for (size_t p = 0; p < numPoints; ++p)
+      {
+        results[p] = ShadeLight (light, obj, points[p], normals[p], 
+          lightSampler, shadowIgnorePrimitive, fullIgnore, 
+          incomingLightVecs + p);
+      }
+      return;
+    }
+
+    VisibilityTester visTesters[RayPacket::PACKET_SIZE];
+    VisibilityTester* testTesters[RayPacket::PACKET_SIZE];
+    VisibilityTester::OcclusionState occlusion[RayPacket::PACKET_SIZE];
+    csColor lightColors[RayPacket::PACKET_SIZE];
+    size_t testPoints[RayPacket::PACKET_SIZE];
+    size_t numTests = 0;
+    const Object* ignObj = obj->GetFlags().Check (OBJECT_FLAG_NOSELFSHADOW)
+      ? obj : 0;
+
+    // Sample the light for each point, collecting the shadow rays to trace
+    for (size_t p = 0; p < numPoints; ++p)
+    {
+      float lightPdf, cosineTerm = 0;
+      // Only delta lights for now, see ShadeLight()
+      float lightSamples[2] = {0};
+
+      results[p].Set (0, 0, 0);
+      visTesters[p].SetLightObject (light, obj);
+      csColor lightColor = light->SampleLight (points[p], normals[p],
+        lightSamples[0], lightSamples[1], incomingLightVecs[p], lightPdf,
+        visTesters[p]);
+
+      if (lightPdf > 0.0f && !lightColor.IsBlack () &&
+        (cosineTerm = normals[p] * incomingLightVecs[p]) > 0)
+      {
+        lightColors[p] = lightColor * fabsf (cosineTerm) / lightPdf;
+        testTesters[numTests] = &visTesters[p];
+        testPoints[numTests] = p;
+        numTests++;
+      }
+    }
+
+    VisibilityTester::Occlusion (testTesters, numTests, ignObj, 
+      shadowIgnorePrimitive, occlusion);
+    for (size_t t = 0; t < numTests; ++t)
+    {
+      const size_t p = testPoints[t];
+      if (occlusion[t] == VisibilityTester::occlOccluded)
+        continue;
+      else if (occlusion[t] == VisibilityTester::occlPartial)
+        lightColors[p] *= visTesters[p].GetFilterColor ();
+      results[p] = lightColors[p];
+    }
+  }
+
   //--------------------------------------------------------------------------
 
   void DirectLighting::ShadeDirectLighting (Sector* sector, 
@@ -439,6 +563,27 @@ namespace lighter
       }
     }
 
+    const bool recordInfluence =
+      globalConfig.GetLighterProperties().specularDirectionMaps
+      && (subLightmapNum == 0);
+
+    /* When baking incrementally, fetch the results of the last run and 
+       set up storage for the results of this run. Influences for specular
+       direction maps are not cached, so everything is shaded then. */
+    CacheState cache (PDLights.GetSize ());
+    if (bakeCache && !recordInfluence)
+    {
+      size_t numSamples = 0;
+      for (size_t submesh = 0; submesh < submeshArray.GetSize (); ++submesh)
+      {
+        PrimitiveArray& primArray = submeshArray[submesh];
+        for (size_t pidx = 0; pidx < primArray.GetSize (); ++pidx)
+          numSamples += primArray[pidx].GetElementCount ();
+      }
+      cache.Setup (bakeCache, obj, subLightmapNum, PDLights, numSamples);
+    }
+
+    size_t sampleIndex = 0;
     for (size_t submesh = 0; submesh < submeshArray.GetSize (); ++submesh)
     {
       PrimitiveArray& primArray = submeshArray[submesh];
@@ -451,6 +596,8 @@ namespace lighter
 
         area2pixel = 
           1.0f / (prim.GetuFormVector () % prim.GetvFormVector ()).Norm();
+        const float elementRadius = 0.5f * (prim.GetuFormVector ().Norm ()
+          + prim.GetvFormVector ().Norm ());
 
         //const ElementAreas& areas = prim.GetElementAreas ();
         size_t numElements = prim.GetElementCount ();        
@@ -459,10 +606,6 @@ namespace lighter
 
         ScopedSwapLock<Lightmap> lightLock (*normalLM);
         
-        bool recordInfluence =
-          globalConfig.GetLighterProperties().specularDirectionMaps
-          && (subLightmapNum == 0);
-        
         pdLightLMs.Empty ();
         for (size_t pdli = 0; pdli < PDLights.GetSize (); ++pdli)
         {
@@ -478,7 +621,7 @@ namespace lighter
         const size_t vOffs = size_t (floorf (minUV.y));
 
         // Iterate all elements
-        for (size_t eidx = 0; eidx < numElements; ++eidx)
+        for (size_t eidx = 0; eidx < numElements; ++eidx, ++sampleIndex)
         {
           //const float elArea = areas.GetElementArea (eidx);
           Primitive::ElementType elemType = prim.GetElementType (eidx);
@@ -500,12 +643,25 @@ namespace lighter
             elemType == Primitive::ELEMENT_BORDER ? prim.ComputeElementFraction (eidx) : 
                                                     1.0f;
 
+          const bool dirty = cache.IsSampleDirty (
+            prim.ComputeElementCenter (eidx), elementRadius);
+
           // Shade non-PD lights
           csColor c;        
-          c = (this->*lmElementShader) (sector, ep, masterSampler,
-            recordInfluence);
+          if (!dirty && cache.cachedColors)
+          {
+            c = cache.cachedColors[sampleIndex];
+            cache.numReused++;
+          }
+          else
+          {
+            c = (this->*lmElementShader) (sector, ep, masterSampler,
+              recordInfluence) * pixelAreaPart;
+            cache.numShaded++;
+          }
+          if (cache.resultColors) cache.resultColors[sampleIndex] = c;
 
-          normalLM->SetAddPixel (u, v, c * pixelAreaPart);
+          normalLM->SetAddPixel (u, v, c);
 
           // Shade PD lights
           for (size_t pdli = 0; pdli < PDLights.GetSize (); ++pdli)
@@ -515,10 +671,15 @@ namespace lighter
             Lightmap* lm = pdLightLMs[pdli];
             Light* pdl = PDLights[pdli];
 
-            c = UniformShadeOneLight (sector, ep, pdl, masterSampler,
-              recordInfluence);
+            if (!dirty && cache.cachedPDColors[pdli])
+              c = cache.cachedPDColors[pdli][sampleIndex];
+            else
+              c = UniformShadeOneLight (sector, ep, pdl, masterSampler,
+                recordInfluence) * pixelAreaPart;
+            if (cache.resultPDColors[pdli])
+              cache.resultPDColors[pdli][sampleIndex] = c;
 
-            lm->SetAddPixel (u, v, c * pixelAreaPart);
+            lm->SetAddPixel (u, v, c);
           }
           progress.Advance ();
         }
@@ -528,6 +689,8 @@ namespace lighter
         }
       }
     }
+
+    if (bakeCache) bakeCache->CountSamples (cache.numReused, cache.numShaded);
   }
 
   void DirectLighting::ShadePerVertex (Sector* sector, Object* obj, 
@@ -548,6 +711,11 @@ namespace lighter
       }
     }
 
+    CacheState cache (PDLights.GetSize ());
+    if (bakeCache)
+      cache.Setup (bakeCache, obj, subLightmapNum, PDLights,
+        vdata.positions.GetSize ());
+
     for (size_t i = 0; i < vdata.positions.GetSize (); ++i)
     {
       csColor& c = litColors->Get (i);
@@ -557,20 +725,57 @@ namespace lighter
       c = csColor (normalBiased.x, normalBiased.y, normalBiased.z);
 #else
       const csVector3& pos = vdata.positions[i];
-      c = (this->*pvlPointShader) (sector, obj, pos, normal, masterSampler);
+      const bool dirty = cache.IsSampleDirty (pos, 0);
+      if (!dirty && cache.cachedColors)
+      {
+        c = cache.cachedColors[i];
+        cache.numReused++;
+      }
+      else
+      {
+        c = (this->*pvlPointShader) (sector, obj, pos, normal, masterSampler);
+        cache.numShaded++;
+      }
+      if (cache.resultColors) cache.resultColors[i] = c;
 
       // Shade PD lights
       for (size_t pdli = 0; pdli < PDLights.GetSize (); ++pdli)
       {
         Light* pdl = PDLights[pdli];
         Object::LitColorArray* pdlColors = obj->GetLitColorsPD (pdl, subLightmapNum);
-        pdlColors->Get (i) += UniformShadeOneLight (sector, obj, pos, normal, pdl,
-          masterSampler);
+        csColor pdc;
+        if (!dirty && cache.cachedPDColors[pdli])
+          pdc = cache.cachedPDColors[pdli][i];
+        else
+          pdc = UniformShadeOneLight (sector, obj, pos, normal, pdl,
+            masterSampler);
+        if (cache.resultPDColors[pdli])
+          cache.resultPDColors[pdli][i] = pdc;
+        pdlColors->Get (i) += pdc;
       }
 #endif
       progress.Advance ();
     }
 
+    if (bakeCache) bakeCache->CountSamples (cache.numReused, cache.numShaded);
+  }
+
+  void DirectLighting::CacheState::Setup (BakeCache* bakeCache, Object* obj,
+    size_t subLightmapNum, const LightRefArray& PDLights, size_t numSamples)
+  {
+    cachedColors = bakeCache->GetCachedColors (obj, subLightmapNum, 0,
+      numSamples);
+    resultColors = bakeCache->GetResultColors (obj, subLightmapNum, 0,
+      numSamples);
+    for (size_t pdli = 0; pdli < PDLights.GetSize (); ++pdli)
+    {
+      cachedPDColors[pdli] = bakeCache->GetCachedColors (obj, subLightmapNum,
+        PDLights[pdli], numSamples);
+      resultPDColors[pdli] = bakeCache->GetResultColors (obj, subLightmapNum,
+        PDLights[pdli], numSamples);
+    }
+    bakeCache->GetDirtyRegions (obj->GetBoundingSphere (), dirtyRegions);
+    useCache = true;
   }
 
   csVector3 DirectLighting::ComputeElementNormal (ElementProxy element,
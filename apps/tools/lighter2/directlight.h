@@ -21,6 +21,7 @@
 
 #include "csutil/noncopyable.h"
 
+#include "bakecache.h"
 #include "light.h"
 #include "lightmap.h"
 #include "primitive.h"
@@ -42,6 +43,9 @@ namespace lighter
     // Setup
     DirectLighting (const csVector3& tangentSpaceNorm, size_t subLightmapNum);
 
+    // Set cache of a previous run to reuse unchanged results from
+    void SetBakeCache (BakeCache* cache) { bakeCache = cache; }
+
     // Shade by using all primitives within range
     void ShadeDirectLighting (Sector* sector, 
       Statistics::Progress& progress);
@@ -93,10 +97,11 @@ namespace lighter
     {
       Object* obj;
       size_t u, v;
-      const csMatrix3& ts;
+      csMatrix3 ts;
       uint primGroup;
       float weight;
     
+      InfluenceRecorder () {}
       InfluenceRecorder (Object* obj, size_t u, size_t v,
         const csMatrix3& ts, uint primGroup,
         float weight) : obj (obj), u (u), v (v), ts (ts),
@@ -117,6 +122,11 @@ namespace lighter
         const csVector3& normal, SamplerSequence<2>& lightSampler, 
         const Primitive* shadowIgnorePrimitive = 0, 
         bool fullIgnore = false, InfluenceRecorder* influenceRec = 0);
+      inline void ShadeLightPacket (Object* obj, size_t numPoints,
+        const csVector3* points, const csVector3* normals, 
+        SamplerSequence<2>& lightSampler, 
+        const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+        InfluenceRecorder* influenceRecs, csColor* results);
     };
 
     struct ShadeRndLightNonPD
@@ -132,6 +142,11 @@ namespace lighter
         const csVector3& normal, SamplerSequence<2>& sampler, 
         const Primitive* shadowIgnorePrimitive = 0, 
         bool fullIgnore = false, InfluenceRecorder* influenceRec = 0);
+      inline void ShadeLightPacket (Object* obj, size_t numPoints,
+        const csVector3* points, const csVector3* normals, 
+        SamplerSequence<2>& sampler, 
+        const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+        InfluenceRecorder* influenceRecs, csColor* results);
     };
     struct ShadeOneLight
     {
@@ -143,6 +158,11 @@ namespace lighter
         const csVector3& normal, SamplerSequence<2>& sampler, 
         const Primitive* shadowIgnorePrimitive = 0, 
         bool fullIgnore = false, InfluenceRecorder* influenceRec = 0);
+      inline void ShadeLightPacket (Object* obj, size_t numPoints,
+        const csVector3* points, const csVector3* normals, 
+        SamplerSequence<2>& sampler, 
+        const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+        InfluenceRecorder* influenceRecs, csColor* results);
     };
 
     // Methods...
@@ -152,6 +172,14 @@ namespace lighter
       const Primitive* shadowIgnorePrimitive = 0, 
       bool fullIgnore = false, csVector3* incomingLightVec = 0);
 
+    /* Shade a number of points with one light. Shadow rays are traced as 
+       packets if enabled. */
+    inline void ShadeLightPacket (Light* light, Object* obj, 
+      size_t numPoints, const csVector3* points, const csVector3* normals,
+      SamplerSequence<2>& lightSampler, 
+      const Primitive* shadowIgnorePrimitive, bool fullIgnore,
+      csColor* results, csVector3* incomingLightVecs);
+
     class ProgressState
     {
       Statistics::Progress& progress;
@@ -176,6 +204,34 @@ namespace lighter
       }
     };
 
+    // Per-object state of incremental baking
+    struct CacheState
+    {
+      bool useCache;
+      const csColor* cachedColors;
+      csColor* resultColors;
+      csArray<const csColor*> cachedPDColors;
+      csArray<csColor*> resultPDColors;
+      csArray<csSphere> dirtyRegions;
+      size_t numReused, numShaded;
+
+      CacheState (size_t numPDLights) : useCache (false), cachedColors (0),
+        resultColors (0), numReused (0), numShaded (0)
+      {
+        cachedPDColors.SetSize (numPDLights, 0);
+        resultPDColors.SetSize (numPDLights, 0);
+      }
+
+      void Setup (BakeCache* bakeCache, Object* obj, size_t subLightmapNum,
+        const LightRefArray& PDLights, size_t numSamples);
+
+      // Whether a sample has to be shaded anew
+      bool IsSampleDirty (const csVector3& pos, float radius) const
+      {
+        return !useCache || BakeCache::IsDirty (dirtyRegions, pos, radius);
+      }
+    };
+
     void ShadeLightmap (Sector* sector, Object* obj, 
       SamplerSequence<2>& masterSampler, ProgressState& progress);
 
@@ -196,6 +252,8 @@ namespace lighter
     PVLPointShader pvlPointShader;
     LMElementShader lmElementShader;
     csBitArray affectingLights;
+    bool packetTracing;
+    BakeCache* bakeCache;
   };
 }
 
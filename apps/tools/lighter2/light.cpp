@@ -23,6 +23,7 @@
 #include "raytracer.h"
 #include "kdtree.h"
 #include "scene.h"
+#include "bakecache.h"
 
 // Attenuation functions
 static float LightAttnNone (float, const csVector4&);
@@ -63,6 +64,18 @@ namespace lighter
     attenuationFunc = attnFuncTable[mode];
   }
 
+  void Light::UpdateHash (csMD5::md5_state_t* md5) const
+  {
+    HashAppend (md5, position);
+    HashAppend (md5, color);
+    HashAppend (md5, attenuationMode);
+    HashAppend (md5, attenuationConsts);
+    HashAppend (md5, boundingSphere.GetCenter ());
+    HashAppend (md5, boundingSphere.GetRadius ());
+    HashAppend (md5, deltaDistribution);
+    HashAppend (md5, pseudoDynamic);
+  }
+
 
   //--
   size_t VisibilityTester::rayID;
@@ -222,6 +235,53 @@ namespace lighter
 
     return (transparentHits.GetSize() != 0) ? occlPartial : occlUnoccluded;
   }
+
+  void VisibilityTester::Occlusion (VisibilityTester* const* testers, 
+    size_t num, const Object* ignoreObject, const Primitive* ignorePrim,
+    OcclusionState* states)
+  {
+    // Ray debugging wants to see every hit, so trace one by one then
+    bool usePackets = !globalLighter->rayDebug.IsEnabled() && (num > 1);
+    for (size_t i = 0; usePackets && (i < num); ++i)
+    {
+      usePackets = (testers[i]->allSegments.GetSize () == 1)
+        && (testers[i]->allSegments[0].tree == testers[0]->allSegments[0].tree);
+    }
+    if (!usePackets)
+    {
+      for (size_t i = 0; i < num; ++i)
+        states[i] = testers[i]->Occlusion (ignoreObject, ignorePrim);
+      return;
+    }
+
+    KDTree* tree = testers[0]->allSegments[0].tree;
+    for (size_t first = 0; first < num; first += RayPacket::PACKET_SIZE)
+    {
+      RayPacket packet;
+      packet.numRays = csMin (num - first, (size_t)RayPacket::PACKET_SIZE);
+      for (size_t i = 0; i < packet.numRays; ++i)
+      {
+        Segment& s = testers[first+i]->allSegments[0];
+        s.ray.ignoreObject = ignoreObject;
+        s.ray.ignorePrimitive = ignorePrim;
+        packet.rays[i] = s.ray;
+      }
+
+      HitPoint hits[RayPacket::PACKET_SIZE];
+      const uint hitMask = Raytracer::TraceAnyHitPacket (tree, packet, hits);
+      for (size_t i = 0; i < packet.numRays; ++i)
+      {
+        if (!(hitMask & (1 << i)))
+          states[first+i] = occlUnoccluded;
+        else if (!(hits[i].kdFlags & KDPRIM_FLAG_TRANSPARENT))
+          states[first+i] = occlOccluded;
+        else
+          // Need all hits to compute the filter color
+          states[first+i] = testers[first+i]->Occlusion (ignoreObject,
+            ignorePrim);
+      }
+    }
+  }
     
   csColor VisibilityTester::GetFilterColor ()
   {
@@ -283,6 +343,12 @@ namespace lighter
     boundingSphere.SetRadius (r);
   }
 
+  void PointLight::UpdateHash (csMD5::md5_state_t* md5) const
+  {
+    Light::UpdateHash (md5);
+    HashAppend (md5, radius);
+  }
+
 
 
 
@@ -351,6 +417,14 @@ namespace lighter
     dir = d;
   }
 
+  void DirectionalLight::UpdateHash (csMD5::md5_state_t* md5) const
+  {
+    Light::UpdateHash (md5);
+    HashAppend (md5, radius);
+    HashAppend (md5, length);
+    HashAppend (md5, dir);
+  }
+
 
 
 
@@ -418,6 +492,14 @@ namespace lighter
     dir = d;
   }
 
+  void SpotLight::UpdateHash (csMD5::md5_state_t* md5) const
+  {
+    Light::UpdateHash (md5);
+    HashAppend (md5, inner);
+    HashAppend (md5, outer);
+    HashAppend (md5, dir);
+  }
+
 
 
 
@@ -488,6 +570,16 @@ namespace lighter
   {
     return proxyTransform.Other2This (parent->GetLightSamplePosition (u1, u2));
   }
+
+  void ProxyLight::UpdateHash (csMD5::md5_state_t* md5) const
+  {
+    parent->UpdateHash (md5);
+    HashAppend (md5, boundingSphere.GetCenter ());
+    HashAppend (md5, boundingSphere.GetRadius ());
+    HashAppend (md5, proxyTransform.GetO2T ());
+    HashAppend (md5, proxyTransform.GetO2TTranslation ());
+    HashAppend (md5, portalPlane);
+  }
 }
 
 
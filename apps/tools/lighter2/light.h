@@ -36,7 +36,14 @@ namespace lighter
   {
     static size_t rayID;
   public:
-    VisibilityTester (Light* light, Object* obj);
+    VisibilityTester (Light* light = 0, Object* obj = 0);
+
+    /// Set light and object (used for ray debugging)
+    void SetLightObject (Light* light, Object* obj)
+    {
+      this->light = light;
+      this->obj = obj;
+    }
 
     enum OcclusionState
     {
@@ -49,6 +56,14 @@ namespace lighter
     OcclusionState Occlusion (const Object* ignoreObject,
       HitIgnoreCallback* ignoreCB);
 
+    /**
+     * Test occlusion of a number of testers at once. Testers with a single
+     * segment in the same tree have their rays traced as packets.
+     */
+    static void Occlusion (VisibilityTester* const* testers, size_t num,
+      const Object* ignoreObject, const Primitive* ignorePrim, 
+      OcclusionState* states);
+
     
     csColor GetFilterColor ();
 
@@ -205,6 +220,12 @@ namespace lighter
      * If the light is not a proxy simply returns pointer to itself.
      */
     virtual Light* GetOriginalLight () { return this; }
+
+    /**
+     * Feed all parameters affecting the lighting result into \a md5.
+     * Used to detect changed lights when baking incrementally.
+     */
+    virtual void UpdateHash (csMD5::md5_state_t* md5) const;
   protected:
     /// Constructor
     Light (Sector* owner, bool deltaDistribution);
@@ -267,6 +288,7 @@ namespace lighter
 
     void SetRadius (float radius);
 
+    virtual void UpdateHash (csMD5::md5_state_t* md5) const;
   protected:
     /// Compute the light position from given sampling values
     virtual csVector3 GetLightSamplePosition (float u1, float u2)
@@ -316,6 +338,7 @@ namespace lighter
 
     void SetDirection (csVector3 direction);
 
+    virtual void UpdateHash (csMD5::md5_state_t* md5) const;
   protected:
     /// Compute the light position from given sampling values
     virtual csVector3 GetLightSamplePosition (float u1, float u2)
@@ -367,6 +390,7 @@ namespace lighter
 
     void SetDirection (csVector3 direction);
 
+    virtual void UpdateHash (csMD5::md5_state_t* md5) const;
   protected:
     /// Compute the light position from given sampling values
     virtual csVector3 GetLightSamplePosition (float u1, float u2)
@@ -397,6 +421,8 @@ namespace lighter
     virtual csColor GetPower () const;
 
     virtual Light* GetOriginalLight () { return parent->GetOriginalLight(); }
+
+    virtual void UpdateHash (csMD5::md5_state_t* md5) const;
   private:
     /// Compute the light position from given sampling values
     virtual csVector3 GetLightSamplePosition (float u1, float u2);
@@ -29,6 +29,7 @@
 #include "scene.h"
 #include "statistics.h"
 #include "tui.h"
+#include "bakecache.h"
 #include "directlight.h"
 #include "sampler.h"
 
@@ -41,6 +42,7 @@ namespace lighter
 
   Lighter::Lighter (iObjectRegistry *objectRegistry)
     : objectRegistry (objectRegistry), swapManager (0), scene (new Scene),
+      bakeCache (0),
       progStartup ("Starting up", 5),
       progLoadFiles ("Loading files", 2),
       progLightmapLayout ("Lightmap layout", 5),
@@ -238,6 +240,7 @@ namespace lighter
     if (scene) scene->CleanUp (*progCleanupScene);
     delete progCleanupScene;
     delete scene; scene = 0;
+    delete bakeCache; bakeCache = 0;
     progress.SetProgress (1*progressStep);
     
     delete swapManager; swapManager = 0;
@@ -279,9 +282,28 @@ namespace lighter
 
     // Build the KD-trees
     BuildKDTrees ();
+
+    if (globalConfig.GetLighterProperties ().incremental)
+      PrepareBakeCache ();
    
     // Shoot direct lighting
+    const bool rayBenchmark = globalConfig.GetLighterProperties ().rayBenchmark;
+    if (rayBenchmark)
+      BenchmarkRaytracer ();
+    const uint64 dlRays = globalStats.raytracer.numRays;
+    const int64 dlStart = csGetMicroTicks ();
     DoDirectLighting ();   
+    if (rayBenchmark)
+    {
+      // Direct lighting runs on one core
+      const int64 dlTime = csMax (csGetMicroTicks () - dlStart, (int64)1);
+      csReport (objectRegistry, CS_REPORTER_SEVERITY_NOTIFY,
+        "crystalspace.application.lighter2",
+        "Direct lighting: %.0f rays/s per core",
+        double (globalStats.raytracer.numRays - dlRays) * 1e6 / dlTime);
+    }
+    if (bakeCache)
+      SaveBakeCache ();
 
     //@@ DO OTHER LIGHTING
 
@@ -449,6 +471,7 @@ namespace lighter
       for (int p = 0; p < numDLPasses; p++)
       {
         DirectLighting lighting (bases[p], p);
+        lighting.SetBakeCache (bakeCache);
 
         SectorHash::GlobalIterator sectIt = 
           scene->GetSectors ().GetIterator ();
@@ -465,6 +488,124 @@ namespace lighter
     }
   }
 
+  void Lighter::PrepareBakeCache ()
+  {
+    const char* filename = 
+      globalConfig.GetLighterProperties ().bakeCacheFile;
+    bakeCache = new BakeCache (BakeCache::ComputeConfigHash ());
+    if (!bakeCache->Load (vfs, filename))
+      csReport (objectRegistry, CS_REPORTER_SEVERITY_NOTIFY,
+        "crystalspace.application.lighter2",
+        "No usable bake cache '%s', lighting everything", 
+        filename);
+    bakeCache->Prepare (scene);
+  }
+
+  void Lighter::SaveBakeCache ()
+  {
+    const char* filename = 
+      globalConfig.GetLighterProperties ().bakeCacheFile;
+    if (!bakeCache->Save (vfs, filename))
+      Report ("Error writing bake cache '%s'", filename);
+
+    csReport (objectRegistry, CS_REPORTER_SEVERITY_NOTIFY,
+      "crystalspace.application.lighter2",
+      "Incremental lighting: %zu changed objects, %zu changed lights, "
+      "%zu samples reused, %zu samples shaded",
+      bakeCache->GetChangedObjectCount (), bakeCache->GetChangedLightCount (),
+      bakeCache->GetReusedSamples (), bakeCache->GetShadedSamples ());
+  }
+
+  void Lighter::BenchmarkRaytracer ()
+  {
+    /* Shoot shadow rays from random points to all lights. Each packet starts
+       at points close together, like the samples of a lightmap element. */
+    static const size_t packetsPerLight = 20000;
+    csRandomGen rng (1234);
+    csArray<RayPacket> packets;
+    SectorHash::GlobalIterator sectIt = scene->GetSectors ().GetIterator ();
+    while (sectIt.HasNext ())
+    {
+      csRef<Sector> sect = sectIt.Next ();
+      if (!sect->kdTree) continue;
+
+      const csBox3& box = sect->kdTree->boundingBox;
+      const float jitter = (box.Max() - box.Min()).Norm() * 0.001f;
+      LightRefArray lights (sect->allNonPDLights);
+      for (size_t l = 0; l < sect->allPDLights.GetSize(); l++)
+        lights.Push (sect->allPDLights[l]);
+
+      for (size_t l = 0; l < lights.GetSize(); l++)
+      {
+        const csVector3& lightPos = lights[l]->GetPosition();
+        for (size_t n = 0; n < packetsPerLight; n++)
+        {
+          const csVector3 base (
+            box.MinX() + rng.Get() * (box.MaxX() - box.MinX()),
+            box.MinY() + rng.Get() * (box.MaxY() - box.MinY()),
+            box.MinZ() + rng.Get() * (box.MaxZ() - box.MinZ()));
+
+          RayPacket packet;
+          packet.numRays = RayPacket::PACKET_SIZE;
+          for (size_t i = 0; i < packet.numRays; i++)
+          {
+            Ray& ray = packet.rays[i];
+            ray.origin = base + csVector3 (rng.Get(), rng.Get(), rng.Get())
+              * jitter;
+            ray.direction = lightPos - ray.origin;
+            const float d = ray.direction.Norm ();
+            ray.direction /= d;
+            ray.minLength = FLT_EPSILON*10.0f;
+            ray.maxLength = d - FLT_EPSILON*10.0f;
+            ray.ignoreFlags = KDPRIM_FLAG_NOSHADOW;
+          }
+          packets.Push (packet);
+        }
+      }
+
+      if (packets.GetSize() == 0) continue;
+      const size_t numRays = packets.GetSize() * RayPacket::PACKET_SIZE;
+
+      size_t scalarHits = 0;
+      const int64 scalarStart = csGetMicroTicks ();
+      for (size_t p = 0; p < packets.GetSize(); p++)
+      {
+        for (size_t i = 0; i < RayPacket::PACKET_SIZE; i++)
+        {
+          HitPoint hit;
+          if (Raytracer::TraceAnyHit (sect->kdTree, packets[p].rays[i], hit))
+            scalarHits++;
+        }
+      }
+      const int64 scalarTime = 
+        csMax (csGetMicroTicks () - scalarStart, (int64)1);
+
+      size_t packetHits = 0;
+      const int64 packetStart = csGetMicroTicks ();
+      for (size_t p = 0; p < packets.GetSize(); p++)
+      {
+        HitPoint hits[RayPacket::PACKET_SIZE];
+        uint hitMask = Raytracer::TraceAnyHitPacket (sect->kdTree, 
+          packets[p], hits);
+        for (; hitMask != 0; hitMask &= hitMask - 1)
+          packetHits++;
+      }
+      const int64 packetTime = 
+        csMax (csGetMicroTicks () - packetStart, (int64)1);
+
+      csReport (objectRegistry, CS_REPORTER_SEVERITY_NOTIFY,
+        "crystalspace.application.lighter2",
+        "Sector %s: %zu shadow rays, %.0f rays/s per core scalar, "
+        "%.0f rays/s per core %s packets (%zu/%zu hits)",
+        sect->sectorName.GetData(), numRays,
+        double (numRays) * 1e6 / scalarTime,
+        double (numRays) * 1e6 / packetTime,
+        Raytracer::HasSIMDPackets () ? "SSE" : "scalar",
+        scalarHits, packetHits);
+      packets.Empty ();
+    }
+  }
+
   void Lighter::PostprocessLightmaps ()
   {
     size_t realNumLMs = scene->GetLightmaps ().GetSize ();
@@ -657,6 +798,16 @@ namespace lighter
                   "meshes matching <regexp>\n");
       csPrintf (" --[no]binary\n");
       csPrintf ("  Whether to save buffers in binary format. Default: True\n");
+      csPrintf (" --[no]packettracing\n");
+      csPrintf ("  Trace shadow rays of neighbouring samples together. "
+                  "Default: True\n");
+      csPrintf (" --raybenchmark\n");
+      csPrintf ("  Report shadow ray throughput of the raytracer\n");
+      csPrintf (" --incremental\n");
+      csPrintf ("  Only relight what changed since the last run\n");
+      csPrintf (" --bakecache=<file>\n");
+      csPrintf ("  VFS path of the cache used for incremental lighting.\n"
+                "  Default: /this/lighter2.bakecache\n");
     }
 
     csPrintf ("\n");
@@ -34,6 +34,7 @@ namespace lighter
   class Scene;
   class Sector;
   class SwapManager;
+  class BakeCache;
 
   class Lighter : public csRefCount
   {
@@ -92,6 +93,15 @@ namespace lighter
     // Shoot direct lighting
     void DoDirectLighting ();
 
+    // Load the results of the last run and compare them to the scene
+    void PrepareBakeCache ();
+
+    // Save the results of this run for the next one
+    void SaveBakeCache ();
+
+    // Measure scalar and packet shadow ray throughput
+    void BenchmarkRaytracer ();
+
     // Post-process all lightmaps
     void PostprocessLightmaps ();
 
@@ -102,6 +112,7 @@ namespace lighter
     void CommandLineHelp (bool expert) const;
 
     Scene *scene;
+    BakeCache* bakeCache;
 
     csRef<LightmapUVFactoryLayouter> uvLayout;
 
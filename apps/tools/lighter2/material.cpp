@@ -33,6 +33,8 @@ namespace lighter
     csRGBpixel* srcPtr = (csRGBpixel*)img->GetImageData ();
     csColor* dstPtr = filterImage->GetData();
     size_t numPixels = filterImage->GetWidth() * filterImage->GetHeight();
+    filterChecksum = CS::Utility::Checksum::CRC32 (srcPtr, 
+      numPixels * sizeof (csRGBpixel));
     while (numPixels-- > 0)
     {
       const float ub2f = 1.0f/255.0f;
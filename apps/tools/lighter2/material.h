@@ -99,8 +99,10 @@ namespace lighter
   struct RadMaterial
   {
     csRef<MaterialImage<csColor> > filterImage;
+    // Checksum of the image the filter image was computed from
+    uint32 filterChecksum;
      
-    RadMaterial() {}
+    RadMaterial() : filterChecksum (0) {}
     
     bool IsTransparent () const { return filterImage.IsValid(); }
     void ComputeFilterImage (iImage* img);
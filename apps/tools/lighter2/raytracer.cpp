@@ -22,6 +22,14 @@
 #include "kdtree.h"
 #include "primitive.h"
 
+/* Packet tracing uses SSE when the compiler targets it; there is no runtime
+   switch since the rest of the code would be built with SSE anyway. */
+#if defined(__SSE__) || (defined(CS_COMPILER_MSVC) && \
+  (defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))))
+#define LIGHTER_PACKET_SSE
+#include <xmmintrin.h>
+#endif
+
 namespace lighter
 {
   RaytraceCore globalRaycore;
@@ -350,5 +358,320 @@ namespace lighter
       return TraceFunction<false> (tree, ray, hit, hitCB, ignCB);
     }
   }
-}
 
+  //-- Packet tracing
+
+  // Transposed copy of a ray packet
+  struct PacketRays
+  {
+    float origin[3][RayPacket::PACKET_SIZE];
+    float direction[3][RayPacket::PACKET_SIZE];
+    float invD[3][RayPacket::PACKET_SIZE];
+    float minLength[RayPacket::PACKET_SIZE];
+    float maxLength[RayPacket::PACKET_SIZE];
+    const Ray* rays[RayPacket::PACKET_SIZE];
+  };
+
+  // Intersect one primitive with all rays in rayMask, returns mask of hits
+  static CS_FORCEINLINE uint IntersectPrimitivePacket (
+    const KDTreePrimitive &primitive, const PacketRays& packet, uint rayMask,
+    float* dist)
+  {
+    const uint k = primitive.normal_K & ~KDPRIM_FLAG_MASK;
+    const uint ku = CS::Math::NextModulo3(k);
+    const uint kv = CS::Math::NextModulo3(ku);
+
+#ifdef LIGHTER_PACKET_SSE
+    const __m128 nU = _mm_set1_ps (primitive.normal_U);
+    const __m128 nV = _mm_set1_ps (primitive.normal_V);
+    const __m128 dK = _mm_loadu_ps (packet.direction[k]);
+    const __m128 dKu = _mm_loadu_ps (packet.direction[ku]);
+    const __m128 dKv = _mm_loadu_ps (packet.direction[kv]);
+    const __m128 oK = _mm_loadu_ps (packet.origin[k]);
+    const __m128 oKu = _mm_loadu_ps (packet.origin[ku]);
+    const __m128 oKv = _mm_loadu_ps (packet.origin[kv]);
+    const __m128 one = _mm_set1_ps (1.0f);
+    const __m128 zero = _mm_setzero_ps ();
+
+    const __m128 nd = _mm_div_ps (one, _mm_add_ps (dK, 
+      _mm_add_ps (_mm_mul_ps (nU, dKu), _mm_mul_ps (nV, dKv))));
+    const __m128 f = _mm_mul_ps (_mm_sub_ps (_mm_sub_ps (_mm_sub_ps (
+      _mm_set1_ps (primitive.normal_D), oK), _mm_mul_ps (nU, oKu)),
+      _mm_mul_ps (nV, oKv)), nd);
+
+    // Check for distance..
+    __m128 valid = _mm_and_ps (
+      _mm_cmpgt_ps (_mm_loadu_ps (packet.maxLength), f),
+      _mm_cmpgt_ps (f, _mm_loadu_ps (packet.minLength)));
+    if ((_mm_movemask_ps (valid) & rayMask) == 0) return 0;
+
+    // Hitpoints on plane
+    const __m128 hu = _mm_add_ps (oKu, _mm_mul_ps (f, dKu));
+    const __m128 hv = _mm_add_ps (oKv, _mm_mul_ps (f, dKv));
+
+    // Barycentric coordinates
+    const __m128 lambda = _mm_add_ps (_mm_add_ps (
+      _mm_mul_ps (hu, _mm_set1_ps (primitive.edgeA_U)),
+      _mm_mul_ps (hv, _mm_set1_ps (primitive.edgeA_V))),
+      _mm_set1_ps (primitive.edgeA_D));
+    const __m128 mu = _mm_add_ps (_mm_add_ps (
+      _mm_mul_ps (hu, _mm_set1_ps (primitive.edgeB_U)),
+      _mm_mul_ps (hv, _mm_set1_ps (primitive.edgeB_V))),
+      _mm_set1_ps (primitive.edgeB_D));
+    valid = _mm_and_ps (valid, _mm_cmpge_ps (lambda, zero));
+    valid = _mm_and_ps (valid, _mm_cmpge_ps (mu, zero));
+    valid = _mm_and_ps (valid, _mm_cmple_ps (_mm_add_ps (lambda, mu), one));
+
+    const uint hitMask = _mm_movemask_ps (valid) & rayMask;
+    if (hitMask) _mm_storeu_ps (dist, f);
+    return hitMask;
+#else
+    uint hitMask = 0;
+    for (uint i = 0; i < RayPacket::PACKET_SIZE; ++i)
+    {
+      if (!(rayMask & (1 << i))) continue;
+
+      const float nd = 1.0f / (packet.direction[k][i] + 
+        primitive.normal_U * packet.direction[ku][i] + 
+        primitive.normal_V * packet.direction[kv][i]);
+      const float f = (primitive.normal_D - packet.origin[k][i] - 
+        primitive.normal_U * packet.origin[ku][i] - 
+        primitive.normal_V * packet.origin[kv][i]) * nd;
+      if (!(packet.maxLength[i] > f && f > packet.minLength[i])) continue;
+
+      const float hu = (packet.origin[ku][i] + f * packet.direction[ku][i]);
+      const float hv = (packet.origin[kv][i] + f * packet.direction[kv][i]);
+
+      const float lambda = (hu * primitive.edgeA_U + hv * primitive.edgeA_V +
+        primitive.edgeA_D);
+      if (lambda < 0.0f) continue;
+      const float mu = (hu * primitive.edgeB_U + hv * primitive.edgeB_V + 
+        primitive.edgeB_D);
+      if (mu < 0.0f) continue;
+      if (lambda + mu > 1.0f) continue;
+
+      dist[i] = f;
+      hitMask |= 1 << i;
+    }
+    return hitMask;
+#endif
+  }
+
+  /* Compute the split plane distances for all rays and classify which rays 
+     only pass on the far (below) or near (above) side of the plane. */
+  static CS_FORCEINLINE void ClassifyPacketSplit (float split, 
+    const PacketRays& packet, uint dim, const float* tnear, const float* tfar,
+    float* thit, uint& liveMask, uint& belowMask, uint& aboveMask)
+  {
+#ifdef LIGHTER_PACKET_SSE
+    const __m128 t = _mm_mul_ps (_mm_sub_ps (_mm_set1_ps (split), 
+      _mm_loadu_ps (packet.origin[dim])), _mm_loadu_ps (packet.invD[dim]));
+    const __m128 tn = _mm_loadu_ps (tnear);
+    const __m128 tf = _mm_loadu_ps (tfar);
+    _mm_storeu_ps (thit, t);
+    liveMask &= _mm_movemask_ps (_mm_cmple_ps (tn, tf));
+    belowMask = _mm_movemask_ps (_mm_cmplt_ps (t, tn)) & liveMask;
+    aboveMask = _mm_movemask_ps (_mm_cmpgt_ps (t, tf)) & liveMask;
+#else
+    uint live = 0;
+    belowMask = aboveMask = 0;
+    for (uint i = 0; i < RayPacket::PACKET_SIZE; ++i)
+    {
+      thit[i] = (split - packet.origin[dim][i]) * packet.invD[dim][i];
+      if (tnear[i] <= tfar[i]) live |= 1 << i;
+      if (thit[i] < tnear[i]) belowMask |= 1 << i;
+      if (thit[i] > tfar[i]) aboveMask |= 1 << i;
+    }
+    liveMask &= live;
+    belowMask &= liveMask;
+    aboveMask &= liveMask;
+#endif
+  }
+
+  uint Raytracer::TraceAnyHitPacket (const KDTree* tree, 
+    const RayPacket& packet, HitPoint* hits)
+  {
+    if (!tree || !tree->nodeList || (packet.numRays == 0)) 
+      return 0;
+
+    // Packets with diverging rays are traced ray by ray
+    if ((packet.numRays == 1) || !packet.IsCoherent ())
+    {
+      uint hitMask = 0;
+      for (size_t i = 0; i < packet.numRays; ++i)
+      {
+        if (TraceAnyHit (tree, packet.rays[i], hits[i]))
+          hitMask |= 1 << i;
+      }
+      return hitMask;
+    }
+
+    RaytraceProfiler prof (uint (packet.numRays));
+
+    // Copy, clip and transpose the rays
+    PacketRays pr;
+    float tnear[RayPacket::PACKET_SIZE], tfar[RayPacket::PACKET_SIZE];
+    uint activeMask = 0;
+    for (size_t i = 0; i < RayPacket::PACKET_SIZE; ++i)
+    {
+      Ray myRay;
+      if (i < packet.numRays)
+      {
+        myRay = packet.rays[i];
+        if (myRay.Clip (tree->boundingBox))
+          activeMask |= 1 << i;
+      }
+      pr.rays[i] = &packet.rays[i];
+      for (size_t dim = 0; dim < 3; ++dim)
+      {
+        const float d = myRay.direction[dim];
+        pr.origin[dim][i] = myRay.origin[dim];
+        pr.direction[dim][i] = d;
+        // Avoid -0, it would put the ray on the wrong side of splits
+        pr.invD[dim][i] = 1.0f / ((d == 0) ? 0.0f : d);
+      }
+      pr.minLength[i] = tnear[i] = myRay.minLength;
+      pr.maxLength[i] = tfar[i] = myRay.maxLength;
+    }
+    if (!activeMask) return 0;
+
+    // All rays go the same way, so near/far children are shared
+    size_t nodeOffset[3][2];
+    for (size_t dim = 0; dim < 3; ++dim)
+    {
+      const bool neg = packet.rays[0].direction[dim] < 0;
+      nodeOffset[dim][0] = neg ? 1 : 0;
+      nodeOffset[dim][1] = neg ? 0 : 1;
+    }
+
+    struct PacketTraversalNode
+    {
+      KDTreeNode* node;
+      float tnear[RayPacket::PACKET_SIZE], tfar[RayPacket::PACKET_SIZE];
+    };
+    PacketTraversalNode traversalStack[RaytraceState::MAX_STACK_DEPTH];
+    size_t traversalStackPtr = 0;
+
+    /* The packet shares one mailbox ID: a primitive is always tested against
+       all still active rays, so it never needs to be tested again. */
+    MailboxHash& mailbox = globalRaycore.GetRaytraceState ().mailbox;
+    const size_t packetID = mailbox.GetRayID ();
+
+    uint hitMask = 0;
+    KDTreeNode* node = tree->nodeList;
+    float thit[RayPacket::PACKET_SIZE];
+
+    while (true)
+    {
+      uint liveMask = activeMask;
+      while (liveMask && !KDTreeNode_Op::IsLeaf (node))
+      {
+        const uint dim = KDTreeNode_Op::GetDimension (node);
+        KDTreeNode* leftNode = KDTreeNode_Op::GetLeft (node);
+        KDTreeNode* nearNode = leftNode + nodeOffset[dim][0];
+        KDTreeNode* farNode = leftNode + nodeOffset[dim][1];
+
+        uint belowMask, aboveMask;
+        ClassifyPacketSplit (node->inner.splitLocation, pr, dim, tnear, tfar,
+          thit, liveMask, belowMask, aboveMask);
+        if (!liveMask) break;
+
+        if (belowMask == liveMask)
+        {
+          node = farNode;
+        }
+        else if (aboveMask == liveMask)
+        {
+          node = nearNode;
+        }
+        else
+        {
+          CS_ASSERT(traversalStackPtr < RaytraceState::MAX_STACK_DEPTH);
+          PacketTraversalNode& farEntry = traversalStack[traversalStackPtr++];
+          farEntry.node = farNode;
+          for (size_t i = 0; i < RayPacket::PACKET_SIZE; ++i)
+          {
+            farEntry.tnear[i] = (thit[i] > tnear[i]) ? thit[i] : tnear[i];
+            farEntry.tfar[i] = tfar[i];
+            if (thit[i] < tfar[i]) tfar[i] = thit[i];
+          }
+          node = nearNode;
+        }
+      }
+
+      if (liveMask)
+      {
+        const size_t nMax = KDTreeNode_Op::GetPrimitiveListSize (node);
+        const KDTreePrimitive* primList = 
+          KDTreeNode_Op::GetPrimitiveList (node);
+
+        for (size_t nIdx = 0; nIdx < nMax; nIdx++)
+        {
+          const KDTreePrimitive* prim = primList + nIdx;
+          const Primitive* primPointer = prim->primPointer;
+          if (mailbox.PutPrimitiveRay (primPointer, packetID))
+            continue;
+
+          const uint32 primFlags = prim->normal_K & KDPRIM_FLAG_MASK;
+          uint rayMask = 0;
+          for (size_t i = 0; i < RayPacket::PACKET_SIZE; ++i)
+          {
+            if (!(activeMask & (1 << i))) continue;
+
+            const Ray& ray = *pr.rays[i];
+            if ((ray.ignoreFlags & primFlags) 
+              || (ray.ignorePrimitive == primPointer))
+              continue;
+            if (ray.ignorePrimitive && 
+              ray.ignorePrimitive->GetPlane () == primPointer->GetPlane ())
+              continue;
+            if ((ray.ignoreObject != 0)
+              && primPointer->GetObject() == ray.ignoreObject)
+              continue;
+            rayMask |= 1 << i;
+          }
+          if (!rayMask) continue;
+
+          float dist[RayPacket::PACKET_SIZE];
+          const uint primHits = IntersectPrimitivePacket (*prim, pr, rayMask,
+            dist);
+          if (!primHits) continue;
+
+          for (size_t i = 0; i < RayPacket::PACKET_SIZE; ++i)
+          {
+            if (!(primHits & (1 << i))) continue;
+
+            const Ray& ray = *pr.rays[i];
+            HitPoint& hit = hits[i];
+            hit.hitPoint = ray.origin + ray.direction * dist[i];
+            hit.distance = dist[i];
+            hit.primitive = prim->primPointer;
+            hit.kdFlags = primFlags;
+          }
+          hitMask |= primHits;
+          activeMask &= ~primHits;
+          if (!activeMask) break;
+        }
+      }
+
+      if (!activeMask || (traversalStackPtr == 0))
+        break;
+
+      const PacketTraversalNode& entry = traversalStack[--traversalStackPtr];
+      node = entry.node;
+      memcpy (tnear, entry.tnear, sizeof (tnear));
+      memcpy (tfar, entry.tfar, sizeof (tfar));
+    }
+
+    return hitMask;
+  }
+
+  bool Raytracer::HasSIMDPackets ()
+  {
+#ifdef LIGHTER_PACKET_SSE
+    return true;
+#else
+    return false;
+#endif
+  }
+}
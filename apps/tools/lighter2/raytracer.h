@@ -128,6 +128,43 @@ namespace lighter
   };
 
 
+  /**
+   * A packet of rays traced together.
+   * Packets are traced coherently when all rays have directions with equal
+   * signs per component (e.g. shadow rays from neighbouring lumels towards
+   * the same light); otherwise the rays are traced one by one.
+   */
+  struct RayPacket
+  {
+    enum
+    {
+      PACKET_SIZE = 4
+    };
+
+    // The rays
+    Ray rays[PACKET_SIZE];
+
+    // Number of rays used
+    size_t numRays;
+
+    RayPacket () : numRays (0) {}
+
+    // Check if all rays have the same direction signs
+    bool IsCoherent () const
+    {
+      for (size_t dim = 0; dim < 3; ++dim)
+      {
+        const bool neg = rays[0].direction[dim] < 0;
+        for (size_t i = 1; i < numRays; ++i)
+        {
+          if ((rays[i].direction[dim] < 0) != neg) return false;
+        }
+      }
+      return true;
+    }
+  };
+
+
   // Hitpoint returned by the raytracer
   struct HitPoint
   {
@@ -334,6 +371,18 @@ namespace lighter
      */
     static bool TraceAllHits (const KDTree* tree, const Ray &ray, 
       HitPointCallback* hitCallback, HitIgnoreCallback* ignoreCB = 0);
+
+    /**
+     * Raytrace a packet of rays until there is any hit for each ray.
+     * \a hits must have room for RayPacket::PACKET_SIZE hit points; the
+     * hit for ray \c i is stored in <tt>hits[i]</tt>.
+     * Returns a mask with bit \c i set if ray \c i hit anything.
+     */
+    static uint TraceAnyHitPacket (const KDTree* tree, 
+      const RayPacket& packet, HitPoint* hits);
+
+    /// Whether packets are traced with SIMD instructions.
+    static bool HasSIMDPackets ();
   };
 
   class RaytraceProfiler
@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// The cache itself doesn't need the rest of the lighter
+#include "../bakecache.cpp"
+
+using namespace lighter;
+
+/**
+ * Test that cached lighting results are reused only for unchanged objects.
+ */
+class BakeCacheTest : public CppUnit::TestFixture
+{
+private:
+  csMD5::Digest configHash;
+  csRef<iDataBuffer> saved;
+
+public:
+  void setUp ();
+  void testHit ();
+  void testChangedObject ();
+  void testChangedConfig ();
+
+  CPPUNIT_TEST_SUITE (BakeCacheTest);
+    CPPUNIT_TEST (testHit);
+    CPPUNIT_TEST (testChangedObject);
+    CPPUNIT_TEST (testChangedConfig);
+  CPPUNIT_TEST_SUITE_END ();
+};
+
+void BakeCacheTest::setUp ()
+{
+  if (iSCF::SCF == 0)
+    scfInitialize (0);
+  configHash = csMD5::Encode ("config");
+
+  // A previous run with one object lit by static lights and a PD light
+  BakeCache cache (configHash);
+  CPPUNIT_ASSERT (cache.AddObject ("sector:mesh", csMD5::Encode ("mesh"),
+    csSphere (csVector3 (0), 1)));
+  csColor* colors = cache.GetResultColors ("sector:mesh", 0, "", 3);
+  colors[0].Set (1, 0, 0);
+  colors[1].Set (0, 1, 0);
+  colors[2].Set (0, 0, 1);
+  colors = cache.GetResultColors ("sector:mesh", 0, "sector:light", 3);
+  colors[0].Set (0.5f, 0.5f, 0.5f);
+  saved = cache.Save ();
+}
+
+void BakeCacheTest::testHit ()
+{
+  BakeCache cache (configHash);
+  CPPUNIT_ASSERT (cache.Load (saved));
+  CPPUNIT_ASSERT (!cache.AddObject ("sector:mesh", csMD5::Encode ("mesh"),
+    csSphere (csVector3 (0), 1)));
+  CPPUNIT_ASSERT_EQUAL ((size_t)0, cache.GetChangedObjectCount ());
+
+  const csColor* colors = cache.GetCachedColors ("sector:mesh", 0, "", 3);
+  CPPUNIT_ASSERT (colors != 0);
+  CPPUNIT_ASSERT (colors[0] == csColor (1, 0, 0));
+  CPPUNIT_ASSERT (colors[1] == csColor (0, 1, 0));
+  CPPUNIT_ASSERT (colors[2] == csColor (0, 0, 1));
+  colors = cache.GetCachedColors ("sector:mesh", 0, "sector:light", 3);
+  CPPUNIT_ASSERT (colors != 0);
+  CPPUNIT_ASSERT (colors[0] == csColor (0.5f, 0.5f, 0.5f));
+
+  // Results that were never stored
+  CPPUNIT_ASSERT (cache.GetCachedColors ("sector:mesh", 1, "", 3) == 0);
+  CPPUNIT_ASSERT (cache.GetCachedColors ("sector:mesh", 0, "", 4) == 0);
+  CPPUNIT_ASSERT (cache.GetCachedColors ("sector:other", 0, "", 3) == 0);
+}
+
+void BakeCacheTest::testChangedObject ()
+{
+  BakeCache cache (configHash);
+  CPPUNIT_ASSERT (cache.Load (saved));
+  CPPUNIT_ASSERT (cache.AddObject ("sector:mesh", csMD5::Encode ("moved"),
+    csSphere (csVector3 (0), 1)));
+  CPPUNIT_ASSERT_EQUAL ((size_t)1, cache.GetChangedObjectCount ());
+
+  CPPUNIT_ASSERT (cache.GetCachedColors ("sector:mesh", 0, "", 3) == 0);
+  CPPUNIT_ASSERT (
+    cache.GetCachedColors ("sector:mesh", 0, "sector:light", 3) == 0);
+}
+
+void BakeCacheTest::testChangedConfig ()
+{
+  BakeCache cache (csMD5::Encode ("other config"));
+  CPPUNIT_ASSERT (!cache.Load (saved));
+  cache.AddObject ("sector:mesh", csMD5::Encode ("mesh"),
+    csSphere (csVector3 (0), 1));
+  CPPUNIT_ASSERT (cache.GetCachedColors ("sector:mesh", 0, "", 3) == 0);
+}
@@ -0,0 +1,253 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "crystalspace.h"
+
+#include "cstool/compiledworld.h"
+
+#include "worldcompile.h"
+
+CS_IMPLEMENT_APPLICATION
+
+namespace worldcompile
+{
+  App::App (iObjectRegistry *objectRegistry)
+    : objectRegistry (objectRegistry)
+  {
+  }
+
+  App::~App ()
+  {
+  }
+
+  bool App::Initialize ()
+  {
+    // Load config
+    if (!csInitializer::SetupConfigManager (objectRegistry,0))
+      return Report ("Cannot setup config manager!");
+
+    // Get plugins
+    if (!csInitializer::RequestPlugins (objectRegistry,
+            CS_REQUEST_ENGINE,
+            CS_REQUEST_IMAGELOADER,
+            CS_REQUEST_LEVELLOADER,
+            CS_REQUEST_NULL3D,
+            CS_REQUEST_VFS,
+            CS_REQUEST_END))
+      return Report ("Cannot load plugins!");
+
+    // Check for commandline help.
+    if (csCommandLineHelper::CheckHelp (objectRegistry))
+    {
+      CommandLineHelp();
+      return true;
+    }
+
+    engine = csQueryRegistry<iEngine> (objectRegistry);
+    if (!engine) return Report ("No iEngine!");
+
+    loader = csQueryRegistry<iLoader> (objectRegistry);
+    if (!loader) return Report ("No iLoader!");
+
+    vfs = csQueryRegistry<iVFS> (objectRegistry);
+    if (!vfs) return Report ("No iVFS!");
+
+    // Open the systems
+    if (!csInitializer::OpenApplication (objectRegistry))
+      return Report ("Error opening system!");
+
+    return true;
+  }
+
+  bool App::Report (const char* msg, ...)
+  {
+    va_list arg;
+    va_start (arg, msg);
+    csReportV (objectRegistry, CS_REPORTER_SEVERITY_ERROR, 
+        "crystalspace.application.worldcompile", msg, arg);
+    va_end (arg);
+    return false;
+  }
+
+  void App::Report (int severity, const char* msg, ...)
+  {
+    va_list arg;
+    va_start (arg, msg);
+    csReportV (objectRegistry, severity, 
+        "crystalspace.application.worldcompile", msg, arg);
+    va_end (arg);
+  }
+
+  int64 App::TimeLoad (const char* file)
+  {
+    int64 start = csGetMicroTicks ();
+    if (!loader->LoadMapFile (file, true))
+    {
+      Report ("Error loading '%s'!", file);
+      return -1;
+    }
+    return (csGetMicroTicks () - start) / 1000;
+  }
+
+  bool App::WriteBinaryDocument (const char* file, const char* outFile)
+  {
+    csRef<iDocumentSystem> xml (
+      csQueryRegistry<iDocumentSystem> (objectRegistry));
+    if (!xml) xml.AttachNew (new csTinyDocumentSystem ());
+    csRef<iDocumentSystem> bindoc (csLoadPluginCheck<iDocumentSystem> (
+      objectRegistry, "crystalspace.documentsystem.binary", false));
+    if (!bindoc) return Report ("Binary document system not available!");
+
+    csRef<iDataBuffer> buf = vfs->ReadFile (file, false);
+    if (!buf) return Report ("Could not read '%s'!", file);
+    csRef<iDocument> doc = xml->CreateDocument ();
+    const char* error = doc->Parse (buf, true);
+    if (error != 0)
+      return Report ("Error parsing '%s': %s", file, error);
+
+    csRef<iDocument> binDoc = bindoc->CreateDocument ();
+    CS::DocSystem::CloneNode (doc->GetRoot (), binDoc->CreateRoot ());
+    error = binDoc->Write (vfs, outFile);
+    if (error != 0)
+      return Report ("Error writing '%s': %s", outFile, error);
+    return true;
+  }
+
+  void App::Compare (const char* file, const char* compiledFile, int count)
+  {
+    csString binFile (file);
+    binFile << ".bindoc";
+    bool haveBinDoc = WriteBinaryDocument (file, binFile);
+
+    // Load the variants in turns so caching affects all of them alike
+    int64 timeXML = 0, timeBinDoc = 0, timeCompiled = 0;
+    for (int i = 0; i < count; i++)
+    {
+      int64 t;
+      if ((t = TimeLoad (file)) < 0) return;
+      timeXML += t;
+      if (haveBinDoc)
+      {
+        if ((t = TimeLoad (binFile)) < 0) return;
+        timeBinDoc += t;
+      }
+      if ((t = TimeLoad (compiledFile)) < 0) return;
+      timeCompiled += t;
+    }
+
+    csPrintf ("Average load times over %d runs:\n", count);
+    csPrintf ("  original:          %6" CS_PRId64 " ms\n", timeXML / count);
+    if (haveBinDoc)
+      csPrintf ("  binary document:   %6" CS_PRId64 " ms\n",
+        timeBinDoc / count);
+    csPrintf ("  compiled world:    %6" CS_PRId64 " ms\n",
+      timeCompiled / count);
+    if (haveBinDoc) vfs->DeleteFile (binFile);
+  }
+
+  bool App::ProcessFiles ()
+  {
+    //Parse cmd-line
+    csRef<iCommandLineParser> cmdline = csQueryRegistry<iCommandLineParser>
+      (objectRegistry);
+
+    const char* map = cmdline->GetName (0);
+    if (!map)
+    {
+      if (!csCommandLineHelper::CheckHelp (objectRegistry))
+        CommandLineHelp();
+      return false;
+    }
+
+    const char* file = cmdline->GetOption ("file");
+    if (!file) file = "world";
+    if (!vfs->ChDirAuto (map, 0, 0, file))
+      return Report ("Cannot find '%s' in '%s'!", file, map);
+
+    csString outFile (cmdline->GetOption ("output"));
+    if (outFile.IsEmpty ()) outFile.Format ("%s.cw", file);
+
+    int64 loadTime = TimeLoad (file);
+    if (loadTime < 0) return false;
+
+    csRef<iDataBuffer> compiled = CS::Utility::CompiledWorld::Compile (
+      objectRegistry, engine);
+    if (!compiled) return Report ("Error compiling '%s'!", file);
+    if (!vfs->WriteFile (outFile, compiled->GetData (), compiled->GetSize ()))
+      return Report ("Error writing '%s'!", outFile.GetData ());
+    Report (CS_REPORTER_SEVERITY_NOTIFY, "Wrote '%s' (%zu bytes)",
+      outFile.GetData (), compiled->GetSize ());
+
+    const char* compare = cmdline->GetOption ("compare");
+    if (compare != 0)
+    {
+      int count = 5;
+      if (*compare != 0) count = atoi (compare);
+      if (count <= 0) return Report ("Invalid run count '%s'!", compare);
+      Compare (file, outFile, count);
+    }
+
+    return true;
+  }
+
+  void App::CommandLineHelp()
+  {
+    csPrintf ("Syntax:\n");
+    csPrintf ("  worldcompile {-file=World} {-output=File} {-compare[=Runs]} "
+      "[Map]\n");
+    csPrintf ("\n");
+    csPrintf ("'Map' can be the name of a level, a VFS directory or the "
+      "name of a zip file\n");
+    csPrintf ("containing the world file named by -file (\"world\" by "
+      "default).\n");
+    csPrintf ("\n");
+    csPrintf ("The compiled world is written next to the world file as "
+      "'World.cw' unless\n");
+    csPrintf ("-output is given. It can be loaded like any other map "
+      "file.\n");
+    csPrintf ("\n");
+    csPrintf ("\"-compare\" loads the original map, a binary document "
+      "version of it and\n");
+    csPrintf ("the compiled world 'Runs' times (5 by default) and reports "
+      "the average\n");
+    csPrintf ("load times.\n");
+  }
+
+}
+
+int main (int argc, char* argv[])
+{
+  iObjectRegistry* object_reg = csInitializer::CreateEnvironment (argc, argv);
+  if (!object_reg) return 1;
+
+  {
+    csRef<worldcompile::App> app;
+    app.AttachNew (new worldcompile::App (object_reg));
+
+    // Initialize it
+    if (!app->Initialize ()) return 1;
+
+    // Run it
+    if (!app->ProcessFiles ()) return 1;
+  }
+
+  // Remove it
+  csInitializer::DestroyApplication (object_reg);
+
+  return 0;
+}
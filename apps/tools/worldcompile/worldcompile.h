@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __WORLDCOMPILE_H__
+#define __WORLDCOMPILE_H__
+
+#include "csutil/refcount.h"
+
+namespace worldcompile
+{
+  class App : public csRefCount
+  {
+    void CommandLineHelp ();
+
+    // Load the map 'file' from the current VFS directory, return the time
+    // it took in milliseconds or -1 on failure
+    int64 TimeLoad (const char* file);
+    // Write the map 'file' in the binary document format to 'outFile'
+    bool WriteBinaryDocument (const char* file, const char* outFile);
+    // Load the original, the binary document and the compiled world 'count'
+    // times each and report the average load times
+    void Compare (const char* file, const char* compiledFile, int count);
+  public:
+    App (iObjectRegistry *objectRegistry);
+    ~App ();
+
+    // Initialize and load plugins we want
+    bool Initialize ();
+
+    // Report an error/warning, always returns false
+    bool Report (const char* msg, ...);
+    void Report (int severity, const char* msg, ...);
+
+    // Parse the commandline and compile the map specified
+    bool ProcessFiles ();
+
+    csRef<iEngine> engine;
+    csRef<iLoader> loader;
+    csRef<iVFS> vfs;
+    iObjectRegistry *objectRegistry;
+  };
+}
+
+#endif // __WORLDCOMPILE_H__
@@ -0,0 +1,313 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_CSGEOM_BATCHMATH_H__
+#define __CS_CSGEOM_BATCHMATH_H__
+
+/**\file
+ * Batched transform and culling kernels working on structure-of-arrays
+ * streams of vectors and boxes.
+ */
+/**
+ * \addtogroup geom_utils
+ * @{ */
+
+#include "csextern.h"
+#include "cstypes.h"
+
+#include "csgeom/box.h"
+#include "csgeom/matrix3.h"
+#include "csgeom/plane3.h"
+#include "csgeom/vector3.h"
+#include "csutil/alignedalloc.h"
+
+class csReversibleTransform;
+class csTransform;
+
+namespace CS
+{
+  namespace Geometry
+  {
+    /**
+     * A stream of 3D vectors, stored as separate arrays of x, y and z
+     * components (structure of arrays) so that batch kernels can process
+     * several vectors per instruction. The arrays are 16 byte aligned.
+     */
+    class Vector3Stream
+    {
+      float* x;
+      float* y;
+      float* z;
+      size_t size;
+      size_t capacity;
+
+      Vector3Stream (const Vector3Stream&);         // not implemented
+      void operator= (const Vector3Stream&);        // not implemented
+    public:
+      /// Create a stream with \a n (uninitialized) vectors
+      Vector3Stream (size_t n = 0) : x (0), y (0), z (0), size (0),
+        capacity (0)
+      {
+        SetSize (n);
+      }
+      ~Vector3Stream ()
+      {
+        CS::Memory::AlignedFree (x);
+      }
+
+      /// Get number of vectors in the stream
+      size_t GetSize () const { return size; }
+      /**
+       * Set number of vectors in the stream. Existing vectors are kept, new
+       * vectors are uninitialized.
+       */
+      void SetSize (size_t n)
+      {
+        if (n > capacity)
+        {
+          // Keep each component array a multiple of 4 floats long
+          size_t newCapacity = (n + 3) & ~(size_t)3;
+          float* newX = (float*)CS::Memory::AlignedMalloc (
+            newCapacity * 3 * sizeof (float), 16);
+          if (size > 0)
+          {
+            memcpy (newX, x, size * sizeof (float));
+            memcpy (newX + newCapacity, y, size * sizeof (float));
+            memcpy (newX + 2 * newCapacity, z, size * sizeof (float));
+          }
+          CS::Memory::AlignedFree (x);
+          x = newX;
+          y = x + newCapacity;
+          z = y + newCapacity;
+          capacity = newCapacity;
+        }
+        size = n;
+      }
+
+      /// Get the x components
+      float* GetX () { return x; }
+      const float* GetX () const { return x; }
+      /// Get the y components
+      float* GetY () { return y; }
+      const float* GetY () const { return y; }
+      /// Get the z components
+      float* GetZ () { return z; }
+      const float* GetZ () const { return z; }
+
+      /// Get a vector
+      csVector3 Get (size_t i) const
+      {
+        CS_ASSERT (i < size);
+        return csVector3 (x[i], y[i], z[i]);
+      }
+      /// Set a vector
+      void Set (size_t i, const csVector3& v)
+      {
+        CS_ASSERT (i < size);
+        x[i] = v.x; y[i] = v.y; z[i] = v.z;
+      }
+      /// Append a vector
+      void Push (const csVector3& v)
+      {
+        SetSize (size + 1);
+        Set (size - 1, v);
+      }
+
+      /// Replace the contents of the stream with \a n vectors
+      void Load (const csVector3* v, size_t n)
+      {
+        SetSize (n);
+        for (size_t i = 0; i < n; i++)
+        {
+          x[i] = v[i].x; y[i] = v[i].y; z[i] = v[i].z;
+        }
+      }
+      /// Copy all vectors of the stream to \a v
+      void Store (csVector3* v) const
+      {
+        for (size_t i = 0; i < size; i++)
+          v[i].Set (x[i], y[i], z[i]);
+      }
+    };
+
+    /**
+     * A stream of axis aligned boxes, stored as streams of the minimum and
+     * maximum corners.
+     */
+    class Box3Stream
+    {
+      Vector3Stream min;
+      Vector3Stream max;
+    public:
+      /// Create a stream with \a n (uninitialized) boxes
+      Box3Stream (size_t n = 0) : min (n), max (n) {}
+
+      /// Get number of boxes in the stream
+      size_t GetSize () const { return min.GetSize (); }
+      /// Set number of boxes in the stream
+      void SetSize (size_t n)
+      {
+        min.SetSize (n);
+        max.SetSize (n);
+      }
+
+      /// Get the minimum corners
+      Vector3Stream& GetMin () { return min; }
+      const Vector3Stream& GetMin () const { return min; }
+      /// Get the maximum corners
+      Vector3Stream& GetMax () { return max; }
+      const Vector3Stream& GetMax () const { return max; }
+
+      /// Get a box
+      csBox3 Get (size_t i) const
+      {
+        return csBox3 (min.Get (i), max.Get (i));
+      }
+      /// Set a box
+      void Set (size_t i, const csBox3& box)
+      {
+        min.Set (i, box.Min ());
+        max.Set (i, box.Max ());
+      }
+      /// Append a box
+      void Push (const csBox3& box)
+      {
+        min.Push (box.Min ());
+        max.Push (box.Max ());
+      }
+
+      /// Replace the contents of the stream with \a n boxes
+      void Load (const csBox3* boxes, size_t n)
+      {
+        SetSize (n);
+        for (size_t i = 0; i < n; i++) Set (i, boxes[i]);
+      }
+      /// Copy all boxes of the stream to \a boxes
+      void Store (csBox3* boxes) const
+      {
+        for (size_t i = 0; i < GetSize (); i++)
+          boxes[i].Set (min.Get (i), max.Get (i));
+      }
+    };
+
+    /**
+     * An affine transformation in the form used by the batch kernels:
+     * <tt>v' = M * (v - pre) + post</tt>. This matches the way csTransform
+     * and csReversibleTransform transform single vectors, so batched and
+     * single results agree.
+     */
+    struct CS_CRYSTALSPACE_EXPORT BatchTransform
+    {
+      /// Matrix
+      csMatrix3 m;
+      /// Translation applied before the matrix
+      csVector3 pre;
+      /// Translation applied after the matrix
+      csVector3 post;
+
+      /// Create an identity transformation
+      BatchTransform () : pre (0), post (0) {}
+      /// Create a transformation
+      BatchTransform (const csMatrix3& m, const csVector3& pre,
+        const csVector3& post) : m (m), pre (pre), post (post) {}
+
+      /// Transformation equivalent to csTransform::Other2This()
+      static BatchTransform Other2This (
+        const csTransform& t);
+      /// Transformation equivalent to csReversibleTransform::This2Other()
+      static BatchTransform This2Other (
+        const csReversibleTransform& t);
+    };
+
+    /**
+     * Kernels processing many vectors or boxes at once. Call sites that
+     * transform or cull one object at a time can collect their objects in
+     * streams and hand them over in one call.
+     *
+     * Each kernel has a generic implementation and, where the compiler
+     * supports it, an SSE implementation processing four objects at once.
+     * The fastest implementation the processor supports is picked at
+     * runtime. All implementations produce identical results.
+     */
+    class CS_CRYSTALSPACE_EXPORT BatchMath
+    {
+    public:
+      /// Kernel implementations
+      enum Implementation
+      {
+        /// Plain C++
+        implGeneric,
+        /// SSE instructions
+        implSSE
+      };
+
+      /// Get the implementation currently used
+      static Implementation GetImplementation ();
+      /**
+       * Use a specific implementation, e.g. to compare implementations.
+       * Returns false if it's not supported by the build or the processor.
+       * Not thread safe; should not be called while kernels are running.
+       */
+      static bool SetImplementation (Implementation impl);
+      /// Get a human readable name of an implementation
+      static const char* GetImplementationName (Implementation impl);
+
+      /**
+       * Transform points. \a out is resized to the size of \a in; \a in and
+       * \a out may be the same stream.
+       */
+      static void TransformPoints (const BatchTransform& t,
+        const Vector3Stream& in, Vector3Stream& out);
+      /**
+       * Transform boxes, computing the axis aligned bounding box of each
+       * transformed box like csTransform::Other2This(const csBox3&) does.
+       * \a out is resized to the size of \a in; \a in and \a out may be the
+       * same stream.
+       */
+      static void TransformBoxes (const BatchTransform& t,
+        const Box3Stream& in, Box3Stream& out);
+      /**
+       * Test boxes against a set of up to 32 planes, like
+       * csIntersect3::BoxFrustum(const csBox3&, const csPlane3*, uint32,
+       * uint32&). Active planes are given by \a inClipMask, with bit \c i
+       * corresponding to <tt>planes[i]</tt>.
+       * \param visible Receives for each box whether it is (partially) on
+       *   the positive side of all active planes.
+       * \param outClipMasks If not 0, receives for each visible box the mask
+       *   of planes it intersects, 0 for invisible boxes.
+       * \return Number of visible boxes.
+       */
+      static size_t ClassifyBoxesAgainstPlanes (const csPlane3* planes,
+        uint32 inClipMask, const Box3Stream& boxes, bool* visible,
+        uint32* outClipMasks = 0);
+      /**
+       * Test spheres against a set of up to 32 planes. A sphere is visible
+       * unless its center lies further than its radius on the negative side
+       * of an active plane; see ClassifyBoxesAgainstPlanes() for the
+       * meaning of the parameters.
+       */
+      static size_t SpheresInFrustum (const csPlane3* planes,
+        uint32 inClipMask, const Vector3Stream& centers, const float* radii,
+        bool* visible, uint32* outClipMasks = 0);
+    };
+  } // namespace Geometry
+} // namespace CS
+
+/** @} */
+
+#endif // __CS_CSGEOM_BATCHMATH_H__
@@ -0,0 +1,296 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_CSGEOM_BVH_H__
+#define __CS_CSGEOM_BVH_H__
+
+/**\file
+ * Bounding volume hierarchies for segment queries.
+ */
+/**
+ * \addtogroup geom_utils
+ * @{ */
+
+#include "csextern.h"
+#include "cstypes.h"
+
+#include "csgeom/box.h"
+#include "csgeom/tri.h"
+#include "csgeom/vector3.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/refcount.h"
+
+struct iJobQueue;
+
+namespace CS
+{
+  namespace Geometry
+  {
+    /**
+     * A bounding volume hierarchy over a set of primitives, each given by
+     * its bounding box. The hierarchy is built with a binned surface area
+     * heuristic and stored as a flat array of nodes, so it can be queried
+     * from several threads at once as long as nobody modifies it.
+     *
+     * The BVH only knows the boxes of the primitives. Tests against the
+     * actual primitives are done by a callback during Trace().
+     */
+    class CS_CRYSTALSPACE_EXPORT BVH
+    {
+    public:
+      /// A node of the hierarchy.
+      struct Node
+      {
+        /// Bounding box of all primitives below this node.
+        csBox3 box;
+        /**
+         * For leaves the index of the first primitive in the primitive
+         * list, for inner nodes the index of the second child. The first
+         * child of an inner node always directly follows it.
+         */
+        uint32 index;
+        /// Number of primitives in a leaf, 0 for inner nodes.
+        uint32 count;
+
+        /// Return true if this node is a leaf.
+        bool IsLeaf () const { return count != 0; }
+      };
+
+    private:
+      csDirtyAccessArray<Node> nodes;
+      csDirtyAccessArray<uint32> primitives;
+
+      class BuildJob;
+      struct BuildContext;
+      static void BuildRange (const BuildContext& context, size_t first,
+        size_t num, int depth, csDirtyAccessArray<Node>& nodes);
+
+      /**
+       * Intersect the segment \a start + t * (\a end - \a start) with a box.
+       * Returns false if the segment misses the box between 0 and \a maxT,
+       * otherwise \a t is set to the entry point.
+       */
+      static bool SegmentBox (const csBox3& box, const csVector3& start,
+        const csVector3& invDir, float maxT, float& t)
+      {
+        float t0 = 0.0f;
+        float t1 = maxT;
+        for (int a = 0 ; a < 3 ; a++)
+        {
+          float tEnter = (box.Min (a) - start[a]) * invDir[a];
+          float tLeave = (box.Max (a) - start[a]) * invDir[a];
+          if (tEnter > tLeave)
+          {
+            float tmp = tEnter; tEnter = tLeave; tLeave = tmp;
+          }
+          if (tEnter > t0) t0 = tEnter;
+          if (tLeave < t1) t1 = tLeave;
+          if (t0 > t1) return false;
+        }
+        t = t0;
+        return true;
+      }
+
+    public:
+      /**
+       * Build the hierarchy for \a num primitives. Primitive \a i is
+       * identified by index \a i in Trace() and has bounding box
+       * \a boxes[i]. Leaves get up to \a maxLeafSize primitives unless
+       * the surface area heuristic finds it worth splitting them.
+       * If \a jobQueue is given large subtrees are built on it in
+       * parallel.
+       */
+      void Build (const csBox3* boxes, size_t num, size_t maxLeafSize = 4,
+        iJobQueue* jobQueue = 0);
+
+      /**
+       * Update the node boxes after primitives moved. \a boxes must hold
+       * the new boxes of the same primitives that were given to Build().
+       * This is much faster than a new Build() but the hierarchy gets
+       * worse if the primitives moved a lot; see GetCost().
+       */
+      void Refit (const csBox3* boxes);
+
+      /// Remove all nodes.
+      void Clear ()
+      {
+        nodes.DeleteAll ();
+        primitives.DeleteAll ();
+      }
+
+      /// Return true if the hierarchy holds no primitives.
+      bool IsEmpty () const { return nodes.GetSize () == 0; }
+
+      /// Get the bounding box of all primitives.
+      const csBox3& GetBBox () const
+      {
+        static const csBox3 empty;
+        return nodes.GetSize () > 0 ? nodes[0].box : empty;
+      }
+
+      /// Get the number of nodes.
+      size_t GetNodeCount () const { return nodes.GetSize (); }
+      /// Get the nodes. Node 0 is the root.
+      const Node* GetNodes () const { return nodes.GetArray (); }
+      /// Get the primitive list the leaves index into.
+      const uint32* GetPrimitives () const { return primitives.GetArray (); }
+
+      /**
+       * Estimate the cost of a segment query with the surface area
+       * heuristic. Comparing this to the cost right after Build() tells
+       * how much Refit() degraded the hierarchy.
+       */
+      float GetCost () const;
+
+      /**
+       * Trace the segment from \a start to \a end through the hierarchy.
+       * Points on the segment are given as a fraction t of the way from
+       * \a start to \a end. For every primitive whose box is hit before
+       * the current maximum fraction, starting at \a maxT, this calls
+       * \code
+       * bool hit (uint32 primitive, float& maxT);
+       * \endcode
+       * The callback lowers \a maxT to the fraction at which it hit the
+       * primitive so that only closer primitives are tested afterwards;
+       * it can return false to stop the traversal. Nodes are visited
+       * front to back.
+       */
+      template<typename HitFn>
+      void Trace (const csVector3& start, const csVector3& end,
+        HitFn& hit, float maxT = 1.0f) const
+      {
+        if (nodes.GetSize () == 0) return;
+        const csVector3 dir = end - start;
+        csVector3 invDir;
+        for (int a = 0 ; a < 3 ; a++)
+          invDir[a] = (dir[a] != 0) ? 1.0f / dir[a] : 1e30f;
+
+        float t;
+        if (!SegmentBox (nodes[0].box, start, invDir, maxT, t)) return;
+
+        // Far nodes are pushed with the fraction at which they were entered
+        // so they can be skipped once a closer hit was found.
+        const Node* stack[64];
+        float stackT[64];
+        size_t sp = 0;
+        const Node* node = nodes.GetArray ();
+        const uint32* prims = primitives.GetArray ();
+        for (;;)
+        {
+          if (node->IsLeaf ())
+          {
+            for (uint32 i = 0 ; i < node->count ; i++)
+            {
+              if (!hit (prims[node->index + i], maxT)) return;
+            }
+          }
+          else
+          {
+            const Node* child1 = node + 1;
+            const Node* child2 = nodes.GetArray () + node->index;
+            float t1, t2;
+            bool hit1 = SegmentBox (child1->box, start, invDir, maxT, t1);
+            bool hit2 = SegmentBox (child2->box, start, invDir, maxT, t2);
+            if (hit1 && hit2)
+            {
+              // Visit the nearer child first; the far one keeps its own
+              // entry fraction.
+              if (t2 < t1)
+              {
+                const Node* tmp = child1; child1 = child2; child2 = tmp;
+                float tmpT = t1; t1 = t2; t2 = tmpT;
+              }
+              CS_ASSERT (sp < 64);
+              stackT[sp] = t2;
+              stack[sp++] = child2;
+              node = child1;
+              continue;
+            }
+            else if (hit1)
+            {
+              node = child1;
+              continue;
+            }
+            else if (hit2)
+            {
+              node = child2;
+              continue;
+            }
+          }
+          // Pop the next far node that is still in front of the best hit.
+          do
+          {
+            if (sp == 0) return;
+            sp--;
+          }
+          while (stackT[sp] > maxT);
+          node = stack[sp];
+        }
+      }
+    };
+
+    /**
+     * A triangle mesh with a BVH for segment queries. The vertices and
+     * triangles are copied, so one TriangleBVH can be shared by all
+     * instances of a mesh factory and queried from several threads at once.
+     */
+    class CS_CRYSTALSPACE_EXPORT TriangleBVH : public csRefCount
+    {
+      csDirtyAccessArray<csVector3> vertices;
+      csDirtyAccessArray<csTriangle> triangles;
+      BVH bvh;
+
+      struct HitTriangle;
+
+    public:
+      /**
+       * Build the BVH for a triangle mesh. If \a jobQueue is given large
+       * meshes are built in parallel.
+       */
+      TriangleBVH (const csVector3* vertices, size_t numVertices,
+        const csTriangle* triangles, size_t numTriangles,
+        iJobQueue* jobQueue = 0);
+
+      /// Get the number of triangles.
+      size_t GetTriangleCount () const { return triangles.GetSize (); }
+      /// Get the triangles.
+      const csTriangle* GetTriangles () const { return triangles.GetArray (); }
+      /// Get the vertices.
+      const csVector3* GetVertices () const { return vertices.GetArray (); }
+      /// Get the bounding box of the mesh.
+      const csBox3& GetBBox () const { return bvh.GetBBox (); }
+      /// Get the BVH over the triangles.
+      const BVH& GetBVH () const { return bvh; }
+
+      /**
+       * Find the first triangle hit by the segment from \a start to
+       * \a end. Both sides of the triangles are hit. On input \a r is the
+       * largest fraction of the segment that is of interest (usually 1).
+       * If a triangle is hit closer than that, returns true and sets \a r
+       * to the fraction of the way to the hit and \a triangle to the index
+       * of the triangle.
+       */
+      bool HitSegment (const csVector3& start, const csVector3& end,
+        float& r, int& triangle) const;
+    };
+  } // namespace Geometry
+} // namespace CS
+
+/** @} */
+
+#endif // __CS_CSGEOM_BVH_H__
@@ -23,10 +23,12 @@
 
 #include "csgeom/box.h"
 
+#include "csutil/array.h"
 #include "csutil/blockallocator.h"
 #include "csutil/ref.h"
 #include "csutil/scfstr.h"
 #include "csutil/scf_implementation.h"
+#include "csutil/set.h"
 
 #include "iutil/dbghelp.h"
 
@@ -37,6 +39,7 @@
  * @{ */
 
 struct iGraphics3D;
+struct iJobQueue;
 struct iString;
 class csKDTree;
 class csKDTreeChild;
@@ -163,6 +166,13 @@ enum
  * insert/remove a lot of objects in the tree and then do the distribution
  * calculation only once. This is more efficient and it also generates
  * a better tree as more information is available then.
+ * <p>
+ * Rebuild() replaces the whole tree with one built with a surface area
+ * heuristic (SAH), optionally in parallel on a job queue. Objects that
+ * move every frame can be updated with RefitObject() instead of
+ * MoveObject(): this only grows the object bounding boxes of the nodes
+ * (see GetObjectBBox()) and schedules a rebuild in the background when the
+ * tree quality degrades too much.
  */
 class CS_CRYSTALSPACE_EXPORT csKDTree :
   public scfImplementation1<csKDTree, iDebugHelper>
@@ -183,6 +193,12 @@ private:
   csRef<iKDTreeUserData> userobject; // An optional user object for this node.
 
   csBox3 node_bbox;             // Bbox of the node itself.
+  csBox3 obj_bbox;              // Bbox of all objects in this node and
+                                // its children.
+  bool refit_dirty;             // Objects or boxes below this node changed
+                                // since the last RefitNode().
+  float refit_cost;             // Estimated cost of this subtree at the
+                                // last RefitNode().
 
   int split_axis;               // One of CS_KDTREE_AXIS?
   float split_location;         // Where is the split?
@@ -212,6 +228,17 @@ private:
   // have the same timestamp are already visited during Front2Back().
   static uint32 global_timestamp;
 
+  // Node of a tree built by Rebuild(), before it is turned into csKDTree
+  // nodes.
+  struct BuildNode;
+  // Job building a subtree for a parallel Rebuild().
+  class SubtreeJob;
+  // Job building a whole tree for a background rebuild.
+  class RebuildJob;
+  // State for refitting and background rebuilds. Only used in the root.
+  struct RebuildState;
+  RebuildState* rebuild;
+
   /// Physically add a child to this tree node.
   void AddObject (csKDTreeChild* obj);
   /// Physically remove a child from this tree node.
@@ -271,13 +298,79 @@ private:
    */
   void FlattenTo (csKDTree* node);
 
+  /**
+   * Grow the object bounding box of this node and its parents so that
+   * it contains the given box.
+   */
+  void ExtendObjectBBox (const csBox3& box);
+
+  /**
+   * Mark this node and its parents as changed, so the next RefitNode()
+   * visits them. A changed node always has changed parents, so this stops
+   * at the first node that is already marked.
+   */
+  void MarkRefitDirty ()
+  {
+    for (csKDTree* node = this ; node && !node->refit_dirty ;
+        node = node->parent)
+      node->refit_dirty = true;
+  }
+
+  /**
+   * Recalculate the object bounding boxes of the changed nodes in this
+   * subtree (see MarkRefitDirty()); unchanged subtrees keep their boxes.
+   * Returns the estimated cost of the subtree: the sum over all nodes of
+   * the surface area of the object bounding box times the number of
+   * objects.
+   */
+  float RefitNode ();
+
+  /**
+   * Build a subtree for the objects with the given indices, using the
+   * binned surface area heuristic to find split locations. If \a jobQueue
+   * is not 0 large subtrees are built in parallel.
+   */
+  static void BuildSubtree (const csBox3* boxes, iJobQueue* jobQueue,
+        BuildNode* node, csArray<size_t>& indices, const csBox3& cell,
+        int depth);
+
+  /**
+   * Replace the tree with one built by BuildSubtree(). \a build_objects
+   * are the objects the build indices refer to. Objects that are no longer
+   * in the tree must not be in \a alive; objects that are in the tree but
+   * not in the build are added as undistributed objects. If \a alive is 0
+   * the objects of the build and the tree must be the same.
+   */
+  void InstallBuild (BuildNode* root, csKDTreeChild** build_objects,
+        const csSet<csPtrKey<csKDTreeChild> >* alive);
+
+  /// Create the nodes for a built subtree.
+  void InstallBuildNode (BuildNode* node, csKDTreeChild** build_objects,
+        const csSet<csPtrKey<csKDTreeChild> >* alive);
+
+  /// Get the rebuild state, creating it if needed.
+  RebuildState* GetRebuildState ();
+
+  /// Start a background rebuild, or rebuild now if there is no job queue.
+  void StartRebuild ();
+
+  /**
+   * Install a finished background rebuild and start a rebuild if
+   * one is needed. Called when a new traversal starts.
+   */
+  void UpdateRebuild ();
+
 public:
   /// Create a new empty KD-tree.
   csKDTree ();
   /// Destroy the KD-tree.
   virtual ~csKDTree ();
   /// Set the parent.
-  void SetParent (csKDTree* p) { parent = p; }
+  void SetParent (csKDTree* p)
+  {
+    parent = p;
+    if (p) p->MarkRefitDirty ();
+  }
 
   /// For debugging: set the object descriptor.
   void SetObjectDescriptor (iKDTreeObjectDescriptor* descriptor)
@@ -324,6 +417,62 @@ public:
    */
   void MoveObject (csKDTreeChild* object, const csBox3& new_bbox);
 
+  /**
+   * Give an object a new bounding box without moving it to other nodes.
+   * The object bounding boxes of the nodes containing it are grown to
+   * include the new box, so queries using GetObjectBBox() stay correct,
+   * but the tree gets worse when objects move far. This is cheaper than
+   * MoveObject() for objects that move every frame.
+   * <p>
+   * When the estimated cost of the tree (see Refit()) grows beyond the
+   * threshold set with SetRefitThreshold() the tree is rebuilt at the
+   * next Refit() or traversal: in the background on the queue set with
+   * SetRebuildJobQueue(), or right away if no queue was set.
+   * <p>
+   * This has to be called on the root of the tree.
+   */
+  void RefitObject (csKDTreeChild* object, const csBox3& new_bbox);
+
+  /**
+   * Recalculate the object bounding boxes of the nodes from the objects
+   * they contain, so they shrink again after objects moved away. Only
+   * nodes on the paths to objects that were added, removed or moved since
+   * the last call are visited. Also updates the tree quality estimate used
+   * to decide when to rebuild. Call this on the root after a batch of
+   * RefitObject() calls.
+   */
+  void Refit ();
+
+  /**
+   * Set the job queue used for background rebuilds caused by
+   * RefitObject() and Refit(). A rebuild is installed on the first
+   * NewTraversal() after it finished.
+   */
+  void SetRebuildJobQueue (iJobQueue* jobQueue);
+
+  /**
+   * Return true if the tree degraded enough through refitting to be
+   * rebuilt and the rebuild has not been installed yet.
+   */
+  bool IsRebuildNeeded () const;
+
+  /**
+   * Set the factor by which the estimated cost of the tree may grow
+   * through refitting before it is rebuilt. The default is 1.5.
+   */
+  void SetRefitThreshold (float factor);
+
+  /**
+   * Rebuild the whole tree, choosing the split locations with a binned
+   * surface area heuristic. This usually gives better trees than
+   * FullDistribute() and is faster for many objects. If \a jobQueue is
+   * given large subtrees are built in parallel on it; the function
+   * returns when the tree is complete.
+   * <p>
+   * As with Flatten(), user objects of the nodes are lost.
+   */
+  void Rebuild (iJobQueue* jobQueue = 0);
+
   /**
    * Distribute all objects in this node to its children.
    * This may also create new children if needed. Note that this
@@ -404,6 +553,14 @@ public:
    */
   inline const csBox3& GetNodeBBox () const { return node_bbox; }
 
+  /**
+   * Return the bounding box of all objects in this node and its children.
+   * Unlike the node bounding box this also contains objects updated with
+   * RefitObject() that moved outside the node. It is not shrunk when
+   * objects are removed or moved, except by Refit() and Rebuild().
+   */
+  inline const csBox3& GetObjectBBox () const { return obj_bbox; }
+
   // Debugging functions.
   bool Debug_CheckTree (csString& str);
   void Debug_Dump (csString& str, int indent);
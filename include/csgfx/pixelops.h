@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_CSGFX_PIXELOPS_H__
+#define __CS_CSGFX_PIXELOPS_H__
+
+/**\file
+ * Pixel processing kernels for truecolor images.
+ */
+
+/**\addtogroup gfx
+ * @{
+ */
+
+#include "csextern.h"
+#include "csgfx/rgbpixel.h"
+#include "csutil/cscolor.h"
+
+namespace CS
+{
+  namespace Graphics
+  {
+    /**
+     * Pixel processing kernels used by csImageMemory and csImageManipulate.
+     *
+     * Each operation has a generic implementation and, where the compiler
+     * supports it, an SSE2 implementation. The fastest implementation the
+     * processor supports is picked at runtime. All implementations produce
+     * identical results.
+     */
+    class CS_CRYSTALSPACE_EXPORT PixelOps
+    {
+    public:
+      /// Kernel implementations
+      enum Implementation
+      {
+        /// Plain C++
+        implGeneric,
+        /// SSE2 instructions
+        implSSE2
+      };
+
+      /// Get the implementation currently used
+      static Implementation GetImplementation ();
+      /**
+       * Use a specific implementation, e.g. to compare implementations.
+       * Returns false if it's not supported by the build or the processor.
+       * Not thread safe; should not be called while kernels are running.
+       */
+      static bool SetImplementation (Implementation impl);
+      /// Get a human readable name of an implementation
+      static const char* GetImplementationName (Implementation impl);
+
+      /**
+       * Scale an image down to half its width and height by averaging 2x2
+       * pixel blocks. \a dst must hold (w/2)*(h/2) pixels. Images with a
+       * width or height of 1 are averaged pairwise along the other axis.
+       */
+      static void Mipmap (const csRGBpixel* src, uint w, uint h,
+        csRGBpixel* dst);
+      /**
+       * Blur an image with a 3x3 filter (weights 1-2-1) which wraps around
+       * at the image borders.
+       */
+      static void Blur (const csRGBpixel* src, uint w, uint h,
+        csRGBpixel* dst);
+      /// Compute \a src * \a mult + \a add for each pixel, clamped to 0..255
+      static void TransformColor (const csRGBpixel* src, csRGBpixel* dst,
+        size_t n, const csColor4& mult, const csColor4& add);
+      /// Replace colors by their luminance, keeping alpha
+      static void Gray (const csRGBpixel* src, csRGBpixel* dst, size_t n);
+      /**
+       * Unsharp mask: \a original + \a strength/256 * (\a original -
+       * \a blurred), clamped to 0..255.
+       */
+      static void Sharpen (const csRGBpixel* original,
+        const csRGBpixel* blurred, csRGBpixel* dst, size_t n, int strength);
+      /// Copy the alpha component of each pixel to \a alpha
+      static void ExtractAlpha (const csRGBpixel* src, uint8* alpha,
+        size_t n);
+      /// Check whether all pixels have an alpha of 255
+      static bool IsOpaque (const csRGBpixel* src, size_t n);
+      /// Set all pixels to a color
+      static void Fill (csRGBpixel* dst, size_t n, const csRGBpixel& color);
+    };
+  } // namespace Graphics
+} // namespace CS
+
+/** @} */
+
+#endif // __CS_CSGFX_PIXELOPS_H__
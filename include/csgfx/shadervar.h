@@ -39,6 +39,7 @@
 #include "csutil/refarr.h"
 #include "csutil/refcount.h"
 #include "csutil/strset.h"
+#include "csutil/threadcachedallocator.h"
 
 #include "iengine/texture.h"
 #include "ivideo/texture.h"
@@ -741,15 +742,15 @@ private:
   AccessorValues* accessor;
 
   CS_DECLARE_STATIC_CLASSVAR (matrixAlloc, MatrixAlloc,
-    CS::Memory::BlockAllocatorSafe<csMatrix3>)
+    CS::Memory::BlockAllocatorThreadCached<csMatrix3>)
   CS_DECLARE_STATIC_CLASSVAR (matrix4Alloc, Matrix4Alloc,
-    CS::Memory::BlockAllocatorSafe<CS::Math::Matrix4>)
+    CS::Memory::BlockAllocatorThreadCached<CS::Math::Matrix4>)
   CS_DECLARE_STATIC_CLASSVAR (transformAlloc, TransformAlloc,
-    CS::Memory::BlockAllocatorSafe<csReversibleTransform>)
+    CS::Memory::BlockAllocatorThreadCached<csReversibleTransform>)
   CS_DECLARE_STATIC_CLASSVAR (arrayAlloc, ShaderVarArrayAlloc,
-    CS::Memory::BlockAllocatorSafe<SvArrayType>)
+    CS::Memory::BlockAllocatorThreadCached<SvArrayType>)
   CS_DECLARE_STATIC_CLASSVAR (accessorAlloc, AccessorValuesAlloc,
-    CS::Memory::BlockAllocatorSafe<AccessorValues>)
+    CS::Memory::BlockAllocatorThreadCached<AccessorValues>)
 
   virtual void NewType (VariableType nt);
   virtual void AllocAccessor (const AccessorValues& other = AccessorValues());
@@ -22,6 +22,7 @@
 
 #include "csextern.h"
 
+#include "csutil/dirtyaccessarray.h"
 #include "csutil/scf_implementation.h"
 
 #include "ivideo/shader/shader.h"
@@ -44,19 +45,50 @@ namespace CS
       public virtual iShaderVariableContext
     {
     protected:
+      struct VariableBlock;
+      class PackedVariable;
+
+      /// Variables, sorted by name
       csRefArray<csShaderVariable> variables;
+      /**
+       * Names of the variables, in the same order as \a variables. Kept
+       * separately so lookups and pushes walk a contiguous block of IDs
+       * instead of dereferencing each variable.
+       */
+      csDirtyAccessArray<ShaderVarStringID> names;
+      /**
+       * Storage for the variables created by GetVariableAdd(). They are
+       * constructed in place, so the values of a context lie next to each
+       * other instead of in separate heap allocations. A block lives until
+       * the context and all variables in it are gone.
+       */
+      csArray<VariableBlock*> blocks;
+
+      /// Find the index of the variable with the given name
+      size_t FindName (ShaderVarStringID name) const;
+      /// Insert a variable at its sorted position
+      void InsertVariable (csShaderVariable* variable);
+      /// Construct a variable in the storage blocks of this context
+      csShaderVariable* NewVariable (ShaderVarStringID name);
   
     public:
+      ShaderVariableContextImpl () {}
+      /// Copy the variables (but not their storage) of another context
+      ShaderVariableContextImpl (const ShaderVariableContextImpl& other);
       virtual ~ShaderVariableContextImpl();
+
+      ShaderVariableContextImpl& operator= (
+        const ShaderVariableContextImpl& other);
   
       const csRefArray<csShaderVariable>& GetShaderVariables () const
       { return variables; }
       virtual void AddVariable (csShaderVariable *variable);
       virtual csShaderVariable* GetVariable (ShaderVarStringID name) const;
+      virtual csShaderVariable* GetVariableAdd (ShaderVarStringID name);
       virtual void PushVariables (csShaderVariableStack& stacks) const;
       virtual bool IsEmpty() const { return variables.GetSize () == 0; }  
       virtual void ReplaceVariable (csShaderVariable *variable);
-      virtual void Clear () { variables.Empty(); }
+      virtual void Clear () { variables.Empty(); names.Empty(); }
       virtual bool RemoveVariable (csShaderVariable* variable);
       virtual bool RemoveVariable (ShaderVarStringID name);
     };
@@ -582,8 +582,17 @@ namespace RenderManager
 	  }
 	}
 	
-	csShaderVariableStack* localStacks =
-	  new csShaderVariableStack[shadows.GetLightLayerSpread()];
+	// Temporary stacks live in the frame arena
+	const size_t numLocalStacks = shadows.GetLightLayerSpread();
+	csShaderVariableStack* localStacks = (csShaderVariableStack*)
+	  node->owner.owner.GetPersistentData ().GetFrameArena ().Alloc (
+	    numLocalStacks * sizeof (csShaderVariableStack));
+	for (size_t s = 0; s < numLocalStacks; s++)
+	{
+#include "csutil/custom_new_disable.h"
+	  new (localStacks + s) csShaderVariableStack;
+#include "csutil/custom_new_enable.h"
+	}
   
 	// Now render lights for each light type
 	remainingLights = firstLight;
@@ -712,7 +721,8 @@ namespace RenderManager
 	  totalLayers = neededLayers;
 	}
 	
-	delete[] localStacks;
+	for (size_t s = 0; s < numLocalStacks; s++)
+	  localStacks[s].~csShaderVariableStack();
 	
 	return firstLight;
       }
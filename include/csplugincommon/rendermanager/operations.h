@@ -27,6 +27,9 @@
 #include "csplugincommon/rendermanager/rendertree.h"
 #include "csutil/set.h"
 #include "csutil/compositefunctor.h"
+#include "csutil/refarr.h"
+#include "csutil/scf_implementation.h"
+#include "iutil/job.h"
 
 namespace CS
 {
@@ -653,6 +656,117 @@ namespace RenderManager
   }
 
   //@}
+
+  namespace Implementation
+  {
+    /**
+     * Job calling a functor for a consecutive range of mesh nodes.
+     * Used by ForEachMeshNodeParallel().
+     */
+    template<typename MeshNode, typename Fn, typename Ordering>
+    class MeshNodeRangeJob :
+      public scfImplementation1<MeshNodeRangeJob<MeshNode, Fn, Ordering>,
+                                iJob>
+    {
+      Fn& fn;
+      MeshNode* const* nodes;
+      size_t first;
+      size_t num;
+
+      void Call (MeshNode* node, size_t, OperationUnorderedParallel)
+      {
+        fn (node);
+      }
+      void Call (MeshNode* node, size_t index, OperationNumberedParallel)
+      {
+        fn (index, node);
+      }
+    public:
+      MeshNodeRangeJob (Fn& fn, MeshNode* const* nodes, size_t first,
+        size_t num)
+        : scfImplementation1<MeshNodeRangeJob<MeshNode, Fn, Ordering>,
+            iJob> (this), fn (fn), nodes (nodes), first (first), num (num)
+      {}
+
+      void Run ()
+      {
+        for (size_t i = first; i < first + num; i++)
+          Call (nodes[i], i, Ordering ());
+      }
+    };
+
+    template<typename ContextType, typename Fn>
+    void ForEachMeshNodeParallel (ContextType& context, Fn& fn, 
+      iJobQueue*, size_t, OperationUnordered)
+    {
+      ForEachMeshNode (context, fn);
+    }
+
+    template<typename ContextType, typename Fn>
+    void ForEachMeshNodeParallel (ContextType& context, Fn& fn, 
+      iJobQueue*, size_t, OperationNumbered)
+    {
+      ForEachMeshNode (context, fn);
+    }
+
+    template<typename ContextType, typename Fn, typename Ordering>
+    void ForEachMeshNodeParallel (ContextType& context, Fn& fn, 
+      iJobQueue* jobQueue, size_t nodesPerJob, Ordering)
+    {
+      typedef typename ContextType::TreeType::MeshNode MeshNode;
+      csDirtyAccessArray<MeshNode*> nodes;
+      typename ContextType::TreeType::MeshNodeTreeIteratorType it = context.meshNodes.GetIterator ();
+      while (it.HasNext ())
+      {
+        MeshNode* node = it.Next ();
+        CS_ASSERT_MSG("Null node encountered, should not be possible", node);
+        nodes.Push (node);
+      }
+      if (nodes.GetSize() == 0) return;
+
+      typedef MeshNodeRangeJob<MeshNode, Fn, Ordering> JobType;
+      if (!jobQueue || (nodes.GetSize() <= nodesPerJob))
+      {
+        JobType job (fn, nodes.GetArray(), 0, nodes.GetSize());
+        job.Run ();
+        return;
+      }
+
+      csRefArray<iJob> jobs;
+      for (size_t first = 0; first < nodes.GetSize(); first += nodesPerJob)
+      {
+        csRef<iJob> job;
+        job.AttachNew (new JobType (fn, nodes.GetArray(), first,
+          csMin (nodesPerJob, nodes.GetSize() - first)));
+        jobQueue->Enqueue (job);
+        jobs.Push (job);
+      }
+      /* Jobs not picked up by a worker yet are run on this thread, so it
+         helps out while waiting. */
+      for (size_t j = 0; j < jobs.GetSize(); j++)
+        jobQueue->PullAndRun (jobs[j], true);
+    }
+  }
+
+  /**
+   * Iterate over all mesh nodes within context, call functor for each one,
+   * possibly in parallel.
+   * The nodes are split into ranges of \a nodesPerJob nodes which are
+   * processed on \a jobQueue. Returns when all nodes were processed.
+   *
+   * Only functors whose ordering is OperationUnorderedParallel or
+   * OperationNumberedParallel are run in parallel; those have to be
+   * re-entrant, ie keep any scratch data (such as shader variable stacks)
+   * local to the call. Other functors are called sequentially, as with
+   * ForEachMeshNode(). The same happens if \a jobQueue is 0.
+   */
+  template<typename ContextType, typename Fn>
+  void ForEachMeshNodeParallel (ContextType& context, Fn& fn,
+    iJobQueue* jobQueue, size_t nodesPerJob = 16)
+  {
+    Implementation::ForEachMeshNodeParallel (context, fn, jobQueue,
+      nodesPerJob, typename OperationTraits<Fn>::Ordering ());
+  }
  
 
 
@@ -26,6 +26,7 @@
 #include "iengine/camera.h"
 #include "csplugincommon/rendermanager/standardtreetraits.h"
 #include "csutil/dirtyaccessarray.h"
+#include "csutil/framearena.h"
 #include "csutil/metautils.h"
 #include "csutil/redblacktree.h"
 #include "cstool/rendermeshholder.h"
@@ -248,6 +249,11 @@ namespace RenderManager
      * Data used by the render tree that needs to persist over multiple frames.
      * Render managers must store an instance of this class and provide
      * it to the render tree upon instantiation.
+     *
+     * Context and mesh nodes, as well as the arrays of meshes and portals they
+     * hold, are allocated from a per-thread frame arena which is reset when
+     * the render tree is destroyed. Enabling the debug flag "framearena"
+     * prints the number of bytes allocated from the arenas for each frame.
      */
     struct PersistentData
     {
@@ -266,17 +272,34 @@ namespace RenderManager
           shmgr->GetSVNameStringset()->Request ("fogplane");
           
         dbgDebugClearScreen = debugPersist.RegisterDebugFlag ("debugclear");
+        dbgFrameArena = debugPersist.RegisterDebugFlag ("framearena");
       }
 
+      /**
+       * End of frame: reclaim the memory of all nodes. The nodes must have
+       * been destructed.
+       */
       void Clear ()
       {
-        // Clean up the persistent data
-        contextNodeAllocator.Empty ();
-        meshNodeAllocator.Empty ();
+        frameArenas.Reset ();
+        if (debugPersist.IsDebugFlagEnabled (dbgFrameArena))
+          csPrintf ("Render tree frame arena: %zu bytes\n",
+            frameArenas.GetLastFrameBytes ());
+      }
+
+      /// Get the frame arena of the calling thread.
+      CS::Memory::FrameArena& GetFrameArena ()
+      {
+        return frameArenas.Get ();
+      }
+
+      /// Get the number of bytes allocated from the frame arenas last frame.
+      size_t GetFrameArenaBytes () const
+      {
+        return frameArenas.GetLastFrameBytes ();
       }
 
-      csBlockAllocator<MeshNode> meshNodeAllocator;
-      csBlockAllocator<ContextNode> contextNodeAllocator;
+      CS::Memory::FrameArenaPerThread frameArenas;
       MeshNodeTreeBlockAlloc meshNodeTreeAlloc;
 
       CS::ShaderVarStringID svObjectToWorldName;
@@ -288,6 +311,7 @@ namespace RenderManager
       
       DebugPersistent debugPersist;
       uint dbgDebugClearScreen;
+      uint dbgFrameArena;
     };
 
     /**
@@ -341,7 +365,9 @@ namespace RenderManager
       typedef typename TreeType::ContextNode ContextNodeType;
 
       //-- Some local types
-      typedef csArray<SingleMesh> MeshArrayType;
+      typedef csArray<SingleMesh, csArrayElementHandler<SingleMesh>,
+        CS::Memory::FrameArenaAllocator,
+        CS::Container::ArrayCapacityExponential<> > MeshArrayType;
       typedef typename MeshArrayType::Iterator MeshArrayIteratorType;
 
       /// Owner
@@ -356,8 +382,10 @@ namespace RenderManager
       /// All the meshes within the meshnode
       MeshArrayType meshes;
 
-      MeshNode (ContextNode& owner)
-        : owner (owner)
+      MeshNode (ContextNode& owner, CS::Memory::FrameArena& arena)
+        : owner (owner),
+          meshes (0, CS::Memory::FrameArenaAllocator (arena),
+            typename MeshArrayType::CapacityHandlerType ())
       {}
     };
 
@@ -386,6 +414,9 @@ namespace RenderManager
 
       //-- Types
       typedef RealTreeType TreeType;
+      typedef csArray<PortalHolder, csArrayElementHandler<PortalHolder>,
+        CS::Memory::FrameArenaAllocator,
+        CS::Container::ArrayCapacityExponential<> > PortalArrayType;
 
       /// Owner of context node
       TreeType& owner;
@@ -427,7 +458,7 @@ namespace RenderManager
       MeshNodeTreeType meshNodes;
 
       /// All portals within context
-      csArray<PortalHolder> allPortals;
+      PortalArrayType allPortals;
 
       /// The SVs themselves
       SVArrayHolder svArrays;
@@ -440,9 +471,12 @@ namespace RenderManager
       /// Total number of render meshes within the context
       size_t totalRenderMeshes;
       
-      ContextNode(TreeType& owner, MeshNodeTreeBlockAlloc& meshNodeAlloc) 
+      ContextNode(TreeType& owner, MeshNodeTreeBlockAlloc& meshNodeAlloc,
+                  CS::Memory::FrameArena& arena) 
         : owner (owner), drawFlags (0), 
           meshNodes (MeshNodeTreeBlockRefAlloc (meshNodeAlloc)),
+          allPortals (0, CS::Memory::FrameArenaAllocator (arena),
+            typename PortalArrayType::CapacityHandlerType ()),
           totalRenderMeshes (0) 
       {}
       
@@ -550,6 +584,8 @@ namespace RenderManager
 
     ~RenderTree ()
     {
+      for (size_t c = 0; c < contexts.GetSize (); c++)
+        DestructContext (contexts[c]);
       persistentData.Clear ();
     }
 
@@ -563,8 +599,11 @@ namespace RenderManager
     ContextNode* CreateContext (RenderView* rw, ContextNode* insertAfter = 0)
     {
       // Create an initial context
-      ContextNode* newCtx = persistentData.contextNodeAllocator.Alloc (*this,
-        persistentData.meshNodeTreeAlloc);
+      CS::Memory::FrameArena& arena = persistentData.GetFrameArena ();
+#include "csutil/custom_new_disable.h"
+      ContextNode* newCtx = new (arena) ContextNode (*this,
+        persistentData.meshNodeTreeAlloc, arena);
+#include "csutil/custom_new_enable.h"
       newCtx->renderView = rw;
       newCtx->cameraTransform = rw->GetCamera ()->GetTransform ();
       newCtx->sector = rw->GetThisSector();
@@ -591,7 +630,7 @@ namespace RenderManager
       CS_ASSERT(contexts.Find (context) != csArrayItemNotFound);
       contexts.Delete (context);
 
-      persistentData.contextNodeAllocator.Free (context);
+      DestructContext (context);
     }
 
     /**
@@ -616,7 +655,10 @@ namespace RenderManager
     MeshNode* CreateMeshNode (ContextNode& context, 
       const typename TreeTraitsType::MeshNodeKeyType& key)
     {
-      MeshNode* newNode = persistentData.meshNodeAllocator.Alloc (context);
+      CS::Memory::FrameArena& arena = persistentData.GetFrameArena ();
+#include "csutil/custom_new_disable.h"
+      MeshNode* newNode = new (arena) MeshNode (context, arena);
+#include "csutil/custom_new_enable.h"
       newNode->key = key;
     
       return newNode;
@@ -629,7 +671,8 @@ namespace RenderManager
     void DestroyMeshNode (MeshNode* meshNode)
     {
       meshNode->owner.meshNodes.Delete (meshNode->key);
-      persistentData.meshNodeAllocator.Free (meshNode);
+      // Memory is reclaimed when the frame arena is reset
+      meshNode->~MeshNode ();
     }
 
     
@@ -651,6 +694,18 @@ namespace RenderManager
   protected:    
     PersistentData&         persistentData;
     ContextNodeArrayType    contexts; 
+
+    /// Destruct a context and its mesh nodes; memory stays in the arena.
+    void DestructContext (ContextNode* context)
+    {
+      MeshNodeTreeIteratorType it = context->meshNodes.GetIterator ();
+      while (it.HasNext ())
+      {
+        MeshNode* meshNode = it.Next ();
+        meshNode->~MeshNode ();
+      }
+      context->~ContextNode ();
+    }
   };
 
 }
@@ -107,10 +107,10 @@ namespace RenderManager
   {
   public:    
 
-    TicketSetup (SVArrayHolder& svArrays, csShaderVariableStack& varStack,       
+    TicketSetup (SVArrayHolder& svArrays,
       const ShaderArrayType& shaderArray, TicketArrayType& tickets, 
       const LayerConfigType& layerConfig)
-      : svArrays (svArrays), varStack (varStack), 
+      : svArrays (svArrays), 
       shaderArray (shaderArray), ticketArray (tickets),
       layerConfig (layerConfig)
     {
@@ -120,6 +120,7 @@ namespace RenderManager
     void operator() (typename RenderTree::MeshNode* node)
     {
       const size_t totalMeshes = node->owner.totalRenderMeshes;
+      csShaderVariableStack varStack;
 
       for (size_t i = 0; i < node->meshes.GetSize (); ++i)
       {
@@ -141,7 +142,6 @@ namespace RenderManager
 
   private:
     SVArrayHolder& svArrays;
-    csShaderVariableStack& varStack;
     const ShaderArrayType& shaderArray;
     TicketArrayType& ticketArray;
     const LayerConfigType& layerConfig;
@@ -153,6 +153,121 @@ namespace RenderManager
     typedef OperationUnordered Ordering;
   };
 
+  /**
+   * Shader ticket setup that can run in parallel.
+   * Uses iShader::TryGetTicket(); meshes for which that fails get the
+   * ticket #ticketDeferred, those have to be set up with DeferredTicketSetup
+   * afterwards.
+   *
+   * Typically used through SetupStandardTicket().
+   */
+  template<typename RenderTree, typename LayerConfigType>
+  class ThreadedTicketSetup
+  {
+  public:    
+    /// Ticket value for meshes whose ticket must be set up on the main thread
+    static const size_t ticketDeferred = ((size_t)~0) - 1;
+
+    ThreadedTicketSetup (SVArrayHolder& svArrays,
+      const ShaderArrayType& shaderArray, TicketArrayType& tickets, 
+      const LayerConfigType& layerConfig)
+      : svArrays (svArrays), 
+      shaderArray (shaderArray), ticketArray (tickets),
+      layerConfig (layerConfig)
+    {
+    }
+
+    void operator() (typename RenderTree::MeshNode* node)
+    {
+      const size_t totalMeshes = node->owner.totalRenderMeshes;
+      csShaderVariableStack varStack;
+
+      for (size_t i = 0; i < node->meshes.GetSize (); ++i)
+      {
+        typename RenderTree::MeshNode::SingleMesh& mesh = node->meshes[i];
+
+        for (size_t layer = 0; layer < layerConfig.GetLayerCount (); ++layer)
+        {
+          size_t layerOffset = layer*totalMeshes;
+          
+          svArrays.SetupSVStack (varStack, layer, mesh.contextLocalId);
+
+          iShader* shader = shaderArray[mesh.contextLocalId+layerOffset];
+          size_t ticket = ~0;
+          if (shader
+              && !shader->TryGetTicket (*mesh.renderMesh, varStack, ticket))
+            ticket = ticketDeferred;
+          ticketArray[mesh.contextLocalId+layerOffset] = ticket;
+        }
+      }
+    }
+
+  private:
+    SVArrayHolder& svArrays;
+    const ShaderArrayType& shaderArray;
+    TicketArrayType& ticketArray;
+    const LayerConfigType& layerConfig;
+  };
+
+  template<typename RenderTree, typename LayerConfigType>
+  struct OperationTraits<ThreadedTicketSetup<RenderTree, LayerConfigType> >
+  {
+    typedef OperationUnorderedParallel Ordering;
+  };
+
+  /**
+   * Set up the tickets ThreadedTicketSetup left to the main thread.
+   */
+  template<typename RenderTree, typename LayerConfigType>
+  class DeferredTicketSetup
+  {
+  public:    
+    DeferredTicketSetup (SVArrayHolder& svArrays,
+      const ShaderArrayType& shaderArray, TicketArrayType& tickets, 
+      const LayerConfigType& layerConfig)
+      : svArrays (svArrays), 
+      shaderArray (shaderArray), ticketArray (tickets),
+      layerConfig (layerConfig)
+    {
+    }
+
+    void operator() (typename RenderTree::MeshNode* node)
+    {
+      const size_t totalMeshes = node->owner.totalRenderMeshes;
+      csShaderVariableStack varStack;
+
+      for (size_t i = 0; i < node->meshes.GetSize (); ++i)
+      {
+        typename RenderTree::MeshNode::SingleMesh& mesh = node->meshes[i];
+
+        for (size_t layer = 0; layer < layerConfig.GetLayerCount (); ++layer)
+        {
+          size_t layerOffset = layer*totalMeshes;
+          size_t& ticket = ticketArray[mesh.contextLocalId+layerOffset];
+          if (ticket != ThreadedTicketSetup<RenderTree,
+              LayerConfigType>::ticketDeferred)
+            continue;
+          
+          svArrays.SetupSVStack (varStack, layer, mesh.contextLocalId);
+          iShader* shader = shaderArray[mesh.contextLocalId+layerOffset];
+          ticket = shader->GetTicket (*mesh.renderMesh, varStack);
+        }
+      }
+    }
+
+  private:
+    SVArrayHolder& svArrays;
+    const ShaderArrayType& shaderArray;
+    TicketArrayType& ticketArray;
+    const LayerConfigType& layerConfig;
+  };
+
+  template<typename RenderTree, typename LayerConfigType>
+  struct OperationTraits<DeferredTicketSetup<RenderTree, LayerConfigType> >
+  {
+    typedef OperationUnordered Ordering;
+  };
+
   // Some helper for below
   template<typename RenderTree, typename LayerConfigType>
   struct StandardSATSetupTypes
@@ -160,6 +275,10 @@ namespace RenderManager
     typedef ShaderSetup<RenderTree, LayerConfigType> ShaderSetupType;
     typedef ShaderSVSetup<RenderTree, LayerConfigType> ShaderSVSetupType;
     typedef TicketSetup<RenderTree, LayerConfigType> TicketSetupType;
+    typedef ThreadedTicketSetup<RenderTree, LayerConfigType>
+      ThreadedTicketSetupType;
+    typedef DeferredTicketSetup<RenderTree, LayerConfigType>
+      DeferredTicketSetupType;
 
     typedef CS::Meta::CompositeFunctorType2<TicketSetupType,
       ShaderSVSetupType>CombinedFunctorType;
@@ -203,7 +322,7 @@ namespace RenderManager
      * Note that SVs have to be set up *after* the tickets - otherwise SVs
      * from fallbacks won't work */
     typename TypeHelper::TicketSetupType 
-      ticketSetup (context.svArrays, shaderManager->GetShaderVariableStack (),
+      ticketSetup (context.svArrays,
         context.shaderArray, context.ticketArray, layerConfig);
 
     typename TypeHelper::ShaderSVSetupType 
@@ -217,6 +336,51 @@ namespace RenderManager
     ForEachMeshNode (context, combFunctor);
   }
 
+  /**
+   * Setup the shader ticket and shader Vs, using \a jobQueue to spread the
+   * work over several threads.
+   * Tickets which need shader techniques to be set up are determined on the
+   * calling thread, which must be the thread the renderer runs on.
+   * Must be done after shader setup (usually SetupStandardShader()).
+   */
+  template<typename ContextNodeType, typename LayerConfigType>
+  void SetupStandardTicket (ContextNodeType& context, 
+    iShaderManager* shaderManager,
+    const LayerConfigType& layerConfig,
+    iJobQueue* jobQueue)
+  {
+    if (!jobQueue)
+    {
+      SetupStandardTicket (context, shaderManager, layerConfig);
+      return;
+    }
+
+    context.ticketArray.SetSize (context.totalRenderMeshes*layerConfig.GetLayerCount ());
+
+    typedef typename ContextNodeType::TreeType Tree;
+    typedef StandardSATSetupTypes<Tree, LayerConfigType> TypeHelper;
+    
+    {
+      typename TypeHelper::ThreadedTicketSetupType 
+        ticketSetup (context.svArrays,
+          context.shaderArray, context.ticketArray, layerConfig);
+      ForEachMeshNodeParallel (context, ticketSetup, jobQueue);
+    }
+    {
+      typename TypeHelper::DeferredTicketSetupType 
+        ticketSetup (context.svArrays,
+          context.shaderArray, context.ticketArray, layerConfig);
+      ForEachMeshNode (context, ticketSetup);
+    }
+    // As above, SVs have to be set up *after* the tickets
+    {
+      typename TypeHelper::ShaderSVSetupType 
+        shaderSVSetup (context.svArrays, context.shaderArray, 
+        context.ticketArray, layerConfig);
+      ForEachMeshNodeParallel (context, shaderSVSetup, jobQueue);
+    }
+  }
+
   typedef csDirtyAccessArray<csStringID> ShaderVariableNameArray;
 }
 }
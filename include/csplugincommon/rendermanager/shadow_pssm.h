@@ -23,7 +23,12 @@
  * PSSM shadow handler
  */
 
+#include "iengine/mesh.h"
+#include "iengine/movable.h"
+#include "imesh/object.h"
+#include "imesh/objmodel.h"
 #include "ivideo/shader/shader.h"
+#include "ivideo/txtmgr.h"
 
 #include "cstool/meshfilter.h"
 
@@ -157,6 +162,102 @@ namespace RenderManager
       bool lightProjectSetup;
       // Transform light space to post-project light space
       CS::Math::Matrix4 lightProject;
+      
+      /**
+       * Shadow casters affecting a split. Only used to detect changes, so
+       * the casters are not stored, just their combined bounding box and a
+       * checksum which doesn't depend on the order they were added in.
+       */
+      struct CasterSet
+      {
+        uint num;
+        uint32 checksum;
+        // Combined bbox, in post-project light space
+        csBox3 bboxPP;
+        
+        CasterSet() : num (0), checksum (0) {}
+        
+        void Add (iMeshWrapper* mesh, const csBox3& meshBboxPP)
+        {
+          uint32 meshSum = uint32 (uintptr_t (mesh)) * 2654435761u;
+          meshSum ^= uint32 (mesh->GetMovable()->GetUpdateNumber());
+          iObjectModel* objModel = mesh->GetMeshObject()->GetObjectModel();
+          if (objModel != 0)
+            meshSum += uint32 (objModel->GetShapeNumber()) * 40503u;
+          checksum += meshSum;
+          num++;
+          bboxPP += meshBboxPP;
+        }
+        
+        bool operator== (const CasterSet& other) const
+        {
+          return (num == other.num) && (checksum == other.checksum)
+            && (bboxPP == other.bboxPP);
+        }
+      };
+      
+      /// Shadow map of a split kept over frames
+      struct CachedSplit
+      {
+        /// Whether the textures contain a shadow map at all
+        bool valid;
+        /// PersistentData::cacheGeneration at the time of rendering
+        uint generation;
+        /// Frame the shadow map was last rendered in
+        uint renderFrame;
+        int shadowMapSize;
+        // Shadow map projection used for rendering
+        CS::Math::Matrix4 matrix;
+        CasterSet staticCasters;
+        CasterSet dynamicCasters;
+        csRef<iTextureHandle> textures[rtaNumAttachments];
+        
+        CachedSplit() : valid (false), generation (0), renderFrame (0),
+          shadowMapSize (0) {}
+        
+        static bool IsMatrixEqual (const CS::Math::Matrix4& m1,
+          const CS::Math::Matrix4& m2)
+        {
+          for (int i = 0; i < 4; i++)
+          {
+            csVector4 r1 (m1.Row (i));
+            csVector4 r2 (m2.Row (i));
+            for (int c = 0; c < 4; c++)
+            {
+              if (fabsf (r1[c] - r2[c])
+                  > EPSILON * csMax (1.0f, fabsf (r1[c])))
+                return false;
+            }
+          }
+          return true;
+        }
+        
+        /// Get the texture for an attachment, creating it if needed
+        iTextureHandle* GetTexture (PersistentData& persist,
+          const ShadowSettings::Target* target, int size)
+        {
+          csRef<iTextureHandle>& tex = textures[target->attachment];
+          if (!tex.IsValid() || (shadowMapSize != size))
+          {
+            tex = persist.g3d->GetTextureManager()->CreateTexture (
+              size, size, csimg2D, target->texCache.GetFormat(),
+              target->texCache.GetFlags());
+            tex->SetTextureClass (target->texCache.GetClass());
+          }
+          return tex;
+        }
+      };
+      struct CachedSplits
+      {
+        uint lastUsedFrame;
+        // Indexed by sublight * number of parts + split
+        csArray<CachedSplit> splits;
+        
+        CachedSplits() : lastUsedFrame (0) {}
+      };
+      /// Cached shadow maps, per camera
+      csHash<CachedSplits, csRef<iCamera> > cachedSplitsHash;
+      
       struct SuperFrustum : public CS::Utility::FastRefCount<SuperFrustum>
       {
         int actualNumParts;
@@ -188,6 +289,10 @@ namespace RenderManager
 	  // Object bboxes in post-project light space
 	  csBox3 receivingObjectsBBoxPP;
 	  
+	  // Casters overlapping the frustum, for shadow map caching
+	  CasterSet staticCasters;
+	  CasterSet dynamicCasters;
+	  
 	  Frustum() : draw (true) {}
 	};
 	Frustum* frustums;
@@ -221,6 +326,7 @@ namespace RenderManager
         {
           lightFrustumsHash.DeleteAll();
           lastSetupFrame = currentFrame;
+          PurgeCachedSplits (currentFrame);
         }
         
         csRef<iCamera> camera (viewSetup.rview->GetCamera());
@@ -516,6 +622,14 @@ namespace RenderManager
           return;
         lightFrustums.setupFrame = currentFrame;
         
+        CachedSplits* cachedSplits = 0;
+        if (persist.IsShadowMapCacheActive())
+        {
+          cachedSplits = &cachedSplitsHash.GetOrCreate (
+            viewSetup.rview->GetCamera(), CachedSplits());
+          cachedSplits->lastUsedFrame = currentFrame;
+        }
+        
 	csBox3 clipToView;
 	clipToView = csBox3 (csVector3 (-1, -1, 0),
 	  csVector3 (1, 1, FLT_MAX));
@@ -673,6 +787,15 @@ namespace RenderManager
 	    lightFrust.shadowMapDimSV->SetValue (csVector4 (1.0f/shadowMapSize,
 	      1.0f/shadowMapSize, shadowMapSize, shadowMapSize));
 	      
+	    CachedSplit* cachedSplit = 0;
+	    if (cachedSplits != 0)
+	    {
+	      size_t splitIndex = l * viewSetup.numParts + frustNum;
+	      if (cachedSplits->splits.GetSize() <= splitIndex)
+	        cachedSplits->splits.SetSize (splitIndex + 1);
+	      cachedSplit = &(cachedSplits->splits[splitIndex]);
+	    }
+	      
 	    if (!lightFrust.draw)
 	    {
 	      for (size_t t = 0; t < persist.settings.targets.GetSize(); t++)
@@ -682,6 +805,7 @@ namespace RenderManager
 	          viewSetup.persist.settings.targets[t];
 		lightFrust.textureSVs[target->attachment]->SetValue (0);
 	      }
+	      if (cachedSplit != 0) cachedSplit->valid = false;
 	      continue;
 	    }
 	    else if (noCasters)
@@ -694,8 +818,31 @@ namespace RenderManager
 		lightFrust.textureSVs[target->attachment]->SetValue (
 		  GetEmptyShadowMap (persist, t, context));
 	      }
+	      if (cachedSplit != 0) cachedSplit->valid = false;
 	      continue;
 	    }
+	    
+	    if ((cachedSplit != 0)
+	        && CanReuseSplit (*cachedSplit, lightFrust, matrix,
+	          shadowMapSize, viewSetup.splitDists[frustNum], persist,
+	          currentFrame))
+	    {
+	      // Shadow map from an earlier frame is still good
+	      for (size_t t = 0; t < persist.settings.targets.GetSize(); t++)
+	      {
+	        const ShadowSettings::Target* target =
+	          viewSetup.persist.settings.targets[t];
+		iTextureHandle* tex = cachedSplit->textures[target->attachment];
+		lightFrust.textureSVs[target->attachment]->SetValue (tex);
+		if (renderTree.IsDebugFlagEnabled (persist.dbgShadowTex))
+		  renderTree.AddDebugTexture (tex);
+	      }
+	      persist.cacheStats.splitsSkipped++;
+	      persist.cacheStats.totalSkipped++;
+	      continue;
+	    }
+	    persist.cacheStats.splitsRendered++;
+	    persist.cacheStats.totalRendered++;
     
 	    csReversibleTransform view = superFrust.world2light_base;
 	    
@@ -709,13 +856,27 @@ namespace RenderManager
 	    {
 	      ShadowSettings::Target* target =
 		viewSetup.persist.settings.targets[t];
-	      iTextureHandle* tex = target->texCache.QueryUnusedTexture (
-		shadowMapSize, shadowMapSize);
+	      iTextureHandle* tex;
+	      if (cachedSplit != 0)
+	        tex = cachedSplit->GetTexture (persist, target, shadowMapSize);
+	      else
+	        tex = target->texCache.QueryUnusedTexture (
+		  shadowMapSize, shadowMapSize);
 	      lightFrust.textureSVs[target->attachment]->SetValue (tex);
 	      if (renderTree.IsDebugFlagEnabled (persist.dbgShadowTex))
 	        renderTree.AddDebugTexture (tex);
 	      texHandles[target->attachment] = tex;
 	    }
+	    if (cachedSplit != 0)
+	    {
+	      cachedSplit->valid = true;
+	      cachedSplit->generation = persist.cacheGeneration;
+	      cachedSplit->renderFrame = currentFrame;
+	      cachedSplit->shadowMapSize = shadowMapSize;
+	      cachedSplit->matrix = matrix;
+	      cachedSplit->staticCasters = lightFrust.staticCasters;
+	      cachedSplit->dynamicCasters = lightFrust.dynamicCasters;
+	    }
 	    
 	    newRenderView->SetViewDimensions (shadowMapSize, shadowMapSize);
 	    csBox2 clipBox (0, 0, shadowMapSize, shadowMapSize);
@@ -763,6 +924,54 @@ namespace RenderManager
         lightProjectSetup = false;
       }
 
+      /**
+       * Check whether the cached shadow map of a split can be used instead
+       * of rendering it again.
+       */
+      bool CanReuseSplit (const CachedSplit& cached,
+        const typename SuperFrustum::Frustum& lightFrust,
+        const CS::Math::Matrix4& matrix, int shadowMapSize, float splitDist,
+        const PersistentData& persist, uint currentFrame)
+      {
+        if (!cached.valid
+            || (cached.generation != persist.cacheGeneration)
+            || (cached.shadowMapSize != shadowMapSize))
+          return false;
+        uint age = currentFrame - cached.renderFrame;
+        if ((persist.cacheMaxAge > 0) && (age >= persist.cacheMaxAge))
+          return false;
+        // Light, view or receivers changed
+        if (!CachedSplit::IsMatrixEqual (cached.matrix, matrix))
+          return false;
+        if (!(cached.staticCasters == lightFrust.staticCasters))
+          return false;
+        if (cached.dynamicCasters == lightFrust.dynamicCasters)
+          return true;
+        // Far splits only pick up moving casters every few frames
+        return (splitDist >= persist.cacheFarSplitDistance)
+          && (age < persist.cacheFarSplitInterval);
+      }
+
+      /// Free cached shadow maps of cameras that weren't used for a while
+      void PurgeCachedSplits (uint currentFrame)
+      {
+        // Number of frames after which cached shadow maps are freed
+        static const uint maxUnusedFrames = 300;
+        
+        csArray<csRef<iCamera> > unusedCameras;
+        typename csHash<CachedSplits, csRef<iCamera> >::GlobalIterator it (
+          cachedSplitsHash.GetIterator());
+        while (it.HasNext())
+        {
+          csRef<iCamera> camera;
+          const CachedSplits& splits = it.Next (camera);
+          if (currentFrame - splits.lastUsedFrame > maxUnusedFrames)
+            unusedCameras.Push (camera);
+        }
+        for (size_t i = 0; i < unusedCameras.GetSize(); i++)
+          cachedSplitsHash.DeleteAll (unusedCameras[i]);
+      }
+
       iTextureHandle* GetEmptyShadowMap (PersistentData& persist, size_t target,
 					 typename RenderTree::ContextNode& context)
       {
@@ -949,8 +1158,34 @@ private:
       int numSplits;
       float farZ;
       float fixedCloseShadow;
+      
+      /// Whether shadow maps are kept over frames
+      bool cacheShadowMaps;
+      /// Age in frames after which cached shadow maps are re-rendered; 0 for no limit
+      uint cacheMaxAge;
+      /// Splits starting beyond this distance pick up moving casters less often
+      float cacheFarSplitDistance;
+      /// Frames between updates of far splits for moving casters
+      uint cacheFarSplitInterval;
+      /// Changing this invalidates all cached shadow maps
+      uint cacheGeneration;
+      
+      /// Shadow map cache counters
+      struct CacheStats
+      {
+        /// Splits rendered resp. reused in the last frame
+        uint splitsRendered, splitsSkipped;
+        /// Splits rendered resp. reused in total
+        uint64 totalRendered, totalSkipped;
+        
+        CacheStats() : splitsRendered (0), splitsSkipped (0),
+          totalRendered (0), totalSkipped (0) {}
+      };
+      CacheStats cacheStats;
 
-      PersistentData() : limitedShadow (false)
+      PersistentData() : limitedShadow (false), cacheShadowMaps (false),
+        cacheMaxAge (0), cacheFarSplitDistance (FLT_MAX),
+        cacheFarSplitInterval (1), cacheGeneration (0)
       {
       }
 
@@ -1009,6 +1244,15 @@ private:
             shadowMapRes);
           fixedCloseShadow = cfg->GetFloat (
             csString().Format ("%s.FixedCloseShadow", configPrefix.GetData()), 0);
+          cacheShadowMaps = cfg->GetBool (
+            csString().Format ("%s.ShadowMapCache", configPrefix.GetData()), false);
+          cacheMaxAge = csMax (0, cfg->GetInt (
+            csString().Format ("%s.ShadowMapCache.MaxAge", configPrefix.GetData()), 0));
+          cacheFarSplitDistance = cfg->GetFloat (
+            csString().Format ("%s.ShadowMapCache.FarSplitDistance", configPrefix.GetData()),
+            farZ * 0.5f);
+          cacheFarSplitInterval = csMax (1, cfg->GetInt (
+            csString().Format ("%s.ShadowMapCache.FarSplitInterval", configPrefix.GetData()), 1));
 	}
 	
 	unscaleSVName = strings->Request ("light shadow map unscale");
@@ -1026,7 +1270,18 @@ private:
         csTicks time = csGetTicks ();
         settings.AdvanceFrame (time);
         lightVarsPersist.UpdateNewFrame();
+        cacheStats.splitsRendered = 0;
+        cacheStats.splitsSkipped = 0;
       }
+      
+      /**
+       * Whether shadow maps are actually cached. Mesh IDs are assigned anew
+       * each frame, so shadow maps are never cached when IDs are provided.
+       */
+      bool IsShadowMapCacheActive () const
+      { return cacheShadowMaps && !settings.provideIDs; }
+      /// Re-render all cached shadow maps
+      void InvalidateShadowMapCache () { cacheGeneration++; }
     };
     
     typedef ViewSetup ShadowParameters;
@@ -1104,6 +1359,8 @@ private:
 	{
 	  superFrust.meshFilter.AddFilterMesh (singleMesh.meshWrapper);
 	  superFrust.castingObjectsBBoxPP += meshBboxLightPP;
+	  if (persist.IsShadowMapCacheActive())
+	    AddCasterToSplits (superFrust, singleMesh, meshBboxLightPP);
 	  /* Here's a stupid bug: limited shadow casters which are outside
 	     the view won't cast shadows */
 	}
@@ -1114,6 +1371,8 @@ private:
 	{
 	  // Mesh casts shadow
 	  superFrust.castingObjectsBBoxPP += meshBboxLightPP;
+	  if (persist.IsShadowMapCacheActive())
+	    AddCasterToSplits (superFrust, singleMesh, meshBboxLightPP);
 	}
 	else
 	{
@@ -1173,6 +1432,34 @@ private:
       return spreadFlags;
     }
     
+    /**
+     * Record a shadow caster in all splits it can cast shadows into, so
+     * changes to the casters can be detected by the shadow map cache.
+     * Casters flagged CS_ENTITY_STATICLIT count as static.
+     */
+    void AddCasterToSplits (
+      typename CachedLightData::SuperFrustum& superFrust,
+      typename RenderTree::MeshNode::SingleMesh& singleMesh,
+      const csBox3& meshBboxLightPP)
+    {
+      const bool isStatic = singleMesh.meshFlags.Check (CS_ENTITY_STATICLIT);
+      for (int f = 0; f < superFrust.actualNumParts; f++)
+      {
+	typename CachedLightData::SuperFrustum::Frustum& lightFrustum =
+	  superFrust.frustums[f];
+	// Casters anywhere between the light and the split matter, so ignore Z
+	const csBox3& volume = lightFrustum.volumePP;
+	if ((meshBboxLightPP.MaxX() < volume.MinX())
+	    || (meshBboxLightPP.MinX() > volume.MaxX())
+	    || (meshBboxLightPP.MaxY() < volume.MinY())
+	    || (meshBboxLightPP.MinY() > volume.MaxY()))
+	  continue;
+	typename CachedLightData::CasterSet& casters = isStatic
+	  ? lightFrustum.staticCasters : lightFrustum.dynamicCasters;
+	casters.Add (singleMesh.meshWrapper, meshBboxLightPP);
+      }
+    }
+    
     static bool NeedFinalHandleLight() { return true; }
     void FinalHandleLight (iLight* light, CachedLightData& lightData)
     {
@@ -131,7 +131,8 @@ namespace RenderManager
 
     /**
      * Setup an SV stack for direct access to given layer and set within SV
-     * array
+     * array. Different sets can be set up and filled from different threads
+     * at the same time.
      */
     void SetupSVStack (csShaderVariableStack& stack, size_t layer, size_t set)
     {
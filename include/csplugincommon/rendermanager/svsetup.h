@@ -40,6 +40,7 @@ namespace RenderManager
    * Sets up mesh-specific SVs for the object to world and inverse transform,
    * SVs from the layer, material, rendermesh and mesh wrapper.
    * Assumes that the contextLocalId in each mesh is set.
+   * Can be run in parallel with ForEachMeshNodeParallel().
    *
    * Usage: with iteration over each mesh. Usually after SetupStandardSVs. 
    * Example:
@@ -106,7 +107,7 @@ namespace RenderManager
   template<typename RenderTree, typename LayerConfigType>
   struct OperationTraits<StandardSVSetup<RenderTree, LayerConfigType> >
   {
-    typedef OperationUnordered Ordering;
+    typedef OperationUnorderedParallel Ordering;
   };
 
   
@@ -115,6 +116,7 @@ namespace RenderManager
    * from given shader and ticket arrays.
    * Assumes that the contextLocalId in each mesh is set.
    * Usually done through SetupStandardTicket().
+   * Can be run in parallel with ForEachMeshNodeParallel().
    */
   template<typename RenderTree, typename LayerConfigType>
   class ShaderSVSetup
@@ -128,13 +130,17 @@ namespace RenderManager
       : svArrays (svArrays), shaderArray (shaderArray),
       ticketArray (tickets), layerConfig (layerConfig)
     {
-      tempStack.Setup (svArrays.GetNumSVNames ());
     }
 
     void operator() (typename RenderTree::MeshNode* node)
     {
       const size_t totalMeshes = node->owner.totalRenderMeshes;
 
+      // Scratch stack on the call stack, so calls can run in parallel
+      const size_t numSVNames = svArrays.GetNumSVNames ();
+      CS_ALLOC_STACK_ARRAY(csShaderVariable*, tempArray, numSVNames);
+      csShaderVariableStack tempStack (tempArray, numSVNames);
+
       for (size_t i = 0; i < node->meshes.GetSize (); ++i)
       {
         typename RenderTree::MeshNode::SingleMesh& mesh = node->meshes[i];
@@ -164,14 +170,13 @@ namespace RenderManager
     SVArrayHolder& svArrays; 
     const ShaderArrayType& shaderArray;
     const TicketArrayType& ticketArray;
-    csShaderVariableStack tempStack;
     const LayerConfigType& layerConfig;
   };
 
   template<typename RenderTree, typename LayerConfigType>
   struct OperationTraits<ShaderSVSetup<RenderTree, LayerConfigType> >
   {
-    typedef OperationUnordered Ordering;
+    typedef OperationUnorderedParallel Ordering;
   };
 
 
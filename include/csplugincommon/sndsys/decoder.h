@@ -0,0 +1,275 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef SNDSYS_DECODER_H
+#define SNDSYS_DECODER_H
+
+/**\file
+ * Background decoding and decoded data caching for compressed sound elements
+ */
+
+#include "iutil/databuff.h"
+#include "iutil/job.h"
+#include "isndsys/ss_data.h"
+#include "csutil/array.h"
+#include "csutil/hash.h"
+#include "csutil/refarr.h"
+#include "csutil/scf_implementation.h"
+#include "csutil/threading/mutex.h"
+
+struct iObjectRegistry;
+
+/**\addtogroup sndsys
+ * @{ */
+
+namespace CS
+{
+  namespace SndSys
+  {
+  /**
+   * Decoder for compressed sound data which can decode ahead of playback.
+   *
+   * Implementations decode the sound chunk by chunk in DecodeChunk(). When a
+   * job queue is set with SetDecodeAhead() the decoder queues itself as a job
+   * that fills a look-ahead buffer in the background, so Read() on the sound
+   * thread usually only copies already decoded data. Without a job queue, or
+   * if the background decoding falls behind, Read() decodes on the calling
+   * thread.
+   *
+   * If the whole sound was already decoded (see SndSysDecodedDataCache), the
+   * decoder reads from that data instead and never decodes.
+   *
+   * All data is returned in the format of the source (source channels and
+   * rate) at the requested sample size; conversion is left to the stream.
+   */
+  class CS_CRYSTALSPACE_EXPORT SndSysDecoder :
+    public scfImplementation1<SndSysDecoder, iJob>
+  {
+  public:
+    /// Size of the chunks in which data is decoded
+    static const size_t ChunkSize = 4096;
+
+    /// \a frameBytes is the size of one decoded frame in bytes
+    SndSysDecoder (size_t frameBytes);
+    virtual ~SndSysDecoder ();
+
+    /**
+     * Decode in the background on \a queue, keeping up to \a lookAheadBytes
+     * of decoded data buffered.
+     */
+    void SetDecodeAhead (iJobQueue* queue, size_t lookAheadBytes);
+
+    /// Read from the fully decoded data of the sound instead of decoding
+    void SetDecodedData (iDataBuffer* decoded);
+
+    /**
+     * Read decoded data. Returns the number of bytes copied to \a dest, at
+     * most \a maxBytes, and 0 at the end of the data. \a section receives
+     * the number of the logical stream the data belongs to, if the format
+     * supports several.
+     */
+    size_t Read (char* dest, size_t maxBytes, int* section = 0);
+
+    /// Discard all buffered data and continue decoding from a frame
+    void Seek (size_t frame);
+
+    /// Queue background decoding if the look-ahead buffer is not full
+    void RequestDecode ();
+
+    /**
+     * Stop decoding in the background and wait for a running decode to
+     * finish. Must be called by the stream owning the decoder before it is
+     * destroyed, so that the job queue holds no reference to the decoder.
+     */
+    void Cancel ();
+
+    /**
+     * Decode the whole sound from the current position. Returns 0 if the
+     * data decodes to more than \a maxBytes or contains more than one
+     * logical stream.
+     */
+    csPtr<iDataBuffer> DecodeAll (size_t maxBytes);
+
+    /// iJob: fill the look-ahead buffer
+    virtual void Run ();
+
+  protected:
+    /**
+     * Decode the next part of the sound into \a buffer, at most \a maxBytes.
+     * Returns the number of bytes decoded and 0 at the end of the data.
+     * Only called with the codec locked, never concurrently.
+     */
+    virtual size_t DecodeChunk (char* buffer, size_t maxBytes,
+      int& section) = 0;
+
+    /// Seek the codec to a frame. Only called with the codec locked.
+    virtual void DecoderSeek (size_t frame) = 0;
+
+  private:
+    struct Chunk
+    {
+      csRef<iDataBuffer> data;
+      size_t size;
+      size_t used;
+      int section;
+    };
+
+    /**
+     * Protects the codec state. Held while decoding and always taken before
+     * \a mutex.
+     */
+    CS::Threading::Mutex codecMutex;
+    /// Protects the buffered chunks and the decoding state
+    CS::Threading::Mutex mutex;
+
+    /// Decoded data not yet read
+    csArray<Chunk> chunks;
+    /// Chunk buffers ready to be reused
+    csRefArray<iDataBuffer> spareBuffers;
+    size_t bufferedBytes;
+    size_t frameBytes;
+
+    csRef<iJobQueue> jobQueue;
+    size_t lookAheadBytes;
+    bool queued;
+    bool cancelled;
+    bool endOfData;
+
+    /// Fully decoded sound, if available
+    csRef<iDataBuffer> decodedData;
+    size_t decodedPosition;
+
+    /// Copy buffered data to \a dest. Called with \a mutex locked.
+    size_t ReadBuffered (char* dest, size_t maxBytes, int* section);
+    /// Get a buffer to decode a chunk into
+    csRef<iDataBuffer> GetSpareBuffer ();
+    /// Queue a decoded chunk; a \a size of 0 marks the end of the data.
+    void AddChunk (iDataBuffer* buffer, size_t size, int section);
+    /// Drop all buffered chunks
+    void FlushChunks ();
+  };
+
+  /**
+   * Size bounded cache of fully decoded sounds.
+   *
+   * Short sounds are decoded completely once and kept here, so that every
+   * stream created later from the same iSndSysData plays from memory instead
+   * of decoding again. When the cache grows beyond its size the least
+   * recently used sounds are dropped. All methods are thread safe.
+   */
+  class CS_CRYSTALSPACE_EXPORT SndSysDecodedDataCache :
+    public scfImplementation0<SndSysDecodedDataCache>
+  {
+  public:
+    /**
+     * \a maxBytes is the total size of the cache and \a maxSoundBytes the
+     * size of the largest sound that is cached.
+     */
+    SndSysDecodedDataCache (size_t maxBytes, size_t maxSoundBytes);
+    virtual ~SndSysDecodedDataCache ();
+
+    /// Whether a sound which decodes to \a decodedBytes bytes is cached
+    bool IsCacheable (size_t decodedBytes) const
+    {
+      return (decodedBytes > 0) && (decodedBytes <= maxSoundBytes)
+        && (decodedBytes <= maxBytes);
+    }
+
+    /// Get the decoded data of a sound at a sample size, 0 if not cached
+    csPtr<iDataBuffer> Get (iSndSysData* data, int bits);
+
+    /**
+     * Decode a sound into the cache on a job queue. \a decoder must be a
+     * decoder for \a data which is not used for anything else, and it must
+     * not keep a reference to \a data. Nothing is done if the sound is
+     * already cached or being decoded.
+     */
+    void DecodeInBackground (iJobQueue* queue, iSndSysData* data, int bits,
+      SndSysDecoder* decoder);
+
+    /// Remove a sound. Called when the sound data is destroyed.
+    void Remove (iSndSysData* data);
+
+    /// Get the size of all cached data in bytes
+    size_t GetCachedBytes ();
+
+  protected:
+    class DecodeJob;
+    friend class DecodeJob;
+
+    struct Entry
+    {
+      csRef<iDataBuffer> decoded;
+      int bits;
+      /// Value of useCounter at the last access
+      uint64 lastUse;
+      /// Whether decoding of the sound is still in progress
+      bool pending;
+      /// Identifies the job decoding the sound
+      uint64 ticket;
+    };
+    typedef csHash<Entry, csPtrKey<iSndSysData> > EntryHash;
+
+    CS::Threading::Mutex mutex;
+    EntryHash entries;
+    size_t maxBytes;
+    size_t maxSoundBytes;
+    size_t cachedBytes;
+    uint64 useCounter;
+
+    /**
+     * Store the decoded data of a sound. \a decoded is 0 if decoding failed.
+     * The data is dropped if the sound was removed in the meantime.
+     */
+    void Put (iSndSysData* data, uint64 ticket, iDataBuffer* decoded);
+
+    /// Drop least recently used sounds until \a needed more bytes fit
+    void MakeRoom (size_t needed);
+  };
+
+  /**
+   * Decoding settings shared by all sounds of a sound element plugin, read
+   * from the SndSys.Decode* keys of the sound configuration.
+   */
+  struct CS_CRYSTALSPACE_EXPORT SndSysDecodeSettings
+  {
+    /// Queue for background decoding, 0 if decoding ahead is disabled
+    csRef<iJobQueue> jobQueue;
+    /// How far to decode ahead of playback in milliseconds
+    size_t lookAheadMS;
+    /// Cache of fully decoded short sounds, 0 if disabled
+    csRef<SndSysDecodedDataCache> cache;
+
+    SndSysDecodeSettings () : lookAheadMS (0) {}
+
+    /// Read the settings and create the job queue and cache
+    void Load (iObjectRegistry* object_reg);
+
+    /**
+     * Set up background decoding for a decoder producing \a bytesPerSecond
+     * bytes of data per second.
+     */
+    void SetupDecoder (SndSysDecoder* decoder, size_t bytesPerSecond) const;
+  };
+
+  }
+}
+
+/** @} */
+
+#endif // #ifndef SNDSYS_DECODER_H
@@ -31,6 +31,8 @@
 #include "csutil/array.h"
 #include "csutil/scf_implementation.h"
 #include "csutil/set.h"
+#include "csutil/hash.h"
+#include "csutil/weakref.h"
 
 #include "ivaria/collider.h"
 
@@ -50,6 +52,8 @@ struct csCollisionPair;
 class csReversibleTransform;
 
 struct csIntersectingTriangle;
+struct iCollisionBroadPhase;
+class csColliderActor;
 
 /**
  * This is a convenience object that you can use in your own
@@ -162,6 +166,90 @@ public:
 
 };
 
+/**
+ * A persistent broad phase for meshes with a csColliderWrapper and for
+ * csColliderActor instances. It keeps the world space bounding boxes of
+ * all registered meshes and actors in an iCollisionBroadPhase (as created
+ * by the collide system) so that csColliderHelper::MoveActors() only has
+ * to do the expensive narrow phase tests for actors and meshes that
+ * can actually touch. Keep one instance around for as long as the
+ * registered meshes live; boxes are only updated for meshes that moved
+ * or changed shape. Actors unregister themselves when they are destroyed.
+ */
+class CS_CRYSTALSPACE_EXPORT csColliderBroadPhase
+{
+private:
+  struct MeshEntry
+  {
+    csWeakRef<iMeshWrapper> mesh;
+    long updateNumber;
+    long shapeNumber;
+  };
+  csRef<iCollisionBroadPhase> broadPhase;
+  /// Registered meshes indexed by broad phase box ID.
+  csHash<MeshEntry, size_t> meshes;
+  csHash<size_t, csPtrKey<iMeshWrapper> > meshIDs;
+  /// Registered actors indexed by broad phase box ID.
+  csHash<csColliderActor*, size_t> actors;
+  csHash<size_t, csPtrKey<csColliderActor> > actorIDs;
+
+  /// Get the shape number of the object model of a mesh.
+  static long GetShapeNumber (iMeshWrapper* mesh);
+  /// Register an actor with the given box.
+  size_t AddActor (csColliderActor* actor, const csBox3& box);
+
+public:
+  /// Create a new broad phase using the given collide system.
+  csColliderBroadPhase (iCollideSystem* colsys);
+  ~csColliderBroadPhase ();
+
+  /**
+   * Register a mesh. Only meshes that have a csColliderWrapper can take
+   * part in collision detection but this is only checked when colliding.
+   */
+  void AddMesh (iMeshWrapper* mesh);
+
+  /**
+   * Register all meshes from the engine that have a csColliderWrapper.
+   * If the optional collection is given only the meshes from that
+   * collection are registered.
+   */
+  void AddMeshes (iEngine* engine, iCollection* collection = 0);
+
+  /// Unregister a mesh.
+  void RemoveMesh (iMeshWrapper* mesh);
+
+  /// Register an actor. This is done automatically by MoveActors().
+  void AddActor (csColliderActor* actor);
+
+  /// Unregister an actor.
+  void RemoveActor (csColliderActor* actor);
+
+  /**
+   * Update the boxes of all registered meshes that moved or changed
+   * shape since the last call. Meshes that were destroyed are
+   * unregistered.
+   */
+  void UpdateMeshes ();
+
+  /**
+   * Set the box of an actor to the given world space box (normally the
+   * box that encloses its next move) and return its broad phase ID.
+   */
+  size_t UpdateActor (csColliderActor* actor, const csBox3& box);
+
+  /**
+   * Get the meshes that overlap the box of each actor. For every ID in
+   * \a actorIDs the corresponding entry in \a candidates will be filled
+   * with the meshes (and the meshes of other actors) that overlap it.
+   */
+  void GetCandidates (size_t num_actors, const size_t* actorIDs,
+      csArray<csArray<iMeshWrapper*> >& candidates);
+
+  /// Get the underlying broad phase.
+  iCollisionBroadPhase* GetBroadPhase () const { return broadPhase; }
+};
+
 /**
  * Return structure for the csColliderHelper::TraceBeam() method.
  */
@@ -342,6 +430,32 @@ public:
   static csTraceBeamResult TraceBeam (iCollideSystem* cdsys, iSector* sector,
 	const csVector3& start, const csVector3& end,
 	bool traverse_portals);
+
+  /**
+   * Move many actors at once. This is equivalent to calling
+   * csColliderActor::Move() on every actor but instead of asking the
+   * engine for nearby meshes for every single collision test the
+   * broad phase is used to find the meshes each actor can possibly hit
+   * during this move. Only those get a narrow phase test. If one of
+   * the candidates of an actor is a portal the actor falls back to
+   * the normal engine query so that collisions across sectors are still
+   * validated correctly.
+   * \param broadphase is the broad phase containing the meshes to
+   *   collide with. Actors are registered automatically.
+   * \param num_actors is the number of actors to move.
+   * \param actors is an array of actors.
+   * \param delta is the elapsed time in seconds (see
+   *   csColliderActor::Move()).
+   * \param speed is the desired movement speed.
+   * \param velBody is an array with the body velocity of every actor.
+   * \param angularVelocity is an array with the angular velocity of
+   *   every actor.
+   * \return the number of actors that moved.
+   */
+  static size_t MoveActors (csColliderBroadPhase& broadphase,
+	size_t num_actors, csColliderActor** actors,
+	float delta, float speed,
+	const csVector3* velBody, const csVector3* angularVelocity);
 };
 
 /**
@@ -379,6 +493,18 @@ private:
 
   int revertCount;
 
+  /**
+   * If not 0 then this is the list of meshes we test against instead of
+   * asking the engine for nearby meshes. Set by
+   * csColliderHelper::MoveActors().
+   */
+  const csArray<iMeshWrapper*>* candidateMeshes;
+  friend class csColliderHelper;
+
+  /// Broad phases this actor is registered with.
+  csArray<csColliderBroadPhase*> broadPhases;
+  friend class csColliderBroadPhase;
+
   /**
    * Performs the collision detection for the provided csColliderWrapper vs
    * all nearby objects.
@@ -421,6 +547,8 @@ private:
 public:
   /// Construct.
   csColliderActor ();
+  /// Destruct. This unregisters the actor from all broad phases.
+  ~csColliderActor ();
 
   /// Set the collision detection system.
   void SetCollideSystem (iCollideSystem* cdsys)
@@ -562,6 +690,19 @@ public:
 	csVector3& newpos,
 	const csVector3& vel,
 	float delta);
+
+  /// Get the mesh this actor is moving (0 if a camera is used).
+  iMeshWrapper* GetMesh () const { return mesh; }
+
+  /// Get the sector the actor is currently in.
+  iSector* GetSector () const;
+
+  /**
+   * Get a world space box that encloses all positions that Move() with
+   * the same parameters can test for collisions.
+   */
+  csBox3 GetMoveBoundingBox (float delta, float speed,
+  	const csVector3& velBody) const;
 };
 
 #endif // __CS_COLLIDER_H__
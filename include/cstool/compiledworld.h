@@ -0,0 +1,265 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_CSTOOL_COMPILEDWORLD_H__
+#define __CS_CSTOOL_COMPILEDWORLD_H__
+
+/**\file
+ * Compiled world format
+ */
+
+#include "csutil/ref.h"
+
+struct iCollection;
+struct iDataBuffer;
+struct iEngine;
+struct iObjectRegistry;
+
+namespace CS
+{
+  namespace Utility
+  {
+    /**
+     * A "compiled world" stores the contents of a map as binary records
+     * that the loader can instantiate without going through document
+     * nodes: all values are stored in their final binary representation
+     * and references between objects are resolved to record indices.
+     *
+     * The file starts with a Header, followed by the records. Each record
+     * starts with a RecordHeader and is padded to a multiple of 4 bytes.
+     * All values are 32 bit and stored in the byte order of the machine
+     * that compiled the world; a compiled world is meant to be generated
+     * from the original map for the machine it is used on.
+     *
+     * Strings are stored in a #recStrings record which must come first.
+     * Other records refer to strings by their offset in that record and to
+     * other objects by the index of the object in the records of the same
+     * type.
+     */
+    namespace CompiledWorld
+    {
+      /// Identifies a compiled world ("CSCW")
+      static const uint32 magic = 0x57435343;
+      /// Stored as the byte order mark
+      static const uint32 byteOrder = 0x01020304;
+      static const uint32 version = 1;
+      /// Value of a missing string or object reference
+      static const uint32 none = 0xffffffff;
+
+      enum RecordType
+      {
+        /// Null-terminated strings
+        recStrings = 1,
+        /// Shader (Shader)
+        recShader,
+        /// Texture (Texture)
+        recTexture,
+        /// Material (Material, followed by shaders and shader variables)
+        recMaterial,
+        /**
+         * Genmesh factory (Factory, followed by the vertex data, the
+         * triangles and the submeshes)
+         */
+        recFactory,
+        /// Sector (Sector)
+        recSector,
+        /// Mesh placed in a sector (Mesh)
+        recMesh,
+        /// Light placed in a sector (Light)
+        recLight,
+        /// Camera position (Start)
+        recStart
+      };
+
+      struct Header
+      {
+        uint32 magic;
+        uint32 byteOrder;
+        uint32 version;
+        uint32 numRecords;
+      };
+
+      struct RecordHeader
+      {
+        uint32 type;
+        /// Size of the record data following the header
+        uint32 size;
+      };
+
+      struct Transform
+      {
+        /// Object to this matrix, row major
+        float matrix[9];
+        float origin[3];
+      };
+
+      struct Shader
+      {
+        uint32 name;
+        uint32 file;
+      };
+
+      struct Texture
+      {
+        uint32 name;
+        uint32 file;
+        uint32 flags;
+      };
+
+      struct Material
+      {
+        uint32 name;
+        uint32 numShaders;
+        uint32 numVariables;
+      };
+
+      struct MaterialShader
+      {
+        uint32 type;
+        /// Shader index
+        uint32 shader;
+      };
+
+      struct ShaderVariable
+      {
+        uint32 name;
+        /// csShaderVariable::VariableType
+        uint32 type;
+        /// Texture index for texture variables, value for int variables
+        uint32 texture;
+        float value[4];
+      };
+
+      /**
+       * The lighting and shadow flags are the inverse of the
+       * CS_ENTITY_NOLIGHTING, CS_ENTITY_NOSHADOWCAST and
+       * CS_ENTITY_NOSHADOWRECEIVE flags of the factory wrapper.
+       */
+      enum FactoryFlags
+      {
+        factLighting = 1,
+        factShadowCasting = 2,
+        factShadowReceiving = 4,
+        factManualColors = 8,
+        factBack2Front = 16,
+        factHasTexels = 32,
+        factHasNormals = 64,
+        factHasColors = 128
+      };
+
+      /**
+       * Followed by the vertices (3 floats each), texels (2 floats),
+       * normals (3 floats) and colors (4 floats), as far as present, the
+       * triangles (3 ints each) and the submeshes (each a SubMesh followed
+       * by its indices).
+       */
+      struct Factory
+      {
+        uint32 name;
+        uint32 material;
+        uint32 mixmode;
+        uint32 renderPriority;
+        /// csZBufMode
+        uint32 zbufMode;
+        /// FactoryFlags
+        uint32 flags;
+        uint32 numVertices;
+        uint32 numTriangles;
+        uint32 numSubMeshes;
+      };
+
+      struct SubMesh
+      {
+        uint32 name;
+        uint32 material;
+        uint32 mixmode;
+        uint32 numIndices;
+        uint32 minIndex;
+        uint32 maxIndex;
+      };
+
+      struct Sector
+      {
+        uint32 name;
+      };
+
+      struct Mesh
+      {
+        uint32 name;
+        uint32 factory;
+        uint32 sector;
+        /// Material overriding the factory material
+        uint32 material;
+        uint32 renderPriority;
+        uint32 zbufMode;
+        /// Mesh wrapper flags
+        uint32 flags;
+        /// Mesh object flags
+        uint32 objectFlags;
+        Transform transform;
+      };
+
+      struct Light
+      {
+        uint32 name;
+        uint32 sector;
+        /// csLightType
+        uint32 type;
+        /// csLightDynamicType
+        uint32 dynamicType;
+        /// csLightAttenuationMode
+        uint32 attenuationMode;
+        uint32 flags;
+        float color[3];
+        float cutoffDistance;
+        float attenuation[4];
+        float spotInner;
+        float spotOuter;
+        Transform transform;
+      };
+
+      struct Start
+      {
+        uint32 name;
+        /// Sector name, as camera positions refer to sectors by name
+        uint32 sector;
+        float position[3];
+        float forward[3];
+        float up[3];
+      };
+
+      /// Check whether \a data starts with a compiled world header
+      CS_CRYSTALSPACE_EXPORT bool IsCompiledWorld (iDataBuffer* data);
+
+      /**
+       * Compile the world currently loaded into \a engine. If \a collection
+       * is given only objects from that collection are written.
+       *
+       * Only what the format can represent is written: shaders loaded from
+       * files, 2D textures loaded from files, materials, genmesh factories,
+       * sectors, genmesh objects, lights and camera positions. Other
+       * objects are skipped and a warning is reported for each of them.
+       */
+      CS_CRYSTALSPACE_EXPORT csPtr<iDataBuffer> Compile (
+        iObjectRegistry* objectReg, iEngine* engine,
+        iCollection* collection = 0);
+    } // namespace CompiledWorld
+  } // namespace Utility
+} // namespace CS
+
+#endif // __CS_CSTOOL_COMPILEDWORLD_H__
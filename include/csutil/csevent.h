@@ -65,8 +65,12 @@ private:
     };
     csEventAttributeType type;
     size_t dataSize;
+    attribute () { type = csEventAttrUnknown; }
     attribute (csEventAttributeType t) { type = t; }
-    attribute (const attribute &o) 
+    attribute (const attribute &o) { CopyFrom (o); }
+    ~attribute () { Release (); }
+    /// Copy the value of another attribute, duplicating owned data.
+    void CopyFrom (const attribute &o)
     {
       type = o.type;
       intVal = o.intVal;
@@ -75,18 +79,40 @@ private:
         ibaseVal->IncRef();
       if (type == csEventAttrDatabuffer) 
       {
-        bufferVal = new char[dataSize];
-        memcpy(bufferVal, o.bufferVal,dataSize);
+        // Buffers are always stored with a terminating null
+        bufferVal = new char[dataSize + 1];
+        memcpy(bufferVal, o.bufferVal, dataSize + 1);
       }
     }
-    ~attribute () 
+    /// Move the value of another attribute here, leaving \a o empty.
+    void TakeOver (attribute &o)
+    {
+      type = o.type;
+      intVal = o.intVal;
+      dataSize = o.dataSize;
+      o.type = csEventAttrUnknown;
+    }
+    /// Release owned data and mark the attribute as empty.
+    void Release ()
     { 
       if (type == csEventAttrDatabuffer) 
         delete[] bufferVal; 
       else if ((type == csEventAttrEvent) || (type == csEventAttriBase))
         ibaseVal->DecRef();
+      type = csEventAttrUnknown;
     }
   };
+  /**
+   * Number of attributes stored directly in the event. Most events carry
+   * only a handful of attributes; as events are recycled through the
+   * csPoolEvent pool, keeping those inline means adding and retrieving them
+   * does not touch the heap. Further attributes go to \c attributes.
+   */
+  enum { inlineAttributeCount = 8 };
+  attribute inlineAttributes[inlineAttributeCount];
+  csStringID inlineKeys[inlineAttributeCount];
+  size_t inlineCount;
+  /// Attributes that did not fit into the inline slots.
   csHash<attribute*, csStringID> attributes;
   friend class csEventAttributeIterator;
 
@@ -94,26 +120,40 @@ private:
 
   bool CheckForLoops(iEvent *current, iEvent *e);
 
+  /// Look up an attribute, first in the inline slots, then in the hash.
+  attribute* FindAttribute (csStringID id) const
+  {
+    for (size_t i = 0; i < inlineCount; i++)
+    {
+      if (inlineKeys[i] == id)
+        return const_cast<attribute*> (&inlineAttributes[i]);
+    }
+    if (attributes.GetSize() == 0) return 0;
+    return attributes.Get (id, 0);
+  }
+  /**
+   * Create a new attribute of the given type. Returns 0 if an attribute with
+   * that name already exists.
+   */
+  attribute* NewAttribute (csStringID id, csEventAttributeType type);
+  void PrintAttribute (int level, csStringID name, attribute* object);
+
   template <class T>
   bool InternalAddInt (const char* name, T value)
   {
-    if (attributes.In (GetKeyID (name))) return false;
-    attribute* object = new attribute (csEventAttrInt);	
-    object->intVal = (int64)value;				
-    attributes.Put (GetKeyID (name), object);				
-    count++;							
-    return true;						
+    attribute* object = NewAttribute (GetKeyID (name), csEventAttrInt);
+    if (!object) return false;
+    object->intVal = (int64)value;
+    return true;
   }
 
   template <class T>
   bool InternalAddUInt (const char* name, T value)
   {
-    if (attributes.In (GetKeyID (name))) return false;
-    attribute* object = new attribute (csEventAttrUInt);	
-    object->intVal = (int64)value;				
-    attributes.Put (GetKeyID (name), object);				
-    count++;							
-    return true;						
+    attribute* object = NewAttribute (GetKeyID (name), csEventAttrUInt);
+    if (!object) return false;
+    object->intVal = (int64)value;
+    return true;
   }
 
   csEventError InternalReportMismatch (attribute* attr) const
@@ -141,7 +181,7 @@ private:
   template <class T>
   csEventError InternalRetrieveInt (const char* name, T& value) const
   {								
-    attribute* object = attributes.Get (GetKeyID (name), 0);
+    attribute* object = FindAttribute (GetKeyID (name));
     if (!object) return csEventErrNotFound;
     if ((object->type == csEventAttrInt) || (object->type == csEventAttrUInt))
     {									
@@ -162,7 +202,7 @@ private:
   template <class T>
   csEventError InternalRetrieveUint (const char* name, T& value) const
   {								
-    attribute* object = attributes.Get (GetKeyID (name), 0);
+    attribute* object = FindAttribute (GetKeyID (name));
     if (!object) return csEventErrNotFound;
     if ((object->type == csEventAttrInt) || (object->type == csEventAttrUInt))
     {									
@@ -242,7 +282,7 @@ public:
 #undef CS_CSEVENT_FINDINT
   virtual csEventError Retrieve (const char* name, int64& value) const
   {								
-    attribute* object = attributes.Get (GetKeyID (name), 0);
+    attribute* object = FindAttribute (GetKeyID (name));
     if (!object) return csEventErrNotFound;
     if ((object->type == csEventAttrInt) || (object->type == csEventAttrUInt))
     {									
@@ -264,7 +304,7 @@ public:
 #undef CS_CSEVENT_FINDUINT
   virtual csEventError Retrieve (const char* name, uint64& value) const
   {								
-    attribute* object = attributes.Get (GetKeyID (name), 0);
+    attribute* object = FindAttribute (GetKeyID (name));
     if (!object) return csEventErrNotFound;
     if ((object->type == csEventAttrInt) || (object->type == csEventAttrUInt))
     {									
@@ -341,12 +381,14 @@ public:
 class csEventAttributeIterator : 
   public scfImplementation1<csEventAttributeIterator, iEventAttributeIterator>
 {
-  csHash<csEvent::attribute*, csStringID>::GlobalIterator iterator;								 
+  csRef<csEvent> event;
+  size_t inlineIndex;
+  csHash<csEvent::attribute*, csStringID>::GlobalIterator iterator;
 public:
   
-  csEventAttributeIterator (
-    csHash<csEvent::attribute*, csStringID>::GlobalIterator& iter) 
-    : scfImplementationType (this),  iterator(iter)
+  csEventAttributeIterator (csEvent* event) 
+    : scfImplementationType (this), event (event), inlineIndex (0),
+      iterator (event->attributes.GetIterator())
   {
   }
 
@@ -356,11 +398,12 @@ public:
 
   virtual bool HasNext()
   {
-    return iterator.HasNext();
+    return (inlineIndex < event->inlineCount) || iterator.HasNext();
   }
   virtual const char* Next();
   virtual void Reset()
   {
+    inlineIndex = 0;
     iterator.Reset();
   }
 };
@@ -37,6 +37,8 @@
 #include "csutil/ref.h"
 #include "csutil/refarr.h"
 #include "csutil/scf_implementation.h"
+#include "csutil/threading/atomicops.h"
+#include "csutil/threading/mutex.h"
 #include "csutil/threading/rwmutex.h"
 #include "csutil/weakref.h"
 #include "csutil/eventhandlers.h"
@@ -51,8 +53,8 @@ class csEventOutlet;
 class csPoolEvent;
 
 /**\internal
- * Default event queue size: the queue will automatically grow
- * when the queue will overflow.
+ * Default event queue size. This is the capacity of the lock-free posting
+ * ring; events posted while the ring is full are kept in an overflow list.
  */
 #define DEF_EVENT_QUEUE_LENGTH  256
 
@@ -79,12 +81,32 @@ private:
   csRef<iEventNameRegistry> NameRegistry;
   // Event handler registry
   csRef<iEventHandlerRegistry> HandlerRegistry;
-  // The queue itself (technically, a ring buffer)
-  volatile iEvent** EventQueue;
-  // Queue head and tail pointers
-  volatile size_t evqHead, evqTail;
-  // The maximum queue length
-  volatile size_t Length;  
+  /* The queue itself: a bounded multi-producer/single-consumer ring.
+   * Each slot carries a sequence number telling whether it is ready to be
+   * written (sequence == position) or read (sequence == position + 1), so
+   * producers only need to agree on the head position (via compare-and-set)
+   * and never block each other or the consumer. */
+  struct RingSlot
+  {
+    int32 sequence;
+    iEvent* event;
+  };
+  RingSlot* EventRing;
+  // Number of ring slots (a power of two), and the mask to wrap positions
+  int32 ringLength, ringMask;
+  // Next position to be claimed by a producer
+  int32 ringHead;
+  // Next position to be read by the consumer
+  int32 ringTail;
+  /* Events posted while the ring was full, in posting order. 'overflowing'
+   * is set while this list is non-empty so later posts queue up behind it
+   * instead of overtaking it through the ring. */
+  csArray<iEvent*> overflow;
+  int32 overflowing;
+  CS::Threading::Mutex overflowMutex;
+  // Overflow events handed to the consumer, and the position of the next one
+  csArray<iEvent*> overflowTaken;
+  size_t overflowTakenPos;
   // Event tree.  All subscription PO graphs and delivery queues hang off
   // of this.
   csEventTree *EventTree;
@@ -96,14 +118,17 @@ private:
   csHash<csEventCord *, csEventID> EventCords;
   // Pool of event objects
   csPoolEvent* EventPool;
+  CS::Threading::Mutex poolMutex;
   /// Registered event handler (used for proper cleanup in RemoveAllListeners())
   csRefArray<iEventHandler> handlers;
   /// Mutex for thread safety.
   CS::Threading::ReadWriteMutex mutex;
   CS::Threading::ReadWriteMutex etreeMutex;
 
-  // Enlarge the queue size.
-  void Resize (size_t iLength);  
+  // Try to place an event into the ring; fails if the ring is full.
+  bool RingPush (iEvent* Event);
+  // Take the next event from the ring, or 0 if there is none.
+  iEvent* RingPop ();
   // Send broadcast pseudo-events (bypassing event queue).
   void Notify (const csEventID &name);
 
@@ -214,14 +239,20 @@ public:
   virtual csPtr<iEvent> CreateEvent (const char *name);
   virtual csPtr<iEvent> CreateBroadcastEvent (const csEventID &name);
   virtual csPtr<iEvent> CreateBroadcastEvent (const char *name);
-  /// Place an event into queue.
+  /**
+   * Place an event into queue. May be called from any thread; does not
+   * block unless the queue is full.
+   */
   virtual void Post (iEvent*);
-  /// Get next event from queue or a null references if no event.
+  /**
+   * Get next event from queue or a null references if no event.
+   * Only one thread (the one processing the queue) may get events.
+   */
   virtual csPtr<iEvent> Get ();
   /// Clear event queue
   virtual void Clear ();
   /// Query if queue is empty (@@@ Not thread safe!)
-  virtual bool IsEmpty () { return evqHead == evqTail; }
+  virtual bool IsEmpty ();
 
   csEventID Frame;
 };
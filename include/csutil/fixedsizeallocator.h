@@ -517,6 +517,8 @@ namespace CS
      * Thread-safe allocator for blocks of the same size.
      * Has the same purpose and interface as csFixedSizeAllocator but is safe
      * to be used concurrently from different threads.
+     * \sa FixedSizeAllocatorThreadCached for a version that does not lock
+     *   on each allocation
      */
     template <size_t Size, class Allocator = CS::Memory::AllocatorMalloc>
     class FixedSizeAllocatorSafe :
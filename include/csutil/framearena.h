@@ -0,0 +1,223 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+#ifndef __CS_CSUTIL_FRAMEARENA_H__
+#define __CS_CSUTIL_FRAMEARENA_H__
+
+/**\file
+ * Linear memory arena for short-lived per-frame allocations
+ */
+
+#include "csextern.h"
+#include "csutil/array.h"
+#include "csutil/threading/mutex.h"
+#include "csutil/threading/tls.h"
+
+#include "csutil/custom_new_disable.h"
+
+/**\addtogroup util_memory
+ * @{ */
+
+namespace CS
+{
+  namespace Memory
+  {
+    /**
+     * A "bump" allocator for data living at most one frame. Allocation just
+     * advances a pointer in the current chunk; individual frees do nothing,
+     * all memory is reclaimed at once by Reset() at the end of the frame.
+     * After a frame that needed more than one chunk, Reset() replaces the
+     * chunks with a single one big enough for that frame, so steady-state
+     * frames allocate from one contiguous block.
+     *
+     * Objects placed into the arena must be destructed explicitly before
+     * Reset() if they need it (see the \c new operator below).
+     *
+     * Can be used as an allocator template parameter (e.g. for csArray) via
+     * FrameArenaAllocator. Not thread-safe; see FrameArenaPerThread.
+     */
+    class CS_CRYSTALSPACE_EXPORT FrameArena
+    {
+      struct Chunk
+      {
+        Chunk* next;
+        size_t size;
+      };
+      /// All chunks; the current one is first.
+      Chunk* chunks;
+      /// Next free byte in the current chunk.
+      uint8* top;
+      /// End of the current chunk.
+      uint8* end;
+      /// Start of the most recent allocation (for in-place Realloc()).
+      uint8* lastAlloc;
+      /// Minimum size of a chunk.
+      size_t granularity;
+      /// Bytes allocated in the current frame.
+      size_t used;
+      /// Bytes allocated in the previous frame.
+      size_t lastFrameUsed;
+      /// Most bytes allocated in any frame.
+      size_t peakUsed;
+      /// Number of chunks in use.
+      size_t numChunks;
+
+      void NewChunk (size_t minSize);
+      void FreeChunks ();
+
+      FrameArena (FrameArena const&);      // Illegal; unimplemented.
+      void operator= (FrameArena const&);  // Illegal; unimplemented.
+    public:
+      /// Default alignment of allocations.
+      enum { defaultAlignment = 16 };
+
+      /**
+       * Construct an arena. \a granularity is the minimum size of a chunk
+       * requested from the heap.
+       */
+      FrameArena (size_t granularity = 64*1024);
+      /// Destroy the arena, freeing all memory.
+      ~FrameArena ();
+
+      /**
+       * Allocate \a n bytes aligned to \a align (a power of 2). The memory is
+       * valid until the next Reset().
+       */
+      CS_ATTRIBUTE_MALLOC void* Alloc (size_t n,
+        size_t align = defaultAlignment)
+      {
+        uint8* p = (uint8*)((uintptr_t (top) + align - 1)
+          & ~uintptr_t (align - 1));
+        if ((top == 0) || (p > end) || (size_t (end - p) < n))
+        {
+          NewChunk (n + align);
+          p = (uint8*)((uintptr_t (top) + align - 1) & ~uintptr_t (align - 1));
+        }
+        used += (p + n) - top;
+        top = p + n;
+        lastAlloc = p;
+        return p;
+      }
+      /// Does nothing; memory is reclaimed by Reset().
+      void Free (void* /*p*/) {}
+      /**
+       * Resize the most recent allocation in place. Returns 0 if \a p is not
+       * the most recent allocation or there is not enough room; callers must
+       * then allocate anew and copy.
+       */
+      void* Realloc (void* p, size_t newSize)
+      {
+        if ((p == 0) || (p != lastAlloc)) return 0;
+        uint8* const start = (uint8*)p;
+        if (size_t (end - start) < newSize) return 0;
+        used = used - (top - start) + newSize;
+        top = start + newSize;
+        return p;
+      }
+      /// Set the information used for memory tracking (ignored).
+      void SetMemTrackerInfo (const char* /*info*/) {}
+
+      /**
+       * End the frame: invalidate all allocations and make the memory
+       * available again.
+       */
+      void Reset ();
+
+      /// Bytes allocated since the last Reset().
+      size_t GetUsedBytes () const { return used; }
+      /// Bytes allocated in the frame before the last Reset().
+      size_t GetLastFrameBytes () const { return lastFrameUsed; }
+      /// Most bytes allocated in a single frame.
+      size_t GetPeakBytes () const { return peakUsed; }
+      /// Bytes currently obtained from the heap.
+      size_t GetReservedBytes () const;
+    };
+
+    /**
+     * Allocator referencing a FrameArena, usable as the allocator parameter
+     * of containers. A default-constructed instance (e.g. in a copied
+     * container) uses the heap.
+     */
+    class FrameArenaAllocator
+    {
+      FrameArena* arena;
+    public:
+      FrameArenaAllocator () : arena (0) {}
+      FrameArenaAllocator (FrameArena& arena) : arena (&arena) {}
+
+      CS_ATTRIBUTE_MALLOC void* Alloc (const size_t n)
+      { return arena ? arena->Alloc (n) : cs_malloc (n); }
+      void Free (void* p)
+      { if (!arena) cs_free (p); }
+      void* Realloc (void* p, size_t newSize)
+      { return arena ? arena->Realloc (p, newSize) : cs_realloc (p, newSize); }
+      void SetMemTrackerInfo (const char* /*info*/) {}
+    };
+
+    /**
+     * A frame arena for each thread, so worker threads can allocate
+     * per-frame data without locking. Reset() ends the frame for all
+     * threads and must not be called while other threads allocate.
+     */
+    class CS_CRYSTALSPACE_EXPORT FrameArenaPerThread
+    {
+      CS::Threading::ThreadLocal<FrameArena*> threadArena;
+      csArray<FrameArena*> arenas;
+      mutable CS::Threading::Mutex arenasLock;
+      size_t granularity;
+      size_t lastFrameUsed;
+
+      FrameArena* CreateArena ();
+    public:
+      FrameArenaPerThread (size_t granularity = 64*1024);
+      ~FrameArenaPerThread ();
+
+      /// Get the arena of the calling thread.
+      FrameArena& Get ()
+      {
+        FrameArena* arena = threadArena;
+        if (arena == 0) arena = CreateArena ();
+        return *arena;
+      }
+
+      /// End the frame for the arenas of all threads.
+      void Reset ();
+
+      /// Bytes allocated by all threads since the last Reset().
+      size_t GetUsedBytes () const;
+      /// Bytes allocated by all threads in the frame before the last Reset().
+      size_t GetLastFrameBytes () const { return lastFrameUsed; }
+    };
+  } // namespace Memory
+} // namespace CS
+
+/** @{ */
+/**
+ * Convenience \c new operator which makes the allocation from a
+ * CS::Memory::FrameArena. The destructor of such objects has to be invoked
+ * explicitly before the arena is reset.
+ */
+inline void* operator new (size_t n, CS::Memory::FrameArena& a)
+{ return a.Alloc (n); }
+inline void operator delete (void* /*p*/, CS::Memory::FrameArena& /*a*/) { }
+/** @} */
+
+/** @} */
+
+#include "csutil/custom_new_enable.h"
+
+#endif // __CS_CSUTIL_FRAMEARENA_H__
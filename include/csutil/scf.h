@@ -305,6 +305,18 @@ CS_CRYSTALSPACE_EXPORT void scfInitialize(csPathsList const* pluginPaths,
 CS_CRYSTALSPACE_EXPORT void scfInitialize(int argc, const char* const argv[],
   bool scanDefaultPluginPaths = true);
 
+/**
+ * Set the file in which plugin scans cache the class registrations of plugin
+ * modules. Modules are only examined again if they changed since they were
+ * cached. By default the cache is kept in the per-user configuration
+ * directory (see csGetPlatformConfigPath()). Pass 0 to disable the cache.
+ * Affects subsequent scfInitialize() and iSCF::ScanPluginsPath() calls.
+ */
+CS_CRYSTALSPACE_EXPORT void scfSetPluginCache (const char* filename);
+
+/// Get the plugin cache file; 0 if the cache is disabled.
+CS_CRYSTALSPACE_EXPORT const char* scfGetPluginCache ();
+
 //@{
 /**
  * Register a static class.
@@ -0,0 +1,864 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+#ifndef __CSUTIL_THREADCACHEDALLOCATOR_H__
+#define __CSUTIL_THREADCACHEDALLOCATOR_H__
+
+/**\file
+ * Fixed size allocators with per-thread caches
+ */
+
+#include "csextern.h"
+#include "csutil/allocator.h"
+#include "csutil/array.h"
+#include "csutil/bitarray.h"
+#include "csutil/blockallocator.h"
+#include "csutil/sysfunc.h"
+#include "csutil/threading/atomicops.h"
+#include "csutil/threading/mutex.h"
+#include "csutil/threading/tls.h"
+
+#ifdef CS_DEBUG
+#include <typeinfo>
+#endif
+
+#include "csutil/custom_new_disable.h"
+
+/**\addtogroup util_memory
+ * @{ */
+
+namespace CS
+{
+  namespace Memory
+  {
+    /**
+     * Thread-safe allocator for blocks of the same size which, unlike
+     * FixedSizeAllocatorSafe, does not take a lock for each Alloc() and
+     * Free().
+     *
+     * Each thread using the allocator owns two "magazines", small stacks
+     * of free blocks, and serves Alloc() and Free() from them without any
+     * synchronization. Only when both magazines of a thread run empty (or
+     * full) is a magazine exchanged with one of two global lock-free lists
+     * of full resp. empty magazines. The heads of those lists carry a tag
+     * that is changed on every update, so a compare-and-set can not succeed
+     * on a stale head (the "ABA problem"). A mutex is only taken when new
+     * memory has to be obtained from the underlying allocator.
+     *
+     * Has the same interface as csFixedSizeAllocator, so it can be used
+     * as the allocator template parameter of containers and as a
+     * replacement of FixedSizeAllocatorSafe.
+     *
+     * \remarks Blocks freed by a thread are cached by that thread. When a
+     *   thread which used the allocator terminates, the blocks in its
+     *   magazines remain unused until the allocator is emptied or destroyed;
+     *   call FlushThreadCache() before a thread exits to return them.
+     * \remarks Every instance uses a thread-local storage slot, of which the
+     *   number is limited on most platforms. The allocator is thus best
+     *   suited for long-lived, shared pools, not for per-object pools.
+     * \remarks Empty(), Compact(), GetAllocatedElems() and destruction must
+     *   not happen concurrently with other uses of the allocator.
+     * \sa BlockAllocatorThreadCached for a version that constructs and
+     *   destructs objects
+     */
+    template <size_t Size, class Allocator = AllocatorMalloc>
+    class FixedSizeAllocatorThreadCached
+    {
+    public:
+      typedef FixedSizeAllocatorThreadCached<Size, Allocator> ThisType;
+      typedef Allocator AllocatorType;
+
+      /// Number of blocks a magazine holds.
+      enum { magazineSize = 32 };
+
+    protected:
+      struct FreeNode
+      {
+        FreeNode* next;
+      };
+
+      struct BlockKey
+      {
+        uint8 const* addr;
+        size_t blocksize;
+        BlockKey(uint8 const* p, size_t n) : addr(p), blocksize(n) {}
+      };
+
+      struct BlocksWrapper : public Allocator
+      {
+        csArray<uint8*> b;
+
+        BlocksWrapper () {}
+        BlocksWrapper (const Allocator& alloc) : Allocator (alloc) {}
+      };
+
+      /**
+       * A stack of free blocks. Magazines are referenced by a 1-based index
+       * instead of a pointer so that the index and an update tag fit into
+       * the pointer-sized word a list head is made of.
+       */
+      struct Magazine
+      {
+        /// Index of the next magazine in a global list, 0 for none.
+        size_t next;
+        /// Index of this magazine.
+        size_t index;
+        /// Number of blocks in the magazine.
+        size_t count;
+        void* blocks[magazineSize];
+      };
+
+      /// The magazines used by one thread.
+      struct ThreadCache
+      {
+        Magazine* loaded;
+        Magazine* previous;
+        ThreadCache* nextCache;
+      };
+
+      /// Number of bits of a list head used for the magazine index.
+      enum { indexBits = sizeof (size_t) * 4 };
+      /**
+       * Magazines are allocated in chunks, chunk \c n holding
+       * <tt>firstChunkSize << n</tt> magazines.
+       */
+      enum { firstChunkShift = 8, firstChunkSize = 1 << firstChunkShift };
+      enum { maxChunks = indexBits - firstChunkShift + 1 };
+
+      static size_t IndexMask ()
+      { return (size_t (1) << indexBits) - 1; }
+      static size_t TagIncrement ()
+      { return size_t (1) << indexBits; }
+
+      /// List of allocated blocks; sorted by address.
+      BlocksWrapper blocks;
+      /// Number of elements per block.
+      size_t elcount;
+      /// Element size; >= sizeof(void*).
+      size_t elsize;
+      /// Size in bytes per block.
+      size_t blocksize;
+
+      /// Head of the list of non-empty magazines (tag and index).
+      size_t fullMagazines;
+      /// Head of the list of empty magazines (tag and index).
+      size_t emptyMagazines;
+      /// Magazine storage; a chunk is never freed before destruction.
+      Magazine* magazineChunks[maxChunks];
+      /// Number of magazines created so far.
+      size_t numMagazines;
+
+      /// Each thread's magazines.
+      CS::Threading::ThreadLocal<ThreadCache*> threadCache;
+      /// All thread caches, so their contents can be found when disposing.
+      ThreadCache* threadCaches;
+      /**
+       * Free blocks for which no magazine could be created. Only used when
+       * the magazine indices are exhausted.
+       */
+      FreeNode* overflow;
+      /// Lock for blocks, magazine creation, thread caches and overflow.
+      mutable CS::Threading::Mutex lock;
+      /// Flag to ignore calls to Free() while disposing all objects.
+      bool insideDisposeAll;
+
+      /**\name Lock-free magazine lists
+       * @{ */
+      static size_t ReadHead (size_t const* head)
+      {
+        return (size_t)CS::Threading::AtomicOperations::Read (
+          (void* const*)head);
+      }
+
+      static bool CompareAndSetHead (size_t* head, size_t value,
+        size_t comparand)
+      {
+        return (size_t)CS::Threading::AtomicOperations::CompareAndSet (
+          (void**)head, (void*)value, (void*)comparand) == comparand;
+      }
+
+      Magazine* GetMagazine (size_t index) const
+      {
+        size_t const i = index - 1;
+        size_t j = (i >> firstChunkShift) + 1;
+        size_t chunk = 0;
+        while (j >>= 1) chunk++;
+        size_t const chunkStart = ((size_t (1) << chunk) - 1)
+          << firstChunkShift;
+        return magazineChunks[chunk] + (i - chunkStart);
+      }
+
+      void PushMagazine (size_t* head, Magazine* m)
+      {
+        size_t oldHead, newHead;
+        do
+        {
+          oldHead = ReadHead (head);
+          m->next = oldHead & IndexMask ();
+          newHead = ((oldHead & ~IndexMask ()) + TagIncrement ()) | m->index;
+        }
+        while (!CompareAndSetHead (head, newHead, oldHead));
+      }
+
+      Magazine* PopMagazine (size_t* head)
+      {
+        size_t oldHead, newHead;
+        Magazine* m;
+        do
+        {
+          oldHead = ReadHead (head);
+          size_t const index = oldHead & IndexMask ();
+          if (index == 0) return 0;
+          /* The magazine may be popped by another thread in the meantime,
+           * making 'next' stale; the tag makes the CAS fail then. */
+          m = GetMagazine (index);
+          newHead = ((oldHead & ~IndexMask ()) + TagIncrement ()) | m->next;
+        }
+        while (!CompareAndSetHead (head, newHead, oldHead));
+        return m;
+      }
+      /** @} */
+
+      /// Create a new, empty magazine. Needs \c lock to be held.
+      Magazine* NewMagazineLocked ()
+      {
+        size_t const index = numMagazines + 1;
+        if (index > IndexMask ()) return 0;
+        size_t const i = index - 1;
+        size_t j = (i >> firstChunkShift) + 1;
+        size_t chunk = 0;
+        while (j >>= 1) chunk++;
+        if (magazineChunks[chunk] == 0)
+        {
+          Magazine* mags = (Magazine*)cs_malloc (
+            (size_t (firstChunkSize) << chunk) * sizeof (Magazine));
+          if (mags == 0) return 0;
+          magazineChunks[chunk] = mags;
+        }
+        Magazine* m = GetMagazine (index);
+        m->next = 0;
+        m->index = index;
+        m->count = 0;
+        numMagazines = index;
+        return m;
+      }
+
+      /// Get an empty magazine from the global list or create one.
+      Magazine* GetEmptyMagazine ()
+      {
+        Magazine* m = PopMagazine (&emptyMagazines);
+        if (m != 0) return m;
+        CS::Threading::MutexScopedLock l (lock);
+        return NewMagazineLocked ();
+      }
+
+      /// Get the calling thread's cache, creating it if needed.
+      ThreadCache* GetThreadCache ()
+      {
+        ThreadCache* tc = threadCache;
+        if (tc != 0) return tc;
+
+        Magazine* loaded = GetEmptyMagazine ();
+        if (loaded == 0) return 0;
+        Magazine* previous = GetEmptyMagazine ();
+        if (previous == 0)
+        {
+          PushMagazine (&emptyMagazines, loaded);
+          return 0;
+        }
+        tc = (ThreadCache*)cs_malloc (sizeof (ThreadCache));
+        tc->loaded = loaded;
+        tc->previous = previous;
+        {
+          CS::Threading::MutexScopedLock l (lock);
+          tc->nextCache = threadCaches;
+          threadCaches = tc;
+        }
+        threadCache = tc;
+        return tc;
+      }
+
+      /**
+       * Comparison function for FindBlock() which does a "fuzzy" search
+       * given an arbitrary address.
+       */
+      static int FuzzyCmp(uint8* const& block, BlockKey const& k)
+      {
+        return (block + k.blocksize <= k.addr ? -1 : (block > k.addr ? 1 : 0));
+      }
+
+      /**
+       * Find the memory block which contains the given memory. Needs
+       * \c lock to be held unless no other thread uses the allocator.
+       */
+      size_t FindBlock(void const* m) const
+      {
+        return blocks.b.FindSortedKey(
+          csArrayCmp<uint8*,BlockKey>(BlockKey((uint8*)m, blocksize), FuzzyCmp));
+      }
+
+      /**
+       * Allocate a new block and put its elements into magazines. Returns
+       * one full magazine, the others are pushed on the global list. If no
+       * magazines are available the elements are put on the overflow list
+       * and 0 is returned.
+       */
+      Magazine* Refill ()
+      {
+        CS::Threading::MutexScopedLock l (lock);
+        // Another thread may have refilled while we waited for the lock.
+        Magazine* result = PopMagazine (&fullMagazines);
+        if (result != 0) return result;
+
+        uint8* block = (uint8*)blocks.Alloc (blocksize);
+        if (block == 0) return 0;
+        blocks.b.InsertSorted (block);
+
+        for (size_t n = 0; n < elcount; n += magazineSize)
+        {
+          uint8* const first = block + n * elsize;
+          Magazine* m = PopMagazine (&emptyMagazines);
+          if (m == 0) m = NewMagazineLocked ();
+          if (m == 0)
+          {
+            for (size_t e = n; e < elcount; e++)
+            {
+              FreeNode* f = (FreeNode*)(block + e * elsize);
+              f->next = overflow;
+              overflow = f;
+            }
+            break;
+          }
+          // Fill backwards so blocks are handed out in address order.
+          for (size_t e = 0; e < magazineSize; e++)
+            m->blocks[e] = first + (magazineSize - 1 - e) * elsize;
+          m->count = magazineSize;
+          if (result == 0)
+            result = m;
+          else
+            PushMagazine (&fullMagazines, m);
+        }
+        return result;
+      }
+
+      /// Slow allocation path, used when magazines are exhausted.
+      void* AllocOverflow ()
+      {
+        CS::Threading::MutexScopedLock l (lock);
+        if (overflow == 0)
+        {
+          uint8* block = (uint8*)blocks.Alloc (blocksize);
+          if (block == 0) return 0;
+          blocks.b.InsertSorted (block);
+          for (size_t e = elcount; e-- > 0; )
+          {
+            FreeNode* f = (FreeNode*)(block + e * elsize);
+            f->next = overflow;
+            overflow = f;
+          }
+        }
+        FreeNode* f = overflow;
+        overflow = f->next;
+        return f;
+      }
+
+      /// Slow deallocation path, used when magazines are exhausted.
+      void FreeOverflow (void* p)
+      {
+        CS::Threading::MutexScopedLock l (lock);
+        FreeNode* f = (FreeNode*)p;
+        f->next = overflow;
+        overflow = f;
+      }
+
+      /**
+       * Get a usage mask showing all used (1's) and free (0's) nodes in
+       * the entire allocator.
+       */
+      csBitArray GetAllocationMap() const
+      {
+        csBitArray mask(elcount * blocks.b.GetSize());
+        mask.FlipAllBits();
+        for (size_t m = 1; m <= numMagazines; m++)
+        {
+          Magazine const* mag = GetMagazine (m);
+          for (size_t i = 0; i < mag->count; i++)
+            ClearBit (mask, mag->blocks[i]);
+        }
+        for (FreeNode* p = overflow; p != 0; p = p->next)
+          ClearBit (mask, p);
+        return mask;
+      }
+
+      void ClearBit (csBitArray& mask, void const* p) const
+      {
+        size_t const n = FindBlock(p);
+        CS_ASSERT(n != csArrayItemNotFound);
+        size_t const slot = ((uint8*)p - blocks.b[n]) / elsize;
+        mask.ClearBit(n * elcount + slot);
+      }
+
+      /**
+       * Destroys all living objects and releases all memory allocated by the
+       * pool. All magazines are emptied, but stay with their threads.
+       */
+      template<typename Disposer>
+      void DisposeAll(Disposer& disposer)
+      {
+        insideDisposeAll = true;
+        csBitArray const mask(GetAllocationMap());
+        size_t node = 0;
+        for (size_t b = 0, bN = blocks.b.GetSize(); b < bN; b++)
+        {
+          for (uint8 *p = blocks.b[b], *pN = p + blocksize; p < pN;
+               p += elsize)
+          {
+            if (mask.IsBitSet(node++))
+              disposer.Dispose (p);
+          }
+          blocks.Free (blocks.b[b]);
+        }
+        blocks.b.DeleteAll();
+        overflow = 0;
+
+        // Rebuild the list of empty magazines from all not owned by a thread.
+        csBitArray owned (numMagazines + 1);
+        for (ThreadCache* tc = threadCaches; tc != 0; tc = tc->nextCache)
+        {
+          tc->loaded->count = 0;
+          tc->previous->count = 0;
+          owned.SetBit (tc->loaded->index);
+          owned.SetBit (tc->previous->index);
+        }
+        fullMagazines &= ~IndexMask ();
+        emptyMagazines &= ~IndexMask ();
+        for (size_t m = 1; m <= numMagazines; m++)
+        {
+          if (owned.IsBitSet (m)) continue;
+          Magazine* mag = GetMagazine (m);
+          mag->count = 0;
+          PushMagazine (&emptyMagazines, mag);
+        }
+        insideDisposeAll = false;
+      }
+
+      /**
+       * Deallocate a chunk of memory. It is safe to provide a null pointer.
+       * \param disposer Disposer object that is called for the memory.
+       * \param p Pointer to deallocate.
+       */
+      template<typename Disposer>
+      void Free (Disposer& disposer, void* p)
+      {
+        if (p == 0 || insideDisposeAll) return;
+#ifdef CS_DEBUG
+        {
+          CS::Threading::MutexScopedLock l (lock);
+          CS_ASSERT(FindBlock(p) != csArrayItemNotFound);
+        }
+#endif
+        disposer.Dispose (p);
+
+        ThreadCache* tc = GetThreadCache ();
+        if (tc != 0)
+        {
+          Magazine* m = tc->loaded;
+          if (m->count < magazineSize)
+          {
+            m->blocks[m->count++] = p;
+            return;
+          }
+          if (tc->previous->count == 0)
+          {
+            tc->loaded = tc->previous;
+            tc->previous = m;
+            tc->loaded->blocks[tc->loaded->count++] = p;
+            return;
+          }
+          Magazine* empty = GetEmptyMagazine ();
+          if (empty != 0)
+          {
+            PushMagazine (&fullMagazines, tc->previous);
+            tc->previous = m;
+            tc->loaded = empty;
+            empty->blocks[empty->count++] = p;
+            return;
+          }
+        }
+        FreeOverflow (p);
+      }
+
+      /**
+       * Try to delete a chunk of memory. Returns \c false if the memory
+       * was not allocated by the allocator.
+       */
+      template<typename Disposer>
+      bool TryFree (Disposer& disposer, void* p)
+      {
+        if (p != 0 && !insideDisposeAll)
+        {
+          {
+            CS::Threading::MutexScopedLock l (lock);
+            if (FindBlock(p) == csArrayItemNotFound) return false;
+          }
+          Free (disposer, p);
+        }
+        return true;
+      }
+
+      /// Disposer for plain memory; nothing to destroy.
+      class DefaultDisposer
+      {
+      public:
+        template<typename BA>
+        DefaultDisposer (const BA&, bool legit)
+        { (void)legit; }
+        void Dispose (void* /*p*/) {}
+      };
+
+      void Init (size_t nelem)
+      {
+        elsize = Size;
+        if (elsize < sizeof (FreeNode))
+          elsize = sizeof (FreeNode);
+        // A block refills whole magazines.
+        if (nelem == 0) nelem = 1;
+        elcount = ((nelem + magazineSize - 1)
+          / magazineSize) * magazineSize;
+        blocksize = elsize * elcount;
+        fullMagazines = 0;
+        emptyMagazines = 0;
+        for (size_t c = 0; c < maxChunks; c++)
+          magazineChunks[c] = 0;
+        numMagazines = 0;
+        threadCaches = 0;
+        overflow = 0;
+        insideDisposeAll = false;
+#ifdef CS_MEMORY_TRACKER
+        blocks.SetMemTrackerInfo (typeid(*this).name());
+#endif
+      }
+    private:
+      // Illegal; unimplemented.
+      void operator= (FixedSizeAllocatorThreadCached const&);
+    public:
+      //@{
+      /**
+       * Construct a new allocator.
+       * \param nelem Number of elements to store in each allocation unit.
+       *   It is rounded up to a multiple of the magazine size.
+       */
+      FixedSizeAllocatorThreadCached (size_t nelem = 32)
+      {
+        Init (nelem);
+      }
+      FixedSizeAllocatorThreadCached (size_t nelem, const Allocator& alloc) :
+        blocks (alloc)
+      {
+        Init (nelem);
+      }
+      //@}
+
+      /**
+       * Construct a new allocator, copying the amounts of elements to
+       * store in an allocation unit.
+       * \remarks Copy-constructing an allocator is only valid if the
+       *   allocator copied from is empty.
+       */
+      FixedSizeAllocatorThreadCached (
+        FixedSizeAllocatorThreadCached const& other)
+      {
+        Init (other.elcount);
+        CS_ASSERT(other.blocks.b.GetSize() == 0);
+      }
+
+      /**
+       * Destroy all allocated objects and release memory.
+       */
+      ~FixedSizeAllocatorThreadCached ()
+      {
+        DefaultDisposer disposer (*this, false);
+        DisposeAll (disposer);
+        while (threadCaches != 0)
+        {
+          ThreadCache* next = threadCaches->nextCache;
+          cs_free (threadCaches);
+          threadCaches = next;
+        }
+        for (size_t c = 0; c < maxChunks; c++)
+          cs_free (magazineChunks[c]);
+      }
+
+      /**
+       * Destroy all chunks allocated.
+       * \remarks All pointers returned by Alloc() are invalidated. It is safe
+       *   to perform new allocations from the pool after invoking Empty().
+       */
+      void Empty()
+      {
+        DefaultDisposer disposer (*this, true);
+        DisposeAll (disposer);
+      }
+
+      /**
+       * Does nothing. Free elements are spread over the magazines of all
+       * threads, so memory is only released by Empty() and destruction.
+       */
+      void Compact() {}
+
+      /**
+       * Return number of allocated elements (potentially slow).
+       */
+      size_t GetAllocatedElems() const
+      {
+        csBitArray mask(GetAllocationMap());
+        return mask.NumBitsSet();
+      }
+
+      /**
+       * Allocate a chunk of memory.
+       */
+      CS_ATTRIBUTE_MALLOC void* Alloc ()
+      {
+        if (insideDisposeAll)
+        {
+          csPrintfErr("ERROR: FixedSizeAllocatorThreadCached(%p) tried to "
+            "allocate memory while inside DisposeAll()", (void*)this);
+          CS_ASSERT(false);
+        }
+
+        ThreadCache* tc = GetThreadCache ();
+        if (tc != 0)
+        {
+          Magazine* m = tc->loaded;
+          if (m->count > 0)
+            return m->blocks[--m->count];
+          if (tc->previous->count > 0)
+          {
+            tc->loaded = tc->previous;
+            tc->previous = m;
+            return tc->loaded->blocks[--tc->loaded->count];
+          }
+          Magazine* full = PopMagazine (&fullMagazines);
+          if (full == 0) full = Refill ();
+          if (full != 0)
+          {
+            PushMagazine (&emptyMagazines, tc->previous);
+            tc->previous = m;
+            tc->loaded = full;
+            return full->blocks[--full->count];
+          }
+        }
+        return AllocOverflow ();
+      }
+
+      /**
+       * Deallocate a chunk of memory. It is safe to provide a null pointer.
+       * \param p Pointer to deallocate.
+       */
+      void Free (void* p)
+      {
+        DefaultDisposer disposer (*this, true);
+        Free (disposer, p);
+      }
+
+      /**
+       * Try to delete a chunk of memory. Usage is the same as Free(), the
+       * difference being that \c false is returned if the deallocation
+       * failed (the reason is most likely that the memory was not allocated
+       * by the allocator).
+       */
+      bool TryFree (void* p)
+      {
+        DefaultDisposer disposer (*this, true);
+        return TryFree (disposer, p);
+      }
+
+      /**
+       * Return the blocks cached by the calling thread to the global lists.
+       * Should be called by threads that used the allocator before they
+       * exit. The thread may continue to use the allocator afterwards.
+       */
+      void FlushThreadCache ()
+      {
+        ThreadCache* tc = threadCache;
+        if (tc == 0) return;
+        threadCache = (ThreadCache*)0;
+        {
+          CS::Threading::MutexScopedLock l (lock);
+          ThreadCache** prev = &threadCaches;
+          while (*prev != tc) prev = &((*prev)->nextCache);
+          *prev = tc->nextCache;
+        }
+        PushMagazine (tc->loaded->count > 0 ? &fullMagazines
+          : &emptyMagazines, tc->loaded);
+        PushMagazine (tc->previous->count > 0 ? &fullMagazines
+          : &emptyMagazines, tc->previous);
+        cs_free (tc);
+      }
+
+      /// Query number of elements per block.
+      size_t GetBlockElements() const { return elcount; }
+
+      /**\name Functions for useability as a allocator template parameter
+       * @{ */
+      void* Alloc (size_t n)
+      {
+        CS_ASSERT (n == Size);
+        return Alloc();
+      }
+      void* Alloc (void* p, size_t newSize)
+      {
+        CS_ASSERT (newSize == Size);
+        return p;
+      }
+      void SetMemTrackerInfo (const char* /*info*/) { }
+      /** @} */
+    };
+
+    /**
+     * Thread-safe allocator for objects of a class which caches free
+     * objects per thread instead of taking a lock for each allocation.
+     * Has the same interface as csBlockAllocator and BlockAllocatorSafe.
+     * \sa FixedSizeAllocatorThreadCached for details and restrictions.
+     */
+    template <class T,
+      typename Allocator = AllocatorMalloc,
+      typename ObjectDispose = csBlockAllocatorDisposeDelete<T>,
+      typename SizeComputer = csBlockAllocatorSizeObject<T>
+    >
+    class BlockAllocatorThreadCached :
+      public FixedSizeAllocatorThreadCached<SizeComputer::value, Allocator>
+    {
+    public:
+      typedef BlockAllocatorThreadCached<T, Allocator, ObjectDispose,
+        SizeComputer> ThisType;
+      typedef T ValueType;
+      typedef Allocator AllocatorType;
+
+    protected:
+      typedef FixedSizeAllocatorThreadCached<SizeComputer::value, Allocator>
+        superclass;
+
+    private:
+      void* Alloc (size_t /*n*/) { return 0; }                       // Illegal
+      void* Alloc (void* /*p*/, size_t /*newSize*/) { return 0; }   // Illegal
+      void SetMemTrackerInfo (const char* /*info*/) { }             // Illegal
+    public:
+      /**
+       * Construct a new block allocator.
+       * \param nelem Number of elements to store in each allocation unit.
+       */
+      BlockAllocatorThreadCached (size_t nelem = 32) : superclass (nelem)
+      {
+      }
+
+      /**
+       * Destroy all allocated objects and release memory.
+       */
+      ~BlockAllocatorThreadCached ()
+      {
+        ObjectDispose dispose (*this, false);
+        superclass::DisposeAll (dispose);
+      }
+
+      /**
+       * Destroy all objects allocated by the pool.
+       * \remarks All pointers returned by Alloc() are invalidated. It is safe
+       *   to perform new allocations from the pool after invoking Empty().
+       */
+      void Empty ()
+      {
+        ObjectDispose dispose (*this, true);
+        superclass::DisposeAll (dispose);
+      }
+
+      /**
+       * Destroy all objects allocated by the pool and release the memory.
+       * Same as Empty().
+       */
+      void DeleteAll ()
+      {
+        Empty ();
+      }
+
+      /**
+       * Allocate a new object.
+       * The default (no-argument) constructor of \a T is invoked.
+       */
+      T* Alloc ()
+      {
+        return new (superclass::Alloc()) T;
+      }
+
+      /**
+       * Allocate a new object.
+       * The two-argument constructor of \a T is invoked.
+       */
+      template<typename A1, typename A2>
+      T* Alloc (A1& a1, A2& a2)
+      {
+        return new (superclass::Alloc()) T (a1, a2);
+      }
+
+      /**
+       * Allocate a new object.
+       * The three-argument constructor of \a T is invoked.
+       */
+      template<typename A1, typename A2, typename A3>
+      T* Alloc (A1& a1, A2& a2, A3& a3)
+      {
+        return new (superclass::Alloc()) T (a1, a2, a3);
+      }
+
+      /**
+       * Allocate a new object.
+       * The one-argument constructor of \a T is invoked.
+       */
+      template<typename A1>
+      T* Alloc (A1& a1)
+      {
+        return new (superclass::Alloc()) T (a1);
+      }
+
+      /**
+       * Deallocate an object. It is safe to provide a null pointer.
+       * \param p Pointer to deallocate.
+       */
+      void Free (T* p)
+      {
+        ObjectDispose dispose (*this, true);
+        superclass::Free (dispose, p);
+      }
+      /**
+       * Try to delete an object. Usage is the same as Free(), the difference
+       * being that \c false is returned if the deallocation failed.
+       */
+      bool TryFree (T* p)
+      {
+        ObjectDispose dispose (*this, true);
+        return superclass::TryFree (dispose, p);
+      }
+    };
+  } // namespace Memory
+} // namespace CS
+
+/** @} */
+
+#include "csutil/custom_new_enable.h"
+
+#endif // __CSUTIL_THREADCACHEDALLOCATOR_H__
@@ -141,6 +141,38 @@ struct iEngineSectorCallback : public virtual iBase
   virtual void RemoveSector (iEngine* engine, iSector* sector) = 0;
 };
 
+/**
+ * A segment to trace with iEngine::HitBeams().
+ */
+struct csBeamQuery
+{
+  /// The sector the segment is in. Portals are not followed.
+  iSector* sector;
+  /// Start of the segment in world space.
+  csVector3 start;
+  /// End of the segment in world space.
+  csVector3 end;
+};
+
+/**
+ * The result for one segment of iEngine::HitBeams(). If no mesh was hit
+ * \a isect is the end of the segment and \a distance its length.
+ */
+struct csBeamQueryResult
+{
+  /// The mesh that was hit, or 0 if no mesh was hit.
+  iMeshWrapper* mesh;
+  /**
+   * Index of the triangle that was hit in the 'base' triangle mesh of
+   * the mesh object model, or -1.
+   */
+  int triangle;
+  /// Distance from the start of the segment to the hit.
+  float distance;
+  /// Intersection point in world space.
+  csVector3 isect;
+};
+
 
 /**
  * This interface is the main interface to the 3D engine.
@@ -158,7 +190,7 @@ struct iEngineSectorCallback : public virtual iBase
  */
 struct iEngine : public virtual iBase
 {
-  SCF_INTERFACE(iEngine, 6, 2, 0);
+  SCF_INTERFACE(iEngine, 6, 4, 0);
   
   /// Get the iObject for the engine.
   virtual iObject *QueryObject() = 0;
@@ -696,6 +728,27 @@ struct iEngine : public virtual iBase
     const csVector3& start, const csVector3& end,
     bool crossPortals = true) = 0;
 
+  /**
+   * Trace many segments at once and find the first triangle each of them
+   * hits. This is meant for picking and line of sight checks in bulk and
+   * is much faster than calling iSector::HitBeam() for every segment.
+   *
+   * The engine keeps a bounding volume hierarchy over the meshes of every
+   * sector that was queried, and one over the triangles of every mesh
+   * factory (shared by all instances). Moved meshes are picked up
+   * automatically. The segments are traced in parallel; the call returns
+   * when all results are filled in.
+   *
+   * Meshes are tested with their 'base' triangle mesh from the object
+   * model; meshes without one and meshes with #CS_ENTITY_NOHITBEAM are
+   * ignored. Both sides of triangles are hit. Portals are not followed.
+   * \param queries The segments.
+   * \param numQueries Number of segments.
+   * \param results Array of  numQueries results that are filled in.
+   */
+  virtual void HitBeams (const csBeamQuery* queries, size_t numQueries,
+    csBeamQueryResult* results) = 0;
+
   /// Get the list of meshes
   virtual iMeshList* GetMeshes () = 0;
 
@@ -1064,6 +1117,32 @@ struct iEngine : public virtual iBase
    * Update the engine and animations etc for a new frame
    */
   virtual void UpdateNewFrame () = 0;
+
+  /**
+   * Enable or disable deferred movable updates (default disabled).
+   * When enabled, iMovable::UpdateMove() only marks the movable as
+   * changed. The meshes, lights, children and movable listeners (which
+   * includes the visibility cullers) are only updated once per frame
+   * in FlushMovableUpdates(), no matter how often UpdateMove() was called
+   * in the mean time. This is useful when objects are moved many times
+   * per frame, for example by a physics engine. The full transform of a
+   * movable is always up to date, but bounding boxes and culler data are
+   * not until the next flush. Disabling this flushes all pending updates.
+   * \remark Cameras are never deferred.
+   */
+  virtual void SetDeferredMovableUpdates (bool enable) = 0;
+
+  /// Return whether deferred movable updates are enabled.
+  virtual bool GetDeferredMovableUpdates () const = 0;
+
+  /**
+   * Deliver all pending movable updates (see SetDeferredMovableUpdates()).
+   * Every changed movable is updated once, parents before their children.
+   * This is called automatically by UpdateNewFrame() and Draw() but you
+   * can call it yourself if you need up to date bounding boxes or culler
+   * data, for example before doing a GetNearbyMeshes().
+   */
+  virtual void FlushMovableUpdates () = 0;
   /** @} */
   
   /**\name Saving/loading
@@ -101,4 +101,37 @@ struct iRenderManagerPostEffects : public virtual iBase
   virtual bool AddLayersFromFile (const char* filename) = 0;
 };
 
+/**
+ * Interface to the shadow map cache of a render manager. Exposed by render
+ * managers which keep shadow maps over frames and only re-render them when
+ * their view or shadow casters changed.
+ */
+struct iRenderManagerShadowMapCache : public virtual iBase
+{
+  SCF_INTERFACE(iRenderManagerShadowMapCache,1,0,0);
+
+  /// Whether shadow maps are cached at all
+  virtual bool IsShadowMapCacheEnabled () const = 0;
+
+  /**
+   * Get the number of shadow map splits that were rendered resp. reused
+   * from the cache in the last frame.
+   */
+  virtual void GetShadowMapSplitCounts (uint& rendered,
+    uint& skipped) const = 0;
+  /**
+   * Get the number of shadow map splits that were rendered resp. reused
+   * from the cache since the render manager was initialized.
+   */
+  virtual void GetShadowMapSplitTotals (uint64& rendered,
+    uint64& skipped) const = 0;
+
+  /**
+   * Re-render all cached shadow maps in the next frame. Useful after changes
+   * to shadow casters the cache can't detect, e.g. mesh animations which
+   * don't change the bounding box.
+   */
+  virtual void InvalidateShadowMaps () = 0;
+};
+
 #endif // __CS_IENGINE_RENDERMANAGER_H__
@@ -94,7 +94,7 @@ namespace CS
  */
 struct iSyntaxService : public virtual iBase
 {
-  SCF_INTERFACE (iSyntaxService, 2, 2, 0);
+  SCF_INTERFACE (iSyntaxService, 2, 3, 0);
   
   /**\name Parse reporting helpers
    * @{ */
@@ -445,6 +445,15 @@ struct iSyntaxService : public virtual iBase
   virtual csRef<iShader> ParseShader (iLoaderContext* ldr_context,
       iDocumentNode* node) = 0;
 
+  /**
+   * Get a file name for storing the render buffer \a bufferName of the
+   * object \a objectName in an external file, for use with
+   * iRenderBufferPersistence. The name has the form
+   * <tt><i>objectName</i>_<i>bufferName</i>.rbuf</tt>, with all characters
+   * that are not letters, digits or '.' replaced by '_'.
+   */
+  virtual csPtr<iString> GetRenderBufferFileName (const char* objectName,
+      const char* bufferName) = 0;
 };
 
 /** @} */
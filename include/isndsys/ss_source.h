@@ -66,7 +66,7 @@ struct iSndSysSource : public virtual iBase
  */
 struct iSndSysSourceSoftware : public iSndSysSource
 {
-  SCF_INTERFACE(iSndSysSourceSoftware,2,0,0);
+  SCF_INTERFACE(iSndSysSourceSoftware,2,1,0);
 
   /**
    * Renderer convenience interface - requests the source to fill the
@@ -80,6 +80,24 @@ struct iSndSysSourceSoftware : public iSndSysSource
    */
   virtual size_t MergeIntoBuffer(csSoundSample *frame_buffer, size_t frame_count) = 0;
 
+  /**
+   * Renderer convenience interface - estimates how loud this source will be
+   * in the next mix, relative to its stream data.  The renderer mixes only
+   * the loudest sources when more sources are playing than it has voices
+   * for.  A value of 0 means the source is inaudible.
+   */
+  virtual float GetAudibility() = 0;
+
+  /**
+   * Renderer convenience interface - advances the source as if it was
+   * mixed, without producing any output.  Used for virtual voices.
+   *
+   * @param frame_count  - The number of frames to advance.
+   * @return - The number of frames the source could have provided, as
+   *           MergeIntoBuffer() would have returned.
+   */
+  virtual size_t AdvanceWithoutMixing(size_t frame_count) = 0;
+
 
   /// Renderer convenience interface - Called to provide processing of output filters
   virtual void ProcessOutputFilters() = 0;
@@ -48,6 +48,33 @@ struct csBulletHitBeamResult
   csVector3 isect;
 };
 
+/**
+ * The Bullet implementation of iDynamics also implements this interface.
+ * \sa iDynamics
+ */
+struct iBulletDynamics : public virtual iBase
+{
+  SCF_INTERFACE(iBulletDynamics, 1, 0, 0);
+
+  /**
+   * Enable or disable parallel stepping. When enabled,
+   * iDynamics::Step() steps all dynamic systems concurrently on a job
+   * queue. The systems have to be independent from each other (no
+   * bodies, colliders or callbacks shared between systems). Updates of
+   * the attached meshes, lights and cameras and the collision callbacks
+   * are deferred and delivered on the calling thread, in one batch per
+   * system, after all systems finished stepping. The kinematic callbacks
+   * are also called on the calling thread, before the systems are
+   * stepped. Disabled by default.
+   * \remark Bullet's built-in profiler is not thread-safe, so Bullet
+   *   should be built with BT_NO_PROFILE when using this.
+   */
+  virtual void SetParallelStepping (bool enable) = 0;
+
+  /// Return whether parallel stepping is enabled.
+  virtual bool GetParallelStepping () const = 0;
+};
+
 /**
  * The Bullet implementation of iDynamicSystem also implements this
  * interface.
@@ -55,7 +82,7 @@ struct csBulletHitBeamResult
  */
 struct iBulletDynamicSystem : public virtual iBase
 {
-  SCF_INTERFACE(iBulletDynamicSystem, 2, 0, 1);
+  SCF_INTERFACE(iBulletDynamicSystem, 2, 1, 0);
 
   /**
    * Draw debug information for all colliders managed by bullet.
@@ -69,6 +96,13 @@ struct iBulletDynamicSystem : public virtual iBase
    * iSector::HitBeamPortals()
    */
   virtual csBulletHitBeamResult HitBeam (const csVector3 &start, const csVector3 &end) = 0;
+
+  /**
+   * Get the time, in microseconds, the Bullet simulation took during the
+   * last call to Step(). This does not include the delivery of movement
+   * updates and collision callbacks.
+   */
+  virtual int64 GetLastStepTime () const = 0;
 };
 
 /**
@@ -135,7 +169,9 @@ struct iBulletKinematicCallback : public virtual iBase
   SCF_INTERFACE (iBulletKinematicCallback, 1, 0, 0);
 
   /**
-   * Update the new transform of the rigid body.
+   * Update the new transform of the rigid body. This is always called on
+   * the thread calling iDynamics::Step(), even with parallel stepping
+   * enabled (see iBulletDynamics::SetParallelStepping()).
    */
   virtual void GetBodyTransform (iRigidBody* body,
 				 csOrthoTransform& transform) const = 0;
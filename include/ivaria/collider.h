@@ -33,6 +33,7 @@
 struct iTriangleMesh;
 struct iTerraFormer;
 struct iMeshObject;
+class csBox3;
 class csReversibleTransform;
 struct iTerrainSystem;
 
@@ -94,6 +95,60 @@ struct iCollider : public virtual iBase
   virtual csColliderType GetColliderType () = 0;
 };
 
+/**
+ * A pair of overlapping boxes as returned by
+ * iCollisionBroadPhase::GetOverlappingPairs(). The ID's are the ones
+ * returned by iCollisionBroadPhase::AddBox(). \a id0 is always smaller
+ * than \a id1.
+ */
+struct csBroadPhasePair
+{
+  /// ID of the first box.
+  size_t id0;
+  /// ID of the second box.
+  size_t id1;
+};
+
+/**
+ * A persistent broad phase for collision detection. It keeps track of
+ * a set of world space axis aligned boxes and reports which of them
+ * overlap. It is meant to be kept around between frames: boxes that
+ * move only a little bit between two queries are updated incrementally.
+ * Typically you register the bounding boxes of colliders with it and only
+ * call iCollideSystem::Collide() for the pairs that are reported here.
+ *
+ * Main creators of instances implementing this interface:
+ * - iCollideSystem::CreateBroadPhase()
+ *
+ * Main users of this interface:
+ * - csColliderBroadPhase
+ */
+struct iCollisionBroadPhase : public virtual iBase
+{
+  SCF_INTERFACE (iCollisionBroadPhase, 0, 0, 1);
+
+  /**
+   * Add a new world space box. Returns an ID that can be used to update
+   * or remove the box later. ID's of removed boxes may be reused.
+   */
+  virtual size_t AddBox (const csBox3& box) = 0;
+
+  /// Change the world space box with the given ID.
+  virtual void UpdateBox (size_t id, const csBox3& box) = 0;
+
+  /// Remove the box with the given ID.
+  virtual void RemoveBox (size_t id) = 0;
+
+  /// Get the number of boxes currently registered.
+  virtual size_t GetBoxCount () const = 0;
+
+  /**
+   * Get all pairs of boxes that currently overlap. The returned array
+   * stays valid until the next call to any method of this broad phase.
+   */
+  virtual const csArray<csBroadPhasePair>& GetOverlappingPairs () = 0;
+};
+
 /**
  * This is the Collide plug-in. This plugin is a factory for creating
  * iCollider entities. A collider represents an entity in the
@@ -112,7 +167,7 @@ struct iCollider : public virtual iBase
  */
 struct iCollideSystem : public virtual iBase
 {
-  SCF_INTERFACE (iCollideSystem, 2, 2, 1);
+  SCF_INTERFACE (iCollideSystem, 2, 3, 0);
 
   /**
    * Get the ID that the collision detection system prefers for getting
@@ -262,6 +317,13 @@ struct iCollideSystem : public virtual iBase
    * call to Collide().
    */
   virtual bool GetOneHitOnly () = 0;
+
+  /**
+   * Create a new, empty broad phase. Use it to quickly find out which
+   * colliders can possibly touch before doing the expensive Collide()
+   * calls on them.
+   */
+  virtual csPtr<iCollisionBroadPhase> CreateBroadPhase () = 0;
 };
 
 #endif // __CS_IVARIA_COLLIDER_H__
@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_IVIDEO_SCREENREADBACK_H__
+#define __CS_IVIDEO_SCREENREADBACK_H__
+
+/**\file
+ * Asynchronous screen readback
+ */
+
+/**
+ * \addtogroup gfx3d
+ * @{ */
+
+#include "csutil/scf_interface.h"
+#include "csutil/ref.h"
+
+struct iDataBuffer;
+
+/**
+ * Asynchronous readback of the screen contents. Optionally implemented by
+ * renderers; query it from the iGraphics3D.
+ *
+ * Unlike iGraphics2D::ScreenShot() this does not wait for the transfer
+ * of the pixels. The transfer is only waited for when the data of the
+ * returned buffer is accessed, so that should happen as late as possible,
+ * e.g. a frame later.
+ */
+struct iScreenReadback : public virtual iBase
+{
+  SCF_INTERFACE(iScreenReadback, 0, 0, 1);
+
+  /**
+   * Start reading back the current contents of the screen. Should be
+   * called after drawing finished and before the screen is flipped.
+   * The buffer contains 32 bit RGBA pixels, the bottom row first.
+   * \remarks The buffer must be accessed and released from the thread the
+   *   renderer runs on.
+   */
+  virtual csPtr<iDataBuffer> ReadbackScreen (int& width, int& height) = 0;
+};
+
+/** @} */
+
+#endif // __CS_IVIDEO_SCREENREADBACK_H__
@@ -39,6 +39,7 @@
 
 struct iDocumentNode;
 struct iHierarchicalCache;
+struct iJobQueue;
 struct iLight;
 struct iObject;
 struct iLoaderContext;
@@ -268,7 +269,7 @@ static inline csShaderVariable* csGetShaderVariableFromStack (
  */
 struct iShaderVariableContext : public virtual iBase
 {
-  SCF_INTERFACE(iShaderVariableContext, 2, 2, 1);
+  SCF_INTERFACE(iShaderVariableContext, 2, 3, 0);
 
   /**
    * Add a variable to this context
@@ -280,8 +281,12 @@ struct iShaderVariableContext : public virtual iBase
   /// Get a named variable from this context
   virtual csShaderVariable* GetVariable (CS::ShaderVarStringID name) const = 0;
 
-  /// Like GetVariable(), but it also adds it if doesn't exist already.
-  csShaderVariable* GetVariableAdd (CS::ShaderVarStringID name)
+  /**
+   * Like GetVariable(), but it also adds it if doesn't exist already.
+   * \remarks Contexts may override this to store variables they create
+   *   themselves more compactly.
+   */
+  virtual csShaderVariable* GetVariableAdd (CS::ShaderVarStringID name)
   {
     csShaderVariable* sv;
     sv = GetVariable (name);
@@ -487,7 +492,7 @@ struct iShaderPriorityList : public virtual iBase
  */
 struct iShader : public virtual iShaderVariableContext
 {
-  SCF_INTERFACE(iShader, 5, 0, 0);
+  SCF_INTERFACE(iShader, 5, 1, 0);
 
   /// Query the object.
   virtual iObject* QueryObject () = 0;
@@ -511,6 +516,17 @@ struct iShader : public virtual iShaderVariableContext
   virtual size_t GetTicket (const CS::Graphics::RenderMeshModes& modes,
     const csShaderVariableStack& stack) = 0;
 
+  /**
+   * Query a "shader ticket" without changing the shader.
+   * Unlike GetTicket() this may be called from any thread, also concurrently,
+   * as long as GetTicket() isn't called at the same time.
+   * \return Whether the ticket could be determined. If not, the variant of
+   *   the shader has to be set up first: GetTicket() has to be called from
+   *   the thread the renderer runs on instead.
+   */
+  virtual bool TryGetTicket (const CS::Graphics::RenderMeshModes& modes,
+    const csShaderVariableStack& stack, size_t& ticket) = 0;
+
   /// Get number of passes this shader has
   virtual size_t GetNumberOfPasses (size_t ticket) = 0;
 
@@ -604,6 +620,38 @@ struct iShader : public virtual iShaderVariableContext
   /** @} */
 };
 
+/**
+ * Preparation of shader techniques ahead of rendering, to avoid hitches
+ * when a combination of shader and mesh is first drawn. Optionally
+ * implemented by shaders; query it from an iShader.
+ *
+ * Warming up happens in three steps: the tickets needed are queued with
+ * QueueWarmUp(), the cached data for them is read on worker threads after
+ * StartWarmUp() and finally the techniques are set up by FinishWarmUp().
+ */
+struct iShaderWarmUp : public virtual iBase
+{
+  SCF_INTERFACE (iShaderWarmUp, 0, 0, 1);
+
+  /**
+   * Determine the tickets that would be used for the given mesh modes and
+   * shader variables with 0 up to \a maxLights lights, and queue them for
+   * warm-up. Nothing is prepared yet.
+   */
+  virtual void QueueWarmUp (const CS::Graphics::RenderMeshModes& modes,
+    const csShaderVariableStack& stack, int maxLights) = 0;
+
+  /// Start reading the cached data of the queued tickets on \a jobQueue.
+  virtual void StartWarmUp (iJobQueue* jobQueue) = 0;
+
+  /**
+   * Set up the queued tickets. Tickets that are not in the shader cache
+   * yet are compiled and added to it.
+   * \remarks Must be called from the thread the renderer runs on.
+   */
+  virtual void FinishWarmUp () = 0;
+};
+
 
 /**
  * Compiler of shaders. Compile from a description of the shader to a 
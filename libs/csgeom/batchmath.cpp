@@ -0,0 +1,608 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "csutil/processorspecdetection.h"
+
+#include "csgeom/batchmath.h"
+#include "csgeom/transfrm.h"
+
+/* SSE kernels are only built if the compiler generates SSE code anyway;
+   whether they are used is decided at runtime. */
+#if defined(__SSE__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define CS_BATCHMATH_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace CS
+{
+  namespace Geometry
+  {
+    BatchTransform BatchTransform::Other2This (const csTransform& t)
+    {
+      return BatchTransform (t.GetO2T (), t.GetO2TTranslation (),
+        csVector3 (0));
+    }
+
+    BatchTransform BatchTransform::This2Other (
+      const csReversibleTransform& t)
+    {
+      return BatchTransform (t.GetT2O (), csVector3 (0),
+        t.GetO2TTranslation ());
+    }
+
+    namespace
+    {
+      /// Active planes of a clip mask, with precomputed absolute normals
+      struct PlaneSet
+      {
+        int num;
+        uint32 bits[32];
+        float a[32], b[32], c[32], d[32];
+        float absA[32], absB[32], absC[32];
+        /// Plane bits, reinterpreted as floats for use in SIMD masks
+        float bitPatterns[32];
+
+        PlaneSet (const csPlane3* planes, uint32 inClipMask) : num (0)
+        {
+          for (int i = 0; i < 32; i++)
+          {
+            const uint32 bit = uint32 (1) << i;
+            if (!(inClipMask & bit)) continue;
+            const csPlane3& p = planes[i];
+            bits[num] = bit;
+            a[num] = p.A (); b[num] = p.B ();
+            c[num] = p.C (); d[num] = p.D ();
+            absA[num] = fabsf (p.A ());
+            absB[num] = fabsf (p.B ());
+            absC[num] = fabsf (p.C ());
+            union { uint32 u; float f; } pattern;
+            pattern.u = bit;
+            bitPatterns[num] = pattern.f;
+            num++;
+          }
+        }
+      };
+
+      /* Box translation part used by TransformBoxes: the box is
+         transformed as M * v + (post - M * pre). */
+      static inline csVector3 BoxOffset (const BatchTransform& t)
+      {
+        return t.post - t.m * t.pre;
+      }
+
+      //-----------------------------------------------------------------------
+      // Generic kernels. These process the range [start, end) so that the
+      // SIMD kernels can use them for the remainder.
+
+      static void TransformPointsGeneric (const BatchTransform& t,
+        const float* inX, const float* inY, const float* inZ,
+        float* outX, float* outY, float* outZ, size_t start, size_t end)
+      {
+        const csMatrix3& m = t.m;
+        for (size_t i = start; i < end; i++)
+        {
+          const float x = inX[i] - t.pre.x;
+          const float y = inY[i] - t.pre.y;
+          const float z = inZ[i] - t.pre.z;
+          outX[i] = m.m11 * x + m.m12 * y + m.m13 * z + t.post.x;
+          outY[i] = m.m21 * x + m.m22 * y + m.m23 * z + t.post.y;
+          outZ[i] = m.m31 * x + m.m32 * y + m.m33 * z + t.post.z;
+        }
+      }
+
+      static void TransformBoxesGeneric (const BatchTransform& t,
+        const Box3Stream& in, Box3Stream& out, size_t start, size_t end)
+      {
+        const csVector3 offset (BoxOffset (t));
+        const float* minIn[3] = { in.GetMin ().GetX (), in.GetMin ().GetY (),
+          in.GetMin ().GetZ () };
+        const float* maxIn[3] = { in.GetMax ().GetX (), in.GetMax ().GetY (),
+          in.GetMax ().GetZ () };
+        float* minOut[3] = { out.GetMin ().GetX (), out.GetMin ().GetY (),
+          out.GetMin ().GetZ () };
+        float* maxOut[3] = { out.GetMax ().GetX (), out.GetMax ().GetY (),
+          out.GetMax ().GetZ () };
+        for (size_t n = start; n < end; n++)
+        {
+          float minA[3], maxA[3], minB[3], maxB[3];
+          for (int j = 0; j < 3; j++)
+          {
+            minA[j] = minIn[j][n];
+            maxA[j] = maxIn[j][n];
+          }
+          for (int i = 0; i < 3; i++)
+          {
+            const csVector3 row (t.m.Row (i));
+            minB[i] = maxB[i] = offset[i];
+            for (int j = 0; j < 3; j++)
+            {
+              const float a = row[j] * minA[j];
+              const float b = row[j] * maxA[j];
+              minB[i] += (a < b) ? a : b;
+              maxB[i] += (a < b) ? b : a;
+            }
+          }
+          for (int i = 0; i < 3; i++)
+          {
+            minOut[i][n] = minB[i];
+            maxOut[i][n] = maxB[i];
+          }
+        }
+      }
+
+      static size_t ClassifyBoxesGeneric (const PlaneSet& planes,
+        const Box3Stream& boxes, bool* visible, uint32* outClipMasks,
+        size_t start, size_t end)
+      {
+        const float* minX = boxes.GetMin ().GetX ();
+        const float* minY = boxes.GetMin ().GetY ();
+        const float* minZ = boxes.GetMin ().GetZ ();
+        const float* maxX = boxes.GetMax ().GetX ();
+        const float* maxY = boxes.GetMax ().GetY ();
+        const float* maxZ = boxes.GetMax ().GetZ ();
+        size_t numVisible = 0;
+        for (size_t n = start; n < end; n++)
+        {
+          // Center and half-diagonal
+          const float mx = (minX[n] + maxX[n]) * 0.5f;
+          const float my = (minY[n] + maxY[n]) * 0.5f;
+          const float mz = (minZ[n] + maxZ[n]) * 0.5f;
+          const float dx = maxX[n] - mx;
+          const float dy = maxY[n] - my;
+          const float dz = maxZ[n] - mz;
+          uint32 mask = 0;
+          bool vis = true;
+          for (int p = 0; p < planes.num; p++)
+          {
+            const float NP = dx * planes.absA[p] + dy * planes.absB[p]
+              + dz * planes.absC[p];
+            const float MP = planes.a[p] * mx + planes.b[p] * my
+              + planes.c[p] * mz + planes.d[p];
+            if ((MP + NP) < 0.0f)
+            {
+              vis = false;
+              mask = 0;
+              break;
+            }
+            if ((MP - NP) < 0.0f) mask |= planes.bits[p];
+          }
+          visible[n] = vis;
+          if (outClipMasks) outClipMasks[n] = mask;
+          if (vis) numVisible++;
+        }
+        return numVisible;
+      }
+
+      static size_t SpheresInFrustumGeneric (const PlaneSet& planes,
+        const Vector3Stream& centers, const float* radii, bool* visible,
+        uint32* outClipMasks, size_t start, size_t end)
+      {
+        const float* cx = centers.GetX ();
+        const float* cy = centers.GetY ();
+        const float* cz = centers.GetZ ();
+        size_t numVisible = 0;
+        for (size_t n = start; n < end; n++)
+        {
+          const float r = radii[n];
+          uint32 mask = 0;
+          bool vis = true;
+          for (int p = 0; p < planes.num; p++)
+          {
+            const float dist = planes.a[p] * cx[n] + planes.b[p] * cy[n]
+              + planes.c[p] * cz[n] + planes.d[p];
+            if (dist < -r)
+            {
+              vis = false;
+              mask = 0;
+              break;
+            }
+            if (dist < r) mask |= planes.bits[p];
+          }
+          visible[n] = vis;
+          if (outClipMasks) outClipMasks[n] = mask;
+          if (vis) numVisible++;
+        }
+        return numVisible;
+      }
+
+      static void TransformPointsGenericAll (const BatchTransform& t,
+        const Vector3Stream& in, Vector3Stream& out)
+      {
+        TransformPointsGeneric (t, in.GetX (), in.GetY (), in.GetZ (),
+          out.GetX (), out.GetY (), out.GetZ (), 0, in.GetSize ());
+      }
+
+      static void TransformBoxesGenericAll (const BatchTransform& t,
+        const Box3Stream& in, Box3Stream& out)
+      {
+        TransformBoxesGeneric (t, in, out, 0, in.GetSize ());
+      }
+
+      static size_t ClassifyBoxesGenericAll (const PlaneSet& planes,
+        const Box3Stream& boxes, bool* visible, uint32* outClipMasks)
+      {
+        return ClassifyBoxesGeneric (planes, boxes, visible, outClipMasks,
+          0, boxes.GetSize ());
+      }
+
+      static size_t SpheresInFrustumGenericAll (const PlaneSet& planes,
+        const Vector3Stream& centers, const float* radii, bool* visible,
+        uint32* outClipMasks)
+      {
+        return SpheresInFrustumGeneric (planes, centers, radii, visible,
+          outClipMasks, 0, centers.GetSize ());
+      }
+
+#ifdef CS_BATCHMATH_SSE
+      //-----------------------------------------------------------------------
+      // SSE kernels. Each step processes four objects; operations are done in
+      // the same order as in the generic kernels so results are identical.
+
+      static void TransformPointsSSE (const BatchTransform& t,
+        const Vector3Stream& in, Vector3Stream& out)
+      {
+        const csMatrix3& m = t.m;
+        const __m128 m11 = _mm_set1_ps (m.m11), m12 = _mm_set1_ps (m.m12),
+          m13 = _mm_set1_ps (m.m13);
+        const __m128 m21 = _mm_set1_ps (m.m21), m22 = _mm_set1_ps (m.m22),
+          m23 = _mm_set1_ps (m.m23);
+        const __m128 m31 = _mm_set1_ps (m.m31), m32 = _mm_set1_ps (m.m32),
+          m33 = _mm_set1_ps (m.m33);
+        const __m128 preX = _mm_set1_ps (t.pre.x),
+          preY = _mm_set1_ps (t.pre.y), preZ = _mm_set1_ps (t.pre.z);
+        const __m128 postX = _mm_set1_ps (t.post.x),
+          postY = _mm_set1_ps (t.post.y), postZ = _mm_set1_ps (t.post.z);
+
+        const float* inX = in.GetX ();
+        const float* inY = in.GetY ();
+        const float* inZ = in.GetZ ();
+        float* outX = out.GetX ();
+        float* outY = out.GetY ();
+        float* outZ = out.GetZ ();
+        const size_t n = in.GetSize ();
+        const size_t n4 = n & ~(size_t)3;
+        // Streams are 16 byte aligned, so aligned loads/stores can be used.
+        for (size_t i = 0; i < n4; i += 4)
+        {
+          const __m128 x = _mm_sub_ps (_mm_load_ps (inX + i), preX);
+          const __m128 y = _mm_sub_ps (_mm_load_ps (inY + i), preY);
+          const __m128 z = _mm_sub_ps (_mm_load_ps (inZ + i), preZ);
+          _mm_store_ps (outX + i, _mm_add_ps (_mm_add_ps (_mm_add_ps (
+            _mm_mul_ps (m11, x), _mm_mul_ps (m12, y)), _mm_mul_ps (m13, z)),
+            postX));
+          _mm_store_ps (outY + i, _mm_add_ps (_mm_add_ps (_mm_add_ps (
+            _mm_mul_ps (m21, x), _mm_mul_ps (m22, y)), _mm_mul_ps (m23, z)),
+            postY));
+          _mm_store_ps (outZ + i, _mm_add_ps (_mm_add_ps (_mm_add_ps (
+            _mm_mul_ps (m31, x), _mm_mul_ps (m32, y)), _mm_mul_ps (m33, z)),
+            postZ));
+        }
+        TransformPointsGeneric (t, inX, inY, inZ, outX, outY, outZ, n4, n);
+      }
+
+      static void TransformBoxesSSE (const BatchTransform& t,
+        const Box3Stream& in, Box3Stream& out)
+      {
+        const csVector3 offset (BoxOffset (t));
+        const float* minIn[3] = { in.GetMin ().GetX (), in.GetMin ().GetY (),
+          in.GetMin ().GetZ () };
+        const float* maxIn[3] = { in.GetMax ().GetX (), in.GetMax ().GetY (),
+          in.GetMax ().GetZ () };
+        float* minOut[3] = { out.GetMin ().GetX (), out.GetMin ().GetY (),
+          out.GetMin ().GetZ () };
+        float* maxOut[3] = { out.GetMax ().GetX (), out.GetMax ().GetY (),
+          out.GetMax ().GetZ () };
+        __m128 m[3][3], offs[3];
+        for (int i = 0; i < 3; i++)
+        {
+          offs[i] = _mm_set1_ps (offset[i]);
+          for (int j = 0; j < 3; j++)
+            m[i][j] = _mm_set1_ps (t.m.Row (i)[j]);
+        }
+
+        const size_t n = in.GetSize ();
+        const size_t n4 = n & ~(size_t)3;
+        for (size_t k = 0; k < n4; k += 4)
+        {
+          __m128 minA[3], maxA[3], minB[3], maxB[3];
+          for (int j = 0; j < 3; j++)
+          {
+            minA[j] = _mm_load_ps (minIn[j] + k);
+            maxA[j] = _mm_load_ps (maxIn[j] + k);
+          }
+          for (int i = 0; i < 3; i++)
+          {
+            minB[i] = maxB[i] = offs[i];
+            for (int j = 0; j < 3; j++)
+            {
+              const __m128 a = _mm_mul_ps (m[i][j], minA[j]);
+              const __m128 b = _mm_mul_ps (m[i][j], maxA[j]);
+              minB[i] = _mm_add_ps (minB[i], _mm_min_ps (a, b));
+              maxB[i] = _mm_add_ps (maxB[i], _mm_max_ps (b, a));
+            }
+          }
+          for (int i = 0; i < 3; i++)
+          {
+            _mm_store_ps (minOut[i] + k, minB[i]);
+            _mm_store_ps (maxOut[i] + k, maxB[i]);
+          }
+        }
+        TransformBoxesGeneric (t, in, out, n4, n);
+      }
+
+      /**
+       * Store the results of a classification step. \a culled has all bits
+       * set in the lanes of culled objects, \a masks the plane bits
+       * accumulated for each lane.
+       */
+      static inline size_t StoreResults (__m128 culled, __m128 masks,
+        bool* visible, uint32* outClipMasks, size_t k)
+      {
+        static const uint8 numVisibleTable[16] =
+        { 4, 3, 3, 2, 3, 2, 2, 1, 3, 2, 2, 1, 2, 1, 1, 0 };
+        const int culledLanes = _mm_movemask_ps (culled);
+        visible[k] = !(culledLanes & 1);
+        visible[k + 1] = !(culledLanes & 2);
+        visible[k + 2] = !(culledLanes & 4);
+        visible[k + 3] = !(culledLanes & 8);
+        if (outClipMasks)
+          _mm_storeu_ps ((float*)(outClipMasks + k),
+            _mm_andnot_ps (culled, masks));
+        return numVisibleTable[culledLanes];
+      }
+
+      static size_t ClassifyBoxesSSE (const PlaneSet& planes,
+        const Box3Stream& boxes, bool* visible, uint32* outClipMasks)
+      {
+        const float* minX = boxes.GetMin ().GetX ();
+        const float* minY = boxes.GetMin ().GetY ();
+        const float* minZ = boxes.GetMin ().GetZ ();
+        const float* maxX = boxes.GetMax ().GetX ();
+        const float* maxY = boxes.GetMax ().GetY ();
+        const float* maxZ = boxes.GetMax ().GetZ ();
+        const __m128 half = _mm_set1_ps (0.5f);
+        const __m128 zero = _mm_setzero_ps ();
+
+        const size_t n = boxes.GetSize ();
+        const size_t n4 = n & ~(size_t)3;
+        size_t numVisible = 0;
+        for (size_t k = 0; k < n4; k += 4)
+        {
+          const __m128 maxx = _mm_load_ps (maxX + k);
+          const __m128 maxy = _mm_load_ps (maxY + k);
+          const __m128 maxz = _mm_load_ps (maxZ + k);
+          const __m128 mx = _mm_mul_ps (_mm_add_ps (_mm_load_ps (minX + k),
+            maxx), half);
+          const __m128 my = _mm_mul_ps (_mm_add_ps (_mm_load_ps (minY + k),
+            maxy), half);
+          const __m128 mz = _mm_mul_ps (_mm_add_ps (_mm_load_ps (minZ + k),
+            maxz), half);
+          const __m128 dx = _mm_sub_ps (maxx, mx);
+          const __m128 dy = _mm_sub_ps (maxy, my);
+          const __m128 dz = _mm_sub_ps (maxz, mz);
+          __m128 masks = zero;
+          __m128 culled = zero;
+          for (int p = 0; p < planes.num; p++)
+          {
+            const __m128 NP = _mm_add_ps (_mm_add_ps (
+              _mm_mul_ps (dx, _mm_set1_ps (planes.absA[p])),
+              _mm_mul_ps (dy, _mm_set1_ps (planes.absB[p]))),
+              _mm_mul_ps (dz, _mm_set1_ps (planes.absC[p])));
+            const __m128 MP = _mm_add_ps (_mm_add_ps (_mm_add_ps (
+              _mm_mul_ps (_mm_set1_ps (planes.a[p]), mx),
+              _mm_mul_ps (_mm_set1_ps (planes.b[p]), my)),
+              _mm_mul_ps (_mm_set1_ps (planes.c[p]), mz)),
+              _mm_set1_ps (planes.d[p]));
+            culled = _mm_or_ps (culled, _mm_cmplt_ps (_mm_add_ps (MP, NP),
+              zero));
+            if (_mm_movemask_ps (culled) == 0xf) break;
+            masks = _mm_or_ps (masks, _mm_and_ps (_mm_cmplt_ps (
+              _mm_sub_ps (MP, NP), zero),
+              _mm_set1_ps (planes.bitPatterns[p])));
+          }
+          numVisible += StoreResults (culled, masks, visible, outClipMasks,
+            k);
+        }
+        return numVisible + ClassifyBoxesGeneric (planes, boxes, visible,
+          outClipMasks, n4, n);
+      }
+
+      static size_t SpheresInFrustumSSE (const PlaneSet& planes,
+        const Vector3Stream& centers, const float* radii, bool* visible,
+        uint32* outClipMasks)
+      {
+        const float* cx = centers.GetX ();
+        const float* cy = centers.GetY ();
+        const float* cz = centers.GetZ ();
+        const __m128 signMask = _mm_set1_ps (-0.0f);
+
+        const size_t n = centers.GetSize ();
+        const size_t n4 = n & ~(size_t)3;
+        size_t numVisible = 0;
+        for (size_t k = 0; k < n4; k += 4)
+        {
+          const __m128 x = _mm_load_ps (cx + k);
+          const __m128 y = _mm_load_ps (cy + k);
+          const __m128 z = _mm_load_ps (cz + k);
+          // Radii are not part of a stream and may be unaligned
+          const __m128 r = _mm_loadu_ps (radii + k);
+          const __m128 negR = _mm_xor_ps (r, signMask);
+          __m128 masks = _mm_setzero_ps ();
+          __m128 culled = _mm_setzero_ps ();
+          for (int p = 0; p < planes.num; p++)
+          {
+            const __m128 dist = _mm_add_ps (_mm_add_ps (_mm_add_ps (
+              _mm_mul_ps (_mm_set1_ps (planes.a[p]), x),
+              _mm_mul_ps (_mm_set1_ps (planes.b[p]), y)),
+              _mm_mul_ps (_mm_set1_ps (planes.c[p]), z)),
+              _mm_set1_ps (planes.d[p]));
+            culled = _mm_or_ps (culled, _mm_cmplt_ps (dist, negR));
+            if (_mm_movemask_ps (culled) == 0xf) break;
+            masks = _mm_or_ps (masks, _mm_and_ps (_mm_cmplt_ps (dist, r),
+              _mm_set1_ps (planes.bitPatterns[p])));
+          }
+          numVisible += StoreResults (culled, masks, visible, outClipMasks,
+            k);
+        }
+        return numVisible + SpheresInFrustumGeneric (planes, centers, radii,
+          visible, outClipMasks, n4, n);
+      }
+#endif // CS_BATCHMATH_SSE
+
+      //-----------------------------------------------------------------------
+
+      struct Kernels
+      {
+        void (*transformPoints) (const BatchTransform& t,
+          const Vector3Stream& in, Vector3Stream& out);
+        void (*transformBoxes) (const BatchTransform& t,
+          const Box3Stream& in, Box3Stream& out);
+        size_t (*classifyBoxes) (const PlaneSet& planes,
+          const Box3Stream& boxes, bool* visible, uint32* outClipMasks);
+        size_t (*spheresInFrustum) (const PlaneSet& planes,
+          const Vector3Stream& centers, const float* radii, bool* visible,
+          uint32* outClipMasks);
+      };
+
+      static const Kernels genericKernels =
+      {
+        TransformPointsGenericAll, TransformBoxesGenericAll,
+        ClassifyBoxesGenericAll, SpheresInFrustumGenericAll
+      };
+#ifdef CS_BATCHMATH_SSE
+      static const Kernels sseKernels =
+      {
+        TransformPointsSSE, TransformBoxesSSE,
+        ClassifyBoxesSSE, SpheresInFrustumSSE
+      };
+#endif
+
+      /* The kernels in use; the implementation is derived from this
+         pointer so readers never see a mismatched pair. */
+      static const Kernels* kernels = 0;
+
+      static bool IsSupported (BatchMath::Implementation impl)
+      {
+        switch (impl)
+        {
+          case BatchMath::implGeneric:
+            return true;
+          case BatchMath::implSSE:
+#ifdef CS_BATCHMATH_SSE
+            {
+              CS::Platform::ProcessorSpecDetection procSpec;
+              return procSpec.HasSSE ();
+            }
+#else
+            return false;
+#endif
+        }
+        return false;
+      }
+
+      static void UseKernels (BatchMath::Implementation impl)
+      {
+#ifdef CS_BATCHMATH_SSE
+        if (impl == BatchMath::implSSE)
+        {
+          kernels = &sseKernels;
+          return;
+        }
+#endif
+        kernels = &genericKernels;
+      }
+
+      static inline const Kernels& GetKernels ()
+      {
+        /* Picking the kernels concurrently is harmless, all threads pick
+           the same. */
+        if (!kernels)
+          UseKernels (IsSupported (BatchMath::implSSE)
+            ? BatchMath::implSSE : BatchMath::implGeneric);
+        return *kernels;
+      }
+    } // anonymous namespace
+
+    BatchMath::Implementation BatchMath::GetImplementation ()
+    {
+      const Kernels& current = GetKernels ();
+#ifdef CS_BATCHMATH_SSE
+      if (&current == &sseKernels) return implSSE;
+#else
+      (void)current;
+#endif
+      return implGeneric;
+    }
+
+    bool BatchMath::SetImplementation (Implementation impl)
+    {
+      if (!IsSupported (impl)) return false;
+      UseKernels (impl);
+      return true;
+    }
+
+    const char* BatchMath::GetImplementationName (Implementation impl)
+    {
+      switch (impl)
+      {
+        case implGeneric: return "generic";
+        case implSSE:     return "SSE";
+      }
+      return 0;
+    }
+
+    void BatchMath::TransformPoints (const BatchTransform& t,
+                                     const Vector3Stream& in,
+                                     Vector3Stream& out)
+    {
+      out.SetSize (in.GetSize ());
+      GetKernels ().transformPoints (t, in, out);
+    }
+
+    void BatchMath::TransformBoxes (const BatchTransform& t,
+                                    const Box3Stream& in, Box3Stream& out)
+    {
+      out.SetSize (in.GetSize ());
+      GetKernels ().transformBoxes (t, in, out);
+    }
+
+    size_t BatchMath::ClassifyBoxesAgainstPlanes (const csPlane3* planes,
+                                                  uint32 inClipMask,
+                                                  const Box3Stream& boxes,
+                                                  bool* visible,
+                                                  uint32* outClipMasks)
+    {
+      const PlaneSet planeSet (planes, inClipMask);
+      return GetKernels ().classifyBoxes (planeSet, boxes, visible,
+        outClipMasks);
+    }
+
+    size_t BatchMath::SpheresInFrustum (const csPlane3* planes,
+                                        uint32 inClipMask,
+                                        const Vector3Stream& centers,
+                                        const float* radii, bool* visible,
+                                        uint32* outClipMasks)
+    {
+      const PlaneSet planeSet (planes, inClipMask);
+      return GetKernels ().spheresInFrustum (planeSet, centers, radii,
+        visible, outClipMasks);
+    }
+  } // namespace Geometry
+} // namespace CS
@@ -0,0 +1,364 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "csgeom/bvh.h"
+#include "csgeom/math.h"
+#include "csutil/ref.h"
+#include "csutil/scf_implementation.h"
+#include "iutil/job.h"
+
+// Number of bins tried per axis by the surface area heuristic.
+#define BVH_SAH_BINS 16
+// Estimated costs of visiting a node and of testing a primitive.
+#define BVH_TRAVERSAL_COST 1.0f
+#define BVH_INTERSECT_COST 1.5f
+// Must stay below the traversal stack size in BVH::Trace().
+#define BVH_MAX_DEPTH 60
+// Both halves of a split need this many primitives to be built in parallel.
+#define BVH_PARALLEL_PRIMITIVES 4096
+
+namespace CS
+{
+  namespace Geometry
+  {
+    struct BVH::BuildContext
+    {
+      const csBox3* boxes;
+      const csVector3* centers;
+      uint32* primitives;
+      size_t maxLeafSize;
+      iJobQueue* jobQueue;
+    };
+
+    /* Builds a subtree into a separate node array. The primitives of the
+       subtree are a range of the primitive list no other job touches. */
+    class BVH::BuildJob : public scfImplementation1<BuildJob, iJob>
+    {
+      BuildContext context;
+      size_t first;
+      size_t num;
+      int depth;
+
+    public:
+      csDirtyAccessArray<Node> nodes;
+
+      BuildJob (const BuildContext& context, size_t first, size_t num,
+        int depth) : scfImplementationType (this), context (context),
+        first (first), num (num), depth (depth) {}
+
+      void Run ()
+      {
+        BuildRange (context, first, num, depth, nodes);
+      }
+    };
+
+    // Surface area of a box, 0 for an empty box.
+    static inline float BoxArea (const csBox3& box)
+    {
+      return box.Empty () ? 0.0f : box.Area ();
+    }
+
+    void BVH::BuildRange (const BuildContext& context, size_t first,
+      size_t num, int depth, csDirtyAccessArray<Node>& nodes)
+    {
+      uint32* prims = context.primitives + first;
+      size_t i;
+
+      csBox3 bounds;
+      csBox3 centerBounds;
+      for (i = 0 ; i < num ; i++)
+      {
+        bounds += context.boxes[prims[i]];
+        centerBounds.AddBoundingVertex (context.centers[prims[i]]);
+      }
+      const size_t n = nodes.GetSize ();
+      nodes.SetSize (n + 1);
+      nodes[n].box = bounds;
+
+      // Find the bin boundary along the primitive centers with the lowest
+      // cost.
+      int bestAxis = -1;
+      int bestBin = 0;
+      float bestCost = 0;
+      const float area = BoxArea (bounds);
+      if (num > 1 && depth < BVH_MAX_DEPTH && area > 0)
+      {
+        const float invArea = 1.0f / area;
+        for (int axis = 0 ; axis < 3 ; axis++)
+        {
+          const float mina = centerBounds.Min (axis);
+          const float maxa = centerBounds.Max (axis);
+          if (!(maxa > mina)) continue;
+
+          size_t binCount[BVH_SAH_BINS];
+          csBox3 binBox[BVH_SAH_BINS];
+          memset (binCount, 0, sizeof (binCount));
+          const float binScale = float (BVH_SAH_BINS) / (maxa - mina);
+          for (i = 0 ; i < num ; i++)
+          {
+            int b = int ((context.centers[prims[i]][axis] - mina) * binScale);
+            b = csClamp (b, BVH_SAH_BINS-1, 0);
+            binCount[b]++;
+            binBox[b] += context.boxes[prims[i]];
+          }
+
+          // Area and count right of every boundary.
+          float rightArea[BVH_SAH_BINS];
+          size_t rightCount[BVH_SAH_BINS];
+          csBox3 box;
+          size_t count = 0;
+          int b;
+          for (b = BVH_SAH_BINS-1 ; b > 0 ; b--)
+          {
+            box += binBox[b];
+            count += binCount[b];
+            rightArea[b] = BoxArea (box);
+            rightCount[b] = count;
+          }
+
+          box.StartBoundingBox ();
+          count = 0;
+          for (b = 1 ; b < BVH_SAH_BINS ; b++)
+          {
+            box += binBox[b-1];
+            count += binCount[b-1];
+            if (count == 0 || rightCount[b] == 0) continue;
+            float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST
+              * (BoxArea (box) * float (count)
+              + rightArea[b] * float (rightCount[b])) * invArea;
+            if (bestAxis < 0 || cost < bestCost)
+            {
+              bestCost = cost;
+              bestAxis = axis;
+              bestBin = b;
+            }
+          }
+        }
+      }
+
+      if (bestAxis < 0 || (num <= context.maxLeafSize
+          && BVH_INTERSECT_COST * float (num) <= bestCost))
+      {
+        nodes[n].index = uint32 (first);
+        nodes[n].count = uint32 (num);
+        return;
+      }
+
+      // Partition the primitives on the chosen boundary, using the same
+      // binning as above.
+      const float mina = centerBounds.Min (bestAxis);
+      const float binScale = float (BVH_SAH_BINS)
+        / (centerBounds.Max (bestAxis) - mina);
+      size_t left = 0;
+      size_t right = num;
+      while (left < right)
+      {
+        int b = int ((context.centers[prims[left]][bestAxis] - mina)
+          * binScale);
+        if (b < bestBin)
+          left++;
+        else
+        {
+          right--;
+          uint32 tmp = prims[left];
+          prims[left] = prims[right];
+          prims[right] = tmp;
+        }
+      }
+      CS_ASSERT (left > 0 && left < num);
+
+      nodes[n].count = 0;
+      if (context.jobQueue && left >= BVH_PARALLEL_PRIMITIVES
+          && num - left >= BVH_PARALLEL_PRIMITIVES)
+      {
+        csRef<BuildJob> job;
+        job.AttachNew (new BuildJob (context, first + left, num - left,
+          depth + 1));
+        context.jobQueue->Enqueue (job);
+        BuildRange (context, first, left, depth + 1, nodes);
+        // Runs the job here if no worker picked it up yet.
+        context.jobQueue->PullAndRun (job, true);
+
+        // Append the second subtree, moving its child links along.
+        const size_t offset = nodes.GetSize ();
+        nodes[n].index = uint32 (offset);
+        nodes.SetSize (offset + job->nodes.GetSize ());
+        for (i = 0 ; i < job->nodes.GetSize () ; i++)
+        {
+          Node& node = nodes[offset + i];
+          node = job->nodes[i];
+          if (!node.IsLeaf ()) node.index += uint32 (offset);
+        }
+      }
+      else
+      {
+        BuildRange (context, first, left, depth + 1, nodes);
+        nodes[n].index = uint32 (nodes.GetSize ());
+        BuildRange (context, first + left, num - left, depth + 1, nodes);
+      }
+    }
+
+    void BVH::Build (const csBox3* boxes, size_t num, size_t maxLeafSize,
+      iJobQueue* jobQueue)
+    {
+      Clear ();
+      if (num == 0) return;
+
+      csDirtyAccessArray<csVector3> centers;
+      centers.SetSize (num);
+      primitives.SetSize (num);
+      size_t i;
+      for (i = 0 ; i < num ; i++)
+      {
+        centers[i] = boxes[i].GetCenter ();
+        primitives[i] = uint32 (i);
+      }
+
+      BuildContext context;
+      context.boxes = boxes;
+      context.centers = centers.GetArray ();
+      context.primitives = primitives.GetArray ();
+      context.maxLeafSize = csMax (maxLeafSize, size_t (1));
+      context.jobQueue = jobQueue;
+      nodes.SetCapacity (2 * num / context.maxLeafSize + 1);
+      BuildRange (context, 0, num, 0, nodes);
+      nodes.ShrinkBestFit ();
+    }
+
+    void BVH::Refit (const csBox3* boxes)
+    {
+      // Children are always stored after their parent.
+      size_t i = nodes.GetSize ();
+      while (i-- > 0)
+      {
+        Node& node = nodes[i];
+        if (node.IsLeaf ())
+        {
+          node.box = boxes[primitives[node.index]];
+          for (uint32 j = 1 ; j < node.count ; j++)
+            node.box += boxes[primitives[node.index + j]];
+        }
+        else
+        {
+          node.box = nodes[i + 1].box;
+          node.box += nodes[node.index].box;
+        }
+      }
+    }
+
+    float BVH::GetCost () const
+    {
+      if (nodes.GetSize () == 0) return 0;
+      const float rootArea = BoxArea (nodes[0].box);
+      if (rootArea <= 0)
+        return BVH_INTERSECT_COST * float (primitives.GetSize ());
+
+      float cost = 0;
+      for (size_t i = 0 ; i < nodes.GetSize () ; i++)
+      {
+        const Node& node = nodes[i];
+        if (node.IsLeaf ())
+          cost += BoxArea (node.box) * BVH_INTERSECT_COST * float (node.count);
+        else
+          cost += BoxArea (node.box) * BVH_TRAVERSAL_COST;
+      }
+      return cost / rootArea;
+    }
+
+    //-----------------------------------------------------------------------
+
+    struct TriangleBVH::HitTriangle
+    {
+      const csVector3* vertices;
+      const csTriangle* triangles;
+      csVector3 start;
+      csVector3 dir;
+      int triangle;
+      float r;
+
+      bool operator() (uint32 prim, float& maxT)
+      {
+        // Moeller-Trumbore, hitting both sides.
+        const csTriangle& tri = triangles[prim];
+        const csVector3& v0 = vertices[tri.a];
+        const csVector3 e1 = vertices[tri.b] - v0;
+        const csVector3 e2 = vertices[tri.c] - v0;
+        const csVector3 p = dir % e2;
+        const float det = e1 * p;
+        if (det == 0) return true;
+        const float invDet = 1.0f / det;
+        const csVector3 s = start - v0;
+        const float u = (s * p) * invDet;
+        if (u < 0 || u > 1) return true;
+        const csVector3 q = s % e1;
+        const float v = (dir * q) * invDet;
+        if (v < 0 || u + v > 1) return true;
+        const float t = (e2 * q) * invDet;
+        if (t >= 0 && t < maxT)
+        {
+          maxT = t;
+          r = t;
+          triangle = int (prim);
+        }
+        return true;
+      }
+    };
+
+    TriangleBVH::TriangleBVH (const csVector3* vertices, size_t numVertices,
+      const csTriangle* triangles, size_t numTriangles, iJobQueue* jobQueue)
+    {
+      this->vertices.SetSize (numVertices);
+      if (numVertices > 0)
+        memcpy (this->vertices.GetArray (), vertices,
+          numVertices * sizeof (csVector3));
+      this->triangles.SetSize (numTriangles);
+      if (numTriangles > 0)
+        memcpy (this->triangles.GetArray (), triangles,
+          numTriangles * sizeof (csTriangle));
+
+      csDirtyAccessArray<csBox3> boxes;
+      boxes.SetSize (numTriangles);
+      for (size_t i = 0 ; i < numTriangles ; i++)
+      {
+        const csTriangle& tri = triangles[i];
+        boxes[i].StartBoundingBox (vertices[tri.a]);
+        boxes[i].AddBoundingVertexSmart (vertices[tri.b]);
+        boxes[i].AddBoundingVertexSmart (vertices[tri.c]);
+      }
+      bvh.Build (boxes.GetArray (), numTriangles, 4, jobQueue);
+    }
+
+    bool TriangleBVH::HitSegment (const csVector3& start,
+      const csVector3& end, float& r, int& triangle) const
+    {
+      HitTriangle hit;
+      hit.vertices = vertices.GetArray ();
+      hit.triangles = triangles.GetArray ();
+      hit.start = start;
+      hit.dir = end - start;
+      hit.triangle = -1;
+      hit.r = r;
+      bvh.Trace (start, end, hit, r);
+      if (hit.triangle < 0) return false;
+      r = hit.r;
+      triangle = hit.triangle;
+      return true;
+    }
+  } // namespace Geometry
+} // namespace CS
@@ -16,11 +16,15 @@
     Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
 #include "cssysdef.h"
+#include "csutil/dirtyaccessarray.h"
 #include "csutil/sysfunc.h"
 #include "csutil/scfstr.h"
+#include "csutil/threading/atomicops.h"
+#include "iutil/job.h"
 #include "iutil/string.h"
 #include "csqint.h"
 #include "csqsqrt.h"
+#include "csgeom/math.h"
 #include "csgeom/math3d.h"
 #include "csgeom/kdtree.h"
 
@@ -131,6 +135,117 @@ uint32 csKDTree::global_timestamp = 1;
 
 #define KDTREE_MAX 100000.
 
+// Number of bins used to find the SAH split location on every axis.
+#define KDTREE_SAH_BINS 16
+// Relative costs of traversing a node and testing an object.
+#define KDTREE_SAH_TRAVERSAL_COST 1.0f
+#define KDTREE_SAH_INTERSECT_COST 1.5f
+// Maximum depth of a tree built by Rebuild().
+#define KDTREE_SAH_MAX_DEPTH 40
+// Subtrees are built in parallel if both sides have at least this
+// many objects.
+#define KDTREE_SAH_PARALLEL_OBJECTS 1024
+// Default value for SetRefitThreshold().
+#define KDTREE_REFIT_THRESHOLD 1.5f
+
+struct csKDTree::BuildNode
+{
+  int axis;
+  float location;
+  BuildNode* child1;
+  BuildNode* child2;
+  // Indices of the objects in a leaf.
+  csArray<size_t> indices;
+
+  BuildNode () : axis (CS_KDTREE_AXISINVALID), location (0), child1 (0),
+    child2 (0) {}
+  ~BuildNode ()
+  {
+    delete child1;
+    delete child2;
+  }
+};
+
+class csKDTree::SubtreeJob : public scfImplementation1<SubtreeJob, iJob>
+{
+  const csBox3* boxes;
+  iJobQueue* jobQueue;
+  BuildNode* node;
+  csArray<size_t> indices;
+  csBox3 cell;
+  int depth;
+
+public:
+  SubtreeJob (const csBox3* boxes, iJobQueue* jobQueue, BuildNode* node,
+      csArray<size_t>& indices, const csBox3& cell, int depth)
+    : scfImplementationType (this), boxes (boxes), jobQueue (jobQueue),
+      node (node), cell (cell), depth (depth)
+  {
+    indices.TransferTo (SubtreeJob::indices);
+  }
+
+  void Run ()
+  {
+    BuildSubtree (boxes, jobQueue, node, indices, cell, depth);
+  }
+};
+
+/* Builds a tree from a copy of the object bounding boxes so that it does
+   not touch the tree itself while it runs. */
+class csKDTree::RebuildJob : public scfImplementation1<RebuildJob, iJob>
+{
+  // Not a reference: the last reference to the queue must not be
+  // released by one of its own threads.
+  iJobQueue* jobQueue;
+  int32 done;
+
+public:
+  csDirtyAccessArray<csKDTreeChild*> objects;
+  csDirtyAccessArray<csBox3> boxes;
+  csBox3 cell;
+  BuildNode root;
+
+  RebuildJob (iJobQueue* jobQueue) : scfImplementationType (this),
+    jobQueue (jobQueue), done (0) {}
+
+  void Run ()
+  {
+    csArray<size_t> indices;
+    indices.SetSize (boxes.GetSize ());
+    for (size_t i = 0 ; i < indices.GetSize () ; i++)
+      indices[i] = i;
+    BuildSubtree (boxes.GetArray (), jobQueue, &root, indices, cell, 0);
+    CS::Threading::AtomicOperations::Set (&done, 1);
+  }
+
+  bool IsDone ()
+  {
+    return CS::Threading::AtomicOperations::Read (&done) != 0;
+  }
+};
+
+struct csKDTree::RebuildState
+{
+  csRef<iJobQueue> jobQueue;
+  csRef<RebuildJob> job;
+  // Set if the tree degraded enough to be rebuilt.
+  bool needed;
+  float threshold;
+  // Estimated cost of the tree when it was last built, -1 if unknown.
+  float build_cost;
+  // Current estimated cost of the tree.
+  float cost;
+
+  RebuildState () : needed (false), threshold (KDTREE_REFIT_THRESHOLD),
+    build_cost (-1), cost (0) {}
+};
+
+// Surface area of a box, 0 for an empty box.
+static inline float BoxArea (const csBox3& box)
+{
+  return box.Empty () ? 0.0f : box.Area ();
+}
+
 csKDTree::csKDTree () : scfImplementationType(this)
 {
   child1 = 0;
@@ -140,6 +255,9 @@ csKDTree::csKDTree () : scfImplementationType(this)
   num_objects = max_objects = 0;
   disallow_distribute = 0;
   split_axis = CS_KDTREE_AXISINVALID;
+  rebuild = 0;
+  refit_dirty = true;
+  refit_cost = 0;
 
   node_bbox.Set (-KDTREE_MAX, -KDTREE_MAX,
         -KDTREE_MAX, KDTREE_MAX,
@@ -151,6 +269,9 @@ csKDTree::csKDTree () : scfImplementationType(this)
 csKDTree::~csKDTree ()
 {
   Clear ();
+  // A running background rebuild only uses its own data, so it is simply
+  // left to finish.
+  delete rebuild;
 }
 
 void csKDTree::SetUserObject (iKDTreeUserData* userobj)
@@ -185,6 +306,14 @@ void csKDTree::Clear ()
   disallow_distribute = 0;
   SetUserObject (0);
   estimate_total_objects = 0;
+  obj_bbox.StartBoundingBox ();
+  MarkRefitDirty ();
+  if (rebuild)
+  {
+    rebuild->job = 0;
+    rebuild->needed = false;
+    rebuild->build_cost = -1;
+  }
 }
 
 void csKDTree::AddObject (csKDTreeChild* obj)
@@ -208,6 +337,8 @@ void csKDTree::AddObject (csKDTreeChild* obj)
 
   objects[num_objects++] = obj;
   estimate_total_objects++;
+  obj_bbox += obj->bbox;
+  MarkRefitDirty ();
 }
 
 void csKDTree::DebugExit ()
@@ -261,6 +392,7 @@ void csKDTree::RemoveObject (int idx)
     DebugExit ();
   }
   estimate_total_objects--;
+  MarkRefitDirty ();
   if (num_objects == 1)
   {
     // Easy case.
@@ -290,8 +422,11 @@ float csKDTree::FindBestSplitLocation (int axis, float& split_loc)
   int i, j;
 
   // If we have only two objects we use the average location between
-  // the two objects.
-  if (num_objects == 2)
+  // the two objects. Refitted objects can lie outside the node; a split
+  // between them could then be outside too, so they take the general
+  // path below, which stays inside the node.
+  if (num_objects == 2 && node_bbox.Overlap (objects[0]->bbox)
+      && node_bbox.Overlap (objects[1]->bbox))
   {
     const csBox3& bbox0 = objects[0]->bbox;
     const csBox3& bbox1 = objects[1]->bbox;
@@ -468,9 +603,24 @@ void csKDTree::AddObjectInt (csKDTreeChild* obj)
   if (disallow_distribute > 0)
     disallow_distribute--;
   obj->AddLeaf (this);
+  ExtendObjectBBox (obj->bbox);
   AddObject (obj);
 }
 
+void csKDTree::ExtendObjectBBox (const csBox3& box)
+{
+  // An object box changed, so the boxes may shrink at the next refit.
+  MarkRefitDirty ();
+  // Parents always contain the object box of their children, so we can
+  // stop at the first node that already contains the box.
+  csKDTree* node = this;
+  while (node && !node->obj_bbox.Contains (box))
+  {
+    node->obj_bbox += box;
+    node = node->parent;
+  }
+}
+
 csKDTreeChild* csKDTree::AddObject (const csBox3& bbox, void* object)
 {
   csKDTreeChild* obj = TreeAlloc()->tree_children.Alloc ();
@@ -532,6 +682,7 @@ void csKDTree::MoveObject (csKDTreeChild* object, const csBox3& new_bbox)
       // Even after moving we are still completely inside the bounding box
       // of the current leaf.
       object->bbox = new_bbox;
+      object->leafs[0]->ExtendObjectBBox (new_bbox);
       if (object->leafs[0]->disallow_distribute > 0)
         object->leafs[0]->disallow_distribute--;
       return;
@@ -570,12 +721,385 @@ void csKDTree::MoveObject (csKDTreeChild* object, const csBox3& new_bbox)
       node = node->parent;
     }
     if (do_flatten)
+    {
       node->Flatten ();
+      node->ExtendObjectBBox (new_bbox);
+    }
     else
       node->AddObjectInt (object);
   }
 }
 
+void csKDTree::RefitObject (csKDTreeChild* object, const csBox3& new_bbox)
+{
+  RebuildState* state = GetRebuildState ();
+  if (state->build_cost < 0)
+    state->build_cost = state->cost = RefitNode ();
+
+  if (new_bbox.Empty ())
+    object->bbox.Set (-.1f, -.1f, -.1f, .1f, .1f, .1f);
+  else
+    object->bbox = new_bbox;
+
+  int i;
+  for (i = 0 ; i < object->num_leafs ; i++)
+  {
+    csKDTree* leaf = object->leafs[i];
+    float old_area = BoxArea (leaf->obj_bbox);
+    leaf->ExtendObjectBBox (object->bbox);
+    state->cost += (BoxArea (leaf->obj_bbox) - old_area)
+      * float (leaf->num_objects);
+  }
+
+  // The rebuild is started by Refit() or the next traversal, when the
+  // other objects of this batch have been moved as well.
+  if (state->cost > state->build_cost * state->threshold)
+    state->needed = true;
+}
+
+float csKDTree::RefitNode ()
+{
+  if (!refit_dirty) return refit_cost;
+  obj_bbox.StartBoundingBox ();
+  int i;
+  for (i = 0 ; i < num_objects ; i++)
+    obj_bbox += objects[i]->bbox;
+  float cost = BoxArea (obj_bbox) * float (num_objects);
+  if (child1)
+  {
+    cost += child1->RefitNode ();
+    cost += child2->RefitNode ();
+    obj_bbox += child1->obj_bbox;
+    obj_bbox += child2->obj_bbox;
+  }
+  refit_dirty = false;
+  refit_cost = cost;
+  return cost;
+}
+
+void csKDTree::Refit ()
+{
+  RebuildState* state = GetRebuildState ();
+  state->cost = RefitNode ();
+  if (state->build_cost < 0)
+    state->build_cost = state->cost;
+  state->needed = state->cost > state->build_cost * state->threshold;
+  // Without a job queue the rebuild is done by the next traversal, as we
+  // might be called from inside a traversal now.
+  if (state->needed && state->jobQueue) StartRebuild ();
+}
+
+csKDTree::RebuildState* csKDTree::GetRebuildState ()
+{
+  if (!rebuild) rebuild = new RebuildState ();
+  return rebuild;
+}
+
+void csKDTree::SetRebuildJobQueue (iJobQueue* jobQueue)
+{
+  GetRebuildState ()->jobQueue = jobQueue;
+}
+
+bool csKDTree::IsRebuildNeeded () const
+{
+  return rebuild && rebuild->needed;
+}
+
+void csKDTree::SetRefitThreshold (float factor)
+{
+  GetRebuildState ()->threshold = factor;
+}
+
+void csKDTree::BuildSubtree (const csBox3* boxes, iJobQueue* jobQueue,
+        BuildNode* node, csArray<size_t>& indices, const csBox3& cell,
+        int depth)
+{
+  const size_t num = indices.GetSize ();
+  size_t i;
+
+  // The SAH is evaluated for the part of the cell that contains objects.
+  csBox3 bounds;
+  for (i = 0 ; i < num ; i++)
+    bounds += boxes[indices[i]];
+  bounds *= cell;
+
+  // Find the split with the lowest cost. Splits that don't separate any
+  // objects are never taken.
+  int best_axis = CS_KDTREE_AXISINVALID;
+  float best_location = 0;
+  float best_cost = KDTREE_SAH_INTERSECT_COST * float (num);
+  const float area = BoxArea (bounds);
+  if (num > 1 && depth < KDTREE_SAH_MAX_DEPTH && area > 0)
+  {
+    const float inv_area = 1.0f / area;
+    int axis;
+    for (axis = CS_KDTREE_AXISX ; axis <= CS_KDTREE_AXISZ ; axis++)
+    {
+      const float mina = bounds.Min (axis);
+      const float maxa = bounds.Max (axis);
+      if (maxa - mina < 0.0001f) continue;
+
+      // Count the objects starting and ending in every bin.
+      size_t starts[KDTREE_SAH_BINS];
+      size_t ends[KDTREE_SAH_BINS];
+      memset (starts, 0, sizeof (starts));
+      memset (ends, 0, sizeof (ends));
+      const float bin_scale = float (KDTREE_SAH_BINS) / (maxa - mina);
+      for (i = 0 ; i < num ; i++)
+      {
+        const csBox3& bbox = boxes[indices[i]];
+        int b0 = int ((bbox.Min (axis) - mina) * bin_scale);
+        int b1 = int ((bbox.Max (axis) - mina) * bin_scale);
+        starts[csClamp (b0, KDTREE_SAH_BINS-1, 0)]++;
+        ends[csClamp (b1, KDTREE_SAH_BINS-1, 0)]++;
+      }
+
+      // Try the boundaries between the bins.
+      size_t left = 0;
+      size_t right = num;
+      int b;
+      for (b = 1 ; b < KDTREE_SAH_BINS ; b++)
+      {
+        left += starts[b-1];
+        right -= ends[b-1];
+        if (left == 0 || right == 0 || left == num || right == num)
+          continue;
+        float location = mina + float (b) * (maxa - mina)
+          / float (KDTREE_SAH_BINS);
+        csBox3 left_box (bounds);
+        left_box.SetMax (axis, location);
+        csBox3 right_box (bounds);
+        right_box.SetMin (axis, location);
+        float cost = KDTREE_SAH_TRAVERSAL_COST + KDTREE_SAH_INTERSECT_COST
+          * (left_box.Area () * float (left)
+          + right_box.Area () * float (right)) * inv_area;
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_axis = axis;
+          best_location = location;
+        }
+      }
+    }
+  }
+
+  csArray<size_t> left, right;
+  if (best_axis != CS_KDTREE_AXISINVALID)
+  {
+    // Same rule as DistributeLeafObjects().
+    for (i = 0 ; i < num ; i++)
+    {
+      const csBox3& bbox = boxes[indices[i]];
+      if (bbox.Min (best_axis)-SMALL_EPSILON <= best_location)
+        left.Push (indices[i]);
+      if (bbox.Max (best_axis) >= best_location)
+        right.Push (indices[i]);
+    }
+  }
+  if (left.GetSize () == 0 || right.GetSize () == 0
+      || (left.GetSize () == num && right.GetSize () == num))
+  {
+    indices.TransferTo (node->indices);
+    return;
+  }
+  indices.DeleteAll ();
+
+  node->axis = best_axis;
+  node->location = best_location;
+  node->child1 = new BuildNode ();
+  node->child2 = new BuildNode ();
+  csBox3 cell1 (cell);
+  cell1.SetMax (best_axis, best_location);
+  csBox3 cell2 (cell);
+  cell2.SetMin (best_axis, best_location);
+
+  if (jobQueue && left.GetSize () >= KDTREE_SAH_PARALLEL_OBJECTS
+      && right.GetSize () >= KDTREE_SAH_PARALLEL_OBJECTS)
+  {
+    csRef<SubtreeJob> job;
+    job.AttachNew (new SubtreeJob (boxes, jobQueue, node->child2, right,
+      cell2, depth+1));
+    jobQueue->Enqueue (job);
+    BuildSubtree (boxes, jobQueue, node->child1, left, cell1, depth+1);
+    // Runs the job here if no worker picked it up yet.
+    jobQueue->PullAndRun (job, true);
+  }
+  else
+  {
+    BuildSubtree (boxes, jobQueue, node->child1, left, cell1, depth+1);
+    BuildSubtree (boxes, jobQueue, node->child2, right, cell2, depth+1);
+  }
+}
+
+void csKDTree::InstallBuildNode (BuildNode* node,
+        csKDTreeChild** build_objects,
+        const csSet<csPtrKey<csKDTreeChild> >* alive)
+{
+  if (!node->child1)
+  {
+    size_t i;
+    for (i = 0 ; i < node->indices.GetSize () ; i++)
+    {
+      csKDTreeChild* obj = build_objects[node->indices[i]];
+      if (alive && !alive->Contains (obj)) continue;
+      obj->AddLeaf (this);
+      AddObject (obj);
+    }
+    // The SAH decided not to split this node, so don't let Distribute()
+    // split it right away.
+    if (num_objects > 1)
+      disallow_distribute = DISALLOW_DISTRIBUTE_TIME;
+    return;
+  }
+
+  split_axis = node->axis;
+  split_location = node->location;
+  child1 = TreeAlloc()->tree_nodes.Alloc ();
+  child1->SetParent (this);
+  child1->SetObjectDescriptor (descriptor);
+  child1->node_bbox = GetNodeBBox ();
+  child1->node_bbox.SetMax (split_axis, split_location);
+  child2 = TreeAlloc()->tree_nodes.Alloc ();
+  child2->SetParent (this);
+  child2->SetObjectDescriptor (descriptor);
+  child2->node_bbox = GetNodeBBox ();
+  child2->node_bbox.SetMin (split_axis, split_location);
+  child1->InstallBuildNode (node->child1, build_objects, alive);
+  child2->InstallBuildNode (node->child2, build_objects, alive);
+  obj_bbox = child1->obj_bbox;
+  obj_bbox += child2->obj_bbox;
+  estimate_total_objects = child1->GetEstimatedObjectCount ()
+    + child2->GetEstimatedObjectCount ();
+}
+
+void csKDTree::InstallBuild (BuildNode* root, csKDTreeChild** build_objects,
+        const csSet<csPtrKey<csKDTreeChild> >* alive)
+{
+  // After flattening all objects are in this node only.
+  Flatten ();
+  csKDTreeChild** old_objects = objects;
+  int old_num_objects = num_objects;
+  int i;
+  for (i = 0 ; i < old_num_objects ; i++)
+    old_objects[i]->num_leafs = 0;
+  objects = 0;
+  num_objects = max_objects = 0;
+  estimate_total_objects = 0;
+  disallow_distribute = 0;
+  obj_bbox.StartBoundingBox ();
+
+  InstallBuildNode (root, build_objects, alive);
+
+  // Objects added after the build started wait for distribution here.
+  for (i = 0 ; i < old_num_objects ; i++)
+    if (old_objects[i]->num_leafs == 0)
+      AddObjectInt (old_objects[i]);
+  delete[] old_objects;
+
+  if (rebuild)
+  {
+    rebuild->needed = false;
+    rebuild->build_cost = rebuild->cost = RefitNode ();
+  }
+}
+
+void csKDTree::Rebuild (iJobQueue* jobQueue)
+{
+  if (rebuild) rebuild->job = 0;
+  Flatten ();
+
+  csDirtyAccessArray<csBox3> boxes;
+  csArray<size_t> indices;
+  boxes.SetCapacity (num_objects);
+  indices.SetCapacity (num_objects);
+  int i;
+  for (i = 0 ; i < num_objects ; i++)
+  {
+    boxes.Push (objects[i]->bbox);
+    indices.Push (i);
+  }
+  // InstallBuild() takes the objects out of this node, so keep a copy.
+  csDirtyAccessArray<csKDTreeChild*> build_objects;
+  build_objects.SetSize (num_objects);
+  if (num_objects > 0)
+    memcpy (build_objects.GetArray (), objects,
+      sizeof (csKDTreeChild*) * num_objects);
+
+  BuildNode root;
+  BuildSubtree (boxes.GetArray (), jobQueue, &root, indices, node_bbox, 0);
+  InstallBuild (&root, build_objects.GetArray (), 0);
+}
+
+void csKDTree::StartRebuild ()
+{
+  RebuildState* state = GetRebuildState ();
+  if (!state->jobQueue)
+  {
+    Rebuild ();
+    return;
+  }
+  if (state->job) return;
+
+  csRef<RebuildJob> job;
+  job.AttachNew (new RebuildJob (state->jobQueue));
+  job->cell = node_bbox;
+  // Collect every object once; objects in several leaves are taken from
+  // their first leaf.
+  csArray<csKDTree*> stack;
+  stack.Push (this);
+  while (stack.GetSize () > 0)
+  {
+    csKDTree* node = stack.Pop ();
+    int i;
+    for (i = 0 ; i < node->num_objects ; i++)
+    {
+      csKDTreeChild* obj = node->objects[i];
+      if (obj->leafs[0] != node) continue;
+      job->objects.Push (obj);
+      job->boxes.Push (obj->bbox);
+    }
+    if (node->child1)
+    {
+      stack.Push (node->child1);
+      stack.Push (node->child2);
+    }
+  }
+  state->job = job;
+  state->jobQueue->Enqueue (job);
+}
+
+void csKDTree::UpdateRebuild ()
+{
+  if (rebuild->job)
+  {
+    if (!rebuild->job->IsDone ()) return;
+    csRef<RebuildJob> job = rebuild->job;
+    rebuild->job = 0;
+
+    // Objects may have been removed while the build ran; their children
+    // may already be freed, so only pointers that are still in the tree
+    // are used.
+    csSet<csPtrKey<csKDTreeChild> > alive;
+    csArray<csKDTree*> stack;
+    stack.Push (this);
+    while (stack.GetSize () > 0)
+    {
+      csKDTree* node = stack.Pop ();
+      int i;
+      for (i = 0 ; i < node->num_objects ; i++)
+        alive.Add (node->objects[i]);
+      if (node->child1)
+      {
+        stack.Push (node->child1);
+        stack.Push (node->child2);
+      }
+    }
+    InstallBuild (&job->root, job->objects.GetArray (), &alive);
+    return;
+  }
+  if (rebuild->needed) StartRebuild ();
+}
+
 void csKDTree::Distribute ()
 {
   // Check if there are objects to distribute or if distribution
@@ -677,6 +1201,9 @@ void csKDTree::FlattenTo (csKDTree* node)
 {
   if (!child1) return;  // Nothing to do.
 
+  // The objects of the children may already be in 'node'.
+  node->MarkRefitDirty ();
+
   // First flatten the children.
   // @@@ Is this the most optimal solution?
   child1->FlattenTo (node);
@@ -818,6 +1345,10 @@ void csKDTree::ResetTimestamps ()
 
 uint32 csKDTree::NewTraversal ()
 {
+  // A new traversal starts, so this is a safe point to restructure the
+  // tree.
+  if (rebuild) UpdateRebuild ();
+
   if (global_timestamp > 4000000000u)
   {
     // For safety reasons we will reset all timestamps to 0
@@ -897,6 +1428,12 @@ bool csKDTree::Debug_CheckTree (csString& str)
     KDT_ASSERT_BOOL (new_node_bbox == GetNodeBBox (), "node_bbox mismatch");
     KDT_ASSERT_BOOL (child1->parent == this, "parent check");
     KDT_ASSERT_BOOL (child2->parent == this, "parent check");
+    KDT_ASSERT_BOOL (child1->GetObjectBBox ().Empty ()
+        || GetObjectBBox ().Contains (child1->GetObjectBBox ()),
+        "obj_bbox mismatch");
+    KDT_ASSERT_BOOL (child2->GetObjectBBox ().Empty ()
+        || GetObjectBBox ().Contains (child2->GetObjectBBox ()),
+        "obj_bbox mismatch");
 
     if (!child1->Debug_CheckTree (str))
       return false;
@@ -927,6 +1464,8 @@ bool csKDTree::Debug_CheckTree (csString& str)
       }
     }
     KDT_ASSERT_BOOL (parcnt == 1, "leaf list doesn't contain parent");
+    KDT_ASSERT_BOOL (GetObjectBBox ().Contains (o->GetBBox ()),
+        "obj_bbox doesn't contain object");
   }
 
   return true;
@@ -1055,12 +1594,28 @@ csTicks csKDTree::Debug_Benchmark (int num_iterations)
 
   csTicks pass4 = csGetTicks ();
 
+  for (i = 0 ; i < num_iterations ; i++)
+  {
+    Rebuild ();
+  }
+
+  csTicks pass5 = csGetTicks ();
+
+  for (i = 0 ; i < num_iterations ; i++)
+  {
+    Front2Back (csVector3 (0, 0, 0), Debug_TraverseFuncBenchmark, 0, 0);
+  }
+
+  csTicks pass6 = csGetTicks ();
+
   csPrintf ("Creating the tree:        %u ms\n", pass1-pass0);
   csPrintf ("Unoptimized Front2Back:   %u ms\n", pass2-pass1);
   csPrintf ("Flatten + FullDistribute: %u ms\n", pass3-pass2);
   csPrintf ("Optimized Front2Back:     %u ms\n", pass4-pass3);
+  csPrintf ("SAH Rebuild:              %u ms\n", pass5-pass4);
+  csPrintf ("SAH Front2Back:           %u ms\n", pass6-pass5);
 
-  return pass4-pass0;
+  return pass6-pass0;
 }
 
 void csKDTree::Debug_Statistics (int& tot_objects,
@@ -0,0 +1,260 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csgeom/batchmath.h"
+#include "csgeom/math3d.h"
+#include "csgeom/transfrm.h"
+
+#include "randomgeometry.h"
+
+using namespace CS::Geometry;
+
+/**
+ * Test CS::Geometry::BatchMath kernels against the single object
+ * operations, with each supported implementation.
+ */
+class BatchMathTest : public CppUnit::TestFixture
+{
+private:
+  // Not a multiple of 4 so the remainder handling is exercised
+  enum { numObjects = 103 };
+  RandomGeometry rng;
+
+  csReversibleTransform RandomTransform ()
+  {
+    csReversibleTransform t;
+    t.RotateThis (csVector3 (1, 0, 0), rng.Get (0, 6));
+    t.RotateThis (csVector3 (0, 1, 0), rng.Get (0, 6));
+    t.SetOrigin (rng.GetVector (-10, 10));
+    return t;
+  }
+  /// Planes of a box shaped frustum, pointing inwards
+  static void MakePlanes (csPlane3* planes)
+  {
+    planes[0].Set (csVector3 ( 1, 0, 0), 10);
+    planes[1].Set (csVector3 (-1, 0, 0), 10);
+    planes[2].Set (csVector3 (0,  1, 0), 10);
+    planes[3].Set (csVector3 (0, -1, 0), 10);
+    csVector3 n (0.6f, 0, 0.8f);
+    planes[4].Set (n, 5);
+  }
+
+  static void AssertVectorsEqual (const csVector3& a, const csVector3& b)
+  {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (a.x, b.x, 1e-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (a.y, b.y, 1e-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (a.z, b.z, 1e-4);
+  }
+
+public:
+  void setUp ()
+  {
+    rng.Initialize (4711);
+  }
+  void tearDown ()
+  {
+    BatchMath::SetImplementation (BatchMath::implGeneric);
+  }
+
+  void testStreams ();
+  void testTransformPoints ();
+  void testTransformBoxes ();
+  void testClassifyBoxes ();
+  void testSpheresInFrustum ();
+
+  CPPUNIT_TEST_SUITE (BatchMathTest);
+    CPPUNIT_TEST (testStreams);
+    CPPUNIT_TEST (testTransformPoints);
+    CPPUNIT_TEST (testTransformBoxes);
+    CPPUNIT_TEST (testClassifyBoxes);
+    CPPUNIT_TEST (testSpheresInFrustum);
+  CPPUNIT_TEST_SUITE_END ();
+};
+
+void BatchMathTest::testStreams ()
+{
+  Vector3Stream s;
+  for (int i = 0; i < 10; i++)
+    s.Push (csVector3 (float (i), float (i * 2), float (i * 3)));
+  CPPUNIT_ASSERT_EQUAL ((size_t)10, s.GetSize ());
+  s.SetSize (50);
+  AssertVectorsEqual (csVector3 (9, 18, 27), s.Get (9));
+  CPPUNIT_ASSERT_EQUAL ((uintptr_t)0, uintptr_t (s.GetY ()) & 15);
+  CPPUNIT_ASSERT_EQUAL ((uintptr_t)0, uintptr_t (s.GetZ ()) & 15);
+
+  csBox3 boxes[3];
+  for (int i = 0; i < 3; i++) boxes[i] = rng.GetBox (20, 10);
+  Box3Stream bs;
+  bs.Load (boxes, 3);
+  csBox3 stored[3];
+  bs.Store (stored);
+  for (int i = 0; i < 3; i++)
+  {
+    AssertVectorsEqual (boxes[i].Min (), stored[i].Min ());
+    AssertVectorsEqual (boxes[i].Max (), stored[i].Max ());
+  }
+}
+
+void BatchMathTest::testTransformPoints ()
+{
+  const csReversibleTransform t (RandomTransform ());
+  Vector3Stream points (numObjects);
+  for (size_t i = 0; i < numObjects; i++)
+    points.Set (i, rng.GetVector (-100, 100));
+
+  for (int impl = BatchMath::implGeneric; impl <= BatchMath::implSSE; impl++)
+  {
+    if (!BatchMath::SetImplementation (BatchMath::Implementation (impl)))
+      continue;
+    Vector3Stream out;
+    BatchMath::TransformPoints (BatchTransform::Other2This (t), points, out);
+    CPPUNIT_ASSERT_EQUAL ((size_t)numObjects, out.GetSize ());
+    for (size_t i = 0; i < numObjects; i++)
+      AssertVectorsEqual (t.Other2This (points.Get (i)), out.Get (i));
+
+    BatchMath::TransformPoints (BatchTransform::This2Other (t), points, out);
+    for (size_t i = 0; i < numObjects; i++)
+      AssertVectorsEqual (t.This2Other (points.Get (i)), out.Get (i));
+
+    // Transforming in place
+    Vector3Stream inPlace (numObjects);
+    for (size_t i = 0; i < numObjects; i++)
+      inPlace.Set (i, points.Get (i));
+    BatchMath::TransformPoints (BatchTransform::Other2This (t), inPlace,
+      inPlace);
+    for (size_t i = 0; i < numObjects; i++)
+      AssertVectorsEqual (t.Other2This (points.Get (i)), inPlace.Get (i));
+  }
+}
+
+void BatchMathTest::testTransformBoxes ()
+{
+  const csReversibleTransform t (RandomTransform ());
+  Box3Stream boxes (numObjects);
+  for (size_t i = 0; i < numObjects; i++)
+    boxes.Set (i, rng.GetBox (20, 10));
+
+  for (int impl = BatchMath::implGeneric; impl <= BatchMath::implSSE; impl++)
+  {
+    if (!BatchMath::SetImplementation (BatchMath::Implementation (impl)))
+      continue;
+    Box3Stream out;
+    BatchMath::TransformBoxes (BatchTransform::Other2This (t), boxes, out);
+    CPPUNIT_ASSERT_EQUAL ((size_t)numObjects, out.GetSize ());
+    for (size_t i = 0; i < numObjects; i++)
+    {
+      const csBox3 expected (t.Other2This (boxes.Get (i)));
+      AssertVectorsEqual (expected.Min (), out.Get (i).Min ());
+      AssertVectorsEqual (expected.Max (), out.Get (i).Max ());
+    }
+
+    BatchMath::TransformBoxes (BatchTransform::This2Other (t), boxes, out);
+    for (size_t i = 0; i < numObjects; i++)
+    {
+      const csBox3 expected (t.This2Other (boxes.Get (i)));
+      AssertVectorsEqual (expected.Min (), out.Get (i).Min ());
+      AssertVectorsEqual (expected.Max (), out.Get (i).Max ());
+    }
+  }
+}
+
+void BatchMathTest::testClassifyBoxes ()
+{
+  csPlane3 planes[5];
+  MakePlanes (planes);
+  Box3Stream boxes (numObjects);
+  for (size_t i = 0; i < numObjects; i++)
+    boxes.Set (i, rng.GetBox (20, 10));
+
+  const uint32 clipMasks[] = { 0x1f, 0x0f, 0x12 };
+  for (int impl = BatchMath::implGeneric; impl <= BatchMath::implSSE; impl++)
+  {
+    if (!BatchMath::SetImplementation (BatchMath::Implementation (impl)))
+      continue;
+    for (size_t c = 0; c < sizeof (clipMasks) / sizeof (clipMasks[0]); c++)
+    {
+      bool visible[numObjects];
+      uint32 outMasks[numObjects];
+      size_t numVisible = BatchMath::ClassifyBoxesAgainstPlanes (planes,
+        clipMasks[c], boxes, visible, outMasks);
+      size_t expectedVisible = 0;
+      for (size_t i = 0; i < numObjects; i++)
+      {
+        uint32 expectedMask;
+        bool expected = csIntersect3::BoxFrustum (boxes.Get (i), planes,
+          clipMasks[c], expectedMask);
+        CPPUNIT_ASSERT_EQUAL (expected, visible[i]);
+        if (expected)
+        {
+          CPPUNIT_ASSERT_EQUAL (expectedMask, outMasks[i]);
+          expectedVisible++;
+        }
+        else
+          CPPUNIT_ASSERT_EQUAL ((uint32)0, outMasks[i]);
+      }
+      CPPUNIT_ASSERT_EQUAL (expectedVisible, numVisible);
+      // Some boxes should be culled and some should intersect
+      CPPUNIT_ASSERT (numVisible > 0 && numVisible < numObjects);
+    }
+  }
+}
+
+void BatchMathTest::testSpheresInFrustum ()
+{
+  csPlane3 planes[5];
+  MakePlanes (planes);
+  Vector3Stream centers (numObjects);
+  float radii[numObjects];
+  for (size_t i = 0; i < numObjects; i++)
+  {
+    centers.Set (i, rng.GetVector (-20, 20));
+    radii[i] = rng.Get (0, 5);
+  }
+
+  for (int impl = BatchMath::implGeneric; impl <= BatchMath::implSSE; impl++)
+  {
+    if (!BatchMath::SetImplementation (BatchMath::Implementation (impl)))
+      continue;
+    bool visible[numObjects];
+    uint32 outMasks[numObjects];
+    size_t numVisible = BatchMath::SpheresInFrustum (planes, 0x1f, centers,
+      radii, visible, outMasks);
+    size_t expectedVisible = 0;
+    for (size_t i = 0; i < numObjects; i++)
+    {
+      bool expected = true;
+      uint32 expectedMask = 0;
+      for (int p = 0; p < 5; p++)
+      {
+        float dist = planes[p].Classify (centers.Get (i));
+        if (dist < -radii[i])
+        {
+          expected = false;
+          expectedMask = 0;
+          break;
+        }
+        if (dist < radii[i]) expectedMask |= 1 << p;
+      }
+      CPPUNIT_ASSERT_EQUAL (expected, visible[i]);
+      CPPUNIT_ASSERT_EQUAL (expectedMask, outMasks[i]);
+      if (expected) expectedVisible++;
+    }
+    CPPUNIT_ASSERT_EQUAL (expectedVisible, numVisible);
+    CPPUNIT_ASSERT (numVisible > 0 && numVisible < numObjects);
+  }
+}
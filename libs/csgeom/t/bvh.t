@@ -0,0 +1,327 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csgeom/bvh.h"
+#include "csgeom/math3d.h"
+#include "csgeom/segment.h"
+#include "csutil/threadjobqueue.h"
+
+#include "randomgeometry.h"
+
+/**
+ * Test CS::Geometry::BVH and CS::Geometry::TriangleBVH.
+ */
+class BVHTest : public CppUnit::TestFixture
+{
+private:
+  RandomGeometry rng;
+
+  static bool SegmentHitsBox (const csBox3& box, const csSegment3& seg)
+  {
+    float t0 = 0, t1 = 1;
+    for (int a = 0; a < 3; a++)
+    {
+      const float d = seg.End ()[a] - seg.Start ()[a];
+      const float inv = (d != 0) ? 1.0f / d : 1e30f;
+      float ta = (box.Min (a) - seg.Start ()[a]) * inv;
+      float tb = (box.Max (a) - seg.Start ()[a]) * inv;
+      if (ta > tb) { float tmp = ta; ta = tb; tb = tmp; }
+      if (ta > t0) t0 = ta;
+      if (tb < t1) t1 = tb;
+    }
+    return t0 <= t1;
+  }
+
+  // Collects the primitives whose box is hit by a segment.
+  struct CollectBoxes
+  {
+    const csBox3* boxes;
+    csSegment3 seg;
+    csArray<uint32> hits;
+
+    bool operator() (uint32 prim, float&)
+    {
+      if (SegmentHitsBox (boxes[prim], seg))
+        hits.Push (prim);
+      return true;
+    }
+  };
+
+  // Finds the nearest box entered by a segment, counting the primitives
+  // tested.
+  struct NearestBox
+  {
+    const csBox3* boxes;
+    csVector3 start, end;
+    uint32 nearest;
+    int tested;
+
+    bool operator() (uint32 prim, float& maxT)
+    {
+      tested++;
+      // Boxes are along the x axis only.
+      float t = (boxes[prim].MinX () - start.x) / (end.x - start.x);
+      if ((t >= 0) && (t < maxT))
+      {
+        maxT = t;
+        nearest = prim;
+      }
+      return true;
+    }
+  };
+
+  static int Compare (const uint32& a, const uint32& b)
+  {
+    return a < b ? -1 : (a > b ? 1 : 0);
+  }
+
+  void CheckNodes (const CS::Geometry::BVH& bvh, const csBox3* boxes)
+  {
+    const CS::Geometry::BVH::Node* nodes = bvh.GetNodes ();
+    const uint32* prims = bvh.GetPrimitives ();
+    for (size_t i = 0; i < bvh.GetNodeCount (); i++)
+    {
+      if (nodes[i].IsLeaf ())
+      {
+        for (uint32 j = 0; j < nodes[i].count; j++)
+          CPPUNIT_ASSERT (nodes[i].box.Contains (
+            boxes[prims[nodes[i].index + j]]));
+      }
+      else
+      {
+        CPPUNIT_ASSERT (nodes[i].index > i + 1);
+        CPPUNIT_ASSERT (nodes[i].box.Contains (nodes[i + 1].box));
+        CPPUNIT_ASSERT (nodes[i].box.Contains (nodes[nodes[i].index].box));
+      }
+    }
+  }
+
+  // Compares segment traces against testing all boxes.
+  void CheckTraces (const CS::Geometry::BVH& bvh, const csBox3* boxes,
+    size_t num)
+  {
+    for (int s = 0; s < 50; s++)
+    {
+      CollectBoxes collect;
+      collect.boxes = boxes;
+      collect.seg.Set (rng.GetVector (-120, 120), rng.GetVector (-120, 120));
+      bvh.Trace (collect.seg.Start (), collect.seg.End (), collect);
+      collect.hits.Sort (Compare);
+
+      csArray<uint32> expected;
+      for (size_t i = 0; i < num; i++)
+      {
+        if (SegmentHitsBox (boxes[i], collect.seg))
+          expected.Push (uint32 (i));
+      }
+      CPPUNIT_ASSERT_EQUAL (expected.GetSize (), collect.hits.GetSize ());
+      for (size_t i = 0; i < expected.GetSize (); i++)
+        CPPUNIT_ASSERT_EQUAL (expected[i], collect.hits[i]);
+    }
+  }
+
+public:
+  void setUp ();
+
+  void testBuild ();
+  void testParallelBuild ();
+  void testRefit ();
+  void testNearestHit ();
+  void testTriangles ();
+
+  CPPUNIT_TEST_SUITE(BVHTest);
+    CPPUNIT_TEST(testBuild);
+    CPPUNIT_TEST(testParallelBuild);
+    CPPUNIT_TEST(testRefit);
+    CPPUNIT_TEST(testNearestHit);
+    CPPUNIT_TEST(testTriangles);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+void BVHTest::setUp ()
+{
+  rng.Initialize (12345);
+}
+
+void BVHTest::testBuild ()
+{
+  static const size_t num = 2000;
+  csBox3 boxes[num];
+  for (size_t i = 0; i < num; i++)
+    boxes[i] = rng.GetBox (100, 5);
+
+  CS::Geometry::BVH bvh;
+  CPPUNIT_ASSERT (bvh.IsEmpty ());
+  bvh.Build (boxes, num);
+  CPPUNIT_ASSERT (!bvh.IsEmpty ());
+  CheckNodes (bvh, boxes);
+  CheckTraces (bvh, boxes, num);
+
+  // Every primitive is in exactly one leaf.
+  csArray<uint32> prims;
+  for (size_t i = 0; i < bvh.GetNodeCount (); i++)
+  {
+    const CS::Geometry::BVH::Node& node = bvh.GetNodes ()[i];
+    for (uint32 j = 0; j < node.count; j++)
+      prims.Push (bvh.GetPrimitives ()[node.index + j]);
+  }
+  prims.Sort (Compare);
+  CPPUNIT_ASSERT_EQUAL (num, prims.GetSize ());
+  for (size_t i = 0; i < num; i++)
+    CPPUNIT_ASSERT_EQUAL (uint32 (i), prims[i]);
+
+  // Identical boxes can't be split but must still work.
+  for (size_t i = 0; i < 100; i++)
+    boxes[i] = boxes[0];
+  bvh.Build (boxes, 100);
+  CheckNodes (bvh, boxes);
+  CheckTraces (bvh, boxes, 100);
+
+  bvh.Clear ();
+  CPPUNIT_ASSERT (bvh.IsEmpty ());
+}
+
+void BVHTest::testParallelBuild ()
+{
+  static const size_t num = 50000;
+  csBox3* boxes = new csBox3[num];
+  for (size_t i = 0; i < num; i++)
+    boxes[i] = rng.GetBox (100, 5);
+
+  CS::Geometry::BVH serial;
+  serial.Build (boxes, num);
+  csRef<iJobQueue> queue;
+  queue.AttachNew (new CS::Threading::ThreadedJobQueue (4));
+  CS::Geometry::BVH parallel;
+  parallel.Build (boxes, num, 4, queue);
+  CheckNodes (parallel, boxes);
+
+  // The parallel build makes the same decisions as the serial one.
+  CPPUNIT_ASSERT_EQUAL (serial.GetNodeCount (), parallel.GetNodeCount ());
+  for (size_t i = 0; i < serial.GetNodeCount (); i++)
+  {
+    CPPUNIT_ASSERT_EQUAL (serial.GetNodes ()[i].index,
+      parallel.GetNodes ()[i].index);
+    CPPUNIT_ASSERT_EQUAL (serial.GetNodes ()[i].count,
+      parallel.GetNodes ()[i].count);
+  }
+  for (size_t i = 0; i < num; i++)
+    CPPUNIT_ASSERT_EQUAL (serial.GetPrimitives ()[i],
+      parallel.GetPrimitives ()[i]);
+  CheckTraces (parallel, boxes, num);
+  delete[] boxes;
+}
+
+void BVHTest::testRefit ()
+{
+  static const size_t num = 2000;
+  csBox3 boxes[num];
+  for (size_t i = 0; i < num; i++)
+    boxes[i] = rng.GetBox (100, 5);
+
+  CS::Geometry::BVH bvh;
+  bvh.Build (boxes, num);
+  const float buildCost = bvh.GetCost ();
+  CPPUNIT_ASSERT (buildCost > 0);
+
+  // Scatter the boxes: the refitted tree is still correct but worse.
+  for (size_t i = 0; i < num; i++)
+    boxes[i].SetCenter (rng.GetVector (-100, 100));
+  bvh.Refit (boxes);
+  CheckNodes (bvh, boxes);
+  CheckTraces (bvh, boxes, num);
+  CPPUNIT_ASSERT (bvh.GetCost () > buildCost * 2);
+
+  bvh.Build (boxes, num);
+  CPPUNIT_ASSERT (bvh.GetCost () < buildCost * 1.5f);
+}
+
+void BVHTest::testNearestHit ()
+{
+  // A row of boxes along the segment: once the first box is hit, the
+  // subtrees behind it, including sibling leaves, must be skipped.
+  static const size_t num = 1024;
+  csBox3 boxes[num];
+  for (size_t i = 0; i < num; i++)
+    boxes[i].Set (float (i) * 2, -1, -1, float (i) * 2 + 1, 1, 1);
+
+  CS::Geometry::BVH bvh;
+  bvh.Build (boxes, num, 1);
+  NearestBox nearest;
+  nearest.boxes = boxes;
+  nearest.start.Set (-10, 0, 0);
+  nearest.end.Set (3000, 0, 0);
+  nearest.nearest = ~0u;
+  nearest.tested = 0;
+  bvh.Trace (nearest.start, nearest.end, nearest);
+  CPPUNIT_ASSERT_EQUAL (0u, nearest.nearest);
+  // With one box per leaf only the nearest box may be tested.
+  CPPUNIT_ASSERT_EQUAL (1, nearest.tested);
+}
+
+void BVHTest::testTriangles ()
+{
+  static const size_t numTris = 3000;
+  csVector3 vertices[numTris * 3];
+  csTriangle tris[numTris];
+  for (size_t i = 0; i < numTris; i++)
+  {
+    csVector3 c = rng.GetVector (-100, 100);
+    for (int j = 0; j < 3; j++)
+      vertices[i * 3 + j] = c + rng.GetVector (-4, 4);
+    tris[i] = csTriangle (int (i * 3), int (i * 3 + 1), int (i * 3 + 2));
+  }
+
+  csRef<CS::Geometry::TriangleBVH> mesh;
+  mesh.AttachNew (new CS::Geometry::TriangleBVH (vertices, numTris * 3,
+    tris, numTris));
+  CPPUNIT_ASSERT_EQUAL (numTris, mesh->GetTriangleCount ());
+
+  int hits = 0;
+  for (int s = 0; s < 500; s++)
+  {
+    csSegment3 seg (rng.GetVector (-120, 120), rng.GetVector (-120, 120));
+    // Closest hit found by testing every triangle.
+    float bestDist = -1;
+    for (size_t i = 0; i < numTris; i++)
+    {
+      csVector3 isect;
+      if (csIntersect3::SegmentTriangle (seg, vertices[tris[i].a],
+          vertices[tris[i].b], vertices[tris[i].c], isect))
+      {
+        float d = (isect - seg.Start ()).Norm ();
+        if (bestDist < 0 || d < bestDist) bestDist = d;
+      }
+    }
+
+    float r = 1.0f;
+    int tri = -1;
+    bool hit = mesh->HitSegment (seg.Start (), seg.End (), r, tri);
+    CPPUNIT_ASSERT_EQUAL (bestDist >= 0, hit);
+    if (!hit) continue;
+    hits++;
+    CPPUNIT_ASSERT (tri >= 0 && tri < int (numTris));
+    const float length = (seg.End () - seg.Start ()).Norm ();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (bestDist, r * length, 0.01);
+
+    // Nothing is hit before that point.
+    float r2 = r * 0.99f;
+    CPPUNIT_ASSERT (!mesh->HitSegment (seg.Start (), seg.End (), r2, tri));
+  }
+  CPPUNIT_ASSERT (hits > 50);
+}
@@ -0,0 +1,310 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csgeom/kdtree.h"
+#include "csutil/threadjobqueue.h"
+
+#include "randomgeometry.h"
+
+/**
+ * Test csKDTree rebuilding and refitting.
+ */
+class csKDTreeTest : public CppUnit::TestFixture
+{
+private:
+  RandomGeometry rng;
+
+  struct QueryData
+  {
+    csBox3 box;
+    int count;
+  };
+
+  // Counts the objects intersecting a box, culling with the object boxes.
+  static bool CountInBox (csKDTree* treenode, void* userdata,
+    uint32 cur_timestamp, uint32&)
+  {
+    QueryData* data = (QueryData*)userdata;
+    if (!treenode->GetObjectBBox ().TestIntersect (data->box))
+      return false;
+    treenode->Distribute ();
+    csKDTreeChild** objects = treenode->GetObjects ();
+    for (int i = 0; i < treenode->GetObjectCount (); i++)
+    {
+      if (objects[i]->timestamp == cur_timestamp) continue;
+      objects[i]->timestamp = cur_timestamp;
+      if (objects[i]->GetBBox ().TestIntersect (data->box)) data->count++;
+    }
+    return true;
+  }
+
+  static int CountInBox (csKDTree* tree, const csBox3& box)
+  {
+    QueryData data;
+    data.box = box;
+    data.count = 0;
+    tree->Front2Back (box.GetCenter (), CountInBox, &data, 0);
+    return data.count;
+  }
+
+  static void CheckTree (csKDTree* tree)
+  {
+    csString str;
+    bool ok = tree->Debug_CheckTree (str);
+    CPPUNIT_ASSERT_MESSAGE (str.GetDataSafe (), ok);
+  }
+
+  // Checks that the object box of every node is the tight box of its
+  // objects and children; returns that box.
+  static csBox3 CheckObjectBBoxes (csKDTree* node)
+  {
+    csBox3 box;
+    csKDTreeChild** objects = node->GetObjects ();
+    for (int i = 0; i < node->GetObjectCount (); i++)
+      box += objects[i]->GetBBox ();
+    if (node->GetChild1 ())
+    {
+      box += CheckObjectBBoxes (node->GetChild1 ());
+      box += CheckObjectBBoxes (node->GetChild2 ());
+    }
+    CPPUNIT_ASSERT (box.Empty () == node->GetObjectBBox ().Empty ());
+    if (!box.Empty ())
+    {
+      CPPUNIT_ASSERT (box.Min () == node->GetObjectBBox ().Min ());
+      CPPUNIT_ASSERT (box.Max () == node->GetObjectBBox ().Max ());
+    }
+    return box;
+  }
+
+  void Fill (csKDTree& tree, csKDTreeChild** children, csBox3* boxes,
+    int num)
+  {
+    for (int i = 0; i < num; i++)
+    {
+      boxes[i] = rng.GetBox (100, 5);
+      children[i] = tree.AddObject (boxes[i], 0);
+    }
+  }
+
+  void CheckQueries (csKDTree& tree, const csBox3* boxes, int num)
+  {
+    static const csBox3 everything (-1000, -1000, -1000, 1000, 1000, 1000);
+    CPPUNIT_ASSERT_EQUAL (num, CountInBox (&tree, everything));
+    for (int q = 0; q < 10; q++)
+    {
+      csBox3 query (rng.GetBox (100, 5));
+      query.SetSize (csVector3 (40));
+      int expected = 0;
+      for (int i = 0; i < num; i++)
+        if (boxes[i].TestIntersect (query)) expected++;
+      CPPUNIT_ASSERT_EQUAL (expected, CountInBox (&tree, query));
+    }
+  }
+
+public:
+  void setUp ();
+
+  void testRebuild ();
+  void testParallelRebuild ();
+  void testRefit ();
+  void testIncrementalRefit ();
+  void testBackgroundRebuild ();
+
+  CPPUNIT_TEST_SUITE(csKDTreeTest);
+    CPPUNIT_TEST(testRebuild);
+    CPPUNIT_TEST(testParallelRebuild);
+    CPPUNIT_TEST(testRefit);
+    CPPUNIT_TEST(testIncrementalRefit);
+    CPPUNIT_TEST(testBackgroundRebuild);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+void csKDTreeTest::setUp ()
+{
+  rng.Initialize (12345);
+}
+
+void csKDTreeTest::testRebuild ()
+{
+  static const int num = 2000;
+  csKDTree tree;
+  csKDTreeChild* children[num];
+  csBox3 boxes[num];
+  Fill (tree, children, boxes, num);
+  tree.Rebuild ();
+  CheckTree (&tree);
+  CPPUNIT_ASSERT (tree.GetChild1 () != 0);
+  CheckQueries (tree, boxes, num);
+
+  // Rebuilding a distributed tree gives the same tree.
+  csRef<iString> stats1 = tree.Debug_Statistics ();
+  tree.Rebuild ();
+  CheckTree (&tree);
+  csRef<iString> stats2 = tree.Debug_Statistics ();
+  CPPUNIT_ASSERT (strcmp (stats1->GetData (), stats2->GetData ()) == 0);
+
+  for (int i = 0; i < num; i += 2)
+    tree.RemoveObject (children[i]);
+  tree.Rebuild ();
+  CheckTree (&tree);
+  static const csBox3 everything (-1000, -1000, -1000, 1000, 1000, 1000);
+  CPPUNIT_ASSERT_EQUAL (num / 2, CountInBox (&tree, everything));
+}
+
+void csKDTreeTest::testParallelRebuild ()
+{
+  static const int num = 20000;
+  csKDTree tree;
+  csKDTreeChild** children = new csKDTreeChild*[num];
+  csBox3* boxes = new csBox3[num];
+  Fill (tree, children, boxes, num);
+  tree.Rebuild ();
+  csRef<iString> stats1 = tree.Debug_Statistics ();
+
+  csRef<iJobQueue> queue;
+  queue.AttachNew (new CS::Threading::ThreadedJobQueue (4));
+  tree.Rebuild (queue);
+  CheckTree (&tree);
+  // The parallel build makes the same decisions as the serial one.
+  csRef<iString> stats2 = tree.Debug_Statistics ();
+  CPPUNIT_ASSERT (strcmp (stats1->GetData (), stats2->GetData ()) == 0);
+  CheckQueries (tree, boxes, num);
+  delete[] children;
+  delete[] boxes;
+}
+
+void csKDTreeTest::testRefit ()
+{
+  static const int num = 1000;
+  csKDTree tree;
+  csKDTreeChild* children[num];
+  csBox3 boxes[num];
+  Fill (tree, children, boxes, num);
+  tree.Rebuild ();
+
+  // Small movements: queries must find the objects at their new places.
+  for (int i = 0; i < num; i++)
+  {
+    boxes[i].SetCenter (boxes[i].GetCenter () + csVector3 (rng.Get (-1, 1)));
+    tree.RefitObject (children[i], boxes[i]);
+  }
+  CheckTree (&tree);
+  CheckQueries (tree, boxes, num);
+  tree.Refit ();
+  CheckTree (&tree);
+  CheckQueries (tree, boxes, num);
+  CPPUNIT_ASSERT (tree.GetChild1 () != 0);
+  csKDTree* child1 = tree.GetChild1 ();
+
+  // Objects swap places, which makes the tree bad enough to be rebuilt
+  // at the start of the next traversal.
+  for (int i = 0; i < num; i++)
+  {
+    boxes[i].SetCenter (-boxes[i].GetCenter ());
+    tree.RefitObject (children[i], boxes[i]);
+  }
+  CheckTree (&tree);
+  CPPUNIT_ASSERT (tree.GetChild1 () == child1);
+  tree.NewTraversal ();
+  CheckTree (&tree);
+  CheckQueries (tree, boxes, num);
+}
+
+void csKDTreeTest::testIncrementalRefit ()
+{
+  static const int num = 1000;
+  csKDTree tree;
+  csKDTreeChild* children[num];
+  csBox3 boxes[num];
+  Fill (tree, children, boxes, num);
+  tree.Rebuild ();
+  tree.Refit ();
+  CheckObjectBBoxes (&tree);
+
+  // Move a few objects away and back: only their paths are refitted, and
+  // the boxes must shrink back to the tight ones.
+  for (int i = 0; i < num; i += 97)
+  {
+    csBox3 old_box = boxes[i];
+    boxes[i].SetCenter (boxes[i].GetCenter () + csVector3 (3, 0, 0));
+    tree.RefitObject (children[i], boxes[i]);
+    tree.Refit ();
+    CheckObjectBBoxes (&tree);
+    boxes[i] = old_box;
+    tree.RefitObject (children[i], boxes[i]);
+    tree.Refit ();
+    CheckObjectBBoxes (&tree);
+  }
+
+  // Adding and removing objects is picked up as well.
+  for (int i = 0; i < num; i += 5)
+    tree.RemoveObject (children[i]);
+  tree.Refit ();
+  CheckObjectBBoxes (&tree);
+  for (int i = 0; i < num; i += 5)
+  {
+    boxes[i] = rng.GetBox (100, 5);
+    children[i] = tree.AddObject (boxes[i], 0);
+  }
+  tree.Refit ();
+  CheckObjectBBoxes (&tree);
+  CheckQueries (tree, boxes, num);
+}
+
+void csKDTreeTest::testBackgroundRebuild ()
+{
+  static const int num = 5000;
+  csKDTree tree;
+  csKDTreeChild** children = new csKDTreeChild*[num];
+  csBox3* boxes = new csBox3[num];
+  Fill (tree, children, boxes, num);
+  tree.Rebuild ();
+
+  csRef<iJobQueue> queue;
+  queue.AttachNew (new CS::Threading::ThreadedJobQueue (2));
+  tree.SetRebuildJobQueue (queue);
+  for (int i = 0; i < num; i++)
+  {
+    boxes[i].SetCenter (boxes[i].GetCenter () * 0.5f
+      + csVector3 (rng.Get (-50, 50)));
+    tree.RefitObject (children[i], boxes[i]);
+  }
+  tree.Refit ();
+  // The rebuild runs in the background; meanwhile objects are removed,
+  // added and refitted.
+  for (int i = 0; i < num; i += 3)
+    tree.RemoveObject (children[i]);
+  for (int i = 0; i < num; i += 3)
+  {
+    boxes[i] = rng.GetBox (100, 5);
+    children[i] = tree.AddObject (boxes[i], 0);
+  }
+  for (int i = 1; i < num; i += 3)
+  {
+    boxes[i].SetCenter (boxes[i].GetCenter () + csVector3 (1));
+    tree.RefitObject (children[i], boxes[i]);
+  }
+  CheckQueries (tree, boxes, num);
+  queue->WaitAll ();
+  // Installs the rebuilt tree.
+  tree.NewTraversal ();
+  CheckTree (&tree);
+  CheckQueries (tree, boxes, num);
+  delete[] children;
+  delete[] boxes;
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_LIBS_CSGEOM_T_RANDOMGEOMETRY_H__
+#define __CS_LIBS_CSGEOM_T_RANDOMGEOMETRY_H__
+
+#include "csgeom/box.h"
+#include "csgeom/vector3.h"
+#include "csutil/randomgen.h"
+
+/**
+ * Random numbers, vectors and boxes for the csgeom tests. Seed it in the
+ * setUp() of a test so every run sees the same values.
+ */
+class RandomGeometry
+{
+  csRandomGen rng;
+public:
+  /// Restart the sequence with the given seed.
+  void Initialize (uint32 seed) { rng.Initialize (seed); }
+
+  /// Get a number in [min, max).
+  float Get (float min, float max)
+  {
+    return min + (max - min) * rng.Get ();
+  }
+
+  /// Get a vector with each component in [min, max).
+  csVector3 GetVector (float min, float max)
+  {
+    float x = Get (min, max);
+    float y = Get (min, max);
+    float z = Get (min, max);
+    return csVector3 (x, y, z);
+  }
+
+  /**
+   * Get a box with its minimum corner in [-range, range) on each axis
+   * and side lengths between 0.1 and \a size + 0.1.
+   */
+  csBox3 GetBox (float range, float size)
+  {
+    csVector3 v = GetVector (-range, range);
+    return csBox3 (v, v + GetVector (.1f, size + .1f));
+  }
+};
+
+#endif // __CS_LIBS_CSGEOM_T_RANDOMGEOMETRY_H__
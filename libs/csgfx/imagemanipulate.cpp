@@ -24,9 +24,12 @@
 #include "csgeom/vector3.h"
 #include "csgfx/imageautoconvert.h"
 #include "csgfx/imagememory.h"
+#include "csgfx/pixelops.h"
 
 #include "csgfx/imagemanipulate.h"
 
+using CS::Graphics::PixelOps;
+
 
 csRef<iImage> csImageManipulate::Rescale2D (iImage* source, int newwidth, 
   int newheight)
@@ -45,16 +48,27 @@ csRef<iImage> csImageManipulate::Rescale2D (iImage* source, int newwidth,
   unsigned int dx = csQfixed16 (float (Width) / float (newwidth));
   unsigned int dy = csQfixed16 (float (Height) / float (newheight));
 
+  /* When enlarging, consecutive rows often come from the same source row;
+     these are copied from the previous destination row. */
 #define RESIZE(pt, Source, Dest)			\
   {							\
     const pt* field = (pt*)Source;			\
     pt* dst = (pt*)Dest;				\
     y = 0;						\
     int ny, nx;						\
+    unsigned int lastRow = (unsigned int)~0;		\
     for (ny = newheight; ny; ny--)			\
     {							\
-      const pt* src = field + (y >> 16) * Width;	\
+      const unsigned int row = y >> 16;			\
       y += dy; x = 0;					\
+      if (row == lastRow)				\
+      {							\
+        memcpy (dst, dst - newwidth, newwidth * sizeof (pt));	\
+        dst += newwidth;				\
+        continue;					\
+      }							\
+      lastRow = row;					\
+      const pt* src = field + row * Width;		\
       for (nx = newwidth; nx; nx--)			\
       {							\
         *dst++ = src [x >> 16];				\
@@ -196,10 +210,6 @@ csRef<iImage> csImageManipulate::Rescale (iImage* source, int newwidth,
 
 //---------------------- Helper functions ---------------------------
 
-#define MIPMAP_NAME	mipmap_0
-#define MIPMAP_LEVEL	0
-#include "mipmap.inc"
-
 #define MIPMAP_NAME	mipmap_0_t
 #define MIPMAP_LEVEL	0
 #define MIPMAP_TRANSPARENT
@@ -221,10 +231,6 @@ csRef<iImage> csImageManipulate::Rescale (iImage* source, int newwidth,
 #define MIPMAP_ALPHA
 #include "mipmap.inc"
 
-#define MIPMAP_NAME	mipmap_1
-#define MIPMAP_LEVEL	1
-#include "mipmap.inc"
-
 #define MIPMAP_NAME	mipmap_1_t
 #define MIPMAP_LEVEL	1
 #define MIPMAP_TRANSPARENT
@@ -300,7 +306,8 @@ csRef<iImage> csImageManipulate::Mipmap2D (iImage* source, int steps,
       break;
       case CS_IMGFMT_TRUECOLOR:
         if (!transp)
-          mipmap_1 (cur_w, cur_h, (csRGBpixel*)simg->GetImageData (), mipmap);
+          PixelOps::Mipmap ((csRGBpixel*)simg->GetImageData (), cur_w, cur_h,
+            mipmap);
         else
           mipmap_1_t (cur_w, cur_h, (csRGBpixel*)simg->GetImageData (),
             mipmap, *transp);
@@ -339,25 +346,6 @@ csRef<iImage> csImageManipulate::Mipmap (iImage* source, int steps,
     return Mipmap2D (source, steps, transp);
 }
 
-static csRGBpixel TransformOneColor (const csRGBpixel& s, const csColor4& mult,
-  const csColor4& add)
-{
-  float r = float (s.red) * mult.red + add.red;
-  if (r < 0) r = 0; else if (r > 255) r = 255;
-  float g = float (s.green) * mult.green + add.green;
-  if (g < 0) g = 0; else if (g > 255) g = 255;
-  float b = float (s.blue) * mult.blue + add.blue;
-  if (b < 0) b = 0; else if (b > 255) b = 255;
-  float a = float (s.alpha) * mult.alpha + add.alpha;
-  if (a < 0) a = 0; else if (a > 255) a = 255;
-  csRGBpixel p;
-  p.red = (uint8)r;
-  p.green = (uint8)g;
-  p.blue = (uint8)b;
-  p.alpha = (uint8)a;
-  return p;
-}
-
 csRef<iImage> csImageManipulate::TransformColor (iImage* source,
   const csColor4& mult, const csColor4& add)
 {
@@ -366,11 +354,6 @@ csRef<iImage> csImageManipulate::TransformColor (iImage* source,
 
   csRef<csImageMemory> nimg;
 
-  const csRGBpixel* src;
-  csRGBpixel* dst;
-
-  size_t i;
-
   switch (source->GetFormat () & CS_IMGFMT_MASK)
   {
     case CS_IMGFMT_NONE:
@@ -378,20 +361,16 @@ csRef<iImage> csImageManipulate::TransformColor (iImage* source,
     case CS_IMGFMT_PALETTED8:
     {
       nimg.AttachNew (new csImageMemory (source));
-      src = source->GetPalette ();
-      dst = nimg->GetPalettePtr ();
-      for (i = 0; i < 256; i++)
-        *dst++ = TransformOneColor (*src++, mult, add);
+      PixelOps::TransformColor (source->GetPalette (),
+        nimg->GetPalettePtr (), 256, mult, add);
     }
     break;
     case CS_IMGFMT_TRUECOLOR:
     {
       nimg.AttachNew (new csImageMemory (Width, Height, source->GetFormat ()));
       csRGBpixel* mipmap = new csRGBpixel [Width * Height];
-      src = (const csRGBpixel*)source->GetImageData ();
-      dst = mipmap;
-      for (i = 0; i < size_t (Width * Height); i++)
-        *dst++ = TransformOneColor (*src++, mult, add);
+      PixelOps::TransformColor ((const csRGBpixel*)source->GetImageData (),
+        mipmap, size_t (Width * Height), mult, add);
       nimg->ConvertFromRGBA (mipmap);
     }
     break;
@@ -400,14 +379,6 @@ csRef<iImage> csImageManipulate::TransformColor (iImage* source,
   return nimg;
 }
 
-static csRGBpixel GrayColor (const csRGBpixel& s)
-{
-  unsigned char lum = s.Luminance ();
-  csRGBpixel p = csRGBpixel (lum, lum, lum);
-  p.alpha = s.alpha;
-  return p;
-}
-
 csRef<iImage> csImageManipulate::Gray (iImage* source)
 {
   const int Width = source->GetWidth ();
@@ -415,10 +386,6 @@ csRef<iImage> csImageManipulate::Gray (iImage* source)
 
   csRef<csImageMemory> nimg;
 
-  const csRGBpixel* src;
-  csRGBpixel* dst;
-  size_t i;
-
   switch (source->GetFormat () & CS_IMGFMT_MASK)
   {
     case CS_IMGFMT_NONE:
@@ -426,20 +393,15 @@ csRef<iImage> csImageManipulate::Gray (iImage* source)
     case CS_IMGFMT_PALETTED8:
     {
       nimg.AttachNew (new csImageMemory (source));
-      src = source->GetPalette ();
-      dst = nimg->GetPalettePtr ();
-      for (i = 0; i < 256; i++)
-        *dst++ = GrayColor (*src++);
+      PixelOps::Gray (source->GetPalette (), nimg->GetPalettePtr (), 256);
     }
     break;
     case CS_IMGFMT_TRUECOLOR:
     {
       nimg.AttachNew (new csImageMemory (Width, Height, source->GetFormat ()));
       csRGBpixel* mipmap = new csRGBpixel [Width * Height];
-      src = (const csRGBpixel*)source->GetImageData ();
-      dst = mipmap;
-      for (i = 0; i < size_t (Width * Height); i++)
-        *dst++ = GrayColor (*src++);
+      PixelOps::Gray ((const csRGBpixel*)source->GetImageData (), mipmap,
+        size_t (Width * Height));
       nimg->ConvertFromRGBA (mipmap);
     }
     break;
@@ -497,8 +459,8 @@ csRef<iImage> csImageManipulate::Blur (iImage* source, csRGBpixel* transp)
     case CS_IMGFMT_TRUECOLOR:
     {
       if (!transp)
-        mipmap_0 (source->GetWidth (), source->GetHeight (), 
-          (csRGBpixel*)source->GetImageData (), mipmap);
+        PixelOps::Blur ((csRGBpixel*)source->GetImageData (), 
+          source->GetWidth (), source->GetHeight (), mipmap);
       else
         mipmap_0_t (source->GetWidth (), source->GetHeight (), 
           (csRGBpixel*)source->GetImageData (), mipmap, *transp);
@@ -604,26 +566,7 @@ csRef<iImage> csImageManipulate::Sharpen (iImage* source, int strength,
   csRGBpixel* result = new csRGBpixel [Width * Height];
   csRGBpixel* src_o = (csRGBpixel*)original->GetImageData ();
   csRGBpixel* src_b = (csRGBpixel*)blurry->GetImageData ();
-  csRGBpixel* dest = result;
- 
-  for (int n = Width * Height; n > 0; n--)
-  {
-    int v;
-    #define DO(comp)  \
-      v = src_o->comp + ((strength * (src_o->comp - src_b->comp)) >> 8);  \
-      dest->comp = (v > 255) ? 255 : ((v < 0) ? 0 : v)
-
-    DO (red);
-    DO (green);
-    DO (blue);
-    DO (alpha);
-
-    #undef DO
-
-    dest++;
-    src_o++;
-    src_b++;
-  }
+  PixelOps::Sharpen (src_o, src_b, result, Width * Height, strength);
 
   csRef<csImageMemory> resimg;
   resimg.AttachNew (new csImageMemory (source->GetWidth (),
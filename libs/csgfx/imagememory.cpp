@@ -21,6 +21,7 @@
 #include "csgfx/imagemanipulate.h"
 #include "csgfx/quantize.h"
 #include "csgfx/imagememory.h"
+#include "csgfx/pixelops.h"
 #include "csgfx/rgbpixel.h"
 #include "csutil/util.h"
 
@@ -225,12 +226,8 @@ void csImageMemory::Clear (const csRGBpixel &colour)
 
   EnsureImage ();
 
-  uint32 *src = (uint32*) &colour;
-  uint32 *dst = (uint32*)databuf->GetData ();
-
-  int i;
-  for (i = 0; i < Width*Height*Depth; i++, dst++)
-    *dst = *src;
+  CS::Graphics::PixelOps::Fill ((csRGBpixel*)databuf->GetData (),
+    size_t (Width*Height*Depth), colour);
 }
 
 void csImageMemory::CheckAlpha ()
@@ -253,12 +250,8 @@ void csImageMemory::CheckAlpha ()
           }
       break;
     case CS_IMGFMT_TRUECOLOR:
-      for (i = 0; i < pixels; i++)
-        if (((csRGBpixel *)databuf->GetData ()) [i].alpha != 255)
-        {
-          noalpha = false;
-          break;
-        }
+      noalpha = CS::Graphics::PixelOps::IsOpaque (
+        (csRGBpixel *)databuf->GetData (), pixels);
       break;
   }
   if (noalpha)
@@ -287,9 +280,7 @@ void csImageMemory::InternalConvertFromRGBA (iDataBuffer* imageData)
       {
         if (!Alpha)
           Alpha = new uint8 [pixels];
-        int i;
-        for (i = 0; i < pixels; i++)
-          Alpha [i] = iImage [i].alpha;
+        CS::Graphics::PixelOps::ExtractAlpha (iImage, Alpha, pixels);
       }
       if ((Format & CS_IMGFMT_MASK) == CS_IMGFMT_PALETTED8)
       {
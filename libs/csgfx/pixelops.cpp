@@ -0,0 +1,575 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "csutil/processorspecdetection.h"
+
+#include "csgfx/pixelops.h"
+
+/* SSE2 kernels are only built if the compiler generates SSE2 code anyway;
+   whether they are used is decided at runtime. */
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CS_PIXELOPS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace CS
+{
+  namespace Graphics
+  {
+    namespace
+    {
+      #define MIPMAP_NAME	MipmapGeneric
+      #define MIPMAP_LEVEL	1
+      #include "mipmap.inc"
+
+      #define MIPMAP_NAME	BlurGeneric
+      #define MIPMAP_LEVEL	0
+      #include "mipmap.inc"
+
+      static inline csRGBpixel TransformOneColor (const csRGBpixel& s,
+        const csColor4& mult, const csColor4& add)
+      {
+        float r = float (s.red) * mult.red + add.red;
+        if (r < 0) r = 0; else if (r > 255) r = 255;
+        float g = float (s.green) * mult.green + add.green;
+        if (g < 0) g = 0; else if (g > 255) g = 255;
+        float b = float (s.blue) * mult.blue + add.blue;
+        if (b < 0) b = 0; else if (b > 255) b = 255;
+        float a = float (s.alpha) * mult.alpha + add.alpha;
+        if (a < 0) a = 0; else if (a > 255) a = 255;
+        csRGBpixel p;
+        p.red = (uint8)r;
+        p.green = (uint8)g;
+        p.blue = (uint8)b;
+        p.alpha = (uint8)a;
+        return p;
+      }
+
+      static inline csRGBpixel GrayColor (const csRGBpixel& s)
+      {
+        unsigned char lum = s.Luminance ();
+        csRGBpixel p = csRGBpixel (lum, lum, lum);
+        p.alpha = s.alpha;
+        return p;
+      }
+
+      static inline csRGBpixel SharpenColor (const csRGBpixel& o,
+        const csRGBpixel& b, int strength)
+      {
+        csRGBpixel p;
+        int v;
+        #define DO(comp)  \
+          v = o.comp + ((strength * (o.comp - b.comp)) >> 8);  \
+          p.comp = (v > 255) ? 255 : ((v < 0) ? 0 : v)
+
+        DO (red);
+        DO (green);
+        DO (blue);
+        DO (alpha);
+
+        #undef DO
+        return p;
+      }
+
+      //-------------------------------------------------------------------
+
+      static void TransformColorGeneric (const csRGBpixel* src,
+        csRGBpixel* dst, size_t n, const csColor4& mult, const csColor4& add)
+      {
+        for (size_t i = 0; i < n; i++)
+          dst[i] = TransformOneColor (src[i], mult, add);
+      }
+
+      static void GrayGeneric (const csRGBpixel* src, csRGBpixel* dst,
+        size_t n)
+      {
+        for (size_t i = 0; i < n; i++)
+          dst[i] = GrayColor (src[i]);
+      }
+
+      static void SharpenGeneric (const csRGBpixel* original,
+        const csRGBpixel* blurred, csRGBpixel* dst, size_t n, int strength)
+      {
+        for (size_t i = 0; i < n; i++)
+          dst[i] = SharpenColor (original[i], blurred[i], strength);
+      }
+
+      static void ExtractAlphaGeneric (const csRGBpixel* src, uint8* alpha,
+        size_t n)
+      {
+        for (size_t i = 0; i < n; i++)
+          alpha[i] = src[i].alpha;
+      }
+
+      static bool IsOpaqueGeneric (const csRGBpixel* src, size_t n)
+      {
+        for (size_t i = 0; i < n; i++)
+        {
+          if (src[i].alpha != 255) return false;
+        }
+        return true;
+      }
+
+      static void FillGeneric (csRGBpixel* dst, size_t n,
+        const csRGBpixel& color)
+      {
+        for (size_t i = 0; i < n; i++)
+          dst[i] = color;
+      }
+
+      //-------------------------------------------------------------------
+
+#ifdef CS_PIXELOPS_SSE2
+      static void MipmapSSE2 (unsigned int w, unsigned int h,
+        const csRGBpixel* src, csRGBpixel* dst)
+      {
+        const unsigned int nw = w >> 1;
+        const unsigned int nh = h >> 1;
+        // Single rows and columns are rare, let the generic code do them
+        if ((nw == 0) || (nh == 0))
+        {
+          MipmapGeneric (w, h, src, dst);
+          return;
+        }
+
+        const __m128i zero = _mm_setzero_si128 ();
+        for (unsigned int y = 0; y < nh; y++)
+        {
+          const csRGBpixel* row0 = src + y * 2 * w;
+          const csRGBpixel* row1 = row0 + w;
+          unsigned int x = 0;
+          // Two output pixels from 2x4 source pixels
+          for (; x + 2 <= nw; x += 2)
+          {
+            const __m128i a = _mm_loadu_si128 ((const __m128i*)(row0 + 2*x));
+            const __m128i b = _mm_loadu_si128 ((const __m128i*)(row1 + 2*x));
+            const __m128i sumLo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero),
+              _mm_unpacklo_epi8 (b, zero));
+            const __m128i sumHi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero),
+              _mm_unpackhi_epi8 (b, zero));
+            const __m128i sum = _mm_add_epi16 (
+              _mm_unpacklo_epi64 (sumLo, sumHi),
+              _mm_unpackhi_epi64 (sumLo, sumHi));
+            const __m128i avg = _mm_srli_epi16 (sum, 2);
+            _mm_storel_epi64 ((__m128i*)dst, _mm_packus_epi16 (avg, avg));
+            dst += 2;
+          }
+          for (; x < nw; x++)
+          {
+            const csRGBpixel& p0 = row0[2*x];
+            const csRGBpixel& p1 = row0[2*x + 1];
+            const csRGBpixel& p2 = row1[2*x];
+            const csRGBpixel& p3 = row1[2*x + 1];
+            dst->red = (p0.red + p1.red + p2.red + p3.red) >> 2;
+            dst->green = (p0.green + p1.green + p2.green + p3.green) >> 2;
+            dst->blue = (p0.blue + p1.blue + p2.blue + p3.blue) >> 2;
+            dst->alpha = (p0.alpha + p1.alpha + p2.alpha + p3.alpha) >> 2;
+            dst++;
+          }
+        }
+      }
+
+      /// Blur one pixel, with explicit neighbour columns
+      static inline void BlurPixel (const csRGBpixel* r1,
+        const csRGBpixel* r2, const csRGBpixel* r3, int xl, int x, int xr,
+        csRGBpixel& out)
+      {
+        #define BLUR(comp)						\
+          out.comp = (r1[xl].comp + 2*r1[x].comp + r1[xr].comp		\
+            + 2*r2[xl].comp + 4*r2[x].comp + 2*r2[xr].comp		\
+            + r3[xl].comp + 2*r3[x].comp + r3[xr].comp) >> 4
+
+        BLUR (red);
+        BLUR (green);
+        BLUR (blue);
+        BLUR (alpha);
+
+        #undef BLUR
+      }
+
+      /// Horizontal 1-2-1 filter of 4 pixels, as 16 bit values
+      static inline void BlurRow (const csRGBpixel* row, __m128i& lo,
+        __m128i& hi)
+      {
+        const __m128i zero = _mm_setzero_si128 ();
+        const __m128i l = _mm_loadu_si128 ((const __m128i*)(row - 1));
+        const __m128i c = _mm_loadu_si128 ((const __m128i*)row);
+        const __m128i r = _mm_loadu_si128 ((const __m128i*)(row + 1));
+        lo = _mm_add_epi16 (_mm_add_epi16 (_mm_unpacklo_epi8 (l, zero),
+          _mm_unpacklo_epi8 (r, zero)),
+          _mm_slli_epi16 (_mm_unpacklo_epi8 (c, zero), 1));
+        hi = _mm_add_epi16 (_mm_add_epi16 (_mm_unpackhi_epi8 (l, zero),
+          _mm_unpackhi_epi8 (r, zero)),
+          _mm_slli_epi16 (_mm_unpackhi_epi8 (c, zero), 1));
+      }
+
+      static void BlurSSE2 (unsigned int w, unsigned int h,
+        const csRGBpixel* src, csRGBpixel* dst)
+      {
+        if (w < 6)
+        {
+          BlurGeneric (w, h, src, dst);
+          return;
+        }
+
+        const int last = int (w) - 1;
+        for (unsigned int y = 0; y < h; y++)
+        {
+          // Rows wrap around at the top and bottom
+          const csRGBpixel* r1 = src + ((y == 0) ? h - 1 : y - 1) * w;
+          const csRGBpixel* r2 = src + y * w;
+          const csRGBpixel* r3 = src + ((y == h - 1) ? 0 : y + 1) * w;
+
+          // Columns wrap around at the left and right
+          BlurPixel (r1, r2, r3, last, 0, 1, *dst++);
+          int x = 1;
+          for (; x + 4 <= last; x += 4)
+          {
+            __m128i lo1, hi1, lo2, hi2, lo3, hi3;
+            BlurRow (r1 + x, lo1, hi1);
+            BlurRow (r2 + x, lo2, hi2);
+            BlurRow (r3 + x, lo3, hi3);
+            const __m128i lo = _mm_srli_epi16 (_mm_add_epi16 (
+              _mm_add_epi16 (lo1, lo3), _mm_slli_epi16 (lo2, 1)), 4);
+            const __m128i hi = _mm_srli_epi16 (_mm_add_epi16 (
+              _mm_add_epi16 (hi1, hi3), _mm_slli_epi16 (hi2, 1)), 4);
+            _mm_storeu_si128 ((__m128i*)dst, _mm_packus_epi16 (lo, hi));
+            dst += 4;
+          }
+          for (; x < last; x++)
+            BlurPixel (r1, r2, r3, x - 1, x, x + 1, *dst++);
+          BlurPixel (r1, r2, r3, last - 1, last, 0, *dst++);
+        }
+      }
+
+      static void TransformColorSSE2 (const csRGBpixel* src,
+        csRGBpixel* dst, size_t n, const csColor4& mult, const csColor4& add)
+      {
+        const __m128i zero = _mm_setzero_si128 ();
+        const __m128 m = _mm_setr_ps (mult.red, mult.green, mult.blue,
+          mult.alpha);
+        const __m128 a = _mm_setr_ps (add.red, add.green, add.blue,
+          add.alpha);
+        const __m128 minV = _mm_setzero_ps ();
+        const __m128 maxV = _mm_set1_ps (255.0f);
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+          const __m128i v = _mm_loadu_si128 ((const __m128i*)(src + i));
+          const __m128i v16lo = _mm_unpacklo_epi8 (v, zero);
+          const __m128i v16hi = _mm_unpackhi_epi8 (v, zero);
+          __m128i c[4];
+          c[0] = _mm_unpacklo_epi16 (v16lo, zero);
+          c[1] = _mm_unpackhi_epi16 (v16lo, zero);
+          c[2] = _mm_unpacklo_epi16 (v16hi, zero);
+          c[3] = _mm_unpackhi_epi16 (v16hi, zero);
+          for (int k = 0; k < 4; k++)
+          {
+            __m128 f = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (c[k]), m), a);
+            f = _mm_min_ps (_mm_max_ps (f, minV), maxV);
+            c[k] = _mm_cvttps_epi32 (f);
+          }
+          const __m128i result = _mm_packus_epi16 (
+            _mm_packs_epi32 (c[0], c[1]), _mm_packs_epi32 (c[2], c[3]));
+          _mm_storeu_si128 ((__m128i*)(dst + i), result);
+        }
+        for (; i < n; i++)
+          dst[i] = TransformOneColor (src[i], mult, add);
+      }
+
+      static void GraySSE2 (const csRGBpixel* src, csRGBpixel* dst,
+        size_t n)
+      {
+        const __m128i zero = _mm_setzero_si128 ();
+        const __m128i weights = _mm_setr_epi16 (30, 59, 11, 0, 30, 59, 11, 0);
+        // x / 100 == (x * 5243) >> 19 for all luminance sums
+        const __m128i div100 = _mm_set1_epi16 (5243);
+        const __m128i alphaMask = _mm_set1_epi32 (0xff000000);
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+          const __m128i v = _mm_loadu_si128 ((const __m128i*)(src + i));
+          // Per pixel: (30r + 59g, 11b)
+          const __m128i m0 = _mm_madd_epi16 (_mm_unpacklo_epi8 (v, zero),
+            weights);
+          const __m128i m1 = _mm_madd_epi16 (_mm_unpackhi_epi8 (v, zero),
+            weights);
+          const __m128i s0 = _mm_add_epi32 (m0, _mm_srli_epi64 (m0, 32));
+          const __m128i s1 = _mm_add_epi32 (m1, _mm_srli_epi64 (m1, 32));
+          const __m128i sums = _mm_unpacklo_epi64 (
+            _mm_shuffle_epi32 (s0, _MM_SHUFFLE (3, 3, 2, 0)),
+            _mm_shuffle_epi32 (s1, _MM_SHUFFLE (3, 3, 2, 0)));
+          const __m128i sums16 = _mm_packs_epi32 (sums, sums);
+          const __m128i lum16 = _mm_srli_epi16 (
+            _mm_mulhi_epu16 (sums16, div100), 3);
+          const __m128i lum = _mm_unpacklo_epi16 (lum16, zero);
+          const __m128i gray = _mm_or_si128 (_mm_or_si128 (lum,
+            _mm_slli_epi32 (lum, 8)), _mm_slli_epi32 (lum, 16));
+          _mm_storeu_si128 ((__m128i*)(dst + i), _mm_or_si128 (gray,
+            _mm_and_si128 (v, alphaMask)));
+        }
+        for (; i < n; i++)
+          dst[i] = GrayColor (src[i]);
+      }
+
+      static void SharpenSSE2 (const csRGBpixel* original,
+        const csRGBpixel* blurred, csRGBpixel* dst, size_t n, int strength)
+      {
+        // The products are computed from 16 bit factors
+        if (strength > 32767)
+        {
+          SharpenGeneric (original, blurred, dst, n, strength);
+          return;
+        }
+
+        const __m128i zero = _mm_setzero_si128 ();
+        const __m128i s = _mm_set1_epi16 ((short)strength);
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+          const __m128i o = _mm_loadu_si128 ((const __m128i*)(original + i));
+          const __m128i b = _mm_loadu_si128 ((const __m128i*)(blurred + i));
+          __m128i half[2];
+          for (int k = 0; k < 2; k++)
+          {
+            const __m128i o16 = k ? _mm_unpackhi_epi8 (o, zero)
+              : _mm_unpacklo_epi8 (o, zero);
+            const __m128i b16 = k ? _mm_unpackhi_epi8 (b, zero)
+              : _mm_unpacklo_epi8 (b, zero);
+            const __m128i d = _mm_sub_epi16 (o16, b16);
+            const __m128i pl = _mm_mullo_epi16 (d, s);
+            const __m128i ph = _mm_mulhi_epi16 (d, s);
+            const __m128i r0 = _mm_add_epi32 (
+              _mm_srai_epi32 (_mm_unpacklo_epi16 (pl, ph), 8),
+              _mm_unpacklo_epi16 (o16, zero));
+            const __m128i r1 = _mm_add_epi32 (
+              _mm_srai_epi32 (_mm_unpackhi_epi16 (pl, ph), 8),
+              _mm_unpackhi_epi16 (o16, zero));
+            half[k] = _mm_packs_epi32 (r0, r1);
+          }
+          _mm_storeu_si128 ((__m128i*)(dst + i),
+            _mm_packus_epi16 (half[0], half[1]));
+        }
+        for (; i < n; i++)
+          dst[i] = SharpenColor (original[i], blurred[i], strength);
+      }
+
+      static void ExtractAlphaSSE2 (const csRGBpixel* src, uint8* alpha,
+        size_t n)
+      {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+          const __m128i* p = (const __m128i*)(src + i);
+          const __m128i a0 = _mm_srli_epi32 (_mm_loadu_si128 (p), 24);
+          const __m128i a1 = _mm_srli_epi32 (_mm_loadu_si128 (p + 1), 24);
+          const __m128i a2 = _mm_srli_epi32 (_mm_loadu_si128 (p + 2), 24);
+          const __m128i a3 = _mm_srli_epi32 (_mm_loadu_si128 (p + 3), 24);
+          _mm_storeu_si128 ((__m128i*)(alpha + i), _mm_packus_epi16 (
+            _mm_packs_epi32 (a0, a1), _mm_packs_epi32 (a2, a3)));
+        }
+        for (; i < n; i++)
+          alpha[i] = src[i].alpha;
+      }
+
+      static bool IsOpaqueSSE2 (const csRGBpixel* src, size_t n)
+      {
+        const __m128i alphaMask = _mm_set1_epi32 (0xff000000);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+          const __m128i a = _mm_and_si128 (
+            _mm_loadu_si128 ((const __m128i*)(src + i)), alphaMask);
+          if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (a, alphaMask)) != 0xffff)
+            return false;
+        }
+        for (; i < n; i++)
+        {
+          if (src[i].alpha != 255) return false;
+        }
+        return true;
+      }
+
+      static void FillSSE2 (csRGBpixel* dst, size_t n,
+        const csRGBpixel& color)
+      {
+        uint32 c;
+        memcpy (&c, &color, sizeof (c));
+        const __m128i v = _mm_set1_epi32 (c);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+          _mm_storeu_si128 ((__m128i*)(dst + i), v);
+        for (; i < n; i++)
+          dst[i] = color;
+      }
+#endif // CS_PIXELOPS_SSE2
+
+      //-------------------------------------------------------------------
+
+      struct Kernels
+      {
+        void (*mipmap) (unsigned int w, unsigned int h,
+          const csRGBpixel* src, csRGBpixel* dst);
+        void (*blur) (unsigned int w, unsigned int h,
+          const csRGBpixel* src, csRGBpixel* dst);
+        void (*transformColor) (const csRGBpixel* src, csRGBpixel* dst,
+          size_t n, const csColor4& mult, const csColor4& add);
+        void (*gray) (const csRGBpixel* src, csRGBpixel* dst, size_t n);
+        void (*sharpen) (const csRGBpixel* original,
+          const csRGBpixel* blurred, csRGBpixel* dst, size_t n, int strength);
+        void (*extractAlpha) (const csRGBpixel* src, uint8* alpha, size_t n);
+        bool (*isOpaque) (const csRGBpixel* src, size_t n);
+        void (*fill) (csRGBpixel* dst, size_t n, const csRGBpixel& color);
+      };
+
+      static const Kernels genericKernels =
+      {
+        MipmapGeneric, BlurGeneric, TransformColorGeneric, GrayGeneric,
+        SharpenGeneric, ExtractAlphaGeneric, IsOpaqueGeneric, FillGeneric
+      };
+#ifdef CS_PIXELOPS_SSE2
+      static const Kernels sse2Kernels =
+      {
+        MipmapSSE2, BlurSSE2, TransformColorSSE2, GraySSE2,
+        SharpenSSE2, ExtractAlphaSSE2, IsOpaqueSSE2, FillSSE2
+      };
+#endif
+
+      static const Kernels* kernels = 0;
+      static PixelOps::Implementation kernelsImpl = PixelOps::implGeneric;
+
+      static bool IsSupported (PixelOps::Implementation impl)
+      {
+        switch (impl)
+        {
+          case PixelOps::implGeneric:
+            return true;
+          case PixelOps::implSSE2:
+#ifdef CS_PIXELOPS_SSE2
+            {
+              CS::Platform::ProcessorSpecDetection procSpec;
+              return procSpec.HasSSE2 ();
+            }
+#else
+            return false;
+#endif
+        }
+        return false;
+      }
+
+      static void UseKernels (PixelOps::Implementation impl)
+      {
+#ifdef CS_PIXELOPS_SSE2
+        if (impl == PixelOps::implSSE2)
+        {
+          kernels = &sse2Kernels;
+          kernelsImpl = impl;
+          return;
+        }
+#endif
+        kernels = &genericKernels;
+        kernelsImpl = PixelOps::implGeneric;
+      }
+
+      static inline const Kernels& GetKernels ()
+      {
+        /* Picking the kernels concurrently is harmless, all threads pick
+           the same. */
+        if (!kernels)
+          UseKernels (IsSupported (PixelOps::implSSE2)
+            ? PixelOps::implSSE2 : PixelOps::implGeneric);
+        return *kernels;
+      }
+    } // anonymous namespace
+
+    PixelOps::Implementation PixelOps::GetImplementation ()
+    {
+      GetKernels ();
+      return kernelsImpl;
+    }
+
+    bool PixelOps::SetImplementation (Implementation impl)
+    {
+      if (!IsSupported (impl)) return false;
+      UseKernels (impl);
+      return true;
+    }
+
+    const char* PixelOps::GetImplementationName (Implementation impl)
+    {
+      switch (impl)
+      {
+        case implGeneric: return "generic";
+        case implSSE2:    return "SSE2";
+      }
+      return 0;
+    }
+
+    void PixelOps::Mipmap (const csRGBpixel* src, uint w, uint h,
+                           csRGBpixel* dst)
+    {
+      GetKernels ().mipmap (w, h, src, dst);
+    }
+
+    void PixelOps::Blur (const csRGBpixel* src, uint w, uint h,
+                         csRGBpixel* dst)
+    {
+      GetKernels ().blur (w, h, src, dst);
+    }
+
+    void PixelOps::TransformColor (const csRGBpixel* src, csRGBpixel* dst,
+                                   size_t n, const csColor4& mult,
+                                   const csColor4& add)
+    {
+      GetKernels ().transformColor (src, dst, n, mult, add);
+    }
+
+    void PixelOps::Gray (const csRGBpixel* src, csRGBpixel* dst, size_t n)
+    {
+      GetKernels ().gray (src, dst, n);
+    }
+
+    void PixelOps::Sharpen (const csRGBpixel* original,
+                            const csRGBpixel* blurred, csRGBpixel* dst,
+                            size_t n, int strength)
+    {
+      GetKernels ().sharpen (original, blurred, dst, n, strength);
+    }
+
+    void PixelOps::ExtractAlpha (const csRGBpixel* src, uint8* alpha,
+                                 size_t n)
+    {
+      GetKernels ().extractAlpha (src, alpha, n);
+    }
+
+    bool PixelOps::IsOpaque (const csRGBpixel* src, size_t n)
+    {
+      return GetKernels ().isOpaque (src, n);
+    }
+
+    void PixelOps::Fill (csRGBpixel* dst, size_t n, const csRGBpixel& color)
+    {
+      GetKernels ().fill (dst, n, color);
+    }
+  } // namespace Graphics
+} // namespace CS
@@ -23,15 +23,15 @@
 //CS_LEAKGUARD_IMPLEMENT (csShaderVariable);
 
 CS_IMPLEMENT_STATIC_CLASSVAR (csShaderVariable, matrixAlloc, MatrixAlloc,
-    CS::Memory::BlockAllocatorSafe<csMatrix3>, (1024));
+    CS::Memory::BlockAllocatorThreadCached<csMatrix3>, (1024));
 CS_IMPLEMENT_STATIC_CLASSVAR (csShaderVariable, matrix4Alloc, Matrix4Alloc,
-    CS::Memory::BlockAllocatorSafe<CS::Math::Matrix4>, (1024));
+    CS::Memory::BlockAllocatorThreadCached<CS::Math::Matrix4>, (1024));
 CS_IMPLEMENT_STATIC_CLASSVAR (csShaderVariable, transformAlloc, TransformAlloc,
-    CS::Memory::BlockAllocatorSafe<csReversibleTransform>, (1024));
+    CS::Memory::BlockAllocatorThreadCached<csReversibleTransform>, (1024));
 CS_IMPLEMENT_STATIC_CLASSVAR (csShaderVariable, arrayAlloc,
-    ShaderVarArrayAlloc, CS::Memory::BlockAllocatorSafe<csShaderVariable::SvArrayType>, (1024));
+    ShaderVarArrayAlloc, CS::Memory::BlockAllocatorThreadCached<csShaderVariable::SvArrayType>, (1024));
 CS_IMPLEMENT_STATIC_CLASSVAR (csShaderVariable, accessorAlloc,
-    AccessorValuesAlloc, CS::Memory::BlockAllocatorSafe<csShaderVariable::AccessorValues>, (1024));
+    AccessorValuesAlloc, CS::Memory::BlockAllocatorThreadCached<csShaderVariable::AccessorValues>, (1024));
 
 
 csShaderVariable::csShaderVariable () :
@@ -18,6 +18,7 @@
 */
 
 #include "cssysdef.h"
+#include "csgeom/math.h"
 #include "csgfx/shadervarcontext.h"
 
 namespace CS
@@ -25,85 +26,234 @@ namespace CS
 namespace Graphics
 {
 
+/* Variables created by a context are constructed in place in blocks of
+ * slots. A slot is released when the variable's last reference goes away,
+ * and a block is freed once the context no longer uses it and all its
+ * slots are released. */
+struct ShaderVariableContextImpl::VariableBlock
+{
+  /// Bit mask of the slots in use
+  uint32 used;
+  /// Number of slots
+  uint32 capacity;
+  /// Whether the owning context still exists
+  bool owned;
+
+  enum { maxCapacity = 32 };
+
+  static size_t SlotsOffset ()
+  { return (sizeof (VariableBlock) + 15) & ~15; }
+
+  void* GetSlot (uint slot);
+
+  static VariableBlock* Create (uint32 capacity);
+
+  bool IsFull () const
+  {
+    return used == ((capacity == 32) ? ~uint32 (0) : ((1u << capacity) - 1));
+  }
+
+  void Release (uint slot)
+  {
+    used &= ~(1u << slot);
+    if ((used == 0) && !owned) cs_free (this);
+  }
+};
+
+class ShaderVariableContextImpl::PackedVariable : public csShaderVariable
+{
+  VariableBlock* block;
+  uint slot;
+public:
+  PackedVariable (VariableBlock* block, uint slot, ShaderVarStringID name) :
+    csShaderVariable (name), block (block), slot (slot) {}
+protected:
+  void Delete ()
+  {
+    VariableBlock* b = block;
+    uint s = slot;
+    this->~PackedVariable ();
+    b->Release (s);
+  }
+};
+
+ShaderVariableContextImpl::VariableBlock*
+ShaderVariableContextImpl::VariableBlock::Create (uint32 capacity)
+{
+  VariableBlock* block = (VariableBlock*)cs_malloc (SlotsOffset ()
+    + capacity * sizeof (PackedVariable));
+  block->used = 0;
+  block->capacity = capacity;
+  block->owned = true;
+  return block;
+}
+
+void* ShaderVariableContextImpl::VariableBlock::GetSlot (uint slot)
+{
+  return (uint8*)this + SlotsOffset () + slot * sizeof (PackedVariable);
+}
+
+ShaderVariableContextImpl::ShaderVariableContextImpl (
+  const ShaderVariableContextImpl& other) : iBase (),
+  iShaderVariableContext (), variables (other.variables),
+  names (other.names)
+{
+}
+
 ShaderVariableContextImpl::~ShaderVariableContextImpl ()
-{}
+{
+  /* Blocks still holding variables are freed when the last of them is
+   * destroyed, which includes the ones in 'variables'. */
+  for (size_t i = 0; i < blocks.GetSize (); i++)
+  {
+    VariableBlock* block = blocks[i];
+    block->owned = false;
+    if (block->used == 0) cs_free (block);
+  }
+}
 
-namespace
+ShaderVariableContextImpl& ShaderVariableContextImpl::operator= (
+  const ShaderVariableContextImpl& other)
 {
-class SvVarArrayCmp : public csArrayCmp<csShaderVariable*, 
-  CS::ShaderVarStringID>
+  variables = other.variables;
+  names = other.names;
+  return *this;
+}
+
+csShaderVariable* ShaderVariableContextImpl::NewVariable (
+  ShaderVarStringID name)
 {
-  static int SvKeyCompare (csShaderVariable* const& r,
-		                         CS::ShaderVarStringID const& k)
-  { 
-    return r->GetName() - k;
+  VariableBlock* block = 0;
+  for (size_t i = blocks.GetSize (); i-- > 0; )
+  {
+    if (!blocks[i]->IsFull ())
+    {
+      block = blocks[i];
+      break;
+    }
   }
-public:
-  SvVarArrayCmp (CS::ShaderVarStringID key) : 
-    csArrayCmp<csShaderVariable*, CS::ShaderVarStringID> (key, SvKeyCompare)
+  if (block == 0)
   {
+    // Small contexts are common, so start small and grow
+    uint32 capacity = blocks.IsEmpty () ? 4
+      : csMin (blocks.Top ()->capacity * 2,
+          uint32 (VariableBlock::maxCapacity));
+    block = VariableBlock::Create (capacity);
+    blocks.Push (block);
   }
-};
 
-static int SvCompare (csShaderVariable* const& r, csShaderVariable* const& k)
-{ 
-  return r->GetName() - k->GetName();
+  uint slot = 0;
+  while (block->used & (1u << slot)) slot++;
+  block->used |= 1u << slot;
+  return new (block->GetSlot (slot)) PackedVariable (block, slot, name);
 }
+
+namespace
+{
+  /// Index of the first element in \a names not less than \a name
+  static size_t LowerBound (const ShaderVarStringID* names, size_t num,
+                            ShaderVarStringID name)
+  {
+    size_t l = 0, r = num;
+    while (l < r)
+    {
+      size_t m = (l + r) / 2;
+      if (names[m] < name)
+        l = m + 1;
+      else
+        r = m;
+    }
+    return l;
+  }
+}
+
+size_t ShaderVariableContextImpl::FindName (ShaderVarStringID name) const
+{
+  const size_t num = names.GetSize ();
+  size_t index = LowerBound (names.GetArray (), num, name);
+  if ((index < num) && (names[index] == name))
+    return index;
+  return csArrayItemNotFound;
+}
+
+void ShaderVariableContextImpl::InsertVariable (csShaderVariable* variable)
+{
+  ShaderVarStringID name = variable->GetName ();
+  size_t index = LowerBound (names.GetArray (), names.GetSize (), name);
+  variables.Insert (index, variable);
+  names.Insert (index, name);
 }
 
 void ShaderVariableContextImpl::AddVariable (csShaderVariable *variable) 
 {
-  csShaderVariable* var = GetVariable (variable->GetName());
-  if (var == 0)
-    variables.InsertSorted (variable, SvCompare);
+  size_t index = FindName (variable->GetName());
+  if (index == csArrayItemNotFound)
+    InsertVariable (variable);
   else
-    *var = *variable;
+    *variables[index] = *variable;
 }
 
 csShaderVariable* ShaderVariableContextImpl::GetVariable (
   ShaderVarStringID name) const 
 {
-  size_t index = variables.FindSortedKey (SvVarArrayCmp (name));
+  size_t index = FindName (name);
   if (index != csArrayItemNotFound)
     return variables[index];
   return 0;
 }
 
-void ShaderVariableContextImpl::PushVariables (
-  csShaderVariableStack& stack) const
+csShaderVariable* ShaderVariableContextImpl::GetVariableAdd (
+  ShaderVarStringID name)
 {
-  for (size_t i = 0; i < variables.GetSize (); ++i)
+  csShaderVariable* sv = GetVariable (name);
+  if (sv == 0)
   {
-    ShaderVarStringID name = variables[i]->GetName ();
-    if (name >= stack.GetSize ())
-      /* Not really an error: can happen if new shader vars are created
-       * after the stack was set up */
-      return;
-    stack[name] = variables[i];
+    csRef<csShaderVariable> nsv;
+    nsv.AttachNew (NewVariable (name));
+    AddVariable (nsv);
+    sv = nsv; // OK, sv won't be destructed, SV context takes ownership
   }
+  return sv;
+}
+
+void ShaderVariableContextImpl::PushVariables (
+  csShaderVariableStack& stack) const
+{
+  const size_t num = names.GetSize ();
+  const ShaderVarStringID* nameArray = names.GetArray ();
+  /* Names are sorted, so everything from the first name outside the stack
+   * on is outside as well. Not really an error: can happen if new shader
+   * vars are created after the stack was set up */
+  const size_t numPush = LowerBound (nameArray, num,
+    ShaderVarStringID (stack.GetSize ()));
+  for (size_t i = 0; i < numPush; ++i)
+    stack[nameArray[i]] = variables[i];
 }
 
 void ShaderVariableContextImpl::ReplaceVariable (csShaderVariable *variable) 
 {
-  size_t index = variables.FindSortedKey (SvVarArrayCmp (
-    variable->GetName()));
+  size_t index = FindName (variable->GetName());
   if (index != csArrayItemNotFound)
     variables.Put (index, variable);
   else
-    variables.InsertSorted (variable, SvCompare);
+    InsertVariable (variable);
 }
 
 bool ShaderVariableContextImpl::RemoveVariable (csShaderVariable* variable)
 {
-  return variables.Delete (variable);
+  size_t index = variables.Find (variable);
+  if (index == csArrayItemNotFound) return false;
+  names.DeleteIndex (index);
+  return variables.DeleteIndex (index);
 }
 
 bool ShaderVariableContextImpl::RemoveVariable (ShaderVarStringID name)
 {
-  size_t index = variables.FindSortedKey (SvVarArrayCmp (name));
+  size_t index = FindName (name);
   if (index != csArrayItemNotFound)
   {
-      return variables.DeleteIndex (index);
+    names.DeleteIndex (index);
+    return variables.DeleteIndex (index);
   }
   return false;
 }
@@ -125,6 +275,7 @@ csShaderVariableContext::csShaderVariableContext (
   scfImplementationType(this), CS::ShaderVariableContextImpl ()
 {
   variables = other.variables;
+  names = other.names;
 }
 
 csShaderVariableContext::~csShaderVariableContext ()
@@ -0,0 +1,429 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+
+#include "csutil/cfgacc.h"
+#include "csutil/databuf.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/threadjobqueue.h"
+
+#include "csplugincommon/sndsys/decoder.h"
+
+using namespace CS::Threading;
+
+namespace CS
+{
+  namespace SndSys
+  {
+
+  SndSysDecoder::SndSysDecoder (size_t frameBytes) :
+    scfImplementationType (this), bufferedBytes (0), frameBytes (frameBytes),
+    lookAheadBytes (0), queued (false), cancelled (false), endOfData (false),
+    decodedPosition (0)
+  {
+  }
+
+  SndSysDecoder::~SndSysDecoder ()
+  {
+  }
+
+  void SndSysDecoder::SetDecodeAhead (iJobQueue* queue, size_t lookAheadBytes)
+  {
+    MutexScopedLock lock (mutex);
+    jobQueue = queue;
+    this->lookAheadBytes = lookAheadBytes;
+  }
+
+  void SndSysDecoder::SetDecodedData (iDataBuffer* decoded)
+  {
+    MutexScopedLock codecLock (codecMutex);
+    MutexScopedLock lock (mutex);
+    decodedData = decoded;
+    decodedPosition = 0;
+    FlushChunks ();
+  }
+
+  size_t SndSysDecoder::Read (char* dest, size_t maxBytes, int* section)
+  {
+    {
+      MutexScopedLock lock (mutex);
+      if (decodedData || !chunks.IsEmpty () || endOfData)
+        return ReadBuffered (dest, maxBytes, section);
+    }
+
+    // Background decoding is not used or fell behind, decode here. This
+    // waits for a chunk the background job is decoding right now.
+    MutexScopedLock codecLock (codecMutex);
+    MutexScopedLock lock (mutex);
+    if (chunks.IsEmpty () && !decodedData && !endOfData)
+    {
+      int chunkSection = 0;
+      csRef<iDataBuffer> buffer = GetSpareBuffer ();
+      size_t size = DecodeChunk (buffer->GetData (), ChunkSize, chunkSection);
+      AddChunk (buffer, size, chunkSection);
+    }
+    return ReadBuffered (dest, maxBytes, section);
+  }
+
+  size_t SndSysDecoder::ReadBuffered (char* dest, size_t maxBytes,
+                                      int* section)
+  {
+    if (decodedData)
+    {
+      size_t bytes = MIN (maxBytes, decodedData->GetSize () - decodedPosition);
+      memcpy (dest, decodedData->GetData () + decodedPosition, bytes);
+      decodedPosition += bytes;
+      if (section) *section = 0;
+      return bytes;
+    }
+
+    if (chunks.IsEmpty ())
+      return 0;
+
+    Chunk& chunk = chunks[0];
+    size_t bytes = MIN (maxBytes, chunk.size - chunk.used);
+    memcpy (dest, chunk.data->GetData () + chunk.used, bytes);
+    chunk.used += bytes;
+    bufferedBytes -= bytes;
+    if (section) *section = chunk.section;
+
+    if (chunk.used == chunk.size)
+    {
+      spareBuffers.Push (chunk.data);
+      chunks.DeleteIndex (0);
+    }
+    return bytes;
+  }
+
+  void SndSysDecoder::Seek (size_t frame)
+  {
+    MutexScopedLock codecLock (codecMutex);
+    MutexScopedLock lock (mutex);
+
+    FlushChunks ();
+    endOfData = false;
+    if (decodedData)
+      decodedPosition = MIN (frame * frameBytes, decodedData->GetSize ());
+    else
+      DecoderSeek (frame);
+  }
+
+  void SndSysDecoder::RequestDecode ()
+  {
+    MutexScopedLock lock (mutex);
+
+    if (!jobQueue || queued || cancelled || endOfData || decodedData
+      || (bufferedBytes >= lookAheadBytes))
+      return;
+    queued = true;
+    jobQueue->Enqueue (this);
+  }
+
+  void SndSysDecoder::Cancel ()
+  {
+    csRef<iJobQueue> queue;
+    {
+      MutexScopedLock lock (mutex);
+      cancelled = true;
+      queue = jobQueue;
+    }
+    // Outside of the lock as a running job may be waiting for it. A queued
+    // job is run right away and returns immediately.
+    if (queue)
+      queue->PullAndRun (this, true);
+  }
+
+  csPtr<iDataBuffer> SndSysDecoder::DecodeAll (size_t maxBytes)
+  {
+    MutexScopedLock codecLock (codecMutex);
+
+    csDirtyAccessArray<char> decoded;
+    int firstSection = -1;
+    while (true)
+    {
+      size_t oldSize = decoded.GetSize ();
+      decoded.SetSize (oldSize + ChunkSize);
+      int section = 0;
+      size_t bytes = DecodeChunk (decoded.GetArray () + oldSize, ChunkSize,
+        section);
+      decoded.SetSize (oldSize + bytes);
+      if (bytes == 0)
+        break;
+
+      // Several logical streams may have different formats
+      if (firstSection == -1)
+        firstSection = section;
+      if ((section != firstSection) || (decoded.GetSize () > maxBytes))
+        return 0;
+    }
+    if (decoded.IsEmpty ())
+      return 0;
+
+    char* data = new char[decoded.GetSize ()];
+    memcpy (data, decoded.GetArray (), decoded.GetSize ());
+    return csPtr<iDataBuffer> (new csDataBuffer (data, decoded.GetSize ()));
+  }
+
+  void SndSysDecoder::Run ()
+  {
+    while (true)
+    {
+      // Only the codec is locked while decoding, so Read() can take
+      // buffered data from the mixer thread in the meantime.
+      MutexScopedLock codecLock (codecMutex);
+      csRef<iDataBuffer> buffer;
+      {
+        MutexScopedLock lock (mutex);
+        if (cancelled || endOfData || decodedData
+          || (bufferedBytes >= lookAheadBytes))
+        {
+          queued = false;
+          return;
+        }
+        buffer = GetSpareBuffer ();
+      }
+
+      int section = 0;
+      size_t size = DecodeChunk (buffer->GetData (), ChunkSize, section);
+
+      MutexScopedLock lock (mutex);
+      AddChunk (buffer, size, section);
+    }
+  }
+
+  csRef<iDataBuffer> SndSysDecoder::GetSpareBuffer ()
+  {
+    csRef<iDataBuffer> buffer;
+    if (spareBuffers.IsEmpty ())
+      buffer.AttachNew (new csDataBuffer (ChunkSize));
+    else
+      buffer = spareBuffers.Pop ();
+    return buffer;
+  }
+
+  void SndSysDecoder::AddChunk (iDataBuffer* buffer, size_t size, int section)
+  {
+    if (size == 0)
+    {
+      spareBuffers.Push (buffer);
+      endOfData = true;
+      return;
+    }
+    Chunk chunk;
+    chunk.data = buffer;
+    chunk.size = size;
+    chunk.used = 0;
+    chunk.section = section;
+    chunks.Push (chunk);
+    bufferedBytes += size;
+  }
+
+  void SndSysDecoder::FlushChunks ()
+  {
+    for (size_t i = 0; i < chunks.GetSize (); i++)
+      spareBuffers.Push (chunks[i].data);
+    chunks.Empty ();
+    bufferedBytes = 0;
+  }
+
+  //-------------------------------------------------------------------------
+
+  /// Job decoding a whole sound into the cache
+  class SndSysDecodedDataCache::DecodeJob :
+    public scfImplementation1<DecodeJob, iJob>
+  {
+    csRef<SndSysDecodedDataCache> cache;
+    // Only used as key, the data may be destroyed while decoding
+    iSndSysData* data;
+    uint64 ticket;
+    csRef<SndSysDecoder> decoder;
+
+  public:
+    DecodeJob (SndSysDecodedDataCache* cache, iSndSysData* data,
+      uint64 ticket, SndSysDecoder* decoder) :
+      scfImplementationType (this), cache (cache), data (data),
+      ticket (ticket), decoder (decoder) {}
+
+    virtual void Run ()
+    {
+      csRef<iDataBuffer> decoded = decoder->DecodeAll (cache->maxSoundBytes);
+      cache->Put (data, ticket, decoded);
+    }
+  };
+
+  SndSysDecodedDataCache::SndSysDecodedDataCache (size_t maxBytes,
+                                                  size_t maxSoundBytes) :
+    scfImplementationType (this), maxBytes (maxBytes),
+    maxSoundBytes (maxSoundBytes), cachedBytes (0), useCounter (0)
+  {
+  }
+
+  SndSysDecodedDataCache::~SndSysDecodedDataCache ()
+  {
+  }
+
+  csPtr<iDataBuffer> SndSysDecodedDataCache::Get (iSndSysData* data, int bits)
+  {
+    MutexScopedLock lock (mutex);
+
+    Entry* entry = entries.GetElementPointer (data);
+    if (!entry || !entry->decoded || (entry->bits != bits))
+      return 0;
+    entry->lastUse = ++useCounter;
+    return csPtr<iDataBuffer> (entry->decoded);
+  }
+
+  void SndSysDecodedDataCache::DecodeInBackground (iJobQueue* queue,
+    iSndSysData* data, int bits, SndSysDecoder* decoder)
+  {
+    uint64 ticket;
+    {
+      MutexScopedLock lock (mutex);
+
+      Entry* entry = entries.GetElementPointer (data);
+      if (entry && (entry->pending || (entry->bits == bits)))
+        return;
+
+      Entry newEntry;
+      newEntry.bits = bits;
+      newEntry.lastUse = ++useCounter;
+      newEntry.pending = true;
+      newEntry.ticket = ticket = newEntry.lastUse;
+      if (entry)
+      {
+        // Cached at a different sample size, replace
+        if (entry->decoded)
+          cachedBytes -= entry->decoded->GetSize ();
+        *entry = newEntry;
+      }
+      else
+        entries.Put (data, newEntry);
+    }
+
+    csRef<iJob> job;
+    job.AttachNew (new DecodeJob (this, data, ticket, decoder));
+    queue->Enqueue (job);
+  }
+
+  void SndSysDecodedDataCache::Put (iSndSysData* data, uint64 ticket,
+                                    iDataBuffer* decoded)
+  {
+    MutexScopedLock lock (mutex);
+
+    Entry* entry = entries.GetElementPointer (data);
+    if (!entry || !entry->pending || (entry->ticket != ticket))
+      return;
+
+    if (!decoded || !IsCacheable (decoded->GetSize ()))
+    {
+      // Keep the failed entry so the sound is not decoded over and over
+      entry->pending = false;
+      return;
+    }
+
+    MakeRoom (decoded->GetSize ());
+    // Dropping other entries may have moved this one
+    entry = entries.GetElementPointer (data);
+    entry->decoded = decoded;
+    entry->lastUse = ++useCounter;
+    entry->pending = false;
+    cachedBytes += decoded->GetSize ();
+  }
+
+  void SndSysDecodedDataCache::Remove (iSndSysData* data)
+  {
+    MutexScopedLock lock (mutex);
+
+    Entry* entry = entries.GetElementPointer (data);
+    if (!entry)
+      return;
+    if (entry->decoded)
+      cachedBytes -= entry->decoded->GetSize ();
+    entries.DeleteAll (data);
+  }
+
+  size_t SndSysDecodedDataCache::GetCachedBytes ()
+  {
+    MutexScopedLock lock (mutex);
+    return cachedBytes;
+  }
+
+  void SndSysDecodedDataCache::MakeRoom (size_t needed)
+  {
+    while (cachedBytes + needed > maxBytes)
+    {
+      iSndSysData* oldest = 0;
+      uint64 oldestUse = 0;
+      EntryHash::GlobalIterator it (entries.GetIterator ());
+      while (it.HasNext ())
+      {
+        csPtrKey<iSndSysData> key;
+        const Entry& entry = it.Next (key);
+        if (!entry.decoded || entry.pending)
+          continue;
+        if (!oldest || (entry.lastUse < oldestUse))
+        {
+          oldest = key;
+          oldestUse = entry.lastUse;
+        }
+      }
+      if (!oldest)
+        break;
+
+      // The sound is decoded again when it's played the next time
+      Entry* entry = entries.GetElementPointer (oldest);
+      cachedBytes -= entry->decoded->GetSize ();
+      entries.DeleteAll (oldest);
+    }
+  }
+
+  //-------------------------------------------------------------------------
+
+  void SndSysDecodeSettings::Load (iObjectRegistry* object_reg)
+  {
+    csConfigAccess config (object_reg, "/config/sound.cfg");
+
+    int aheadMS = config->GetInt ("SndSys.DecodeAhead", 500);
+    if (aheadMS > 0)
+    {
+      lookAheadMS = aheadMS;
+      jobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (1,
+        CS::Threading::THREAD_PRIO_NORMAL));
+    }
+
+    int cacheKB = config->GetInt ("SndSys.DecodeCacheSize", 8192);
+    int soundKB = config->GetInt ("SndSys.DecodeCacheMaxSound", 512);
+    if ((cacheKB > 0) && (soundKB > 0))
+      cache.AttachNew (new SndSysDecodedDataCache (size_t (cacheKB) * 1024,
+        size_t (soundKB) * 1024));
+  }
+
+  void SndSysDecodeSettings::SetupDecoder (SndSysDecoder* decoder,
+                                           size_t bytesPerSecond) const
+  {
+    if (!jobQueue)
+      return;
+    // Keep at least one chunk ahead
+    size_t lookAheadBytes = MAX (bytesPerSecond * lookAheadMS / 1000,
+      SndSysDecoder::ChunkSize);
+    decoder->SetDecodeAhead (jobQueue, lookAheadBytes);
+  }
+
+  }
+}
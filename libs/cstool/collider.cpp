@@ -159,6 +159,182 @@ void csColliderWrapper::UpdateCollider (iTerraFormer* terrain)
 }
 //----------------------------------------------------------------------
 
+csColliderBroadPhase::csColliderBroadPhase (iCollideSystem* colsys)
+{
+  broadPhase = colsys->CreateBroadPhase ();
+}
+
+csColliderBroadPhase::~csColliderBroadPhase ()
+{
+  csHash<csColliderActor*, size_t>::GlobalIterator it = actors.GetIterator ();
+  while (it.HasNext ())
+    it.Next ()->broadPhases.Delete (this);
+}
+
+long csColliderBroadPhase::GetShapeNumber (iMeshWrapper* mesh)
+{
+  iMeshObject* meshobj = mesh->GetMeshObject ();
+  iObjectModel* objmodel = meshobj ? meshobj->GetObjectModel () : 0;
+  return objmodel ? objmodel->GetShapeNumber () : 0;
+}
+
+void csColliderBroadPhase::AddMesh (iMeshWrapper* mesh)
+{
+  if (meshIDs.Contains (mesh)) return;
+  size_t id = broadPhase->AddBox (mesh->GetWorldBoundingBox ());
+  MeshEntry entry;
+  entry.mesh = mesh;
+  entry.updateNumber = mesh->GetMovable ()->GetUpdateNumber ();
+  entry.shapeNumber = GetShapeNumber (mesh);
+  meshes.Put (id, entry);
+  meshIDs.Put (mesh, id);
+}
+
+#include "csutil/deprecated_warn_off.h"
+
+void csColliderBroadPhase::AddMeshes (iEngine* engine,
+    iCollection* collection)
+{
+  int i;
+  iMeshList* meshlist = engine->GetMeshes ();
+  for (i = 0 ; i < meshlist->GetCount () ; i++)
+  {
+    iMeshWrapper* sp = meshlist->Get (i);
+    if (collection && !collection->IsParentOf (sp->QueryObject ())) continue;
+    if (!csColliderWrapper::GetColliderWrapper (sp->QueryObject ())) continue;
+    AddMesh (sp);
+  }
+}
+
+#include "csutil/deprecated_warn_on.h"
+
+void csColliderBroadPhase::RemoveMesh (iMeshWrapper* mesh)
+{
+  size_t id = meshIDs.Get (mesh, csArrayItemNotFound);
+  if (id == csArrayItemNotFound) return;
+  broadPhase->RemoveBox (id);
+  meshes.DeleteAll (id);
+  meshIDs.DeleteAll (mesh);
+}
+
+size_t csColliderBroadPhase::AddActor (csColliderActor* actor,
+    const csBox3& box)
+{
+  size_t id = broadPhase->AddBox (box);
+  actors.Put (id, actor);
+  actorIDs.Put (actor, id);
+  actor->broadPhases.Push (this);
+  return id;
+}
+
+void csColliderBroadPhase::AddActor (csColliderActor* actor)
+{
+  if (actorIDs.Contains (actor)) return;
+  AddActor (actor, csBox3 ());
+}
+
+void csColliderBroadPhase::RemoveActor (csColliderActor* actor)
+{
+  size_t id = actorIDs.Get (actor, csArrayItemNotFound);
+  if (id == csArrayItemNotFound) return;
+  broadPhase->RemoveBox (id);
+  actors.DeleteAll (id);
+  actorIDs.DeleteAll (actor);
+  actor->broadPhases.Delete (this);
+}
+
+void csColliderBroadPhase::UpdateMeshes ()
+{
+  csArray<size_t> dead;
+  csHash<MeshEntry, size_t>::GlobalIterator it = meshes.GetIterator ();
+  while (it.HasNext ())
+  {
+    size_t id;
+    MeshEntry& entry = it.Next (id);
+    if (!entry.mesh)
+    {
+      dead.Push (id);
+      continue;
+    }
+    long updateNumber = entry.mesh->GetMovable ()->GetUpdateNumber ();
+    long shapeNumber = GetShapeNumber (entry.mesh);
+    if ((updateNumber == entry.updateNumber)
+        && (shapeNumber == entry.shapeNumber))
+      continue;
+    entry.updateNumber = updateNumber;
+    entry.shapeNumber = shapeNumber;
+    broadPhase->UpdateBox (id, entry.mesh->GetWorldBoundingBox ());
+  }
+
+  // Destroyed meshes: the weak reference is gone so we can't use
+  // RemoveMesh() here.
+  for (size_t i = 0 ; i < dead.GetSize () ; i++)
+  {
+    broadPhase->RemoveBox (dead[i]);
+    meshes.DeleteAll (dead[i]);
+  }
+  if (dead.GetSize () > 0)
+  {
+    csHash<size_t, csPtrKey<iMeshWrapper> >::GlobalIterator idIt =
+      meshIDs.GetIterator ();
+    while (idIt.HasNext ())
+    {
+      size_t id = idIt.Next ();
+      if (!meshes.Contains (id)) meshIDs.DeleteElement (idIt);
+    }
+  }
+}
+
+size_t csColliderBroadPhase::UpdateActor (csColliderActor* actor,
+    const csBox3& box)
+{
+  size_t id = actorIDs.Get (actor, csArrayItemNotFound);
+  if (id == csArrayItemNotFound)
+    return AddActor (actor, box);
+  broadPhase->UpdateBox (id, box);
+  return id;
+}
+
+void csColliderBroadPhase::GetCandidates (size_t num_actors,
+    const size_t* actorIDs, csArray<csArray<iMeshWrapper*> >& candidates)
+{
+  // Map broad phase ID's of the actors we're interested in to their
+  // index in 'candidates'.
+  csHash<size_t, size_t> actorIndex;
+  candidates.Empty ();
+  candidates.SetSize (num_actors);
+  for (size_t i = 0 ; i < num_actors ; i++)
+    actorIndex.Put (actorIDs[i], i);
+
+  const csArray<csBroadPhasePair>& pairs = broadPhase->GetOverlappingPairs ();
+  for (size_t p = 0 ; p < pairs.GetSize () ; p++)
+  {
+    const csBroadPhasePair& pair = pairs[p];
+    for (int side = 0 ; side < 2 ; side++)
+    {
+      size_t self = side ? pair.id1 : pair.id0;
+      size_t other = side ? pair.id0 : pair.id1;
+      size_t idx = actorIndex.Get (self, csArrayItemNotFound);
+      if (idx == csArrayItemNotFound) continue;
+
+      iMeshWrapper* mesh = 0;
+      const MeshEntry* entry = meshes.GetElementPointer (other);
+      if (entry)
+        mesh = entry->mesh;
+      else
+      {
+        // Another actor: we can only hit its mesh.
+        csColliderActor* const* otherActor = actors.GetElementPointer (other);
+        if (otherActor) mesh = (*otherActor)->GetMesh ();
+      }
+      if (mesh && candidates[idx].Find (mesh) == csArrayItemNotFound)
+        candidates[idx].Push (mesh);
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+
 csColliderWrapper* csColliderHelper::InitializeCollisionWrapper (
   iCollideSystem* colsys, iMeshWrapper* mesh)
 {
@@ -594,6 +770,56 @@ float csColliderHelper::TraceBeam (iCollideSystem* cdsys, iSector* sector,
   else
     return -1.0f;
 }
+size_t csColliderHelper::MoveActors (csColliderBroadPhase& broadphase,
+    size_t num_actors, csColliderActor** actors,
+    float delta, float speed,
+    const csVector3* velBody, const csVector3* angularVelocity)
+{
+  broadphase.UpdateMeshes ();
+
+  CS_ALLOC_STACK_ARRAY(size_t, actorIDs, num_actors);
+  for (size_t i = 0 ; i < num_actors ; i++)
+    actorIDs[i] = broadphase.UpdateActor (actors[i],
+      actors[i]->GetMoveBoundingBox (delta, speed, velBody[i]));
+
+  csArray<csArray<iMeshWrapper*> > candidates;
+  broadphase.GetCandidates (num_actors, actorIDs, candidates);
+
+  size_t moved = 0;
+  for (size_t i = 0 ; i < num_actors ; i++)
+  {
+    csColliderActor* actor = actors[i];
+    iSector* sector = actor->GetSector ();
+
+    // Only keep candidates in our sector. If there is a portal nearby
+    // the actor can cross into another sector and the engine has to
+    // decide which meshes are really near.
+    csArray<iMeshWrapper*>& cand = candidates[i];
+    bool usePortals = false;
+    size_t j = 0;
+    while (j < cand.GetSize ())
+    {
+      iMeshWrapper* m = cand[j];
+      if (m->GetPortalContainer ())
+      {
+        usePortals = true;
+        break;
+      }
+      if (m == actor->GetMesh ()
+          || m->GetMovable ()->GetSectors ()->Find (sector) < 0)
+        cand.DeleteIndexFast (j);
+      else
+        j++;
+    }
+
+    actor->candidateMeshes = usePortals ? 0 : &cand;
+    if (actor->Move (delta, speed, velBody[i], angularVelocity[i]))
+      moved++;
+    actor->candidateMeshes = 0;
+  }
+  return moved;
+}
+
 //----------------------------------------------------------------------
 
 csColliderActor::csColliderActor ()
@@ -608,11 +834,20 @@ csColliderActor::csColliderActor ()
   camera = 0;
   movable = 0;
   do_hit_meshes = false;
+  candidateMeshes = 0;
 
   // Only used in case a camera is used.
   rotation.Set (0, 0, 0);
 }
 
+csColliderActor::~csColliderActor ()
+{
+  // RemoveActor() takes the broad phase out of our list.
+  csArray<csColliderBroadPhase*> registered (broadPhases);
+  for (size_t i = 0 ; i < registered.GetSize () ; i++)
+    registered[i]->RemoveActor (this);
+}
+
 void csColliderActor::InitializeColliders (
   const csVector3& legs, const csVector3& body, const csVector3& shift)
 {
@@ -751,22 +986,33 @@ int csColliderActor::CollisionDetect (
 
   csCollisionPair* CD_contact;
 
-  csRef<iMeshWrapperIterator> objectIter = engine->GetNearbyMeshes (sector,
-      playerBoxStart + playerBoxEnd,
-      true);
+  csBox3 playerBox = playerBoxStart + playerBoxEnd;
+  csArray<iMeshWrapper*> nearbyMeshes;
+  if (!candidateMeshes)
+  {
+    csRef<iMeshWrapperIterator> objectIter = engine->GetNearbyMeshes (sector,
+        playerBox, true);
+    while (objectIter->HasNext ())
+      nearbyMeshes.Push (objectIter->Next ());
+  }
+  const csArray<iMeshWrapper*>& meshes = candidateMeshes
+    ? *candidateMeshes : nearbyMeshes;
 
   // Check if any portal mesh is close to the player object.
-  while (objectIter->HasNext () && !checkSectors)
+  for (size_t m = 0 ; m < meshes.GetSize () && !checkSectors ; m++)
   {
-    iMeshWrapper* meshwrap = objectIter->Next();
-    if (meshwrap->GetPortalContainer())
+    if (meshes[m]->GetPortalContainer())
       checkSectors = true;
   }
-  objectIter->Reset();
 
-  while (objectIter->HasNext ())
+  for (size_t m = 0 ; m < meshes.GetSize () ; m++)
   {
-    iMeshWrapper* meshWrapper = objectIter->Next ();
+    iMeshWrapper* meshWrapper = meshes[m];
+    // The broad phase candidates were found for the whole move, only
+    // test those that are near to this step.
+    if (candidateMeshes
+        && !meshWrapper->GetWorldBoundingBox ().Overlap (playerBox))
+      continue;
 
     iMovable* meshMovable = meshWrapper->GetMovable ();
     // Avoid hitting the mesh from this entity itself.
@@ -1589,3 +1835,38 @@ bool csColliderActor::Move (float delta, float speed, const csVector3& velBody,
 }
 
 
+
+iSector* csColliderActor::GetSector () const
+{
+  if (movable)
+  {
+    iSectorList* sectors = movable->GetSectors ();
+    return sectors->GetCount () > 0 ? sectors->Get (0) : 0;
+  }
+  return camera ? camera->GetSector () : 0;
+}
+
+csBox3 csColliderActor::GetMoveBoundingBox (float delta, float speed,
+  const csVector3& velBody) const
+{
+  // Same cap as in Move().
+  if (delta > .3f) delta = .3f;
+  float time = delta * speed;
+
+  csVector3 pos;
+  if (movable)
+    pos = movable->GetFullTransform ().GetOrigin ();
+  else
+    pos = camera->GetTransform ().GetOrigin ();
+
+  // Upper bound of the distance we can travel: body velocity plus world
+  // velocity plus what gravity can add during this move. Also allow for
+  // stepping up by the size of the legs.
+  float travel = (velBody.Norm () + velWorld.Norm () + gravity * time) * time
+    + bottomSize.y + EPSILON;
+
+  csBox3 box = boundingBox;
+  box.SetCenter (pos + boundingBox.GetCenter ());
+  return csBox3 (box.Min () - csVector3 (travel),
+    box.Max () + csVector3 (travel));
+}
@@ -0,0 +1,641 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include <stdarg.h>
+
+#include "cstool/compiledworld.h"
+#include "csgfx/shadervar.h"
+#include "csgeom/tri.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/hash.h"
+#include "csutil/memfile.h"
+#include "iengine/campos.h"
+#include "iengine/collection.h"
+#include "iengine/engine.h"
+#include "iengine/light.h"
+#include "iengine/material.h"
+#include "iengine/mesh.h"
+#include "iengine/movable.h"
+#include "iengine/scenenode.h"
+#include "iengine/sector.h"
+#include "iengine/texture.h"
+#include "imesh/genmesh.h"
+#include "imesh/object.h"
+#include "iutil/databuff.h"
+#include "iutil/object.h"
+#include "iutil/objreg.h"
+#include "iutil/strset.h"
+#include "ivaria/reporter.h"
+#include "ivideo/material.h"
+#include "ivideo/rndbuf.h"
+#include "ivideo/shader/shader.h"
+#include "ivideo/texture.h"
+
+namespace CS
+{
+  namespace Utility
+  {
+    namespace CompiledWorld
+    {
+      bool IsCompiledWorld (iDataBuffer* data)
+      {
+        if (!data || (data->GetSize () < sizeof (Header))) return false;
+        const Header* header = (const Header*)data->GetData ();
+        return header->magic == magic;
+      }
+
+      namespace
+      {
+        /// Writes the objects of an engine to records
+        class Compiler
+        {
+          iObjectRegistry* objectReg;
+          iEngine* engine;
+          iCollection* collection;
+          csRef<iStringSet> strings;
+          csRef<iShaderVarStringSet> svStrings;
+
+          csDirtyAccessArray<char> stringData;
+          csHash<uint32, csString> stringOffsets;
+
+          csMemFile records;
+          uint32 numRecords;
+          /// Data of the record currently being written
+          csDirtyAccessArray<uint32> record;
+
+          csHash<uint32, csPtrKey<iShader> > shaders;
+          csHash<uint32, csPtrKey<iTextureWrapper> > textures;
+          csHash<uint32, csPtrKey<iMaterialWrapper> > materials;
+          csHash<uint32, csPtrKey<iMeshFactoryWrapper> > factories;
+          csHash<uint32, csPtrKey<iSector> > sectors;
+
+          void Warn (const char* msg, ...) CS_GNUC_PRINTF (2, 3)
+          {
+            va_list args;
+            va_start (args, msg);
+            csReportV (objectReg, CS_REPORTER_SEVERITY_WARNING,
+              "crystalspace.compiledworld", msg, args);
+            va_end (args);
+          }
+
+          bool Contains (iObject* obj)
+          {
+            return !collection || collection->IsParentOf (obj);
+          }
+
+          template<typename T>
+          static uint32 Find (const csHash<uint32, csPtrKey<T> >& hash,
+                              T* obj)
+          {
+            return obj ? hash.Get (obj, none) : none;
+          }
+
+          uint32 AddString (const char* str)
+          {
+            if (!str) return none;
+            uint32 offset = stringOffsets.Get (str, none);
+            if (offset == none)
+            {
+              offset = uint32 (stringData.GetSize ());
+              size_t len = strlen (str) + 1;
+              stringData.SetSize (offset + len);
+              memcpy (stringData.GetArray () + offset, str, len);
+              stringOffsets.Put (str, offset);
+            }
+            return offset;
+          }
+
+          void Append (const void* data, size_t size)
+          {
+            size_t pos = record.GetSize ();
+            record.SetSize (pos + (size + 3) / 4, 0);
+            memcpy (record.GetArray () + pos, data, size);
+          }
+          template<typename T>
+          void Append (const T& data) { Append (&data, sizeof (T)); }
+
+          void WriteRecord (RecordType type)
+          {
+            RecordHeader header;
+            header.type = type;
+            header.size = uint32 (record.GetSize () * sizeof (uint32));
+            records.Write ((const char*)&header, sizeof (header));
+            records.Write ((const char*)record.GetArray (), header.size);
+            record.Empty ();
+            numRecords++;
+          }
+
+          static void SetTransform (Transform& dest,
+                                    const csReversibleTransform& tf)
+          {
+            const csMatrix3& m = tf.GetO2T ();
+            const float matrix[9] = { m.m11, m.m12, m.m13, m.m21, m.m22,
+              m.m23, m.m31, m.m32, m.m33 };
+            memcpy (dest.matrix, matrix, sizeof (matrix));
+            const csVector3& o = tf.GetOrigin ();
+            dest.origin[0] = o.x;
+            dest.origin[1] = o.y;
+            dest.origin[2] = o.z;
+          }
+
+          uint32 AddPriority (long priority)
+          {
+            return AddString (engine->GetRenderPriorityName (priority));
+          }
+
+          void WriteShaders ();
+          void WriteTextures ();
+          void WriteMaterials ();
+          bool WriteSubMesh (iGeneralMeshSubMesh* submesh);
+          void WriteFactories ();
+          void WriteSectors ();
+          void WriteMeshes ();
+          void WriteLights ();
+          void WriteStarts ();
+        public:
+          Compiler (iObjectRegistry* objectReg, iEngine* engine,
+            iCollection* collection);
+
+          csPtr<iDataBuffer> Compile ();
+        };
+
+        Compiler::Compiler (iObjectRegistry* objectReg, iEngine* engine,
+                            iCollection* collection)
+          : objectReg (objectReg), engine (engine), collection (collection),
+            numRecords (0)
+        {
+          strings = csQueryRegistryTagInterface<iStringSet> (objectReg,
+            "crystalspace.shared.stringset");
+          svStrings = csQueryRegistryTagInterface<iShaderVarStringSet> (
+            objectReg, "crystalspace.shader.variablenameset");
+        }
+
+        void Compiler::WriteShaders ()
+        {
+          // Only the shaders used by materials are of interest
+          iMaterialList* list = engine->GetMaterialList ();
+          uint32 numShaders = 0;
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iMaterialWrapper* mat = list->Get (i);
+            if (!Contains (mat->QueryObject ())) continue;
+            csHash<csRef<iShader>, csStringID>::ConstGlobalIterator it (
+              mat->GetMaterial ()->GetShaders ().GetIterator ());
+            while (it.HasNext ())
+            {
+              iShader* shader = it.Next ();
+              if (shaders.Contains (shader)) continue;
+              const char* file = shader->GetFileName ();
+              if (!file || !*file)
+              {
+                Warn ("Shader '%s' was not loaded from a file, skipping",
+                  shader->QueryObject ()->GetName ());
+                shaders.Put (shader, none);
+                continue;
+              }
+              Shader data;
+              data.name = AddString (shader->QueryObject ()->GetName ());
+              data.file = AddString (file);
+              Append (data);
+              WriteRecord (recShader);
+              shaders.Put (shader, numShaders++);
+            }
+          }
+        }
+
+        void Compiler::WriteTextures ()
+        {
+          iTextureList* list = engine->GetTextureList ();
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iTextureWrapper* tex = list->Get (i);
+            if (!Contains (tex->QueryObject ())) continue;
+            const char* name = tex->QueryObject ()->GetName ();
+            iTextureHandle* handle = tex->GetTextureHandle ();
+            const char* file = handle ? handle->GetImageName () : 0;
+            if (!handle
+              || (handle->GetTextureType () != iTextureHandle::texType2D)
+              || !file || !*file)
+            {
+              Warn ("Texture '%s' is not a 2D texture loaded from a file, "
+                "skipping", name);
+              continue;
+            }
+            const char* texClass = tex->GetTextureClass ();
+            if (texClass && (strcmp (texClass, "default") != 0))
+              Warn ("Texture class '%s' of texture '%s' is not stored",
+                texClass, name);
+
+            Texture data;
+            data.name = AddString (name);
+            data.file = AddString (file);
+            data.flags = tex->GetFlags ();
+            Append (data);
+            WriteRecord (recTexture);
+            textures.Put (tex, uint32 (textures.GetSize ()));
+          }
+        }
+
+        void Compiler::WriteMaterials ()
+        {
+          iMaterialList* list = engine->GetMaterialList ();
+          csDirtyAccessArray<MaterialShader> matShaders;
+          csDirtyAccessArray<ShaderVariable> matVars;
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iMaterialWrapper* mat = list->Get (i);
+            if (!Contains (mat->QueryObject ())) continue;
+            const char* name = mat->QueryObject ()->GetName ();
+            iMaterial* material = mat->GetMaterial ();
+
+            matShaders.Empty ();
+            csHash<csRef<iShader>, csStringID>::ConstGlobalIterator it (
+              material->GetShaders ().GetIterator ());
+            while (it.HasNext ())
+            {
+              csStringID type;
+              iShader* shader = it.Next (type);
+              uint32 index = Find (shaders, shader);
+              if (index == none) continue;
+              MaterialShader& data = matShaders.GetExtend (
+                matShaders.GetSize ());
+              data.type = AddString (strings->Request (type));
+              data.shader = index;
+            }
+
+            matVars.Empty ();
+            const csRefArray<csShaderVariable>& vars =
+              material->GetShaderVariables ();
+            for (size_t v = 0; v < vars.GetSize (); v++)
+            {
+              csShaderVariable* var = vars[v];
+              const char* varName = svStrings->Request (var->GetName ());
+              ShaderVariable data;
+              memset (&data, 0, sizeof (data));
+              data.name = AddString (varName);
+              data.type = var->GetType ();
+              data.texture = none;
+              switch (var->GetType ())
+              {
+                case csShaderVariable::INT:
+                  {
+                    int value;
+                    var->GetValue (value);
+                    data.texture = uint32 (value);
+                  }
+                  break;
+                case csShaderVariable::FLOAT:
+                  var->GetValue (data.value[0]);
+                  break;
+                case csShaderVariable::VECTOR2:
+                case csShaderVariable::VECTOR3:
+                case csShaderVariable::VECTOR4:
+                  {
+                    csVector4 value;
+                    var->GetValue (value);
+                    data.value[0] = value.x;
+                    data.value[1] = value.y;
+                    data.value[2] = value.z;
+                    data.value[3] = value.w;
+                  }
+                  break;
+                case csShaderVariable::TEXTURE:
+                  {
+                    iTextureWrapper* tex = 0;
+                    var->GetValue (tex);
+                    data.texture = Find (textures, tex);
+                    if (data.texture == none)
+                    {
+                      Warn ("Texture of variable '%s' of material '%s' "
+                        "is not stored, skipping", varName, name);
+                      continue;
+                    }
+                  }
+                  break;
+                default:
+                  Warn ("Type of variable '%s' of material '%s' is not "
+                    "supported, skipping", varName, name);
+                  continue;
+              }
+              matVars.Push (data);
+            }
+
+            Material data;
+            data.name = AddString (name);
+            data.numShaders = uint32 (matShaders.GetSize ());
+            data.numVariables = uint32 (matVars.GetSize ());
+            Append (data);
+            Append (matShaders.GetArray (),
+              matShaders.GetSize () * sizeof (MaterialShader));
+            Append (matVars.GetArray (),
+              matVars.GetSize () * sizeof (ShaderVariable));
+            WriteRecord (recMaterial);
+            materials.Put (mat, uint32 (materials.GetSize ()));
+          }
+        }
+
+        /**
+         * Whether the factory has a buffer for all its vertices. The
+         * GetTexels() style accessors are not used for this as they never
+         * return null and create missing arrays.
+         */
+        static bool HasVertexBuffer (iGeneralFactoryState* state,
+                                     csRenderBufferName name,
+                                     uint32 numVertices)
+        {
+          iRenderBuffer* buffer = state->GetRenderBuffer (name);
+          return buffer && (buffer->GetElementCount () >= numVertices);
+        }
+
+        bool Compiler::WriteSubMesh (iGeneralMeshSubMesh* submesh)
+        {
+          iRenderBuffer* indices = submesh->GetIndices ();
+          csRenderBufferComponentType compType =
+            indices->GetComponentType ();
+          if ((compType != CS_BUFCOMP_UNSIGNED_INT)
+            && (compType != CS_BUFCOMP_UNSIGNED_SHORT))
+            return false;
+
+          SubMesh data;
+          data.name = AddString (submesh->GetName ());
+          data.material = Find (materials, submesh->GetMaterial ());
+          data.mixmode = submesh->GetMixmode ();
+          data.numIndices = uint32 (indices->GetElementCount ());
+          data.minIndex = uint32 (indices->GetRangeStart ());
+          data.maxIndex = uint32 (indices->GetRangeEnd ());
+          Append (data);
+
+          const void* src = indices->Lock (CS_BUF_LOCK_READ);
+          if (compType == CS_BUFCOMP_UNSIGNED_INT)
+            Append (src, data.numIndices * sizeof (uint32));
+          else
+          {
+            const uint16* src16 = (const uint16*)src;
+            for (uint32 i = 0; i < data.numIndices; i++)
+              Append (uint32 (src16[i]));
+          }
+          indices->Release ();
+          return true;
+        }
+
+        void Compiler::WriteFactories ()
+        {
+          iMeshFactoryList* list = engine->GetMeshFactories ();
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iMeshFactoryWrapper* fact = list->Get (i);
+            if (!Contains (fact->QueryObject ())) continue;
+            const char* name = fact->QueryObject ()->GetName ();
+            iMeshObjectFactory* objFact = fact->GetMeshObjectFactory ();
+            csRef<iGeneralFactoryState> state =
+              scfQueryInterfaceSafe<iGeneralFactoryState> (objFact);
+            if (!state || state->GetAnimationControlFactory ())
+            {
+              Warn ("Factory '%s' is not a static genmesh factory, skipping",
+                name);
+              continue;
+            }
+
+            Factory data;
+            data.name = AddString (name);
+            data.material = Find (materials, objFact->GetMaterialWrapper ());
+            data.mixmode = objFact->GetMixMode ();
+            data.renderPriority = AddPriority (fact->GetRenderPriority ());
+            data.zbufMode = fact->GetZBufMode ();
+            data.flags = 0;
+            const csFlags& meshFlags = fact->GetFlags ();
+            if (!meshFlags.Check (CS_ENTITY_NOLIGHTING))
+              data.flags |= factLighting;
+            if (!meshFlags.Check (CS_ENTITY_NOSHADOWCAST))
+              data.flags |= factShadowCasting;
+            if (!meshFlags.Check (CS_ENTITY_NOSHADOWRECEIVE))
+              data.flags |= factShadowReceiving;
+            if (state->IsManualColors ()) data.flags |= factManualColors;
+            if (state->IsBack2Front ()) data.flags |= factBack2Front;
+            data.numVertices = uint32 (state->GetVertexCount ());
+            if (HasVertexBuffer (state, CS_BUFFER_TEXCOORD0, data.numVertices))
+              data.flags |= factHasTexels;
+            if (HasVertexBuffer (state, CS_BUFFER_NORMAL, data.numVertices))
+              data.flags |= factHasNormals;
+            if (HasVertexBuffer (state, CS_BUFFER_COLOR, data.numVertices))
+              data.flags |= factHasColors;
+            data.numTriangles = uint32 (state->GetTriangleCount ());
+            data.numSubMeshes = uint32 (state->GetSubMeshCount ());
+            Append (data);
+
+            Append (state->GetVertices (),
+              data.numVertices * sizeof (csVector3));
+            if (data.flags & factHasTexels)
+              Append (state->GetTexels (),
+                data.numVertices * sizeof (csVector2));
+            if (data.flags & factHasNormals)
+              Append (state->GetNormals (),
+                data.numVertices * sizeof (csVector3));
+            if (data.flags & factHasColors)
+              Append (state->GetColors (),
+                data.numVertices * sizeof (csColor4));
+            Append (state->GetTriangles (),
+              data.numTriangles * sizeof (csTriangle));
+
+            bool submeshesOk = true;
+            for (uint32 s = 0; s < data.numSubMeshes; s++)
+              submeshesOk &= WriteSubMesh (state->GetSubMesh (s));
+            if (!submeshesOk)
+            {
+              Warn ("Factory '%s' has unsupported index buffers, skipping",
+                name);
+              record.Empty ();
+              continue;
+            }
+
+            WriteRecord (recFactory);
+            factories.Put (fact, uint32 (factories.GetSize ()));
+          }
+        }
+
+        void Compiler::WriteSectors ()
+        {
+          iSectorList* list = engine->GetSectors ();
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iSector* sector = list->Get (i);
+            if (!Contains (sector->QueryObject ())) continue;
+            Sector data;
+            data.name = AddString (sector->QueryObject ()->GetName ());
+            Append (data);
+            WriteRecord (recSector);
+            sectors.Put (sector, uint32 (sectors.GetSize ()));
+          }
+        }
+
+        void Compiler::WriteMeshes ()
+        {
+          iMeshList* list = engine->GetMeshes ();
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iMeshWrapper* mesh = list->Get (i);
+            if (!Contains (mesh->QueryObject ())) continue;
+            const char* name = mesh->QueryObject ()->GetName ();
+            iMeshFactoryWrapper* fact = mesh->GetFactory ();
+            uint32 factIndex = Find (factories, fact);
+            if (factIndex == none)
+            {
+              Warn ("Factory of mesh '%s' is not stored, skipping", name);
+              continue;
+            }
+            iMovable* movable = mesh->GetMovable ();
+            iSectorList* meshSectors = movable->GetSectors ();
+            if (mesh->QuerySceneNode ()->GetParent ()
+              || (meshSectors->GetCount () != 1))
+            {
+              Warn ("Mesh '%s' is not in exactly one sector, skipping", name);
+              continue;
+            }
+
+            Mesh data;
+            data.name = AddString (name);
+            data.factory = factIndex;
+            data.sector = Find (sectors, meshSectors->Get (0));
+            iMaterialWrapper* mat = mesh->GetMeshObject ()->GetMaterialWrapper ();
+            data.material =
+              (mat != fact->GetMeshObjectFactory ()->GetMaterialWrapper ())
+              ? Find (materials, mat) : none;
+            data.renderPriority = AddPriority (mesh->GetRenderPriority ());
+            data.zbufMode = mesh->GetZBufMode ();
+            data.flags = mesh->GetFlags ().Get ();
+            data.objectFlags = mesh->GetMeshObject ()->GetFlags ().Get ();
+            SetTransform (data.transform, movable->GetTransform ());
+            Append (data);
+            WriteRecord (recMesh);
+          }
+        }
+
+        void Compiler::WriteLights ()
+        {
+          iSectorList* list = engine->GetSectors ();
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iSector* sector = list->Get (i);
+            uint32 sectorIndex = Find (sectors, sector);
+            if (sectorIndex == none) continue;
+            iLightList* lights = sector->GetLights ();
+            for (int l = 0; l < lights->GetCount (); l++)
+            {
+              iLight* light = lights->Get (l);
+              if (!Contains (light->QueryObject ())) continue;
+              if (light->QuerySceneNode ()->GetParent ())
+              {
+                Warn ("Light '%s' is attached to a mesh, skipping",
+                  light->QueryObject ()->GetName ());
+                continue;
+              }
+
+              Light data;
+              data.name = AddString (light->QueryObject ()->GetName ());
+              data.sector = sectorIndex;
+              data.type = light->GetType ();
+              data.dynamicType = light->GetDynamicType ();
+              data.attenuationMode = light->GetAttenuationMode ();
+              data.flags = light->GetFlags ().Get ();
+              const csColor& color = light->GetColor ();
+              data.color[0] = color.red;
+              data.color[1] = color.green;
+              data.color[2] = color.blue;
+              data.cutoffDistance = light->GetCutoffDistance ();
+              const csVector4& atten = light->GetAttenuationConstants ();
+              data.attenuation[0] = atten.x;
+              data.attenuation[1] = atten.y;
+              data.attenuation[2] = atten.z;
+              data.attenuation[3] = atten.w;
+              light->GetSpotLightFalloff (data.spotInner, data.spotOuter);
+              SetTransform (data.transform,
+                light->GetMovable ()->GetTransform ());
+              Append (data);
+              WriteRecord (recLight);
+            }
+          }
+        }
+
+        void Compiler::WriteStarts ()
+        {
+          iCameraPositionList* list = engine->GetCameraPositions ();
+          for (int i = 0; i < list->GetCount (); i++)
+          {
+            iCameraPosition* campos = list->Get (i);
+            if (!Contains (campos->QueryObject ())) continue;
+            Start data;
+            data.name = AddString (campos->QueryObject ()->GetName ());
+            data.sector = AddString (campos->GetSector ());
+            const csVector3& pos = campos->GetPosition ();
+            const csVector3& forward = campos->GetForwardVector ();
+            const csVector3& up = campos->GetUpwardVector ();
+            for (int c = 0; c < 3; c++)
+            {
+              data.position[c] = pos[c];
+              data.forward[c] = forward[c];
+              data.up[c] = up[c];
+            }
+            Append (data);
+            WriteRecord (recStart);
+          }
+        }
+
+        csPtr<iDataBuffer> Compiler::Compile ()
+        {
+          // Referenced objects are always written before their users
+          WriteTextures ();
+          WriteShaders ();
+          WriteMaterials ();
+          WriteFactories ();
+          WriteSectors ();
+          WriteMeshes ();
+          WriteLights ();
+          WriteStarts ();
+
+          csMemFile file;
+          Header header;
+          header.magic = magic;
+          header.byteOrder = byteOrder;
+          header.version = version;
+          header.numRecords = numRecords + 1;
+          file.Write ((const char*)&header, sizeof (header));
+
+          Append (stringData.GetArray (), stringData.GetSize ());
+          RecordHeader stringsHeader;
+          stringsHeader.type = recStrings;
+          stringsHeader.size = uint32 (record.GetSize () * sizeof (uint32));
+          file.Write ((const char*)&stringsHeader, sizeof (stringsHeader));
+          file.Write ((const char*)record.GetArray (), stringsHeader.size);
+          record.Empty ();
+
+          csRef<iDataBuffer> recordData = records.GetAllData ();
+          file.Write (recordData->GetData (), recordData->GetSize ());
+          return file.GetAllData ();
+        }
+      } // anonymous namespace
+
+      csPtr<iDataBuffer> Compile (iObjectRegistry* objectReg,
+                                  iEngine* engine, iCollection* collection)
+      {
+        Compiler compiler (objectReg, engine, collection);
+        return compiler.Compile ();
+      }
+    } // namespace CompiledWorld
+  } // namespace Utility
+} // namespace CS
@@ -0,0 +1,406 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csgeom/box.h"
+#include "csgeom/sphere.h"
+#include "csgeom/transfrm.h"
+#include "cstool/collider.h"
+#include "cstool/meshobjtmpl.h"
+#include "csutil/flags.h"
+#include "iengine/mesh.h"
+#include "iengine/movable.h"
+#include "ivaria/collider.h"
+
+namespace
+{
+  /// Broad phase that simply tests all pairs of boxes.
+  class TestBroadPhase :
+    public scfImplementation1<TestBroadPhase, iCollisionBroadPhase>
+  {
+    csArray<csBox3> boxes;
+    csArray<bool> used;
+    csArray<csBroadPhasePair> pairs;
+  public:
+    TestBroadPhase () : scfImplementationType (this) {}
+
+    virtual size_t AddBox (const csBox3& box)
+    {
+      size_t id = used.Find (false);
+      if (id == csArrayItemNotFound)
+      {
+        id = boxes.Push (box);
+        used.Push (true);
+      }
+      else
+      {
+        boxes[id] = box;
+        used[id] = true;
+      }
+      return id;
+    }
+    virtual void UpdateBox (size_t id, const csBox3& box) { boxes[id] = box; }
+    virtual void RemoveBox (size_t id) { used[id] = false; }
+    virtual size_t GetBoxCount () const
+    {
+      size_t count = 0;
+      for (size_t i = 0 ; i < used.GetSize () ; i++)
+        if (used[i]) count++;
+      return count;
+    }
+    virtual const csArray<csBroadPhasePair>& GetOverlappingPairs ()
+    {
+      pairs.Empty ();
+      for (size_t i = 0 ; i < boxes.GetSize () ; i++)
+        for (size_t j = i + 1 ; j < boxes.GetSize () ; j++)
+        {
+          if (!used[i] || !used[j] || !boxes[i].TestIntersect (boxes[j]))
+            continue;
+          csBroadPhasePair pair;
+          pair.id0 = i;
+          pair.id1 = j;
+          pairs.Push (pair);
+        }
+      return pairs;
+    }
+  };
+
+  /// Collide system that only creates broad phases.
+  class TestCollideSystem :
+    public scfImplementation1<TestCollideSystem, iCollideSystem>
+  {
+    csArray<csIntersectingTriangle> triangles;
+  public:
+    TestCollideSystem () : scfImplementationType (this) {}
+
+    virtual csStringID GetTriangleDataID () { return csStringID (); }
+    virtual csStringID GetBaseDataID () { return csStringID (); }
+    virtual csPtr<iCollider> CreateCollider (iTriangleMesh*) { return 0; }
+    virtual csPtr<iCollider> CreateCollider (iTerraFormer*) { return 0; }
+    virtual csPtr<iCollider> CreateCollider (iTerrainSystem*) { return 0; }
+    virtual bool Collide (iCollider*, const csReversibleTransform*,
+      iCollider*, const csReversibleTransform*) { return false; }
+    virtual csCollisionPair* GetCollisionPairs () { return 0; }
+    virtual size_t GetCollisionPairCount () { return 0; }
+    virtual void ResetCollisionPairs () { }
+    virtual bool CollideRay (iCollider*, const csReversibleTransform*,
+      const csVector3&, const csVector3&) { return false; }
+    virtual bool CollideSegment (iCollider*, const csReversibleTransform*,
+      const csVector3&, const csVector3&) { return false; }
+    virtual const csArray<csIntersectingTriangle>& GetIntersectingTriangles ()
+      const { return triangles; }
+    virtual void SetOneHitOnly (bool) { }
+    virtual bool GetOneHitOnly () { return false; }
+    virtual csPtr<iCollisionBroadPhase> CreateBroadPhase ()
+    { return new TestBroadPhase; }
+  };
+
+  class TestMovable : public scfImplementation1<TestMovable, iMovable>
+  {
+    csReversibleTransform transform;
+    long updateNumber;
+  public:
+    TestMovable () : scfImplementationType (this), updateNumber (0) {}
+
+    virtual iSceneNode* GetSceneNode () { return 0; }
+    virtual void SetSector (iSector*) { }
+    virtual void ClearSectors () { }
+    virtual iSectorList* GetSectors () { return 0; }
+    virtual bool InSector () const { return false; }
+    virtual void SetPosition (iSector*, const csVector3&) { }
+    virtual void SetPosition (const csVector3& v) { transform.SetOrigin (v); }
+    virtual const csVector3& GetPosition () const
+    { return transform.GetOrigin (); }
+    virtual const csVector3 GetFullPosition () const
+    { return transform.GetOrigin (); }
+    virtual void SetTransform (const csMatrix3&) { }
+    virtual void SetTransform (const csReversibleTransform&) { }
+    virtual csReversibleTransform& GetTransform () { return transform; }
+    virtual csReversibleTransform GetFullTransform () const
+    { return transform; }
+    virtual void MovePosition (const csVector3&) { }
+    virtual void Transform (const csMatrix3&) { }
+    virtual void AddListener (iMovableListener*) { }
+    virtual void RemoveListener (iMovableListener*) { }
+    virtual void UpdateMove () { updateNumber++; }
+    virtual long GetUpdateNumber () const { return updateNumber; }
+    virtual bool IsTransformIdentity () const { return false; }
+    virtual bool IsFullTransformIdentity () const { return false; }
+    virtual void TransformIdentity () { }
+  };
+
+  class TestMeshObject : public csMeshObject
+  {
+  public:
+    TestMeshObject () : csMeshObject (0) {}
+
+    /// Change the object space box and bump the shape number.
+    void SetShape (const csBox3& box)
+    {
+      boundingbox = box;
+      ShapeChanged ();
+    }
+
+    virtual iMeshObjectFactory* GetFactory () const { return 0; }
+    virtual bool HitBeamObject (const csVector3&, const csVector3&,
+      csVector3&, float*, int*, iMaterialWrapper**,
+      csArray<iMaterialWrapper*>*) { return false; }
+  };
+
+  /// Mesh with a box shaped object at the position of its movable.
+  class TestMesh : public scfImplementation1<TestMesh, iMeshWrapper>
+  {
+    csRef<TestMovable> movable;
+    csRef<TestMeshObject> object;
+    csFlags flags;
+    csBox3 worldBox;
+  public:
+    TestMesh (const csBox3& box) : scfImplementationType (this)
+    {
+      movable.AttachNew (new TestMovable);
+      object.AttachNew (new TestMeshObject);
+      object->SetShape (box);
+    }
+
+    void Move (const csVector3& pos)
+    {
+      movable->SetPosition (pos);
+      movable->UpdateMove ();
+    }
+    void Reshape (const csBox3& box) { object->SetShape (box); }
+
+    virtual iObject* QueryObject () { return 0; }
+    virtual iMeshObject* GetMeshObject () const { return object; }
+    virtual void SetMeshObject (iMeshObject*) { }
+    virtual iPortalContainer* GetPortalContainer () const { return 0; }
+    virtual iMeshFactoryWrapper* GetFactory () const { return 0; }
+    virtual void SetFactory (iMeshFactoryWrapper*) { }
+    virtual iMovable* GetMovable () const { return movable; }
+    virtual iSceneNode* QuerySceneNode () { return 0; }
+    virtual iMeshWrapper* FindChildByName (const char*) { return 0; }
+    virtual void PlaceMesh () { }
+    virtual csHitBeamResult HitBeamBBox (const csVector3&, const csVector3&)
+    { return csHitBeamResult (); }
+    virtual csHitBeamResult HitBeamOutline (const csVector3&, const csVector3&)
+    { return csHitBeamResult (); }
+    virtual csHitBeamResult HitBeamObject (const csVector3&, const csVector3&,
+      bool)
+    { return csHitBeamResult (); }
+    virtual csHitBeamResult HitBeam (const csVector3&, const csVector3&, bool)
+    { return csHitBeamResult (); }
+    virtual void SetDrawCallback (iMeshDrawCallback*) { }
+    virtual void RemoveDrawCallback (iMeshDrawCallback*) { }
+    virtual int GetDrawCallbackCount () const { return 0; }
+    virtual iMeshDrawCallback* GetDrawCallback (int) const { return 0; }
+    virtual void SetRenderPriority (CS::Graphics::RenderPriority) { }
+    virtual CS::Graphics::RenderPriority GetRenderPriority () const
+    { return CS::Graphics::RenderPriority (); }
+    virtual void SetRenderPriorityRecursive (CS::Graphics::RenderPriority) { }
+    virtual csFlags& GetFlags () { return flags; }
+    virtual void SetFlagsRecursive (uint32, uint32) { }
+    virtual void SetZBufMode (csZBufMode) { }
+    virtual csZBufMode GetZBufMode () const { return csZBufMode (); }
+    virtual void SetZBufModeRecursive (csZBufMode) { }
+    virtual void HardTransform (const csReversibleTransform&) { }
+    virtual const csBox3& GetWorldBoundingBox ()
+    {
+      const csBox3& box = object->GetObjectBoundingBox ();
+      const csVector3& pos = movable->GetTransform ().GetOrigin ();
+      worldBox.Set (box.Min () + pos, box.Max () + pos);
+      return worldBox;
+    }
+    virtual csBox3 GetTransformedBoundingBox (const csReversibleTransform&)
+    { return csBox3 (); }
+    virtual csScreenBoxResult GetScreenBoundingBox (iCamera*)
+    { return csScreenBoxResult (); }
+    virtual csSphere GetRadius () const { return csSphere (); }
+    virtual void ResetMinMaxRenderDistance () { }
+    virtual void SetMinimumRenderDistance (float) { }
+    virtual float GetMinimumRenderDistance () const { return 0; }
+    virtual void SetMaximumRenderDistance (float) { }
+    virtual float GetMaximumRenderDistance () const { return 0; }
+    virtual void SetMinimumRenderDistanceVar (iSharedVariable*) { }
+    virtual iSharedVariable* GetMinimumRenderDistanceVar () const { return 0; }
+    virtual void SetMaximumRenderDistanceVar (iSharedVariable*) { }
+    virtual iSharedVariable* GetMaximumRenderDistanceVar () const { return 0; }
+    virtual iLODControl* CreateStaticLOD () { return 0; }
+    virtual void DestroyStaticLOD () { }
+    virtual iLODControl* GetStaticLOD () { return 0; }
+    virtual void AddMeshToStaticLOD (int, iMeshWrapper*) { }
+    virtual void RemoveMeshFromStaticLOD (iMeshWrapper*) { }
+    virtual iShaderVariableContext* GetSVContext () { return 0; }
+    virtual csRenderMesh** GetRenderMeshes (int&, iRenderView*, uint32)
+    { return 0; }
+    virtual size_t AddExtraRenderMesh (CS::Graphics::RenderMesh*, csZBufMode)
+    { return 0; }
+    virtual void AddExtraRenderMesh (CS::Graphics::RenderMesh*,
+      CS::Graphics::RenderPriority, csZBufMode)
+    { }
+    virtual CS::Graphics::RenderMesh* GetExtraRenderMesh (size_t) const
+    { return 0; }
+    virtual size_t GetExtraRenderMeshCount () const { return 0; }
+    virtual CS::Graphics::RenderPriority GetExtraRenderMeshPriority
+      (size_t) const
+    { return CS::Graphics::RenderPriority (); }
+    virtual csZBufMode GetExtraRenderMeshZBufMode (size_t) const
+    { return csZBufMode (); }
+    virtual void RemoveExtraRenderMesh (CS::Graphics::RenderMesh*) { }
+    virtual void RemoveExtraRenderMesh (size_t) { }
+    virtual csShaderVariable* AddInstance (csVector3&, csMatrix3&)
+    { return 0; }
+    virtual void RemoveInstance (csShaderVariable*) { }
+  };
+}
+
+/**
+ * Test csColliderBroadPhase.
+ */
+class csColliderBroadPhaseTest : public CppUnit::TestFixture
+{
+private:
+  csRef<TestCollideSystem> colsys;
+
+  static csRef<TestMesh> CreateMesh (float x)
+  {
+    csRef<TestMesh> mesh;
+    mesh.AttachNew (new TestMesh (csBox3 (x, 0, 0, x + 1, 1, 1)));
+    return mesh;
+  }
+  /// Get the meshes whose boxes overlap the given box of an actor.
+  static csArray<iMeshWrapper*> GetCandidates (
+    csColliderBroadPhase& broadphase, csColliderActor& actor,
+    const csBox3& box)
+  {
+    size_t id = broadphase.UpdateActor (&actor, box);
+    csArray<csArray<iMeshWrapper*> > candidates;
+    broadphase.GetCandidates (1, &id, candidates);
+    return candidates[0];
+  }
+
+public:
+  void setUp ();
+
+  void testOverlap ();
+  void testMove ();
+  void testReshape ();
+  void testActorDestroyed ();
+
+  CPPUNIT_TEST_SUITE (csColliderBroadPhaseTest);
+    CPPUNIT_TEST (testOverlap);
+    CPPUNIT_TEST (testMove);
+    CPPUNIT_TEST (testReshape);
+    CPPUNIT_TEST (testActorDestroyed);
+  CPPUNIT_TEST_SUITE_END ();
+};
+
+void csColliderBroadPhaseTest::setUp ()
+{
+  // Ensure that we have an initialized iSCF::SCF object
+  if (iSCF::SCF == 0)
+    scfInitialize (0);
+  colsys.AttachNew (new TestCollideSystem);
+}
+
+/**
+ * Meshes overlapping the actor box are candidates, the others aren't.
+ */
+void csColliderBroadPhaseTest::testOverlap ()
+{
+  csRef<TestMesh> near = CreateMesh (0);
+  csRef<TestMesh> far = CreateMesh (10);
+  csColliderBroadPhase broadphase (colsys);
+  broadphase.AddMesh (near);
+  broadphase.AddMesh (far);
+
+  csColliderActor actor;
+  csArray<iMeshWrapper*> cand = GetCandidates (broadphase, actor,
+    csBox3 (0.5f, 0.5f, 0.5f, 2, 2, 2));
+  CPPUNIT_ASSERT_EQUAL ((size_t)1, cand.GetSize ());
+  CPPUNIT_ASSERT (cand[0] == (iMeshWrapper*)near);
+
+  cand = GetCandidates (broadphase, actor, csBox3 (4, 0, 0, 5, 1, 1));
+  CPPUNIT_ASSERT_EQUAL ((size_t)0, cand.GetSize ());
+}
+
+/**
+ * A mesh that moved into the actor box is reported after UpdateMeshes(),
+ * and no longer once it moved away again.
+ */
+void csColliderBroadPhaseTest::testMove ()
+{
+  csRef<TestMesh> mesh = CreateMesh (10);
+  csColliderBroadPhase broadphase (colsys);
+  broadphase.AddMesh (mesh);
+
+  csColliderActor actor;
+  csBox3 actorBox (0, 0, 0, 2, 2, 2);
+  CPPUNIT_ASSERT_EQUAL ((size_t)0,
+    GetCandidates (broadphase, actor, actorBox).GetSize ());
+
+  mesh->Move (csVector3 (-9.5f, 0, 0));
+  broadphase.UpdateMeshes ();
+  csArray<iMeshWrapper*> cand = GetCandidates (broadphase, actor, actorBox);
+  CPPUNIT_ASSERT_EQUAL ((size_t)1, cand.GetSize ());
+  CPPUNIT_ASSERT (cand[0] == (iMeshWrapper*)mesh);
+
+  mesh->Move (csVector3 (0, 0, 0));
+  broadphase.UpdateMeshes ();
+  CPPUNIT_ASSERT_EQUAL ((size_t)0,
+    GetCandidates (broadphase, actor, actorBox).GetSize ());
+}
+
+/**
+ * A mesh that grew into the actor box without moving is reported after
+ * UpdateMeshes().
+ */
+void csColliderBroadPhaseTest::testReshape ()
+{
+  csRef<TestMesh> mesh = CreateMesh (10);
+  csColliderBroadPhase broadphase (colsys);
+  broadphase.AddMesh (mesh);
+
+  csColliderActor actor;
+  csBox3 actorBox (0, 0, 0, 2, 2, 2);
+  CPPUNIT_ASSERT_EQUAL ((size_t)0,
+    GetCandidates (broadphase, actor, actorBox).GetSize ());
+
+  mesh->Reshape (csBox3 (1, 0, 0, 11, 1, 1));
+  broadphase.UpdateMeshes ();
+  csArray<iMeshWrapper*> cand = GetCandidates (broadphase, actor, actorBox);
+  CPPUNIT_ASSERT_EQUAL ((size_t)1, cand.GetSize ());
+  CPPUNIT_ASSERT (cand[0] == (iMeshWrapper*)mesh);
+}
+
+/**
+ * Destroyed actors unregister themselves, and actors can outlive the
+ * broad phase they were registered with.
+ */
+void csColliderBroadPhaseTest::testActorDestroyed ()
+{
+  csColliderBroadPhase* broadphase = new csColliderBroadPhase (colsys);
+  iCollisionBroadPhase* boxes = broadphase->GetBroadPhase ();
+  csColliderActor* actor = new csColliderActor;
+  broadphase->AddActor (actor);
+  CPPUNIT_ASSERT_EQUAL ((size_t)1, boxes->GetBoxCount ());
+  delete actor;
+  CPPUNIT_ASSERT_EQUAL ((size_t)0, boxes->GetBoxCount ());
+
+  actor = new csColliderActor;
+  broadphase->AddActor (actor);
+  delete broadphase;
+  delete actor;
+}
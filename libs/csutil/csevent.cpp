@@ -64,7 +64,7 @@ const csEventID csEvent::GetName()
 }
 
 csEvent::csEvent () :
-  scfImplementationType (this), attributes (53), count(0)
+  scfImplementationType (this), inlineCount (0), attributes (53), count(0)
 {
   Time = ~0;
   Name = csInvalidStringID;
@@ -72,7 +72,7 @@ csEvent::csEvent () :
 }
 
 csEvent::csEvent (csTicks iTime, csEventID iName, bool iBroadcast) :
-  scfImplementationType (this), attributes (53), count (0)
+  scfImplementationType (this), inlineCount (0), attributes (53), count (0)
 {
   Time = iTime;
   Name = iName;
@@ -81,13 +81,20 @@ csEvent::csEvent (csTicks iTime, csEventID iName, bool iBroadcast) :
 
 // Copy constructor
 csEvent::csEvent (csEvent const& e) : iBase(), scfImplementationType (this),
-	attributes (53)
+	inlineCount (0), attributes (53)
 {
   count = 0;
 
   Name = e.Name;
   Broadcast = e.Broadcast;
   Time = e.Time;
+  for (size_t i = 0; i < e.inlineCount; i++)
+  {
+    inlineKeys[i] = e.inlineKeys[i];
+    inlineAttributes[i].CopyFrom (e.inlineAttributes[i]);
+  }
+  inlineCount = e.inlineCount;
+  count = inlineCount;
   csHash<attribute*, csStringID>::ConstGlobalIterator it = e.attributes.GetIterator();
   csStringID key;
   while (it.HasNext())
@@ -103,57 +110,67 @@ csEvent::~csEvent ()
   RemoveAll();
 }
 
+csEvent::attribute* csEvent::NewAttribute (csStringID id,
+                                           csEventAttributeType type)
+{
+  if (FindAttribute (id)) return 0;
+  attribute* object;
+  if (inlineCount < inlineAttributeCount)
+  {
+    inlineKeys[inlineCount] = id;
+    object = &inlineAttributes[inlineCount++];
+    object->type = type;
+  }
+  else
+  {
+    object = new attribute (type);
+    attributes.Put (id, object);
+  }
+  count++;
+  return object;
+}
+
 bool csEvent::Add (const char *name, float v)
 {
-  if (attributes.In (GetKeyID (name))) return false;
-  attribute* object = new attribute (csEventAttrFloat);
+  attribute* object = NewAttribute (GetKeyID (name), csEventAttrFloat);
+  if (!object) return false;
   object->doubleVal = v;
-  attributes.Put (GetKeyID (name), object);
-  count++;
   return true;
 }
 
 bool csEvent::Add (const char *name, double v)
 {
-  if (attributes.In (GetKeyID (name))) return false;
-  attribute* object = new attribute (csEventAttrFloat);
+  attribute* object = NewAttribute (GetKeyID (name), csEventAttrFloat);
+  if (!object) return false;
   object->doubleVal = v;
-  attributes.Put (GetKeyID (name), object);
-  count++;
   return true;
 }
 
 bool csEvent::Add (const char *name, bool v)
 {
-  if (attributes.In (GetKeyID (name))) return false;
-  attribute* object = new attribute (csEventAttrInt);
+  attribute* object = NewAttribute (GetKeyID (name), csEventAttrInt);
+  if (!object) return false;
   object->intVal = v ? 1 : 0;
-  attributes.Put (GetKeyID (name), object);
-  count++;
   return true;
 }
 
 bool csEvent::Add (const char *name, const char *v)
 {
-  if (attributes.In (GetKeyID (name))) return false;
-  attribute* object = new attribute (csEventAttrDatabuffer);
+  attribute* object = NewAttribute (GetKeyID (name), csEventAttrDatabuffer);
+  if (!object) return false;
   object->dataSize = strlen(v);
   object->bufferVal = csStrNew(v);
-  attributes.Put (GetKeyID (name), object);
-  count++;
   return true;
 }
 
 bool csEvent::Add (const char *name, const void *v, size_t size)
 {
-  if (attributes.In (GetKeyID (name))) return false;
-  attribute* object = new attribute (csEventAttrDatabuffer);
+  attribute* object = NewAttribute (GetKeyID (name), csEventAttrDatabuffer);
+  if (!object) return false;
   object->bufferVal = new char[size + 1];
   memcpy (object->bufferVal, v, size);
   object->bufferVal[size] = 0;
   object->dataSize = size;
-  attributes.Put (GetKeyID (name), object);
-  count++;
   return true;
 }
 
@@ -179,15 +196,13 @@ bool csEvent::CheckForLoops (iEvent* current, iEvent* e)
 
 bool csEvent::Add (const char *name, iEvent *v)
 {
-  if (attributes.In (GetKeyID (name))) return false;
   if (this == v)
     return false;
   if (v && CheckForLoops(v, this))
   {
-    attribute* object = new attribute (csEventAttrEvent);
+    attribute* object = NewAttribute (GetKeyID (name), csEventAttrEvent);
+    if (!object) return false;
     (object->ibaseVal = v)->IncRef();
-    attributes.Put (GetKeyID (name), object);
-    count++;
     return true;
   }
   return false;
@@ -195,13 +210,11 @@ bool csEvent::Add (const char *name, iEvent *v)
 
 bool csEvent::Add (const char *name, iBase* v)
 {
-  if (attributes.In (GetKeyID (name))) return false;
   if (v)
   {
-    attribute* object = new attribute (csEventAttriBase);
+    attribute* object = NewAttribute (GetKeyID (name), csEventAttriBase);
+    if (!object) return false;
     (object->ibaseVal = v)->IncRef();
-    attributes.Put (GetKeyID (name), object);
-    count++;
     return true;
   }
   return false;
@@ -209,7 +222,7 @@ bool csEvent::Add (const char *name, iBase* v)
 
 csEventError csEvent::Retrieve (const char *name, float &v) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttrFloat)
   {
@@ -224,7 +237,7 @@ csEventError csEvent::Retrieve (const char *name, float &v) const
 
 csEventError csEvent::Retrieve (const char *name, double &v) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttrFloat)
   {
@@ -239,7 +252,7 @@ csEventError csEvent::Retrieve (const char *name, double &v) const
 
 csEventError csEvent::Retrieve (const char *name, const char *&v) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttrDatabuffer)
   {
@@ -255,7 +268,7 @@ csEventError csEvent::Retrieve (const char *name, const char *&v) const
 csEventError csEvent::Retrieve (const char *name, void const *&v,
   size_t &size) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttrDatabuffer)
   {
@@ -271,7 +284,7 @@ csEventError csEvent::Retrieve (const char *name, void const *&v,
 
 csEventError csEvent::Retrieve (const char *name, bool &v) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttrInt)
   {
@@ -286,7 +299,7 @@ csEventError csEvent::Retrieve (const char *name, bool &v) const
 
 csEventError csEvent::Retrieve (const char *name, csRef<iEvent> &v) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttrEvent)
   {
@@ -302,7 +315,7 @@ csEventError csEvent::Retrieve (const char *name, csRef<iEvent> &v) const
 
 csEventError csEvent::Retrieve (const char *name, csRef<iBase> &v) const
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (!object) return csEventErrNotFound;
   if (object->type == csEventAttriBase)
   {
@@ -317,12 +330,12 @@ csEventError csEvent::Retrieve (const char *name, csRef<iBase> &v) const
 
 bool csEvent::AttributeExists (const char* name)
 {
-  return attributes.In (GetKeyID (name));
+  return FindAttribute (GetKeyID (name)) != 0;
 }
 
 csEventAttributeType csEvent::GetAttributeType (const char* name)
 {
-  attribute* object = attributes.Get (GetKeyID (name), 0);
+  attribute* object = FindAttribute (GetKeyID (name));
   if (object)
   {
     return object->type;
@@ -333,36 +346,56 @@ csEventAttributeType csEvent::GetAttributeType (const char* name)
 bool csEvent::Remove(const char *name)
 {
   csStringID id = GetKeyID (name);
+  for (size_t i = 0; i < inlineCount; i++)
+  {
+    if (inlineKeys[i] == id)
+    {
+      inlineAttributes[i].Release ();
+      inlineCount--;
+      if (i != inlineCount)
+      {
+        inlineKeys[i] = inlineKeys[inlineCount];
+        inlineAttributes[i].TakeOver (inlineAttributes[inlineCount]);
+      }
+      count--;
+      return true;
+    }
+  }
   if (!attributes.In (id)) return false;
   attribute* object = attributes.Get (id, 0);
   bool result = attributes.Delete (id, object);
   delete object;
+  count--;
   return result;
 }
 
 bool csEvent::RemoveAll()
 {
-  csHash<attribute*, csStringID>::GlobalIterator iter (
-    attributes.GetIterator ());
+  for (size_t i = 0; i < inlineCount; i++)
+    inlineAttributes[i].Release ();
+  inlineCount = 0;
 
-  while (iter.HasNext())
+  if (attributes.GetSize() > 0)
   {
-    csStringID name;
-    attribute* object = iter.Next (name);
-    delete object;
-  }
+    csHash<attribute*, csStringID>::GlobalIterator iter (
+      attributes.GetIterator ());
+
+    while (iter.HasNext())
+    {
+      csStringID name;
+      attribute* object = iter.Next (name);
+      delete object;
+    }
 
-  attributes.DeleteAll();
+    attributes.DeleteAll();
+  }
   count = 0;
   return true;
 }
 
 csRef<iEventAttributeIterator> csEvent::GetAttributeIterator()
 {
-  csHash<csEvent::attribute*, csStringID>::GlobalIterator attrIter (
-    attributes.GetIterator());
-  return csPtr<iEventAttributeIterator> (new csEventAttributeIterator (
-    attrIter));
+  return csPtr<iEventAttributeIterator> (new csEventAttributeIterator (this));
 }
 
 static void IndentLevel(int level)
@@ -371,8 +404,52 @@ static void IndentLevel(int level)
     csPrintf("\t");
 }
 
+void csEvent::PrintAttribute (int level, csStringID name, attribute* object)
+{
+  IndentLevel(level); csPrintf ("------\n");
+  IndentLevel(level); csPrintf ("Name: %s\n", GetKeyName (name));
+  IndentLevel(level); csPrintf (" Datatype: %s\n",
+	  GetTypeName(object->type));
+  if (object->type == csEventAttrEvent)
+  {
+    IndentLevel(level); csPrintf(" Sub-Event Contents:\n");
+    csRef<csEvent> csev = scfQueryInterface<csEvent> (object->ibaseVal);
+    if (csev)
+      csev->Print(level+1);
+    else
+    {
+      IndentLevel(level+1); csPrintf(" (Not an event!):\n");
+    }
+
+  }
+  if (object->type == csEventAttrInt)
+  {
+
+    IndentLevel(level);
+    csPrintf(" Value: %" CS_PRId64 "\n", object->intVal);
+  }
+  else if (object->type == csEventAttrUInt)
+  {
+    IndentLevel(level);
+    csPrintf(" Value: %" CS_PRIu64 "\n", object->intVal);
+  }
+  else if (object->type == csEventAttrFloat)
+  {
+    IndentLevel(level);
+    csPrintf (" Value: %f\n", object->doubleVal);
+  }
+  else if (object->type == csEventAttrDatabuffer)
+  {
+    IndentLevel(level); csPrintf(" Value: 0x%p\n", object->bufferVal);
+    IndentLevel(level); csPrintf(" Length: %zu\n", object->dataSize);
+  }
+}
+
 bool csEvent::Print (int level)
 {
+  for (size_t i = 0; i < inlineCount; i++)
+    PrintAttribute (level, inlineKeys[i], &inlineAttributes[i]);
+
   csHash<attribute*, csStringID>::GlobalIterator iter (
     attributes.GetIterator ());
 
@@ -380,44 +457,7 @@ bool csEvent::Print (int level)
   {
     csStringID name;
     attribute* object = iter.Next (name);
-
-    IndentLevel(level); csPrintf ("------\n");
-    IndentLevel(level); csPrintf ("Name: %s\n", GetKeyName (name));
-    IndentLevel(level); csPrintf (" Datatype: %s\n",
-	  GetTypeName(object->type));
-    if (object->type == csEventAttrEvent)
-    {
-      IndentLevel(level); csPrintf(" Sub-Event Contents:\n");
-      csRef<csEvent> csev = scfQueryInterface<csEvent> (object->ibaseVal);
-      if (csev)
-	csev->Print(level+1);
-      else
-      {
-	IndentLevel(level+1); csPrintf(" (Not an event!):\n");
-      }
-
-    }
-    if (object->type == csEventAttrInt)
-    {
-
-      IndentLevel(level);
-      csPrintf(" Value: %" CS_PRId64 "\n", object->intVal);
-    }
-    else if (object->type == csEventAttrUInt)
-    {
-      IndentLevel(level);
-      csPrintf(" Value: %" CS_PRIu64 "\n", object->intVal);
-    }
-    else if (object->type == csEventAttrFloat)
-    {
-      IndentLevel(level);
-      csPrintf (" Value: %f\n", object->doubleVal);
-    }
-    else if (object->type == csEventAttrDatabuffer)
-    {
-      IndentLevel(level); csPrintf(" Value: 0x%p\n", object->bufferVal);
-      IndentLevel(level); csPrintf(" Length: %zu\n", object->dataSize);
-    }
+    PrintAttribute (level, name, object);
   }
 
   return true;
@@ -432,6 +472,8 @@ csRef<iEvent> csEvent::CreateEvent()
 
 const char* csEventAttributeIterator::Next()
 {
+  if (inlineIndex < event->inlineCount)
+    return csEvent::GetKeyName (event->inlineKeys[inlineIndex++]);
   csStringID key;
   iterator.Next (key);
   return csEvent::GetKeyName (key);
@@ -448,22 +490,29 @@ csPoolEvent::csPoolEvent(csEventQueue *q)
 
 void csPoolEvent::DecRef()
 {
-  if (scfRefCount == 1)
+  // Posting threads and the processing thread may release references at the
+  // same time, so only ever decrement the count atomically.
+  int32 refCount;
+  while ((refCount = CS::Threading::AtomicOperations::Read (&scfRefCount)) > 1)
   {
-    if (!pool.IsValid())
+    if (CS::Threading::AtomicOperations::CompareAndSet (&scfRefCount,
+        refCount - 1, refCount) == refCount)
       return;
-
-    next = pool->EventPool;
-    pool->EventPool = this;
-    RemoveAll();
-    Name = csInvalidStringID;
-    Time = ~0;
-    Broadcast = false;
-  }
-  else
-  {
-    scfRefCount--;
   }
+
+  // This was the last reference.
+  if (!pool.IsValid())
+    return;
+
+  // Release attributes before the event becomes visible in the pool:
+  // releasing may return attached events to the pool as well.
+  RemoveAll();
+  Name = csInvalidStringID;
+  Time = ~0;
+  Broadcast = false;
+  CS::Threading::MutexScopedLock lock (pool->poolMutex);
+  next = pool->EventPool;
+  pool->EventPool = this;
 }
 
 csRef<iEvent> csPoolEvent::CreateEvent()
@@ -43,10 +43,21 @@ csEventQueue::csEventQueue (iObjectRegistry* r, size_t iLength) :
   Registry(r), 
   NameRegistry(csEventNameRegistry::GetRegistry(r)),
   HandlerRegistry(csEventHandlerRegistry::GetRegistry(r)),
-  EventQueue(0), evqHead(0), evqTail(0), Length(0),
-  EventTree(0), EventPool(0)
+  EventRing(0), ringHead(0), ringTail(0), overflowing(0),
+  overflowTakenPos(0), EventTree(0), EventPool(0)
 {
-  Resize (iLength);
+  if (iLength < 2)
+    iLength = DEF_EVENT_QUEUE_LENGTH;
+  ringLength = 2;
+  while ((size_t)ringLength < iLength)
+    ringLength <<= 1;
+  ringMask = ringLength - 1;
+  EventRing = new RingSlot[ringLength];
+  for (int32 i = 0; i < ringLength; i++)
+  {
+    EventRing[i].sequence = i;
+    EventRing[i].event = 0;
+  }
   // Create the default event outlet.
   EventOutlets.Push (new csEventOutlet (0, this, Registry));
   EventTree = csEventTree::CreateRootNode(HandlerRegistry, NameRegistry, this);
@@ -58,8 +69,7 @@ csEventQueue::~csEventQueue ()
 {
   // We don't allow deleting the event queue from within an event handler.
   Clear();
-  if (EventQueue)
-    delete[] EventQueue;
+  delete[] EventRing;
   EventOutlets.Get(0)->DecRef(); // The default event outlet which we created.
   while (EventPool) 
   {
@@ -73,6 +83,7 @@ csEventQueue::~csEventQueue ()
 
 uint32 csEventQueue::CountPool()
 {
+  CS::Threading::MutexScopedLock lock (poolMutex);
   if (!EventPool) return 0;
   csPoolEvent *e = EventPool;
   uint32 count = 0;
@@ -86,13 +97,16 @@ uint32 csEventQueue::CountPool()
 
 iEvent *csEventQueue::CreateRawEvent ()
 {
-  csPoolEvent *e;
-  if (EventPool) 
+  csPoolEvent *e = 0;
   {
-    e = EventPool;
-    EventPool = e->next;
+    CS::Threading::MutexScopedLock lock (poolMutex);
+    if (EventPool) 
+    {
+      e = EventPool;
+      EventPool = e->next;
+    }
   }
-  else 
+  if (!e)
   {
     e = new csPoolEvent(this);
   }
@@ -145,31 +159,99 @@ void csEventQueue::Post (iEvent *Event)
 	    << " (" << Event->Time << ")"
 	    << std::endl;
 #endif
-again:
-  size_t newHead = evqHead + 1;
-  if (newHead == Length)
-    newHead = 0;
-
-  if (newHead == evqTail) // Queue full?
-  {    
-    Resize (Length * 2); // Normally queue should not be more than half full.
-    goto again;
+  Event->IncRef ();
+  if (!CS::Threading::AtomicOperations::Read (&overflowing)
+    && RingPush (Event))
+    return;
+
+  // Ring is full (normally it should not be more than half full).
+  CS::Threading::MutexScopedLock lock (overflowMutex);
+  overflow.Push (Event);
+  CS::Threading::AtomicOperations::Set (&overflowing, 1);
+}
+
+bool csEventQueue::RingPush (iEvent* Event)
+{
+  int32 pos = CS::Threading::AtomicOperations::Read (&ringHead);
+  RingSlot* slot;
+  while (true)
+  {
+    slot = EventRing + (pos & ringMask);
+    int32 seq = CS::Threading::AtomicOperations::Read (&slot->sequence);
+    // Positions wrap around, so compare them by their (signed) distance.
+    int32 diff = (int32)((uint32)seq - (uint32)pos);
+    if (diff == 0)
+    {
+      // Slot is free; try to claim it.
+      int32 oldPos = CS::Threading::AtomicOperations::CompareAndSet (
+        &ringHead, (int32)((uint32)pos + 1), pos);
+      if (oldPos == pos) break;
+      pos = oldPos;
+    }
+    else if (diff < 0)
+    {
+      // Slot still holds an event from the previous round: ring is full.
+      return false;
+    }
+    else
+    {
+      // Another producer claimed this position in the meantime.
+      pos = CS::Threading::AtomicOperations::Read (&ringHead);
+    }
   }
+  slot->event = Event;
+  // Publish the event to the consumer.
+  CS::Threading::AtomicOperations::Set (&slot->sequence,
+    (int32)((uint32)pos + 1));
+  return true;
+}
 
-  EventQueue [evqHead] = Event;
-  Event->IncRef ();
-  evqHead = newHead;
+iEvent* csEventQueue::RingPop ()
+{
+  RingSlot* slot = EventRing + (ringTail & ringMask);
+  int32 seq = CS::Threading::AtomicOperations::Read (&slot->sequence);
+  if (seq != (int32)((uint32)ringTail + 1))
+    return 0;
+  iEvent* ev = slot->event;
+  slot->event = 0;
+  // Hand the slot back to the producers for the next round.
+  CS::Threading::AtomicOperations::Set (&slot->sequence,
+    (int32)((uint32)ringTail + ringLength));
+  ringTail = (int32)((uint32)ringTail + 1);
+  return ev;
 }
 
 csPtr<iEvent> csEventQueue::Get ()
 {
   iEvent* ev = 0;
-  if (!IsEmpty ())
+  /* Events taken from the overflow list were posted before anything now in
+   * the ring, so deliver them first. */
+  if (overflowTakenPos < overflowTaken.GetSize ())
   {
-    size_t oldTail = evqTail++;
-    if (evqTail == Length)
-      evqTail = 0;
-    ev = (iEvent*)EventQueue [oldTail];
+    ev = overflowTaken[overflowTakenPos++];
+  }
+  else
+  {
+    /* Check for overflow events before looking at the ring: if the ring is
+     * found empty afterwards, everything posted ahead of those events has
+     * been delivered. */
+    bool hasOverflow =
+      CS::Threading::AtomicOperations::Read (&overflowing) != 0;
+    ev = RingPop ();
+    if (!ev && hasOverflow)
+    {
+      overflowTaken.Empty ();
+      {
+        CS::Threading::MutexScopedLock lock (overflowMutex);
+        for (size_t i = 0; i < overflow.GetSize (); i++)
+          overflowTaken.Push (overflow[i]);
+        overflow.Empty ();
+        CS::Threading::AtomicOperations::Set (&overflowing, 0);
+      }
+      overflowTakenPos = 0;
+      if (overflowTaken.GetSize () > 0)
+        ev = overflowTaken[overflowTakenPos++];
+    }
   }
 #ifdef ADB_DEBUG
   if (ev != 0)
@@ -183,44 +265,19 @@ csPtr<iEvent> csEventQueue::Get ()
   return ev;
 }
 
-void csEventQueue::Clear ()
+bool csEventQueue::IsEmpty ()
 {
-  csRef<iEvent> ev;
-  for (ev = Get(); ev.IsValid(); ev = Get()) /* empty */;
+  if (overflowTakenPos < overflowTaken.GetSize ()) return false;
+  if (CS::Threading::AtomicOperations::Read (&overflowing)) return false;
+  RingSlot* slot = EventRing + (ringTail & ringMask);
+  return CS::Threading::AtomicOperations::Read (&slot->sequence)
+    != (int32)((uint32)ringTail + 1);
 }
 
-void csEventQueue::Resize (size_t iLength)
+void csEventQueue::Clear ()
 {
-  if (iLength <= 0)
-    iLength = DEF_EVENT_QUEUE_LENGTH;
-
-  if (iLength == Length)
-  {
-    return;
-  }
-
-  // Remember old event queue and allocate a new one
-  volatile iEvent **oldEventQueue = EventQueue;
-  EventQueue = (volatile iEvent**) new iEvent *[iLength];
-  // Remember old values of head & tail and set both to 0
-  size_t oldHead = evqHead, oldTail = evqTail;
-  evqHead = evqTail = 0;
-  // Remember old queue length and set new one
-  size_t oldLength = Length;
-  Length = iLength;
-
-  // Copy old events into the new queue until its full
-  if (oldEventQueue)
-  {
-    while ((oldTail != oldHead) && (evqHead < Length - 1))
-    {
-      EventQueue [evqHead++] = oldEventQueue [oldTail++];
-      if (oldTail == oldLength)
-        oldTail = 0;
-    }
-  }
-
-  delete[] oldEventQueue; 
+  csRef<iEvent> ev;
+  for (ev = Get(); ev.IsValid(); ev = Get()) /* empty */;
 }
 
 void csEventQueue::Notify (const csEventID &name)
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "csgeom/math.h"
+#include "csutil/framearena.h"
+
+namespace CS
+{
+  namespace Memory
+  {
+    FrameArena::FrameArena (size_t granularity) : chunks (0), top (0),
+      end (0), lastAlloc (0), granularity (granularity), used (0),
+      lastFrameUsed (0), peakUsed (0), numChunks (0)
+    {
+    }
+
+    FrameArena::~FrameArena ()
+    {
+      FreeChunks ();
+    }
+
+    void FrameArena::NewChunk (size_t minSize)
+    {
+      size_t size = csMax (minSize, granularity);
+      Chunk* chunk = (Chunk*)cs_malloc (sizeof (Chunk) + size);
+      chunk->next = chunks;
+      chunk->size = size;
+      chunks = chunk;
+      numChunks++;
+      top = (uint8*)(chunk + 1);
+      end = top + size;
+    }
+
+    void FrameArena::FreeChunks ()
+    {
+      while (chunks != 0)
+      {
+        Chunk* next = chunks->next;
+        cs_free (chunks);
+        chunks = next;
+      }
+      numChunks = 0;
+      top = end = lastAlloc = 0;
+    }
+
+    void FrameArena::Reset ()
+    {
+      lastFrameUsed = used;
+      peakUsed = csMax (peakUsed, used);
+      used = 0;
+      if (numChunks > 1)
+      {
+        /* The frame did not fit into one chunk: replace all chunks with one
+         * that would have held it (plus alignment slack). */
+        size_t needed = 0;
+        for (Chunk* c = chunks; c != 0; c = c->next)
+          needed += c->size;
+        FreeChunks ();
+        NewChunk (needed);
+      }
+      else if (chunks != 0)
+      {
+        top = (uint8*)(chunks + 1);
+        end = top + chunks->size;
+      }
+      lastAlloc = 0;
+    }
+
+    size_t FrameArena::GetReservedBytes () const
+    {
+      size_t reserved = 0;
+      for (Chunk* c = chunks; c != 0; c = c->next)
+        reserved += c->size;
+      return reserved;
+    }
+
+    //-----------------------------------------------------------------------
+
+    FrameArenaPerThread::FrameArenaPerThread (size_t granularity) :
+      granularity (granularity), lastFrameUsed (0)
+    {
+    }
+
+    FrameArenaPerThread::~FrameArenaPerThread ()
+    {
+      for (size_t i = 0; i < arenas.GetSize (); i++)
+        delete arenas[i];
+    }
+
+    FrameArena* FrameArenaPerThread::CreateArena ()
+    {
+      FrameArena* arena = new FrameArena (granularity);
+      {
+        CS::Threading::MutexScopedLock lock (arenasLock);
+        arenas.Push (arena);
+      }
+      threadArena = arena;
+      return arena;
+    }
+
+    void FrameArenaPerThread::Reset ()
+    {
+      CS::Threading::MutexScopedLock lock (arenasLock);
+      lastFrameUsed = 0;
+      for (size_t i = 0; i < arenas.GetSize (); i++)
+      {
+        lastFrameUsed += arenas[i]->GetUsedBytes ();
+        arenas[i]->Reset ();
+      }
+    }
+
+    size_t FrameArenaPerThread::GetUsedBytes () const
+    {
+      CS::Threading::MutexScopedLock lock (arenasLock);
+      size_t used = 0;
+      for (size_t i = 0; i < arenas.GetSize (); i++)
+        used += arenas[i]->GetUsedBytes ();
+      return used;
+    }
+  } // namespace Memory
+} // namespace CS
@@ -53,6 +53,8 @@
 #include "reftrack.h"
 #endif
 
+#include "scfplugincache.h"
+
 #if (defined(CS_EXTENSIVE_MEMDEBUG) && defined(CS_COMPILER_MSVC)) || \
   defined(CS_MEMORY_TRACKER) || defined(CS_REF_TRACKER)
 /*
@@ -95,9 +97,11 @@ private:
   { return s != csInvalidStringID ? contexts.Request(s) : "{none}"; }
   char const* GetContextName(char const* s)
   { return s != 0 ? s : "{none}"; }
-  void RegisterClassesInt (char const* pluginPath, iDocumentNode* scfnode, 
+  void RegisterClassesInt (char const* pluginPath, 
+    const csArray<scfPluginCache::ClassInfo>& classes, 
     const char* context = 0);
-  void ScanPluginsInt(csPathsList const*, char const* context);
+  void ScanPluginsInt(csPathsList const*, char const* context,
+    bool fullScan = false);
 
   friend void scfInitialize (csPathsList const*, unsigned int);
 
@@ -603,12 +607,15 @@ void* csSCF::QueryInterface (scfInterfaceID iInterfaceID,
 }
 
 void csSCF::ScanPluginsInt (csPathsList const* pluginPaths,
-                            const char* context)
+                            const char* context, bool fullScan)
 {
   if (pluginPaths)
   {
     // Search plugins in pluginpaths
     csRef<iStringArray> plugins;
+    /* A scan from scfInitialize() covers all plugin paths, so modules it
+       doesn't see are gone for good; other scans only cover some paths. */
+    scfPluginCache cache (scfGetPluginCache (), fullScan);
 
     size_t i, j;
     for (i = 0; i < pluginPaths->Length(); i++)
@@ -638,16 +645,16 @@ void csSCF::ScanPluginsInt (csPathsList const* pluginPaths,
           csPrintfErr(" %s\n", messages->Get (j));
       }
 
-      csRef<iDocument> metadata;
-      csRef<iString> msg;
-      for (j = 0; j < plugins->GetSize (); j++)
+      csArray<scfPluginCache::PluginInfo> infos;
+      cache.GetMetadata (plugins, infos);
+      for (j = 0; j < infos.GetSize (); j++)
       {
-        char const* plugin = plugins->Get(j);
-        msg = csGetPluginMetadata (plugin, metadata);
-        if (msg != 0)
+        const scfPluginCache::PluginInfo& info = infos[j];
+        char const* plugin = info.path;
+        if (!info.message.IsEmpty ())
         {
           csPrintfErr("SCF_ERROR: metadata retrieval error for %s: %s\n",
-            plugin, msg->GetData ());
+            plugin, info.message.GetData ());
         }
         // It is possible for an error or warning message to be generated even
         // when metadata is also obtained.  Likewise, it is possible for no
@@ -659,8 +666,8 @@ void csSCF::ScanPluginsInt (csPathsList const* pluginPaths,
         // metadata.  This is a valid case, which we simply ignore since it is
         // legal for non-CS libraries to exist alongside CS plugins in the
         // scanned directories.
-        if (metadata)
-          RegisterClasses(plugin, metadata, 
+        if (info.hasMetadata)
+          RegisterClassesInt(plugin, info.classes, 
           context ? context : pathrec.type.GetData());
       }
     }
@@ -678,13 +685,31 @@ static unsigned int parse_verbosity(int argc, const char* const argv[])
   return v;
 }
 
+static csString* pluginCacheFile = 0;
+
+void scfSetPluginCache (const char* filename)
+{
+  if (!pluginCacheFile) pluginCacheFile = new csString;
+  *pluginCacheFile = filename;
+}
+
+const char* scfGetPluginCache ()
+{
+  if (!pluginCacheFile)
+  {
+    pluginCacheFile = new csString (
+      csGetPlatformConfigPath ("CrystalSpace.PluginCache", true));
+  }
+  return pluginCacheFile->IsEmpty () ? 0 : pluginCacheFile->GetData ();
+}
+
 void scfInitialize (csPathsList const* pluginPaths, unsigned int verbose)
 {
   if (!PrivateSCF)
     PrivateSCF = new csSCF (verbose);
   else if (verbose != SCF_VERBOSE_NONE)
     PrivateSCF->SetVerbose(verbose | PrivateSCF->GetVerbose());
-  PrivateSCF->ScanPluginsInt (pluginPaths, 0);
+  PrivateSCF->ScanPluginsInt (pluginPaths, 0, true);
 }
 
 void scfInitialize (int argc, const char* const argv[],
@@ -854,32 +879,20 @@ void csSCF::RegisterClasses (char const* pluginPath,
     csRef<iDocumentNode> rootnode = doc->GetRoot();
     if (rootnode != 0)
     {
-      csRef<iDocumentNode> pluginnode = rootnode->GetNode("plugin");
-      if (pluginnode)
-      {
-	csRef<iDocumentNode> scfnode = pluginnode->GetNode("scf");
-	if (scfnode.IsValid())
-	  RegisterClassesInt (pluginPath, scfnode, context);
-	else
-	  csPrintfErr("SCF_ERROR: missing <scf> node in metadata for %s "
-	    "in context `%s'\n", pluginPath != 0 ? pluginPath : "{unknown}",
-	    GetContextName(context));
-      }
+      csArray<scfPluginCache::ClassInfo> classes;
+      csString error;
+      if (scfPluginCache::ReadClasses (doc, classes, error))
+        RegisterClassesInt (pluginPath, classes, context);
       else
-        csPrintfErr("SCF_ERROR: missing root <plugin> node in metadata "
-	  "for %s in context `%s'\n",
-	  pluginPath != 0 ? pluginPath : "{unknown}", GetContextName(context));
+        csPrintfErr("SCF_ERROR: %s for %s in context `%s'\n", 
+          error.GetData(), pluginPath != 0 ? pluginPath : "{unknown}",
+          GetContextName(context));
     }
   }
 }
 
-static char const* get_node_value(csRef<iDocumentNode> parent, char const* key)
-{
-  csRef<iDocumentNode> node = parent->GetNode(key);
-  return node.IsValid() ? node->GetContentsValue() : "";
-}
-
-void csSCF::RegisterClassesInt(char const* pluginPath, iDocumentNode* scfnode, 
+void csSCF::RegisterClassesInt(char const* pluginPath, 
+			       const csArray<scfPluginCache::ClassInfo>& classes, 
 			       const char* context)
 {
   bool const seen = pluginPath != 0 && libraryNames->Contains(pluginPath);
@@ -898,37 +911,13 @@ void csSCF::RegisterClassesInt(char const* pluginPath, iDocumentNode* scfnode,
   if (seen)
     return;			// *** RETURN: Do not re-register ***
 
-  csRef<iDocumentNode> classesnode = scfnode->GetNode("classes");
-  if (classesnode)
+  for (size_t i = 0; i < classes.GetSize(); i++)
   {
-    csRef<iDocumentNodeIterator> classiter = classesnode->GetNodes("class");
-    csRef<iDocumentNode> classnode;
-    while ((classnode = classiter->Next()))
-    {
-      csString classname = get_node_value(classnode, "name");
-      csString imp = get_node_value(classnode, "implementation");
-      csString desc = get_node_value(classnode, "description");
-
-      // For backward compatibility, we build a comma-delimited dependency
-      // string from the individual dependency nodes.  In the future,
-      // iSCF::GetClassDependencies() should be updated to return an
-      // iStringArray, rather than a simple comma-delimited string.
-      csString depend;
-      csRef<iDocumentNode> depnode = classnode->GetNode("requires");
-      if (depnode)
-      {
-	csRef<iDocumentNodeIterator> depiter = depnode->GetNodes("class");
-	csRef<iDocumentNode> depclassnode;
-	while ((depclassnode = depiter->Next()))
-	{
-	  if (!depend.IsEmpty()) depend << ", ";
-	  depend << depclassnode->GetContentsValue();
-	}
-      }
-
-      char const* pdepend = (depend.IsEmpty() ? 0 : depend.GetData());
-      RegisterClass(classname, pluginPath, imp, desc, pdepend, context);
-    }
+    const scfPluginCache::ClassInfo& info = classes[i];
+    char const* pdepend = (info.dependencies.IsEmpty() ? 0 
+      : info.dependencies.GetData());
+    RegisterClass(info.name, pluginPath, info.implementation, 
+      info.description, pdepend, context);
   }
 }
 
@@ -0,0 +1,398 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+
+#include <sys/stat.h>
+#ifdef CS_PLATFORM_WIN32
+#include <process.h>
+#define getpid() _getpid()
+#else
+#include <unistd.h>
+#endif
+
+#include "csgeom/math.h"
+#include "csutil/csshlib.h"
+#include "csutil/platform.h"
+#include "csutil/refarr.h"
+#include "csutil/stringarray.h"
+#include "csutil/threading/atomicops.h"
+#include "csutil/threading/thread.h"
+#include "iutil/document.h"
+#include "iutil/stringarray.h"
+
+#include "scfplugincache.h"
+
+/* Cache file format: a header line, then for each module a "P" line with
+   the key, the metadata flag, the class count and the path, followed by a
+   "C" line per class. Fields are separated by tabs. */
+static const char cacheHeader[] = "CSPluginCache 1";
+
+static csString GetNodeValue (iDocumentNode* parent, const char* key)
+{
+  csRef<iDocumentNode> node = parent->GetNode (key);
+  return node.IsValid() ? node->GetContentsValue() : "";
+}
+
+bool scfPluginCache::ReadClasses (iDocument* metadata,
+                                  csArray<ClassInfo>& classes,
+                                  csString& error)
+{
+  csRef<iDocumentNode> rootnode = metadata->GetRoot();
+  if (!rootnode.IsValid()) return false;
+  csRef<iDocumentNode> pluginnode = rootnode->GetNode ("plugin");
+  if (!pluginnode.IsValid())
+  {
+    error = "missing root <plugin> node in metadata";
+    return false;
+  }
+  csRef<iDocumentNode> scfnode = pluginnode->GetNode ("scf");
+  if (!scfnode.IsValid())
+  {
+    error = "missing <scf> node in metadata";
+    return false;
+  }
+
+  csRef<iDocumentNode> classesnode = scfnode->GetNode ("classes");
+  if (classesnode.IsValid())
+  {
+    csRef<iDocumentNodeIterator> classiter = classesnode->GetNodes ("class");
+    csRef<iDocumentNode> classnode;
+    while ((classnode = classiter->Next()))
+    {
+      ClassInfo& info = classes.GetExtend (classes.GetSize());
+      info.name = GetNodeValue (classnode, "name");
+      info.implementation = GetNodeValue (classnode, "implementation");
+      info.description = GetNodeValue (classnode, "description");
+
+      // For backward compatibility, we build a comma-delimited dependency
+      // string from the individual dependency nodes.
+      csRef<iDocumentNode> depnode = classnode->GetNode ("requires");
+      if (depnode.IsValid())
+      {
+	csRef<iDocumentNodeIterator> depiter = depnode->GetNodes ("class");
+	csRef<iDocumentNode> depclassnode;
+	while ((depclassnode = depiter->Next()))
+	{
+	  if (!info.dependencies.IsEmpty()) info.dependencies << ", ";
+	  info.dependencies << depclassnode->GetContentsValue();
+	}
+      }
+    }
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+scfPluginCache::scfPluginCache (const char* filename, bool keepSeenOnly)
+  : keepSeenOnly (keepSeenOnly), dirty (false)
+{
+  if (filename != 0)
+  {
+    this->filename = filename;
+    Load ();
+  }
+}
+
+scfPluginCache::~scfPluginCache ()
+{
+  if (filename.IsEmpty()) return;
+  Prune ();
+  if (dirty) Save ();
+}
+
+bool scfPluginCache::Stat (PluginInfo& info)
+{
+  struct stat st;
+  if (stat (info.path, &st) != 0) return false;
+  info.size = st.st_size;
+  info.mtime = st.st_mtime;
+
+  /* Metadata can also come from a .csplugin file next to the module, so
+     that is part of the key as well. */
+  csString metaPath (info.path);
+  size_t dot = metaPath.FindLast ('.');
+  if (dot != (size_t)-1) metaPath.Truncate (dot);
+  if (strcmp (info.path.GetData() + metaPath.Length(), ".csplugin") == 0)
+  {
+#ifdef CS_PLATFORM_WIN32
+    metaPath << ".dll";
+#else
+    metaPath.Empty();
+#endif
+  }
+  else
+    metaPath << ".csplugin";
+  if (!metaPath.IsEmpty() && (stat (metaPath, &st) == 0))
+  {
+    info.metaSize = st.st_size;
+    info.metaMTime = st.st_mtime;
+  }
+  else
+    info.metaSize = info.metaMTime = -1;
+  return true;
+}
+
+void scfPluginCache::Retrieve (PluginInfo& info)
+{
+  csRef<iDocument> metadata;
+  csRef<iString> msg = csGetPluginMetadata (info.path, metadata);
+  if (msg.IsValid()) info.message = msg->GetData();
+  // A module without metadata nor error message simply isn't a CS plugin
+  info.hasMetadata = metadata.IsValid();
+  if (info.hasMetadata)
+  {
+    csString error;
+    if (!ReadClasses (metadata, info.classes, error))
+    {
+      info.hasMetadata = false;
+      if (!info.message.IsEmpty()) info.message << "\n";
+      info.message << error;
+    }
+  }
+}
+
+/// Retrieves metadata for a shared list of modules
+class scfPluginCache::RetrieveRunnable : public CS::Threading::Runnable
+{
+  csArray<PluginInfo*>& todo;
+  int32& next;
+public:
+  RetrieveRunnable (csArray<PluginInfo*>& todo, int32& next) 
+    : todo (todo), next (next) {}
+
+  void Run ()
+  {
+    while (true)
+    {
+      size_t n = size_t (
+        CS::Threading::AtomicOperations::Increment (&next) - 1);
+      if (n >= todo.GetSize()) break;
+      Retrieve (*todo[n]);
+    }
+  }
+  const char* GetName () const { return "SCF metadata retrieval"; }
+};
+
+void scfPluginCache::GetMetadata (iStringArray* plugins,
+                                  csArray<PluginInfo>& infos)
+{
+  infos.SetSize (plugins->GetSize());
+  csArray<PluginInfo*> todo;
+  for (size_t i = 0; i < plugins->GetSize(); i++)
+  {
+    PluginInfo& info = infos[i];
+    info.path = plugins->Get (i);
+    seen.Add (info.path);
+    const PluginInfo* cached = entries.GetElementPointer (info.path);
+    if (Stat (info) && (cached != 0)
+      && (cached->size == info.size) && (cached->mtime == info.mtime)
+      && (cached->metaSize == info.metaSize)
+      && (cached->metaMTime == info.metaMTime))
+    {
+      info = *cached;
+      continue;
+    }
+    todo.Push (&info);
+  }
+  if (todo.GetSize() == 0) return;
+
+  int32 next = 0;
+  size_t numThreads = csMin (size_t (CS::Platform::GetProcessorCount()),
+    todo.GetSize());
+  if (numThreads > 1)
+  {
+    csRef<RetrieveRunnable> runnable;
+    runnable.AttachNew (new RetrieveRunnable (todo, next));
+    csRefArray<CS::Threading::Thread> threads;
+    // The calling thread does its share as well
+    for (size_t t = 1; t < numThreads; t++)
+    {
+      csRef<CS::Threading::Thread> thread;
+      thread.AttachNew (new CS::Threading::Thread (runnable, true));
+      threads.Push (thread);
+    }
+    runnable->Run ();
+    for (size_t t = 0; t < threads.GetSize(); t++)
+      threads[t]->Wait ();
+  }
+  else
+  {
+    for (size_t i = 0; i < todo.GetSize(); i++)
+      Retrieve (*todo[i]);
+  }
+
+  for (size_t i = 0; i < todo.GetSize(); i++)
+  {
+    const PluginInfo& info = *todo[i];
+    // Keep trying modules with problems, so the messages show up again
+    if ((info.size < 0) || !info.message.IsEmpty()) continue;
+    entries.PutUnique (info.path, info);
+    dirty = true;
+  }
+}
+
+static void AppendField (csString& line, const char* value)
+{
+  line << '\t';
+  for (; *value != 0; value++)
+    line << (((*value == '\t') || (*value == '\n') || (*value == '\r'))
+      ? ' ' : *value);
+}
+
+static bool ParseInt64 (const char*& p, int64& v)
+{
+  bool neg = (*p == '-');
+  if (neg) p++;
+  if ((*p < '0') || (*p > '9')) return false;
+  v = 0;
+  while ((*p >= '0') && (*p <= '9')) v = v * 10 + (*p++ - '0');
+  if (neg) v = -v;
+  if (*p == '\t') p++;
+  return true;
+}
+
+/// Split the next tab-delimited field off \a p
+static csString NextField (const char*& p)
+{
+  const char* end = strchr (p, '\t');
+  if (end == 0) end = p + strlen (p);
+  csString field;
+  field.Append (p, end - p);
+  p = (*end == '\t') ? end + 1 : end;
+  return field;
+}
+
+void scfPluginCache::Load ()
+{
+  FILE* file = fopen (filename, "rb");
+  if (file == 0) return;
+  csString contents;
+  char buf[4096];
+  size_t n;
+  while ((n = fread (buf, 1, sizeof (buf), file)) > 0)
+    contents.Append (buf, n);
+  fclose (file);
+
+  csStringArray lines;
+  lines.SplitString (contents, "\n");
+  if ((lines.GetSize() == 0) || (strcmp (lines[0], cacheHeader) != 0))
+    return;
+
+  size_t l = 1;
+  while (l < lines.GetSize())
+  {
+    const char* p = lines[l++];
+    if (*p == 0) continue;
+    PluginInfo info;
+    int64 hasMetadata, numClasses;
+    if ((p[0] != 'P') || (p[1] != '\t')) break;
+    p += 2;
+    if (!ParseInt64 (p, info.size) || !ParseInt64 (p, info.mtime)
+      || !ParseInt64 (p, info.metaSize) || !ParseInt64 (p, info.metaMTime)
+      || !ParseInt64 (p, hasMetadata) || !ParseInt64 (p, numClasses))
+      break;
+    info.path = p;
+    info.hasMetadata = hasMetadata != 0;
+    for (int64 c = 0; c < numClasses; c++)
+    {
+      if (l >= lines.GetSize()) return;
+      p = lines[l++];
+      if ((p[0] != 'C') || (p[1] != '\t')) return;
+      p += 2;
+      ClassInfo& classInfo = info.classes.GetExtend (info.classes.GetSize());
+      classInfo.name = NextField (p);
+      classInfo.implementation = NextField (p);
+      classInfo.description = NextField (p);
+      classInfo.dependencies = NextField (p);
+    }
+    entries.PutUnique (info.path, info);
+  }
+}
+
+void scfPluginCache::Prune ()
+{
+  csArray<csString> stale;
+  csHash<PluginInfo, csString>::GlobalIterator it (entries.GetIterator());
+  while (it.HasNext())
+  {
+    const PluginInfo& info = it.Next();
+    if (seen.Contains (info.path)) continue;
+    struct stat st;
+    if (keepSeenOnly || (stat (info.path, &st) != 0))
+      stale.Push (info.path);
+  }
+  for (size_t i = 0; i < stale.GetSize(); i++)
+    entries.DeleteAll (stale[i]);
+  if (stale.GetSize() > 0) dirty = true;
+}
+
+void scfPluginCache::Save ()
+{
+  // Write to a temporary file first so concurrent readers never see a
+  // partially written cache. The name is unique per process so processes
+  // starting at the same time don't write into the same file.
+  csString tmpName;
+  tmpName.Format ("%s.%d.tmp", filename.GetData(), int (getpid ()));
+  FILE* file = fopen (tmpName, "wb");
+  if (file == 0)
+  {
+    // Create the directory the cache lives in
+    csString dir (filename);
+    size_t slash = dir.FindLast (CS_PATH_SEPARATOR);
+    if (slash == (size_t)-1) return;
+    dir.Truncate (slash);
+    CS_MKDIR (dir);
+    file = fopen (tmpName, "wb");
+    if (file == 0) return;
+  }
+
+  csString line;
+  fprintf (file, "%s\n", cacheHeader);
+  csHash<PluginInfo, csString>::GlobalIterator it (entries.GetIterator());
+  while (it.HasNext())
+  {
+    const PluginInfo& info = it.Next();
+    line.Format ("P\t%" CS_PRId64 "\t%" CS_PRId64 "\t%" CS_PRId64 "\t%"
+      CS_PRId64 "\t%d\t%zu", info.size, info.mtime, info.metaSize,
+      info.metaMTime, info.hasMetadata ? 1 : 0, info.classes.GetSize());
+    AppendField (line, info.path);
+    line << '\n';
+    for (size_t c = 0; c < info.classes.GetSize(); c++)
+    {
+      const ClassInfo& classInfo = info.classes[c];
+      line << 'C';
+      AppendField (line, classInfo.name);
+      AppendField (line, classInfo.implementation);
+      AppendField (line, classInfo.description);
+      AppendField (line, classInfo.dependencies);
+      line << '\n';
+    }
+    fwrite (line.GetData(), 1, line.Length(), file);
+  }
+  bool ok = (ferror (file) == 0);
+  ok &= (fclose (file) == 0);
+  // rename() doesn't replace existing files everywhere
+  if (ok)
+  {
+    remove (filename);
+    ok = (rename (tmpName, filename) == 0);
+  }
+  if (!ok) remove (tmpName);
+}
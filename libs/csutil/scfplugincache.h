@@ -0,0 +1,115 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_LIBS_CSUTIL_SCFPLUGINCACHE_H__
+#define __CS_LIBS_CSUTIL_SCFPLUGINCACHE_H__
+
+#include "csutil/array.h"
+#include "csutil/csstring.h"
+#include "csutil/hash.h"
+#include "csutil/set.h"
+
+struct iDocument;
+struct iDocumentNode;
+struct iStringArray;
+
+/**
+ * Cache of the SCF class registrations of plugin modules.
+ *
+ * Retrieving plugin metadata means opening each module, extracting the
+ * embedded metadata and parsing it as XML. The cache keeps the resulting
+ * class registrations in a file, keyed by the module path, size and
+ * modification time (and those of a .csplugin file next to it), so later
+ * scans only need to stat() the modules. Modules missing from the cache or
+ * changed since are examined on several threads. Entries for modules that
+ * no longer exist are dropped when the cache is written back.
+ */
+class scfPluginCache
+{
+public:
+  /// Registration data of a class
+  struct ClassInfo
+  {
+    csString name;
+    csString implementation;
+    csString description;
+    /// Comma-delimited list of required classes
+    csString dependencies;
+  };
+
+  /// Metadata retrieved for one plugin module
+  struct PluginInfo
+  {
+    csString path;
+    int64 size;
+    int64 mtime;
+    /// Size and modification time of a .csplugin file, -1 if none exists
+    int64 metaSize;
+    int64 metaMTime;
+    /// Whether metadata was found; other modules are not CS plugins
+    bool hasMetadata;
+    csArray<ClassInfo> classes;
+    /// Error or warning retrieving the metadata; such results aren't cached
+    csString message;
+
+    PluginInfo () : size (-1), mtime (-1), metaSize (-1), metaMTime (-1),
+      hasMetadata (false) {}
+  };
+
+  /**
+   * Read the classes from an <scf> metadata node. Returns false if the
+   * node isn't there.
+   */
+  static bool ReadClasses (iDocument* metadata, csArray<ClassInfo>& classes,
+    csString& error);
+
+  /**
+   * Cache backed by \a filename; 0 for no persistent cache. If
+   * \a keepSeenOnly is set the scan using this cache covers all plugin
+   * paths, so only the modules it has seen are written back.
+   */
+  scfPluginCache (const char* filename, bool keepSeenOnly = false);
+  /// Writes the cache back if it changed.
+  ~scfPluginCache ();
+
+  /**
+   * Get the metadata of the given plugin modules. Up to date results come
+   * from the cache, the others are retrieved (in parallel) and cached.
+   */
+  void GetMetadata (iStringArray* plugins, csArray<PluginInfo>& infos);
+private:
+  csString filename;
+  csHash<PluginInfo, csString> entries;
+  /// Paths of all modules passed to GetMetadata()
+  csSet<csString> seen;
+  bool keepSeenOnly;
+  bool dirty;
+
+  /// Fill the key of \a info from the file system; false if not found
+  static bool Stat (PluginInfo& info);
+  /// Retrieve the metadata for \a info from the module
+  static void Retrieve (PluginInfo& info);
+  class RetrieveRunnable;
+
+  void Load ();
+  /// Remove entries of modules that weren't seen or don't exist any more
+  void Prune ();
+  void Save ();
+};
+
+#endif // __CS_LIBS_CSUTIL_SCFPLUGINCACHE_H__
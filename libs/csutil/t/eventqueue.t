@@ -20,6 +20,8 @@
 #include "csutil/cssubscription.h"
 #include "csutil/eventnames.h"
 #include "csutil/cseventq.h"
+#include "csutil/csevent.h"
+#include "csutil/threading/thread.h"
 
 static csList<csString *> *handlers;
 
@@ -91,6 +93,27 @@ private:
     CS_EVENTHANDLER_PHASE_FRAME("unit.test.other");
   };
 
+  /// Posts a numbered sequence of events from its own thread.
+  class Poster : public CS::Threading::Runnable
+  {
+    csEventQueue* queue;
+    int32 id;
+    int32 num;
+  public:
+    Poster (csEventQueue* queue, int32 id, int32 num) : queue (queue),
+      id (id), num (num) {}
+
+    void Run ()
+    {
+      for (int32 i = 0; i < num; i++)
+      {
+        csRef<iEvent> ev = queue->CreateEvent ("unit.test.post");
+        ev->Add ("producer", id);
+        ev->Add ("seq", i);
+        queue->Post (ev);
+      }
+    }
+  };
 
 public:
   /**
@@ -109,11 +132,17 @@ public:
   void testPhaseHandlers ();
   void testFrameSubEvents ();
   void testMixedHandlers ();
+  void testPostOrder ();
+  void testThreadedPost ();
+  void testAttributes ();
 
   CPPUNIT_TEST_SUITE (csEventQueueTest);
     CPPUNIT_TEST (testSmokeTest);
     CPPUNIT_TEST (testPhaseHandlers);
     CPPUNIT_TEST (testMixedHandlers);
+    CPPUNIT_TEST (testPostOrder);
+    CPPUNIT_TEST (testThreadedPost);
+    CPPUNIT_TEST (testAttributes);
   CPPUNIT_TEST_SUITE_END ();
 };
 
@@ -232,3 +261,127 @@ void csEventQueueTest::testMixedHandlers ()
 {
 
 }
+
+/**
+ * Make sure events come out in posting order, also when the posting ring
+ * overflows.
+ */
+void csEventQueueTest::testPostOrder ()
+{
+  csRef<csEventQueue> queue;
+  queue.AttachNew (new csEventQueue (objreg, 4));
+
+  for (int32 i = 0; i < 20; i++)
+  {
+    csRef<iEvent> ev = queue->CreateEvent ("unit.test.post");
+    ev->Add ("seq", i);
+    queue->Post (ev);
+  }
+  for (int32 i = 0; i < 20; i++)
+  {
+    csRef<iEvent> ev = queue->Get ();
+    CPPUNIT_ASSERT (ev.IsValid ());
+    int32 seq = -1;
+    CPPUNIT_ASSERT_EQUAL (csEventErrNone, ev->Retrieve ("seq", seq));
+    CPPUNIT_ASSERT_EQUAL (i, seq);
+  }
+  CPPUNIT_ASSERT (queue->IsEmpty ());
+  csRef<iEvent> ev = queue->Get ();
+  CPPUNIT_ASSERT (!ev.IsValid ());
+}
+
+/**
+ * Post from several threads at once; events of each thread must arrive
+ * complete and in order.
+ */
+void csEventQueueTest::testThreadedPost ()
+{
+  static const int numThreads = 4;
+  static const int32 numEvents = 10000;
+  csRef<csEventQueue> queue;
+  queue.AttachNew (new csEventQueue (objreg, 16));
+
+  csRef<Poster> posters[numThreads];
+  csRef<CS::Threading::Thread> threads[numThreads];
+  int32 last[numThreads];
+  for (int t = 0; t < numThreads; t++)
+  {
+    last[t] = -1;
+    posters[t].AttachNew (new Poster (queue, t, numEvents));
+    threads[t].AttachNew (new CS::Threading::Thread (posters[t], true));
+  }
+  int received = 0;
+  while (received < numThreads * numEvents)
+  {
+    csRef<iEvent> ev = queue->Get ();
+    if (!ev.IsValid ()) continue;
+    int32 id = -1, seq = -1;
+    CPPUNIT_ASSERT_EQUAL (csEventErrNone, ev->Retrieve ("producer", id));
+    CPPUNIT_ASSERT_EQUAL (csEventErrNone, ev->Retrieve ("seq", seq));
+    CPPUNIT_ASSERT (id >= 0 && id < numThreads);
+    CPPUNIT_ASSERT_EQUAL (last[id] + 1, seq);
+    last[id] = seq;
+    received++;
+  }
+  for (int t = 0; t < numThreads; t++)
+    threads[t]->Wait ();
+  CPPUNIT_ASSERT (queue->IsEmpty ());
+}
+
+/**
+ * Exercise event attributes beyond the number kept inline in the event.
+ */
+void csEventQueueTest::testAttributes ()
+{
+  csRef<csEventQueue> queue;
+  queue.AttachNew (new csEventQueue (objreg));
+  csRef<iEvent> ev = queue->CreateEvent ("unit.test.attr");
+
+  csString name;
+  for (int32 i = 0; i < 12; i++)
+  {
+    name.Format ("attr%d", (int)i);
+    CPPUNIT_ASSERT (ev->Add (name, i));
+  }
+  CPPUNIT_ASSERT (!ev->Add ("attr3", (int32)0));
+  CPPUNIT_ASSERT (!ev->Add ("attr10", (int32)0));
+  CPPUNIT_ASSERT (ev->Add ("text", "hello"));
+  const char data[] = { 1, 2, 0, 3 };
+  CPPUNIT_ASSERT (ev->Add ("data", data, sizeof (data)));
+  CPPUNIT_ASSERT (!ev->Add ("data", data, sizeof (data)));
+  CPPUNIT_ASSERT (!ev->Add ("attr1", data, sizeof (data)));
+  CPPUNIT_ASSERT (ev->Remove ("attr2"));
+  CPPUNIT_ASSERT (ev->Remove ("attr11"));
+  CPPUNIT_ASSERT (!ev->AttributeExists ("attr2"));
+
+  int count = 0;
+  csRef<iEventAttributeIterator> it = ev->GetAttributeIterator ();
+  while (it->HasNext ())
+  {
+    it->Next ();
+    count++;
+  }
+  CPPUNIT_ASSERT_EQUAL (12, count);
+
+  csRef<csEvent> copy;
+  copy.AttachNew (new csEvent (*static_cast<csEvent*> ((iEvent*)ev)));
+  for (int32 i = 0; i < 11; i++)
+  {
+    if (i == 2) continue;
+    name.Format ("attr%d", (int)i);
+    int32 v = -1;
+    CPPUNIT_ASSERT_EQUAL (csEventErrNone, ev->Retrieve (name, v));
+    CPPUNIT_ASSERT_EQUAL (i, v);
+    v = -1;
+    CPPUNIT_ASSERT_EQUAL (csEventErrNone, copy->Retrieve (name, v));
+    CPPUNIT_ASSERT_EQUAL (i, v);
+  }
+  const char* text = 0;
+  CPPUNIT_ASSERT_EQUAL (csEventErrNone, copy->Retrieve ("text", text));
+  CPPUNIT_ASSERT_EQUAL (csString ("hello"), csString (text));
+  const void* buffer = 0;
+  size_t size = 0;
+  CPPUNIT_ASSERT_EQUAL (csEventErrNone, copy->Retrieve ("data", buffer, size));
+  CPPUNIT_ASSERT_EQUAL (sizeof (data), size);
+  CPPUNIT_ASSERT (memcmp (buffer, data, size) == 0);
+}
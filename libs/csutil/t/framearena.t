@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csutil/framearena.h"
+
+/**
+ * Test CS::Memory::FrameArena.
+ */
+class FrameArenaTest : public CppUnit::TestFixture
+{
+public:
+  void testAlloc();
+  void testReset();
+  void testArray();
+
+  CPPUNIT_TEST_SUITE(FrameArenaTest);
+    CPPUNIT_TEST(testAlloc);
+    CPPUNIT_TEST(testReset);
+    CPPUNIT_TEST(testArray);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+void FrameArenaTest::testAlloc()
+{
+  CS::Memory::FrameArena arena (256);
+  uint8* p1 = (uint8*)arena.Alloc (10);
+  uint8* p2 = (uint8*)arena.Alloc (10);
+  CPPUNIT_ASSERT((uintptr_t (p1) & 15) == 0);
+  CPPUNIT_ASSERT((uintptr_t (p2) & 15) == 0);
+  CPPUNIT_ASSERT(p2 >= p1 + 10);
+  // Bigger than a chunk
+  uint8* p3 = (uint8*)arena.Alloc (1000);
+  memset (p3, 0xaa, 1000);
+  CPPUNIT_ASSERT(p3 != 0);
+  // In-place resizing works only for the most recent allocation
+  CPPUNIT_ASSERT(arena.Realloc (p3, 500) == p3);
+  CPPUNIT_ASSERT(arena.Realloc (p1, 20) == 0);
+}
+
+void FrameArenaTest::testReset()
+{
+  CS::Memory::FrameArena arena (256);
+  for (int i = 0; i < 10; i++)
+    arena.Alloc (100, 4);
+  size_t const used = arena.GetUsedBytes();
+  CPPUNIT_ASSERT(used >= 1000);
+  arena.Reset();
+  CPPUNIT_ASSERT_EQUAL(used, arena.GetLastFrameBytes());
+  CPPUNIT_ASSERT_EQUAL((size_t)0, arena.GetUsedBytes());
+  // The next frame of the same size fits into a single chunk
+  uint8* first = (uint8*)arena.Alloc (100, 4);
+  for (int i = 1; i < 10; i++)
+  {
+    uint8* p = (uint8*)arena.Alloc (100, 4);
+    CPPUNIT_ASSERT(p == first + i * 100);
+  }
+  CPPUNIT_ASSERT(arena.GetReservedBytes() >= used);
+}
+
+void FrameArenaTest::testArray()
+{
+  CS::Memory::FrameArena arena (256);
+  csArray<int, csArrayElementHandler<int>, CS::Memory::FrameArenaAllocator>
+    a (0, CS::Memory::FrameArenaAllocator (arena),
+      csArrayCapacityFixedGrow<16> ());
+  for (int i = 0; i < 1000; i++)
+  {
+    a.Push (i);
+    // Interleave with other allocations to force copies
+    if (i % 100 == 0) arena.Alloc (8);
+  }
+  for (int i = 0; i < 1000; i++)
+    CPPUNIT_ASSERT_EQUAL(i, a[i]);
+}
@@ -0,0 +1,188 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csutil/threadcachedallocator.h"
+#include "csutil/set.h"
+#include "csutil/threading/thread.h"
+
+/**
+ * Test CS::Memory::FixedSizeAllocatorThreadCached and
+ * CS::Memory::BlockAllocatorThreadCached.
+ */
+class ThreadCachedAllocatorTest : public CppUnit::TestFixture
+{
+private:
+  class SideEffect
+  {
+  private:
+    int id;
+    csSet<int>* registry;
+  public:
+    SideEffect() : id(0), registry(0) {}
+    ~SideEffect() { if (registry != 0) registry->Delete(id); }
+    void Register(int i, csSet<int>* r) { id = i, registry = r; r->Add(i); }
+  };
+
+  typedef CS::Memory::FixedSizeAllocatorThreadCached<sizeof (int)>
+    IntAllocator;
+
+  /// Allocates, checks and frees blocks; frees half of them in another thread.
+  class Worker : public CS::Threading::Runnable
+  {
+    IntAllocator& alloc;
+    int id;
+    int** passOn;
+    bool failed;
+  public:
+    Worker (IntAllocator& alloc, int id, int** passOn) : alloc (alloc),
+      id (id), passOn (passOn), failed (false) {}
+
+    void Run ()
+    {
+      int* p[100];
+      for (int r = 0; r < 200; r++)
+      {
+        for (int i = 0; i < 100; i++)
+        {
+          p[i] = (int*)alloc.Alloc ();
+          *p[i] = id * 1000 + i;
+        }
+        for (int i = 0; i < 100; i++)
+        {
+          if (*p[i] != id * 1000 + i) failed = true;
+          if (i & 1)
+            alloc.Free (p[i]);
+          else
+            passOn[r * 50 + i / 2] = p[i];
+        }
+      }
+      alloc.FlushThreadCache ();
+    }
+    bool Failed () const { return failed; }
+  };
+
+public:
+  void testDestroy();
+  void testRecycle();
+  void testCount();
+  void testThreads();
+
+  CPPUNIT_TEST_SUITE(ThreadCachedAllocatorTest);
+    CPPUNIT_TEST(testDestroy);
+    CPPUNIT_TEST(testRecycle);
+    CPPUNIT_TEST(testCount);
+    CPPUNIT_TEST(testThreads);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+void ThreadCachedAllocatorTest::testDestroy()
+{
+  csSet<int> r;
+
+  { // SCOPE
+    CS::Memory::BlockAllocatorThreadCached<SideEffect> b(3);
+    SideEffect* e1 = b.Alloc();
+    SideEffect* e2 = b.Alloc();
+    SideEffect* e3 = b.Alloc();
+    SideEffect* e4 = b.Alloc();
+    e1->Register(1,&r);
+    e2->Register(2,&r);
+    e3->Register(3,&r);
+    e4->Register(4,&r);
+
+    b.Free(e2);
+    b.Free(e4);
+    CPPUNIT_ASSERT( r.Contains(1));
+    CPPUNIT_ASSERT(!r.Contains(2));
+    CPPUNIT_ASSERT( r.Contains(3));
+    CPPUNIT_ASSERT(!r.Contains(4));
+  }
+
+  CPPUNIT_ASSERT(r.IsEmpty());
+}
+
+void ThreadCachedAllocatorTest::testRecycle()
+{
+  CS::Memory::BlockAllocatorThreadCached<int> b(3);
+  int* o1 = b.Alloc();
+  int* o2 = b.Alloc();
+  int* o3 = b.Alloc();
+  int* o4 = b.Alloc();
+  b.Free(o3);
+  b.Free(o2);
+  b.Free(o4);
+  b.Free(o1);
+  int* n1 = b.Alloc();
+  int* n2 = b.Alloc();
+  int* n3 = b.Alloc();
+  int* n4 = b.Alloc();
+  CPPUNIT_ASSERT(n1 == o1 || n1 == o2 || n1 == o3 || n1 == o4);
+  CPPUNIT_ASSERT(n2 == o1 || n2 == o2 || n2 == o3 || n2 == o4);
+  CPPUNIT_ASSERT(n3 == o1 || n3 == o2 || n3 == o3 || n3 == o4);
+  CPPUNIT_ASSERT(n4 == o1 || n4 == o2 || n4 == o3 || n4 == o4);
+  int dummy;
+  CPPUNIT_ASSERT(!b.TryFree(&dummy));
+}
+
+void ThreadCachedAllocatorTest::testCount()
+{
+  IntAllocator b(8);
+  void* p[100];
+  for (int i = 0; i < 100; i++)
+    p[i] = b.Alloc();
+  CPPUNIT_ASSERT_EQUAL((size_t)100, b.GetAllocatedElems());
+  for (int i = 0; i < 100; i += 2)
+    b.Free(p[i]);
+  CPPUNIT_ASSERT_EQUAL((size_t)50, b.GetAllocatedElems());
+  b.Empty();
+  CPPUNIT_ASSERT_EQUAL((size_t)0, b.GetAllocatedElems());
+  p[0] = b.Alloc();
+  CPPUNIT_ASSERT_EQUAL((size_t)1, b.GetAllocatedElems());
+}
+
+void ThreadCachedAllocatorTest::testThreads()
+{
+  static const int numThreads = 4;
+  IntAllocator b;
+  int** passOn = new int*[numThreads * 200 * 50];
+  csRef<Worker> workers[numThreads];
+  csRef<CS::Threading::Thread> threads[numThreads];
+  for (int t = 0; t < numThreads; t++)
+  {
+    workers[t].AttachNew (new Worker (b, t, passOn + t * 200 * 50));
+    threads[t].AttachNew (new CS::Threading::Thread (workers[t], true));
+  }
+  for (int t = 0; t < numThreads; t++)
+  {
+    threads[t]->Wait ();
+    CPPUNIT_ASSERT(!workers[t]->Failed ());
+  }
+  // Blocks kept must still hold the values written by their thread.
+  for (int t = 0; t < numThreads; t++)
+  {
+    for (int i = 0; i < 200 * 50; i++)
+      CPPUNIT_ASSERT_EQUAL(t * 1000 + (i % 50) * 2, *passOn[t * 200 * 50 + i]);
+  }
+  CPPUNIT_ASSERT_EQUAL((size_t)(numThreads * 200 * 50),
+    b.GetAllocatedElems());
+  // Blocks allocated by other threads can be freed here.
+  for (int i = 0; i < numThreads * 200 * 50; i++)
+    b.Free (passOn[i]);
+  CPPUNIT_ASSERT_EQUAL((size_t)0, b.GetAllocatedElems());
+  delete[] passOn;
+}
@@ -28,8 +28,14 @@
 
 #include <bfd.h>
 
+#include "csutil/threading/mutex.h"
+
+// libbfd is not thread-safe, but plugin metadata is retrieved in parallel
+static CS::Threading::Mutex bfdLock;
+
 char* csExtractMetadata (const char* fullPath, const char*& errMsg)
 {
+  CS::Threading::MutexScopedLock lock (bfdLock);
   char* buf = 0;
   bfd *abfd = bfd_openr (fullPath, 0);
   if (abfd)
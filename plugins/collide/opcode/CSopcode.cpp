@@ -1060,5 +1060,10 @@ bool csOPCODECollideSystem::GetOneHitOnly ()
   return (TreeCollider.FirstContactEnabled () != FALSE);
 }
 
+csPtr<iCollisionBroadPhase> csOPCODECollideSystem::CreateBroadPhase ()
+{
+  return csPtr<iCollisionBroadPhase> (new csOPCODEBroadPhase ());
+}
+
 }
 CS_PLUGIN_NAMESPACE_END(csOpcode)
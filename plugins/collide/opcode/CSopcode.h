@@ -38,6 +38,7 @@
 #include "csgeom/transfrm.h"
 #include "imesh/terrain2.h"
 #include "CSopcodecollider.h"
+#include "CSopcodebroadphase.h"
 #include "csTerraFormerCollider.h"
 #include "Opcode.h"
 
@@ -209,6 +210,8 @@ public:
    * For CD systems that support one hit only this will always return true.
    */
   virtual bool GetOneHitOnly ();
+
+  virtual csPtr<iCollisionBroadPhase> CreateBroadPhase ();
 };
 
 }
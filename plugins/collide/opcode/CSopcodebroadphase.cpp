@@ -0,0 +1,151 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "CSopcodebroadphase.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(csOpcode)
+{
+
+using namespace Opcode;
+
+csOPCODEBroadPhase::csOPCODEBroadPhase () :
+  scfImplementationType (this), boxCount (0), rebuild (true)
+{
+}
+
+csOPCODEBroadPhase::~csOPCODEBroadPhase ()
+{
+}
+
+void csOPCODEBroadPhase::ToAABB (const csBox3& box, IceMaths::AABB& aabb)
+{
+  const csVector3& bmin = box.Min ();
+  const csVector3& bmax = box.Max ();
+  aabb.SetMinMax (Point (bmin.x, bmin.y, bmin.z),
+    Point (bmax.x, bmax.y, bmax.z));
+}
+
+size_t csOPCODEBroadPhase::AddBox (const csBox3& box)
+{
+  size_t id;
+  if (freeSlots.GetSize () > 0)
+    id = freeSlots.Pop ();
+  else
+    id = slots.Push (Slot ());
+  Slot& slot = slots[id];
+  slot.box = box;
+  slot.sapIndex = csArrayItemNotFound;
+  slot.used = true;
+  slot.dirty = false;
+  boxCount++;
+  rebuild = true;
+  return id;
+}
+
+void csOPCODEBroadPhase::UpdateBox (size_t id, const csBox3& box)
+{
+  CS_ASSERT (id < slots.GetSize () && slots[id].used);
+  Slot& slot = slots[id];
+  slot.box = box;
+  if (!rebuild && !slot.dirty)
+  {
+    slot.dirty = true;
+    dirtySlots.Push (id);
+  }
+}
+
+void csOPCODEBroadPhase::RemoveBox (size_t id)
+{
+  CS_ASSERT (id < slots.GetSize () && slots[id].used);
+  slots[id].used = false;
+  freeSlots.Push (id);
+  boxCount--;
+  rebuild = true;
+}
+
+void csOPCODEBroadPhase::Rebuild ()
+{
+  sapToSlot.Empty ();
+  dirtySlots.Empty ();
+  csArray<IceMaths::AABB> aabbs;
+  aabbs.SetCapacity (boxCount);
+  for (size_t i = 0 ; i < slots.GetSize () ; i++)
+  {
+    Slot& slot = slots[i];
+    slot.dirty = false;
+    if (!slot.used) continue;
+    slot.sapIndex = sapToSlot.Push (i);
+    ToAABB (slot.box, aabbs.GetExtend (slot.sapIndex));
+  }
+
+  CS_ALLOC_STACK_ARRAY(const IceMaths::AABB*, aabbPtrs, aabbs.GetSize ());
+  for (size_t i = 0 ; i < aabbs.GetSize () ; i++)
+    aabbPtrs[i] = &aabbs[i];
+  sap.Init ((udword)aabbs.GetSize (), aabbPtrs);
+  rebuild = false;
+}
+
+BOOL csOPCODEBroadPhase::PairCallback (udword id0, udword id1,
+  void* user_data)
+{
+  csOPCODEBroadPhase* bp = (csOPCODEBroadPhase*)user_data;
+  csBroadPhasePair pair;
+  pair.id0 = bp->sapToSlot[id0];
+  pair.id1 = bp->sapToSlot[id1];
+  if (pair.id0 > pair.id1)
+  {
+    size_t t = pair.id0; pair.id0 = pair.id1; pair.id1 = t;
+  }
+  bp->pairs.Push (pair);
+  return TRUE;
+}
+
+const csArray<csBroadPhasePair>& csOPCODEBroadPhase::GetOverlappingPairs ()
+{
+  pairs.Empty ();
+  // The sweep-and-prune can't deal with less than two boxes.
+  if (boxCount < 2)
+  {
+    rebuild = true;
+    return pairs;
+  }
+
+  if (rebuild)
+  {
+    Rebuild ();
+  }
+  else
+  {
+    IceMaths::AABB aabb;
+    for (size_t i = 0 ; i < dirtySlots.GetSize () ; i++)
+    {
+      Slot& slot = slots[dirtySlots[i]];
+      slot.dirty = false;
+      ToAABB (slot.box, aabb);
+      sap.UpdateObject ((udword)slot.sapIndex, aabb);
+    }
+    dirtySlots.Empty ();
+  }
+
+  sap.GetPairs (PairCallback, this);
+  return pairs;
+}
+
+}
+CS_PLUGIN_NAMESPACE_END(csOpcode)
@@ -0,0 +1,80 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_OPCODEBROADPHASE_H__
+#define __CS_OPCODEBROADPHASE_H__
+
+#include "csgeom/box.h"
+#include "csutil/array.h"
+#include "csutil/scf_implementation.h"
+#include "ivaria/collider.h"
+#include "Opcode.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(csOpcode)
+{
+
+/**
+ * Broad phase based on the OPCODE sweep-and-prune implementation.
+ * Moving boxes are updated incrementally in the sorted endpoint lists.
+ * Adding or removing boxes causes the lists to be rebuilt (with box
+ * pruning) on the next query.
+ */
+class csOPCODEBroadPhase :
+  public scfImplementation1<csOPCODEBroadPhase, iCollisionBroadPhase>
+{
+private:
+  struct Slot
+  {
+    csBox3 box;
+    /// Index in the sweep-and-prune or csArrayItemNotFound.
+    size_t sapIndex;
+    bool used;
+    bool dirty;
+  };
+  csArray<Slot> slots;
+  csArray<size_t> freeSlots;
+  /// Slots that moved since the last query.
+  csArray<size_t> dirtySlots;
+  /// Maps sweep-and-prune indices back to slots.
+  csArray<size_t> sapToSlot;
+  size_t boxCount;
+  /// The sweep-and-prune lists have to be rebuilt from scratch.
+  bool rebuild;
+
+  Opcode::SweepAndPrune sap;
+  csArray<csBroadPhasePair> pairs;
+
+  static void ToAABB (const csBox3& box, IceMaths::AABB& aabb);
+  static BOOL PairCallback (udword id0, udword id1, void* user_data);
+  void Rebuild ();
+
+public:
+  csOPCODEBroadPhase ();
+  virtual ~csOPCODEBroadPhase ();
+
+  virtual size_t AddBox (const csBox3& box);
+  virtual void UpdateBox (size_t id, const csBox3& box);
+  virtual void RemoveBox (size_t id);
+  virtual size_t GetBoxCount () const { return boxCount; }
+  virtual const csArray<csBroadPhasePair>& GetOverlappingPairs ();
+};
+
+}
+CS_PLUGIN_NAMESPACE_END(csOpcode)
+
+#endif // __CS_OPCODEBROADPHASE_H__
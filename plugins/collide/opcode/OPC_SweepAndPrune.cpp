@@ -390,8 +390,11 @@ void SAP_PairData::DumpPairs(PairCallback callback, void* user_data) const
  *	Constructor.
  */
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-SweepAndPrune::SweepAndPrune()
+SweepAndPrune::SweepAndPrune() :
+	mNbObjects	(0),
+	mBoxes		(null)
 {
+	mList[0] = mList[1] = mList[2] = null;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -401,6 +404,16 @@ SweepAndPrune::SweepAndPrune()
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 SweepAndPrune::~SweepAndPrune()
 {
+	Release();
+}
+
+void SweepAndPrune::Release()
+{
+	mNbObjects = 0;
+	DELETEARRAY(mBoxes);
+	DELETEARRAY(mList[0]);
+	DELETEARRAY(mList[1]);
+	DELETEARRAY(mList[2]);
 }
 
 void SweepAndPrune::GetPairs(Pairs& pairs) const
@@ -415,6 +428,12 @@ void SweepAndPrune::GetPairs(PairCallback callback, void* user_data) const
 
 bool SweepAndPrune::Init(udword nb_objects, const AABB** boxes)
 {
+	// Make sure everything has been released, Init() may be called again
+	// to rebuild the lists from scratch
+	Release();
+	mPairs.Init(0);
+	if(!nb_objects)	return false;
+
 	// 1) Create sorted lists
 	mNbObjects = nb_objects;
 
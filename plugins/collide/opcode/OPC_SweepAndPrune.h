@@ -81,6 +81,7 @@
 				SAP_EndPoint*	mList[3];
 		// Internal methods
 				bool			CheckListsIntegrity();
+				void			Release();
 	};
 
 #endif //__OPC_SWEEPANDPRUNE_H__
@@ -0,0 +1,526 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+
+#include "csgeom/tri.h"
+#include "csgfx/renderbuffer.h"
+#include "csgfx/shadervar.h"
+#include "cstool/compiledworld.h"
+#include "iengine/campos.h"
+#include "iengine/engine.h"
+#include "iengine/light.h"
+#include "iengine/material.h"
+#include "iengine/mesh.h"
+#include "iengine/movable.h"
+#include "iengine/sector.h"
+#include "iengine/texture.h"
+#include "imap/ldrctxt.h"
+#include "imesh/genmesh.h"
+#include "imesh/object.h"
+#include "iutil/databuff.h"
+#include "iutil/object.h"
+#include "iutil/vfs.h"
+#include "ivideo/material.h"
+#include "ivideo/shader/shader.h"
+
+#include "csthreadedloader.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(csparser)
+{
+  using namespace CS::Utility::CompiledWorld;
+
+  namespace
+  {
+    /// Bounds checked access to the contents of a record
+    class RecordReader
+    {
+      const uint8* p;
+      const uint8* end;
+    public:
+      RecordReader (const uint8* data, size_t size) : p (data),
+        end (data + size) {}
+
+      /// Get the next \a count items, 0 if the record is too short
+      template<typename T>
+      const T* Get (size_t count = 1)
+      {
+        size_t size = ((sizeof (T) * count) + 3) & ~3;
+        if (size_t (end - p) < size) return 0;
+        const T* data = (const T*)p;
+        p += size;
+        return data;
+      }
+    };
+
+    /// Access to the strings of a compiled world
+    class StringTable
+    {
+      const char* strings;
+      uint32 size;
+    public:
+      StringTable () : strings (0), size (0) {}
+
+      void Set (const uint8* data, uint32 dataSize)
+      {
+        strings = (const char*)data;
+        size = dataSize;
+        // Padding or the last string make sure the data ends with a null
+        if ((size > 0) && (strings[size - 1] != 0)) size = 0;
+      }
+
+      const char* Get (uint32 offset) const
+      {
+        return (offset < size) ? strings + offset : 0;
+      }
+    };
+
+    template<typename T>
+    static T* GetIndexed (const csRefArray<T>& array, uint32 index)
+    {
+      if (index >= array.GetSize ()) return 0;
+      return array[index];
+    }
+
+    /// Check that all triangle corners refer to one of \a numVertices
+    static bool CheckTriangles (const csTriangle* triangles, uint32 num,
+                                uint32 numVertices)
+    {
+      for (uint32 i = 0; i < num; i++)
+      {
+        const csTriangle& tri = triangles[i];
+        if ((uint32 (tri.a) >= numVertices) || (uint32 (tri.b) >= numVertices)
+          || (uint32 (tri.c) >= numVertices))
+          return false;
+      }
+      return true;
+    }
+
+    /**
+     * Check the submeshes that follow a factory: all indices must lie in
+     * the submesh index range, which must lie within \a numVertices.
+     * Returns false if a submesh is truncated or an index is out of range.
+     */
+    static bool CheckSubMeshes (RecordReader rec, uint32 numSubMeshes,
+                                uint32 numVertices)
+    {
+      for (uint32 s = 0; s < numSubMeshes; s++)
+      {
+        const SubMesh* submesh = rec.Get<SubMesh> ();
+        const uint32* indices = submesh
+          ? rec.Get<uint32> (submesh->numIndices) : 0;
+        if (!indices) return false;
+        if ((submesh->minIndex > submesh->maxIndex)
+          || (submesh->maxIndex >= numVertices))
+          return false;
+        for (uint32 i = 0; i < submesh->numIndices; i++)
+        {
+          if ((indices[i] < submesh->minIndex)
+            || (indices[i] > submesh->maxIndex))
+            return false;
+        }
+      }
+      return true;
+    }
+
+    static void GetTransform (csReversibleTransform& tf,
+                              const Transform& data)
+    {
+      const float* m = data.matrix;
+      tf.SetO2T (csMatrix3 (m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7],
+        m[8]));
+      tf.SetOrigin (csVector3 (data.origin[0], data.origin[1],
+        data.origin[2]));
+    }
+  }
+
+  bool csThreadedLoader::LoadCompiledWorld (iLoaderContext* ldr_context,
+                                            iDataBuffer* data,
+                                            const char* fname)
+  {
+    const uint8* p = data->GetUint8 ();
+    const uint8* end = p + data->GetSize ();
+    const Header* header = (const Header*)p;
+    if ((data->GetSize () < sizeof (Header)) || (header->magic != magic))
+    {
+      ReportError ("crystalspace.maploader.parse.compiledworld",
+        "'%s' is not a compiled world", fname);
+      return false;
+    }
+    if ((header->byteOrder != byteOrder) || (header->version != version))
+    {
+      ReportError ("crystalspace.maploader.parse.compiledworld",
+        "Compiled world '%s' was made for another version or platform, "
+        "please recompile it", fname);
+      return false;
+    }
+    p += sizeof (Header);
+
+    csRef<iShaderManager> shaderMgr =
+      csQueryRegistry<iShaderManager> (object_reg);
+    csString cwd = vfs->GetCwd ();
+    StringTable strings;
+    csRefArray<iShader> shaders;
+    csRefArray<iTextureWrapper> textures;
+    csRefArray<iMaterialWrapper> materials;
+    csRefArray<iMeshFactoryWrapper> factories;
+    csRefArray<iSector> sectors;
+    csRefArray<iThreadReturn> threadReturns;
+    bool error = false;
+
+    for (uint32 r = 0; (r < header->numRecords) && !error; r++)
+    {
+      const RecordHeader* recHeader = (const RecordHeader*)p;
+      if ((size_t (end - p) < sizeof (RecordHeader))
+        || (size_t (end - p) - sizeof (RecordHeader) < recHeader->size))
+      {
+        error = true;
+        break;
+      }
+      p += sizeof (RecordHeader);
+      RecordReader rec (p, recHeader->size);
+      p += recHeader->size;
+
+      switch (recHeader->type)
+      {
+        case recStrings:
+          strings.Set (p - recHeader->size, recHeader->size);
+          break;
+        case recShader:
+          {
+            const Shader* shader = rec.Get<Shader> ();
+            if (!shader) { error = true; break; }
+            const char* name = strings.Get (shader->name);
+            iShader* s = shaderMgr ? shaderMgr->GetShader (name) : 0;
+            if (!s && shaderMgr)
+            {
+              csRef<iThreadReturn> itr;
+              itr.AttachNew (new csLoaderReturn (threadman));
+              LoadShaderTC (itr, false, cwd, strings.Get (shader->file),
+                true, ldr_context->GetVerbose ());
+              s = shaderMgr->GetShader (name);
+            }
+            if (!s)
+              ReportWarning ("crystalspace.maploader.parse.compiledworld",
+                "Shader '%s' could not be loaded", name);
+            shaders.Push (s);
+          }
+          break;
+        case recTexture:
+          {
+            const Texture* tex = rec.Get<Texture> ();
+            if (!tex) { error = true; break; }
+            const char* name = strings.Get (tex->name);
+            csRef<iTextureWrapper> t = ldr_context->FindTexture (name, false);
+            if (!t)
+            {
+              csRef<iThreadReturn> itr;
+              itr.AttachNew (new csLoaderReturn (threadman));
+              if (LoadTextureTC (itr, false, cwd, name,
+                strings.Get (tex->file), tex->flags, 0, true, false, true,
+                ldr_context->GetCollection (), ldr_context->GetKeepFlags (),
+                ldr_context->GetVerbose ()))
+              {
+                t = scfQueryInterface<iTextureWrapper> (
+                  itr->GetResultRefPtr ());
+              }
+            }
+            else
+              ldr_context->AddToCollection (t->QueryObject ());
+            textures.Push (t);
+          }
+          break;
+        case recMaterial:
+          {
+            const Material* mat = rec.Get<Material> ();
+            const MaterialShader* matShaders = mat
+              ? rec.Get<MaterialShader> (mat->numShaders) : 0;
+            const ShaderVariable* vars = matShaders
+              ? rec.Get<ShaderVariable> (mat->numVariables) : 0;
+            if (!vars) { error = true; break; }
+
+            const char* name = strings.Get (mat->name);
+            csRef<iMaterialWrapper> m = ldr_context->FindMaterial (name, false);
+            if (m)
+            {
+              ldr_context->AddToCollection (m->QueryObject ());
+              materials.Push (m);
+              break;
+            }
+
+            csRef<iMaterial> material = Engine->CreateBaseMaterial (0);
+            for (uint32 i = 0; i < mat->numShaders; i++)
+            {
+              iShader* shader = GetIndexed (shaders, matShaders[i].shader);
+              if (!shader) continue;
+              material->SetShader (stringSet->Request (
+                strings.Get (matShaders[i].type)), shader);
+            }
+            for (uint32 i = 0; i < mat->numVariables; i++)
+            {
+              const ShaderVariable& var = vars[i];
+              csRef<csShaderVariable> sv;
+              sv.AttachNew (new csShaderVariable (
+                stringSetSvName->Request (strings.Get (var.name))));
+              const float* v = var.value;
+              switch (var.type)
+              {
+                case csShaderVariable::INT:
+                  sv->SetValue (int (var.texture));
+                  break;
+                case csShaderVariable::FLOAT:
+                  sv->SetValue (v[0]);
+                  break;
+                case csShaderVariable::VECTOR2:
+                  sv->SetValue (csVector2 (v[0], v[1]));
+                  break;
+                case csShaderVariable::VECTOR3:
+                  sv->SetValue (csVector3 (v[0], v[1], v[2]));
+                  break;
+                case csShaderVariable::VECTOR4:
+                  sv->SetValue (csVector4 (v[0], v[1], v[2], v[3]));
+                  break;
+                case csShaderVariable::TEXTURE:
+                  sv->SetValue (GetIndexed (textures, var.texture));
+                  break;
+                default:
+                  continue;
+              }
+              material->AddVariable (sv);
+            }
+
+            m = Engine->GetMaterialList ()->CreateMaterial (material, name);
+            AddMaterialToList (m);
+            ldr_context->AddToCollection (m->QueryObject ());
+            materials.Push (m);
+          }
+          break;
+        case recFactory:
+          {
+            const Factory* fact = rec.Get<Factory> ();
+            if (!fact) { error = true; break; }
+            const uint32 numVertices = fact->numVertices;
+            const csVector3* vertices = rec.Get<csVector3> (numVertices);
+            const csVector2* texels = (fact->flags & factHasTexels)
+              ? rec.Get<csVector2> (numVertices) : 0;
+            const csVector3* normals = (fact->flags & factHasNormals)
+              ? rec.Get<csVector3> (numVertices) : 0;
+            const csColor4* colors = (fact->flags & factHasColors)
+              ? rec.Get<csColor4> (numVertices) : 0;
+            const csTriangle* triangles =
+              rec.Get<csTriangle> (fact->numTriangles);
+            if (!vertices || !triangles) { error = true; break; }
+
+            const char* name = strings.Get (fact->name);
+            // Indices are copied unchecked into the factory below
+            if (!CheckTriangles (triangles, fact->numTriangles, numVertices)
+              || !CheckSubMeshes (rec, fact->numSubMeshes, numVertices))
+            {
+              ReportError ("crystalspace.maploader.parse.compiledworld",
+                "Mesh factory '%s' in compiled world '%s' has vertex "
+                "indices out of range", name, fname);
+              return false;
+            }
+            csRef<iMeshFactoryWrapper> factory = Engine->CreateMeshFactory (
+              "crystalspace.mesh.object.genmesh", name, false);
+            if (!factory)
+            {
+              ReportError ("crystalspace.maploader.parse.compiledworld",
+                "Could not create genmesh factory '%s'", name);
+              return false;
+            }
+            iMeshObjectFactory* objFact = factory->GetMeshObjectFactory ();
+            csRef<iGeneralFactoryState> state =
+              scfQueryInterface<iGeneralFactoryState> (objFact);
+
+            // The vertex data is copied straight into the factory arrays
+            state->SetVertexCount (int (numVertices));
+            memcpy (state->GetVertices (), vertices,
+              numVertices * sizeof (csVector3));
+            if (texels)
+              memcpy (state->GetTexels (), texels,
+                numVertices * sizeof (csVector2));
+            if (normals)
+            {
+              state->DisableAutoNormals ();
+              memcpy (state->GetNormals (), normals,
+                numVertices * sizeof (csVector3));
+            }
+            if (colors)
+              memcpy (state->GetColors (), colors,
+                numVertices * sizeof (csColor4));
+            state->SetTriangleCount (int (fact->numTriangles));
+            memcpy (state->GetTriangles (), triangles,
+              fact->numTriangles * sizeof (csTriangle));
+
+            for (uint32 s = 0; s < fact->numSubMeshes; s++)
+            {
+              const SubMesh* submesh = rec.Get<SubMesh> ();
+              const uint32* indices = submesh
+                ? rec.Get<uint32> (submesh->numIndices) : 0;
+              if (!indices) { error = true; break; }
+              csRef<csRenderBuffer> buffer =
+                csRenderBuffer::CreateIndexRenderBuffer (submesh->numIndices,
+                CS_BUF_STATIC, CS_BUFCOMP_UNSIGNED_INT, submesh->minIndex,
+                submesh->maxIndex);
+              buffer->CopyInto (indices, submesh->numIndices);
+              state->AddSubMesh (buffer,
+                GetIndexed (materials, submesh->material),
+                strings.Get (submesh->name), submesh->mixmode);
+            }
+            if (error) break;
+
+            uint32 meshFlags = 0;
+            if (!(fact->flags & factLighting))
+              meshFlags |= CS_ENTITY_NOLIGHTING;
+            if (!(fact->flags & factShadowCasting))
+              meshFlags |= CS_ENTITY_NOSHADOWCAST;
+            if (!(fact->flags & factShadowReceiving))
+              meshFlags |= CS_ENTITY_NOSHADOWRECEIVE;
+            factory->GetFlags ().Set (CS_ENTITY_NOLIGHTING
+              | CS_ENTITY_NOSHADOWCAST | CS_ENTITY_NOSHADOWRECEIVE, meshFlags);
+            state->SetManualColors ((fact->flags & factManualColors) != 0);
+            state->SetBack2Front ((fact->flags & factBack2Front) != 0);
+            state->Invalidate ();
+
+            objFact->SetMaterialWrapper (
+              GetIndexed (materials, fact->material));
+            objFact->SetMixMode (fact->mixmode);
+            const char* priority = strings.Get (fact->renderPriority);
+            if (priority)
+              factory->SetRenderPriority (Engine->GetRenderPriority (priority));
+            factory->SetZBufMode ((csZBufMode)fact->zbufMode);
+
+            AddMeshFactToList (factory);
+            ldr_context->AddToCollection (factory->QueryObject ());
+            factories.Push (factory);
+          }
+          break;
+        case recSector:
+          {
+            const Sector* sector = rec.Get<Sector> ();
+            if (!sector) { error = true; break; }
+            const char* name = strings.Get (sector->name);
+            csRef<iSector> s = ldr_context->FindSector (name);
+            if (!s)
+            {
+              s = Engine->CreateSector (name, false);
+              AddSectorToList (s);
+            }
+            ldr_context->AddToCollection (s->QueryObject ());
+            sectors.Push (s);
+          }
+          break;
+        case recMesh:
+          {
+            const Mesh* mesh = rec.Get<Mesh> ();
+            if (!mesh) { error = true; break; }
+            iMeshFactoryWrapper* factory =
+              GetIndexed (factories, mesh->factory);
+            if (!factory) { error = true; break; }
+
+            csRef<iMeshWrapper> m = Engine->CreateMeshWrapper (factory,
+              strings.Get (mesh->name), 0, csVector3 (0), false);
+            iMaterialWrapper* material = GetIndexed (materials,
+              mesh->material);
+            if (material)
+              m->GetMeshObject ()->SetMaterialWrapper (material);
+            const char* priority = strings.Get (mesh->renderPriority);
+            if (priority)
+              m->SetRenderPriority (Engine->GetRenderPriority (priority));
+            m->SetZBufMode ((csZBufMode)mesh->zbufMode);
+            m->GetFlags ().SetAll (mesh->flags);
+            m->GetMeshObject ()->GetFlags ().SetAll (mesh->objectFlags);
+
+            csReversibleTransform tf;
+            GetTransform (tf, mesh->transform);
+            m->GetMovable ()->SetTransform (tf);
+
+            AddMeshToList (m);
+            ldr_context->AddToCollection (m->QueryObject ());
+            iSector* sector = GetIndexed (sectors, mesh->sector);
+            if (sector)
+              threadReturns.Push (AddObjectToSector (m->GetMovable (),
+                sector));
+          }
+          break;
+        case recLight:
+          {
+            const Light* light = rec.Get<Light> ();
+            if (!light) { error = true; break; }
+            iSector* sector = GetIndexed (sectors, light->sector);
+            if (!sector) { error = true; break; }
+
+            const char* name = strings.Get (light->name);
+            csReversibleTransform tf;
+            GetTransform (tf, light->transform);
+            csColor color (light->color[0], light->color[1],
+              light->color[2]);
+            csRef<iLight> l = Engine->CreateLight (name, tf.GetOrigin (),
+              light->cutoffDistance, color,
+              (csLightDynamicType)light->dynamicType);
+            l->SetType ((csLightType)light->type);
+            l->GetFlags ().SetAll (light->flags);
+            l->SetSpotLightFalloff (light->spotInner, light->spotOuter);
+            l->SetAttenuationMode (
+              (csLightAttenuationMode)light->attenuationMode);
+            l->SetAttenuationConstants (csVector4 (light->attenuation[0],
+              light->attenuation[1], light->attenuation[2],
+              light->attenuation[3]));
+            l->SetCutoffDistance (light->cutoffDistance);
+            l->GetMovable ()->SetTransform (tf);
+            l->GetMovable ()->UpdateMove ();
+
+            ldr_context->AddToCollection (l->QueryObject ());
+            AddLightToList (l, name);
+            threadReturns.Push (sector->AddLight (l));
+          }
+          break;
+        case recStart:
+          {
+            const Start* start = rec.Get<Start> ();
+            if (!start) { error = true; break; }
+            const char* name = strings.Get (start->name);
+            csRef<iCameraPosition> campos = Engine->GetCameraPositions ()->
+              CreateCameraPosition (name ? name : "Start");
+            campos->Set (strings.Get (start->sector),
+              csVector3 (start->position[0], start->position[1],
+                start->position[2]),
+              csVector3 (start->forward[0], start->forward[1],
+                start->forward[2]),
+              csVector3 (start->up[0], start->up[1], start->up[2]));
+            AddCamposToList (campos);
+            ldr_context->AddToCollection (campos->QueryObject ());
+          }
+          break;
+        default:
+          // Unknown records are skipped
+          break;
+      }
+    }
+
+    if (error)
+    {
+      ReportError ("crystalspace.maploader.parse.compiledworld",
+        "Compiled world '%s' is corrupt", fname);
+      return false;
+    }
+    return threadman->Wait (threadReturns);
+  }
+}
+CS_PLUGIN_NAMESPACE_END(csparser)
@@ -22,6 +22,7 @@
 #include <ctype.h>
 #include "csqint.h"
 
+#include "cstool/compiledworld.h"
 #include "cstool/saverref.h"
 #include "cstool/saverfile.h"
 #include "cstool/unusedresourcehelper.h"
@@ -377,6 +378,31 @@ CS_PLUGIN_NAMESPACE_BEGIN(csparser)
       return false;
     }
 
+    // Compiled worlds are instantiated directly, without a document.
+    uint32 magic = 0;
+    buf->Read ((char*)&magic, sizeof (magic));
+    buf->SetPos (0);
+    if (magic == CS::Utility::CompiledWorld::magic)
+    {
+      if (clearEngine)
+      {
+        Engine->DeleteAll ();
+        Engine->ResetWorldSpecificSettings();
+      }
+      csRef<iLoaderContext> ldr_context = csPtr<iLoaderContext> (
+        new csLoaderContext (object_reg, Engine, this, collection,
+        missingdata, keepFlags, do_verbose));
+      csRef<iDataBuffer> data = buf->GetAllData ();
+      bool res = LoadCompiledWorld (ldr_context, data, filename);
+
+      if(sync && res)
+      {
+        Engine->SyncEngineListsWait(this);
+      }
+
+      return res;
+    }
+
     csRef<iDocument> doc;
     bool er = LoadStructuredDoc (filename, buf, doc);
     if (!er)
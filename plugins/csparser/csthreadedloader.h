@@ -582,6 +582,13 @@ CS_PLUGIN_NAMESPACE_BEGIN(csparser)
     bool LoadMap (iLoaderContext* ldr_context, iDocumentNode* world_node,
       iStreamSource* ssource, iMissingLoaderData* missingdata, bool do_verbose);
 
+    /**
+    * Load a compiled world (see CS::Utility::CompiledWorld) from a memory
+    * buffer.
+    */
+    bool LoadCompiledWorld (iLoaderContext* ldr_context, iDataBuffer* data,
+      const char* fname);
+
     bool Load (iDataBuffer* buffer, const char* fname, iCollection* collection,
       iStreamSource* ssource, iMissingLoaderData* missingdata, uint keepFlags = KEEP_ALL,
       bool do_verbose = false);
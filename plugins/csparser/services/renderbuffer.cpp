@@ -17,6 +17,7 @@
 */
 
 #include "cssysdef.h"
+#include <ctype.h>
 #include <limits.h>
 
 #include "iutil/document.h"
@@ -28,6 +29,8 @@
 #include "csutil/csendian.h"
 #include "csutil/databuf.h"
 #include "csutil/dirtyaccessarray.h"
+#include "csutil/mmapio.h"
+#include "csutil/scfstr.h"
 #include "cstool/rbuflock.h"
 
 #include "syntxldr.h"
@@ -169,6 +172,59 @@ struct BufferWriter
   }
 };
 
+/// Data buffer referencing a memory mapping
+class MappedDataBuffer :
+  public scfImplementation1<MappedDataBuffer, iDataBuffer>
+{
+  csRef<csMemoryMapping> mapping;
+public:
+  MappedDataBuffer (csMemoryMapping* mapping) : 
+    scfImplementationType (this), mapping (mapping) {}
+
+  virtual size_t GetSize () const { return mapping->GetLength(); }
+  virtual char* GetData () const { return (char*)mapping->GetData(); }
+};
+
+csRef<iDataBuffer> csTextSyntaxService::ReadRenderBufferFile (
+  const char* filename)
+{
+  csRef<iVFS> vfs = csQueryRegistry<iVFS> (object_reg);
+  size_t fileSize;
+  if (!vfs->GetFileSize (filename, fileSize)) return 0;
+
+  csRef<iDataBuffer> realPath = vfs->GetRealPath (filename);
+  if (realPath.IsValid() && (fileSize > 0))
+  {
+    csRef<csMemoryMappedIO> mmio;
+    mmio.AttachNew (new csMemoryMappedIO (realPath->GetData()));
+    if (mmio->IsValid())
+    {
+      csRef<csMemoryMapping> mapping = mmio->GetData (0, fileSize);
+      if (mapping.IsValid())
+      {
+        csRef<iDataBuffer> data;
+        data.AttachNew (new MappedDataBuffer (mapping));
+        return data;
+      }
+    }
+  }
+  return csRef<iDataBuffer> (vfs->ReadFile (filename, false));
+}
+
+csPtr<iString> csTextSyntaxService::GetRenderBufferFileName (
+  const char* objectName, const char* bufferName)
+{
+  csString filename;
+  filename.Format ("%s_%s.rbuf", objectName, bufferName);
+  for (size_t i = 0; i < filename.Length(); i++)
+  {
+    // isalnum() is only defined for unsigned char values (and EOF)
+    if (!isalnum ((unsigned char)filename[i]) && (filename[i] != '.'))
+      filename[i] = '_';
+  }
+  return csPtr<iString> (new scfString (filename));
+}
+
 csRef<iRenderBuffer> csTextSyntaxService::ParseRenderBuffer (iDocumentNode* node)
 {
   static const char* msgid = "crystalspace.syntax.renderbuffer";
@@ -176,14 +232,18 @@ csRef<iRenderBuffer> csTextSyntaxService::ParseRenderBuffer (iDocumentNode* node
   const char* filename = node->GetAttributeValue ("file");
   if (filename != 0)
   {
-    csRef<iVFS> vfs = csQueryRegistry<iVFS> (object_reg);
-    csRef<iDataBuffer> data = vfs->ReadFile (filename, false);
+    csRef<iDataBuffer> data = ReadRenderBufferFile (filename);
     if (!data.IsValid())
     {
       ReportError (msgid, node, "could not read from '%s'", filename);
       return 0;
     }
-    return ReadRenderBuffer (data, KeepSaveInfo() ? filename : 0);
+    csRef<iRenderBuffer> buffer = 
+      ReadRenderBuffer (data, KeepSaveInfo() ? filename : 0);
+    if (!buffer.IsValid())
+      ReportError (msgid, node, "'%s' is not a valid render buffer file",
+        filename);
+    return buffer;
   }
 
   const char* componentType = node->GetAttributeValue ("type");
@@ -338,16 +398,36 @@ bool csTextSyntaxService::ParseRenderBuffer (iDocumentNode* node, iRenderBuffer*
   const char* filename = node->GetAttributeValue ("file");
   if (filename != 0)
   {
-    csRef<iVFS> vfs = csQueryRegistry<iVFS> (object_reg);
-    csRef<iDataBuffer> data = vfs->ReadFile (filename, false);
+    csRef<iDataBuffer> data = ReadRenderBufferFile (filename);
     if (!data.IsValid())
     {
       ReportError (msgid, node, "could not read from '%s'", filename);
       return false;
     }
-    //return ReadRenderBuffer (data, KeepSaveInfo() ? filename : 0);
-    //@@TODO: Implement
-    return false;
+    csRef<iRenderBuffer> fileBuffer = ReadRenderBuffer (data, 0);
+    if (!fileBuffer.IsValid())
+    {
+      ReportError (msgid, node, "'%s' is not a valid render buffer file",
+        filename);
+      return false;
+    }
+    if ((fileBuffer->GetComponentType() != buffer->GetComponentType())
+      || (fileBuffer->GetComponentCount() != buffer->GetComponentCount())
+      || (fileBuffer->IsIndexBuffer() != buffer->IsIndexBuffer()))
+    {
+      ReportError (msgid, node, "format of '%s' does not match the buffer",
+        filename);
+      return false;
+    }
+    if (fileBuffer->GetElementCount() > buffer->GetElementCount())
+    {
+      ReportError (msgid, node, "too many elements: %zu", 
+        fileBuffer->GetElementCount());
+      return false;
+    }
+    csRenderBufferLock<uint8> lock (fileBuffer, CS_BUF_LOCK_READ);
+    buffer->CopyInto (lock.Lock(), fileBuffer->GetElementCount());
+    return true;
   }
 
   const char* componentType = node->GetAttributeValue ("type");
@@ -1077,16 +1157,17 @@ csRef<iRenderBuffer> csTextSyntaxService::ReadRenderBuffer (iDataBuffer* buf,
   const size_t headerSize = (magic == RenderBufferHeaderCommon::MagicNormal)
     ? sizeof (RenderBufferHeaderNormal) : sizeof (RenderBufferHeaderIndex);
 
-  const size_t totalElements = 
-    header->compCount * csLittleEndian::Convert (header->elementCount);
-  const size_t totalSizeDisk = 
-    totalElements * RenderBufferComponentSizesOnDisk[header->compType];
-
-  // Sanity check
-  if (buf->GetSize() < (totalSizeDisk + headerSize))
+  if ((header->compType >= CS_BUFCOMP_TYPECOUNT) || (header->compCount == 0)
+      || (buf->GetSize() < headerSize))
+    return 0;
+  const size_t elementSizeDisk = 
+    header->compCount * RenderBufferComponentSizesOnDisk[header->compType];
+  const size_t elementCount = csLittleEndian::Convert (header->elementCount);
+  if (elementCount > (buf->GetSize() - headerSize) / elementSizeDisk)
     return 0;
 
 #if !defined(CS_LITTLE_ENDIAN) || !defined(CS_IEEE_DOUBLE_FORMAT)
+  const size_t totalElements = header->compCount * elementCount;
   const size_t totalSize = 
     totalElements * csRenderBufferComponentSizes[header->compType];
 
@@ -1116,6 +1197,18 @@ csRef<iRenderBuffer> csTextSyntaxService::ReadRenderBuffer (iDataBuffer* buf,
   buf = newData;
 #endif
 
+  /* The buffer data is used in place, so it has to be aligned for the
+     component type. Mapped files and heap blocks always are; only copy if
+     the data buffer is some odd slice of memory. */
+  const size_t compAlign = csRenderBufferComponentSizes[header->compType];
+  csRef<iDataBuffer> alignedData;
+  if (((uintptr_t)(buf->GetData() + headerSize) % compAlign) != 0)
+  {
+    alignedData.AttachNew (new CS::DataBuffer<> (buf->GetSize()));
+    memcpy (alignedData->GetData(), buf->GetData(), buf->GetSize());
+    buf = alignedData;
+  }
+
   csRef<StoredRenderBuffer> newBuffer;
   if (filename != 0)
   {
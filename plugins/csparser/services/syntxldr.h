@@ -153,6 +153,14 @@ public:
   virtual csRef<iRenderBuffer> ParseRenderBuffer (iDocumentNode* node);
   virtual bool ParseRenderBuffer (iDocumentNode* node, iRenderBuffer* buffer);
   virtual bool WriteRenderBuffer (iDocumentNode* node, iRenderBuffer* buffer);
+  /**
+   * Get the contents of a render buffer file. Files on the real file system
+   * are memory mapped, so render buffers read from them use the mapped
+   * pages directly; files in archives are read through VFS.
+   */
+  csRef<iDataBuffer> ReadRenderBufferFile (const char* filename);
+  virtual csPtr<iString> GetRenderBufferFileName (const char* objectName,
+      const char* bufferName);
   /**
    * Read a render buffer from a data buffer. If \a filename is not 0, the
    * returned buffer will also exhibit an iRenderBufferPersistence that returns
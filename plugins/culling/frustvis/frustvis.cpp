@@ -24,6 +24,8 @@
 #include "csutil/scfstr.h"
 #include "csutil/event.h"
 #include "csutil/eventnames.h"
+#include "csutil/platform.h"
+#include "csutil/threadjobqueue.h"
 #include "iutil/event.h"
 #include "iutil/eventq.h"
 #include "csgeom/frustum.h"
@@ -154,6 +156,7 @@ csFrustumVis::csFrustumVis (iBase *iParent) :
   current_vistest_nr = 1;
   vistest_objects_inuse = false;
   updating = false;
+  hasRebuildQueue = false;
 }
 
 csFrustumVis::~csFrustumVis ()
@@ -213,6 +216,9 @@ bool csFrustumVis::Initialize (iObjectRegistry *object_reg)
   csRef<csFrustVisObjectDescriptor> desc;
   desc.AttachNew (new csFrustVisObjectDescriptor ());
   kdtree->SetObjectDescriptor (desc);
+  // Moving objects are refitted; the tree is rebuilt in the background
+  // when it gets too bad (see UpdateObjects()).
+  hasRebuildQueue = false;
 
   csRef<iGraphics2D> g2d = csQueryRegistry<iGraphics2D> (object_reg);
   if (g2d)
@@ -298,7 +304,6 @@ void csFrustumVis::RegisterVisObject (iVisibilityObject* visobj)
   csBox3 bbox;
   CalculateVisObjBBox (visobj, bbox);
   visobj_wrap->child = kdtree->AddObject (bbox, (void*)visobj_wrap);
-  kdtree_box += bbox;
 
   iMeshWrapper* mesh = visobj->GetMeshWrapper ();
   visobj_wrap->mesh = mesh;
@@ -346,6 +351,7 @@ void csFrustumVis::AddObjectToUpdateQueue (csFrustVisObjectWrapper* visobj_wrap)
 
 void csFrustumVis::UpdateObjects ()
 {
+  if (update_queue.IsEmpty ()) return;
   updating = true;
   {
     csSet<csPtrKey<csFrustVisObjectWrapper> >::GlobalIterator it = 
@@ -357,9 +363,35 @@ void csFrustumVis::UpdateObjects ()
     }
   }
   update_queue.DeleteAll ();
+  // Shrink the node boxes again and check whether the tree needs a rebuild.
+  kdtree->Refit ();
+  if (!hasRebuildQueue && kdtree->IsRebuildNeeded ())
+  {
+    // The queue is only set up once a tree actually degrades. Refitting
+    // again is cheap as nothing changed, and starts the rebuild.
+    kdtree->SetRebuildJobQueue (GetRebuildQueue ());
+    hasRebuildQueue = true;
+    kdtree->Refit ();
+  }
   updating = false;
 }
 
+iJobQueue* csFrustumVis::GetRebuildQueue ()
+{
+  // The job queue is shared by the culler of every sector.
+  csRef<iJobQueue> rebuildQueue = csQueryRegistryTagInterface<iJobQueue> (
+    object_reg, "crystalspace.culling.frustvis.rebuildqueue");
+  if (!rebuildQueue)
+  {
+    rebuildQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+      CS::Platform::GetProcessorCount (), CS::Threading::THREAD_PRIO_LOW));
+    object_reg->Register (rebuildQueue,
+      "crystalspace.culling.frustvis.rebuildqueue");
+  }
+  // The registry keeps the queue alive.
+  return rebuildQueue;
+}
+
 void csFrustumVis::UpdateObject (csFrustVisObjectWrapper* visobj_wrap)
 {
   CS_ASSERT (visobj_wrap->frustvis != (csFrustumVis*)0xdeadbeef);
@@ -367,8 +399,7 @@ void csFrustumVis::UpdateObject (csFrustVisObjectWrapper* visobj_wrap)
   iMovable* movable = visobj->GetMovable ();
   csBox3 bbox;
   CalculateVisObjBBox (visobj, bbox);
-  kdtree->MoveObject (visobj_wrap->child, bbox);
-  kdtree_box += bbox;
+  kdtree->RefitObject (visobj_wrap->child, bbox);
   visobj_wrap->shape_number = visobj->GetObjectModel ()->GetShapeNumber ();
   visobj_wrap->update_number = movable->GetUpdateNumber ();
 }
@@ -385,8 +416,7 @@ struct FrustTest_Front2BackData
 int csFrustumVis::TestNodeVisibility (csKDTree* treenode,
 	FrustTest_Front2BackData* data, uint32& frustum_mask)
 {
-  csBox3 node_bbox = treenode->GetNodeBBox ();
-  node_bbox *= kdtree_box;
+  const csBox3& node_bbox = treenode->GetObjectBBox ();
 
   if (node_bbox.Contains (data->pos))
   {
@@ -560,7 +590,7 @@ static bool FrustTestPlanes_Front2Back (csKDTree* treenode,
 
   // In the first part of this test we are going to test if the node
   // itself is visible. If it is not then we don't need to continue.
-  const csBox3& node_bbox = treenode->GetNodeBBox ();
+  const csBox3& node_bbox = treenode->GetObjectBBox ();
   uint32 new_mask;
   if (!csIntersect3::BoxFrustum (node_bbox, data->frustum, frustum_mask,
   	new_mask))
@@ -672,7 +702,7 @@ static bool FrustTestBox_Front2Back (csKDTree* treenode, void* userdata,
   // In the first part of this test we are going to test if the
   // box vector intersects with the node. If not then we don't
   // need to continue.
-  const csBox3& node_bbox = treenode->GetNodeBBox ();
+  const csBox3& node_bbox = treenode->GetObjectBBox ();
   if (!node_bbox.TestIntersect (data->box))
   {
     return false;
@@ -757,7 +787,7 @@ static bool FrustTestSphere_Front2Back (csKDTree* treenode,
   // In the first part of this test we are going to test if the
   // box vector intersects with the node. If not then we don't
   // need to continue.
-  const csBox3& node_bbox = treenode->GetNodeBBox ();
+  const csBox3& node_bbox = treenode->GetObjectBBox ();
   if (!csIntersect3::BoxSphere (node_bbox, data->pos, data->sqradius))
   {
     return false;
@@ -866,7 +896,7 @@ static bool IntersectSegmentSloppy_Front2Back (csKDTree* treenode,
   IntersectSegment_Front2BackData* data
   	= (IntersectSegment_Front2BackData*)userdata;
 
-  const csBox3& node_bbox = treenode->GetNodeBBox ();
+  const csBox3& node_bbox = treenode->GetObjectBBox ();
 
   // In the first part of this test we are going to test if the
   // start-end vector intersects with the node. If not then we don't
@@ -914,7 +944,7 @@ static bool IntersectSegment_Front2Back (csKDTree* treenode,
   IntersectSegment_Front2BackData* data
   	= (IntersectSegment_Front2BackData*)userdata;
 
-  const csBox3& node_bbox = treenode->GetNodeBBox ();
+  const csBox3& node_bbox = treenode->GetObjectBBox ();
 
   // If mesh != 0 then we have already found our mesh. In that
   // case we will compare the distance of the origin with the the
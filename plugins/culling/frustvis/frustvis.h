@@ -91,10 +91,6 @@ private:
   csEventID CanvasResize;
   csRef<iEventHandler> weakEventHandler;
   csKDTree* kdtree;
-  // Ever growing box of all objects that were ever in the tree.
-  // This puts an upper limit of all boxes in the kdtree itself because
-  // those go off to infinity.
-  csBox3 kdtree_box;
   csRefArray<csFrustVisObjectWrapper, CS::Container::ArrayAllocDefault, 
     csArrayCapacityFixedGrow<256> > visobj_vector;
   int scr_width, scr_height;	// Screen dimensions.
@@ -108,9 +104,16 @@ private:
   // again).
   bool updating;
 
+  // True once the kd-tree was given the shared rebuild queue.
+  bool hasRebuildQueue;
+
   // Update all objects in the update queue.
   void UpdateObjects ();
 
+  // Get the job queue for background kd-tree rebuilds, creating it if
+  // needed.
+  iJobQueue* GetRebuildQueue ();
+
   // Fill the bounding box with the current object status.
   void CalculateVisObjBBox (iVisibilityObject* visobj, csBox3& bbox);
 
@@ -0,0 +1,478 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include <stdarg.h>
+
+#include "csutil/bitops.h"
+#include "csutil/csuctransform.h"
+
+#include "parser.h"
+
+#if defined(__SSE2__) || defined(_M_X64) \
+  || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define XMLINSITU_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+CS_PLUGIN_NAMESPACE_BEGIN(XMLInSitu)
+{
+  /* Number of bytes after the terminating null the scanners may read.
+     Must be at least the SIMD vector width. */
+  static const size_t bufferPadding = 16;
+
+  void NodeTable::Clear ()
+  {
+    cs_free (buffer);
+    buffer = 0;
+    nodes.DeleteAll ();
+    attributes.DeleteAll ();
+  }
+
+  char* NodeTable::AllocBuffer (size_t size)
+  {
+    Clear ();
+    buffer = (char*)cs_malloc (size + 1 + bufferPadding);
+    memset (buffer + size, 0, 1 + bufferPadding);
+    return buffer;
+  }
+
+  //-------------------------------------------------------------------------
+
+  static inline bool IsSpace (char c)
+  {
+    return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r');
+  }
+
+  static inline char* SkipSpace (char* p)
+  {
+    while (IsSpace (*p)) p++;
+    return p;
+  }
+
+  static inline bool IsNameChar (char c)
+  {
+    // Everything but whitespace, controls and XML syntax characters
+    return ((unsigned char)c > ' ') && (c != '/') && (c != '>')
+      && (c != '<') && (c != '=') && (c != '"') && (c != '\'');
+  }
+
+  /**
+   * Return a pointer to the first occurence of \a c1, \a c2 or a null
+   * character. With SSE2, 16 bytes are compared at once; this relies on
+   * the buffer padding to not read beyond the allocated memory.
+   */
+  static inline char* ScanFor (char* p, char c1, char c2)
+  {
+#ifdef XMLINSITU_USE_SSE2
+    const __m128i v1 = _mm_set1_epi8 (c1);
+    const __m128i v2 = _mm_set1_epi8 (c2);
+    const __m128i zero = _mm_setzero_si128 ();
+    while (true)
+    {
+      __m128i data = _mm_loadu_si128 ((const __m128i*)p);
+      __m128i found = _mm_or_si128 (
+        _mm_or_si128 (_mm_cmpeq_epi8 (data, v1), _mm_cmpeq_epi8 (data, v2)),
+        _mm_cmpeq_epi8 (data, zero));
+      uint32 mask = uint32 (_mm_movemask_epi8 (found));
+      if (mask != 0)
+      {
+        unsigned long index;
+        CS::Utility::BitOps::ScanBitForward (mask, index);
+        return p + index;
+      }
+      p += 16;
+    }
+#else
+    while ((*p != c1) && (*p != c2) && (*p != 0)) p++;
+    return p;
+#endif
+  }
+
+  /// Return a pointer to the first occurence of \a str or the terminator.
+  static char* ScanForString (char* p, const char* str)
+  {
+    size_t len = strlen (str);
+    while (true)
+    {
+      p = ScanFor (p, str[0], str[0]);
+      if ((*p == 0) || (strncmp (p, str, len) == 0)) return p;
+      p++;
+    }
+  }
+
+  /**
+   * Decode the entity at \a p, write the result to \a out and advance it.
+   * Unknown entities are copied literally. Returns a pointer to the first
+   * character after the entity.
+   */
+  static char* DecodeEntity (char* p, char*& out)
+  {
+    static const struct
+    {
+      const char* str;
+      size_t len;
+      char chr;
+    } entities[] =
+    {
+      { "&amp;", 5, '&' },
+      { "&lt;", 4, '<' },
+      { "&gt;", 4, '>' },
+      { "&quot;", 6, '"' },
+      { "&apos;", 6, '\'' }
+    };
+    for (size_t i = 0; i < sizeof (entities) / sizeof (entities[0]); i++)
+    {
+      if (strncmp (p, entities[i].str, entities[i].len) == 0)
+      {
+        *out++ = entities[i].chr;
+        return p + entities[i].len;
+      }
+    }
+
+    if (p[1] == '#')
+    {
+      char* q = p + 2;
+      bool hex = (*q == 'x') || (*q == 'X');
+      if (hex) q++;
+      char* digits = q;
+      utf32_char ch = 0;
+      while (ch <= CS_UC_LAST_CHAR)
+      {
+        int digit;
+        if ((*q >= '0') && (*q <= '9'))
+          digit = *q - '0';
+        else if (hex && (*q >= 'a') && (*q <= 'f'))
+          digit = *q - 'a' + 10;
+        else if (hex && (*q >= 'A') && (*q <= 'F'))
+          digit = *q - 'A' + 10;
+        else
+          break;
+        ch = ch * (hex ? 16 : 10) + digit;
+        q++;
+      }
+      if ((*q == ';') && (q > digits))
+      {
+        /* The encoded character is never longer than the entity, so it can
+           be written over it. */
+        size_t entityLen = q + 1 - p;
+        size_t n = csUnicodeTransform::EncodeUTF8 (ch, (utf8_char*)out,
+          entityLen);
+        if ((n > 0) && (n <= entityLen))
+        {
+          out += n;
+          return q + 1;
+        }
+      }
+    }
+
+    *out++ = '&';
+    return p + 1;
+  }
+
+  /**
+   * Decode entities from \a p up to the first occurence of \a end or the
+   * terminator. The decoded string starts at \a p, \a out is set to the
+   * end of it. Returns a pointer to the end character.
+   */
+  static char* DecodeUntil (char* p, char end, char*& out)
+  {
+    out = p;
+    while (true)
+    {
+      char* q = ScanFor (p, end, '&');
+      if (out != p) memmove (out, p, q - p);
+      out += q - p;
+      if (*q != '&') return q;
+      p = DecodeEntity (q, out);
+    }
+  }
+
+  /**
+   * Strip leading and trailing whitespace from the string between \a start
+   * and \a end and replace runs of whitespace with single spaces. Returns
+   * the new end.
+   */
+  static char* CollapseSpace (char* start, char* end)
+  {
+    char* out = start;
+    bool space = false;
+    for (char* p = start; p < end; p++)
+    {
+      if (IsSpace (*p))
+      {
+        space = true;
+        continue;
+      }
+      if (space && (out != start)) *out++ = ' ';
+      space = false;
+      *out++ = *p;
+    }
+    return out;
+  }
+
+  static bool IsBlank (const char* p, const char* end)
+  {
+    for (; p < end; p++)
+    {
+      if (!IsSpace (*p)) return false;
+    }
+    return true;
+  }
+
+  //-------------------------------------------------------------------------
+
+  Parser::Parser (NodeTable& table, bool collapse) : table (table),
+    buffer (0), collapse (collapse)
+  {
+  }
+
+  uint32 Parser::AddNode (csDocumentNodeType type, const char* value)
+  {
+    csDirtyAccessArray<NodeData>& nodes = table.nodes;
+    // Grow geometrically, large documents have a lot of nodes
+    if (nodes.GetSize () == nodes.Capacity ())
+      nodes.SetCapacity (nodes.Capacity () * 2 + 64);
+
+    uint32 index = uint32 (nodes.GetSize ());
+    NodeData& node = nodes.GetExtend (index);
+    node.value = value ? Offset (value) : tableNone;
+    node.parent = (openNodes.GetSize () > 0)
+      ? openNodes[openNodes.GetSize () - 1] : tableNone;
+    node.firstChild = tableNone;
+    node.nextSibling = tableNone;
+    node.firstAttr = tableNone;
+    node.numAttrs = 0;
+    node.type = type;
+
+    if (node.parent != tableNone)
+    {
+      uint32& lastChild = lastChildren[lastChildren.GetSize () - 1];
+      if (lastChild == tableNone)
+        nodes[node.parent].firstChild = index;
+      else
+        nodes[lastChild].nextSibling = index;
+      lastChild = index;
+    }
+    return index;
+  }
+
+  char* Parser::SetError (const char* p, const char* msg, ...)
+  {
+    va_list args;
+    va_start (args, msg);
+    error.FormatV (msg, args);
+    va_end (args);
+
+    int line = 1;
+    for (const char* q = buffer; q < p; q++)
+    {
+      if (*q == '\n') line++;
+    }
+    error.AppendFmt (" (line %d)", line);
+    return 0;
+  }
+
+  char* Parser::ParseText (char* p)
+  {
+    char* out;
+    char* end = DecodeUntil (p, '<', out);
+    bool moreTags = (*end == '<');
+    if (collapse) out = CollapseSpace (p, out);
+    *out = 0;
+    AddNode (CS_NODE_TEXT, p);
+    return moreTags ? ParseTag (end + 1) : end;
+  }
+
+  char* Parser::ParseTag (char* p)
+  {
+    if (*p == '/')
+      return ParseEndTag (p + 1);
+    else if ((*p == '!') || (*p == '?'))
+      return ParseSpecial (p);
+    else
+      return ParseStartTag (p);
+  }
+
+  char* Parser::ParseStartTag (char* p)
+  {
+    char* name = p;
+    while (IsNameChar (*p)) p++;
+    if (p == name)
+      return SetError (p, "Error reading element name");
+    /* The name can only be terminated when the tag was parsed completely,
+       as the terminator may overwrite the '>'. */
+    char* nameEnd = p;
+    uint32 node = AddNode (CS_NODE_ELEMENT, name);
+
+    csDirtyAccessArray<AttributeData>& attributes = table.attributes;
+    size_t firstAttr = attributes.GetSize ();
+    while (true)
+    {
+      p = SkipSpace (p);
+      if ((*p == '>') || ((*p == '/') && (p[1] == '>')))
+      {
+        bool empty = (*p == '/');
+        *nameEnd = 0;
+        size_t numAttrs = attributes.GetSize () - firstAttr;
+        if (numAttrs > 0)
+        {
+          table.nodes[node].firstAttr = uint32 (firstAttr);
+          table.nodes[node].numAttrs = uint32 (numAttrs);
+        }
+        if (empty) return p + 2;
+        openNodes.Push (node);
+        lastChildren.Push (tableNone);
+        return p + 1;
+      }
+
+      char* attrName = p;
+      while (IsNameChar (*p)) p++;
+      if (p == attrName)
+        return SetError (p, "Error reading attributes");
+      char* attrNameEnd = p;
+      p = SkipSpace (p);
+      if (*p != '=')
+        return SetError (p, "Expected '=' after attribute name");
+      p = SkipSpace (p + 1);
+      char quote = *p;
+      if ((quote != '"') && (quote != '\''))
+        return SetError (p, "Expected quoted attribute value");
+      char* value = p + 1;
+      char* valueEnd;
+      p = DecodeUntil (value, quote, valueEnd);
+      if (*p != quote)
+        return SetError (value, "Unterminated attribute value");
+      *attrNameEnd = 0;
+      *valueEnd = 0;
+      p++;
+
+      if (attributes.GetSize () == attributes.Capacity ())
+        attributes.SetCapacity (attributes.Capacity () * 2 + 64);
+      AttributeData& attr = attributes.GetExtend (attributes.GetSize ());
+      attr.name = Offset (attrName);
+      attr.value = Offset (value);
+    }
+  }
+
+  char* Parser::ParseEndTag (char* p)
+  {
+    char* name = p;
+    while (IsNameChar (*p)) p++;
+    size_t nameLen = p - name;
+    p = SkipSpace (p);
+    if (*p != '>')
+      return SetError (p, "Error reading end tag");
+    name[nameLen] = 0;
+
+    if (openNodes.GetSize () <= 1)
+      return SetError (name, "Unexpected end tag '%s'", name);
+    uint32 node = openNodes[openNodes.GetSize () - 1];
+    const char* openName = table.GetString (table.nodes[node].value);
+    if (strcmp (openName, name) != 0)
+      return SetError (name, "End tag '%s' does not match start tag '%s'",
+        name, openName);
+    openNodes.Truncate (openNodes.GetSize () - 1);
+    lastChildren.Truncate (lastChildren.GetSize () - 1);
+    return p + 1;
+  }
+
+  char* Parser::ParseSpecial (char* p)
+  {
+    if (*p == '?')
+    {
+      char* value = p + 1;
+      char* end = ScanForString (value, "?>");
+      if (*end == 0)
+        return SetError (p, "Unterminated declaration");
+      *end = 0;
+      AddNode (CS_NODE_DECLARATION, value);
+      return end + 2;
+    }
+    else if (strncmp (p, "!--", 3) == 0)
+    {
+      char* value = p + 3;
+      char* end = ScanForString (value, "-->");
+      if (*end == 0)
+        return SetError (p, "Unterminated comment");
+      *end = 0;
+      AddNode (CS_NODE_COMMENT, value);
+      return end + 3;
+    }
+    else if (strncmp (p, "![CDATA[", 8) == 0)
+    {
+      char* value = p + 8;
+      char* end = ScanForString (value, "]]>");
+      if (*end == 0)
+        return SetError (p, "Unterminated CDATA section");
+      if (!IsBlank (value, end))
+      {
+        *end = 0;
+        AddNode (CS_NODE_TEXT, value);
+      }
+      return end + 3;
+    }
+    else
+    {
+      // DOCTYPE and friends
+      char* end = ScanFor (p, '>', '>');
+      if (*end == 0)
+        return SetError (p, "Unterminated tag");
+      *end = 0;
+      AddNode (CS_NODE_UNKNOWN, p);
+      return end + 1;
+    }
+  }
+
+  const char* Parser::Parse (char* buf)
+  {
+    buffer = buf;
+    char* p = buf;
+    // Skip any UTF8 BOM
+    if (((uint8)p[0] == 0xEF) && ((uint8)p[1] == 0xBB)
+        && ((uint8)p[2] == 0xBF))
+      p += 3;
+    if (*SkipSpace (p) != '<')
+      return "Data does not seem to be XML.";
+
+    openNodes.Push (AddNode (CS_NODE_DOCUMENT, 0));
+    lastChildren.Push (tableNone);
+    while (true)
+    {
+      char* text = p;
+      p = SkipSpace (p);
+      if (*p == 0) break;
+      if (*p == '<')
+        p = ParseTag (p + 1);
+      else
+        // Only collapsed text has its leading whitespace removed
+        p = ParseText (collapse ? p : text);
+      if (p == 0) return error;
+    }
+
+    if (openNodes.GetSize () > 1)
+    {
+      uint32 node = openNodes[openNodes.GetSize () - 1];
+      SetError (p, "Missing end tag for '%s'",
+        table.GetString (table.nodes[node].value));
+      return error;
+    }
+    return 0;
+  }
+}
+CS_PLUGIN_NAMESPACE_END(XMLInSitu)
@@ -0,0 +1,125 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_XMLINSITU_PARSER_H__
+#define __CS_XMLINSITU_PARSER_H__
+
+#include "csutil/csstring.h"
+#include "csutil/dirtyaccessarray.h"
+#include "iutil/document.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(XMLInSitu)
+{
+  /// Marks a missing node, attribute or string
+  static const uint32 tableNone = 0xffffffff;
+
+  /**
+   * A node in the node table. Strings are stored as offsets into the
+   * document buffer, nodes and attributes as indices into the tables.
+   */
+  struct NodeData
+  {
+    /// Element name resp. text
+    uint32 value;
+    uint32 parent;
+    uint32 firstChild;
+    uint32 nextSibling;
+    /// Attributes of a node are stored consecutively
+    uint32 firstAttr;
+    uint32 numAttrs : 28;
+    /// csDocumentNodeType
+    uint32 type : 4;
+  };
+
+  /// An attribute in the attribute table
+  struct AttributeData
+  {
+    uint32 name;
+    uint32 value;
+  };
+
+  /**
+   * The parsed contents of a document: the buffer the document was parsed
+   * from and tables of all nodes and attributes. Node 0 is the document
+   * node.
+   */
+  class NodeTable
+  {
+    char* buffer;
+  public:
+    csDirtyAccessArray<NodeData> nodes;
+    csDirtyAccessArray<AttributeData> attributes;
+
+    NodeTable () : buffer (0) {}
+    ~NodeTable () { Clear (); }
+
+    /// Free the buffer and all nodes
+    void Clear ();
+    /**
+     * Allocate a buffer for a document of \a size bytes. The buffer is null
+     * terminated and padded so the parser can scan a few bytes beyond the
+     * end.
+     */
+    char* AllocBuffer (size_t size);
+    bool IsEmpty () const { return nodes.GetSize () == 0; }
+
+    const char* GetString (uint32 offset) const
+    { return (offset == tableNone) ? 0 : buffer + offset; }
+  };
+
+  /**
+   * XML parser working in place on the document buffer: strings are null
+   * terminated and entities decoded right in the buffer, nodes and
+   * attributes are appended to the tables of a NodeTable.
+   */
+  class Parser
+  {
+    NodeTable& table;
+    char* buffer;
+    bool collapse;
+    csString error;
+
+    /// Indices of the currently open elements
+    csDirtyAccessArray<uint32> openNodes;
+    /// Last child of each open element
+    csDirtyAccessArray<uint32> lastChildren;
+
+    uint32 Offset (const char* p) const { return uint32 (p - buffer); }
+    uint32 AddNode (csDocumentNodeType type, const char* value);
+    /// Set the error message, returns 0 for convenience
+    char* SetError (const char* p, const char* msg, ...)
+      CS_GNUC_PRINTF (3, 4);
+
+    char* ParseText (char* p);
+    char* ParseTag (char* p);
+    char* ParseStartTag (char* p);
+    char* ParseEndTag (char* p);
+    char* ParseSpecial (char* p);
+  public:
+    Parser (NodeTable& table, bool collapse);
+
+    /**
+     * Parse a buffer allocated with NodeTable::AllocBuffer(). Returns an
+     * error message or 0 on success.
+     */
+    const char* Parse (char* buf);
+  };
+}
+CS_PLUGIN_NAMESPACE_END(XMLInSitu)
+
+#endif // __CS_XMLINSITU_PARSER_H__
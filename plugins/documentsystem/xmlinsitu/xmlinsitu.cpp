@@ -0,0 +1,433 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+
+#include "iutil/databuff.h"
+#include "iutil/string.h"
+#include "iutil/vfs.h"
+#include "csutil/scf.h"
+
+#include "xmlinsitu.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(XMLInSitu)
+{
+
+SCF_IMPLEMENT_FACTORY (csInSituDocumentSystem)
+
+csInSituDocumentSystem::csInSituDocumentSystem (iBase* parent) :
+  scfImplementationType (this, parent)
+{
+}
+
+csInSituDocumentSystem::~csInSituDocumentSystem ()
+{
+}
+
+bool csInSituDocumentSystem::Initialize (iObjectRegistry* /*objreg*/)
+{
+  return true;
+}
+
+csRef<iDocument> csInSituDocumentSystem::CreateDocument ()
+{
+  return csPtr<iDocument> (new csInSituDocument (this));
+}
+
+//------------------------------------------------------------------------
+
+/* The pooled classes hold a reference to the document. On release, the
+   instance is returned to a pool owned by the document, so keep the
+   document alive while that happens. */
+
+csInSituAttribute::csInSituAttribute (csInSituDocument* doc, uint32 index) :
+  scfPooledImplementationType (this), doc (doc), index (index)
+{
+  doc->IncRef ();
+}
+
+csInSituAttribute::~csInSituAttribute ()
+{
+  doc->DecRef ();
+}
+
+void csInSituAttribute::DecRef ()
+{
+  csInSituDocument* d = doc;
+  d->IncRef ();
+  scfPooledImplementationType::DecRef ();
+  d->DecRef ();
+}
+
+const char* csInSituAttribute::GetName ()
+{
+  const NodeTable& table = doc->GetTable ();
+  return table.GetString (table.attributes[index].name);
+}
+
+const char* csInSituAttribute::GetValue ()
+{
+  const NodeTable& table = doc->GetTable ();
+  return table.GetString (table.attributes[index].value);
+}
+
+//------------------------------------------------------------------------
+
+csInSituAttributeIterator::csInSituAttributeIterator (csInSituDocument* doc,
+  uint32 first, uint32 num) : scfPooledImplementationType (this),
+  doc (doc), current (first), end (first + num)
+{
+  doc->IncRef ();
+}
+
+csInSituAttributeIterator::~csInSituAttributeIterator ()
+{
+  doc->DecRef ();
+}
+
+void csInSituAttributeIterator::DecRef ()
+{
+  csInSituDocument* d = doc;
+  d->IncRef ();
+  scfPooledImplementationType::DecRef ();
+  d->DecRef ();
+}
+
+bool csInSituAttributeIterator::HasNext ()
+{
+  return current < end;
+}
+
+csRef<iDocumentAttribute> csInSituAttributeIterator::Next ()
+{
+  if (current >= end) return 0;
+  return csPtr<iDocumentAttribute> (doc->AllocAttribute (current++));
+}
+
+//------------------------------------------------------------------------
+
+csInSituNodeIterator::csInSituNodeIterator (csInSituDocument* doc,
+  uint32 firstChild, const char* value) : scfPooledImplementationType (this),
+  doc (doc), filter (value), filtered (value != 0), currentPos (0),
+  endPos ((size_t)~0)
+{
+  doc->IncRef ();
+  current = Match (firstChild);
+}
+
+csInSituNodeIterator::~csInSituNodeIterator ()
+{
+  doc->DecRef ();
+}
+
+void csInSituNodeIterator::DecRef ()
+{
+  csInSituDocument* d = doc;
+  d->IncRef ();
+  scfPooledImplementationType::DecRef ();
+  d->DecRef ();
+}
+
+uint32 csInSituNodeIterator::Match (uint32 node)
+{
+  if (!filtered) return node;
+  const NodeTable& table = doc->GetTable ();
+  while (node != tableNone)
+  {
+    const char* value = table.GetString (table.nodes[node].value);
+    if (value && (strcmp (value, filter) == 0)) break;
+    node = table.nodes[node].nextSibling;
+  }
+  return node;
+}
+
+bool csInSituNodeIterator::HasNext ()
+{
+  return current != tableNone;
+}
+
+csRef<iDocumentNode> csInSituNodeIterator::Next ()
+{
+  if (current == tableNone) return 0;
+  csRef<iDocumentNode> node;
+  node.AttachNew (doc->AllocNode (current));
+  current = Match (doc->GetTable ().nodes[current].nextSibling);
+  currentPos++;
+  return node;
+}
+
+size_t csInSituNodeIterator::GetEndPosition ()
+{
+  if (endPos == (size_t)~0)
+  {
+    endPos = currentPos;
+    const NodeTable& table = doc->GetTable ();
+    uint32 node = current;
+    while (node != tableNone)
+    {
+      endPos++;
+      node = table.nodes[node].nextSibling;
+    }
+  }
+  return endPos;
+}
+
+//------------------------------------------------------------------------
+
+csInSituNode::csInSituNode (csInSituDocument* doc, uint32 index) :
+  scfPooledImplementationType (this), doc (doc), index (index)
+{
+  doc->IncRef ();
+}
+
+csInSituNode::~csInSituNode ()
+{
+  doc->DecRef ();
+}
+
+void csInSituNode::DecRef ()
+{
+  csInSituDocument* d = doc;
+  d->IncRef ();
+  scfPooledImplementationType::DecRef ();
+  d->DecRef ();
+}
+
+const NodeData& csInSituNode::GetData () const
+{
+  return doc->GetTable ().nodes[index];
+}
+
+uint32 csInSituNode::FindAttribute (const char* name) const
+{
+  const NodeData& data = GetData ();
+  if (data.numAttrs == 0) return tableNone;
+  const NodeTable& table = doc->GetTable ();
+  const uint32 end = data.firstAttr + data.numAttrs;
+  for (uint32 a = data.firstAttr; a < end; a++)
+  {
+    if (strcmp (table.GetString (table.attributes[a].name), name) == 0)
+      return a;
+  }
+  return tableNone;
+}
+
+csDocumentNodeType csInSituNode::GetType ()
+{
+  return (csDocumentNodeType)GetData ().type;
+}
+
+bool csInSituNode::Equals (iDocumentNode* other)
+{
+  csInSituNode* other_node = static_cast<csInSituNode*> (other);
+  return (doc == other_node->doc) && (index == other_node->index);
+}
+
+const char* csInSituNode::GetValue ()
+{
+  return doc->GetTable ().GetString (GetData ().value);
+}
+
+csRef<iDocumentNode> csInSituNode::GetParent ()
+{
+  uint32 parent = GetData ().parent;
+  if (parent == tableNone) return 0;
+  return csPtr<iDocumentNode> (doc->AllocNode (parent));
+}
+
+#include "csutil/custom_new_disable.h"
+
+csRef<iDocumentNodeIterator> csInSituNode::GetNodes ()
+{
+  return csPtr<iDocumentNodeIterator> (new (doc->nodeIteratorPool)
+    csInSituNodeIterator (doc, GetData ().firstChild, 0));
+}
+
+csRef<iDocumentNodeIterator> csInSituNode::GetNodes (const char* value)
+{
+  return csPtr<iDocumentNodeIterator> (new (doc->nodeIteratorPool)
+    csInSituNodeIterator (doc, GetData ().firstChild, value));
+}
+
+csRef<iDocumentAttributeIterator> csInSituNode::GetAttributes ()
+{
+  const NodeData& data = GetData ();
+  return csPtr<iDocumentAttributeIterator> (new (doc->attributeIteratorPool)
+    csInSituAttributeIterator (doc, data.firstAttr, data.numAttrs));
+}
+
+#include "csutil/custom_new_enable.h"
+
+csRef<iDocumentNode> csInSituNode::GetNode (const char* value)
+{
+  const NodeTable& table = doc->GetTable ();
+  uint32 child = GetData ().firstChild;
+  while (child != tableNone)
+  {
+    const char* childValue = table.GetString (table.nodes[child].value);
+    if (childValue && (strcmp (childValue, value) == 0))
+      return csPtr<iDocumentNode> (doc->AllocNode (child));
+    child = table.nodes[child].nextSibling;
+  }
+  return 0;
+}
+
+const char* csInSituNode::GetContentsValue ()
+{
+  const NodeTable& table = doc->GetTable ();
+  uint32 child = GetData ().firstChild;
+  while (child != tableNone)
+  {
+    if (table.nodes[child].type == CS_NODE_TEXT)
+      return table.GetString (table.nodes[child].value);
+    child = table.nodes[child].nextSibling;
+  }
+  return 0;
+}
+
+csRef<iDocumentAttribute> csInSituNode::GetAttribute (const char* name)
+{
+  uint32 attr = FindAttribute (name);
+  if (attr == tableNone) return 0;
+  return csPtr<iDocumentAttribute> (doc->AllocAttribute (attr));
+}
+
+const char* csInSituNode::GetAttributeValue (const char* name)
+{
+  uint32 attr = FindAttribute (name);
+  if (attr == tableNone) return 0;
+  const NodeTable& table = doc->GetTable ();
+  return table.GetString (table.attributes[attr].value);
+}
+
+//------------------------------------------------------------------------
+
+csInSituDocument::csInSituDocument (csInSituDocumentSystem* sys) :
+  scfImplementationType (this), sys (sys)
+{
+}
+
+csInSituDocument::~csInSituDocument ()
+{
+}
+
+#include "csutil/custom_new_disable.h"
+
+csInSituNode* csInSituDocument::AllocNode (uint32 index)
+{
+  return new (nodePool) csInSituNode (this, index);
+}
+
+csInSituAttribute* csInSituDocument::AllocAttribute (uint32 index)
+{
+  return new (attributePool) csInSituAttribute (this, index);
+}
+
+#include "csutil/custom_new_enable.h"
+
+void csInSituDocument::Clear ()
+{
+  table.Clear ();
+}
+
+csRef<iDocumentNode> csInSituDocument::CreateRoot ()
+{
+  return 0;
+}
+
+csRef<iDocumentNode> csInSituDocument::GetRoot ()
+{
+  if (table.IsEmpty ()) return 0;
+  return csPtr<iDocumentNode> (AllocNode (0));
+}
+
+const char* csInSituDocument::ParseBuffer (char* buf, bool collapse)
+{
+  Parser parser (table, collapse);
+  const char* err = parser.Parse (buf);
+  if (err != 0)
+  {
+    error = err;
+    table.Clear ();
+    return error;
+  }
+  return 0;
+}
+
+/* The parser modifies the data it works on. Data passed in by the caller
+   (and file data handed out by VFS, which may be memory mapped) can't be
+   written to, so all of these make exactly one copy of the data into the
+   buffer that is then parsed in place. */
+
+const char* csInSituDocument::Parse (iFile* file, bool collapse)
+{
+  size_t size = file->GetSize ();
+  // Offsets in the node table are 32 bit
+  if (size >= tableNone)
+    return "Document too large";
+  char* buf = table.AllocBuffer (size);
+  if (file->Read (buf, size) != size)
+  {
+    table.Clear ();
+    return "Unexpected EOF encountered";
+  }
+  return ParseBuffer (buf, collapse);
+}
+
+const char* csInSituDocument::Parse (iDataBuffer* buf, bool collapse)
+{
+  return Parse (buf->GetData (), buf->GetSize (), collapse);
+}
+
+const char* csInSituDocument::Parse (iString* str, bool collapse)
+{
+  return Parse (str->GetData (), str->Length (), collapse);
+}
+
+const char* csInSituDocument::Parse (const char* buf, bool collapse)
+{
+  return Parse (buf, strlen (buf), collapse);
+}
+
+const char* csInSituDocument::Parse (const char* buf, size_t bufSize,
+                                     bool collapse)
+{
+  if (bufSize >= tableNone)
+    return "Document too large";
+  char* data = table.AllocBuffer (bufSize);
+  memcpy (data, buf, bufSize);
+  return ParseBuffer (data, collapse);
+}
+
+const char* csInSituDocument::Write (iFile*)
+{
+  return "Writing not supported by this plugin!";
+}
+
+const char* csInSituDocument::Write (iString*)
+{
+  return "Writing not supported by this plugin!";
+}
+
+const char* csInSituDocument::Write (iVFS*, const char*)
+{
+  return "Writing not supported by this plugin!";
+}
+
+}
+CS_PLUGIN_NAMESPACE_END(XMLInSitu)
@@ -0,0 +1,198 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_XMLINSITU_XMLINSITU_H__
+#define __CS_XMLINSITU_XMLINSITU_H__
+
+#include "iutil/comp.h"
+#include "iutil/document.h"
+#include "csutil/documentcommon.h"
+#include "csutil/pooledscfclass.h"
+#include "csutil/scf_implementation.h"
+
+#include "parser.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(XMLInSitu)
+{
+  class csInSituDocument;
+
+  /**
+   * Document system parsing XML in place: the document data is loaded into
+   * one buffer and the strings of nodes and attributes point into it.
+   */
+  class csInSituDocumentSystem :
+    public scfImplementation2<csInSituDocumentSystem,
+                              iDocumentSystem,
+                              iComponent>
+  {
+  public:
+    csInSituDocumentSystem (iBase* parent = 0);
+    virtual ~csInSituDocumentSystem ();
+
+    virtual bool Initialize (iObjectRegistry* objreg);
+
+    virtual csRef<iDocument> CreateDocument ();
+  };
+
+  /// Attribute, a view on an entry in the attribute table
+  class csInSituAttribute :
+    public scfImplementationPooled<
+      scfImplementationExt0<csInSituAttribute, csDocumentAttributeCommon>,
+      CS::Memory::AllocatorMalloc,
+      true>
+  {
+    csInSituDocument* doc;
+    uint32 index;
+  public:
+    csInSituAttribute (csInSituDocument* doc, uint32 index);
+    virtual ~csInSituAttribute ();
+    virtual void DecRef ();
+
+    virtual const char* GetName ();
+    virtual const char* GetValue ();
+    virtual void SetName (const char*) { }
+    virtual void SetValue (const char*) { }
+  };
+
+  /// Iterator over consecutive entries in the attribute table
+  class csInSituAttributeIterator :
+    public scfImplementationPooled<
+      scfImplementation1<csInSituAttributeIterator,
+                         iDocumentAttributeIterator>,
+      CS::Memory::AllocatorMalloc,
+      true>
+  {
+    csInSituDocument* doc;
+    uint32 current;
+    uint32 end;
+  public:
+    csInSituAttributeIterator (csInSituDocument* doc, uint32 first,
+      uint32 num);
+    virtual ~csInSituAttributeIterator ();
+    virtual void DecRef ();
+
+    virtual bool HasNext ();
+    virtual csRef<iDocumentAttribute> Next ();
+  };
+
+  /// Iterator over the children of a node, optionally filtered by value
+  class csInSituNodeIterator :
+    public scfImplementationPooled<
+      scfImplementation1<csInSituNodeIterator, iDocumentNodeIterator>,
+      CS::Memory::AllocatorMalloc,
+      true>
+  {
+    csInSituDocument* doc;
+    uint32 current;
+    csString filter;
+    bool filtered;
+    size_t currentPos;
+    size_t endPos;
+
+    uint32 Match (uint32 node);
+  public:
+    csInSituNodeIterator (csInSituDocument* doc, uint32 firstChild,
+      const char* value);
+    virtual ~csInSituNodeIterator ();
+    virtual void DecRef ();
+
+    virtual bool HasNext ();
+    virtual csRef<iDocumentNode> Next ();
+    virtual size_t GetNextPosition () { return currentPos; }
+    virtual size_t GetEndPosition ();
+  };
+
+  /// Node, a view on an entry in the node table
+  class csInSituNode :
+    public scfImplementationPooled<
+      scfImplementationExt0<csInSituNode, csDocumentNodeReadOnly>,
+      CS::Memory::AllocatorMalloc,
+      true>
+  {
+    csInSituDocument* doc;
+    uint32 index;
+
+    const NodeData& GetData () const;
+    uint32 FindAttribute (const char* name) const;
+  public:
+    csInSituNode (csInSituDocument* doc, uint32 index);
+    virtual ~csInSituNode ();
+    virtual void DecRef ();
+
+    virtual csDocumentNodeType GetType ();
+    virtual bool Equals (iDocumentNode* other);
+    virtual const char* GetValue ();
+
+    virtual csRef<iDocumentNode> GetParent ();
+    virtual csRef<iDocumentNodeIterator> GetNodes ();
+    virtual csRef<iDocumentNodeIterator> GetNodes (const char* value);
+    virtual csRef<iDocumentNode> GetNode (const char* value);
+
+    virtual const char* GetContentsValue ();
+
+    virtual csRef<iDocumentAttributeIterator> GetAttributes ();
+    virtual csRef<iDocumentAttribute> GetAttribute (const char* name);
+    virtual const char* GetAttributeValue (const char* name);
+  };
+
+  /**
+   * Document owning the parsed data. Nodes, attributes and iterators are
+   * allocated from pools in the document and keep it alive.
+   */
+  class csInSituDocument :
+    public scfImplementation1<csInSituDocument, iDocument>
+  {
+    // Keep a reference to avoid the plugin being unloaded too early
+    csRef<csInSituDocumentSystem> sys;
+    NodeTable table;
+    csString error;
+
+    const char* ParseBuffer (char* buf, bool collapse);
+  public:
+    csInSituNode::Pool nodePool;
+    csInSituAttribute::Pool attributePool;
+    csInSituNodeIterator::Pool nodeIteratorPool;
+    csInSituAttributeIterator::Pool attributeIteratorPool;
+
+    csInSituDocument (csInSituDocumentSystem* sys);
+    virtual ~csInSituDocument ();
+
+    const NodeTable& GetTable () const { return table; }
+    csInSituNode* AllocNode (uint32 index);
+    csInSituAttribute* AllocAttribute (uint32 index);
+
+    virtual void Clear ();
+    virtual csRef<iDocumentNode> CreateRoot ();
+    virtual csRef<iDocumentNode> GetRoot ();
+
+    virtual const char* Parse (iFile* file,      bool collapse = false);
+    virtual const char* Parse (iDataBuffer* buf, bool collapse = false);
+    virtual const char* Parse (iString* str,     bool collapse = false);
+    virtual const char* Parse (const char* buf,  bool collapse = false);
+    const char* Parse (const char* buf, size_t bufSize, bool collapse);
+
+    virtual const char* Write (iFile*);
+    virtual const char* Write (iString*);
+    virtual const char* Write (iVFS*, const char*);
+
+    virtual int Changeable () { return CS_CHANGEABLE_NEVER; }
+  };
+}
+CS_PLUGIN_NAMESPACE_END(XMLInSitu)
+
+#endif // __CS_XMLINSITU_XMLINSITU_H__
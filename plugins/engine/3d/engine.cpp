@@ -27,10 +27,12 @@
 #include "cstool/vfsdirchange.h"
 #include "csutil/cfgacc.h"
 #include "csutil/databuf.h"
+#include "csutil/platform.h"
 #include "csutil/scf.h"
 #include "csutil/scfstrset.h"
 #include "csutil/scanstr.h"
 #include "csutil/sysfunc.h"
+#include "csutil/threadjobqueue.h"
 #include "csutil/util.h"
 #include "csutil/vfscache.h"
 #include "csutil/xmltiny.h"
@@ -507,6 +509,8 @@ SCF_IMPLEMENT_FACTORY (csEngine)
 csEngine::csEngine (iBase *iParent) :
   scfImplementationType (this, iParent), objectRegistry (0),
   envTexHolder (this), enableEnvTex (true),
+  shaderWarmUp (false), shaderWarmUpMaxLights (0),
+  warmUpDefaultsResolved (false),
   frameWidth (0), frameHeight (0), 
   lightAmbientRed (CS_DEFAULT_LIGHT_LEVEL),
   lightAmbientGreen (CS_DEFAULT_LIGHT_LEVEL),
@@ -514,7 +518,8 @@ csEngine::csEngine (iBase *iParent) :
   sectors (this), textures (new csTextureList (this)), 
   materials (new csMaterialList), sharedVariables (new csSharedVariableList),
   renderLoopManager (0), topLevelClipper (0), resize (false),
-  worldSaveable (false), defaultKeepImage (false), maxAspectRatio (0),
+  worldSaveable (false), defaultKeepImage (false),
+  deferMovableUpdates (false), maxAspectRatio (0),
   nextframePending (0), currentFrameNumber (0), 
   clearZBuf (false), defaultClearZBuf (false), 
   clearScreen (false),  defaultClearScreen (false), 
@@ -1105,14 +1110,18 @@ void csEngine::PrecacheMesh (iMeshWrapper* s)
   CS::RenderManager::RenderView rview (c, view, G3D, G2D);
   StartDraw (c, view, rview);
   PrecacheMesh (s, &rview);
+  WarmUpShaders ();
 }
 
 void csEngine::PrecacheMesh (iMeshWrapper* s, iRenderView* rview)
 {
   int num;
   if (s->GetMeshObject ())
-    s->GetMeshObject ()->GetRenderMeshes (num, rview,
-      s->GetMovable (), 0xf);
+  {
+    csRenderMesh** rmeshes = s->GetMeshObject ()->GetRenderMeshes (num,
+      rview, s->GetMovable (), 0xf);
+    if (rmeshes) QueueShaderWarmUp (s, rmeshes, num);
+  }
   const csRef<iSceneNodeArray> children = s->QuerySceneNode ()
     ->GetChildrenArray ();
   size_t i;
@@ -1143,6 +1152,8 @@ void csEngine::PrecacheDraw (iCollection* collection)
     if (!collection || collection->IsParentOf(s->QueryObject ()))
       PrecacheMesh (s, &rview);
   }
+  // Prepare the shaders before the sectors are drawn with them
+  WarmUpShaders ();
 
   for (sn = 0 ; sn < sectors.GetCount () ; sn++)
   {
@@ -1152,6 +1163,77 @@ void csEngine::PrecacheDraw (iCollection* collection)
   }
 }
 
+void csEngine::QueueShaderWarmUp (iMeshWrapper* mesh, csRenderMesh** rmeshes,
+                                  int num)
+{
+  if (!shaderWarmUp || !shaderManager) return;
+
+  if (!warmUpDefaultsResolved)
+  {
+    for (size_t i = 0; i < shaderWarmUpDefaults.GetSize (); i++)
+    {
+      iShader* shader = shaderManager->GetShader (shaderWarmUpDefaults[i]);
+      if (shader) warmUpDefaultShaders.Push (shader);
+    }
+    warmUpDefaultsResolved = true;
+  }
+
+  csShaderVariableStack stack;
+  stack.Setup (svNameStringSet->GetSize ());
+  for (int i = 0; i < num; i++)
+  {
+    csRenderMesh* rm = rmeshes[i];
+    if (!rm->material) continue;
+    iMaterial* material = rm->material->GetMaterial ();
+
+    csRefArray<iShader> shaders (warmUpDefaultShaders);
+    csHash<csRef<iShader>, csStringID>::ConstGlobalIterator it =
+      material->GetShaders ().GetIterator ();
+    while (it.HasNext ())
+      shaders.PushSmart (it.Next ());
+
+    for (size_t s = 0; s < shaders.GetSize (); s++)
+    {
+      iShader* shader = shaders[s];
+      csRef<iShaderWarmUp> warmUp = scfQueryInterface<iShaderWarmUp> (shader);
+      if (!warmUp) continue;
+
+      // Same order as the render managers set up variables
+      stack.Clear ();
+      shaderManager->PushVariables (stack);
+      if (rm->variablecontext) rm->variablecontext->PushVariables (stack);
+      mesh->GetSVContext ()->PushVariables (stack);
+      material->PushVariables (stack);
+      shader->PushVariables (stack);
+
+      warmUp->QueueWarmUp (*rm, stack, shaderWarmUpMaxLights);
+      warmUpShaders.PutUnique ((iShaderWarmUp*)warmUp, warmUp);
+    }
+  }
+}
+
+void csEngine::WarmUpShaders ()
+{
+  warmUpDefaultShaders.Empty ();
+  warmUpDefaultsResolved = false;
+  if (warmUpShaders.IsEmpty ()) return;
+
+  if (!warmUpJobQueue)
+    warmUpJobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+      CS::Platform::GetProcessorCount (), CS::Threading::THREAD_PRIO_NORMAL));
+
+  // Read the cached data of all shaders in parallel, then set them up here
+  csHash<csRef<iShaderWarmUp>, csPtrKey<iShaderWarmUp> >::GlobalIterator it =
+    warmUpShaders.GetIterator ();
+  while (it.HasNext ())
+    it.Next ()->StartWarmUp (warmUpJobQueue);
+  it.Reset ();
+  while (it.HasNext ())
+    it.Next ()->FinishWarmUp ();
+
+  warmUpShaders.DeleteAll ();
+}
+
 void csEngine::StartDraw (iCamera *c, iClipper2D* /*view*/,
                           CS::RenderManager::RenderView &rview)
 {
@@ -1189,6 +1271,7 @@ void csEngine::Draw (iCamera *c, iClipper2D *view, iMeshWrapper* mesh)
   currentFrameNumber++;
   c->SetViewportSize (frameWidth, frameHeight);
   ControlMeshes ();
+  FlushMovableUpdates ();
   csRef<CS::RenderManager::RenderView> rview;
   rview.AttachNew (new (rviewPool) CS::RenderManager::RenderView (c, view,
     G3D, G2D));
@@ -1454,6 +1537,50 @@ void csEngine::ControlMeshes ()
   }
 }
 
+void csEngine::SetDeferredMovableUpdates (bool enable)
+{
+  if (!enable) FlushMovableUpdates ();
+  deferMovableUpdates = enable;
+}
+
+void csEngine::FlushMovableUpdates ()
+{
+  if (dirtyMovables.GetSize () == 0) return;
+
+  // Take the list: movables that get changed by listeners during the
+  // flush are updated immediately. The movables stay queued until they
+  // are visited, so one that is destroyed by a listener in the meantime
+  // clears its entry (see RemoveDirtyMovable()).
+  flushingMovables = dirtyMovables;
+  dirtyMovables.Empty ();
+
+  bool oldDefer = deferMovableUpdates;
+  deferMovableUpdates = false;
+  // Updating a movable also updates all its children. So only update
+  // movables that don't have a changed parent, the others will be done
+  // when updating their topmost changed parent.
+  for (size_t i = 0 ; i < flushingMovables.GetSize () ; i++)
+  {
+    CS_PLUGIN_NAMESPACE_NAME(Engine)::csMovable* movable =
+      flushingMovables[i];
+    if (!movable) continue;
+    flushingMovables[i] = 0;
+    movable->SetQueued (false);
+    if (movable->IsUpdatePending () && !movable->HasPendingParent ())
+      movable->UpdateMoveNow ();
+  }
+  flushingMovables.Empty ();
+  deferMovableUpdates = oldDefer;
+}
+
+void csEngine::RemoveDirtyMovable (
+  CS_PLUGIN_NAMESPACE_NAME(Engine)::csMovable* movable)
+{
+  dirtyMovables.Delete (movable);
+  size_t idx = flushingMovables.Find (movable);
+  if (idx != csArrayItemNotFound) flushingMovables[idx] = 0;
+}
+
 const char* csEngine::SplitCollectionName(const char* name, iCollection*& collection,
 	bool& global)
 {
@@ -1606,6 +1733,13 @@ void csEngine::ReadConfig (iConfigFile *Config)
   
   enableEnvTex = 
     Config->GetBool ("Engine.AutomaticEnvironmentCube", true);
+
+  shaderWarmUp = Config->GetBool ("Engine.ShaderWarmUp.Enabled", false);
+  shaderWarmUpMaxLights = Config->GetInt ("Engine.ShaderWarmUp.MaxLights", 2);
+  shaderWarmUpDefaults.DeleteAll ();
+  shaderWarmUpDefaults.SplitString (Config->GetStr (
+    "Engine.ShaderWarmUp.DefaultShaders", "lighting_default"), ", ",
+    csStringArray::delimIgnore);
 }
 
 struct LightAndDist
@@ -2324,6 +2458,89 @@ csPtr<iMeshWrapperIterator> csEngine::GetNearbyMeshes (
   return csPtr<iMeshWrapperIterator> (it);
 }
 
+// Number of segments traced by one job in HitBeams().
+#define BEAM_BATCH_SIZE 64
+
+namespace
+{
+  /* Traces a range of the segments of a HitBeams() call. The mesh BVHs
+     are up to date and only read. */
+  class BeamJob : public scfImplementation1<BeamJob, iJob>
+  {
+    const csBeamQuery* queries;
+    const csSectorMeshBVH* const* bvhs;
+    csBeamQueryResult* results;
+    size_t num;
+
+  public:
+    BeamJob (const csBeamQuery* queries, const csSectorMeshBVH* const* bvhs,
+      csBeamQueryResult* results, size_t num) : scfImplementationType (this),
+      queries (queries), bvhs (bvhs), results (results), num (num) {}
+
+    void Run ()
+    {
+      for (size_t i = 0 ; i < num ; i++)
+      {
+        if (bvhs[i])
+          bvhs[i]->HitBeam (queries[i].start, queries[i].end, results[i]);
+        else
+        {
+          results[i].mesh = 0;
+          results[i].triangle = -1;
+          results[i].isect = queries[i].end;
+          results[i].distance = (queries[i].end - queries[i].start).Norm ();
+        }
+      }
+    }
+  };
+}
+
+void csEngine::HitBeams (const csBeamQuery* queries, size_t numQueries,
+  csBeamQueryResult* results)
+{
+  if (numQueries == 0) return;
+  if (!beamJobQueue)
+    beamJobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+      CS::Platform::GetProcessorCount (), CS::Threading::THREAD_PRIO_NORMAL));
+
+  // Bring the BVHs of all sectors involved up to date here: the jobs
+  // only read them.
+  csDirtyAccessArray<const csSectorMeshBVH*> bvhs;
+  bvhs.SetSize (numQueries);
+  csSet<csPtrKey<csSectorMeshBVH> > updated;
+  size_t i;
+  for (i = 0 ; i < numQueries ; i++)
+  {
+    csSector* sector = static_cast<csSector*> (queries[i].sector);
+    csSectorMeshBVH* bvh = sector ? sector->GetMeshBVH () : 0;
+    if (bvh && !updated.Contains (bvh))
+    {
+      bvh->Update (beamJobQueue);
+      updated.AddNoTest (bvh);
+    }
+    bvhs[i] = bvh;
+  }
+
+  csRefArray<BeamJob> jobs;
+  for (i = 0 ; i < numQueries ; i += BEAM_BATCH_SIZE)
+  {
+    csRef<BeamJob> job;
+    job.AttachNew (new BeamJob (queries + i, bvhs.GetArray () + i,
+      results + i, csMin (size_t (BEAM_BATCH_SIZE), numQueries - i)));
+    jobs.Push (job);
+  }
+  if (jobs.GetSize () == 1)
+  {
+    jobs[0]->Run ();
+    return;
+  }
+  for (i = 0 ; i < jobs.GetSize () ; i++)
+    beamJobQueue->Enqueue (jobs[i]);
+  // Help with the jobs that were not picked up yet.
+  for (i = 0 ; i < jobs.GetSize () ; i++)
+    beamJobQueue->PullAndRun (jobs[i], true);
+}
+
 csPtr<iMeshWrapperIterator> csEngine::GetVisibleMeshes (
   iSector* /*sector*/,
   const csVector3& /*pos*/)
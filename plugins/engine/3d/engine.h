@@ -47,6 +47,7 @@
 #include "iutil/comp.h"
 #include "iutil/dbghelp.h"
 #include "iutil/eventh.h"
+#include "iutil/job.h"
 #include "iutil/pluginconfig.h"
 #include "iutil/string.h"
 #include "iutil/strset.h"
@@ -387,6 +388,9 @@ public:
   virtual csPtr<iMeshWrapperIterator> GetNearbyMeshes (iSector* sector,
     const csVector3& start, const csVector3& end, bool crossPortals = true );
 
+  virtual void HitBeams (const csBeamQuery* queries, size_t numQueries,
+    csBeamQueryResult* results);
+
   virtual iMeshList* GetMeshes ()
   { return &meshes; }
 
@@ -505,8 +509,22 @@ public:
     currentFrameNumber++; 
     envTexHolder.NextFrame ();
     ControlMeshes ();
+    FlushMovableUpdates ();
   }
 
+  virtual void SetDeferredMovableUpdates (bool enable);
+  virtual bool GetDeferredMovableUpdates () const
+  { return deferMovableUpdates; }
+  virtual void FlushMovableUpdates ();
+
+  /// Remember a movable for the next FlushMovableUpdates().
+  void AddDirtyMovable (
+    CS_PLUGIN_NAMESPACE_NAME(Engine)::csMovable* movable)
+  { dirtyMovables.Push (movable); }
+  /// Forget a movable that is destroyed before it was flushed.
+  void RemoveDirtyMovable (
+    CS_PLUGIN_NAMESPACE_NAME(Engine)::csMovable* movable);
+
   //-- Saving/loading
 
   virtual void SetSaveableFlag (bool enable)
@@ -751,6 +769,12 @@ private:
   // Precache a single mesh
   void PrecacheMesh (iMeshWrapper* s, iRenderView* rview);
 
+  /// Queue the shaders used by some render meshes for warm-up
+  void QueueShaderWarmUp (iMeshWrapper* mesh, csRenderMesh** rmeshes,
+    int num);
+  /// Warm up the queued shaders
+  void WarmUpShaders ();
+
   iRenderManager* GetRenderManager () { return renderManager; }
   void SetRenderManager (iRenderManager*);
   void ReloadRenderManager (csConfigAccess& cfg);
@@ -784,6 +808,24 @@ public:
   EnvTex::Holder envTexHolder;
   bool enableEnvTex;
 
+  /// Shader warm-up settings
+  bool shaderWarmUp;
+  int shaderWarmUpMaxLights;
+  /// Shaders warmed up for every material, e.g. render layer defaults
+  csStringArray shaderWarmUpDefaults;
+  /**
+   * The shaders named by shaderWarmUpDefaults, looked up once per warm-up
+   * as shaders can be (un)registered between warm-ups.
+   */
+  csRefArray<iShader> warmUpDefaultShaders;
+  bool warmUpDefaultsResolved;
+  /// Shaders with tickets queued for warm-up
+  csHash<csRef<iShaderWarmUp>, csPtrKey<iShaderWarmUp> > warmUpShaders;
+  csRef<iJobQueue> warmUpJobQueue;
+
+  /// Job queue for HitBeams() and the BVH builds it needs.
+  csRef<iJobQueue> beamJobQueue;
+
   /// For triangle meshes.
   csStringID colldet_id;
   csStringID viscull_id;
@@ -938,6 +980,13 @@ private:
   /// Default 'keep image' flag
   bool defaultKeepImage;
 
+  /// Whether movable updates are deferred to FlushMovableUpdates().
+  bool deferMovableUpdates;
+  /// Movables with pending updates.
+  csArray<CS_PLUGIN_NAMESPACE_NAME(Engine)::csMovable*> dirtyMovables;
+  /// Movables being updated by FlushMovableUpdates().
+  csArray<CS_PLUGIN_NAMESPACE_NAME(Engine)::csMovable*> flushingMovables;
+
   /// Maximum texture aspect ratio
   int maxAspectRatio;
 
@@ -199,6 +199,9 @@ public:
 
   csLightDynamicType GetDynamicType () const { return dynamicType; }
 
+  /// Get the engine this light belongs to.
+  csEngine* GetEngine () const { return engine; }
+
   /// Get the ID of this light.
   const char* GetLightID () { return GenerateUniqueID (); }
 
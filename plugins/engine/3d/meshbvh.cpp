@@ -0,0 +1,331 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "csutil/refarr.h"
+#include "csutil/set.h"
+#include "iengine/engine.h"
+#include "imesh/object.h"
+#include "imesh/objmodel.h"
+#include "iutil/job.h"
+
+#include "plugins/engine/3d/engine.h"
+#include "plugins/engine/3d/meshbvh.h"
+#include "plugins/engine/3d/meshfact.h"
+#include "plugins/engine/3d/meshobj.h"
+
+using namespace CS_PLUGIN_NAMESPACE_NAME(Engine);
+
+// Meshes per leaf of the top level BVH.
+#define MESHBVH_LEAF_SIZE 2
+// The top level BVH is rebuilt when refitting made it this much worse.
+#define MESHBVH_REBUILD_THRESHOLD 1.5f
+
+/* Builds the BVH of one triangle mesh. The triangle data is fetched on the
+   main thread, the job only reads it. */
+class csSectorMeshBVH::BuildJob : public scfImplementation1<BuildJob, iJob>
+{
+public:
+  csTriangleBVHCache* cache;
+  csRef<iTriangleMesh> source;
+  uint32 changeNumber;
+  const csVector3* vertices;
+  size_t numVertices;
+  const csTriangle* triangles;
+  size_t numTriangles;
+  csRef<CS::Geometry::TriangleBVH> bvh;
+
+  BuildJob (csTriangleBVHCache* cache, iTriangleMesh* source) :
+    scfImplementationType (this), cache (cache), source (source)
+  {
+    changeNumber = source->GetChangeNumber ();
+    vertices = source->GetVertices ();
+    numVertices = source->GetVertexCount ();
+    triangles = source->GetTriangles ();
+    numTriangles = source->GetTriangleCount ();
+  }
+
+  void Run ()
+  {
+    bvh.AttachNew (new CS::Geometry::TriangleBVH (vertices, numVertices,
+      triangles, numTriangles));
+  }
+};
+
+struct csSectorMeshBVH::HitInstance
+{
+  const csSectorMeshBVH* self;
+  csVector3 start;
+  csVector3 end;
+  csMeshWrapper* mesh;
+  int triangle;
+  float r;
+
+  bool operator() (uint32 prim, float& maxT)
+  {
+    const Instance& inst = self->instances[self->primitiveInstance[prim]];
+    if (inst.mesh->flags.Check (CS_ENTITY_NOHITBEAM)) return true;
+    float hitR = maxT;
+    int hitTriangle;
+    bool hit;
+    // The fraction along the segment is the same in object space.
+    if (inst.identity)
+      hit = inst.triangles->HitSegment (start, end, hitR, hitTriangle);
+    else
+      hit = inst.triangles->HitSegment (inst.transform.Other2This (start),
+        inst.transform.Other2This (end), hitR, hitTriangle);
+    if (hit)
+    {
+      maxT = r = hitR;
+      mesh = inst.mesh;
+      triangle = hitTriangle;
+    }
+    return true;
+  }
+};
+
+csSectorMeshBVH::csSectorMeshBVH () :
+  scfImplementationType (this), needBuild (false),
+  anyDirty (false), buildCost (0)
+{
+}
+
+csSectorMeshBVH::~csSectorMeshBVH ()
+{
+}
+
+void csSectorMeshBVH::AddMesh (iMeshWrapper* mesh)
+{
+  csMeshWrapper* cmesh = static_cast<csMeshWrapper*> (mesh);
+  // Same meshes as the visibility culler gets.
+  if (cmesh->SomeParentHasStaticLOD ()) return;
+  iMovable* movable = mesh->GetMovable ();
+  if (instanceIndex.Contains (movable)) return;
+
+  Instance inst;
+  inst.mesh = cmesh;
+  inst.identity = true;
+  inst.shapeNumber = 0;
+  inst.primitive = csArrayItemNotFound;
+  inst.dirty = true;
+  instanceIndex.Put (movable, instances.Push (inst));
+  movable->AddListener (this);
+  anyDirty = true;
+  needBuild = true;
+}
+
+void csSectorMeshBVH::RemoveMesh (iMeshWrapper* mesh)
+{
+  iMovable* movable = mesh->GetMovable ();
+  size_t index = instanceIndex.Get (movable, csArrayItemNotFound);
+  if (index == csArrayItemNotFound) return;
+  movable->RemoveListener (this);
+  RemoveInstance (index);
+}
+
+void csSectorMeshBVH::RemoveInstance (size_t index)
+{
+  instanceIndex.DeleteAll (instances[index].mesh->GetMovable ());
+  const size_t last = instances.GetSize () - 1;
+  if (index != last)
+  {
+    instances[index] = instances[last];
+    instanceIndex.PutUnique (instances[index].mesh->GetMovable (), index);
+  }
+  instances.Truncate (last);
+  needBuild = true;
+}
+
+void csSectorMeshBVH::RemoveAll ()
+{
+  for (size_t i = 0 ; i < instances.GetSize () ; i++)
+    instances[i].mesh->GetMovable ()->RemoveListener (this);
+  instances.DeleteAll ();
+  instanceIndex.DeleteAll ();
+  bvh.Clear ();
+  boxes.DeleteAll ();
+  primitiveInstance.DeleteAll ();
+  needBuild = false;
+  anyDirty = false;
+}
+
+csTriangleBVHCache* csSectorMeshBVH::GetTriangleCache (csMeshWrapper* mesh,
+  iTriangleMesh*& triangles)
+{
+  iMeshObject* meshobj = mesh->GetMeshObject ();
+  if (!meshobj) return 0;
+  iObjectModel* model = meshobj->GetObjectModel ();
+  if (!model) return 0;
+  const csStringID base_id = mesh->engine->base_id;
+  triangles = model->GetTriangleData (base_id);
+  if (!triangles || triangles->GetTriangleCount () == 0) return 0;
+
+  // Instances that use the triangles of their factory share its BVH.
+  csMeshFactoryWrapper* factory = static_cast<csMeshFactoryWrapper*> (
+    mesh->GetFactory ());
+  if (factory && factory->GetMeshObjectFactory ())
+  {
+    iObjectModel* factoryModel =
+      factory->GetMeshObjectFactory ()->GetObjectModel ();
+    if (factoryModel && factoryModel->GetTriangleData (base_id) == triangles)
+      return &factory->triangleBVH;
+  }
+  return &mesh->triangleBVH;
+}
+
+void csSectorMeshBVH::BuildTriangleBVHs (iJobQueue* jobQueue)
+{
+  csSet<csPtrKey<csTriangleBVHCache> > queued;
+  csRefArray<BuildJob> jobs;
+  size_t i;
+  for (i = 0 ; i < instances.GetSize () ; i++)
+  {
+    if (!instances[i].dirty) continue;
+    iTriangleMesh* triangles;
+    csTriangleBVHCache* cache = GetTriangleCache (instances[i].mesh,
+      triangles);
+    if (!cache || cache->IsValid (triangles) || queued.Contains (cache))
+      continue;
+    queued.AddNoTest (cache);
+
+    triangles->Lock ();
+    csRef<BuildJob> job;
+    job.AttachNew (new BuildJob (cache, triangles));
+    jobs.Push (job);
+    if (jobQueue) jobQueue->Enqueue (job);
+  }
+
+  for (i = 0 ; i < jobs.GetSize () ; i++)
+  {
+    BuildJob* job = jobs[i];
+    if (jobQueue)
+      jobQueue->PullAndRun (job, true);
+    else
+      job->Run ();
+    job->cache->source = job->source;
+    job->cache->changeNumber = job->changeNumber;
+    job->cache->bvh = job->bvh;
+    job->source->Unlock ();
+  }
+}
+
+void csSectorMeshBVH::Update (iJobQueue* jobQueue)
+{
+  size_t i;
+  // Shape changes are not reported to movable listeners.
+  for (i = 0 ; i < instances.GetSize () ; i++)
+  {
+    Instance& inst = instances[i];
+    if (inst.dirty) continue;
+    iMeshObject* meshobj = inst.mesh->GetMeshObject ();
+    iObjectModel* model = meshobj ? meshobj->GetObjectModel () : 0;
+    if (model && model->GetShapeNumber () != inst.shapeNumber)
+    {
+      inst.dirty = true;
+      anyDirty = true;
+    }
+  }
+  if (!anyDirty && !needBuild) return;
+
+  if (anyDirty)
+  {
+    BuildTriangleBVHs (jobQueue);
+    for (i = 0 ; i < instances.GetSize () ; i++)
+    {
+      Instance& inst = instances[i];
+      if (!inst.dirty) continue;
+      inst.dirty = false;
+
+      iMovable* movable = inst.mesh->GetMovable ();
+      inst.transform = movable->GetFullTransform ();
+      inst.identity = movable->IsFullTransformIdentity ();
+      iMeshObject* meshobj = inst.mesh->GetMeshObject ();
+      iObjectModel* model = meshobj ? meshobj->GetObjectModel () : 0;
+      inst.shapeNumber = model ? model->GetShapeNumber () : 0;
+      iTriangleMesh* triangles;
+      csTriangleBVHCache* cache = GetTriangleCache (inst.mesh, triangles);
+      inst.triangles = cache ? cache->GetBVH () : 0;
+
+      // Meshes that get or lose triangles change the set of primitives.
+      const bool hasTriangles = inst.triangles
+        && !inst.triangles->GetBBox ().Empty ();
+      if (hasTriangles != (inst.primitive != csArrayItemNotFound))
+        needBuild = true;
+      else if (hasTriangles)
+        boxes[inst.primitive] = inst.transform.This2Other (
+          inst.triangles->GetBBox ());
+    }
+    anyDirty = false;
+
+    if (!needBuild)
+    {
+      bvh.Refit (boxes.GetArray ());
+      if (bvh.GetCost () <= buildCost * MESHBVH_REBUILD_THRESHOLD) return;
+    }
+  }
+
+  boxes.Empty ();
+  primitiveInstance.Empty ();
+  for (i = 0 ; i < instances.GetSize () ; i++)
+  {
+    Instance& inst = instances[i];
+    inst.primitive = csArrayItemNotFound;
+    if (!inst.triangles || inst.triangles->GetBBox ().Empty ()) continue;
+    inst.primitive = boxes.Push (inst.transform.This2Other (
+      inst.triangles->GetBBox ()));
+    primitiveInstance.Push (i);
+  }
+  bvh.Build (boxes.GetArray (), boxes.GetSize (), MESHBVH_LEAF_SIZE,
+    jobQueue);
+  buildCost = bvh.GetCost ();
+  needBuild = false;
+}
+
+bool csSectorMeshBVH::HitBeam (const csVector3& start, const csVector3& end,
+  csBeamQueryResult& result) const
+{
+  HitInstance hit;
+  hit.self = this;
+  hit.start = start;
+  hit.end = end;
+  hit.mesh = 0;
+  hit.triangle = -1;
+  hit.r = 1.0f;
+  bvh.Trace (start, end, hit);
+
+  const csVector3 dir = end - start;
+  result.mesh = hit.mesh;
+  result.triangle = hit.triangle;
+  result.isect = start + dir * hit.r;
+  result.distance = dir.Norm () * hit.r;
+  return hit.mesh != 0;
+}
+
+void csSectorMeshBVH::MovableChanged (iMovable* movable)
+{
+  size_t index = instanceIndex.Get (movable, csArrayItemNotFound);
+  if (index == csArrayItemNotFound) return;
+  instances[index].dirty = true;
+  anyDirty = true;
+}
+
+void csSectorMeshBVH::MovableDestroyed (iMovable* movable)
+{
+  size_t index = instanceIndex.Get (movable, csArrayItemNotFound);
+  if (index != csArrayItemNotFound) RemoveInstance (index);
+}
@@ -0,0 +1,162 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_MESHBVH_H__
+#define __CS_MESHBVH_H__
+
+#include "csgeom/bvh.h"
+#include "csgeom/transfrm.h"
+#include "csutil/array.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/hash.h"
+#include "csutil/ref.h"
+#include "csutil/scf_implementation.h"
+#include "iengine/movable.h"
+#include "igeom/trimesh.h"
+
+struct csBeamQueryResult;
+struct iJobQueue;
+struct iMeshWrapper;
+
+CS_PLUGIN_NAMESPACE_BEGIN(Engine)
+{
+  class csMeshWrapper;
+}
+CS_PLUGIN_NAMESPACE_END(Engine)
+
+/**
+ * The triangle BVH of a triangle mesh, rebuilt when the triangle mesh
+ * changes. Mesh factories keep one that all their instances share;
+ * meshes with their own triangles keep their own.
+ */
+class csTriangleBVHCache
+{
+  friend class csSectorMeshBVH;
+
+  /// The triangle mesh the BVH was built from.
+  csRef<iTriangleMesh> source;
+  /// Change number of the source when the BVH was built.
+  uint32 changeNumber;
+  csRef<CS::Geometry::TriangleBVH> bvh;
+
+public:
+  csTriangleBVHCache () : changeNumber (0) {}
+
+  /// Return true if the BVH was built for the current state of \a mesh.
+  bool IsValid (iTriangleMesh* mesh) const
+  {
+    return bvh && source == mesh && changeNumber == mesh->GetChangeNumber ();
+  }
+
+  /// Get the BVH (0 if never built).
+  CS::Geometry::TriangleBVH* GetBVH () const { return bvh; }
+
+  /// Forget the BVH.
+  void Clear ()
+  {
+    source = 0;
+    bvh = 0;
+  }
+};
+
+/**
+ * The top level of the two-level hierarchy used by iEngine::HitBeams():
+ * a BVH over the world space boxes of all meshes in a sector. Every mesh
+ * refers to the triangle BVH of its factory (or its own).
+ *
+ * Moving meshes are picked up through movable listeners and only refit
+ * the BVH; it is rebuilt when meshes are added or removed or when it got
+ * too bad. Update() must be called on the main thread before queries;
+ * HitBeam() only reads and can run on any number of threads at once.
+ */
+class csSectorMeshBVH :
+  public scfImplementation1<csSectorMeshBVH, iMovableListener>
+{
+  struct Instance
+  {
+    CS_PLUGIN_NAMESPACE_NAME(Engine)::csMeshWrapper* mesh;
+    /// Object to world transform.
+    csReversibleTransform transform;
+    bool identity;
+    /// Shape number of the object model when the instance was updated.
+    long shapeNumber;
+    /// The triangles; 0 if the mesh has none.
+    csRef<CS::Geometry::TriangleBVH> triangles;
+    /// Index of the instance in the BVH (csArrayItemNotFound if not in it).
+    size_t primitive;
+    /// The movable changed since the last update.
+    bool dirty;
+  };
+  struct HitInstance;
+  class BuildJob;
+
+  csArray<Instance> instances;
+  csHash<size_t, csPtrKey<iMovable> > instanceIndex;
+  /// BVH over the instances with triangles.
+  CS::Geometry::BVH bvh;
+  /// Boxes of the BVH primitives.
+  csDirtyAccessArray<csBox3> boxes;
+  /// Instance of every BVH primitive.
+  csArray<size_t> primitiveInstance;
+  /// Instances were added or removed since the last build.
+  bool needBuild;
+  /// Some instance is dirty.
+  bool anyDirty;
+  /// Cost of the BVH when it was built.
+  float buildCost;
+
+  void RemoveInstance (size_t index);
+  /// Find the triangle BVH cache to use for a mesh.
+  csTriangleBVHCache* GetTriangleCache (
+    CS_PLUGIN_NAMESPACE_NAME(Engine)::csMeshWrapper* mesh,
+    iTriangleMesh*& triangles);
+  /// Build the triangle BVHs the dirty instances need.
+  void BuildTriangleBVHs (iJobQueue* jobQueue);
+
+public:
+  csSectorMeshBVH ();
+  virtual ~csSectorMeshBVH ();
+
+  /// Add a mesh (without children).
+  void AddMesh (iMeshWrapper* mesh);
+  /// Remove a mesh (without children).
+  void RemoveMesh (iMeshWrapper* mesh);
+  /// Remove all meshes.
+  void RemoveAll ();
+
+  /**
+   * Bring the BVH up to date with all moved and changed meshes. New
+   * triangle BVHs are built in parallel on \a jobQueue.
+   */
+  void Update (iJobQueue* jobQueue);
+
+  /**
+   * Find the first triangle hit by the segment from \a start to \a end.
+   * Returns false if nothing was hit.
+   */
+  bool HitBeam (const csVector3& start, const csVector3& end,
+    csBeamQueryResult& result) const;
+
+  /**\name iMovableListener implementation
+   * @{ */
+  virtual void MovableChanged (iMovable* movable);
+  virtual void MovableDestroyed (iMovable* movable);
+  /** @} */
+};
+
+#endif // __CS_MESHBVH_H__
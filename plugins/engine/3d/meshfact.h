@@ -44,6 +44,7 @@
 #include "meshlod.h"
 #include "scenenode.h"
 #include "light.h"
+#include "meshbvh.h"
 
 struct iMeshFactLoaderIterator;
 struct iMeshWrapper;
@@ -204,6 +205,9 @@ protected:
   virtual void InternalRemove() { SelfDestruct(); }
 
 public:
+  /// BVH of the factory triangles, shared by all instances.
+  csTriangleBVHCache triangleBVH;
+
   /// Constructor.
   csMeshFactoryWrapper (csEngine* engine, iMeshObjectFactory* meshFact);
   /// Constructor.
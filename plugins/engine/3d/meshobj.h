@@ -44,6 +44,7 @@
 #include "meshlod.h"
 #include "scenenode.h"
 #include "light.h"
+#include "meshbvh.h"
 
 struct iMeshLoaderIterator;
 struct iMeshWrapper;
@@ -280,6 +281,12 @@ public:
 
   csEngine* engine;
 
+  /**
+   * BVH of our triangles for iEngine::HitBeams(), if they are not the
+   * triangles of the factory.
+   */
+  csTriangleBVHCache triangleBVH;
+
   /**
    * Clear this object from all sector portal lists.
    * If a sector is given then it will only clear for that sector.
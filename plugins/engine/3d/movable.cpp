@@ -100,13 +100,16 @@ iSector *csMovableSectorList::FindByName (const char *Name) const
 
 csMovable::csMovable ()
   : scfImplementationType (this), is_identity (true), parent (0),
-    meshobject (0), lightobject (0), cameraobject (0), updatenr (0)
+    meshobject (0), lightobject (0), cameraobject (0), updatenr (0),
+    updatePending (false), queuedEngine (0)
 {
   sectors.SetMovable (this);
 }
 
 csMovable::~csMovable ()
 {
+  if (queuedEngine) queuedEngine->RemoveDirtyMovable (this);
+
   size_t i = listeners.GetSize ();
   while (i > 0)
   {
@@ -163,8 +166,35 @@ void csMovable::RemoveListener (iMovableListener *listener)
   listeners.Delete (listener);
 }
 
+csEngine* csMovable::GetEngine () const
+{
+  if (meshobject) return meshobject->engine;
+  if (lightobject) return lightobject->GetEngine ();
+  return 0;
+}
+
 void csMovable::UpdateMove ()
 {
+  is_identity = obj.IsIdentity ();
+
+  csEngine* engine = GetEngine ();
+  if (engine && engine->GetDeferredMovableUpdates ())
+  {
+    updatePending = true;
+    if (!queuedEngine)
+    {
+      queuedEngine = engine;
+      engine->AddDirtyMovable (this);
+    }
+    return;
+  }
+
+  UpdateMoveNow ();
+}
+
+void csMovable::UpdateMoveNow ()
+{
+  updatePending = false;
   updatenr++;
   is_identity = obj.IsIdentity ();
 
@@ -173,7 +203,7 @@ void csMovable::UpdateMove ()
 
   size_t i;
   for (i = 0 ; i < scene_children.GetSize () ; i++)
-    scene_children[i]->GetMovable ()->UpdateMove ();
+    ((csMovable*)scene_children[i]->GetMovable ())->UpdateMoveNow ();
 
   i = listeners.GetSize ();
   while (i > 0)
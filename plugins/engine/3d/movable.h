@@ -31,6 +31,8 @@
 class csVector3;
 class csMatrix3;
 
+class csEngine;
+
 CS_PLUGIN_NAMESPACE_BEGIN(Engine)
 {
   class csCameraBase;
@@ -113,6 +115,17 @@ private:
   /// Update number.
   long updatenr;
 
+  /**
+   * UpdateMove() was called but the update was deferred
+   * (see csEngine::SetDeferredMovableUpdates()).
+   */
+  bool updatePending;
+  /// Engine on whose list of changed movables we are (or 0).
+  csEngine* queuedEngine;
+
+  /// Get the engine of our mesh or light.
+  csEngine* GetEngine () const;
+
 public:
   /**
    * Create a default movable.
@@ -289,6 +302,29 @@ public:
    */
   void UpdateMove ();
 
+  /**
+   * Update the mesh, light, children and listeners now, even if
+   * movable updates are deferred.
+   */
+  void UpdateMoveNow ();
+
+  /// Return true if an update of this movable has been deferred.
+  bool IsUpdatePending () const { return updatePending; }
+
+  /// Return true if one of our parents has a deferred update.
+  bool HasPendingParent () const
+  {
+    for (csMovable* p = parent ; p != 0 ; p = p->parent)
+      if (p->updatePending) return true;
+    return false;
+  }
+
+  /// Called by the engine when it removes us from its list.
+  void SetQueued (bool queued)
+  {
+    if (!queued) queuedEngine = 0;
+  }
+
   /**
    * Add a listener to this movable. This listener will be called whenever
    * the movable changes or right before the movable is destroyed.
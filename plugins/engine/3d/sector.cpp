@@ -146,6 +146,7 @@ csSector::csSector (csEngine *engine) :
 csSector::~csSector ()
 {
   lights.RemoveAll ();
+  if (meshBVH) meshBVH->RemoveAll ();
 }
 
 void csSector::SelfDestruct ()
@@ -211,12 +212,41 @@ void csSector::UnregisterMeshToCuller (iMeshWrapper* mesh)
   culler->UnregisterVisObject (vo);
 }
 
+void csSector::RegisterEntireMeshToBVH (iMeshWrapper* mesh)
+{
+  meshBVH->AddMesh (mesh);
+
+  csMeshWrapper* cmesh = (csMeshWrapper*)mesh;
+  if (cmesh->GetStaticLODMesh ()) return;
+  size_t i;
+  const csRefArray<iSceneNode>& ml = cmesh->GetChildren ();
+  for (i = 0 ; i < ml.GetSize () ; i++)
+  {
+    iMeshWrapper* child = ml[i]->QueryMesh ();
+    if (child)
+      RegisterEntireMeshToBVH (child);
+  }
+}
+
+csSectorMeshBVH* csSector::GetMeshBVH ()
+{
+  if (!meshBVH)
+  {
+    meshBVH.AttachNew (new csSectorMeshBVH ());
+    int i;
+    for (i = 0 ; i < meshes.GetCount () ; i++)
+      RegisterEntireMeshToBVH (meshes.Get (i));
+  }
+  return meshBVH;
+}
+
 void csSector::PrepareMesh (iMeshWrapper *mesh)
 {
   bool do_camera = mesh->GetFlags ().Check (CS_ENTITY_CAMERA);
   if (do_camera) cameraMeshes.Push (mesh);
 
   if (culler) RegisterMeshToCuller (mesh);
+  if (meshBVH) meshBVH->AddMesh (mesh);
   size_t i;
   const csRefArray<iSceneNode>& ml = ((csMeshWrapper*)mesh)->GetChildren ();
   for (i = 0 ; i < ml.GetSize () ; i++)
@@ -232,6 +262,7 @@ void csSector::UnprepareMesh (iMeshWrapper *mesh)
   cameraMeshes.Delete (mesh);
 
   if (culler) UnregisterMeshToCuller (mesh);
+  if (meshBVH) meshBVH->RemoveMesh (mesh);
   size_t i;
   const csRefArray<iSceneNode>& ml = ((csMeshWrapper*)mesh)->GetChildren ();
   for (i = 0 ; i < ml.GetSize () ; i++)
@@ -298,6 +298,12 @@ public:
 
   virtual iVisibilityCuller* GetVisibilityCuller ();
 
+  /**
+   * Get the BVH over the meshes of this sector used by
+   * iEngine::HitBeams(). It is created on first use.
+   */
+  csSectorMeshBVH* GetMeshBVH ();
+
   virtual csSectorHitBeamResult HitBeamPortals (const csVector3& start,
   	const csVector3& end);
 
@@ -403,6 +409,11 @@ private:
    */
   void UnregisterMeshToCuller (iMeshWrapper* mesh);
 
+  /**
+   * Add a mesh and all children to the mesh BVH.
+   */
+  void RegisterEntireMeshToBVH (iMeshWrapper* mesh);
+
   /**
    * Prepare a mesh for rendering. This function is called for all meshes that
    * are added to the sector.
@@ -518,6 +529,9 @@ private:
    */
   csRef<iVisibilityCuller> culler;
 
+  /// BVH for iEngine::HitBeams() or 0 if it was never used.
+  csRef<csSectorMeshBVH> meshBVH;
+
   /// Caching of visible meshes
   struct visibleMeshCacheHolder
   {
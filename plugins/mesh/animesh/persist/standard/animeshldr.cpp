@@ -19,16 +19,23 @@
 
 #include "cssysdef.h"
 
+
+#include "csgfx/renderbuffer.h"
+#include "csutil/cfgacc.h"
 #include "csutil/ref.h"
 #include "iengine/engine.h"
 #include "imap/services.h"
 #include "imesh/animesh.h"
 #include "imesh/object.h"
+#include "iutil/string.h"
 #include "iutil/stringarray.h"
 #include "iutil/document.h"
 #include "iutil/plugin.h"
 #include "ivaria/reporter.h"
 #include "imap/ldrctxt.h"
+#include "imap/renderbufferpersistence.h"
+#include "iengine/material.h"
+#include "iutil/object.h"
 #include "iengine/mesh.h"
 #include "imesh/skeleton2.h"
 #include "imesh/skeleton2anim.h"
@@ -389,15 +396,174 @@ CS_PLUGIN_NAMESPACE_BEGIN(Animeshldr)
     : scfImplementationType (this, parent)
   {}
 
+  void AnimeshFactorySaver::WriteRenderBuffer (iDocumentNode* parent,
+    const char* nodeName, iRenderBuffer* buffer, const char* factName,
+    const char* bufName)
+  {
+    if (!buffer) return;
+
+    csRef<iDocumentNode> node = parent->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+    node->SetValue (nodeName);
+
+    // Write large buffers to a file unless the buffer knows where it goes
+    csRef<iRenderBufferPersistence> persist = 
+      scfQueryInterface<iRenderBufferPersistence> (buffer);
+    if ((externalBufferSize == 0) || persist.IsValid()
+      || (buffer->GetSize() < externalBufferSize))
+    {
+      synldr->WriteRenderBuffer (node, buffer);
+      return;
+    }
+
+    csRef<iString> filename = synldr->GetRenderBufferFileName (
+      factName ? factName : "animesh", bufName);
+    csRef<CS::RenderBufferPersistent> bufPersist;
+    bufPersist.AttachNew (new CS::RenderBufferPersistent (buffer));
+    bufPersist->SetFileName (filename->GetData ());
+    synldr->WriteRenderBuffer (node, bufPersist);
+  }
+
   bool AnimeshFactorySaver::WriteDown (iBase *obj, iDocumentNode* parent,
     iStreamSource*)
   {
-    return false;
+    if (!parent) return false;
+
+    csRef<iMeshObjectFactory> meshfact = 
+      scfQueryInterfaceSafe<iMeshObjectFactory> (obj);
+    csRef<iAnimatedMeshFactory> amfact = 
+      scfQueryInterfaceSafe<iAnimatedMeshFactory> (obj);
+    if (!meshfact || !amfact) return false;
+
+    const char* factName = 0;
+    if (meshfact->GetMeshFactoryWrapper ())
+      factName = meshfact->GetMeshFactoryWrapper ()->QueryObject ()->GetName ();
+
+    csRef<iDocumentNode> paramsNode = 
+      parent->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+    paramsNode->SetValue ("params");
+
+    iMaterialWrapper* mat = meshfact->GetMaterialWrapper ();
+    if (mat && mat->QueryObject ()->GetName ())
+    {
+      csRef<iDocumentNode> matNode = 
+        paramsNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      matNode->SetValue ("material");
+      matNode->CreateNodeBefore (CS_NODE_TEXT, 0)->SetValue (
+        mat->QueryObject ()->GetName ());
+    }
+
+    csRef<iDocumentNode> mixmodeNode = 
+      paramsNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+    mixmodeNode->SetValue ("mixmode");
+    synldr->WriteMixmode (mixmodeNode, meshfact->GetMixMode (), true);
+
+    WriteRenderBuffer (paramsNode, "vertex", amfact->GetVertices (),
+      factName, "vertex");
+    WriteRenderBuffer (paramsNode, "texcoord", amfact->GetTexCoords (),
+      factName, "texcoord");
+    WriteRenderBuffer (paramsNode, "normal", amfact->GetNormals (),
+      factName, "normal");
+    WriteRenderBuffer (paramsNode, "tangent", amfact->GetTangents (),
+      factName, "tangent");
+    WriteRenderBuffer (paramsNode, "binormal", amfact->GetBinormals (),
+      factName, "binormal");
+    WriteRenderBuffer (paramsNode, "color", amfact->GetColors (),
+      factName, "color");
+
+    /* Skeleton factories are not named, so the <skeleton> reference can't
+       be written; the bone influences refer to bones by ID anyway. */
+    if (amfact->GetSkeletonFactory ())
+    {
+      uint perVertex = amfact->GetBoneInfluencesPerVertex ();
+      csRef<iDocumentNode> biNode = 
+        paramsNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      biNode->SetValue ("boneinfluences");
+      biNode->SetAttributeAsInt ("bonespervertex", perVertex);
+      const csAnimatedMeshBoneInfluence* bi = amfact->GetBoneInfluences ();
+      size_t numInfl = amfact->GetVertexCount () * perVertex;
+      for (size_t i = 0; i < numInfl; i++)
+      {
+        csRef<iDocumentNode> node = 
+          biNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+        node->SetValue ("bi");
+        node->SetAttributeAsInt ("bone", bi[i].bone);
+        node->SetAttributeAsFloat ("weight", bi[i].influenceWeight);
+      }
+    }
+
+    for (size_t s = 0; s < amfact->GetSubMeshCount (); s++)
+    {
+      iAnimatedMeshFactorySubMesh* submesh = amfact->GetSubMesh (s);
+      csRef<iDocumentNode> submeshNode = 
+        paramsNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      submeshNode->SetValue ("submesh");
+      csString bufName ("submesh");
+      if (submesh->GetName ())
+      {
+        submeshNode->SetAttribute ("name", submesh->GetName ());
+        bufName = submesh->GetName ();
+      }
+      bufName << "_index";
+      WriteRenderBuffer (submeshNode, "index", submesh->GetIndices (0),
+        factName, bufName);
+
+      if (submesh->GetMaterial ())
+      {
+        csRef<iDocumentNode> matNode = 
+          submeshNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+        matNode->SetValue ("material");
+        matNode->CreateNodeBefore (CS_NODE_TEXT, 0)->SetValue (
+          submesh->GetMaterial ()->QueryObject ()->GetName ());
+      }
+    }
+
+    for (uint m = 0; m < amfact->GetMorphTargetCount (); m++)
+    {
+      iAnimatedMeshMorphTarget* target = amfact->GetMorphTarget (m);
+      csRef<iDocumentNode> targetNode = 
+        paramsNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      targetNode->SetValue ("morphtarget");
+      targetNode->SetAttribute ("name", target->GetName ());
+      csString bufName (target->GetName ());
+      bufName << "_offsets";
+      WriteRenderBuffer (targetNode, "offsets", target->GetVertexOffsets (),
+        factName, bufName);
+    }
+
+    for (size_t i = 0; i < amfact->GetSocketCount (); i++)
+    {
+      iAnimatedMeshSocketFactory* socket = amfact->GetSocket (i);
+      csRef<iDocumentNode> socketNode = 
+        paramsNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      socketNode->SetValue ("socket");
+      socketNode->SetAttributeAsInt ("bone", socket->GetBone ());
+      if (socket->GetName ())
+        socketNode->SetAttribute ("name", socket->GetName ());
+
+      const csReversibleTransform& transform = socket->GetTransform ();
+      csRef<iDocumentNode> tNode = 
+        socketNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      tNode->SetValue ("transform");
+      csRef<iDocumentNode> vNode = tNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      vNode->SetValue ("vector");
+      synldr->WriteVector (vNode, transform.GetOrigin ());
+      csRef<iDocumentNode> mNode = tNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
+      mNode->SetValue ("matrix");
+      synldr->WriteMatrix (mNode, transform.GetO2T ());
+    }
+
+    return true;
   }
   
-  bool AnimeshFactorySaver::Initialize (iObjectRegistry*)
+  bool AnimeshFactorySaver::Initialize (iObjectRegistry* objReg)
   {
-    return false;
+    object_reg = objReg;
+    synldr = csQueryRegistry<iSyntaxService> (object_reg);
+
+    csConfigAccess cfg (object_reg);
+    externalBufferSize = cfg->GetInt (
+      "Mesh.Animesh.Saver.ExternalBufferSize", 0);
+    return true;
   }
 
 
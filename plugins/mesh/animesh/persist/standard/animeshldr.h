@@ -79,6 +79,15 @@ CS_PLUGIN_NAMESPACE_BEGIN(Animeshldr)
 
     //-- iComponent
     virtual bool Initialize (iObjectRegistry*);
+
+  private:
+    iObjectRegistry* object_reg;
+    csRef<iSyntaxService> synldr;
+    /// Buffers of at least this many bytes are written to external files
+    size_t externalBufferSize;
+
+    void WriteRenderBuffer (iDocumentNode* parent, const char* nodeName,
+      iRenderBuffer* buffer, const char* factName, const char* bufName);
   };
 
 
@@ -27,6 +27,7 @@
 #include "csgeom/sphere.h"
 #include "csgfx/renderbuffer.h"
 #include "cstool/primitives.h"
+#include "csutil/cfgacc.h"
 #include "csutil/cscolor.h"
 #include "csutil/dirtyaccessarray.h"
 #include "csutil/refarr.h"
@@ -39,6 +40,7 @@
 #include "iengine/material.h"
 #include "iengine/mesh.h"
 #include "imap/ldrctxt.h"
+#include "imap/renderbufferpersistence.h"
 #include "imap/services.h"
 #include "imesh/genmesh.h"
 #include "imesh/object.h"
@@ -48,6 +50,7 @@
 #include "iutil/object.h"
 #include "iutil/objreg.h"
 #include "iutil/plugin.h"
+#include "iutil/string.h"
 #include "iutil/stringarray.h"
 #include "ivaria/reporter.h"
 #include "ivideo/graph3d.h"
@@ -824,11 +827,41 @@ bool csGeneralFactorySaver::Initialize (iObjectRegistry* object_reg)
   reporter = csQueryRegistry<iReporter> (object_reg);
   synldr = csQueryRegistry<iSyntaxService> (object_reg);
   engine = csQueryRegistry<iEngine> (object_reg);
+
+  csConfigAccess cfg (object_reg);
+  externalBufferSize = cfg->GetInt ("Mesh.GenMesh.Saver.ExternalBufferSize",
+    0);
   return true;
 }
 
+void csGeneralFactorySaver::WriteRenderBuffer (iDocumentNode* node, 
+                                               iRenderBuffer* buffer,
+                                               const char* factName,
+                                               const char* bufName)
+{
+  /* Buffers which already carry persistence information are left alone:
+     either they were loaded from a file or are explicitly meant to be
+     written inline. */
+  csRef<iRenderBufferPersistence> persist = 
+    scfQueryInterface<iRenderBufferPersistence> (buffer);
+  if ((externalBufferSize == 0) || persist.IsValid()
+    || (buffer->GetSize() < externalBufferSize))
+  {
+    synldr->WriteRenderBuffer (node, buffer);
+    return;
+  }
+
+  csRef<iString> filename = synldr->GetRenderBufferFileName (
+    factName ? factName : "genmesh", bufName);
+  csRef<CS::RenderBufferPersistent> bufPersist;
+  bufPersist.AttachNew (new CS::RenderBufferPersistent (buffer));
+  bufPersist->SetFileName (filename->GetData ());
+  synldr->WriteRenderBuffer (node, bufPersist);
+}
+
 void csGeneralFactorySaver::WriteSubMesh (iGeneralMeshSubMesh* submesh, 
-                                          iDocumentNode* submeshNode)
+                                          iDocumentNode* submeshNode,
+                                          const char* factName)
 {
   const char* submeshName = submesh->GetName ();
   if (submeshName != 0)
@@ -881,8 +914,10 @@ void csGeneralFactorySaver::WriteSubMesh (iGeneralMeshSubMesh* submesh,
   csRef<iDocumentNode> indexBufferNode = 
     submeshNode->CreateNodeBefore (CS_NODE_ELEMENT, 0);
   indexBufferNode->SetValue ("indexbuffer");
-  synldr->WriteRenderBuffer (indexBufferNode, 
-    submesh->GetIndices());
+  csString bufName;
+  bufName.Format ("%s_indices", submeshName ? submeshName : "submesh");
+  WriteRenderBuffer (indexBufferNode, submesh->GetIndices(), factName,
+    bufName);
 
   csRef<iShaderVariableContext> svc = 
     scfQueryInterface<iShaderVariableContext> (submesh);
@@ -913,6 +948,9 @@ bool csGeneralFactorySaver::WriteDown (iBase* obj, iDocumentNode* parent,
       scfQueryInterface<iMeshObjectFactory> (obj);
     if (!gfact) return false;
     if (!meshfact) return false;
+    const char* factName = 0;
+    if (meshfact->GetMeshFactoryWrapper ())
+      factName = meshfact->GetMeshFactoryWrapper ()->QueryObject ()->GetName ();
 
     // Write render buffers
     {
@@ -925,7 +963,7 @@ bool csGeneralFactorySaver::WriteDown (iBase* obj, iDocumentNode* parent,
       /* Disabled checking on this buffer b/c no vertex count is available
        * when loading it */
       rbufNode->SetAttribute ("checkelementcount", "no");
-      synldr->WriteRenderBuffer (rbufNode, posBuffer);
+      WriteRenderBuffer (rbufNode, posBuffer, factName, "position");
     }
     
     int rbufCount = gfact->GetRenderBufferCount ();
@@ -942,7 +980,7 @@ bool csGeneralFactorySaver::WriteDown (iBase* obj, iDocumentNode* parent,
       rbufNode->SetValue ("renderbuffer");
       rbufNode->SetAttribute ("name", name->GetData ());
       csRef<iRenderBuffer> buffer = gfact->GetRenderBuffer (i);
-      synldr->WriteRenderBuffer (rbufNode, buffer);
+      WriteRenderBuffer (rbufNode, buffer, factName, name->GetData ());
     }
     
     //Writedown DefaultColor tag
@@ -1018,7 +1056,7 @@ bool csGeneralFactorySaver::WriteDown (iBase* obj, iDocumentNode* parent,
       submeshNode->SetValue("submesh");
 
       iGeneralMeshSubMesh* submesh = gfact->GetSubMesh (s);
-      WriteSubMesh (submesh, submeshNode);
+      WriteSubMesh (submesh, submeshNode, factName);
     }
   }
   return true;
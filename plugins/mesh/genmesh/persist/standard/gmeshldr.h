@@ -89,7 +89,18 @@ private:
   csRef<iReporter> reporter;
   csRef<iSyntaxService> synldr;
   csRef<iEngine> engine;
-
+  /**
+   * Render buffers of at least this many bytes are written to external
+   * files (0 to always write inline).
+   */
+  size_t externalBufferSize;
+
+  /**
+   * Write a render buffer. Large buffers are written to a file named after
+   * the factory and the buffer.
+   */
+  void WriteRenderBuffer (iDocumentNode* node, iRenderBuffer* buffer,
+    const char* factName, const char* bufName);
 public:
   /// Constructor.
   csGeneralFactorySaver (iBase*);
@@ -100,7 +111,8 @@ public:
   /// Register plugin with the system driver
   virtual bool Initialize (iObjectRegistry *object_reg);
 
-  void WriteSubMesh (iGeneralMeshSubMesh* submesh, iDocumentNode* submeshNode);
+  void WriteSubMesh (iGeneralMeshSubMesh* submesh, iDocumentNode* submeshNode,
+    const char* factName);
                           
   /// Write down given object and add to iDocumentNode.
   virtual bool WriteDown (iBase *obj, iDocumentNode* parent,
@@ -31,7 +31,9 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include "imesh/genmesh.h"
 #include "imesh/objmodel.h"
 #include "imesh/object.h"
+#include "csutil/platform.h"
 #include "csutil/sysfunc.h"
+#include "csutil/threadjobqueue.h"
 #include "iutil/objreg.h"
 #include "ivaria/view.h"
 #include "ivideo/graph2d.h"
@@ -194,6 +196,12 @@ public:
       body->moveCb->Execute (body->camera, tr);
   }
 
+  /**
+   * Prepare for a deferred step, which may run on another thread. Only
+   * kinematic bodies need to do anything here.
+   */
+  virtual void FetchTransform () {}
+
   virtual void setWorldTransform (const btTransform& trans)
   {
     btDefaultMotionState::setWorldTransform (trans);
@@ -203,13 +211,7 @@ public:
       return;
 
     csOrthoTransform tr = BulletToCS (trans * inversePrincipalAxis);
-
-    if (body->mesh)
-      body->moveCb->Execute (body->mesh, tr);
-    if (body->light)
-      body->moveCb->Execute (body->light, tr);
-    if (body->camera)
-      body->moveCb->Execute (body->camera, tr);
+    body->dynSys->MoveBody (body, tr);
   }
 };
 
@@ -218,16 +220,42 @@ public:
 
 class csBulletKinematicMotionState : public csBulletMotionState
 {
+public:
+  // transform fetched from the callback before a deferred step
+  btTransform fetchedTransform;
+  bool hasFetchedTransform;
+
 public:
   csBulletKinematicMotionState (csBulletRigidBody* body,
 		       const btTransform& initialTransform,
 		       const btTransform& principalAxis)
-    : csBulletMotionState (body, initialTransform, principalAxis)
+    : csBulletMotionState (body, initialTransform, principalAxis),
+      hasFetchedTransform (false)
   {
   }
 
+  // get the body transform from the callback to use in the deferred step
+  virtual void FetchTransform ()
+  {
+    hasFetchedTransform = false;
+    if (!body->kinematicCb)
+      return;
+
+    csOrthoTransform transform;
+    body->kinematicCb->GetBodyTransform (body, transform);
+    fetchedTransform = CSToBullet (transform);
+    hasFetchedTransform = true;
+  }
+
   virtual void getWorldTransform (btTransform& trans) const
   {
+    if (body->dynSys->deferMoves)
+    {
+      if (hasFetchedTransform)
+	trans = fetchedTransform;
+      return;
+    }
+
     if (!body->kinematicCb)
       return;
 
@@ -241,7 +269,7 @@ public:
 //---------------------------------------------------------------------------
 
 csBulletDynamics::csBulletDynamics (iBase *iParent)
-  : scfImplementationType (this, iParent)
+  : scfImplementationType (this, iParent), parallelStepping (false)
 {
 }
 
@@ -280,11 +308,71 @@ iDynamicSystem* csBulletDynamics::FindSystem (const char *name)
   return systems.FindByName (name);
 }
 
+void csBulletDynamics::SetParallelStepping (bool enable)
+{
+  parallelStepping = enable;
+  if (!enable)
+    stepQueue.Invalidate ();
+}
+
+namespace
+{
+  /// Job stepping one dynamic system.
+  class StepSystemJob : public scfImplementation1<StepSystemJob, iJob>
+  {
+    csBulletDynamicsSystem* system;
+    float stepsize;
+  public:
+    StepSystemJob (csBulletDynamicsSystem* system, float stepsize)
+      : scfImplementationType (this), system (system), stepsize (stepsize) {}
+
+    void Run ()
+    {
+      system->StepSimulation (stepsize, true);
+    }
+  };
+}
+
+void csBulletDynamics::StepParallel (float stepsize)
+{
+  if (!stepQueue)
+  {
+    uint numThreads = csMax (CS::Platform::GetProcessorCount (), (uint)1);
+    stepQueue.AttachNew (new CS::Threading::ThreadedJobQueue (numThreads));
+  }
+
+  // The kinematic callbacks are user code, so call them on this thread.
+  for (size_t i = 0; i < systems.GetSize (); i++)
+    static_cast<csBulletDynamicsSystem*> ((iDynamicSystem*)systems[i])
+      ->FetchKinematicTransforms ();
+
+  // All systems are created by CreateSystem().
+  for (size_t i = 0; i < systems.GetSize (); i++)
+  {
+    csRef<iJob> job;
+    job.AttachNew (new StepSystemJob (
+      static_cast<csBulletDynamicsSystem*> ((iDynamicSystem*)systems[i]),
+      stepsize));
+    stepQueue->Enqueue (job);
+  }
+  stepQueue->WaitAll ();
+
+  // Deliver all movements and collisions back on this thread.
+  for (size_t i = 0; i < systems.GetSize (); i++)
+    static_cast<csBulletDynamicsSystem*> ((iDynamicSystem*)systems[i])
+      ->FinishStep ();
+}
+
 void csBulletDynamics::Step (float stepsize)
 {
   // step each system
-  for (size_t i = 0; i < systems.GetSize (); i++)
-    systems[i]->Step (stepsize);
+  if (parallelStepping && systems.GetSize () > 1)
+    StepParallel (stepsize);
+  else
+  {
+    for (size_t i = 0; i < systems.GetSize (); i++)
+      systems[i]->Step (stepsize);
+  }
 
   // call the callbacks
   for (size_t i = 0; i < stepCallbacks.GetSize (); i++)
@@ -367,7 +455,8 @@ public:
 
 csBulletDynamicsSystem::csBulletDynamicsSystem
   (iObjectRegistry* object_reg)
-  : scfImplementationType (this), gimpactRegistered (false), debugDraw (0)
+  : scfImplementationType (this), gimpactRegistered (false), debugDraw (0),
+    deferMoves (false), lastStepTime (0)
 {
   // create base Bullet objects
   configuration = new btDefaultCollisionConfiguration ();
@@ -532,12 +621,66 @@ void csBulletDynamicsSystem::CheckCollisions ()
 }
 
 void csBulletDynamicsSystem::Step (float stepsize)
+{
+  StepSimulation (stepsize, false);
+  FinishStep ();
+}
+
+void csBulletDynamicsSystem::StepSimulation (float stepsize, bool deferMoves)
 {
   if (debugDraw) debugDraw->ClearDebug ();
+  this->deferMoves = deferMoves;
+  int64 startTime = csGetMicroTicks ();
   bulletWorld->stepSimulation (stepsize);
+  lastStepTime = csGetMicroTicks () - startTime;
+  this->deferMoves = false;
+}
+
+void csBulletDynamicsSystem::FinishStep ()
+{
+  // Only the last movement of every body matters but the movements
+  // are delivered in order so the last one wins anyway.
+  for (size_t i = 0; i < pendingMoves.GetSize (); i++)
+    MoveBody (pendingMoves[i].body, pendingMoves[i].transform);
+  pendingMoves.Empty ();
+
   CheckCollisions();
 }
 
+void csBulletDynamicsSystem::FetchKinematicTransforms ()
+{
+  for (size_t i = 0; i < dynamicBodies.GetSize (); i++)
+  {
+    csBulletRigidBody* body =
+      static_cast<csBulletRigidBody*> (dynamicBodies.Get (i));
+    if (body->body)
+      body->motionState->FetchTransform ();
+  }
+}
+
+void csBulletDynamicsSystem::MoveBody (csBulletRigidBody* body,
+				      csOrthoTransform& transform)
+{
+  if (deferMoves)
+  {
+    PendingMove move;
+    move.body = body;
+    move.transform = transform;
+    pendingMoves.Push (move);
+    return;
+  }
+
+  if (!body->moveCb)
+    return;
+
+  if (body->mesh)
+    body->moveCb->Execute (body->mesh, transform);
+  if (body->light)
+    body->moveCb->Execute (body->light, transform);
+  if (body->camera)
+    body->moveCb->Execute (body->camera, transform);
+}
+
 csPtr<iRigidBody> csBulletDynamicsSystem::CreateBody ()
 {
   csRef<csBulletRigidBody> body;
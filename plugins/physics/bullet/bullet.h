@@ -26,6 +26,8 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include "csutil/csobject.h"
 #include "csutil/nobjvec.h"
 #include "csutil/weakrefarr.h"
+#include "csgeom/transfrm.h"
+#include "iutil/job.h"
 #include "ivaria/bullet.h"
 
 CS_PLUGIN_NAMESPACE_BEGIN(Bullet)
@@ -72,13 +74,17 @@ public:
 * This is the implementation for the actual plugin.
 * It is responsible for creating iDynamicSystem.
 */
-class csBulletDynamics : public scfImplementation2<csBulletDynamics,
-  iDynamics, iComponent>
+class csBulletDynamics : public scfImplementation3<csBulletDynamics,
+  iDynamics, iBulletDynamics, iComponent>
 {
 private:
   iObjectRegistry* object_reg;
   csRefArrayObject<iDynamicSystem> systems;
   csRefArray<iDynamicsStepCallback> stepCallbacks;
+  bool parallelStepping;
+  csRef<iJobQueue> stepQueue;
+
+  void StepParallel (float stepsize);
 
 public:
   csBulletDynamics (iBase *iParent);
@@ -94,6 +100,10 @@ public:
   virtual void RemoveStepCallback (iDynamicsStepCallback *callback)
   { stepCallbacks.Delete (callback); }
 
+  //-- iBulletDynamics
+  virtual void SetParallelStepping (bool enable);
+  virtual bool GetParallelStepping () const { return parallelStepping; }
+
   //  iComponent
   virtual bool Initialize (iObjectRegistry* object_reg);  
 };
@@ -105,6 +115,7 @@ class csBulletDynamicsSystem : public scfImplementationExt2<
   friend class csBulletRigidBody;
   friend class csBulletCollider;
   friend class csBulletJoint;
+  friend class csBulletKinematicMotionState;
 
 private:
   btDynamicsWorld* bulletWorld;
@@ -124,6 +135,18 @@ private:
   csStringID colldetId;
 
   csBulletDebugDraw* debugDraw;
+
+  /// A movement of a body that still has to be delivered.
+  struct PendingMove
+  {
+    csBulletRigidBody* body;
+    csOrthoTransform transform;
+  };
+  /// Whether movements are collected instead of delivered directly.
+  bool deferMoves;
+  csArray<PendingMove> pendingMoves;
+  int64 lastStepTime;
+
   void CheckCollisions();
   void CheckCollision(csBulletRigidBody& cs_obA, btCollisionObject *obB,
 		      btPersistentManifold &contactManifold);
@@ -146,6 +169,24 @@ public:
     float time);
   virtual void Step (float stepsize);
 
+  /**
+   * Run the Bullet simulation only. If \a deferMoves is true then the
+   * movements of the bodies are collected and only delivered by
+   * FinishStep(). Doesn't call back into the engine if \a deferMoves is
+   * true so it can be run from another thread; the kinematic bodies then
+   * use the transforms of the last FetchKinematicTransforms() call.
+   */
+  void StepSimulation (float stepsize, bool deferMoves);
+  /// Get the transforms of all kinematic bodies from their callbacks.
+  void FetchKinematicTransforms ();
+  /// Deliver pending movements and collision callbacks.
+  void FinishStep ();
+  /**
+   * Deliver the movement of a body to the move callback or remember
+   * it if movements are deferred.
+   */
+  void MoveBody (csBulletRigidBody* body, csOrthoTransform& transform);
+
   virtual csPtr<iRigidBody> CreateBody ();
   virtual void RemoveBody (iRigidBody* body);
   virtual iRigidBody *FindBody (const char *name);
@@ -190,6 +231,7 @@ public:
   //-- iBulletDynamicSystem
   virtual void DebugDraw (iView* view);
   virtual csBulletHitBeamResult HitBeam (const csVector3 &start, const csVector3 &end);
+  virtual int64 GetLastStepTime () const { return lastStepTime; }
 };
 
 class csBulletRigidBody : public scfImplementationExt2<csBulletRigidBody,
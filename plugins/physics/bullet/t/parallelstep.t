@@ -0,0 +1,174 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "csgeom/plane3.h"
+#include "csgeom/transfrm.h"
+#include "csutil/objreg.h"
+#include "csutil/scfstrset.h"
+#include "csutil/threading/thread.h"
+#include "iutil/comp.h"
+#include "ivaria/bullet.h"
+#include "ivaria/dynamics.h"
+
+namespace
+{
+  /// Moves a kinematic body along the x axis with the simulation time.
+  class TestKinematicCallback :
+    public scfImplementation1<TestKinematicCallback, iBulletKinematicCallback>
+  {
+  public:
+    float time;
+    CS::Threading::ThreadID mainThread;
+    bool calledOffThread;
+
+    TestKinematicCallback () : scfImplementationType (this), time (0),
+      mainThread (CS::Threading::Thread::GetThreadID ()),
+      calledOffThread (false) {}
+
+    virtual void GetBodyTransform (iRigidBody*,
+      csOrthoTransform& transform) const
+    {
+      if (CS::Threading::Thread::GetThreadID () != mainThread)
+        const_cast<TestKinematicCallback*> (this)->calledOffThread = true;
+      transform.Identity ();
+      transform.SetOrigin (csVector3 (-2.0f + time * 4.0f, 0.5f, 0));
+    }
+  };
+}
+
+/**
+ * Test that stepping the Bullet systems on a job queue gives the same
+ * results as stepping them one after another.
+ */
+class csBulletParallelStepTest : public CppUnit::TestFixture
+{
+private:
+  iObjectRegistry* objreg;
+  csRef<TestKinematicCallback> kinematicCb;
+
+  csPtr<iDynamics> CreateDynamics ();
+  void Simulate (bool parallel, csArray<csOrthoTransform>& transforms);
+
+public:
+  void setUp ();
+  void tearDown ();
+  void testSameTransforms ();
+
+  CPPUNIT_TEST_SUITE (csBulletParallelStepTest);
+    CPPUNIT_TEST (testSameTransforms);
+  CPPUNIT_TEST_SUITE_END ();
+};
+
+void csBulletParallelStepTest::setUp ()
+{
+  if (iSCF::SCF == 0)
+    scfInitialize (0);
+  objreg = new csObjectRegistry ();
+  csRef<iStringSet> strings;
+  strings.AttachNew (new csScfStringSet ());
+  objreg->Register (strings, "crystalspace.shared.stringset");
+}
+
+void csBulletParallelStepTest::tearDown ()
+{
+  kinematicCb.Invalidate ();
+  objreg->Clear ();
+  objreg->DecRef ();
+}
+
+csPtr<iDynamics> csBulletParallelStepTest::CreateDynamics ()
+{
+  csRef<iDynamics> dynamics = scfCreateInstance<iDynamics> (
+    "crystalspace.dynamics.bullet");
+  if (!dynamics)
+    return 0;
+  csRef<iComponent> comp = scfQueryInterface<iComponent> (dynamics);
+  if (comp) comp->Initialize (objreg);
+  return csPtr<iDynamics> (dynamics);
+}
+
+void csBulletParallelStepTest::Simulate (bool parallel,
+  csArray<csOrthoTransform>& transforms)
+{
+  csRef<iDynamics> dynamics = CreateDynamics ();
+  csRef<iBulletDynamics> bulletDynamics =
+    scfQueryInterface<iBulletDynamics> (dynamics);
+  bulletDynamics->SetParallelStepping (parallel);
+
+  kinematicCb.AttachNew (new TestKinematicCallback ());
+
+  // Parallel stepping is only used with more than one system
+  csRefArray<iRigidBody> bodies;
+  for (int s = 0; s < 3; s++)
+  {
+    csRef<iDynamicSystem> system = dynamics->CreateSystem ();
+    system->AttachColliderPlane (csPlane3 (0, 1, 0, 0), 0.5f, 0.2f);
+
+    for (int b = 0; b < 4; b++)
+    {
+      csRef<iRigidBody> body = system->CreateBody ();
+      body->AttachColliderSphere (0.5f, csVector3 (0), 0.5f, 1.0f, 0.2f);
+      body->SetPosition (csVector3 (b * 0.6f, 1.0f + b + s, 0.1f * b));
+      bodies.Push (body);
+    }
+
+    // A kinematic box pushing the spheres around
+    csRef<iRigidBody> pusher = system->CreateBody ();
+    pusher->AttachColliderBox (csVector3 (1), csOrthoTransform (),
+      0.5f, 1.0f, 0.2f);
+    csRef<iBulletRigidBody> bulletPusher =
+      scfQueryInterface<iBulletRigidBody> (pusher);
+    bulletPusher->SetKinematicCallback (kinematicCb);
+    bulletPusher->MakeKinematic ();
+  }
+
+  const float stepsize = 1.0f / 60.0f;
+  for (int i = 0; i < 120; i++)
+  {
+    kinematicCb->time = i * stepsize;
+    dynamics->Step (stepsize);
+  }
+
+  CPPUNIT_ASSERT (!kinematicCb->calledOffThread);
+
+  transforms.Empty ();
+  for (size_t i = 0; i < bodies.GetSize (); i++)
+    transforms.Push (bodies[i]->GetTransform ());
+}
+
+void csBulletParallelStepTest::testSameTransforms ()
+{
+  // Nothing to test if the plugin is not available
+  csRef<iDynamics> dynamics = CreateDynamics ();
+  if (!dynamics)
+    return;
+  dynamics.Invalidate ();
+
+  csArray<csOrthoTransform> serial;
+  Simulate (false, serial);
+  csArray<csOrthoTransform> parallel;
+  Simulate (true, parallel);
+
+  // The systems are stepped the same way, just on other threads
+  CPPUNIT_ASSERT_EQUAL (serial.GetSize (), parallel.GetSize ());
+  for (size_t i = 0; i < serial.GetSize (); i++)
+  {
+    CPPUNIT_ASSERT (serial[i].GetOrigin () == parallel[i].GetOrigin ());
+    CPPUNIT_ASSERT (serial[i].GetO2T () == parallel[i].GetO2T ());
+  }
+}
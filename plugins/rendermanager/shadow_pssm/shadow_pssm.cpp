@@ -163,7 +163,7 @@ public:
       StandardSVSetup<RenderTreeType, MultipleRenderLayer> svSetup (
         context.svArrays, layerConfig);
 
-      ForEachMeshNode (context, svSetup);
+      ForEachMeshNodeParallel (context, svSetup, rmanager->setupJobQueue);
     }
 
     SetupStandardShader (context, shaderManager, layerConfig);
@@ -176,7 +176,7 @@ public:
 
     // Setup shaders and tickets
     SetupStandardTicket (context, shaderManager,
-      lightSetup.GetPostLightingLayers());
+      lightSetup.GetPostLightingLayers(), rmanager->setupJobQueue);
   
   
     RMShadowedPSSM::AutoFramebufferTexType fxFB (
@@ -517,6 +517,13 @@ bool RMShadowedPSSM::Initialize(iObjectRegistry* objectReg)
   }
   
   maxPortalRecurse = cfg->GetInt("RenderManager.ShadowPSSM.MaxPortalRecurse", 30);
+  /* Number of threads for mesh setup. 0 sets up meshes sequentially, -1
+     uses one thread per processor. */
+  int setupThreads = cfg->GetInt ("RenderManager.ShadowPSSM.SetupThreads", 0);
+  if (setupThreads < 0) setupThreads = CS::Platform::GetProcessorCount ();
+  if (setupThreads > 0)
+    setupJobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+      setupThreads, CS::Threading::THREAD_PRIO_NORMAL));
   
   csRef<iGraphics3D> g3d = csQueryRegistry<iGraphics3D> (objectReg);
   treePersistent.Initialize (shaderManager);
@@ -42,10 +42,11 @@ CS_PLUGIN_NAMESPACE_BEGIN(RMShadowedPSSM)
   
   typedef CS::RenderManager::RenderTree<RenderTreeTraits> RenderTreeType;
 
-  class RMShadowedPSSM : public scfImplementation5<RMShadowedPSSM, 
+  class RMShadowedPSSM : public scfImplementation6<RMShadowedPSSM, 
                                                  iRenderManager, 
                                                  iRenderManagerTargets,
                                                  iRenderManagerPostEffects,
+                                                 iRenderManagerShadowMapCache,
                                                  iComponent,
                                                  scfFakeInterface<iDebugHelper> >,
                          public CS::RenderManager::RMDebugCommon<RenderTreeType>
@@ -86,6 +87,26 @@ CS_PLUGIN_NAMESPACE_BEGIN(RMShadowedPSSM)
       return postEffectsParser.AddLayersFromFile (filename, postEffects);
     }
 
+    //---- iRenderManagerShadowMapCache ----
+    bool IsShadowMapCacheEnabled () const
+    {
+      return lightPersistent.shadowPersist.IsShadowMapCacheActive();
+    }
+    void GetShadowMapSplitCounts (uint& rendered, uint& skipped) const
+    {
+      rendered = lightPersistent.shadowPersist.cacheStats.splitsRendered;
+      skipped = lightPersistent.shadowPersist.cacheStats.splitsSkipped;
+    }
+    void GetShadowMapSplitTotals (uint64& rendered, uint64& skipped) const
+    {
+      rendered = lightPersistent.shadowPersist.cacheStats.totalRendered;
+      skipped = lightPersistent.shadowPersist.cacheStats.totalSkipped;
+    }
+    void InvalidateShadowMaps ()
+    {
+      lightPersistent.shadowPersist.InvalidateShadowMapCache();
+    }
+
     //---- iComponent ----
     virtual bool Initialize (iObjectRegistry*);
 
@@ -147,6 +168,8 @@ CS_PLUGIN_NAMESPACE_BEGIN(RMShadowedPSSM)
     CS::RenderManager::HDR::Exposure::Configurable hdrExposure;
     bool doHDRExposure;
     int maxPortalRecurse;
+    /// Queue for setting up meshes in parallel; 0 if done sequentially
+    csRef<iJobQueue> setupJobQueue;
 
     csRef<iShaderVarStringSet>  svNameStringSet;
     csRef<iStringSet>           stringSet;
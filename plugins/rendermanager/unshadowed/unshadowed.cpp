@@ -118,7 +118,7 @@ public:
       StandardSVSetup<RenderTreeType, MultipleRenderLayer> svSetup (
         context.svArrays, layerConfig);
 
-      ForEachMeshNode (context, svSetup);
+      ForEachMeshNodeParallel (context, svSetup, rmanager->setupJobQueue);
     }
 
     SetupStandardShader (context, shaderManager, layerConfig);
@@ -132,7 +132,7 @@ public:
 
     // Setup shaders and tickets
     SetupStandardTicket (context, shaderManager,
-      lightSetup.GetPostLightingLayers());
+      lightSetup.GetPostLightingLayers(), rmanager->setupJobQueue);
   
     {
       ThisType ctxRefl (*this,
@@ -386,6 +386,13 @@ bool RMUnshadowed::Initialize(iObjectRegistry* objectReg)
   }
   
   maxPortalRecurse = cfg->GetInt("RenderManager.Unshadowed.MaxPortalRecurse", 30);
+  /* Number of threads for mesh setup. 0 sets up meshes sequentially, -1
+     uses one thread per processor. */
+  int setupThreads = cfg->GetInt ("RenderManager.Unshadowed.SetupThreads", 0);
+  if (setupThreads < 0) setupThreads = CS::Platform::GetProcessorCount ();
+  if (setupThreads > 0)
+    setupJobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+      setupThreads, CS::Threading::THREAD_PRIO_NORMAL));
   
   csRef<iGraphics3D> g3d = csQueryRegistry<iGraphics3D> (objectReg);
   treePersistent.Initialize (shaderManager);
@@ -121,6 +121,8 @@ CS_PLUGIN_NAMESPACE_BEGIN(RMUnshadowed)
     CS::RenderManager::HDR::Exposure::Configurable hdrExposure;
     bool doHDRExposure;
     int maxPortalRecurse;
+    /// Queue for setting up meshes in parallel; 0 if done sequentially
+    csRef<iJobQueue> setupJobQueue;
 
     csRef<iShaderVarStringSet>  svNameStringSet;
     csRef<iStringSet>           stringSet;
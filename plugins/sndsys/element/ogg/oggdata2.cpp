@@ -22,6 +22,7 @@
 #include "isndsys/ss_loader.h"
 #include "oggstream2.h"
 #include "oggdata2.h"
+#include "oggdecoder.h"
 
 
 
@@ -96,10 +97,11 @@ cs_ov_callbacks *GetCallbacks()
   return &ogg_callbacks;
 }
 
-SndSysOggSoundData::SndSysOggSoundData (iBase *pParent, iDataBuffer* pDataBuffer) :
+SndSysOggSoundData::SndSysOggSoundData (iBase *pParent, iDataBuffer* pDataBuffer,
+                                        const SndSysDecodeSettings& DecodeSettings) :
   SndSysBasicData(pParent),
   // Create a new DataStore associated with the passed DataBuffer
-  m_DataStore(pDataBuffer)
+  m_DataStore(pDataBuffer), m_DecodeSettings(DecodeSettings)
 {
   // Set some default format information
   m_SoundFormat.Bits = 16;
@@ -108,6 +110,8 @@ SndSysOggSoundData::SndSysOggSoundData (iBase *pParent, iDataBuffer* pDataBuffer
 
 SndSysOggSoundData::~SndSysOggSoundData ()
 {
+  if (m_DecodeSettings.cache)
+    m_DecodeSettings.cache->Remove (this);
 }
 
 
@@ -119,8 +123,28 @@ size_t SndSysOggSoundData::GetDataSize()
 iSndSysStream *SndSysOggSoundData::CreateStream (
   csSndSysSoundFormat *pRenderFormat, int Mode3D)
 {
-  // Creating a stream from the data is a simple operation for Ogg
-  SndSysOggSoundStream *pStream=new SndSysOggSoundStream(this, &m_DataStore, pRenderFormat, Mode3D);
+  csRef<iDataBuffer> decoded;
+  if (m_DecodeSettings.cache)
+    decoded = m_DecodeSettings.cache->Get (this, pRenderFormat->Bits);
+
+  SndSysOggSoundStream *pStream=new SndSysOggSoundStream(this, &m_DataStore,
+    pRenderFormat, Mode3D, m_DecodeSettings, decoded);
+
+  // Decode short sounds completely in the background, so the streams created
+  //  later play from memory
+  if (!decoded && m_DecodeSettings.cache && m_DecodeSettings.jobQueue)
+  {
+    size_t decoded_size=GetFrameCount() * GetFormat()->Channels *
+      (pRenderFormat->Bits/8);
+    if (m_DecodeSettings.cache->IsCacheable (decoded_size))
+    {
+      csRef<SndSysOggDecoder> decoder;
+      decoder.AttachNew (new SndSysOggDecoder (m_DataStore.buf, GetFormat(),
+        pRenderFormat->Bits, 0));
+      m_DecodeSettings.cache->DecodeInBackground (m_DecodeSettings.jobQueue,
+        this, pRenderFormat->Bits, decoder);
+    }
+  }
 
   return (pStream);
 }
@@ -26,6 +26,7 @@
 
 #include "iutil/databuff.h"
 #include "csplugincommon/sndsys/snddata.h"
+#include "csplugincommon/sndsys/decoder.h"
 
 
 using namespace CS::SndSys;
@@ -83,7 +84,8 @@ class SndSysOggSoundData : public SndSysBasicData
 {
 public:
   /// Construction requires passing an iDataBuffer which references encoded ogg vorbis audio
-  SndSysOggSoundData (iBase *pParent, iDataBuffer* pDataBuffer);
+  SndSysOggSoundData (iBase *pParent, iDataBuffer* pDataBuffer,
+    const SndSysDecodeSettings& DecodeSettings);
   virtual ~SndSysOggSoundData ();
 
   ////
@@ -133,6 +135,9 @@ protected:
 
    /// An accessor structure for the underlying ogg vorbis sound data
   OggDataStore m_DataStore;
+
+  /// Background decoding and decoded data cache used by our streams
+  SndSysDecodeSettings m_DecodeSettings;
 };
 
 #endif // #ifndef SNDSYS_DATA_OGG_H
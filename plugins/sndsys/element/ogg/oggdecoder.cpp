@@ -0,0 +1,95 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+#include "oggdecoder.h"
+
+extern cs_ov_callbacks *GetCallbacks();
+
+SndSysOggDecoder::SndSysOggDecoder (iDataBuffer* pEncoded,
+                                    const csSndSysSoundFormat *pFormat,
+                                    int Bits, iDataBuffer* pDecoded) :
+  SndSysDecoder (pFormat->Channels * (Bits/8)),
+  m_bFileOpen (false), m_DataStore (pEncoded), m_SoundFormat (*pFormat),
+  m_Bits (Bits)
+{
+  m_StreamData.datastore=&m_DataStore;
+  m_StreamData.position=0;
+
+  if (pDecoded)
+  {
+    SetDecodedData (pDecoded);
+    return;
+  }
+
+  // Initialize ogg file
+  memset(&m_VorbisFile,0,sizeof(OggVorbis_File));
+  ov_open_callbacks (&m_StreamData,&m_VorbisFile,0,0,
+    *(ov_callbacks*)GetCallbacks());
+  m_bFileOpen=true;
+}
+
+SndSysOggDecoder::~SndSysOggDecoder ()
+{
+  if (m_bFileOpen)
+    ov_clear (&m_VorbisFile);
+}
+
+void SndSysOggDecoder::GetSectionFormat (int Section, int &Channels, int &Rate)
+{
+  // The fully decoded data only has a single section in the format of the
+  //  sound data
+  if (!m_bFileOpen)
+  {
+    Channels=m_SoundFormat.Channels;
+    Rate=m_SoundFormat.Freq;
+    return;
+  }
+
+  vorbis_info *info=ov_info(&m_VorbisFile,Section);
+  Channels=info->channels;
+  Rate=info->rate;
+}
+
+size_t SndSysOggDecoder::DecodeChunk (char* buffer, size_t maxBytes,
+                                      int& section)
+{
+  if (!m_bFileOpen)
+    return 0;
+
+  long bytes_read = ov_read (&m_VorbisFile, buffer, (int)maxBytes, OGG_ENDIAN,
+    (m_Bits==8)?1:2, (m_Bits==8)?0:1, &section);
+
+  // Assert on error
+  CS_ASSERT(bytes_read >=0);
+
+  if (bytes_read <= 0)
+    return 0;
+  return bytes_read;
+}
+
+void SndSysOggDecoder::DecoderSeek (size_t frame)
+{
+  if (!m_bFileOpen)
+    return;
+
+  if (frame == 0)
+    ov_raw_seek(&m_VorbisFile,0);
+  else
+    ov_pcm_seek(&m_VorbisFile,frame);
+}
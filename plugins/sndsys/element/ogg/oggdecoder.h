@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef SNDSYS_DECODER_OGG_H
+#define SNDSYS_DECODER_OGG_H
+
+#include "csplugincommon/sndsys/decoder.h"
+#include "oggdata2.h"
+
+using namespace CS::SndSys;
+
+#ifdef CS_LITTLE_ENDIAN
+  #define OGG_ENDIAN 0
+#else
+  #define OGG_ENDIAN 1
+#endif
+
+/// Ogg Vorbis decoder which can run ahead of playback in the background
+class SndSysOggDecoder : public SndSysDecoder
+{
+public:
+  /**
+   * Decode the given ogg data of the given format at the given sample size.
+   * If \a pDecoded is set it's the fully decoded sound and the ogg data is
+   * not decoded at all.
+   *
+   * The decoder only references the encoded data buffer and not the sound
+   * data element, so it can outlive the element in a background job.
+   */
+  SndSysOggDecoder (iDataBuffer* pEncoded, const csSndSysSoundFormat *pFormat,
+    int Bits, iDataBuffer* pDecoded);
+  virtual ~SndSysOggDecoder ();
+
+  /// Retrieve the channel count and rate of a logical stream
+  void GetSectionFormat (int Section, int &Channels, int &Rate);
+
+protected:
+  virtual size_t DecodeChunk (char* buffer, size_t maxBytes, int& section);
+  virtual void DecoderSeek (size_t frame);
+
+  /// State information about the sound data used by the ogg vorbis library
+  OggVorbis_File m_VorbisFile;
+
+  /// Whether m_VorbisFile was opened
+  bool m_bFileOpen;
+
+  /// Accessor for the encoded data
+  OggDataStore m_DataStore;
+
+  /// Our position tracking reference to the underlying raw data
+  OggStreamData m_StreamData;
+
+  /// Format of the sound data
+  csSndSysSoundFormat m_SoundFormat;
+
+  /// Size of the decoded samples in bits
+  int m_Bits;
+};
+
+#endif // #ifndef SNDSYS_DECODER_OGG_H
@@ -23,6 +23,7 @@
 #include "isndsys/ss_loader.h"
 
 #include "csutil/scf_implementation.h"
+#include "csplugincommon/sndsys/decoder.h"
 
 
 /// iSndSysLoader interface for Ogg Vorbis audio data
@@ -54,8 +55,12 @@ public:
   // iComponent
   //------------------------
 public:
-  /// Initialize this component. Not much to do here.
-  virtual bool Initialize (iObjectRegistry *){return true;}
+  /// Initialize this component. Only the decoding settings are read.
+  virtual bool Initialize (iObjectRegistry *object_reg)
+  {
+    m_DecodeSettings.Load (object_reg);
+    return true;
+  }
 
   //------------------------
   // iSndSysLoader
@@ -76,13 +81,17 @@ public:
     if (SndSysOggSoundData::IsOgg (Buffer))
     {
       // Create the Data object.
-      sd = new SndSysOggSoundData ((iBase*)this, Buffer);
+      sd = new SndSysOggSoundData ((iBase*)this, Buffer, m_DecodeSettings);
       // Set the Data object desctiption to the passed value (may be NULL)
       sd->SetDescription(pDescription);
     }
 
     return csPtr<iSndSysData> (sd);
   }
+
+protected:
+  /// Background decoding and decoded data cache shared by all our data
+  CS::SndSys::SndSysDecodeSettings m_DecodeSettings;
 };
 
 #endif // #ifndef SNDSYS_LOADER_OGG_H
@@ -35,19 +35,14 @@
  * The size in bytes of the buffer in which decoded ogg data is stored before 
  * copying/conversion
  */
-#define OGG_DECODE_BUFFER_SIZE 4096
-
-extern cs_ov_callbacks *GetCallbacks();
+#define OGG_DECODE_BUFFER_SIZE SndSysDecoder::ChunkSize
 
 SndSysOggSoundStream::SndSysOggSoundStream (csRef<SndSysOggSoundData> pData, 
 					    OggDataStore *pDataStore, csSndSysSoundFormat *pRenderFormat, 
-              int Mode3D) :
+              int Mode3D, const SndSysDecodeSettings& DecodeSettings,
+              iDataBuffer* pDecoded) :
   SndSysBasicStream(pRenderFormat, Mode3D)
 {
-  // Initialize the stream data
-  m_StreamData.datastore=pDataStore;
-  m_StreamData.position=0;
-
   m_pSoundData=pData;
 
   // Allocate an advance buffer
@@ -57,10 +52,13 @@ SndSysOggSoundStream::SndSysOggSoundStream (csRef<SndSysOggSoundData> pData,
 	OGG_BUFFER_LENGTH_DIVISOR));
   CS_ASSERT(m_pCyclicBuffer!=0);
 
-  // Initialize ogg file
-  memset(&m_VorbisFile,0,sizeof(OggVorbis_File));
-  ov_open_callbacks (&m_StreamData,&m_VorbisFile,0,0,
-    *(ov_callbacks*)GetCallbacks());
+  // Create the decoder and start decoding ahead of playback
+  const csSndSysSoundFormat *data_format=pData->GetFormat();
+  m_pDecoder.AttachNew (new SndSysOggDecoder (pDataStore->buf, data_format,
+    m_RenderFormat.Bits, pDecoded));
+  DecodeSettings.SetupDecoder (m_pDecoder,
+    data_format->Freq * data_format->Channels * (m_RenderFormat.Bits/8));
+  m_pDecoder->RequestDecode ();
 
   // Set to not a valid stream
   m_CurrentOggStream=-1;
@@ -68,6 +66,7 @@ SndSysOggSoundStream::SndSysOggSoundStream (csRef<SndSysOggSoundData> pData,
 
 SndSysOggSoundStream::~SndSysOggSoundStream ()
 {
+  m_pDecoder->Cancel ();
 }
 
 const char *SndSysOggSoundStream::GetDescription()
@@ -108,7 +107,7 @@ void SndSysOggSoundStream::AdvancePosition(size_t frame_delta)
       m_PreparedDataBufferStart=0;
 
       // Seek the ogg stream to the start loop position position for the rest of the advancement
-      ov_pcm_seek(&m_VorbisFile,m_startLoopFrame);
+      m_pDecoder->Seek(m_startLoopFrame);
   }
 
   if (m_NewPosition != InvalidPosition)
@@ -121,7 +120,7 @@ void SndSysOggSoundStream::AdvancePosition(size_t frame_delta)
     m_PreparedDataBufferStart=0;
 
     // Seek the ogg stream to the requested position
-    ov_pcm_seek(&m_VorbisFile,m_NewPosition);
+    m_pDecoder->Seek(m_NewPosition);
 
     m_NewPosition = InvalidPosition;
     m_bPlaybackReadComplete=false;
@@ -161,32 +160,24 @@ void SndSysOggSoundStream::AdvancePosition(size_t frame_delta)
 
     while (bytes_read==0)
     {
-      bytes_read = ov_read (&m_VorbisFile, ogg_decode_buffer,
-        OGG_DECODE_BUFFER_SIZE, OGG_ENDIAN,
-        (m_RenderFormat.Bits==8)?1:2, (m_RenderFormat.Bits==8)?0:1,
-        &m_CurrentOggStream);
-   
-      // Assert on error
-      CS_ASSERT(bytes_read >=0);
-
-      if (bytes_read <= 0)
+      bytes_read = (long)m_pDecoder->Read (ogg_decode_buffer,
+        OGG_DECODE_BUFFER_SIZE, &m_CurrentOggStream);
+
+      if (bytes_read == 0)
       {
         if (!m_bLooping)
         {
           // Seek back to the beginning for a restart.  Pause on the next call
           m_bPlaybackReadComplete=true;
-          ov_raw_seek(&m_VorbisFile,0);
+          m_pDecoder->Seek(0);
           return;
         }
 
         // Loop by resetting the position to the start loop position and continuing
-        ov_pcm_seek(&m_VorbisFile,m_startLoopFrame);
+        m_pDecoder->Seek(m_startLoopFrame);
       }
     }
 
-
-    
-
     // If streams changed, the format may have changed as well
     if ((m_NewOutputFrequency != m_OutputFrequency) 
       || (last_ogg_stream != m_CurrentOggStream))
@@ -195,16 +186,16 @@ void SndSysOggSoundStream::AdvancePosition(size_t frame_delta)
 
       m_OutputFrequency=m_NewOutputFrequency;
 
-      m_pCurrentOggFormatInfo=ov_info(&m_VorbisFile,m_CurrentOggStream);
+      m_pDecoder->GetSectionFormat (m_CurrentOggStream, m_CurrentOggChannels,
+        m_CurrentOggRate);
 
       // Create the pcm sample converter if it's not yet created
       if (m_pPCMConverter == 0)
         m_pPCMConverter = new PCMSampleConverter (
-          m_pCurrentOggFormatInfo->channels, m_RenderFormat.Bits,
-          m_pCurrentOggFormatInfo->rate);
+          m_CurrentOggChannels, m_RenderFormat.Bits, m_CurrentOggRate);
 
       // Calculate the size of one source sample
-      source_sample_size=m_pCurrentOggFormatInfo->channels * m_RenderFormat.Bits;
+      source_sample_size=m_CurrentOggChannels * m_RenderFormat.Bits;
 
       // Calculate the needed buffer size for this conversion
       needed_buffer = (m_pPCMConverter->GetRequiredOutputBufferMultiple (
@@ -221,8 +212,8 @@ void SndSysOggSoundStream::AdvancePosition(size_t frame_delta)
     }
 
     // If no conversion is necessary 
-    if ((m_pCurrentOggFormatInfo->rate == m_OutputFrequency) &&
-        (m_pCurrentOggFormatInfo->channels == m_RenderFormat.Channels))
+    if ((m_CurrentOggRate == m_OutputFrequency) &&
+        (m_CurrentOggChannels == m_RenderFormat.Channels))
     {
       CS_ASSERT(bytes_read <= m_PreparedDataBufferSize);
       memcpy(m_pPreparedDataBuffer,ogg_decode_buffer,bytes_read);
@@ -239,6 +230,8 @@ void SndSysOggSoundStream::AdvancePosition(size_t frame_delta)
       needed_bytes -= CopyBufferBytes (needed_bytes);
 
   }
-      
+
+  // Keep decoding ahead of the playback position
+  m_pDecoder->RequestDecode ();
 }
 
@@ -23,35 +23,17 @@
 
 #include "csplugincommon/sndsys/sndstream.h"
 #include "oggdata2.h"
+#include "oggdecoder.h"
 
 using namespace CS::SndSys;
 
-// This hack works around a build problem with some installations of Ogg/Vorbis
-// on Cygwin where it attempts to #include the non-existent <_G_config.h>.  We
-// must ensure that _WIN32 is not defined prior to #including the Vorbis
-// headers.  This problem is specific to C++ builds; it does not occur with
-// plain C builds (which explains why the CS configure check does not require
-// this hack).
-#ifdef __CYGWIN__
-#undef _WIN32
-#endif
-
-#include <vorbis/codec.h>
-#include <vorbis/vorbisfile.h>
-
-
-#ifdef CS_LITTLE_ENDIAN
-  #define OGG_ENDIAN 0
-#else
-  #define OGG_ENDIAN 1
-#endif
-
 /// Implementation of iSndSysStream for Ogg Vorbis audio
 class SndSysOggSoundStream : public SndSysBasicStream
 {
 public:
   SndSysOggSoundStream (csRef<SndSysOggSoundData> pData, OggDataStore *pDataStore, 
-    csSndSysSoundFormat *pRenderFormat, int Mode3D);
+    csSndSysSoundFormat *pRenderFormat, int Mode3D,
+    const SndSysDecodeSettings& DecodeSettings, iDataBuffer* pDecoded);
   virtual ~SndSysOggSoundStream ();
 
 
@@ -95,12 +77,8 @@ public:
   //  Member variables
   ////
 protected:
-  /// State information about the sound data used by the ogg vorbis library
-  OggVorbis_File m_VorbisFile;
-
-  /// Our data related information. A reference to the underlying raw data
-  //   and our position tracking reference are contained here.
-  OggStreamData m_StreamData;
+  /// Decoder providing the decoded ogg data, possibly ahead of time
+  csRef<SndSysOggDecoder> m_pDecoder;
 
   /// Holds our reference to the underlying data element
   csRef<SndSysOggSoundData> m_pSoundData;
@@ -113,7 +91,8 @@ protected:
   int m_CurrentOggStream;
 
   /// Format of the sound data in the current ogg stream
-  vorbis_info *m_pCurrentOggFormatInfo;
+  int m_CurrentOggChannels;
+  int m_CurrentOggRate;
 };
 
 #endif // #ifndef SNDSYS_STREAM_OGG_H
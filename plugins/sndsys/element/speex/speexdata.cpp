@@ -21,10 +21,13 @@
 #include <speex/speex_header.h>
 
 #include "speexdata.h"
+#include "speexdecoder.h"
 #include "speexstream.h"
 
-SndSysSpeexSoundData::SndSysSpeexSoundData (iBase *pParent, iDataBuffer* pDataBuffer) :
-  SndSysBasicData(pParent), m_DataStore(pDataBuffer)
+SndSysSpeexSoundData::SndSysSpeexSoundData (iBase *pParent, iDataBuffer* pDataBuffer,
+                                            const SndSysDecodeSettings& DecodeSettings) :
+  SndSysBasicData(pParent), m_DataStore(pDataBuffer),
+  m_DecodeSettings(DecodeSettings), m_DecodedSize(0)
 {
   m_SoundFormat.Bits = 16;
   m_SoundFormat.Channels = 2;
@@ -32,6 +35,8 @@ SndSysSpeexSoundData::SndSysSpeexSoundData (iBase *pParent, iDataBuffer* pDataBu
 
 SndSysSpeexSoundData::~SndSysSpeexSoundData ()
 {
+  if (m_DecodeSettings.cache)
+    m_DecodeSettings.cache->Remove (this);
 }
 
 size_t SndSysSpeexSoundData::GetDataSize()
@@ -44,7 +49,23 @@ iSndSysStream *SndSysSpeexSoundData::CreateStream(csSndSysSoundFormat *pRenderFo
   if (!m_bInfoReady)
     Initialize();
 
-  SndSysSpeexSoundStream *pStream = new SndSysSpeexSoundStream(this, pRenderFormat, Mode3D);
+  csRef<iDataBuffer> decoded;
+  if (m_DecodeSettings.cache)
+    decoded = m_DecodeSettings.cache->Get (this, 16);
+
+  SndSysSpeexSoundStream *pStream = new SndSysSpeexSoundStream(this, pRenderFormat,
+    Mode3D, m_DecodeSettings, decoded);
+
+  // Decode short sounds completely in the background, so the streams created
+  // later play from memory. Speex always decodes to 16 bit samples.
+  if (!decoded && m_DecodeSettings.cache && m_DecodeSettings.jobQueue
+    && m_DecodeSettings.cache->IsCacheable (m_DecodedSize))
+  {
+    csRef<SndSysSpeexDecoder> decoder;
+    decoder.AttachNew (new SndSysSpeexDecoder (m_DataStore.buf, 0));
+    m_DecodeSettings.cache->DecodeInBackground (m_DecodeSettings.jobQueue,
+      this, 16, decoder);
+  }
 
   return (pStream);
 }
@@ -81,6 +102,7 @@ void SndSysSpeexSoundData::Initialize()
   }
 
   m_FrameCount = header->frames_per_packet * count;
+  m_DecodedSize = m_FrameCount * header->frame_size * sizeof(short);
 
   // Free memory.
   speex_header_free(header);
@@ -20,6 +20,7 @@
 #define SNDSYS_DATA_SPEEX_H
 
 #include "csplugincommon/sndsys/snddata.h"
+#include "csplugincommon/sndsys/decoder.h"
 
 using namespace CS::SndSys;
 
@@ -40,7 +41,8 @@ struct SpeexDataStore
 class SndSysSpeexSoundData : public SndSysBasicData
 {
 public:
-  SndSysSpeexSoundData (iBase *pParent, iDataBuffer* pDataBuffer);
+  SndSysSpeexSoundData (iBase *pParent, iDataBuffer* pDataBuffer,
+    const SndSysDecodeSettings& DecodeSettings);
   virtual ~SndSysSpeexSoundData ();
 
 protected:
@@ -52,6 +54,12 @@ protected:
   /// An accessor structure for the underlying speex sound data
   SpeexDataStore m_DataStore;
 
+  /// Background decoding and decoded data cache used by our streams
+  SndSysDecodeSettings m_DecodeSettings;
+
+  /// Size of the sound once decoded in bytes
+  size_t m_DecodedSize;
+
 public:
   /// Call to determine if the provided data can be decoded as speex audio
   static bool IsSpeex (iDataBuffer* Buffer);
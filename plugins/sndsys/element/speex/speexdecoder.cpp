@@ -0,0 +1,141 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "cssysdef.h"
+
+#include "speexdecoder.h"
+
+SndSysSpeexDecoder::SndSysSpeexDecoder (iDataBuffer* pEncoded,
+                                        iDataBuffer* pDecoded) :
+  SndSysDecoder (sizeof(short)), m_DataStore (pEncoded), state (0),
+  header (0)
+{
+  // Initialize speex stream.
+  Reset (false);
+
+  if (pDecoded)
+    SetDecodedData (pDecoded);
+}
+
+SndSysSpeexDecoder::~SndSysSpeexDecoder ()
+{
+  if (state)
+    speex_decoder_destroy(state);
+  speex_bits_destroy(&bits);
+  speex_header_free(header);
+  if (stream_init)
+    ogg_stream_clear(&os);
+}
+
+void SndSysSpeexDecoder::Reset (bool clear)
+{
+  // Clear the stream if needed.
+  if (clear)
+  {
+    if (stream_init)
+      ogg_stream_clear(&os);
+    speex_bits_destroy(&bits);
+  }
+
+  // Set up the sync state and buffers.
+  speex_bits_init(&bits);
+  ogg_sync_init(&oy);
+  oy.data = m_DataStore.data;
+  oy.storage = (int)m_DataStore.length;
+  ogg_sync_wrote(&oy, (long)m_DataStore.length);
+
+  // Reset flags and counters.
+  stream_init = false;
+  newPage = true;
+  packet_count = 0;
+}
+
+void SndSysSpeexDecoder::DecoderSeek (size_t)
+{
+  Reset (true);
+}
+
+size_t SndSysSpeexDecoder::DecodeChunk (char* buffer, size_t maxBytes,
+                                        int& section)
+{
+  section = 0;
+
+  while (true)
+  {
+    if (newPage)
+    {
+      if (ogg_sync_pageout(&oy, &og) != 1)
+        return 0;
+
+      if (!stream_init)
+      {
+        ogg_stream_init(&os, ogg_page_serialno(&og));
+        stream_init = true;
+      }
+
+      if (ogg_page_serialno(&og) != os.serialno)
+      {
+        ogg_stream_reset_serialno(&os, ogg_page_serialno(&og));
+      }
+
+      ogg_stream_pagein(&os, &og);
+      newPage = false;
+    }
+
+    if (ogg_stream_packetout(&os, &op) != 1)
+    {
+      newPage = true;
+      continue;
+    }
+
+    // First packets contain header data.
+    if (packet_count == 0)
+    {
+      if (header)
+      {
+        speex_header_free(header);
+      }
+      if (state)
+      {
+        speex_decoder_destroy(state);
+      }
+
+      header = speex_packet_to_header((char*)op.packet, op.bytes);
+      // const_cast for version compatibility.
+      SpeexMode* mode = const_cast<SpeexMode*>(speex_lib_get_mode (header->mode));
+      state = speex_decoder_init(mode);
+      speex_decoder_ctl(state, SPEEX_SET_SAMPLING_RATE, &header->rate);
+    }
+
+    if (packet_count++ < uint(2+header->extra_headers))
+    {
+      continue;
+    }
+
+    // Frame size is in shorts.
+    int frame_size;
+    speex_decoder_ctl(state, SPEEX_GET_FRAME_SIZE, &frame_size);
+    CS_ASSERT(frame_size * sizeof(short) <= maxBytes);
+
+    // Read and decode.
+    speex_bits_read_from(&bits, (char*)op.packet, op.bytes);
+    speex_decode_int(state, &bits, (int16*)buffer);
+
+    return frame_size * sizeof(short);
+  }
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef SNDSYS_DECODER_SPEEX_H
+#define SNDSYS_DECODER_SPEEX_H
+
+#include <ogg/ogg.h>
+#include <speex/speex.h>
+#include <speex/speex_header.h>
+
+#include "csplugincommon/sndsys/decoder.h"
+#include "speexdata.h"
+
+#ifndef CS_HAVE_SPEEX_HEADER_FREE
+#define speex_header_free(X)	free(X)
+#endif
+
+using namespace CS::SndSys;
+
+/// Speex decoder which can run ahead of playback in the background
+class SndSysSpeexDecoder : public SndSysDecoder
+{
+public:
+  /**
+   * Decode the given speex data. If \a pDecoded is set it's the fully
+   * decoded sound and the speex data is not decoded at all.
+   *
+   * The decoder only references the encoded data buffer and not the sound
+   * data element, so it can outlive the element in a background job.
+   */
+  SndSysSpeexDecoder (iDataBuffer* pEncoded, iDataBuffer* pDecoded);
+  virtual ~SndSysSpeexDecoder ();
+
+protected:
+  virtual size_t DecodeChunk (char* buffer, size_t maxBytes, int& section);
+
+  /// Only seeking to the beginning is supported
+  virtual void DecoderSeek (size_t frame);
+
+  /// Set up decoding from the beginning of the data
+  void Reset (bool clear);
+
+  /// An accessor structure for the underlying speex sound data
+  SpeexDataStore m_DataStore;
+
+  /// Ogg data structures for accessing the speex file.
+  ogg_sync_state oy;
+  ogg_page og;
+  ogg_packet op;
+  ogg_stream_state os;
+
+  /// Speex data structures.
+  void* state;
+  SpeexHeader* header;
+  SpeexBits bits;
+
+  /// Marks whether a new page is required.
+  bool newPage;
+
+  /// True if the stream has finished being initialised.
+  bool stream_init;
+
+  /// Count of processed packets.
+  uint packet_count;
+};
+
+#endif // #ifndef SNDSYS_DECODER_SPEEX_H
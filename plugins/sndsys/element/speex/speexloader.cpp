@@ -31,8 +31,9 @@ SndSysSpeexLoader::~SndSysSpeexLoader()
 {
 }
 
-bool SndSysSpeexLoader::Initialize(iObjectRegistry*)
+bool SndSysSpeexLoader::Initialize(iObjectRegistry* object_reg)
 {
+  m_DecodeSettings.Load(object_reg);
   return true;
 }
 
@@ -43,7 +44,7 @@ csPtr<iSndSysData> SndSysSpeexLoader::LoadSound(iDataBuffer* Buffer, const char*
   // If the data is Speex then load, else return 0;
   if (SndSysSpeexSoundData::IsSpeex(Buffer))
   {
-    data = new SndSysSpeexSoundData((iBase*)this, Buffer);
+    data = new SndSysSpeexSoundData((iBase*)this, Buffer, m_DecodeSettings);
     data->SetDescription(pDescription);
   }
 
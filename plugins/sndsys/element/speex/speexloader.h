@@ -22,6 +22,7 @@
 #include "csutil/scf_implementation.h"
 #include "isndsys/ss_loader.h"
 #include "iutil/comp.h"
+#include "csplugincommon/sndsys/decoder.h"
 
 /**
  * iSndSysLoader interface for Speex audio data.
@@ -34,6 +35,10 @@ public:
 
   virtual bool Initialize(iObjectRegistry*);
   virtual csPtr<iSndSysData> LoadSound(iDataBuffer* Buffer, const char *pDescription);
+
+private:
+  /// Background decoding and decoded data cache shared by all our data
+  CS::SndSys::SndSysDecodeSettings m_DecodeSettings;
 };
 
 #endif // SNDSYS_LOADER_SPEEX_H
@@ -28,8 +28,10 @@
 
 SndSysSpeexSoundStream::SndSysSpeexSoundStream (csRef<SndSysSpeexSoundData> pData, 
                                                 csSndSysSoundFormat *pRenderFormat, 
-                                                int Mode3D) : 
-SndSysBasicStream(pRenderFormat, Mode3D), m_pSoundData(pData), header(0)
+                                                int Mode3D,
+                                                const SndSysDecodeSettings& DecodeSettings,
+                                                iDataBuffer* pDecoded) : 
+SndSysBasicStream(pRenderFormat, Mode3D), m_pSoundData(pData)
 {
   // Allocate an advance buffer
   m_pCyclicBuffer = new SoundCyclicBuffer (
@@ -38,14 +40,21 @@ SndSysBasicStream(pRenderFormat, Mode3D), m_pSoundData(pData), header(0)
 	SPEEX_BUFFER_LENGTH_DIVISOR));
   CS_ASSERT(m_pCyclicBuffer!=0);
 
-  // Initialize speex stream.
-  ResetPosition(false);
+  // Decoded data is copied unconverted from the decoder
+  m_pPreparedDataBuffer = new char[SndSysDecoder::ChunkSize];
+  m_PreparedDataBufferSize = SndSysDecoder::ChunkSize;
+
+  // Create the decoder and start decoding ahead of playback
+  m_pDecoder.AttachNew (new SndSysSpeexDecoder (
+    pData->GetDataStore().buf, pDecoded));
+  DecodeSettings.SetupDecoder (m_pDecoder,
+    pData->GetFormat()->Freq * sizeof(short));
+  m_pDecoder->RequestDecode ();
 }
 
 SndSysSpeexSoundStream::~SndSysSpeexSoundStream ()
 {
-  speex_header_free(header);
-  ogg_stream_clear(&os);
+  m_pDecoder->Cancel ();
 }
 
 const char *SndSysSpeexSoundStream::GetDescription()
@@ -70,26 +79,11 @@ size_t SndSysSpeexSoundStream::GetFrameCount()
   return framecount;
 }
 
-bool SndSysSpeexSoundStream::ResetPosition(bool clear)
+bool SndSysSpeexSoundStream::ResetPosition(bool)
 {
-  // Clear the stream if needed.
-  if(clear)
-  {
-    ogg_stream_clear(&os);
-  }
-
-  // Set up the sync state and buffers.
-  speex_bits_init(&bits);
-  ogg_sync_init(&oy);
-  oy.data = m_pSoundData->GetDataStore().data;
-  oy.storage = (int)m_pSoundData->GetDataStore().length;
-  ogg_sync_wrote(&oy, (long)m_pSoundData->GetDataStore().length);
-
-  // Reset flags and counters.
-  stream_init = false;
-  newPage = true;
-  packet_count = 0;
-
+  m_PreparedDataBufferUsage = 0;
+  m_PreparedDataBufferStart = 0;
+  m_pDecoder->Seek(0);
   return true;
 }
 
@@ -115,97 +109,25 @@ void SndSysSpeexSoundStream::AdvancePosition(size_t frame_delta)
 
   while (needed_bytes > 0)
   {
-    if(newPage)
-    {
-      if(ogg_sync_pageout(&oy, &og) != 1)
-      {
-        // Mark as complete if not looping.
-        if (!m_bLooping)
-        {
-          m_bPlaybackReadComplete = true;
-        }
-
-        // Reset stream.
-        ResetPosition();
-
-        return;
-      }
-
-      if (!stream_init)
-      {
-        ogg_stream_init(&os, ogg_page_serialno(&og));
-        stream_init = true;
-      }
-
-      if (ogg_page_serialno(&og) != os.serialno)
-      {
-        ogg_stream_reset_serialno(&os, ogg_page_serialno(&og));
-      }
-
-      ogg_stream_pagein(&os, &og);
-      newPage = false;
-    }
-
-    if(ogg_stream_packetout(&os, &op) != 1)
-    {
-      newPage = true;
-      continue;
-    }
-
-    // First packets contain header data.
-    if(packet_count == 0)
+    m_PreparedDataBufferUsage = m_pDecoder->Read (m_pPreparedDataBuffer,
+      (size_t)m_PreparedDataBufferSize);
+    if (m_PreparedDataBufferUsage == 0)
     {
-      if(header)
+      // Mark as complete if not looping.
+      if (!m_bLooping)
       {
-        speex_header_free(header);
+        m_bPlaybackReadComplete = true;
       }
 
-      header = speex_packet_to_header((char*)op.packet, op.bytes);
-      // const_cast for version compatibility.
-      SpeexMode* mode = const_cast<SpeexMode*>(speex_lib_get_mode (header->mode));
-      state = speex_decoder_init(mode);
-      speex_decoder_ctl(state, SPEEX_SET_SAMPLING_RATE, &header->rate);
-
-      m_OutputFrequency=m_NewOutputFrequency;
-
-      // Create the pcm sample converter if it's not yet created
-      if (m_pPCMConverter == 0)
-        m_pPCMConverter = new PCMSampleConverter (
-        m_RenderFormat.Channels, m_RenderFormat.Bits,
-        m_RenderFormat.Freq);
-
-      // Calculate the size of one source sample
-      int source_sample_size = m_RenderFormat.Channels * m_RenderFormat.Bits;
-
-      // Calculate the needed buffer size for this conversion
-      int needed_buffer = (m_pPCMConverter->GetRequiredOutputBufferMultiple (
-        m_RenderFormat.Channels, m_RenderFormat.Bits, m_OutputFrequency) * 
-        (4096 + source_sample_size))/1024;
+      // Reset stream.
+      ResetPosition();
 
-      // Allocate a new buffer.
-      if (m_PreparedDataBufferSize < needed_buffer)
-      {
-        delete[] m_pPreparedDataBuffer;
-        m_pPreparedDataBuffer = new char[needed_buffer];
-        m_PreparedDataBufferSize=needed_buffer;
-      }
-    }
-
-    if(packet_count++ < uint(2+header->extra_headers))
-    {
-      continue;
+      return;
     }
 
-    // Read and decode.
-    speex_bits_read_from(&bits, (char*)op.packet, op.bytes);
-    speex_decode_int(state, &bits, (int16*)m_pPreparedDataBuffer);
-
-    // Frame size is in shorts.
-    speex_decoder_ctl(state, SPEEX_GET_FRAME_SIZE, &m_PreparedDataBufferUsage);
-    m_PreparedDataBufferUsage *= sizeof(short);
-
-    if (m_PreparedDataBufferUsage > 0)
-      needed_bytes -= CopyBufferBytes (needed_bytes);
+    needed_bytes -= CopyBufferBytes (needed_bytes);
   }
-}
 
+  // Keep decoding ahead of the playback position
+  m_pDecoder->RequestDecode ();
+}
@@ -19,16 +19,9 @@
 #ifndef SNDSYS_STREAM_SPEEX_H
 #define SNDSYS_STREAM_SPEEX_H
 
-#include <ogg/ogg.h>
-#include <speex/speex.h>
-#include <speex/speex_header.h>
-
 #include "csplugincommon/sndsys/sndstream.h"
 #include "speexdata.h"
-
-#ifndef CS_HAVE_SPEEX_HEADER_FREE
-#define speex_header_free(X)	free(X)
-#endif
+#include "speexdecoder.h"
 
 using namespace CS::SndSys;
 
@@ -36,7 +29,8 @@ class SndSysSpeexSoundStream : public SndSysBasicStream
 {
 public:
   SndSysSpeexSoundStream(csRef<SndSysSpeexSoundData> pData, 
-    csSndSysSoundFormat *pRenderFormat, int Mode3D);
+    csSndSysSoundFormat *pRenderFormat, int Mode3D,
+    const SndSysDecodeSettings& DecodeSettings, iDataBuffer* pDecoded);
 
   virtual ~SndSysSpeexSoundStream ();
 
@@ -89,25 +83,8 @@ private:
   /// Holds our reference to the underlying data element
   csRef<SndSysSpeexSoundData> m_pSoundData;
 
-  /// Ogg data structures for accessing the speex file.
-  ogg_sync_state oy;
-  ogg_page og;
-  ogg_packet op;
-  ogg_stream_state os;
-
-  /// Speex data structures.
-  void* state;
-  SpeexHeader* header;
-  SpeexBits bits;
-
-  /// Marks whether a new page is required.
-  bool newPage;
-
-  /// True if the stream has finished being initialised.
-  bool stream_init;
-
-  /// Count of processed packets.
-  uint packet_count;
+  /// Decoder providing the decoded speex data, possibly ahead of time
+  csRef<SndSysSpeexDecoder> m_pDecoder;
 };
 
 #endif // #ifndef SNDSYS_STREAM_SPEEX_H
@@ -33,6 +33,7 @@
 
 #include "source.h"
 #include "listener.h"
+#include "mixer.h"
 
 using namespace CS::SndSys;
 
@@ -212,11 +213,6 @@ public:
       second_buffer=new csSoundSample[properties.buffer_samples];
       second_buffersize=properties.buffer_samples;
     }
-    // Copy to the second buffer
-    if (second_filter)
-      memcpy(second_buffer,properties.work_buffer,
-      properties.buffer_samples * sizeof(csSoundSample));
-
     if (second_filter)
     {
       memcpy(&second_props, &properties,
@@ -233,9 +229,8 @@ public:
     {
       second_filter->Apply(second_props);
 
-      size_t i;
-      for (i=0;i<properties.buffer_samples;i++)
-        properties.work_buffer[i]+=second_buffer[i];
+      SndSysMixAddBlock(properties.work_buffer, second_buffer,
+        properties.buffer_samples);
     }
   }
 
@@ -350,14 +345,9 @@ public:
           if (history_shift + delay_samples > history_samples)
             delay_samples=history_samples- history_shift;
           if (delay_samples < properties.buffer_samples)
-          {
-            size_t idx;
-            for (idx=properties.buffer_samples-1;idx>=delay_samples;idx--)
-              properties.work_buffer[idx]=properties.work_buffer[idx-delay_samples];
-            //memcpy(&(properties.work_buffer[delay_samples]), 
-            //properties.work_buffer, 
-            //(properties.buffer_samples- delay_samples) * sizeof(csSoundSample));
-          }
+            memmove(&(properties.work_buffer[delay_samples]), 
+              properties.work_buffer, 
+              (properties.buffer_samples- delay_samples) * sizeof(csSoundSample));
           memcpy(properties.work_buffer, 
             &(history_buffer[history_samples-(history_shift + delay_samples)]), 
             delay_samples * sizeof(csSoundSample));
@@ -440,14 +430,9 @@ public:
       if (history_shift + delay_samples > history_samples)
         delay_samples=history_samples- history_shift;
       if (delay_samples < properties.buffer_samples)
-      {
-        size_t idx;
-        for (idx=properties.buffer_samples-1;idx>=delay_samples;idx--)
-          properties.work_buffer[idx]=properties.work_buffer[idx-delay_samples];
-        //memcpy(&(properties.work_buffer[delay_samples]), 
-        //properties.work_buffer, 
-        //(properties.buffer_samples- delay_samples) * sizeof(csSoundSample));
-      }
+        memmove(&(properties.work_buffer[delay_samples]), 
+          properties.work_buffer, 
+          (properties.buffer_samples- delay_samples) * sizeof(csSoundSample));
       memcpy(properties.work_buffer, 
         &(history_buffer[history_samples-(history_shift + delay_samples)]), 
         delay_samples * sizeof(csSoundSample));
@@ -659,10 +644,8 @@ public:
       float vol = 
         (properties.speaker_direction_cos[properties.channel]-cos_far) / range;
 
-      size_t i;
-      for (i=0;i<properties.buffer_samples;i++)
-        properties.work_buffer[i] = 
-        (int)((float)properties.work_buffer[i] * vol);
+      SndSysMixScaleBlock(properties.work_buffer, properties.buffer_samples,
+        vol);
     }
 
     if (next_filter)
@@ -0,0 +1,124 @@
+/*
+  Copyright (C) 2010 by the Crystal Space team
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+
+#ifndef SNDSYS_RENDERER_SOFTWARE_MIXER_H
+#define SNDSYS_RENDERER_SOFTWARE_MIXER_H
+
+/*  Block operations for the Software Sound Renderer
+ *
+ *  The mixer and the 3D filters work on whole blocks of csSoundSample values.
+ *  These helpers process a block at a time, four samples per step when SSE2
+ *  is available at compile time.
+*/
+#include "isndsys/ss_structs.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SNDSYS_MIXER_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/// Add a block of samples into a mix buffer
+inline void SndSysMixAddBlock(csSoundSample *dst, const csSoundSample *src,
+                              size_t count)
+{
+  size_t i=0;
+#ifdef SNDSYS_MIXER_SSE2
+  for (;i+4<=count;i+=4)
+  {
+    __m128i d=_mm_loadu_si128((const __m128i*)(dst+i));
+    __m128i s=_mm_loadu_si128((const __m128i*)(src+i));
+    _mm_storeu_si128((__m128i*)(dst+i), _mm_add_epi32(d, s));
+  }
+#endif
+  for (;i<count;i++)
+    dst[i]+=src[i];
+}
+
+/// Multiply a block of samples by a volume factor, truncating towards zero
+inline void SndSysMixScaleBlock(csSoundSample *buf, size_t count, float factor)
+{
+  size_t i=0;
+#ifdef SNDSYS_MIXER_SSE2
+  const __m128 f=_mm_set1_ps(factor);
+  for (;i+4<=count;i+=4)
+  {
+    __m128 s=_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(buf+i)));
+    _mm_storeu_si128((__m128i*)(buf+i), _mm_cvttps_epi32(_mm_mul_ps(s, f)));
+  }
+#endif
+  for (;i<count;i++)
+    buf[i]=(csSoundSample)((float)buf[i] * factor);
+}
+
+/// Convert a block of signed 16 bit samples into mix samples
+inline void SndSysMixConvert16Block(csSoundSample *dst, const short *src,
+                                    size_t count)
+{
+  size_t i=0;
+#ifdef SNDSYS_MIXER_SSE2
+  for (;i+8<=count;i+=8)
+  {
+    __m128i s=_mm_loadu_si128((const __m128i*)(src+i));
+    // Place each sample in the high half of a 32 bit lane, then shift it
+    //  back down with sign extension
+    _mm_storeu_si128((__m128i*)(dst+i),
+      _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+    _mm_storeu_si128((__m128i*)(dst+i+4),
+      _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+  }
+#endif
+  for (;i<count;i++)
+    dst[i]=src[i];
+}
+
+/// Find the largest absolute sample value in a block
+inline csSoundSample SndSysMixMaxAbs(const csSoundSample *buf, size_t count)
+{
+  csSoundSample maxintensity=0;
+  size_t i=0;
+#ifdef SNDSYS_MIXER_SSE2
+  if (count>=4)
+  {
+    __m128i m=_mm_setzero_si128();
+    for (;i+4<=count;i+=4)
+    {
+      __m128i s=_mm_loadu_si128((const __m128i*)(buf+i));
+      __m128i sign=_mm_srai_epi32(s, 31);
+      __m128i a=_mm_sub_epi32(_mm_xor_si128(s, sign), sign);
+      __m128i gt=_mm_cmpgt_epi32(a, m);
+      m=_mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, m));
+    }
+    csSoundSample lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, m);
+    for (int l=0;l<4;l++)
+      if (lanes[l] > maxintensity) maxintensity=lanes[l];
+  }
+#endif
+  for (;i<count;i++)
+  {
+    csSoundSample abssamp=buf[i];
+    if (abssamp<0) abssamp=-abssamp;
+    if (abssamp > maxintensity) maxintensity=abssamp;
+  }
+  return maxintensity;
+}
+
+#endif // #ifndef SNDSYS_RENDERER_SOFTWARE_MIXER_H
@@ -45,6 +45,7 @@
 #include "listener.h"
 #include "source.h"
 #include "renderer.h"
+#include "mixer.h"
 
 
 
@@ -62,6 +63,7 @@ SCF_IMPLEMENT_FACTORY (csSndSysRendererSoftware)
 csSndSysRendererSoftware::csSndSysRendererSoftware(iBase* pParent) :
   scfImplementationType(this, pParent),
   m_pObjectRegistry(0), m_pSampleBuffer(0), m_SampleBufferFrames(0),
+  m_MaxRealVoices(0), m_LastMixTime(0), m_MaxMixTime(0),
   m_LastGarbageCollectionTicks(0), m_LastIntensityMultiplier(0)
 {
   m_pObjectRegistry = 0;
@@ -418,6 +420,10 @@ bool csSndSysRendererSoftware::Open ()
 
   RecordEvent(SSEL_DEBUG, "Global Volume set to %.2f (0.0 - 1.0)", m_GlobalVolume);
 
+  int max_voices = m_Config->GetInt("SndSys.MaxVoices", 64);
+  m_MaxRealVoices = (max_voices > 0) ? (size_t)max_voices : 0;
+  RecordEvent(SSEL_DEBUG, "Real voice budget set to %d (0 = unlimited)", max_voices);
+
   return m_pSoundDriver->StartThread();
 }
 
@@ -592,6 +598,8 @@ void csSndSysRendererSoftware::StatusReport()
     RecordEvent(SSEL_DEBUG,"Stream remove queue length [%d]", m_StreamRemoveQueue.Length());
     RecordEvent(SSEL_DEBUG,"Current time (csTicks) [%u]", CurrentTime);
     RecordEvent(SSEL_DEBUG,"Last garbage collection time (csTicks) [%u]", m_LastGarbageCollectionTicks);
+    RecordEvent(SSEL_DEBUG,"Last mix time (us) [%u]", (uint)m_LastMixTime);
+    RecordEvent(SSEL_DEBUG,"Longest mix time (us) [%u]", (uint)m_MaxMixTime);
 
     m_LastStatusReport=CurrentTime;
   }
@@ -817,9 +825,49 @@ void csSndSysRendererSoftware::AdvanceStreams(size_t Frames)
   }
 }
 
+int csSndSysRendererSoftware::CompareVoiceAudibility(VoiceEntry const& a,
+                                                     VoiceEntry const& b)
+{
+  if (a.audibility > b.audibility)
+    return -1;
+  if (a.audibility < b.audibility)
+    return 1;
+  return 0;
+}
+
+size_t csSndSysRendererSoftware::SelectRealVoices()
+{
+  size_t source_count=m_ActiveSources.GetSize();
+  size_t idx;
+
+  // Sources which are inaudible never get a real voice
+  m_RealVoice.SetSize(source_count);
+  m_AudibleVoices.Empty();
+  for (idx=0;idx<source_count;idx++)
+  {
+    VoiceEntry entry;
+    entry.audibility=m_ActiveSources[idx]->GetAudibility();
+    entry.source_idx=idx;
+    m_RealVoice[idx]=(entry.audibility > 0.0f);
+    if (m_RealVoice[idx])
+      m_AudibleVoices.Push(entry);
+  }
+
+  if ((m_MaxRealVoices == 0) || (m_AudibleVoices.GetSize() <= m_MaxRealVoices))
+    return m_AudibleVoices.GetSize();
+
+  // Over budget, the quietest audible sources become virtual as well
+  m_AudibleVoices.Sort(CompareVoiceAudibility);
+  for (idx=m_MaxRealVoices;idx<m_AudibleVoices.GetSize();idx++)
+    m_RealVoice[m_AudibleVoices[idx].source_idx]=false;
+  return m_MaxRealVoices;
+}
+
 size_t csSndSysRendererSoftware::FillDriverBuffer(void *buf1, size_t buf1_frames,
 						  void *buf2, size_t buf2_frames)
 {
+  int64 mix_start=csGetMicroTicks();
+
   // Update queued listener property changes
   m_pListener->UpdateQueuedProperties();
 
@@ -849,7 +897,10 @@ size_t csSndSysRendererSoftware::FillDriverBuffer(void *buf1, size_t buf1_frames
   //  This call also queues completed auto-unregister streams for cleanup
   AdvanceStreams(needed_frames);
 
-  // Mix all the sources
+  // Pick the sources which will be mixed this time
+  size_t real_voices=SelectRealVoices();
+
+  // Mix all the real voices, advance the virtual ones
   size_t maxidx=m_ActiveSources.GetSize();
   size_t currentidx;
   for (currentidx=0;currentidx<maxidx;currentidx++)
@@ -859,7 +910,10 @@ size_t csSndSysRendererSoftware::FillDriverBuffer(void *buf1, size_t buf1_frames
       //"Requesting %d samples from source.", needed_samples);
 
     // The return from this function is this number of samples actually available
-    provided_frames = m_ActiveSources.Get(currentidx)->MergeIntoBuffer (m_pSampleBuffer, needed_frames);
+    if (m_RealVoice[currentidx])
+      provided_frames = m_ActiveSources.Get(currentidx)->MergeIntoBuffer (m_pSampleBuffer, needed_frames);
+    else
+      provided_frames = m_ActiveSources.Get(currentidx)->AdvanceWithoutMixing (needed_frames);
 
     if (provided_frames==0)
     {
@@ -896,8 +950,16 @@ size_t csSndSysRendererSoftware::FillDriverBuffer(void *buf1, size_t buf1_frames
   CopySampleBufferToDriverBuffer (buf1, buf1_frames * m_PlaybackFormat.Channels * m_PlaybackFormat.Bits/8,
     buf2, buf2_frames * m_PlaybackFormat.Channels * m_PlaybackFormat.Bits/8, needed_frames);
 
-  //csTicks end_ticks=csGetTicks();
-//  Report (CS_REPORTER_SEVERITY_DEBUG, "Processing time: %u ticks.", end_ticks-current_ticks);
+  // Report the time spent mixing, and whether the driver will run dry because of it
+  m_LastMixTime=csGetMicroTicks()-mix_start;
+  if (m_LastMixTime > m_MaxMixTime)
+    m_MaxMixTime=m_LastMixTime;
+  RecordEvent(SSEL_DEBUG, "Mixed [%u] of [%u] sources in [%u] us.",
+    (uint)real_voices, (uint)maxidx, (uint)m_LastMixTime);
+  int64 deadline=((int64)needed_frames * 1000000) / m_PlaybackFormat.Freq;
+  if (m_LastMixTime > deadline)
+    RecordEvent(SSEL_WARNING, "Mixing [%u] frames took [%u] us, longer than their playback time of [%u] us.",
+      (uint)needed_frames, (uint)m_LastMixTime, (uint)deadline);
 
 
   return needed_frames;
@@ -916,12 +978,7 @@ void csSndSysRendererSoftware::NormalizeSampleBuffer(size_t used_samples)
   desiredintensity=desiredintensity<<16;
 
   // First scan, find the max abs sample value
-  for (sample_idx=0;sample_idx<used_samples;sample_idx++)
-  {
-    csSoundSample abssamp=m_pSampleBuffer[sample_idx];
-    if (abssamp<0) abssamp=-abssamp;
-    if (abssamp > maxintensity) maxintensity=abssamp;
-  }
+  maxintensity=SndSysMixMaxAbs(m_pSampleBuffer, used_samples);
 
   RecordEvent(SSEL_DEBUG, "Maximum sample intensity is %d", maxintensity);
 
@@ -208,6 +208,31 @@ protected:
   /// Size of the sample buffer in frames of audio
   size_t m_SampleBufferFrames;
 
+  /// Maximum number of sources mixed in one callback, 0 for no limit
+  //
+  //  When more sources are audible, only the loudest are mixed (real voices).
+  //   The others are virtual voices: they advance with the stream but are not mixed.
+  size_t m_MaxRealVoices;
+
+  /// Audibility of an active source, used to pick the real voices
+  struct VoiceEntry
+  {
+    float audibility;
+    size_t source_idx;
+  };
+
+  /// Audible sources of the current callback, sorted by audibility if over budget
+  csArray<VoiceEntry> m_AudibleVoices;
+
+  /// Whether each active source is mixed in the current callback, indexed like m_ActiveSources
+  csArray<bool> m_RealVoice;
+
+  /// Time taken by the last FillDriverBuffer() call in microseconds
+  int64 m_LastMixTime;
+
+  /// Longest time taken by a FillDriverBuffer() call so far in microseconds
+  int64 m_MaxMixTime;
+
   /// ID of the 'Open' event fired on system startup
   csEventID evSystemOpen;
   /// ID of the 'Close' event fired on system shutdown
@@ -275,6 +300,13 @@ protected:
   //   This function only has a body in debug mode
   void StatusReport();
 
+  /// Decide which active sources are mixed and which are virtual voices.
+  //   Fills m_RealVoice and returns the number of real voices.
+  size_t SelectRealVoices();
+
+  /// Comparison sorting VoiceEntry structures loudest first
+  static int CompareVoiceAudibility(VoiceEntry const& a, VoiceEntry const& b);
+
   /// Called when a source is added to the sound renderer
   void SourceAdded(iSndSysSource *pSource);
   /// Called when a source is removed from the sound renderer
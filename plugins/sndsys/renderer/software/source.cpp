@@ -36,6 +36,7 @@
 #include "renderer.h"
 #include "listener.h"
 #include "filters.h"
+#include "mixer.h"
 
 #include "source.h"
 
@@ -398,6 +399,45 @@ size_t SndSysSourceSoftwareBasic::MergeIntoBuffer(csSoundSample *channel_buffer,
   return original_frame_count;
 }
 
+float SndSysSourceSoftwareBasic::GetAudibility()
+{
+  UpdateQueuedParameters();
+
+  // Paused streams generate no audio
+  if ((sound_stream->GetPauseState() == CS_SNDSYS_STREAM_PAUSED) && 
+      (sound_stream->GetPosition() == stream_position))
+    return 0.0f;
+
+  // Same threshold as MergeIntoBuffer()
+  if (active_parameters.volume < 0.00001f)
+    return 0.0f;
+  return active_parameters.volume;
+}
+
+size_t SndSysSourceSoftwareBasic::AdvanceWithoutMixing(size_t frame_count)
+{
+  void *buf1,*buf2;
+  size_t buf1_len, buf2_len;
+
+  UpdateQueuedParameters();
+
+  // Muted or paused sources do not advance when mixed either
+  if (active_parameters.volume == 0.0f)
+    return frame_count;
+  if ((sound_stream->GetPauseState() == CS_SNDSYS_STREAM_PAUSED) && 
+      (sound_stream->GetPosition() == stream_position))
+    return frame_count;
+
+  // Move the stream cursor without touching the data
+  int bytes_per_frame=renderer->m_PlaybackFormat.Bits * renderer->m_PlaybackFormat.Channels/8;
+  sound_stream->GetDataPointers (&stream_position, frame_count * bytes_per_frame,
+    &buf1, &buf1_len, &buf2, &buf2_len);
+
+  if ((buf1_len+buf2_len)/bytes_per_frame == 0)
+    return 0;
+  return frame_count;
+}
+
 
 
 
@@ -781,8 +821,7 @@ size_t SndSysSourceSoftware3D::MergeIntoBuffer (csSoundSample *channel_buffer,
   else
   {
     // 16 bit samples
-    size_t i;
-    int buffer_idx;
+    size_t buffer_idx;
     short *src_ptr;
 
     buffer_idx=0;
@@ -791,19 +830,17 @@ size_t SndSysSourceSoftware3D::MergeIntoBuffer (csSoundSample *channel_buffer,
     buf1_len/=2;
     buf2_len/=2;
 
+    // Convert to signed integers
     if (buf1_len)
     {
       src_ptr =(short *)buf1;
-      for (i=0;i<buf1_len;i++)
-        // Convert to a signed integer
-        clean_buffer[buffer_idx++]=src_ptr[i];
+      SndSysMixConvert16Block(&(clean_buffer[buffer_idx]), src_ptr, buf1_len);
+      buffer_idx+=buf1_len;
     }
     if (buf2_len)
     {
       src_ptr =(short *)buf2;
-      for (i=0;i<buf2_len;i++)
-        // Convert to a signed integer
-        clean_buffer[buffer_idx++]=src_ptr[i];
+      SndSysMixConvert16Block(&(clean_buffer[buffer_idx]), src_ptr, buf2_len);
     }
   }
 
@@ -816,59 +853,9 @@ size_t SndSysSourceSoftware3D::MergeIntoBuffer (csSoundSample *channel_buffer,
 
   int channel,total_channels;
   total_channels=renderer->m_PlaybackFormat.Channels;
-  csVector3 listener_to_source;
-  
-  if (sound_stream->Get3dMode() == CS_SND3D_RELATIVE)
-    listener_to_source=active_parameters.position;
-  else
-  {
-    // Translate absolute coordinates into relative listener coordinates
-    listener_to_source=renderer->m_pListener->active_properties.world_to_listener.Other2This(active_parameters.position);
-  }
-
-  /*
-  if (debug_cycle++ >= 20)
-  {
-    renderer->Report(CS_REPORTER_SEVERITY_DEBUG, "3D sound source has relative vector (%0.4f,%0.4f,%0.4f)", 
-      listener_to_source.x, listener_to_source.y, listener_to_source.z);
-    debug_cycle=0;
-  }
-  */
-
 
+  UpdateSpeakerDistances();
 
-  // For each output channel, calculate the distance
-  closest_speaker=-1.0f;
-  for (channel=0;channel<total_channels;channel++)
-  {
-    csVector3 speaker_to_source = listener_to_source - renderer->m_Speakers[channel].RelativePosition;
-    // Calculate the distance between the listener and the source
-    float distance=speaker_to_source.Norm();
-
-    // Clamp the distance at the max
-    if (active_parameters.maximum_distance != CS_SNDSYS_SOURCE_DISTANCE_INFINITE)
-    {
-      if (distance > active_parameters.maximum_distance)
-        distance=active_parameters.maximum_distance;
-    }
-
-    if ((closest_speaker < 0.0f) || (distance < closest_speaker))
-      closest_speaker=distance;
-    speaker_distance[channel]=distance;
-
-    // Translate speaker position from starting coordinate system to directional coordinate system
-    speaker_to_source.Normalize();
-
-    speaker_direction_cos[channel]=(renderer->m_Speakers[channel].Direction * speaker_to_source);
-    /*
-    // Approximate the effect of direction as a 40 percent variance in volume
-    speaker_scale[channel] = 0.40f * (listener_to_source * speaker_to_source);
-    if (speaker_scale[channel] < 0.0f)
-      speaker_scale[channel]=0.0f;
-    speaker_scale[channel]+=0.60f;
-    */
-  }
-  
   SndSysOutputFilterQueue::SampleBuffer *pFilterSampleBuffer=0;
   if (m_SourceOutFilterQueue.GetOutputFilterCount()>0)
     pFilterSampleBuffer=new SndSysOutputFilterQueue::SampleBuffer(frame_count, total_channels);
@@ -883,8 +870,7 @@ size_t SndSysSourceSoftware3D::MergeIntoBuffer (csSoundSample *channel_buffer,
       // If there's at least one output filter, queue samples for it
       if (pFilterSampleBuffer)
         pFilterSampleBuffer->AddSamples(working_buffer, frame_count);
-      for (size_t i=0;i<frame_count;i++)
-        channel_base[i]+=working_buffer[i];
+      SndSysMixAddBlock(channel_base, working_buffer, frame_count);
     }
     else
     {
@@ -1035,6 +1021,106 @@ bool SndSysSourceSoftware3D::ProcessSoundChain(int channel, size_t buffer_sample
 
 
 
+void SndSysSourceSoftware3D::UpdateSpeakerDistances()
+{
+  int channel,total_channels;
+  total_channels=renderer->m_PlaybackFormat.Channels;
+  csVector3 listener_to_source;
+  
+  if (sound_stream->Get3dMode() == CS_SND3D_RELATIVE)
+    listener_to_source=active_parameters.position;
+  else
+  {
+    // Translate absolute coordinates into relative listener coordinates
+    listener_to_source=renderer->m_pListener->active_properties.world_to_listener.Other2This(active_parameters.position);
+  }
+
+  // For each output channel, calculate the distance
+  closest_speaker=-1.0f;
+  for (channel=0;channel<total_channels;channel++)
+  {
+    csVector3 speaker_to_source = listener_to_source - renderer->m_Speakers[channel].RelativePosition;
+    // Calculate the distance between the listener and the source
+    float distance=speaker_to_source.Norm();
+
+    // Clamp the distance at the max
+    if (active_parameters.maximum_distance != CS_SNDSYS_SOURCE_DISTANCE_INFINITE)
+    {
+      if (distance > active_parameters.maximum_distance)
+        distance=active_parameters.maximum_distance;
+    }
+
+    if ((closest_speaker < 0.0f) || (distance < closest_speaker))
+      closest_speaker=distance;
+    speaker_distance[channel]=distance;
+
+    // Translate speaker position from starting coordinate system to directional coordinate system
+    speaker_to_source.Normalize();
+
+    speaker_direction_cos[channel]=(renderer->m_Speakers[channel].Direction * speaker_to_source);
+  }
+}
+
+float SndSysSourceSoftware3D::GetAudibility()
+{
+  UpdateQueuedParameters();
+
+  if (active_parameters.volume == 0.0f)
+    return 0.0f;
+
+  // Paused streams generate no audio
+  if ((sound_stream->GetPauseState() == CS_SNDSYS_STREAM_PAUSED) && 
+    (sound_stream->GetPosition() == stream_position))
+    return 0.0f;
+
+  // Use the volume the IID filter applies for the closest speaker
+  UpdateSpeakerDistances();
+
+  float minimum_distance=active_parameters.minimum_distance;
+  if (minimum_distance < 0.000001f)
+    minimum_distance=0.000001f;
+  float iid_distance=closest_speaker/minimum_distance;
+  if (iid_distance < 1.0f) iid_distance=1.0f;
+
+  float rollofffactor = renderer->m_pListener->active_properties.rolloff_factor;
+  float vol=active_parameters.volume;
+  if (rollofffactor != 1.0f)
+    vol/=pow(iid_distance,rollofffactor);
+  else
+    vol/=iid_distance;
+
+  // Below this the integer volume factor of the IID filter is 0
+  if (vol * SOURCE_INTEGER_VOLUME_MULTIPLE < 1.0f)
+    return 0.0f;
+  return vol;
+}
+
+size_t SndSysSourceSoftware3D::AdvanceWithoutMixing(size_t frame_count)
+{
+  void *buf1,*buf2;
+  size_t buf1_len,buf2_len;
+
+  UpdateQueuedParameters();
+
+  // Muted or paused sources do not advance when mixed either
+  if (active_parameters.volume == 0.0f)
+    return frame_count;
+  if ((sound_stream->GetPauseState() == CS_SNDSYS_STREAM_PAUSED) && 
+    (sound_stream->GetPosition() == stream_position))
+    return frame_count;
+
+  // Move the stream cursor without touching the data.  The filter histories
+  //  are not updated, so a voice becoming real again starts from silence.
+  int bytes_per_frame=renderer->m_PlaybackFormat.Bits/8;
+  sound_stream->GetDataPointers (&stream_position, frame_count * bytes_per_frame,
+    &buf1, &buf1_len, &buf2, &buf2_len);
+
+  if ((buf1_len+buf2_len)/bytes_per_frame == 0)
+    return 0;
+  return frame_count;
+}
+
+
 inline bool SndSysSourceSoftware3D::PrepareBuffer(csSoundSample **p_buf, size_t *p_buf_len, size_t required)
 {
   if (*p_buf_len < required)
@@ -145,6 +145,12 @@ public:
   virtual size_t MergeIntoBuffer(csSoundSample *frame_buffer,
     size_t frame_count);
 
+  /// Renderer convenience interface - Estimate the loudness of the next mix
+  virtual float GetAudibility();
+
+  /// Renderer convenience interface - Advance without mixing, as a virtual voice
+  virtual size_t AdvanceWithoutMixing(size_t frame_count);
+
   /**
    * Renderer convenience interface - Called to provide processing of
    * output filters
@@ -266,6 +272,12 @@ public:
   virtual size_t MergeIntoBuffer(csSoundSample *frame_buffer, 
     size_t frame_count);
 
+  /// Renderer convenience interface - Estimate the loudness of the next mix
+  virtual float GetAudibility();
+
+  /// Renderer convenience interface - Advance without mixing, as a virtual voice
+  virtual size_t AdvanceWithoutMixing(size_t frame_count);
+
   /// Renderer convenience interface - Called to provide processing of output filters
   virtual void ProcessOutputFilters();
 
@@ -285,6 +297,9 @@ protected:
   inline void ClearBuffer(csSoundSample *p_buf, size_t p_buf_len);
   bool ProcessSoundChain(int channel, size_t buffer_samples);
 
+  /// Calculate the distance and direction from each speaker to the source
+  void UpdateSpeakerDistances();
+
 
   void SetupFilters();
 
@@ -31,15 +31,22 @@
 #include "iutil/eventq.h"
 #include "ivaria/reporter.h"
 #include "ivideo/graph2d.h"
+#include "ivideo/graph3d.h"
+#include "ivideo/screenreadback.h"
 #include "iutil/virtclk.h"
 #include "ivaria/reporter.h"
 #include "iengine/engine.h"
 #include "igraphic/image.h"
+#include "iutil/databuff.h"
 
 #include "csutil/event.h"
 #include "csutil/eventhandlers.h"
 #include "csutil/csstring.h"
+#include "csutil/platform.h"
+#include "csutil/threadjobqueue.h"
+#include "csutil/threading/atomicops.h"
 #include "csgfx/imagemanipulate.h"
+#include "csgfx/imagememory.h"
 
 #include "movierecorder.h"
 
@@ -49,6 +56,66 @@ CS_PLUGIN_NAMESPACE_BEGIN(Movierecorder)
 {
 SCF_IMPLEMENT_FACTORY (csMovieRecorder)
 
+using namespace CS::Threading;
+
+/// Converts a frame into the format the writer compresses
+class csMovieRecorder::ConvertJob : public scfImplementation1<ConvertJob, iJob>
+{
+  csMovieRecorder* recorder;
+  CapturedFrame* frame;
+public:
+  ConvertJob (csMovieRecorder* recorder, CapturedFrame* frame) :
+    scfImplementationType (this), recorder (recorder), frame (frame) {}
+
+  void Run ()
+  {
+    csTicks startTime = csGetTicks();
+    NuppelWriter* writer = recorder->writer;
+    const uint8* pixels = frame->pixels;
+    csRef<iImage> scaled;
+    // If we're recording to a different resolution, scale the image
+    if ((frame->width != writer->width) || (frame->height != writer->height))
+    {
+      csRef<iImage> img;
+      img.AttachNew (new csImageMemory (frame->width, frame->height,
+        frame->pixels, false));
+      scaled = csImageManipulate::Rescale (img, writer->width,
+        writer->height);
+      pixels = (const uint8*)scaled->GetImageData();
+    }
+    writer->convertFrame (pixels, frame->converted, frame->bottomUp);
+    frame->convertTime = csGetTicks() - startTime;
+  }
+};
+
+/// Compresses and writes a frame once it was converted
+class csMovieRecorder::EncodeJob : public scfImplementation1<EncodeJob, iJob>
+{
+  csMovieRecorder* recorder;
+  CapturedFrame* frame;
+  csRef<ConvertJob> convertJob;
+public:
+  EncodeJob (csMovieRecorder* recorder, CapturedFrame* frame,
+    ConvertJob* convertJob) : scfImplementationType (this),
+    recorder (recorder), frame (frame), convertJob (convertJob) {}
+
+  void Run ()
+  {
+    // Runs the conversion here if no worker got to it yet
+    recorder->convertQueue->PullAndRun (convertJob, true);
+
+    NuppelWriter* writer = recorder->writer;
+    for (int i = 0; i < frame->skipBefore; i++)
+      writer->skipFrame();
+    csTicks encodeTime, writeTime;
+    writer->writeConvertedFrame (frame->converted, recorder->encodeScratch,
+      encodeTime, writeTime);
+    recorder->AddEncodeStats (frame->convertTime + encodeTime, writeTime);
+
+    AtomicOperations::Set (&frame->busy, 0);
+  }
+};
+
 void csMovieRecorder::Report (int severity, const char* msg, ...)
 {
   va_list arg;
@@ -70,6 +137,7 @@ csMovieRecorder::csMovieRecorder (iBase* parent) :
   object_reg = 0;
   initialized = false;
   writer = 0;
+  encodeScratch = 0;
   ffakeClockTicks = 0;
   fakeClockTicks = 0;
   fakeClockElapsed = 0;
@@ -187,6 +255,8 @@ void csMovieRecorder::SetupPlugin()
     return;
   }
 
+  csRef<iGraphics3D> G3D = csQueryRegistry<iGraphics3D> (object_reg);
+
   config.AddConfig (object_reg, "/config/movierecorder.cfg");
 
   frameRate = config->GetFloat("MovieRecorder.Capture.FPS", 30.0);
@@ -197,6 +267,24 @@ void csMovieRecorder::SetupPlugin()
   useRTJpeg = config->GetBool("MovieRecorder.Capture.UseRTJpeg", false);
   useRGB = config->GetBool("MovieRecorder.Capture.UseRGB", false);
   throttle = config->GetBool("MovieRecorder.Capture.Throttle", true);
+  usePipeline = config->GetBool("MovieRecorder.Capture.Pipeline", true);
+  useAsyncReadback = config->GetBool("MovieRecorder.Capture.AsyncReadback",
+    true);
+  queueLength = config->GetInt("MovieRecorder.Capture.QueueLength", 8);
+  dropFrames = config->GetBool("MovieRecorder.Capture.DropFrames", false);
+  numThreads = config->GetInt("MovieRecorder.Capture.Threads", 0);
+  if (numThreads <= 0)
+    numThreads = CS::Platform::GetProcessorCount();
+  if (queueLength < 2) usePipeline = false;
+
+  if (usePipeline)
+  {
+    convertQueue.AttachNew (new ThreadedJobQueue (numThreads,
+      THREAD_PRIO_NORMAL));
+    encodeQueue.AttachNew (new ThreadedJobQueue (1, THREAD_PRIO_NORMAL));
+    if (useAsyncReadback && G3D)
+      screenReadback = scfQueryInterface<iScreenReadback> (G3D);
+  }
 
   GetKeyCode(config->GetStr("MovieRecorder.Keys.Record", "alt-r"), keyRecord);
   GetKeyCode(config->GetStr("MovieRecorder.Keys.Pause", "alt-p"), keyPause);
@@ -252,44 +340,113 @@ bool csMovieRecorder::HandleStartFrame (iEvent& /*event*/)
 bool csMovieRecorder::HandleEndFrame (iEvent& /*event*/)
 {
   if (IsRecording() && !IsPaused()) {
-    csRef<iImage> img (csPtr<iImage> (G2D->ScreenShot ()));
+    csRef<iDataBuffer> readback;
+    csRef<iImage> img;
+    int w, h;
+    if (screenReadback)
+      readback = screenReadback->ReadbackScreen (w, h);
+    else
+      img.AttachNew (G2D->ScreenShot ());
 
     csTicks ticks = csGetTicks();
     csTicks thisFrameTime = ticks - frameStartTime;
 
-    if (!img) {
+    if (!img && !readback) {
       Report (CS_REPORTER_SEVERITY_ERROR, "This video driver doesn't support screen capture.");
       Stop();
       return false;
     }
 
-    // If we're recording to a different resolution, try to scale the image
-    if (img->GetWidth() != writer->width || img->GetHeight() != writer->height) {
-      img = csImageManipulate::Rescale (img, writer->width, writer->height);
-    }
-
-    numFrames++;
-
-    csTicks encodeTime, writeTime;
-    unsigned char *buffer = (unsigned char *) img->GetImageData();
-    writer->writeFrame(buffer, encodeTime, writeTime);
-
     totalFrameTime += thisFrameTime;
     minFrameTime = MIN (minFrameTime, thisFrameTime);
     maxFrameTime = MAX (maxFrameTime, thisFrameTime);
 
-    totalFrameEncodeTime += encodeTime;
-    minFrameEncodeTime = MIN (minFrameEncodeTime, encodeTime);
-    maxFrameEncodeTime = MAX (maxFrameEncodeTime, encodeTime);
-
-    totalWriteToDiskTime += writeTime;
-    minWriteToDiskTime = MIN (minWriteToDiskTime, writeTime);
-    maxWriteToDiskTime = MAX (maxWriteToDiskTime, writeTime);
+    if (readback) {
+      // The last frame's transfer should be done by now
+      FlushReadback();
+      pendingReadback = readback;
+      pendingWidth = w;
+      pendingHeight = h;
+    }
+    else if (usePipeline) {
+      QueueFrame ((const uint8*)img->GetImageData(), img->GetWidth(),
+        img->GetHeight(), false);
+    }
+    else {
+      // If we're recording to a different resolution, try to scale the image
+      if (img->GetWidth() != writer->width || img->GetHeight() != writer->height) {
+        img = csImageManipulate::Rescale (img, writer->width, writer->height);
+      }
+
+      csTicks encodeTime, writeTime;
+      unsigned char *buffer = (unsigned char *) img->GetImageData();
+      writer->writeFrame(buffer, encodeTime, writeTime);
+      AddEncodeStats (encodeTime, writeTime);
+    }
   }
 
   return false;
 }
 
+void csMovieRecorder::QueueFrame (const uint8* pixels, int width, int height,
+                                  bool bottomUp)
+{
+  CapturedFrame* frame = frames[nextFrame];
+  if (AtomicOperations::Read (&frame->busy) != 0) {
+    // The encoder fell behind and the queue is full
+    if (dropFrames) {
+      numDroppedFrames++;
+      framesToSkip++;
+      return;
+    }
+    numStalledFrames++;
+    while (AtomicOperations::Read (&frame->busy) != 0)
+      csSleep (1);
+  }
+  nextFrame = (nextFrame + 1) % frames.GetSize();
+
+  size_t pixelsSize = width * height * 4;
+  if (frame->pixelsSize != pixelsSize) {
+    frame->pixels = (uint8*)cs_realloc (frame->pixels, pixelsSize);
+    frame->pixelsSize = pixelsSize;
+  }
+  memcpy (frame->pixels, pixels, pixelsSize);
+  frame->width = width;
+  frame->height = height;
+  frame->bottomUp = bottomUp;
+  frame->skipBefore = framesToSkip;
+  framesToSkip = 0;
+  AtomicOperations::Set (&frame->busy, 1);
+
+  csRef<ConvertJob> convertJob;
+  convertJob.AttachNew (new ConvertJob (this, frame));
+  csRef<EncodeJob> encodeJob;
+  encodeJob.AttachNew (new EncodeJob (this, frame, convertJob));
+  convertQueue->Enqueue (convertJob);
+  encodeQueue->Enqueue (encodeJob);
+}
+
+void csMovieRecorder::FlushReadback ()
+{
+  if (!pendingReadback) return;
+  QueueFrame (pendingReadback->GetUint8(), pendingWidth, pendingHeight,
+    true);
+  pendingReadback = 0;
+}
+
+void csMovieRecorder::AddEncodeStats (csTicks encodeTime, csTicks writeTime)
+{
+  numFrames++;
+
+  totalFrameEncodeTime += encodeTime;
+  minFrameEncodeTime = MIN (minFrameEncodeTime, encodeTime);
+  maxFrameEncodeTime = MAX (maxFrameEncodeTime, encodeTime);
+
+  totalWriteToDiskTime += writeTime;
+  minWriteToDiskTime = MIN (minWriteToDiskTime, writeTime);
+  maxWriteToDiskTime = MAX (maxWriteToDiskTime, writeTime);
+}
+
 bool csMovieRecorder::IsRecording(void) const
 {
   return writer != 0;
@@ -311,6 +468,7 @@ void csMovieRecorder::Start(void)
   int h = recordHeight ? recordHeight : G2D->GetHeight();
 
   numFrames = 0;
+  numDroppedFrames = numStalledFrames = 0;
   totalFrameEncodeTime = totalFrameTime = totalWriteToDiskTime = 0;
   minFrameEncodeTime = minFrameTime = minWriteToDiskTime = (csTicks)-1;
   maxFrameEncodeTime = maxFrameTime = maxWriteToDiskTime = 0;
@@ -330,6 +488,17 @@ void csMovieRecorder::Start(void)
   writer = new NuppelWriter(w, h, &WriterCallback, this, frameRate,
 			    rtjQuality, useRTJpeg, useLZO, useRGB);
 
+  if (usePipeline) {
+    for (int i = 0; i < queueLength; i++) {
+      CapturedFrame* frame = new CapturedFrame;
+      frame->converted = (uint8*)cs_malloc (writer->convertedSize);
+      frames.Push (frame);
+    }
+    nextFrame = 0;
+    framesToSkip = 0;
+    encodeScratch = (uint8*)cs_malloc (writer->scratchSize);
+  }
+
   Report (CS_REPORTER_SEVERITY_NOTIFY, "Video recorder started - %s", 
     movieFileName.GetData());
 }
@@ -337,6 +506,15 @@ void csMovieRecorder::Start(void)
 void csMovieRecorder::Stop(void)
 {
   if (IsRecording()) {
+    if (usePipeline) {
+      // Write out all frames still in the pipeline
+      FlushReadback();
+      encodeQueue->WaitAll();
+      convertQueue->WaitAll();
+      frames.DeleteAll();
+      cs_free (encodeScratch);
+      encodeScratch = 0;
+    }
     delete writer;
     writer = 0;
     movieFile = 0;
@@ -352,6 +530,7 @@ void csMovieRecorder::Stop(void)
       Report (CS_REPORTER_SEVERITY_NOTIFY, 
 	"Video recording statistics for %s:\n"
 	" Number of frames: %d\n"
+	" Dropped frames: %d, frames waiting for the encoder: %d\n"
 	" Time spent for:\n"
 	"  encoding image data - total: %.3fs, per frame: %zu min/%g avg/%zu max ms\n"
 	"  writing encoded data - total: %.3fs, per frame: %zu min/%g avg/%zu max ms\n"
@@ -361,6 +540,7 @@ void csMovieRecorder::Stop(void)
 	" Theoretical video FPS recordable in real-time: %.2f\n",
 	movieFileName.GetData(), 
 	numFrames,
+	numDroppedFrames, numStalledFrames,
 	((float)totalFrameEncodeTime / 1000.0f),
 	  minFrameEncodeTime, avgFrameEncodeTime, maxFrameEncodeTime,
 	((float)totalWriteToDiskTime / 1000.0f),
@@ -28,8 +28,10 @@
 #include "ivaria/movierecorder.h"
 #include "iutil/eventh.h"
 #include "iutil/virtclk.h"
+#include "iutil/job.h"
 #include "csutil/cfgacc.h"
 #include "csutil/eventnames.h"
+#include "csutil/parray.h"
 #include "csutil/util.h"
 #include "csutil/weakref.h"
 #include "cstool/numberedfilenamehelper.h"
@@ -38,6 +40,8 @@
 struct iObjectRegistry;
 struct iEngine;
 struct iGraphics2D;
+struct iScreenReadback;
+struct iDataBuffer;
 struct iVFS;
 struct iFile;
 
@@ -50,6 +54,11 @@ CS_PLUGIN_NAMESPACE_BEGIN(Movierecorder)
  * in NuppelVideo format using the RTJpeg lossy codec and/or the LZO
  * lossless codec. Note that this module is GPLed rather than LGPLed due to
  * licenses on the existing compression code.
+ *
+ * In pipelined mode, captured frames are put into a bounded queue and
+ * converted and compressed on worker threads while the next frames are
+ * drawn. If the renderer supports iScreenReadback the screen is also read
+ * back asynchronously and only copied a frame later.
  */
 class csMovieRecorder : 
   public scfImplementation2<csMovieRecorder, 
@@ -60,6 +69,7 @@ private:
   iObjectRegistry *object_reg;
   csRef<iEngine> Engine;
   csRef<iGraphics2D> G2D;
+  csRef<iScreenReadback> screenReadback;
   csRef<iVFS> VFS;
   csRef<iVirtualClock> vc;
   csConfigAccess config;
@@ -84,6 +94,7 @@ private:
   csTicks totalFrameEncodeTime, minFrameEncodeTime, maxFrameEncodeTime;
   csTicks totalWriteToDiskTime, minWriteToDiskTime, maxWriteToDiskTime;
   csTicks frameStartTime, totalFrameTime, minFrameTime, maxFrameTime;
+  int numDroppedFrames, numStalledFrames;
 
   /// format of the movie filename (e.g. "/this/cryst%03d.nuv")
   CS::NumberedFilenameHelper captureFormat;
@@ -95,6 +106,53 @@ private:
   bool useLZO, useRTJpeg, useRGB;
   /// Throttle clock if frame is drawn faster than required
   bool throttle;
+  /// Pipeline settings
+  bool usePipeline, useAsyncReadback, dropFrames;
+  int queueLength, numThreads;
+
+  class ConvertJob;
+  class EncodeJob;
+  /// A captured frame on its way through the pipeline
+  struct CapturedFrame
+  {
+    /// Nonzero from capture until the frame was written
+    int32 busy;
+    /// Screen contents, RGBA
+    uint8* pixels;
+    size_t pixelsSize;
+    int width, height;
+    bool bottomUp;
+    /// Frame in the format the writer compresses
+    uint8* converted;
+    csTicks convertTime;
+    /// Number of dropped frames to skip before writing this one
+    int skipBefore;
+
+    CapturedFrame () : busy (0), pixels (0), pixelsSize (0),
+      converted (0) {}
+    ~CapturedFrame () { cs_free (pixels); cs_free (converted); }
+  };
+  /// Frame slots, used round robin
+  csPDelArray<CapturedFrame> frames;
+  size_t nextFrame;
+  /// Frames dropped since the last frame entered the queue
+  int framesToSkip;
+  /// Workers converting frames, may run several frames at once
+  csRef<iJobQueue> convertQueue;
+  /// Worker compressing and writing frames, one after another
+  csRef<iJobQueue> encodeQueue;
+  uint8* encodeScratch;
+  /// Readback of the last frame, copied into the queue in the next frame
+  csRef<iDataBuffer> pendingReadback;
+  int pendingWidth, pendingHeight;
+
+  /// Put a captured frame into the pipeline
+  void QueueFrame (const uint8* pixels, int width, int height,
+    bool bottomUp);
+  /// Queue the pending readback, if any
+  void FlushReadback ();
+  /// Update the statistics for a frame that was written
+  void AddEncodeStats (csTicks encodeTime, csTicks writeTime);
 
   /// Key bindings
   struct keyBinding {
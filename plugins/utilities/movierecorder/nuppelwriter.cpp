@@ -36,8 +36,8 @@
 /* Colorspace conversion routines from rgb2yuv420.cpp */
 void InitLookupTable();
 int RGB2YUV420 (int x_dim, int y_dim, 
-		unsigned char *bmp, 
-		unsigned char *yuv);
+		const unsigned char *bmp, 
+		unsigned char *yuv, bool bottomUp);
 
 
 NuppelWriter::NuppelWriter(int width, int height, 
@@ -73,6 +73,10 @@ NuppelWriter::NuppelWriter(int width, int height,
   nuvh.videoblocks = -1;   /* unknown */
   
   bufferSize = width * height * 3;
+  convertedSize = rgb ? width * height * 4
+    : width*height+(width*height)/2;
+  /* LZO output may be slightly larger than its input */
+  scratchSize = width * height * 4 + (width * height * 4) / 16 + 64 + 3;
 
   /* Allocate several temporary buffers */
   compressBuffer = new unsigned char [width*height+(width*height)/2];
@@ -112,10 +116,56 @@ NuppelWriter::~NuppelWriter() {
 
 void NuppelWriter::writeFrame(unsigned char *frameBuffer, 
 			      csTicks& encodeTime, csTicks& writeTime) 
+{
+  csTicks convertTime = csGetTicks();
+  if (!rgb) {
+    /* Convert from RGB to YUV420. */
+    convertFrame(frameBuffer, yuvBuffer, false);
+    convertTime = csGetTicks() - convertTime;
+    writeConvertedFrame(yuvBuffer, frameBuffer, encodeTime, writeTime);
+  }
+  else {
+    convertTime = 0;
+    writeConvertedFrame(frameBuffer, frameBuffer, encodeTime, writeTime);
+  }
+  encodeTime += convertTime;
+}
+
+void NuppelWriter::convertFrame(const unsigned char *frameBuffer,
+				unsigned char *converted, bool bottomUp) const
+{
+  if (rgb) {
+    /* The RGB format stores the frame as it is, top row first */
+    const size_t pitch = width * 4;
+    if (!bottomUp)
+      memcpy(converted, frameBuffer, pitch * height);
+    else {
+      const unsigned char *src = frameBuffer + (height - 1) * pitch;
+      for (int y = 0; y < height; y++) {
+	memcpy(converted, src, pitch);
+	converted += pitch;
+	src -= pitch;
+      }
+    }
+  }
+  else
+    RGB2YUV420(width, height, frameBuffer, converted, bottomUp);
+}
+
+void NuppelWriter::skipFrame()
+{
+  frameNumber++;
+  frameofgop++;
+}
+
+void NuppelWriter::writeConvertedFrame(const unsigned char *converted, 
+				       unsigned char *scratch,
+				       csTicks& encodeTime,
+				       csTicks& writeTime) 
 {
   rtframeheader frameh;
   lzo_uint lzoSize;
-  unsigned char *currentBuffer;
+  const unsigned char *currentBuffer;
   unsigned int currentBufferSize;
 
 
@@ -144,63 +194,36 @@ void NuppelWriter::writeFrame(unsigned char *frameBuffer,
   frameh.keyframe = frameofgop;
   frameh.timecode = (int) (frameNumber * frameRate * 1000.0);
 
+  currentBuffer = converted;
   if (rgb) {
-    /* Nonstandard: uncompressed bottom-up RGB24 */
+    /* Nonstandard: uncompressed RGB */
     frameh.comptype = 'R';
-#if 0
-    uint8 *rawRgb = frameBuffer;
-    int bufPitch = width * 3;
-    uint8 *destLine = rgbBuffer + (height - 1) * bufPitch;
-    
-    int x, y;
-    y = height;
-    while (y--)
-    {
-      x = width;
-      while (x--)
-      {
-	*destLine++ = *rawRgb++;
-	*destLine++ = *rawRgb++;
-	*destLine++ = *rawRgb++;
-	rawRgb++;
-      }
-      destLine -= bufPitch * 2;
-    }
-
-    currentBuffer = rgbBuffer;
-    currentBufferSize = bufferSize;
-#else
-    currentBuffer = frameBuffer;
     currentBufferSize = bufferSize;
-#endif
   }
   else {
-    /* Convert from RGB to YUV420. This routine has also
-     * been modified to flip the video vertically.
-     */
-    RGB2YUV420(width, height, frameBuffer, yuvBuffer);
-    currentBuffer = yuvBuffer;
+    /* YUV420, converted by convertFrame() */
     currentBufferSize = width*height+(width*height/2);
     frameh.comptype = '0';
   }
 
   if (rtjpeg) {
     /* Compress the frame using RTJpeg (lossy) */
-    currentBufferSize = RTjpeg_mcompressYUV420((int8*) compressBuffer, yuvBuffer, 1, 1);
+    currentBufferSize = RTjpeg_mcompressYUV420((int8*) compressBuffer,
+      (unsigned char*)converted, 1, 1);
     currentBuffer = compressBuffer;
     frameh.comptype = '1';
   }
 
   if (lzo) {
     /* Compress it again using LZO (lossless) */
-    lzo1x_1_compress(currentBuffer, currentBufferSize, frameBuffer, &lzoSize, lzoTmp);
+    lzo1x_1_compress(currentBuffer, currentBufferSize, scratch, &lzoSize, lzoTmp);
     currentBufferSize = lzoSize;
-    currentBuffer = frameBuffer;
+    currentBuffer = scratch;
     if (rtjpeg)
       frameh.comptype = '2';
     else {
       if (rgb)
-	frameh.comptype = 'r';   /* Nonstandard: LZO'ed bottom-up RGB24 */
+	frameh.comptype = 'r';   /* Nonstandard: LZO'ed RGB */
       else
 	frameh.comptype = '3';
     }
@@ -55,8 +55,24 @@ public:
   void writeFrame(unsigned char *frameBuffer, csTicks& encodeTime,
   	csTicks& writeTime);
 
+  /* The two halves of writeFrame(), for pipelined recording.
+   * convertFrame() converts an RGBA frame into the colour space it is
+   * compressed in and may be called from any thread, for several frames at
+   * once. writeConvertedFrame() compresses and outputs converted frames; it
+   * must be called for one frame at a time, in order. 'scratch' needs to
+   * hold scratchSize bytes.
+   */
+  void convertFrame(const unsigned char *frameBuffer, unsigned char *converted,
+  	bool bottomUp) const;
+  void writeConvertedFrame(const unsigned char *converted,
+  	unsigned char *scratch, csTicks& encodeTime, csTicks& writeTime);
+  /* Advance the timecode without writing a frame */
+  void skipFrame();
+
   /* Expected size of the framebuffer */
   unsigned long bufferSize;
+  /* Sizes of the buffers for convertFrame() and writeConvertedFrame() */
+  unsigned long convertedSize, scratchSize;
 
   int width, height;
   float frameRate;
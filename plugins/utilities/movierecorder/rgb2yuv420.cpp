@@ -18,8 +18,8 @@ void InitLookupTable();
 /************************************************************************
  *
  *  int RGB2YUV420 (int x_dim, int y_dim, 
- *				unsigned char *bmp, 
- *				unsigned char *yuv, int flip)
+ *				const unsigned char *bmp, 
+ *				unsigned char *yuv, bool bottomUp)
  *
  *	Purpose :	It takes a 24-bit RGB bitmap and convert it into
  *				YUV (4:2:0) format
@@ -28,6 +28,11 @@ void InitLookupTable();
  *				y_dim	the y dimension of the bitmap
  *				bmp		pointer to the buffer of the bitmap
  *				yuv		pointer to the YUV structure
+ *				bottomUp	whether the bitmap rows are stored
+ *						bottom row first
+ *
+ *  The conversion only uses constant tables, so it can run on several
+ *  threads at once.
  *
  ************************************************************************/
 
@@ -42,14 +47,16 @@ void InitLookupTable();
 #endif
 
 int RGB2YUV420 (int x_dim, int y_dim, 
-		uint8 *bmp, 
-		uint8 *yuv)
+		const uint8 *bmp, 
+		uint8 *yuv, bool bottomUp)
 {
   int i, j;
-  uint32 *rgb_line1, *rgb_line2;
+  const uint32 *rgb_line1, *rgb_line2;
   uint8 *y1, *y2, *u, *v;
-  int pitch;
+  int pitch, rgb_pitch;
   pitch = x_dim;
+  // Step from the end of a line pair to the start of the next one
+  rgb_pitch = bottomUp ? -3 * pitch : pitch;
 
   y1 = yuv;
   y2 = y1 + pitch;
@@ -57,8 +64,16 @@ int RGB2YUV420 (int x_dim, int y_dim,
   x_dim >>= 1;
   y_dim >>= 1;
   v = u + (x_dim * y_dim);
-  rgb_line1 = (uint32*)bmp;
-  rgb_line2 = rgb_line1 + pitch;
+  if (bottomUp)
+  {
+    rgb_line1 = (const uint32*)bmp + (y_dim * 2 - 1) * pitch;
+    rgb_line2 = rgb_line1 - pitch;
+  }
+  else
+  {
+    rgb_line1 = (const uint32*)bmp;
+    rgb_line2 = rgb_line1 + pitch;
+  }
 
   for (i=0; i < y_dim; i++){
     for (j=0; j < x_dim; j++){
@@ -97,8 +112,8 @@ int RGB2YUV420 (int x_dim, int y_dim,
       *u++ = tu >> 18;
       *v++ = tv >> 18;
     }
-    rgb_line1 += pitch;
-    rgb_line2 += pitch;
+    rgb_line1 += rgb_pitch;
+    rgb_line2 += rgb_pitch;
     y1 += pitch;
     y2 += pitch;
   }
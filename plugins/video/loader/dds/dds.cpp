@@ -21,8 +21,13 @@
 */
 #include "cssysdef.h"
 
+#include <math.h>
+
+#include "csgeom/math.h"
+#include "csgfx/pixelops.h"
 #include "csutil/csendian.h"
 #include "dds.h"
+#include "ddsutil.h"
 
 #include "dxt.h"
 
@@ -31,6 +36,136 @@ CS_PLUGIN_NAMESPACE_BEGIN(DDSImageIO)
 namespace dds
 {
 
+#ifdef CS_DDS_SSE2
+namespace
+{
+  enum { blockDXT1, blockDXT3, blockDXT5 };
+
+  /* The SSE2 decoder is used when csgfx' pixel kernels use SSE2; that way
+     both are switched together by PixelOps::SetImplementation(). */
+  static bool UseSSE2 ()
+  {
+    return CS::Graphics::PixelOps::GetImplementation ()
+      == CS::Graphics::PixelOps::implSSE2;
+  }
+
+  /* Select the colors of one block row (the lowest 8 bits of 'bits' are the
+     four 2 bit indices) from the palette, using compare masks. */
+  static inline __m128i SelectColorRow (uint32 bits, const __m128i* pal)
+  {
+    const __m128i bit0 = _mm_set_epi32 (0x40, 0x10, 0x04, 0x01);
+    const __m128i bit1 = _mm_set_epi32 (0x80, 0x20, 0x08, 0x02);
+    const __m128i v = _mm_set1_epi32 (int (bits));
+    const __m128i m0 = _mm_cmpeq_epi32 (_mm_and_si128 (v, bit0), bit0);
+    const __m128i m1 = _mm_cmpeq_epi32 (_mm_and_si128 (v, bit1), bit1);
+    const __m128i c01 = _mm_or_si128 (_mm_and_si128 (m0, pal[1]),
+      _mm_andnot_si128 (m0, pal[0]));
+    const __m128i c23 = _mm_or_si128 (_mm_and_si128 (m0, pal[3]),
+      _mm_andnot_si128 (m0, pal[2]));
+    return _mm_or_si128 (_mm_and_si128 (m1, c23),
+      _mm_andnot_si128 (m1, c01));
+  }
+
+  /* Decode DXT1/3/5 blocks into rows of four pixels. Blocks that lie
+     completely inside the image are stored directly. */
+  template<int blockType>
+  static void DecompressBlocksSSE2 (csRGBpixel* buffer, const uint8* source,
+                                    int Width, int Height, int depth,
+                                    size_t planesize)
+  {
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i colorMask = _mm_set1_epi32 (0x00ffffff);
+    const uint8* block = source;
+
+    for (int z = 0; z < depth; z++)
+    {
+      csRGBpixel* plane = buffer + z * planesize;
+      for (int y = 0; y < Height; y += 4)
+      {
+        for (int x = 0; x < Width; x += 4)
+        {
+          const uint8* colorBlock = block;
+          __m128i alpha[4];
+          if (blockType == blockDXT3)
+          {
+            for (int j = 0; j < 4; j++)
+            {
+              const uint32 word =
+                csLittleEndian::Convert (((const uint16*)block)[j]);
+              alpha[j] = _mm_set_epi32 (
+                int (((word >> 12) & 0xf) * 0x11u << 24),
+                int (((word >> 8) & 0xf) * 0x11u << 24),
+                int (((word >> 4) & 0xf) * 0x11u << 24),
+                int ((word & 0xf) * 0x11u << 24));
+            }
+            colorBlock += 8;
+          }
+          else if (blockType == blockDXT5)
+          {
+            uint8 alphaValues[16];
+            DXTDecompress::DecodeDXT5Alpha (block, alphaValues);
+            const __m128i a = _mm_loadu_si128 ((const __m128i*)alphaValues);
+            // Move each alpha value to the top byte of a pixel
+            const __m128i a01 = _mm_unpacklo_epi8 (zero, a);
+            const __m128i a23 = _mm_unpackhi_epi8 (zero, a);
+            alpha[0] = _mm_unpacklo_epi16 (zero, a01);
+            alpha[1] = _mm_unpackhi_epi16 (zero, a01);
+            alpha[2] = _mm_unpacklo_epi16 (zero, a23);
+            alpha[3] = _mm_unpackhi_epi16 (zero, a23);
+            colorBlock += 8;
+          }
+          block = colorBlock + 8;
+
+          DXTDecompress::Color8888 colours[4];
+          uint32 bits = DXTDecompress::DecodeDXT1Palette<
+            blockType == blockDXT1> (colorBlock, colours);
+          uint32 colours32[4];
+          memcpy (colours32, colours, sizeof (colours32));
+          __m128i pal[4];
+          for (int k = 0; k < 4; k++)
+            pal[k] = _mm_set1_epi32 (int (colours32[k]));
+
+          __m128i rows[4];
+          for (int j = 0; j < 4; j++)
+          {
+            rows[j] = SelectColorRow (bits, pal);
+            if (blockType != blockDXT1)
+              rows[j] = _mm_or_si128 (_mm_and_si128 (rows[j], colorMask),
+                alpha[j]);
+            bits >>= 8;
+          }
+
+          if ((x + 4 <= Width) && (y + 4 <= Height))
+          {
+            csRGBpixel* dst = plane + y * Width + x;
+            for (int j = 0; j < 4; j++)
+            {
+              _mm_storeu_si128 ((__m128i*)dst, rows[j]);
+              dst += Width;
+            }
+          }
+          else
+          {
+            csRGBpixel pixels[16];
+            for (int j = 0; j < 4; j++)
+              _mm_storeu_si128 ((__m128i*)(pixels + j * 4), rows[j]);
+            for (int j = 0; j < 4; j++)
+            {
+              if (y + j >= Height) break;
+              for (int i = 0; i < 4; i++)
+              {
+                if (x + i >= Width) break;
+                plane[(y + j) * Width + (x + i)] = pixels[j * 4 + i];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+#endif // CS_DDS_SSE2
+
 bool Loader::ProbeDXT1C (const uint8* source, int w, int h, int depth, 
   size_t /*size*/)
 {
@@ -61,6 +196,14 @@ void Loader::DecompressDXT1 (csRGBpixel* buffer, const uint8* source,
 			     int Width, int Height, int depth, 
 			     size_t planesize)
 {
+#ifdef CS_DDS_SSE2
+  if (UseSSE2 ())
+  {
+    DecompressBlocksSSE2<blockDXT1> (buffer, source, Width, Height, depth,
+      planesize);
+    return;
+  }
+#endif
   int          x, y, z, i, j;
   uint8 *Temp;
   DXTDecompress::Color8888    colorBlock[16];
@@ -113,6 +256,14 @@ void Loader::DecompressDXT3(csRGBpixel* buffer, const uint8* source,
 			    int Width, int Height, int depth, 
 			    size_t planesize)
 {
+#ifdef CS_DDS_SSE2
+  if (UseSSE2 ())
+  {
+    DecompressBlocksSSE2<blockDXT3> (buffer, source, Width, Height, depth,
+      planesize);
+    return;
+  }
+#endif
   int           x, y, z, i, j;
   uint16        *Temp;
   DXTDecompress::Color8888    colorBlock[16];
@@ -183,6 +334,14 @@ void Loader::DecompressDXT5 (csRGBpixel* buffer, const uint8* source,
 			     int Width, int Height, int depth, 
 			     size_t planesize)
 {
+#ifdef CS_DDS_SSE2
+  if (UseSSE2 ())
+  {
+    DecompressBlocksSSE2<blockDXT5> (buffer, source, Width, Height, depth,
+      planesize);
+    return;
+  }
+#endif
   int             x, y, z, i, j;
   const uint8     *Temp;
   DXTDecompress::Color8888    colorBlock[16];
@@ -226,6 +385,46 @@ void Loader::DecompressDXT5 (csRGBpixel* buffer, const uint8* source,
   }
 }
 
+void Loader::DecompressATI2 (csRGBpixel* buffer, const uint8* source, 
+			     int Width, int Height, int depth, 
+			     size_t planesize)
+{
+  const uint8* Temp = source;
+  uint8 redMask[16];
+  uint8 greenMask[16];
+
+  for (int z = 0; z < depth; z++) 
+  {
+    for (int y = 0; y < Height; y += 4) 
+    {
+      for (int x = 0; x < Width; x += 4) 
+      {
+        DXTDecompress::DecodeDXT5Alpha (Temp, redMask);
+	Temp += 8;
+        DXTDecompress::DecodeDXT5Alpha (Temp, greenMask);
+	Temp += 8;
+
+	for (int j = 0; j < 4; j++) 
+	{
+	  for (int i = 0; i < 4; i++) 
+	  {
+	    // only put pixels out < width or height
+	    if (((x + i) >= Width) || ((y + j) >= Height)) continue;
+
+	    const int k = j * 4 + i;
+	    const float nx = redMask[k] * (2.0f / 255.0f) - 1.0f;
+	    const float ny = greenMask[k] * (2.0f / 255.0f) - 1.0f;
+	    const float nz = sqrtf (csMax (0.0f, 1.0f - nx * nx - ny * ny));
+	    const size_t Offset = z * planesize + (y + j) * Width + (x + i);
+	    buffer[Offset].Set (redMask[k], greenMask[k],
+	      int (nz * 127.5f + 127.5f), 255);
+	  }
+	}
+      }
+    }
+  }
+}
+
 inline static void ComputeMaskParams (uint32 mask, int& shift1, int& mul, int& shift2)
 {
   shift1 = 0; mul = 1; shift2 = 0;
@@ -160,6 +160,12 @@ public:
     int w, int h, int depth, size_t size);
   static void DecompressDXT5 (csRGBpixel* buffer, const uint8* source, 
     int w, int h, int depth, size_t size);
+  /**
+   * Decompress a two channel ATI2 (BC5) image. Red and green are decoded,
+   * blue is reconstructed as the Z component of a unit length normal.
+   */
+  static void DecompressATI2 (csRGBpixel* buffer, const uint8* source, 
+    int w, int h, int depth, size_t size);
   static void DecompressRGB (csRGBpixel* buffer, const uint8* source, 
     int w, int h, int depth, size_t size, const PixelFormat& pf);
   static void DecompressRGBA (csRGBpixel* buffer, const uint8* source, 
@@ -19,6 +19,8 @@
 
 #include "cssysdef.h"
 #include "csutil/csendian.h"
+#include "csutil/platform.h"
+#include "csutil/threadjobqueue.h"
 #include "csgfx/imagemanipulate.h"
 #include "ivaria/reporter.h"
 #include "dds.h"
@@ -99,6 +101,12 @@ csDDSRawDataType csDDSImageIO::IdentifyPixelFormat (const dds::PixelFormat& pf,
         bpp = 8; 
         break;
       }
+    case 83:
+      {
+        type = csrawATI2;
+        bpp = 8; 
+        break;
+      }
     }
   }
   else if (pf.flags & dds::DDPF_FOURCC)
@@ -125,6 +133,10 @@ csDDSRawDataType csDDSImageIO::IdentifyPixelFormat (const dds::PixelFormat& pf,
       type = csrawDXT5;
       bpp = 8; 
       break;
+    case MakeFourCC ('A','T','I','2'):
+      type = csrawATI2;
+      bpp = 8; 
+      break;
     }
   }
   else
@@ -183,6 +195,7 @@ static size_t DataSize (csDDSRawDataType dataType, int bpp, int w, int h,
     case csrawDXT3:
     case csrawDXT4:
     case csrawDXT5:
+    case csrawATI2:
       {
 	int minW = ((w + 3) / 4) * 4;
 	int minH = ((h + 3) / 4) * 4;
@@ -306,10 +319,23 @@ csPtr<iDataBuffer> csDDSImageIO::Save (iImage* image, const char* mime,
 {
   if (strcmp (mime, DDS_MIME) != 0) return 0;
   csImageLoaderOptionsParser optparser (options);
-  csDDSSaver saver;
+  csDDSSaver saver (GetJobQueue ());
   return saver.Save (image, optparser);
 }
 
+iJobQueue* csDDSImageIO::GetJobQueue ()
+{
+  CS::Threading::MutexScopedLock lock (jobQueueLock);
+  if (!jobQueue.IsValid())
+  {
+    jobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+      CS::Platform::GetProcessorCount(), CS::Threading::THREAD_PRIO_NORMAL));
+    // Set up here where it's protected from concurrent saves
+    dds::DXTCompress::Initialize ();
+  }
+  return jobQueue;
+}
+
 //---------------------------------------------------------------------------
 
 csDDSImageFile::csDDSImageFile (iObjectRegistry* object_reg, int format, 
@@ -370,6 +396,12 @@ void csDDSImageFile::MakeImageData ()
 	    dataSize);
 	  break;
 	}
+      case csrawATI2:
+	{
+	  dds::Loader::DecompressATI2 (buf, source, Width, Height, 1,
+	    dataSize);
+	  break;
+	}
       case csrawLum8:
 	{
 	  dds::Loader::DecompressLum (buf, source, Width, Height, Depth, 
@@ -24,6 +24,8 @@
 #include "csgfx/imagememory.h"
 #include "csutil/parasiticdatabuffer.h"
 #include "csutil/refarr.h"
+#include "csutil/threading/mutex.h"
+#include "iutil/job.h"
 #include "iutil/comp.h"
 #include "igraphic/imageio.h"
 
@@ -41,6 +43,7 @@ enum csDDSRawDataType
   csrawR8G8B8,
   csrawR5G6B5,
   csrawLum8,
+  csrawATI2,
 
   csrawUnknownAlpha,
   csrawDXT1Alpha,
@@ -81,6 +84,11 @@ public:
 private:
   csImageIOFileFormatDescriptions formats;
   iObjectRegistry* object_reg;
+  /// Queue to compress DXT blocks on, created when first saving
+  csRef<iJobQueue> jobQueue;
+  CS::Threading::Mutex jobQueueLock;
+
+  iJobQueue* GetJobQueue ();
 
   csDDSRawDataType IdentifyPixelFormat (const dds::PixelFormat& pf, 
     uint32 dxgiFormat, bool isDX10, uint& bpp);
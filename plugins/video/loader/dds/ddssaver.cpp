@@ -19,7 +19,10 @@
 
 #include "cssysdef.h"
 #include "csgfx/imagememory.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/scf_implementation.h"
 #include "csutil/util.h"
+#include "iutil/job.h"
 
 #include "ddssaver.h"
 #include "dds.h"
@@ -30,6 +33,16 @@
 CS_PLUGIN_NAMESPACE_BEGIN(DDSImageIO)
 {
 
+bool csDDSSaver::Format::SaveAll (csMemFile& out,
+                                  const csRefArray<iImage>& images)
+{
+  for (size_t i = 0; i < images.GetSize(); i++)
+  {
+    if (!Save (out, images[i])) return false;
+  }
+  return true;
+}
+
 bool csDDSSaver::FmtB8G8R8::Save (csMemFile& out, iImage* image)
 {
   size_t pixNum = image->GetWidth() * image->GetHeight() * image->GetDepth();
@@ -66,8 +79,129 @@ bool csDDSSaver::FmtB8G8R8A8::Save (csMemFile& out, iImage* image)
   return true;
 }
 
+/// Compresses a band of block rows of one image
+class csDDSSaver::FmtDXT::CompressJob :
+  public scfImplementation1<CompressJob, iJob>
+{
+  dds::DXTCompress::Format format;
+  dds::DXTCompress::Quality quality;
+  // Keeps the pixels alive
+  csRef<iImage> image;
+  const csRGBpixel* pixels;
+  int firstRow, numRows;
+  uint8* out;
+public:
+  CompressJob (dds::DXTCompress::Format format, 
+    dds::DXTCompress::Quality quality, iImage* image, 
+    const csRGBpixel* pixels, int firstRow, int numRows, uint8* out) : 
+    scfImplementationType (this), format (format), quality (quality), 
+    image (image), pixels (pixels), firstRow (firstRow), numRows (numRows),
+    out (out) {}
+
+  virtual void Run ()
+  {
+    dds::DXTCompress::CompressRows (format, quality, pixels, 
+      image->GetWidth(), image->GetHeight(), firstRow, numRows, out);
+  }
+};
+
+csDDSSaver::FmtDXT::FmtDXT (ImageLib::DXTCMethod method, 
+                            dds::DXTCompress::Format blockFormat,
+                            const csImageLoaderOptionsParser& options,
+                            iJobQueue* jobQueue) : method (method), 
+  options (options), blockFormat (blockFormat), 
+  quality (dds::DXTCompress::qualityNormal), useImageLib (false), 
+  jobQueue (jobQueue)
+{
+  csString qualityStr;
+  if (options.GetString ("quality", qualityStr))
+  {
+    if (qualityStr == "fast")
+      quality = dds::DXTCompress::qualityFast;
+    else if (qualityStr == "high")
+      quality = dds::DXTCompress::qualityHigh;
+    else if (qualityStr == "reference")
+      useImageLib = true;
+  }
+  // Error diffusion is only implemented by ImageLib
+  bool dither = false;
+  if (options.GetBool ("dither", dither) && dither)
+    useImageLib = true;
+  // ImageLib only supports the DXT formats
+  if (blockFormat == dds::DXTCompress::fmtBC5)
+    useImageLib = false;
+}
+
+bool csDDSSaver::FmtDXT::SaveAll (csMemFile& out, 
+                                  const csRefArray<iImage>& images)
+{
+  if (useImageLib) return Format::SaveAll (out, images);
+
+  dds::DXTCompress::Initialize ();
+
+  // All images go into one buffer so they can be compressed at once
+  csDirtyAccessArray<size_t> offsets;
+  size_t totalSize = 0;
+  for (size_t i = 0; i < images.GetSize(); i++)
+  {
+    offsets.Push (totalSize);
+    totalSize += dds::DXTCompress::ImageSize (blockFormat, 
+      images[i]->GetWidth(), images[i]->GetHeight());
+  }
+  uint8* blocks = new uint8[totalSize];
+
+  // Split images into bands of block rows of about equal size
+  const int bandBlocks = 1024;
+  csRefArray<iJob> jobs;
+  for (size_t i = 0; i < images.GetSize(); i++)
+  {
+    iImage* image = images[i];
+    // Images may decode their data on first access, do that here and not
+    // concurrently in the jobs
+    const csRGBpixel* pixels = (const csRGBpixel*)image->GetImageData();
+    const int blocksX = (image->GetWidth() + 3) / 4;
+    const int blocksY = (image->GetHeight() + 3) / 4;
+    const int bandRows = csMax (1, bandBlocks / blocksX);
+    const size_t rowSize = 
+      dds::DXTCompress::BlockSize (blockFormat) * blocksX;
+    for (int row = 0; row < blocksY; row += bandRows)
+    {
+      const int numRows = csMin (bandRows, blocksY - row);
+      csRef<iJob> job;
+      job.AttachNew (new CompressJob (blockFormat, quality, image, pixels,
+        row, numRows, blocks + offsets[i] + row * rowSize));
+      jobs.Push (job);
+    }
+  }
+
+  if (jobQueue && (jobs.GetSize() > 1))
+  {
+    for (size_t j = 0; j < jobs.GetSize(); j++)
+      jobQueue->Enqueue (jobs[j]);
+    // Help with the work while waiting for it to finish
+    for (size_t j = 0; j < jobs.GetSize(); j++)
+      jobQueue->PullAndRun (jobs[j], true);
+  }
+  else
+  {
+    for (size_t j = 0; j < jobs.GetSize(); j++)
+      jobs[j]->Run();
+  }
+
+  out.Write ((char*)blocks, totalSize);
+  delete[] blocks;
+  return true;
+}
+
 bool csDDSSaver::FmtDXT::Save (csMemFile& out, iImage* image)
 {
+  if (!useImageLib)
+  {
+    csRefArray<iImage> images;
+    images.Push (image);
+    return SaveAll (out, images);
+  }
+
   const int imgW = image->GetWidth();
   if ((imgW > 4) && ((imgW & 3) != 0)) return 0;
   const int imgH = image->GetHeight();
@@ -115,13 +249,14 @@ bool csDDSSaver::FmtDXT::Save (csMemFile& out, iImage* image)
   return true;
 }
 
-uint csDDSSaver::SaveMips (csMemFile& out, iImage* image, Format* format)
+uint csDDSSaver::CollectMips (csRefArray<iImage>& images, iImage* image)
 {
   uint m;
   for (m = 0; m <= image->HasMipmaps(); m++)
   {
     csRef<iImage> mip = image->GetMipmap (m);
-    if (!format->Save (out, mip)) return 0;
+    if (!mip.IsValid()) return 0;
+    images.Push (mip);
   }
   return m;
 }
@@ -210,7 +345,8 @@ csPtr<iDataBuffer> csDDSSaver::Save (csRef<iImage> image,
       && (image->GetImageType() != csimgCube)) return 0;
     ddsHead.pixelformat.flags = dds::DDPF_FOURCC;
     ddsHead.pixelformat.fourcc = MakeFourCC ('D','X','T','1');
-    saver = new FmtDXT (ImageLib::DC_DXT1, options);
+    saver = new FmtDXT (ImageLib::DC_DXT1, dds::DXTCompress::fmtDXT1, options,
+      jobQueue);
   }
   else if (format == "dxt3")
   {
@@ -218,7 +354,8 @@ csPtr<iDataBuffer> csDDSSaver::Save (csRef<iImage> image,
       && (image->GetImageType() != csimgCube)) return 0;
     ddsHead.pixelformat.flags = dds::DDPF_FOURCC;
     ddsHead.pixelformat.fourcc = MakeFourCC ('D','X','T','3');
-    saver = new FmtDXT (ImageLib::DC_DXT3, options);
+    saver = new FmtDXT (ImageLib::DC_DXT3, dds::DXTCompress::fmtDXT3, options,
+      jobQueue);
   }
   else if (format == "dxt5")
   {
@@ -226,7 +363,17 @@ csPtr<iDataBuffer> csDDSSaver::Save (csRef<iImage> image,
       && (image->GetImageType() != csimgCube)) return 0;
     ddsHead.pixelformat.flags = dds::DDPF_FOURCC;
     ddsHead.pixelformat.fourcc = MakeFourCC ('D','X','T','5');
-    saver = new FmtDXT (ImageLib::DC_DXT5, options);
+    saver = new FmtDXT (ImageLib::DC_DXT5, dds::DXTCompress::fmtDXT5, options,
+      jobQueue);
+  }
+  else if ((format == "bc5") || (format == "ati2"))
+  {
+    if ((image->GetImageType() != csimg2D) 
+      && (image->GetImageType() != csimgCube)) return 0;
+    ddsHead.pixelformat.flags = dds::DDPF_FOURCC;
+    ddsHead.pixelformat.fourcc = MakeFourCC ('A','T','I','2');
+    saver = new FmtDXT (ImageLib::DC_None, dds::DXTCompress::fmtBC5, options,
+      jobQueue);
   }
   if (!saver) return 0;
 
@@ -240,49 +387,37 @@ csPtr<iDataBuffer> csDDSSaver::Save (csRef<iImage> image,
       outFile.Write ((char*)&x, sizeof (x));
     }
   }
+  // Gather all images in file order, so they can be saved in one go
+  csRefArray<iImage> images;
   if (image->GetImageType() == csimgCube)
   {
     const uint mipcount = ddsHead.mipmapcount ? ddsHead.mipmapcount : 1;
     for (int i = 0; i < 6; i++)
     {
       if (noMipMaps)
+	images.Push (image->GetSubImage (i));
+      else if (CollectMips (images, image->GetSubImage (i)) != mipcount)
       {
-	if (!saver->Save (outFile, image->GetSubImage (i))) 
-	{
-	  delete saver;
-	  return 0;
-	}
-      }
-      else
-      {
-	if (SaveMips (outFile, image->GetSubImage (i), saver) 
-	  != mipcount)
-	{
-	  delete saver;
-	  return 0;
-	}
+	delete saver;
+	return 0;
       }
     }
   }
   else
   {
     if (noMipMaps)
+      images.Push (image);
+    else if (!CollectMips (images, image))
     {
-      if (!saver->Save (outFile, image)) 
-      {
-	delete saver;
-	return 0;
-      }
-    }
-    else
-    {
-      if (!SaveMips (outFile, image, saver)) 
-      {
-	delete saver;
-	return 0;
-      }
+      delete saver;
+      return 0;
     }
   }
+  if (!saver->SaveAll (outFile, images))
+  {
+    delete saver;
+    return 0;
+  }
   delete saver;
 
   csRef<iDataBuffer> fileData (outFile.GetAllData());
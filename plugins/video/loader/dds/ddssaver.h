@@ -22,12 +22,15 @@
 
 #include "csutil/memfile.h"
 #include "csutil/ref.h"
+#include "csutil/refarr.h"
 #include "csplugincommon/imageloader/optionsparser.h"
 #include "iutil/databuff.h"
 
 #include "ImageLib/ImageDXTC.h"
+#include "dxtcompress.h"
 
 struct iImage;
+struct iJobQueue;
 
 CS_PLUGIN_NAMESPACE_BEGIN(DDSImageIO)
 {
@@ -39,6 +42,8 @@ class csDDSSaver
   public:
     virtual ~Format() {}
     virtual bool Save (csMemFile& out, iImage* image) = 0;
+    /// Save a number of images in order; by default, calls Save() for each
+    virtual bool SaveAll (csMemFile& out, const csRefArray<iImage>& images);
   };
   class FmtB8G8R8 : public Format
   {
@@ -53,15 +58,31 @@ class csDDSSaver
   protected:
     ImageLib::DXTCMethod method;
     const csImageLoaderOptionsParser& options;
+    dds::DXTCompress::Format blockFormat;
+    dds::DXTCompress::Quality quality;
+    /// Whether ImageLib is used for compression
+    bool useImageLib;
+    iJobQueue* jobQueue;
+
+    class CompressJob;
   public:
-    FmtDXT (ImageLib::DXTCMethod method, 
-      const csImageLoaderOptionsParser& options) : method(method), 
-      options(options) {}
+    FmtDXT (ImageLib::DXTCMethod method, dds::DXTCompress::Format blockFormat,
+      const csImageLoaderOptionsParser& options, iJobQueue* jobQueue);
     virtual bool Save (csMemFile& out, iImage* image);
+    /**
+     * Compresses the blocks of all images (mipmaps, cube faces) in parallel
+     * on the job queue.
+     */
+    virtual bool SaveAll (csMemFile& out, const csRefArray<iImage>& images);
   };
 
-  uint SaveMips (csMemFile& out, iImage* image, Format* format);
+  iJobQueue* jobQueue;
+
+  uint CollectMips (csRefArray<iImage>& images, iImage* image);
 public:
+  /// \a jobQueue is used to compress DXT blocks in parallel; may be 0
+  csDDSSaver (iJobQueue* jobQueue = 0) : jobQueue (jobQueue) {}
+
   csPtr<iDataBuffer> Save (csRef<iImage> image, 
     const csImageLoaderOptionsParser& options);
 };
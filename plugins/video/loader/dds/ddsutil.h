@@ -19,6 +19,13 @@
 
 #include "csutil/csendian.h"
 
+// SSE2 is part of the x86-64 baseline; on x86 it needs to be enabled
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CS_DDS_SSE2
+#include <emmintrin.h>
+#endif
+
 CS_PLUGIN_NAMESPACE_BEGIN(DDSImageIO)
 {
 
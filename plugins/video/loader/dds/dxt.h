@@ -45,16 +45,18 @@ namespace dds
   #define COLOR565_GREEN(x)   ColorComponent(x, 6, 5)
   #define COLOR565_BLUE(x)    ColorComponent(x, 5, 0)
 
+    /**
+     * Compute the four colors of a DXT1 color block. Returns the 2 bit
+     * color indices of the 16 pixels.
+     */
     template <bool withAlpha>
-    static inline void DecodeDXT1Color (const uint8* block, Color8888* outColor)
+    static inline uint32 DecodeDXT1Palette (const uint8* block,
+                                            Color8888* colours)
     {
       uint16       color_0, color_1;
-      Color8888    colours[4];
-      uint32       bitmask;
 
       color_0 = csLittleEndian::Convert (*((uint16*)block)); 
       color_1 = csLittleEndian::Convert (*((uint16*)block+1));
-      bitmask = csLittleEndian::Convert (((uint32*)block)[1]);
 
       colours[0].r = COLOR565_RED(color_0); 
       colours[0].g = COLOR565_GREEN(color_0);
@@ -66,7 +68,8 @@ namespace dds
       colours[1].b = COLOR565_BLUE(color_1);
       colours[1].a = 0xFF;
 
-      if (withAlpha && (color_0 > color_1))
+      // Only DXT1 has the three color mode, DXT2-5 always use four colors
+      if (!withAlpha || (color_0 > color_1))
       {
         // Four-color block: derive the other two colors.
         // 00 = color_0, 01 = color_1, 10 = color_2, 11 = color_3
@@ -99,6 +102,14 @@ namespace dds
         colours[3].r = (colours[0].r + 2 * colours[1].r + 1) / 3;
         colours[3].a = 0x00;
       }
+      return csLittleEndian::Convert (((uint32*)block)[1]);
+    }
+
+    template <bool withAlpha>
+    static inline void DecodeDXT1Color (const uint8* block, Color8888* outColor)
+    {
+      Color8888    colours[4];
+      uint32       bitmask = DecodeDXT1Palette<withAlpha> (block, colours);
       
       for (int j = 0, k = 0; j < 4; j++) 
       {
@@ -0,0 +1,558 @@
+/*
+    DDS image file format support for CrystalSpace 3D library
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+#include "cssysdef.h"
+
+#include <math.h>
+
+#include "csgeom/math.h"
+
+#include "dxtcompress.h"
+#include "ddsutil.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(DDSImageIO)
+{
+namespace dds
+{
+
+  // Expand quantized components the same way the decoder does
+  static inline int Expand5 (int v) { return (v << 3) | (v >> 2); }
+  static inline int Expand6 (int v) { return (v << 2) | (v >> 4); }
+
+  /* For each 8 bit value, the pair of quantized endpoints whose first
+     interpolated color (2/3 c0 + 1/3 c1) comes closest to it. Used for
+     blocks of a single color, where the endpoints themselves would suffer
+     from the quantization error. */
+  static uint8 singleMatch5[256][2];
+  static uint8 singleMatch6[256][2];
+  static bool tablesReady = false;
+
+  static void BuildSingleMatch (uint8 (*table)[2], int size, bool six)
+  {
+    for (int v = 0; v < 256; v++)
+    {
+      int bestErr = 0x7fffffff;
+      for (int a = 0; a < size; a++)
+      {
+        const int ea = six ? Expand6 (a) : Expand5 (a);
+        for (int b = 0; b < size; b++)
+        {
+          const int eb = six ? Expand6 (b) : Expand5 (b);
+          const int interp = (2 * ea + eb + 1) / 3;
+          // Prefer close endpoints, decoders differ slightly in rounding
+          const int err = abs (interp - v) * 100 + abs (ea - eb) * 3;
+          if (err < bestErr)
+          {
+            bestErr = err;
+            table[v][0] = a;
+            table[v][1] = b;
+          }
+        }
+      }
+    }
+  }
+
+  void DXTCompress::Initialize ()
+  {
+    if (tablesReady) return;
+    BuildSingleMatch (singleMatch5, 32, false);
+    BuildSingleMatch (singleMatch6, 64, true);
+    tablesReady = true;
+  }
+
+  //-------------------------------------------------------------------------
+
+  static inline uint16 Pack565 (float r, float g, float b)
+  {
+    int ir = int (r * (31.0f / 255.0f) + 0.5f);
+    int ig = int (g * (63.0f / 255.0f) + 0.5f);
+    int ib = int (b * (31.0f / 255.0f) + 0.5f);
+    ir = csClamp (ir, 31, 0);
+    ig = csClamp (ig, 63, 0);
+    ib = csClamp (ib, 31, 0);
+    return (ir << 11) | (ig << 5) | ib;
+  }
+
+  // Colors of a four color block, computed like the decoder does
+  static void MakeColorPalette (uint16 c0, uint16 c1, float pal[3][4])
+  {
+    int e0[3], e1[3];
+    e0[0] = Expand5 (c0 >> 11); e0[1] = Expand6 ((c0 >> 5) & 63);
+    e0[2] = Expand5 (c0 & 31);
+    e1[0] = Expand5 (c1 >> 11); e1[1] = Expand6 ((c1 >> 5) & 63);
+    e1[2] = Expand5 (c1 & 31);
+    for (int c = 0; c < 3; c++)
+    {
+      pal[c][0] = float (e0[c]);
+      pal[c][1] = float (e1[c]);
+      pal[c][2] = float ((2 * e0[c] + e1[c] + 1) / 3);
+      pal[c][3] = float ((e0[c] + 2 * e1[c] + 1) / 3);
+    }
+  }
+
+  /* Pick the nearest palette color for each pixel. Returns the squared
+     error of the block, the 2 bit indices are stored in 'indices'. */
+  static float MatchColors (const float* r, const float* g, const float* b,
+                            const float pal[3][4], uint32& indices)
+  {
+    float error = 0;
+    indices = 0;
+#ifdef CS_DDS_SSE2
+    for (int i = 0; i < 16; i += 4)
+    {
+      const __m128 vr = _mm_loadu_ps (r + i);
+      const __m128 vg = _mm_loadu_ps (g + i);
+      const __m128 vb = _mm_loadu_ps (b + i);
+      __m128 best = _mm_set1_ps (1e30f);
+      __m128i bestIndex = _mm_setzero_si128 ();
+      for (int k = 0; k < 4; k++)
+      {
+        const __m128 dr = _mm_sub_ps (vr, _mm_set1_ps (pal[0][k]));
+        const __m128 dg = _mm_sub_ps (vg, _mm_set1_ps (pal[1][k]));
+        const __m128 db = _mm_sub_ps (vb, _mm_set1_ps (pal[2][k]));
+        const __m128 d = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dr, dr),
+          _mm_mul_ps (dg, dg)), _mm_mul_ps (db, db));
+        const __m128i closer = _mm_castps_si128 (_mm_cmplt_ps (d, best));
+        best = _mm_min_ps (d, best);
+        bestIndex = _mm_or_si128 (_mm_and_si128 (closer, _mm_set1_epi32 (k)),
+          _mm_andnot_si128 (closer, bestIndex));
+      }
+      float bestErr[4];
+      int32 bestIdx[4];
+      _mm_storeu_ps (bestErr, best);
+      _mm_storeu_si128 ((__m128i*)bestIdx, bestIndex);
+      for (int j = 0; j < 4; j++)
+      {
+        error += bestErr[j];
+        indices |= uint32 (bestIdx[j]) << (2 * (i + j));
+      }
+    }
+#else
+    for (int i = 0; i < 16; i++)
+    {
+      float best = 1e30f;
+      uint32 bestIndex = 0;
+      for (int k = 0; k < 4; k++)
+      {
+        const float dr = r[i] - pal[0][k];
+        const float dg = g[i] - pal[1][k];
+        const float db = b[i] - pal[2][k];
+        const float d = dr * dr + dg * dg + db * db;
+        if (d < best)
+        {
+          best = d;
+          bestIndex = k;
+        }
+      }
+      error += best;
+      indices |= bestIndex << (2 * i);
+    }
+#endif
+    return error;
+  }
+
+  /* Direction of the largest color variance in the block, found by power
+     iteration on the covariance matrix. The start vector is the extent of
+     the block with the signs of the covariance, which is already a usable
+     estimate if no iterations are done. */
+  static void PrincipalAxis (const float* r, const float* g, const float* b,
+                             int iterations, float* axis)
+  {
+    float mean[3] = { 0, 0, 0 };
+    float minC[3] = { 255, 255, 255 };
+    float maxC[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+      mean[0] += r[i]; mean[1] += g[i]; mean[2] += b[i];
+      minC[0] = csMin (minC[0], r[i]); maxC[0] = csMax (maxC[0], r[i]);
+      minC[1] = csMin (minC[1], g[i]); maxC[1] = csMax (maxC[1], g[i]);
+      minC[2] = csMin (minC[2], b[i]); maxC[2] = csMax (maxC[2], b[i]);
+    }
+    mean[0] *= 1.0f / 16; mean[1] *= 1.0f / 16; mean[2] *= 1.0f / 16;
+
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+      const float dr = r[i] - mean[0];
+      const float dg = g[i] - mean[1];
+      const float db = b[i] - mean[2];
+      cov[0] += dr * dr; cov[1] += dr * dg; cov[2] += dr * db;
+      cov[3] += dg * dg; cov[4] += dg * db; cov[5] += db * db;
+    }
+
+    axis[0] = maxC[0] - minC[0];
+    axis[1] = maxC[1] - minC[1];
+    axis[2] = maxC[2] - minC[2];
+    // Relative to the channel with the largest extent
+    if ((axis[0] >= axis[1]) && (axis[0] >= axis[2]))
+    {
+      if (cov[1] < 0) axis[1] = -axis[1];
+      if (cov[2] < 0) axis[2] = -axis[2];
+    }
+    else if (axis[1] >= axis[2])
+    {
+      if (cov[1] < 0) axis[0] = -axis[0];
+      if (cov[4] < 0) axis[2] = -axis[2];
+    }
+    else
+    {
+      if (cov[2] < 0) axis[0] = -axis[0];
+      if (cov[4] < 0) axis[1] = -axis[1];
+    }
+
+    for (int it = 0; it < iterations; it++)
+    {
+      const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+      const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+      const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+      const float m = csMax (fabsf (x), csMax (fabsf (y), fabsf (z)));
+      if (m < 1e-6f) break;
+      const float inv = 1.0f / m;
+      axis[0] = x * inv; axis[1] = y * inv; axis[2] = z * inv;
+    }
+  }
+
+  /* Least squares fit of the endpoints to the current index assignment.
+     Returns false if the system can't be solved, e.g. if all pixels use
+     the same index. */
+  static bool RefineEndpoints (const float* r, const float* g,
+                               const float* b, uint32 indices,
+                               uint16& c0, uint16& c1)
+  {
+    static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    float aa = 0, bb = 0, ab = 0;
+    float at[3] = { 0, 0, 0 };
+    float bt[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+      const float wa = weight0[(indices >> (2 * i)) & 3];
+      const float wb = 1.0f - wa;
+      aa += wa * wa; bb += wb * wb; ab += wa * wb;
+      at[0] += wa * r[i]; at[1] += wa * g[i]; at[2] += wa * b[i];
+      bt[0] += wb * r[i]; bt[1] += wb * g[i]; bt[2] += wb * b[i];
+    }
+    const float det = aa * bb - ab * ab;
+    if (fabsf (det) < 1e-6f) return false;
+    const float inv = 1.0f / det;
+
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; c++)
+    {
+      e0[c] = (at[c] * bb - bt[c] * ab) * inv;
+      e1[c] = (bt[c] * aa - at[c] * ab) * inv;
+    }
+    c0 = Pack565 (e0[0], e0[1], e0[2]);
+    c1 = Pack565 (e1[0], e1[1], e1[2]);
+    return true;
+  }
+
+  void DXTCompress::CompressColorBlock (const csRGBpixel* block, uint8* out,
+                                        Quality quality)
+  {
+    float r[16], g[16], b[16];
+    bool uniform = true;
+    for (int i = 0; i < 16; i++)
+    {
+      r[i] = block[i].red;
+      g[i] = block[i].green;
+      b[i] = block[i].blue;
+      if ((block[i].red != block[0].red) || (block[i].green != block[0].green)
+        || (block[i].blue != block[0].blue))
+        uniform = false;
+    }
+
+    uint16 c0, c1;
+    uint32 indices;
+    if (uniform)
+    {
+      const csRGBpixel& p = block[0];
+      c0 = (singleMatch5[p.red][0] << 11) | (singleMatch6[p.green][0] << 5)
+        | singleMatch5[p.blue][0];
+      c1 = (singleMatch5[p.red][1] << 11) | (singleMatch6[p.green][1] << 5)
+        | singleMatch5[p.blue][1];
+      // All pixels use the first interpolated color
+      indices = 0xaaaaaaaa;
+    }
+    else
+    {
+      static const int axisIterations[3] = { 0, 4, 8 };
+      static const int refinements[3] = { 0, 1, 3 };
+
+      float axis[3];
+      PrincipalAxis (r, g, b, axisIterations[quality], axis);
+
+      // The pixels furthest apart along the axis become the endpoints
+      int minIndex = 0, maxIndex = 0;
+      float minDot = 1e30f, maxDot = -1e30f;
+      for (int i = 0; i < 16; i++)
+      {
+        const float d = r[i] * axis[0] + g[i] * axis[1] + b[i] * axis[2];
+        if (d < minDot) { minDot = d; minIndex = i; }
+        if (d > maxDot) { maxDot = d; maxIndex = i; }
+      }
+      float e0[3] = { r[maxIndex], g[maxIndex], b[maxIndex] };
+      float e1[3] = { r[minIndex], g[minIndex], b[minIndex] };
+      if (quality != qualityFast)
+      {
+        // Inset the endpoints a bit, outliers are rarely worth reaching
+        for (int c = 0; c < 3; c++)
+        {
+          const float inset = (e0[c] - e1[c]) * (1.0f / 16.0f);
+          e0[c] -= inset;
+          e1[c] += inset;
+        }
+      }
+      c0 = Pack565 (e0[0], e0[1], e0[2]);
+      c1 = Pack565 (e1[0], e1[1], e1[2]);
+
+      float pal[3][4];
+      MakeColorPalette (c0, c1, pal);
+      float error = MatchColors (r, g, b, pal, indices);
+
+      for (int n = 0; n < refinements[quality]; n++)
+      {
+        uint16 n0, n1;
+        if (!RefineEndpoints (r, g, b, indices, n0, n1)) break;
+        if ((n0 == c0) && (n1 == c1)) break;
+        uint32 newIndices;
+        MakeColorPalette (n0, n1, pal);
+        const float newError = MatchColors (r, g, b, pal, newIndices);
+        if (newError >= error) break;
+        c0 = n0; c1 = n1;
+        indices = newIndices;
+        error = newError;
+      }
+    }
+
+    // The four color mode requires c0 > c1
+    if (c0 < c1)
+    {
+      uint16 t = c0; c0 = c1; c1 = t;
+      // Swaps 0 <-> 1 and 2 <-> 3
+      indices ^= 0x55555555;
+    }
+    else if (c0 == c1)
+      indices = 0;
+
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    out[4] = indices & 0xff; out[5] = (indices >> 8) & 0xff;
+    out[6] = (indices >> 16) & 0xff; out[7] = indices >> 24;
+  }
+
+  //-------------------------------------------------------------------------
+
+  // Values of an alpha block, computed like the decoder does
+  static void MakeAlphaPalette (int a0, int a1, int* pal)
+  {
+    pal[0] = a0;
+    pal[1] = a1;
+    if (a0 > a1)
+    {
+      for (int i = 1; i < 7; i++)
+        pal[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+    }
+    else
+    {
+      for (int i = 1; i < 5; i++)
+        pal[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+      pal[6] = 0;
+      pal[7] = 255;
+    }
+  }
+
+  /* Pick the nearest palette value for each of the 16 values. Returns the
+     squared error, the 3 bit indices are stored in 'indices'. */
+  static int MatchAlpha (const uint8* values, const int* pal,
+                         uint64& indices)
+  {
+    int error = 0;
+    indices = 0;
+#ifdef CS_DDS_SSE2
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i v = _mm_loadu_si128 ((const __m128i*)values);
+    const __m128i vLo = _mm_unpacklo_epi8 (v, zero);
+    const __m128i vHi = _mm_unpackhi_epi8 (v, zero);
+    __m128i bestLo = _mm_set1_epi16 (0x7fff);
+    __m128i bestHi = bestLo;
+    __m128i indexLo = zero;
+    __m128i indexHi = zero;
+    for (int k = 0; k < 8; k++)
+    {
+      const __m128i p = _mm_set1_epi16 ((short)pal[k]);
+      const __m128i k16 = _mm_set1_epi16 ((short)k);
+      const __m128i dLo = _mm_max_epi16 (_mm_sub_epi16 (vLo, p),
+        _mm_sub_epi16 (p, vLo));
+      const __m128i dHi = _mm_max_epi16 (_mm_sub_epi16 (vHi, p),
+        _mm_sub_epi16 (p, vHi));
+      const __m128i closerLo = _mm_cmplt_epi16 (dLo, bestLo);
+      const __m128i closerHi = _mm_cmplt_epi16 (dHi, bestHi);
+      bestLo = _mm_min_epi16 (dLo, bestLo);
+      bestHi = _mm_min_epi16 (dHi, bestHi);
+      indexLo = _mm_or_si128 (_mm_and_si128 (closerLo, k16),
+        _mm_andnot_si128 (closerLo, indexLo));
+      indexHi = _mm_or_si128 (_mm_and_si128 (closerHi, k16),
+        _mm_andnot_si128 (closerHi, indexHi));
+    }
+    // Sum of squared differences
+    const __m128i sq = _mm_add_epi32 (_mm_madd_epi16 (bestLo, bestLo),
+      _mm_madd_epi16 (bestHi, bestHi));
+    int32 sums[4];
+    _mm_storeu_si128 ((__m128i*)sums, sq);
+    error = sums[0] + sums[1] + sums[2] + sums[3];
+
+    int16 idx[16];
+    _mm_storeu_si128 ((__m128i*)idx, indexLo);
+    _mm_storeu_si128 ((__m128i*)(idx + 8), indexHi);
+    for (int i = 0; i < 16; i++)
+      indices |= uint64 (idx[i]) << (3 * i);
+#else
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0x7fff;
+      uint64 bestIndex = 0;
+      for (int k = 0; k < 8; k++)
+      {
+        const int d = abs (int (values[i]) - pal[k]);
+        if (d < best)
+        {
+          best = d;
+          bestIndex = k;
+        }
+      }
+      error += best * best;
+      indices |= bestIndex << (3 * i);
+    }
+#endif
+    return error;
+  }
+
+  void DXTCompress::CompressAlphaBlock (const uint8* values, uint8* out,
+                                        Quality quality)
+  {
+    int minV = 255, maxV = 0;
+    // Extremes without the values the six value mode represents exactly
+    int min6 = 255, max6 = 0;
+    for (int i = 0; i < 16; i++)
+    {
+      const int v = values[i];
+      minV = csMin (minV, v);
+      maxV = csMax (maxV, v);
+      if ((v != 0) && (v != 255))
+      {
+        min6 = csMin (min6, v);
+        max6 = csMax (max6, v);
+      }
+    }
+
+    int a0 = maxV, a1 = minV;
+    uint64 indices = 0;
+    if (minV != maxV)
+    {
+      int pal[8];
+      MakeAlphaPalette (a0, a1, pal);
+      int error = MatchAlpha (values, pal, indices);
+
+      // Blocks with fully transparent or opaque pixels next to others may
+      // be represented better by the six value mode
+      if ((quality == qualityHigh) && ((minV == 0) || (maxV == 255)))
+      {
+        if (min6 > max6) min6 = max6 = 0;
+        uint64 indices6;
+        MakeAlphaPalette (min6, max6, pal);
+        const int error6 = MatchAlpha (values, pal, indices6);
+        if (error6 < error)
+        {
+          a0 = min6;
+          a1 = max6;
+          indices = indices6;
+        }
+      }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (int i = 0; i < 6; i++)
+      out[2 + i] = uint8 (indices >> (8 * i));
+  }
+
+  void DXTCompress::CompressExplicitAlphaBlock (const csRGBpixel* block,
+                                                uint8* out)
+  {
+    for (int i = 0; i < 8; i++)
+    {
+      const int lo = (block[i * 2].alpha * 15 + 127) / 255;
+      const int hi = (block[i * 2 + 1].alpha * 15 + 127) / 255;
+      out[i] = lo | (hi << 4);
+    }
+  }
+
+  //-------------------------------------------------------------------------
+
+  void DXTCompress::CompressRows (Format format, Quality quality,
+                                  const csRGBpixel* image, int w, int h,
+                                  int firstRow, int numRows, uint8* out)
+  {
+    const int blocksX = (w + 3) / 4;
+    const size_t blockSize = BlockSize (format);
+    csRGBpixel block[16];
+    uint8 values[16];
+
+    for (int by = firstRow; by < firstRow + numRows; by++)
+    {
+      for (int bx = 0; bx < blocksX; bx++)
+      {
+        // Gather the block, repeating edge pixels
+        for (int y = 0; y < 4; y++)
+        {
+          const int py = csMin (by * 4 + y, h - 1);
+          const csRGBpixel* row = image + py * w;
+          for (int x = 0; x < 4; x++)
+            block[y * 4 + x] = row[csMin (bx * 4 + x, w - 1)];
+        }
+
+        switch (format)
+        {
+          case fmtDXT1:
+            CompressColorBlock (block, out, quality);
+            break;
+          case fmtDXT3:
+            CompressExplicitAlphaBlock (block, out);
+            CompressColorBlock (block, out + 8, quality);
+            break;
+          case fmtDXT5:
+            for (int i = 0; i < 16; i++) values[i] = block[i].alpha;
+            CompressAlphaBlock (values, out, quality);
+            CompressColorBlock (block, out + 8, quality);
+            break;
+          case fmtBC5:
+            for (int i = 0; i < 16; i++) values[i] = block[i].red;
+            CompressAlphaBlock (values, out, quality);
+            for (int i = 0; i < 16; i++) values[i] = block[i].green;
+            CompressAlphaBlock (values, out + 8, quality);
+            break;
+        }
+        out += blockSize;
+      }
+    }
+  }
+
+} // end of namespace dds
+}
+CS_PLUGIN_NAMESPACE_END(DDSImageIO)
@@ -0,0 +1,94 @@
+/*
+    DDS image file format support for CrystalSpace 3D library
+    Copyright (C) 2010 by the Crystal Space team
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public
+    License along with this library; if not, write to the Free
+    Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef __CS_DDS_DXTCOMPRESS_H__
+#define __CS_DDS_DXTCOMPRESS_H__
+
+#include "csgfx/rgbpixel.h"
+
+CS_PLUGIN_NAMESPACE_BEGIN(DDSImageIO)
+{
+namespace dds
+{
+
+  /**
+   * Block compressor for DXT1, DXT3, DXT5 (BC1-3) and ATI2 (BC5).
+   * Blocks are independent of each other, so any number of block rows can
+   * be compressed concurrently.
+   */
+  struct DXTCompress
+  {
+    enum Format
+    {
+      fmtDXT1,
+      fmtDXT3,
+      fmtDXT5,
+      /// Two channel format, red and green are stored
+      fmtBC5
+    };
+
+    enum Quality
+    {
+      /// Endpoints from a single principal axis estimate
+      qualityFast,
+      /// Principal axis fit and one least squares refinement
+      qualityNormal,
+      /// Tighter axis fit, several refinements, more alpha modes
+      qualityHigh
+    };
+
+    /// Size of one compressed block in bytes
+    static size_t BlockSize (Format format)
+    { return (format == fmtDXT1) ? 8 : 16; }
+
+    /// Size of a compressed image in bytes
+    static size_t ImageSize (Format format, int w, int h)
+    { return BlockSize (format) * ((w + 3) / 4) * ((h + 3) / 4); }
+
+    /**
+     * Set up lookup tables. Must be called once before blocks are
+     * compressed, and not concurrently with compression.
+     */
+    static void Initialize ();
+
+    /**
+     * Compress \a numRows block rows of an image, starting with \a firstRow.
+     * \a out points to the first block of the first row. Blocks overlapping
+     * the image border are padded by repeating the edge pixels.
+     */
+    static void CompressRows (Format format, Quality quality,
+      const csRGBpixel* image, int w, int h, int firstRow, int numRows,
+      uint8* out);
+
+    /// Compress a 4x4 block of opaque colors into a DXT1 color block
+    static void CompressColorBlock (const csRGBpixel* block, uint8* out,
+      Quality quality);
+    /// Compress 16 values into a DXT5 alpha (BC4) block
+    static void CompressAlphaBlock (const uint8* values, uint8* out,
+      Quality quality);
+    /// Compress the alpha of a 4x4 block into a DXT3 explicit alpha block
+    static void CompressExplicitAlphaBlock (const csRGBpixel* block,
+      uint8* out);
+  };
+
+} // end of namespace dds
+}
+CS_PLUGIN_NAMESPACE_END(DDSImageIO)
+
+#endif // __CS_DDS_DXTCOMPRESS_H__
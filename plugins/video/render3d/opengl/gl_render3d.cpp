@@ -4195,5 +4195,45 @@ int csGLGraphics3D::GetCurrentDrawFlags () const
   return current_drawflags;
 }
 
+////////////////////////////////////////////////////////////////////
+//                         iScreenReadback
+////////////////////////////////////////////////////////////////////
+
+csPtr<iDataBuffer> csGLGraphics3D::ReadbackScreen (int& width, int& height)
+{
+  G2D->PerformExtension ("glflushtext");
+
+  width = G2D->GetWidth ();
+  height = G2D->GetHeight ();
+  const size_t readbackSize = width * height * 4;
+
+  csRef<iDataBuffer> db;
+  if (ext->CS_GL_ARB_pixel_buffer_object)
+  {
+    // The transfer into the PBO happens asynchronously
+    csRef<PBOWrapper> pbo = txtmgr->GetPBOWrapper (readbackSize);
+    GLuint _pbo = pbo->GetPBO (GL_PIXEL_PACK_BUFFER_ARB);
+    statecache->SetBufferARB (GL_PIXEL_PACK_BUFFER_ARB, _pbo, true);
+    glReadPixels (0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    statecache->SetBufferARB (GL_PIXEL_PACK_BUFFER_ARB, 0, true);
+
+#include "csutil/custom_new_disable.h"
+    db.AttachNew (new (txtmgr->pboTextureReadbacks) TextureReadbackPBO (
+      pbo, readbackSize));
+#include "csutil/custom_new_enable.h"
+  }
+  else
+  {
+    void* data = cs_malloc (readbackSize);
+    glReadPixels (0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+
+#include "csutil/custom_new_disable.h"
+    db.AttachNew (new (txtmgr->simpleTextureReadbacks) TextureReadbackSimple (
+      data, readbackSize));
+#include "csutil/custom_new_enable.h"
+  }
+  return csPtr<iDataBuffer> (db);
+}
+
 }
 CS_PLUGIN_NAMESPACE_END(gl3d)
@@ -32,6 +32,7 @@
 #include "iutil/eventh.h"
 #include "ivideo/graph3d.h"
 #include "ivideo/halo.h"
+#include "ivideo/screenreadback.h"
 
 #include "csgeom/csrect.h"
 #include "csgeom/poly3d.h"
@@ -189,10 +190,11 @@ public:
 // To silence EnableZOffset/DisableZOffset
 #include "csutil/deprecated_warn_off.h"
 
-class csGLGraphics3D : public scfImplementation3<csGLGraphics3D, 
+class csGLGraphics3D : public scfImplementation4<csGLGraphics3D, 
 						 iGraphics3D,
 						 iComponent,
-						 iDebugHelper>
+						 iDebugHelper,
+						 iScreenReadback>
 {
 private:
   //friend declarations
@@ -874,6 +876,11 @@ public:
   { return 0; }
   virtual void Dump (iGraphics3D* /*g3d*/)
   { }
+
+  ////////////////////////////////////////////////////////////////////
+  //                         iScreenReadback
+  ////////////////////////////////////////////////////////////////////
+  virtual csPtr<iDataBuffer> ReadbackScreen (int& width, int& height);
 };
 
 // To silence EnableZOffset/DisableZOffset
@@ -39,12 +39,13 @@ CS_PLUGIN_NAMESPACE_BEGIN(ShaderWeaver)
 
 class WeaverCompiler;
 
-class WeaverShader : public scfImplementationExt4<WeaverShader,
+class WeaverShader : public scfImplementationExt5<WeaverShader,
 						  csObject,
 						  iShader,
 						  iSelfDestruct,
 						  iXMLShader,
-						  iXMLShaderInternal>
+						  iXMLShaderInternal,
+						  iShaderWarmUp>
 {
   csRef<WeaverCompiler> compiler;
   csRef<iShaderManager> shadermgr;
@@ -120,6 +121,12 @@ public:
     return realShader->GetTicket (modes, stack);
   }
 
+  virtual bool TryGetTicket (const CS::Graphics::RenderMeshModes& modes,
+      const csShaderVariableStack& stack, size_t& ticket)
+  {
+    return realShader->TryGetTicket (modes, stack, ticket);
+  }
+
   virtual size_t GetNumberOfPasses (size_t ticket)
   {
     return realShader->GetNumberOfPasses (ticket);
@@ -201,6 +208,11 @@ public:
     return realShader->GetVariable (name);
   }
 
+  csShaderVariable* GetVariableAdd (CS::ShaderVarStringID name)
+  { 
+    return realShader->GetVariableAdd (name);
+  }
+
   const csRefArray<csShaderVariable>& GetShaderVariables () const
   { 
     return realShader->GetShaderVariables ();
@@ -256,6 +268,29 @@ public:
       : (size_t)~0;
   }
   /** @} */
+
+  /**\name iShaderWarmUp implementation
+   * @{ */
+  virtual void QueueWarmUp (const CS::Graphics::RenderMeshModes& modes,
+    const csShaderVariableStack& stack, int maxLights)
+  {
+    csRef<iShaderWarmUp> warmUp = scfQueryInterfaceSafe<iShaderWarmUp> (
+      realShader);
+    if (warmUp.IsValid()) warmUp->QueueWarmUp (modes, stack, maxLights);
+  }
+  virtual void StartWarmUp (iJobQueue* jobQueue)
+  {
+    csRef<iShaderWarmUp> warmUp = scfQueryInterfaceSafe<iShaderWarmUp> (
+      realShader);
+    if (warmUp.IsValid()) warmUp->StartWarmUp (jobQueue);
+  }
+  virtual void FinishWarmUp ()
+  {
+    csRef<iShaderWarmUp> warmUp = scfQueryInterfaceSafe<iShaderWarmUp> (
+      realShader);
+    if (warmUp.IsValid()) warmUp->FinishWarmUp ();
+  }
+  /** @} */
 public:
   csStringHash& xmltokens;
 };
@@ -80,12 +80,17 @@ static void SetSizeFill1 (T& array, size_t newSize)
 
 csConditionEvaluator::csConditionEvaluator (iShaderVarStringSet* strings,
   const csConditionConstants& constants) :
-  strings(strings), ticketEvalPool (0),
-  evalStatePool (0), constants(constants)
+  strings(strings), constants(constants), affectionMasksSize (0)
 {
 }
 
 csConditionEvaluator::~csConditionEvaluator ()
+{
+  for (size_t i = 0; i < allThreadStates.GetSize(); i++)
+    delete allThreadStates[i];
+}
+
+csConditionEvaluator::ThreadState::~ThreadState ()
 {
   while (ticketEvalPool != 0)
   {
@@ -101,6 +106,19 @@ csConditionEvaluator::~csConditionEvaluator ()
   }
 }
 
+csConditionEvaluator::ThreadState* csConditionEvaluator::GetThreadState ()
+{
+  ThreadState* state = threadState;
+  if (state == 0)
+  {
+    state = new ThreadState;
+    threadState = state;
+    CS::Threading::MutexScopedLock lock (allThreadStatesLock);
+    allThreadStates.Push (state);
+  }
+  return state;
+}
+
 size_t* csConditionEvaluator::AllocSVIndices (size_t num)
 {
   if (num == 0) return 0;
@@ -887,10 +905,33 @@ bool csConditionEvaluator::IsConditionPartOf (csConditionID condition,
    thus may result in incorrect use of a cached eval result. */
 static const csShaderVariable definitelyUniqueSV;
 
-void csConditionEvaluator::SetupEvalCacheInternal (const csShaderVariableStack* stack)
+void csConditionEvaluator::GrowAffectionMasksInternal ()
+{
+  const size_t numConditions = conditions.GetNumConditions ();
+  for (size_t i = 0; i < svAffectedConditions.GetSize(); i++)
+  {
+    MyBitArrayMalloc& bits = svAffectedConditions[i].affectedConditions;
+    if (bits.GetSize() < numConditions)
+      SetSizeFill1 (bits, numConditions);
+  }
+  if (bufferAffectConditions.GetSize() < numConditions)
+    SetSizeFill1 (bufferAffectConditions, numConditions);
+  affectionMasksSize = numConditions;
+}
+
+void csConditionEvaluator::SetupEvalCacheInternal (EvalCacheState& evalCache,
+                                                   const csShaderVariableStack* stack)
 {
   if (stack != 0)
   {
+    /* The affection masks were grown to the number of conditions before,
+     * so only the cache may need to be grown */
+    if (evalCache.condChecked.GetSize() != affectionMasksSize)
+    {
+      evalCache.condChecked.SetSize (affectionMasksSize);
+      evalCache.condResult.SetSize (affectionMasksSize);
+    }
+
     if (evalCache.lastShaderVars.GetSize() != svAffectedConditions.GetSize())
     {
       evalCache.lastShaderVars.DeleteAll();
@@ -900,39 +941,18 @@ void csConditionEvaluator::SetupEvalCacheInternal (const csShaderVariableStack*
 	
     for (size_t i = 0; i < svAffectedConditions.GetSize(); i++)
     {
-      SVAffection& affection = svAffectedConditions[i];
+      const SVAffection& affection = svAffectedConditions[i];
       csShaderVariable* sv = (affection.svName < stack->GetSize()) ?
 	(*stack)[affection.svName] : 0;
       if (evalCache.lastShaderVars[i] != sv)
       {
-	if (affection.affectedConditions.GetSize() != evalCache.condChecked.GetSize())
-	{
-	  /* Sometimes the affected conditions mask is bigger,
-	   * sometimes the condition checked mask - the former can happen
-	   * when a fallback shader or new tech is loaded that uses hitherto
-	   * unknown conditions */
-	  size_t newCondSize = csMax (affection.affectedConditions.GetSize(),
-	    evalCache.condChecked.GetSize());
-	  SetSizeFill1 (affection.affectedConditions, newCondSize);
-	  evalCache.condChecked.SetSize (newCondSize);
-	  evalCache.condResult.SetSize (newCondSize);
-	}
 	evalCache.condChecked &= affection.affectedConditions;
 	evalCache.lastShaderVars[i] = sv;
       }
     }
     /* Checking against last buffer value is expensive, so just mask all
        conditions depending on buffer values */
-    MyBitArrayMalloc& bitarray = bufferAffectConditions;
-    if (bitarray.GetSize() != evalCache.condChecked.GetSize())
-    {
-      size_t newCondSize = csMax (bitarray.GetSize(),
-	evalCache.condChecked.GetSize());
-      SetSizeFill1 (bitarray, newCondSize);
-      evalCache.condChecked.SetSize (newCondSize);
-      evalCache.condResult.SetSize (newCondSize);
-    }
-    evalCache.condChecked &= bitarray;
+    evalCache.condChecked &= bufferAffectConditions;
   }
 }
 
@@ -941,23 +961,37 @@ csPtr<csConditionEvaluator::TicketEvaluator> csConditionEvaluator::BeginTicketEv
   const CS::Graphics::RenderMeshModes& modes,
   const csShaderVariableStack* stack)
 {
-  mutex.Lock();
+  mutex.ReadLock();
+  while (affectionMasksSize != conditions.GetNumConditions ())
+  {
+    /* Conditions were added since the last evaluation; the masks can only
+       be grown while no other evaluation is running. */
+    mutex.ReadUnlock();
+    {
+      LockType lock (mutex);
+      GrowAffectionMasksInternal ();
+    }
+    mutex.ReadLock();
+  }
 
+  ThreadState* state = GetThreadState ();
+  EvalCacheState& evalCache = state->evalCache;
   EvalState* evalState = &evalCache;
   EvaluatorShadervar eval (*this, evalState, &modes, stack);
   
   void* newp;
-  if (ticketEvalPool != 0)
+  if (state->ticketEvalPool != 0)
   {
-    newp = ticketEvalPool;
-    ticketEvalPool = ticketEvalPool->poolNext;
+    newp = state->ticketEvalPool;
+    state->ticketEvalPool = state->ticketEvalPool->poolNext;
   }
   else
   {
     newp = cs_malloc (sizeof (TicketEvaluator));
   }
 #include "csutil/custom_new_disable.h"
-  TicketEvaluator* newEval = new (newp) TicketEvaluator (this, true, evalState, eval);
+  TicketEvaluator* newEval = new (newp) TicketEvaluator (this, state, true,
+    evalState, eval);
 #include "csutil/custom_new_enable.h"
   {
     uint currentFrame = ~0;
@@ -972,7 +1006,7 @@ csPtr<csConditionEvaluator::TicketEvaluator> csConditionEvaluator::BeginTicketEv
       evalCache.lastEvalFrame = currentFrame;
     }
   }
-  SetupEvalCacheInternal (stack);
+  SetupEvalCacheInternal (evalCache, stack);
   
   return csPtr<TicketEvaluator> (newEval);
 }
@@ -981,11 +1015,12 @@ csPtr<csConditionEvaluator::TicketEvaluator> csConditionEvaluator::BeginTicketEv
   const csBitArray& condSet,
   const csBitArray& condResults)
 {
+  ThreadState* state = GetThreadState ();
   EvalState* evalState;
-  if (evalStatePool != 0)
+  if (state->evalStatePool != 0)
   {
-    evalState = evalStatePool;
-    evalStatePool = evalStatePool->poolNext;
+    evalState = state->evalStatePool;
+    state->evalStatePool = state->evalStatePool->poolNext;
   }
   else
   {
@@ -1015,17 +1050,18 @@ csPtr<csConditionEvaluator::TicketEvaluator> csConditionEvaluator::BeginTicketEv
   EvaluatorShadervar eval (*this, evalState, 0, 0);
   
   void* newp;
-  if (ticketEvalPool != 0)
+  if (state->ticketEvalPool != 0)
   {
-    newp = ticketEvalPool;
-    ticketEvalPool = ticketEvalPool->poolNext;
+    newp = state->ticketEvalPool;
+    state->ticketEvalPool = state->ticketEvalPool->poolNext;
   }
   else
   {
     newp = cs_malloc (sizeof (TicketEvaluator));
   }
 #include "csutil/custom_new_disable.h"
-  TicketEvaluator* newEval = new (newp) TicketEvaluator (this, false, evalState, eval);
+  TicketEvaluator* newEval = new (newp) TicketEvaluator (this, state, false,
+    evalState, eval);
 #include "csutil/custom_new_enable.h"
 
   return csPtr<TicketEvaluator> (newEval);
@@ -1583,33 +1619,35 @@ Logic3 csConditionEvaluator::CheckConditionResults (
   return CheckConditionResultsInternal (condition, vars, trueVars, falseVars);
 }
 
-  void csConditionEvaluator::RecycleTicketEvaluator (TicketEvaluator* p)
+  void csConditionEvaluator::RecycleTicketEvaluator (ThreadState* state,
+                                                     TicketEvaluator* p)
   {
-    p->poolNext = ticketEvalPool;
-    ticketEvalPool = p;
+    p->poolNext = state->ticketEvalPool;
+    state->ticketEvalPool = p;
   }
 
-  void csConditionEvaluator::RecycleEvalState (EvalState* p)
+  void csConditionEvaluator::RecycleEvalState (ThreadState* state,
+                                               EvalState* p)
   {
-    if (p == &evalCache) return;
-    p->poolNext = evalStatePool;
-    evalStatePool = p;
+    if (p == &state->evalCache) return;
+    p->poolNext = state->evalStatePool;
+    state->evalStatePool = p;
   }
 
 //---------------------------------------------------------------------------
 
   csConditionEvaluator::TicketEvaluator::TicketEvaluator (
-    csConditionEvaluator* owner, bool hasLock,
+    csConditionEvaluator* owner, ThreadState* threadState, bool hasLock,
       EvalState* evalState, EvaluatorShadervar& eval)
-    : owner (owner), mutex (owner->mutex), inEval (true), hasLock (hasLock),
-      evalState (evalState), eval (eval)
+    : owner (owner), mutex (owner->mutex), threadState (threadState),
+      inEval (true), hasLock (hasLock), evalState (evalState), eval (eval)
   {
   }
   
   csConditionEvaluator::TicketEvaluator::~TicketEvaluator()
   {
     EndEvaluation();
-    owner->RecycleEvalState (evalState);
+    RecycleEvalState (threadState, evalState);
   }
   
   void csConditionEvaluator::TicketEvaluator::DecRef ()
@@ -1618,9 +1656,9 @@ Logic3 csConditionEvaluator::CheckConditionResults (
     ref_count--;
     if (ref_count <= 0)
     {
-      csConditionEvaluator* _owner = owner;
+      ThreadState* _threadState = threadState;
       this->~TicketEvaluator();
-      _owner->RecycleTicketEvaluator (this);
+      RecycleTicketEvaluator (_threadState, this);
     }
   }
   
@@ -1635,7 +1673,7 @@ Logic3 csConditionEvaluator::CheckConditionResults (
   {
     if (inEval)
     {
-      if (hasLock) mutex.Unlock();
+      if (hasLock) mutex.ReadUnlock();
     }
     inEval = false;
   }
@@ -23,6 +23,8 @@
 #include "csplugincommon/shader/shadercachehelper.h"
 #include "csutil/hashr.h"
 #include "csutil/memfile.h"
+#include "csutil/threading/rwmutex.h"
+#include "csutil/threading/tls.h"
 #include "csutil/weakref.h"
 #include "csgfx/shadervararrayhelper.h"
 #include "csgfx/shadervarnameparser.h"
@@ -61,16 +63,22 @@ struct EvaluatorShadervarValuesSimple;
 /**
  * Processes an expression tree and converts it into an internal 
  * representation and allows later evaluation of this expression.
+ *
+ * Ticket evaluations may run concurrently on several threads: the
+ * conditions are only read during an evaluation, and evaluation caches are
+ * kept per thread.
  */
 class csConditionEvaluator :
   public csRefCount,
   public CS::Memory::CustomAllocated
 {
-  typedef CS::Threading::Mutex MutexType;
-  typedef CS::Threading::ScopedLock<MutexType> LockType;
+  typedef CS::Threading::ReadWriteMutex MutexType;
+  typedef CS::Threading::ScopedWriteLock LockType;
+  typedef CS::Threading::ScopedReadLock ReadLockType;
   mutable MutexType mutex;
 
   struct EvalState;
+  struct ThreadState;
   struct EvaluatorShadervar
   {
     typedef bool EvalResult;
@@ -138,15 +146,20 @@ public:
       TicketEvaluator* poolNext;
     };
     MutexType& mutex;
+    ThreadState* threadState;
     bool inEval : 1;
     bool hasLock : 1;
     EvalState* evalState;
     EvaluatorShadervar eval;
     
-    TicketEvaluator (csConditionEvaluator* owner, bool hasLock,
-      EvalState* evalState, EvaluatorShadervar& eval);
+    TicketEvaluator (csConditionEvaluator* owner, ThreadState* threadState,
+      bool hasLock, EvalState* evalState, EvaluatorShadervar& eval);
     ~TicketEvaluator();
   public:
+    /**
+     * Release the evaluator.
+     * \remarks Must happen on the thread the evaluator was created on.
+     */
     void DecRef ();
     
     /// Evaluate a condition and return the result.
@@ -187,12 +200,24 @@ private:
     EvalCacheState() { Clear(); }
     void Clear() { lastEvalFrame = ~0; EvalState::Clear(); }
   };
-  EvalCacheState evalCache;
+  /// Evaluation cache and pooled objects of one thread
+  struct ThreadState : public CS::Memory::CustomAllocated
+  {
+    EvalCacheState evalCache;
+    TicketEvaluator* ticketEvalPool;
+    EvalState* evalStatePool;
+
+    ThreadState() : ticketEvalPool (0), evalStatePool (0) {}
+    ~ThreadState();
+  };
+  CS::Threading::ThreadLocal<ThreadState*> threadState;
+  /// All thread states, for cleanup
+  csArray<ThreadState*> allThreadStates;
+  CS::Threading::Mutex allThreadStatesLock;
+  ThreadState* GetThreadState ();
   
-  TicketEvaluator* ticketEvalPool;
-  void RecycleTicketEvaluator (TicketEvaluator* p);
-  EvalState* evalStatePool;
-  void RecycleEvalState (EvalState* p);
+  static void RecycleTicketEvaluator (ThreadState* state, TicketEvaluator* p);
+  static void RecycleEvalState (ThreadState* state, EvalState* p);
   
   csMemoryPool scratch;
 
@@ -214,6 +239,13 @@ private:
   };
   csSafeCopyArray<SVAffection> svAffectedConditions;
   MyBitArrayMalloc bufferAffectConditions;
+  /**
+   * Number of conditions the affection masks were grown to. The masks are
+   * shared by the evaluations on all threads, so they're only grown with a
+   * write lock held and before an evaluation starts.
+   */
+  size_t affectionMasksSize;
+  void GrowAffectionMasksInternal ();
 
   csString lastError;
   const char* SetLastError (const char* msg, ...) CS_GNUC_PRINTF (2, 3);
@@ -255,7 +287,8 @@ private:
   size_t* AllocSVIndicesInternal (size_t num);
   const char* ProcessExpressionInternal (csExpression* expression, 
     csConditionID& cond);
-  void SetupEvalCacheInternal (const csShaderVariableStack* stack);
+  void SetupEvalCacheInternal (EvalCacheState& evalCache,
+    const csShaderVariableStack* stack);
   bool EvaluateCachedInternal (EvalState* evalState, EvaluatorShadervar& eval,
     csConditionID condition);
   Logic3 CheckConditionResultsInternal (csConditionID condition,
@@ -287,7 +320,8 @@ public:
 
   /**
    * Create an evaluator object with the given parameters.
-   * \warning Locks the csConditionEvaluator until evaluation was ended!
+   * \warning Prevents changes to the csConditionEvaluator until evaluation
+   *   was ended! Evaluations on other threads can run at the same time.
    */
   csPtr<TicketEvaluator> BeginTicketEvaluationCaching (const CS::Graphics::RenderMeshModes& modes,
     const csShaderVariableStack* stack);
@@ -300,7 +334,7 @@ public:
   /// Get number of conditions allocated so far
   size_t GetNumConditions()
   { 
-    LockType lock (mutex);
+    ReadLockType lock (mutex);
     return conditions.GetNumConditions(); 
   }
 
@@ -326,7 +360,7 @@ public:
   
   CondOperation GetCondition (csConditionID condition)
   { 
-    LockType lock (mutex);
+    ReadLockType lock (mutex);
     return conditions.GetCondition (condition);
   }
 
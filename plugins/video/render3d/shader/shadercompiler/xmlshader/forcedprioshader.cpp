@@ -37,6 +37,11 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
     return parentShader->GetVariable (name);
   }
   
+  csShaderVariable* ForcedPriorityShader::GetVariableAdd (CS::ShaderVarStringID name)
+  {
+    return parentShader->GetVariableAdd (name);
+  }
+  
   const csRefArray<csShaderVariable>& ForcedPriorityShader::GetShaderVariables () const
   {
     return parentShader->GetShaderVariables();
@@ -83,6 +88,13 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
     return parentShader->GetTicketForTech (modes, stack, techNum);
   }
   
+  bool ForcedPriorityShader::TryGetTicket (
+    const CS::Graphics::RenderMeshModes& modes,
+    const csShaderVariableStack& stack, size_t& ticket)
+  {
+    return parentShader->TryGetTicketForTech (modes, stack, techNum, ticket);
+  }
+  
   size_t ForcedPriorityShader::GetNumberOfPasses (size_t ticket)
   {
     return parentShader->GetNumberOfPasses (ticket);
@@ -34,6 +34,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
   
     void AddVariable (csShaderVariable *variable);
     csShaderVariable* GetVariable (CS::ShaderVarStringID name) const;
+    csShaderVariable* GetVariableAdd (CS::ShaderVarStringID name);
     const csRefArray<csShaderVariable>& GetShaderVariables () const;
     void PushVariables (csShaderVariableStack& stack) const;
     bool IsEmpty() const;
@@ -48,6 +49,8 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
     
     size_t GetTicket (const CS::Graphics::RenderMeshModes& modes,
       const csShaderVariableStack& stack);
+    bool TryGetTicket (const CS::Graphics::RenderMeshModes& modes,
+      const csShaderVariableStack& stack, size_t& ticket);
     
     size_t GetNumberOfPasses (size_t ticket);
     bool ActivatePass (size_t ticket, size_t number);
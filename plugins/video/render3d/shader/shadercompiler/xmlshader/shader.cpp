@@ -193,9 +193,10 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
     variantIDs.Empty();
   }
 
-  size_t csShaderConditionResolver::GetVariant ()
+  size_t csShaderConditionResolver::GetVariant (
+    csConditionEvaluator::TicketEvaluator* eval) const
   {
-    CS_ASSERT(currentEval != 0);
+    CS_ASSERT(eval != 0);
 
     if (rootNode == 0)
     {
@@ -209,7 +210,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
       while (nextRoot != 0)
       {
         currentRoot = nextRoot;
-        if (currentEval->Evaluate (currentRoot->condition))
+        if (eval->Evaluate (currentRoot->condition))
         {
           nextRoot = currentRoot->trueNode;
         }
@@ -512,6 +513,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
 
   csXMLShader::~csXMLShader ()
   {
+    CancelWarmUpJobs ();
     for (size_t i = 0; i < techniques.GetSize(); i++)
     {
       techniques[i].Free();
@@ -1230,6 +1232,8 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
     }
     virtual csShaderVariable* GetVariable (CS::ShaderVarStringID name) const
     { return wrappedSVC.GetVariable (name); }
+    virtual csShaderVariable* GetVariableAdd (CS::ShaderVarStringID name)
+    { return wrappedSVC.GetVariableAdd (name); }
     virtual const csRefArray<csShaderVariable>& GetShaderVariables () const
     { return wrappedSVC.GetShaderVariables (); }  
     virtual void PushVariables (csShaderVariableStack& stacks) const
@@ -1283,125 +1287,127 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
     Technique& tech = techniques[techNum];
     if (lightCount < tech.minLights) return csArrayItemNotFound;
 
-    csRef<iHierarchicalCache> techCache;
     tech.resolver->SetCurrentEval (eval);
 
     size_t vi = tech.resolver->GetVariant ();
     if (vi != csArrayItemNotFound)
     {
-      csXMLShaderTech*& var = tech.variants.GetExtend (vi);
-      tech.variantsPrepared.SetSize (csMax (tech.variantsPrepared.GetSize(),
-	vi+1));
-      size_t ticket = ComputeTicket (techNum, vi);
-
-      csRef<iHierarchicalCache> varCache;
-      if (!tech.variantsPrepared[vi])
+      csXMLShaderTech* var = PrepareTechVariant (techNum, vi, 0);
+      if (var != 0)
       {
-	if (!techCache.IsValid() && shaderCache.IsValid())
-	{
-	  techCache = shaderCache->GetRootedCache (
-	    csString().Format ("/%s/%zu", cacheScope_tech.GetData(), techNum));
-	}
-
-	if (techCache.IsValid())
-	{
-	  varCache.AttachNew (
-	    new CS::PluginCommon::ShaderCacheHelper::MicroArchiveCache (
-	    techCache, csString().Format ("/%zu", vi)));
-	}
+	tech.resolver->SetCurrentEval (0);
+	return ComputeTicket (techNum, vi);
+      }
+    }
+    tech.resolver->SetCurrentEval (0);
+    
+    return csArrayItemNotFound;
+  }
+  
+  csXMLShaderTech* csXMLShader::PrepareTechVariant (size_t techNum,
+    size_t vi, iHierarchicalCache* varCache)
+  {
+    Technique& tech = techniques[techNum];
+    csXMLShaderTech*& var = tech.variants.GetExtend (vi);
+    tech.variantsPrepared.SetSize (csMax (tech.variantsPrepared.GetSize(),
+      vi+1));
+    if (tech.variantsPrepared[vi]) return var;
+    size_t ticket = ComputeTicket (techNum, vi);
+
+    csRef<iHierarchicalCache> ownVarCache;
+    if ((varCache == 0) && shaderCache.IsValid())
+    {
+      csRef<iHierarchicalCache> techCache = shaderCache->GetRootedCache (
+	csString().Format ("/%s/%zu", cacheScope_tech.GetData(), techNum));
+      ownVarCache.AttachNew (
+	new CS::PluginCommon::ShaderCacheHelper::MicroArchiveCache (
+	techCache, csString().Format ("/%zu", vi)));
+      varCache = ownVarCache;
+    }
 
-	if (compiler->doDumpXML)
-	{
-	  csRef<iDocumentSystem> docsys;
-	  docsys.AttachNew (new csTinyDocumentSystem);
-	  csRef<iDocument> newdoc = docsys->CreateDocument();
-	  CS::DocSystem::CloneNode (tech.techNode, newdoc->CreateRoot());
-	  newdoc->Write (compiler->vfs, csString().Format ("/tmp/shader/%s_%zu_%zu.xml",
-	    GetName(), techNum, vi));
-	}
+    if (compiler->doDumpXML)
+    {
+      csRef<iDocumentSystem> docsys;
+      docsys.AttachNew (new csTinyDocumentSystem);
+      csRef<iDocument> newdoc = docsys->CreateDocument();
+      CS::DocSystem::CloneNode (tech.techNode, newdoc->CreateRoot());
+      newdoc->Write (compiler->vfs, csString().Format ("/tmp/shader/%s_%zu_%zu.xml",
+	GetName(), techNum, vi));
+    }
 
-	iShaderProgram::CacheLoadResult loadResult = iShaderProgram::loadFail;
-	var = 0;
-	if (techCache.IsValid())
+    iShaderProgram::CacheLoadResult loadResult = iShaderProgram::loadFail;
+    var = 0;
+    if (varCache != 0)
+    {
+      var = new csXMLShaderTech (this);
+      loadResult = var->LoadFromCache (ldr_context, tech.techNode,
+	varCache, shaderRootStripped, ticket);
+      if (compiler->do_verbose)
+      {
+	switch (loadResult)
 	{
-	  var = new csXMLShaderTech (this);
-	  loadResult = var->LoadFromCache (ldr_context, tech.techNode,
-	    varCache, shaderRootStripped, ticket);
-	  if (compiler->do_verbose)
+	case iShaderProgram::loadFail:
 	  {
-	    switch (loadResult)
-	    {
-	    case iShaderProgram::loadFail:
-	      {
-		compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
-		  "Shader '%s': Technique with priority %d<%zu> fails (from cache). Reason: %s.",
-		  GetName(), tech.priority, vi, var->GetFailReason());
-	      }
-	      break;
-	    case iShaderProgram::loadSuccessShaderInvalid:
-	      {
-		compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
-		  "Shader '%s': Technique with priority %d<%zu> succeeds (from cache) but shader is invalid.",
-		  GetName(), tech.priority, vi);
-	      }
-	      break;
-	    case iShaderProgram::loadSuccessShaderValid:
-	      {
-		compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
-		  "Shader '%s': Technique with priority %d<%zu> succeeds (from cache).",
-		  GetName(), tech.priority, vi);
-	      }
-	      break;
-	    }
+	    compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
+	      "Shader '%s': Technique with priority %d<%zu> fails (from cache). Reason: %s.",
+	      GetName(), tech.priority, vi, var->GetFailReason());
 	  }
-	  if (loadResult != iShaderProgram::loadSuccessShaderValid)
-	  {
-	    delete var; var = 0;
-	  }
-	}
-
-	if ((var == 0)
-	  && (loadResult == iShaderProgram::loadFail))
-	{
-	  // So external files are found correctly
-	  csVfsDirectoryChanger dirChange (compiler->vfs);
-	  dirChange.ChangeTo (vfsStartDir);
-
-	  var = new csXMLShaderTech (this);
-	  bool loadResult = var->Load (ldr_context, tech.techNode, shaderRootStripped, ticket,
-	    varCache);
-	  if (loadResult)
+	  break;
+	case iShaderProgram::loadSuccessShaderInvalid:
 	  {
-	    if (compiler->do_verbose)
-	      compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
-	      "Shader '%s': Technique with priority %d<%zu> succeeds!",
+	    compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
+	      "Shader '%s': Technique with priority %d<%zu> succeeds (from cache) but shader is invalid.",
 	      GetName(), tech.priority, vi);
 	  }
-	  else
+	  break;
+	case iShaderProgram::loadSuccessShaderValid:
 	  {
-	    if (compiler->do_verbose)
-	    {
-	      compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
-		"Shader '%s': Technique with priority %d<%zu> fails. Reason: %s.",
-		GetName(), tech.priority, vi, var->GetFailReason());
-	    }
-	    delete var; var = 0;
+	    compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
+	      "Shader '%s': Technique with priority %d<%zu> succeeds (from cache).",
+	      GetName(), tech.priority, vi);
 	  }
+	  break;
 	}
+      }
+      if (loadResult != iShaderProgram::loadSuccessShaderValid)
+      {
+	delete var; var = 0;
+      }
+    }
 
-	tech.variantsPrepared[vi] = true;
+    if ((var == 0)
+      && (loadResult == iShaderProgram::loadFail))
+    {
+      // So external files are found correctly
+      csVfsDirectoryChanger dirChange (compiler->vfs);
+      dirChange.ChangeTo (vfsStartDir);
+
+      var = new csXMLShaderTech (this);
+      bool loadResult = var->Load (ldr_context, tech.techNode, shaderRootStripped, ticket,
+	varCache);
+      if (loadResult)
+      {
+	if (compiler->do_verbose)
+	  compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
+	  "Shader '%s': Technique with priority %d<%zu> succeeds!",
+	  GetName(), tech.priority, vi);
       }
-      if (var != 0)
+      else
       {
-	tech.resolver->SetCurrentEval (0);
-	return ticket;
+	if (compiler->do_verbose)
+	{
+	  compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
+	    "Shader '%s': Technique with priority %d<%zu> fails. Reason: %s.",
+	    GetName(), tech.priority, vi, var->GetFailReason());
+	}
+	delete var; var = 0;
       }
     }
-    tech.resolver->SetCurrentEval (0);
-    
-    return csArrayItemNotFound;
+
+    tech.variantsPrepared[vi] = true;
+    return var;
   }
-  
+
   size_t csXMLShader::GetTicketForTechVar (const csRenderMeshModes& modes, 
     const csShaderVariableStack& stack, csConditionEvaluator::TicketEvaluator* eval,
     int lightCount, size_t tvi)
@@ -1514,6 +1520,240 @@ CS_PLUGIN_NAMESPACE_BEGIN(XMLShader)
       lightCount);
   }
 
+  bool csXMLShader::TryGetTicketForTech (
+    csConditionEvaluator::TicketEvaluator* eval,
+    int lightCount, size_t techNum, size_t& ticket) const
+  {
+    ticket = csArrayItemNotFound;
+    const Technique& tech = techniques[techNum];
+    if (lightCount < tech.minLights) return true;
+
+    size_t vi = tech.resolver->GetVariant (eval);
+    if (vi == csArrayItemNotFound) return true;
+    // Setting up the variant is left to GetTicket()
+    if ((vi >= tech.variantsPrepared.GetSize())
+	|| !tech.variantsPrepared.IsBitSet (vi))
+      return false;
+    if (tech.variants[vi] != 0) ticket = ComputeTicket (techNum, vi);
+    return true;
+  }
+
+  bool csXMLShader::TryGetTicketForTech (const csRenderMeshModes& modes, 
+    const csShaderVariableStack& stack, size_t techNum, size_t& ticket)
+  {
+    csRef<csConditionEvaluator::TicketEvaluator> eval (
+      sharedEvaluator->BeginTicketEvaluationCaching (modes, &stack));
+    
+    int lightCount = 0;
+    if (stack.GetSize() > compiler->stringLightCount)
+    {
+      csShaderVariable* svLightCount = stack[compiler->stringLightCount];
+      if (svLightCount != 0)
+        svLightCount->GetValue (lightCount);
+    }
+
+    return TryGetTicketForTech (eval, lightCount, techNum, ticket);
+  }
+
+  bool csXMLShader::TryGetTicket (const csRenderMeshModes& modes, 
+    const csShaderVariableStack& stack, size_t& ticket)
+  {
+    csRef<csConditionEvaluator::TicketEvaluator> eval (
+      sharedEvaluator->BeginTicketEvaluationCaching (modes, &stack));
+
+    int lightCount = 0;
+    if (stack.GetSize() > compiler->stringLightCount)
+    {
+      csShaderVariable* svLightCount = stack[compiler->stringLightCount];
+      if (svLightCount != 0)
+        svLightCount->GetValue (lightCount);
+    }
+
+    ticket = csArrayItemNotFound;
+    size_t tvi = techsResolver->GetVariant (eval);
+    if (tvi == csArrayItemNotFound) return true;
+    if (tvi >= techVariants.GetSize()) return false;
+
+    const ShaderTechVariant& techVar = techVariants[tvi];
+    for (size_t t = 0; t < techniques.GetSize(); t++)
+    {
+      if (!techVar.activeTechniques.IsBitSet (t)) continue;
+      if (!TryGetTicketForTech (eval, lightCount, t, ticket)) return false;
+      if (ticket != csArrayItemNotFound) return true;
+    }
+    /* No technique validated: the fallback shader is needed, which might
+       not be loaded yet */
+    return false;
+  }
+
+  /**
+   * Reads the cache of a technique variant, so preparing it later only
+   * needs to set up the programs.
+   */
+  class csXMLShader::WarmUpJob : public scfImplementation1<WarmUpJob, iJob>
+  {
+    csRef<iHierarchicalCache> techCache;
+    size_t variant;
+  public:
+    csRef<iHierarchicalCache> varCache;
+
+    WarmUpJob (iHierarchicalCache* techCache, size_t variant) :
+      scfImplementationType (this), techCache (techCache), variant (variant)
+    {}
+
+    void Run ()
+    {
+      varCache.AttachNew (
+	new CS::PluginCommon::ShaderCacheHelper::MicroArchiveCache (
+	techCache, csString().Format ("/%zu", variant)));
+    }
+  };
+
+  void csXMLShader::QueueWarmUp (const CS::Graphics::RenderMeshModes& modes,
+    const csShaderVariableStack& stack, int maxLights)
+  {
+    csShaderVariableStack warmUpStack (stack);
+    warmUpStack.MakeOwnArray ();
+
+    for (int lightCount = 0; lightCount <= maxLights; lightCount++)
+    {
+      if (warmUpStack.GetSize() > compiler->stringLightCount)
+	warmUpStack[compiler->stringLightCount] =
+	  compiler->GetWarmUpLightCount (lightCount);
+
+      csRef<csConditionEvaluator::TicketEvaluator> eval (
+	sharedEvaluator->BeginTicketEvaluationCaching (modes, &warmUpStack));
+
+      techsResolver->SetCurrentEval (eval);
+      size_t tvi = techsResolver->GetVariant ();
+      techsResolver->SetCurrentEval (0);
+      if ((tvi == csArrayItemNotFound) || (tvi >= techVariants.GetSize()))
+	continue;
+
+      // Same technique order as in GetTicketForTechVar()
+      const ShaderTechVariant& techVar = techVariants[tvi];
+      csArray<WarmUpCandidate> candidates;
+      for (size_t t = 0; t < techniques.GetSize(); t++)
+      {
+	if (!techVar.activeTechniques.IsBitSet (t)) continue;
+	Technique& tech = techniques[t];
+	if (lightCount < tech.minLights) continue;
+
+	tech.resolver->SetCurrentEval (eval);
+	size_t vi = tech.resolver->GetVariant ();
+	tech.resolver->SetCurrentEval (0);
+	if (vi == csArrayItemNotFound) continue;
+
+	WarmUpCandidate candidate;
+	candidate.tech = t;
+	candidate.variant = vi;
+	candidates.Push (candidate);
+      }
+      if (candidates.GetSize() == 0) continue;
+
+      size_t ticket = ComputeTicket (candidates[0].tech,
+	candidates[0].variant);
+      if (warmUpTickets.Contains (ticket)) continue;
+      warmUpTickets.AddNoTest (ticket);
+      warmUpQueue.Push (candidates);
+    }
+  }
+
+  void csXMLShader::StartWarmUp (iJobQueue* jobQueue)
+  {
+    if (!shaderCache.IsValid()) return;
+    warmUpJobQueue = jobQueue;
+
+    csRefArray<iHierarchicalCache> techCaches;
+    for (size_t i = 0; i < warmUpQueue.GetSize(); i++)
+    {
+      const csArray<WarmUpCandidate>& candidates = warmUpQueue[i];
+      for (size_t c = 0; c < candidates.GetSize(); c++)
+      {
+	const WarmUpCandidate& candidate = candidates[c];
+	const Technique& tech = techniques[candidate.tech];
+	if ((candidate.variant < tech.variantsPrepared.GetSize())
+	    && tech.variantsPrepared[candidate.variant])
+	  continue;
+	size_t ticket = ComputeTicket (candidate.tech, candidate.variant);
+	if (warmUpJobs.Contains (ticket)) continue;
+
+	if (techCaches.GetSize() <= candidate.tech)
+	  techCaches.SetSize (candidate.tech+1);
+	if (!techCaches[candidate.tech])
+	{
+	  csRef<iHierarchicalCache> techCache = shaderCache->GetRootedCache (
+	    csString().Format ("/%s/%zu", cacheScope_tech.GetData(),
+	      candidate.tech));
+	  techCaches.Put (candidate.tech, techCache);
+	}
+
+	csRef<WarmUpJob> job;
+	job.AttachNew (new WarmUpJob (techCaches[candidate.tech],
+	  candidate.variant));
+	warmUpJobs.Put (ticket, job);
+	jobQueue->Enqueue (job);
+      }
+    }
+  }
+
+  void csXMLShader::FinishWarmUp ()
+  {
+    size_t numPrepared = 0;
+    for (size_t i = 0; i < warmUpQueue.GetSize(); i++)
+    {
+      const csArray<WarmUpCandidate>& candidates = warmUpQueue[i];
+      for (size_t c = 0; c < candidates.GetSize(); c++)
+      {
+	const WarmUpCandidate& candidate = candidates[c];
+	Technique& tech = techniques[candidate.tech];
+	size_t ticket = ComputeTicket (candidate.tech, candidate.variant);
+
+	csRef<iHierarchicalCache> varCache;
+	WarmUpJob* job = warmUpJobs.Get (ticket, (WarmUpJob*)0);
+	if (job != 0)
+	{
+	  // Reads the cache right here if no worker got to it yet
+	  warmUpJobQueue->PullAndRun (job);
+	  varCache = job->varCache;
+	}
+
+	bool wasPrepared = (candidate.variant < tech.variantsPrepared.GetSize())
+	  && tech.variantsPrepared[candidate.variant];
+	tech.resolver->SetVariantEval (candidate.variant);
+	csXMLShaderTech* var = PrepareTechVariant (candidate.tech,
+	  candidate.variant, varCache);
+	tech.resolver->SetCurrentEval (0);
+	if (!wasPrepared) numPrepared++;
+	if (var != 0) break;
+      }
+    }
+
+    if (compiler->do_verbose && (numPrepared > 0))
+      compiler->Report (CS_REPORTER_SEVERITY_NOTIFY,
+	"Shader '%s': warmed up %zu technique variants",
+	GetName(), numPrepared);
+
+    warmUpQueue.DeleteAll ();
+    warmUpTickets.DeleteAll ();
+    // Jobs for lower priority techniques are not needed if a higher one
+    // validated
+    CancelWarmUpJobs ();
+  }
+
+  void csXMLShader::CancelWarmUpJobs ()
+  {
+    if (warmUpJobQueue.IsValid())
+    {
+      csHash<csRef<WarmUpJob>, size_t>::GlobalIterator it (
+	warmUpJobs.GetIterator ());
+      while (it.HasNext ())
+	warmUpJobQueue->Dequeue (it.Next ());
+    }
+    warmUpJobs.DeleteAll ();
+    warmUpJobQueue.Invalidate ();
+  }
+
   void csXMLShader::PrepareTechVars (iDocumentNode* shaderRoot,
 				     const csArray<TechniqueKeeper>& allTechniques,
 				     int forcepriority)
@@ -20,6 +20,7 @@
 #ifndef __CS_SHADER_H__
 #define __CS_SHADER_H__
 
+#include "iutil/job.h"
 #include "iutil/selfdestruct.h"
 #include "ivideo/graph3d.h"
 #include "ivideo/shader/shader.h"
@@ -29,6 +30,7 @@
 #include "csutil/bitarray.h"
 #include "csutil/csobject.h"
 #include "csutil/dirtyaccessarray.h"
+#include "csutil/set.h"
 
 #include "cpi/condition.h"
 #include "cpi/docwrap.h"
@@ -140,7 +142,13 @@ public:
     const MyBitArrayTemp& conditionResultsSet);
   virtual void FinishAdding ();
 
-  size_t GetVariant ();
+  size_t GetVariant ()
+  { return GetVariant (currentEval); }
+  /**
+   * Determine the variant with the given evaluator instead of the current
+   * one. Does not change the resolver and can be called concurrently.
+   */
+  size_t GetVariant (csConditionEvaluator::TicketEvaluator* eval) const;
   size_t GetVariantCount () const
   { return nextVariant; }
   void SetVariantEval (size_t variant);
@@ -164,12 +172,13 @@ public:
 
 class ForcedPriorityShader;
 
-class csXMLShader : public scfImplementationExt4<csXMLShader,
+class csXMLShader : public scfImplementationExt5<csXMLShader,
 						 csObject,
 						 iShader,
 						 iSelfDestruct,
 						 iXMLShader,
-						 iXMLShaderInternal>
+						 iXMLShaderInternal,
+						 iShaderWarmUp>
 {
   friend class csShaderConditionResolver;
   friend class ForcedPriorityShader;
@@ -312,6 +321,31 @@ class csXMLShader : public scfImplementationExt4<csXMLShader,
     return nextTicket + allTechVariantCount;
   }
 
+  /// Set up a technique variant if that didn't happen yet
+  csXMLShaderTech* PrepareTechVariant (size_t techNum, size_t vi,
+    iHierarchicalCache* varCache);
+
+  class WarmUpJob;
+  /// A technique variant to warm up
+  struct WarmUpCandidate
+  {
+    size_t tech;
+    size_t variant;
+  };
+  /**
+   * Technique variants queued for warm-up. Each entry holds the variants
+   * of the techniques which may be used in one situation, in order of
+   * priority; the first one that validates is used.
+   */
+  csArray<csArray<WarmUpCandidate> > warmUpQueue;
+  /// Tickets of the first candidates of warmUpQueue entries
+  csSet<size_t> warmUpTickets;
+  /// Jobs reading variant caches, by ticket
+  csHash<csRef<WarmUpJob>, size_t> warmUpJobs;
+  csRef<iJobQueue> warmUpJobQueue;
+  /// Remove the warm-up jobs that did not run yet from the job queue
+  void CancelWarmUpJobs ();
+
   csShaderVariableContext globalSVContext;
   void ParseGlobalSVs (iLoaderContext* ldr_context, iDocumentNode* node);
 
@@ -382,6 +416,17 @@ public:
   virtual size_t GetTicket (const CS::Graphics::RenderMeshModes& modes,
       const csShaderVariableStack& stack);
 
+  /**
+   * Get the ticket for a technique if its variant was set up already.
+   * Only reads the shader, so it can be called concurrently.
+   */
+  bool TryGetTicketForTech (csConditionEvaluator::TicketEvaluator* eval,
+    int lightCount, size_t techNum, size_t& ticket) const;
+  bool TryGetTicketForTech (const csRenderMeshModes& modes, 
+    const csShaderVariableStack& stack, size_t techNum, size_t& ticket);
+  virtual bool TryGetTicket (const CS::Graphics::RenderMeshModes& modes,
+      const csShaderVariableStack& stack, size_t& ticket);
+
   /// Get number of passes this shader have
   virtual size_t GetNumberOfPasses (size_t ticket)
   {
@@ -497,6 +542,14 @@ public:
     return GetUsedSVContext().GetVariable (name); 
   }
 
+  /// Get a named variable from this context, add it if it doesn't exist
+  csShaderVariable* GetVariableAdd (CS::ShaderVarStringID name)
+  { 
+    if (useFallbackContext)
+      return fallbackShader->GetVariableAdd (name);
+    return GetUsedSVContext().GetVariableAdd (name); 
+  }
+
   /// Get Array of all ShaderVariables
   const csRefArray<csShaderVariable>& GetShaderVariables () const
   { 
@@ -579,6 +632,14 @@ public:
     const csShaderVariableStack& stack, void* eval, int lightCount);
   /** @} */
 
+  /**\name iShaderWarmUp implementation
+   * @{ */
+  virtual void QueueWarmUp (const CS::Graphics::RenderMeshModes& modes,
+    const csShaderVariableStack& stack, int maxLights);
+  virtual void StartWarmUp (iJobQueue* jobQueue);
+  virtual void FinishWarmUp ();
+  /** @} */
+
   /// Set object description
   void SetDescription (const char *desc)
   {
@@ -220,6 +220,18 @@ bool csXMLShaderCompiler::PrecacheShader(iDocumentNode* templ,
   return result;
 }
 
+csShaderVariable* csXMLShaderCompiler::GetWarmUpLightCount (int lightCount)
+{
+  while (warmUpLightCounts.GetSize() <= (size_t)lightCount)
+  {
+    csRef<csShaderVariable> sv;
+    sv.AttachNew (new csShaderVariable (stringLightCount));
+    sv->SetValue ((int)warmUpLightCounts.GetSize());
+    warmUpLightCounts.Push (sv);
+  }
+  return warmUpLightCounts[lightCount];
+}
+
 csPtr<iShaderPriorityList> csXMLShaderCompiler::GetPriorities (
 	iDocumentNode* templ)
 {
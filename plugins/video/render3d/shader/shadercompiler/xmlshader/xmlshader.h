@@ -23,6 +23,7 @@
 #include "iutil/comp.h"
 #include "ivideo/shader/shader.h"
 
+#include "csutil/refarr.h"
 #include "csutil/weakref.h"
 #include "csutil/scf_implementation.h"
 
@@ -110,6 +111,12 @@ public:
   
   CS::ShaderVarStringID string_mixmode_alpha;
   CS::ShaderVarStringID stringLightCount;
+  /**
+   * Light count variables for shader warm-up, by value. Kept around as the
+   * condition evaluator caches results per variable instance.
+   */
+  csRefArray<csShaderVariable> warmUpLightCounts;
+  csShaderVariable* GetWarmUpLightCount (int lightCount);
 
 #define CS_TOKEN_ITEM_FILE \
   "plugins/video/render3d/shader/shadercompiler/xmlshader/xmlshader.tok"
@@ -58,6 +58,9 @@ public:
 
   virtual size_t GetTicket (const CS::Graphics::RenderMeshModes&, 
     const csShaderVariableStack&) { return 0; }
+  virtual bool TryGetTicket (const CS::Graphics::RenderMeshModes&, 
+    const csShaderVariableStack&, size_t& ticket)
+  { ticket = 0; return true; }
   virtual size_t GetPrioritiesTicket (const CS::Graphics::RenderMeshModes& modes,
     const csShaderVariableStack& stack)
   { return csArrayItemNotFound; }